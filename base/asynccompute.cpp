@@ -0,0 +1,324 @@
+/*
+* Overlap of compute simulation steps with graphics frames
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "asynccompute.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+namespace vkx {
+
+std::set<std::string> AsyncCompute::getDeviceExtensions(const vk::PhysicalDevice& physicalDevice) {
+    std::set<std::string> result;
+    if (vks::Context::isDeviceExtensionPresent(physicalDevice, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME)) {
+        result.insert(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+    }
+    return result;
+}
+
+bool AsyncCompute::enableFeatures(vks::Context& deviceContext) {
+    assert(&deviceContext == &context);
+    if (getDeviceExtensions(context.physicalDevice).empty()) {
+        return false;
+    }
+    const auto supported = context.physicalDevice
+                               .getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR>(context.dynamicDispatch)
+                               .get<vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR>();
+    if (!supported.timelineSemaphore) {
+        return false;
+    }
+
+    features = vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR{};
+    features.timelineSemaphore = VK_TRUE;
+    features.pNext = deviceContext.enabledFeatures2.pNext;
+    deviceContext.enabledFeatures2.pNext = &features;
+    return true;
+}
+
+vk::BufferMemoryBarrier AsyncCompute::slotBarrier(uint32_t slot, vk::AccessFlags srcAccess, vk::AccessFlags dstAccess, bool toGraphics) const {
+    vk::BufferMemoryBarrier barrier;
+    barrier.srcAccessMask = srcAccess;
+    barrier.dstAccessMask = dstAccess;
+    barrier.srcQueueFamilyIndex = toGraphics ? context.queueIndices.compute : context.queueIndices.graphics;
+    barrier.dstQueueFamilyIndex = toGraphics ? context.queueIndices.graphics : context.queueIndices.compute;
+    barrier.buffer = slots[slot].buffer;
+    barrier.offset = 0;
+    barrier.size = VK_WHOLE_SIZE;
+    return barrier;
+}
+
+void AsyncCompute::create(const vks::Buffer& source, vk::DeviceSize size, vk::BufferUsageFlags targetUsage) {
+    assert(!created);
+    sourceBuffer = source.buffer;
+    this->size = size;
+    for (auto& slot : slots) {
+        slot = context.createDeviceBuffer(vk::BufferUsageFlagBits::eTransferSrc | vk::BufferUsageFlagBits::eTransferDst, size);
+    }
+    targetBuffer = context.createDeviceBuffer(targetUsage | vk::BufferUsageFlagBits::eTransferDst, size);
+
+    graphicsPool = device.createCommandPool({ vk::CommandPoolCreateFlagBits::eResetCommandBuffer, context.queueIndices.graphics });
+    auto stepBuffers = device.allocateCommandBuffers({ compute.commandPool, vk::CommandBufferLevel::ePrimary, RING_SIZE });
+    auto graphicsBuffers = device.allocateCommandBuffers({ graphicsPool, vk::CommandBufferLevel::ePrimary, 2 * RING_SIZE });
+    std::copy(stepBuffers.begin(), stepBuffers.end(), stepCommandBuffers.begin());
+    std::copy(graphicsBuffers.begin(), graphicsBuffers.begin() + RING_SIZE, beginCommandBuffers.begin());
+    std::copy(graphicsBuffers.begin() + RING_SIZE, graphicsBuffers.end(), endCommandBuffers.begin());
+
+    vk::SemaphoreTypeCreateInfoKHR timelineInfo{ vk::SemaphoreTypeKHR::eTimeline, 0 };
+    vk::SemaphoreCreateInfo semaphoreInfo;
+    semaphoreInfo.pNext = &timelineInfo;
+    computeTimeline = device.createSemaphore(semaphoreInfo);
+    graphicsTimeline = device.createSemaphore(semaphoreInfo);
+    step = 0;
+    frame = 0;
+
+    if (context.queueFamilyProperties[context.queueIndices.compute].timestampValidBits != 0 &&
+        context.queueFamilyProperties[context.queueIndices.graphics].timestampValidBits != 0) {
+        computeQueries = device.createQueryPool({ {}, vk::QueryType::eTimestamp, 2 * RING_SIZE });
+        graphicsQueries = device.createQueryPool({ {}, vk::QueryType::eTimestamp, 2 * RING_SIZE });
+    }
+    resetStatistics();
+
+    // Copy the slot of the frame into the target buffer
+    const vk::PipelineStageFlags drawStages = vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eVertexShader;
+    for (uint32_t i = 0; i < RING_SIZE; ++i) {
+        const uint32_t slot = i % SLOT_COUNT;
+        const auto& commandBuffer = beginCommandBuffers[i];
+        commandBuffer.begin({ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
+        if (graphicsQueries) {
+            commandBuffer.resetQueryPool(graphicsQueries, 2 * i, 2);
+            commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, graphicsQueries, 2 * i);
+        }
+        // Previous frames still draw from the target buffer
+        std::vector<vk::BufferMemoryBarrier> acquire;
+        if (separateFamilies()) {
+            acquire.push_back(slotBarrier(slot, {}, vk::AccessFlagBits::eTransferRead, true));
+        }
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer | drawStages, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, acquire, nullptr);
+        commandBuffer.copyBuffer(slots[slot].buffer, targetBuffer.buffer, vk::BufferCopy{ 0, 0, size });
+
+        vk::BufferMemoryBarrier targetBarrier;
+        targetBarrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        targetBarrier.dstAccessMask = vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eShaderRead;
+        targetBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        targetBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        targetBarrier.buffer = targetBuffer.buffer;
+        targetBarrier.offset = 0;
+        targetBarrier.size = VK_WHOLE_SIZE;
+        std::vector<vk::BufferMemoryBarrier> release{ targetBarrier };
+        if (separateFamilies()) {
+            release.push_back(slotBarrier(slot, {}, {}, false));
+        }
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, drawStages, {}, nullptr, release, nullptr);
+        commandBuffer.end();
+
+        const auto& endCommandBuffer = endCommandBuffers[i];
+        endCommandBuffer.begin({ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
+        if (graphicsQueries) {
+            endCommandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, graphicsQueries, 2 * i + 1);
+        }
+        endCommandBuffer.end();
+    }
+
+    // The first step writing a slot acquires it like every later one, so the graphics queue has to release
+    // both slots once
+    if (separateFamilies()) {
+        vk::CommandBuffer releaseCmd = device.allocateCommandBuffers({ graphicsPool, vk::CommandBufferLevel::ePrimary, 1 })[0];
+        releaseCmd.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+        std::vector<vk::BufferMemoryBarrier> release;
+        for (uint32_t slot = 0; slot < SLOT_COUNT; ++slot) {
+            release.push_back(slotBarrier(slot, {}, {}, false));
+        }
+        releaseCmd.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr, release, nullptr);
+        releaseCmd.end();
+        vk::SubmitInfo submitInfo;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &releaseCmd;
+        context.queue.submit(submitInfo, {});
+        context.queue.waitIdle();
+        device.freeCommandBuffers(graphicsPool, releaseCmd);
+    }
+    created = true;
+}
+
+void AsyncCompute::destroy() {
+    if (!created) {
+        return;
+    }
+    device.freeCommandBuffers(compute.commandPool, stepCommandBuffers);
+    device.destroy(graphicsPool);
+    device.destroy(computeTimeline);
+    device.destroy(graphicsTimeline);
+    if (computeQueries) {
+        device.destroy(computeQueries);
+        device.destroy(graphicsQueries);
+        computeQueries = vk::QueryPool();
+        graphicsQueries = vk::QueryPool();
+    }
+    for (auto& slot : slots) {
+        slot.destroy();
+    }
+    targetBuffer.destroy();
+    created = false;
+}
+
+void AsyncCompute::record(const std::function<void(const vk::CommandBuffer& commandBuffer)>& stepCommands) {
+    for (uint32_t i = 0; i < RING_SIZE; ++i) {
+        const uint32_t slot = i % SLOT_COUNT;
+        const auto& commandBuffer = stepCommandBuffers[i];
+        commandBuffer.begin({ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
+        if (computeQueries) {
+            commandBuffer.resetQueryPool(computeQueries, 2 * i, 2);
+            commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, computeQueries, 2 * i);
+        }
+        // The copy of the previous step still reads the source
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer, {},
+                                      nullptr, nullptr, nullptr);
+        stepCommands(commandBuffer);
+
+        vk::BufferMemoryBarrier sourceBarrier;
+        sourceBarrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite;
+        sourceBarrier.dstAccessMask = vk::AccessFlagBits::eTransferRead;
+        sourceBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        sourceBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        sourceBarrier.buffer = sourceBuffer;
+        sourceBarrier.offset = 0;
+        sourceBarrier.size = VK_WHOLE_SIZE;
+        std::vector<vk::BufferMemoryBarrier> acquire{ sourceBarrier };
+        if (separateFamilies()) {
+            acquire.push_back(slotBarrier(slot, {}, vk::AccessFlagBits::eTransferWrite, false));
+        }
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eTransfer, {},
+                                      nullptr, acquire, nullptr);
+        commandBuffer.copyBuffer(sourceBuffer, slots[slot].buffer, vk::BufferCopy{ 0, 0, size });
+        if (separateFamilies()) {
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eBottomOfPipe, {}, nullptr,
+                                          slotBarrier(slot, vk::AccessFlagBits::eTransferWrite, {}, true), nullptr);
+        }
+        if (computeQueries) {
+            commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, computeQueries, 2 * i + 1);
+        }
+        commandBuffer.end();
+    }
+}
+
+void AsyncCompute::submitStep() {
+    ++step;
+    // The slot of this step is free once the frame two steps earlier has copied it.  The serialized mode
+    // waits for the previous frame instead.
+    const uint64_t distance = mode == Mode::overlapped ? 2 : 1;
+    const uint64_t waitValue = step > distance ? step - distance : 0;
+    const vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+
+    vk::TimelineSemaphoreSubmitInfoKHR timelineInfo;
+    timelineInfo.waitSemaphoreValueCount = waitValue ? 1 : 0;
+    timelineInfo.pWaitSemaphoreValues = &waitValue;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &step;
+
+    vk::SubmitInfo submitInfo;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = waitValue ? 1 : 0;
+    submitInfo.pWaitSemaphores = &graphicsTimeline;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &stepCommandBuffers[step % RING_SIZE];
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &computeTimeline;
+    compute.queue.submit(submitInfo, {});
+}
+
+void AsyncCompute::beginFrame() {
+    ++frame;
+    measure(frame);
+
+    const uint64_t lastStep = mode == Mode::overlapped ? frame + 1 : frame;
+    while (step < lastStep) {
+        submitStep();
+    }
+
+    const vk::PipelineStageFlags waitStage = vk::PipelineStageFlagBits::eAllCommands;
+    vk::TimelineSemaphoreSubmitInfoKHR timelineInfo;
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = &frame;
+
+    vk::SubmitInfo submitInfo;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &computeTimeline;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &beginCommandBuffers[frame % RING_SIZE];
+    context.queue.submit(submitInfo, {});
+}
+
+void AsyncCompute::endFrame() {
+    vk::TimelineSemaphoreSubmitInfoKHR timelineInfo;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &frame;
+
+    vk::SubmitInfo submitInfo;
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &endCommandBuffers[frame % RING_SIZE];
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &graphicsTimeline;
+    context.queue.submit(submitInfo, {});
+}
+
+// Compare the frame two frames back with the steps it depends on and the one submitted during it, if all
+// of them have completed.  The queries of these are not reused before the current frame is submitted.
+void AsyncCompute::measure(uint64_t current) {
+    if (!measurementAvailable() || current < 3) {
+        return;
+    }
+    const uint64_t measured = current - 2;
+    if (device.getSemaphoreCounterValueKHR(graphicsTimeline, context.dynamicDispatch) < measured ||
+        device.getSemaphoreCounterValueKHR(computeTimeline, context.dynamicDispatch) < measured + 1) {
+        return;
+    }
+
+    auto read = [&](vk::QueryPool pool, uint64_t index, uint64_t& begin, uint64_t& end) {
+        std::array<uint64_t, 2> timestamps;
+        auto result = device.getQueryPoolResults(pool, static_cast<uint32_t>(2 * (index % RING_SIZE)), 2, vk::ArrayProxy<uint64_t>{ timestamps },
+                                                 sizeof(uint64_t), vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+        begin = timestamps[0];
+        end = timestamps[1];
+        return result == vk::Result::eSuccess;
+    };
+    uint64_t frameBegin, frameEnd;
+    std::array<uint64_t, 2> stepBegin, stepEnd;
+    if (!read(graphicsQueries, measured, frameBegin, frameEnd) || !read(computeQueries, measured, stepBegin[0], stepEnd[0]) ||
+        !read(computeQueries, measured + 1, stepBegin[1], stepEnd[1])) {
+        return;
+    }
+
+    const double period = context.deviceProperties.limits.timestampPeriod / 1e6;
+    uint64_t shared = 0;
+    for (size_t i = 0; i < stepBegin.size(); ++i) {
+        const uint64_t begin = std::max(frameBegin, stepBegin[i]);
+        const uint64_t end = std::min(frameEnd, stepEnd[i]);
+        shared += end > begin ? end - begin : 0;
+    }
+    ++totals.frames;
+    totals.computeMilliseconds += static_cast<float>((stepEnd[1] - stepBegin[1]) * period);
+    totals.graphicsMilliseconds += static_cast<float>((frameEnd - frameBegin) * period);
+    totals.overlapMilliseconds += static_cast<float>(shared * period);
+}
+
+AsyncCompute::Statistics AsyncCompute::statistics() const {
+    Statistics result;
+    if (totals.frames == 0) {
+        return result;
+    }
+    const float scale = 1.0f / static_cast<float>(totals.frames);
+    result.frames = totals.frames;
+    result.computeMilliseconds = totals.computeMilliseconds * scale;
+    result.graphicsMilliseconds = totals.graphicsMilliseconds * scale;
+    result.overlapMilliseconds = totals.overlapMilliseconds * scale;
+    return result;
+}
+
+}  // namespace vkx
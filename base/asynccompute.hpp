@@ -0,0 +1,137 @@
+/*
+* Overlap of compute simulation steps with graphics frames
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <functional>
+#include <set>
+#include <string>
+
+#include "compute.hpp"
+
+namespace vkx {
+
+/**
+* @brief Runs the simulation step of frame N + 1 on the compute queue while the graphics queue draws frame N
+*
+* vkx::Compute::submit() waits for the previous frame and the next frame waits for the step, so both queues
+* take turns even if they belong to different families.  This scheduler decouples them:
+*
+* - The simulation keeps its state in a buffer only the compute queue uses.  At the end of every step the
+*   result is copied into one of two slots, alternating between steps.
+* - At the start of a frame the graphics queue copies the slot of that frame into the buffer it draws.
+* - Two timeline semaphores order the queues.  Step N signals N on the compute timeline, and frame N waits
+*   for it.  Frame N signals N on the graphics timeline, and step N + 2 waits for it before the slot is
+*   written again.
+* - If the queues belong to different families, ownership of the slots is released and acquired around
+*   every copy, so the buffers can keep exclusive sharing mode.
+*
+* In the overlapped mode the scheduler keeps the compute queue one step ahead.  The serialized mode
+* submits each step right before its frame and makes it wait for the previous frame, which is the
+* behavior of vkx::Compute::submit() and serves as the baseline of the measurement.
+*
+* Usage: return getDeviceExtensions() from the context's device extensions picker, call enableFeatures()
+* from ExampleBase::getEnabledFeatures(), then create() once the buffers exist.  Wrap ExampleBase::draw()
+* in beginFrame() and endFrame() and draw from target().
+*/
+class AsyncCompute {
+public:
+    enum class Mode
+    {
+        serialized,  // Step N runs after frame N - 1, frame N after step N
+        overlapped,  // Step N + 1 runs during frame N
+    };
+
+    // Averages over the frames since the last resetStatistics()
+    struct Statistics {
+        uint32_t frames{ 0 };
+        float computeMilliseconds{ 0.0f };   // Duration of a simulation step, including the copy into its slot
+        float graphicsMilliseconds{ 0.0f };  // Duration of a frame on the graphics queue
+        float overlapMilliseconds{ 0.0f };   // Time a frame shares with simulation steps
+        // Share of the simulation hidden behind graphics work
+        float overlap() const { return computeMilliseconds > 0.0f ? overlapMilliseconds / computeMilliseconds : 0.0f; }
+    };
+
+    AsyncCompute(Compute& compute)
+        : compute(compute)
+        , context(compute.context) {}
+
+    AsyncCompute(const AsyncCompute&) = delete;
+    AsyncCompute& operator=(const AsyncCompute&) = delete;
+
+    // The device extensions needed by the scheduler, or an empty set if the device does not offer them
+    static std::set<std::string> getDeviceExtensions(const vk::PhysicalDevice& physicalDevice);
+
+    // Chain the timeline semaphore feature into the device creation.  Returns false, leaving the context
+    // untouched, if the device does not support it.  `deviceContext` is the (mutable) context of the compute
+    // resources the scheduler was constructed with.
+    bool enableFeatures(vks::Context& deviceContext);
+
+    // Create the slots, the buffer the graphics queue draws from and the synchronization objects.
+    // `source` receives the simulation state and needs transfer source usage.
+    void create(const vks::Buffer& source, vk::DeviceSize size, vk::BufferUsageFlags targetUsage = vk::BufferUsageFlagBits::eVertexBuffer);
+    void destroy();
+    explicit operator bool() const { return created; }
+
+    // Record the commands of one simulation step, which update `source`.  Called once for every command
+    // buffer of the scheduler, so record it again whenever the commands change.
+    void record(const std::function<void(const vk::CommandBuffer& commandBuffer)>& step);
+
+    // Submit the simulation steps the next frame depends on and the copy into the target buffer
+    void beginFrame();
+    // Mark the end of the frame, after ExampleBase::draw() submitted it
+    void endFrame();
+
+    const vks::Buffer& target() const { return targetBuffer; }
+
+    Mode mode{ Mode::overlapped };
+    // Timestamps of both queues, only available if both queue families support them.  Comparing them
+    // assumes the queues share a time domain, which holds for the queues of a device on desktop drivers.
+    bool measurementAvailable() const { return computeQueries && graphicsQueries; }
+    Statistics statistics() const;
+    void resetStatistics() { totals = Statistics{}; }
+
+private:
+    // Command buffers and queries are used round robin over more frames than there are slots, so the
+    // timestamps of a frame and the steps around it stay readable until the frame has completed
+    static const uint32_t RING_SIZE = 4;
+    static const uint32_t SLOT_COUNT = 2;
+
+    void submitStep();
+    void measure(uint64_t frame);
+    bool separateFamilies() const { return context.queueIndices.compute != context.queueIndices.graphics; }
+    vk::BufferMemoryBarrier slotBarrier(uint32_t slot, vk::AccessFlags srcAccess, vk::AccessFlags dstAccess, bool toGraphics) const;
+
+    Compute& compute;
+    const vks::Context& context;
+    const vk::Device& device{ context.device };
+    vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR features;
+    bool created{ false };
+
+    vk::Buffer sourceBuffer;
+    vk::DeviceSize size{ 0 };
+    std::array<vks::Buffer, SLOT_COUNT> slots;
+    vks::Buffer targetBuffer;
+
+    vk::CommandPool graphicsPool;
+    std::array<vk::CommandBuffer, RING_SIZE> stepCommandBuffers;
+    std::array<vk::CommandBuffer, RING_SIZE> beginCommandBuffers;
+    std::array<vk::CommandBuffer, RING_SIZE> endCommandBuffers;
+
+    vk::Semaphore computeTimeline;
+    vk::Semaphore graphicsTimeline;
+    // Last step and frame submitted, the first ones are 1
+    uint64_t step{ 0 };
+    uint64_t frame{ 0 };
+
+    // Two timestamps per step and frame
+    vk::QueryPool computeQueries;
+    vk::QueryPool graphicsQueries;
+    Statistics totals;
+};
+
+}  // namespace vkx
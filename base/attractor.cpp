@@ -0,0 +1,50 @@
+#include "attractor.hpp"
+
+using namespace vkx::attractor;
+
+static const size_t UPDATE_GRAIN = 16 * 1024;
+
+void Simulation::load(const Particle* particles, size_t count) {
+    for (auto* values : { &x, &y, &vx, &vy, &gradient }) {
+        values->resize(count);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        x[i] = particles[i].pos.x;
+        y[i] = particles[i].pos.y;
+        vx[i] = particles[i].vel.x;
+        vy[i] = particles[i].vel.y;
+        gradient[i] = particles[i].gradientPos.x;
+    }
+}
+
+void Simulation::store(Particle* particles) const {
+    for (size_t i = 0; i < size(); ++i) {
+        particles[i].pos = glm::vec2(x[i], y[i]);
+        particles[i].vel = glm::vec2(vx[i], vy[i]);
+        particles[i].gradientPos = glm::vec4(gradient[i], 0.0f, 0.0f, 0.0f);
+    }
+}
+
+void Simulation::step(const Parameters& params, ThreadPool& pool, simd::Backend backend) {
+    const simd::AttractorArrays particles{ x.data(), y.data(), vx.data(), vy.data(), gradient.data(), static_cast<uint32_t>(size()) };
+    const simd::AttractorConstants constants{ params.deltaT, params.destX, params.destY };
+    pool.parallelFor(size(), UPDATE_GRAIN, [&](size_t begin, size_t end) {
+        simd::attractorUpdate(backend, particles, constants, static_cast<uint32_t>(begin), static_cast<uint32_t>(end));
+    });
+}
+
+vkx::simd::Comparison Simulation::compare(const Particle* reference, const simd::Tolerance& tolerance) const {
+    simd::Comparison result;
+    for (size_t i = 0; i < size(); ++i) {
+        result.add(reference[i].pos.x, x[i], tolerance);
+        result.add(reference[i].pos.y, y[i], tolerance);
+        result.add(reference[i].vel.x, vx[i], tolerance);
+        result.add(reference[i].vel.y, vy[i], tolerance);
+        result.add(reference[i].gradientPos.x, gradient[i], tolerance);
+    }
+    return result;
+}
+
+void vkx::simd::attractorUpdate(Backend backend, const AttractorArrays& particles, const AttractorConstants& constants, uint32_t begin, uint32_t end) {
+    VKX_SIMD_DISPATCH(attractorUpdate(particles, constants, begin, end))
+}
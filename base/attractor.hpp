@@ -0,0 +1,55 @@
+/*
+* CPU implementation of the attractor particle system of the computeparticles example
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "attractor_kernels.hpp"
+#include "threadpool.hpp"
+
+namespace vkx { namespace attractor {
+
+// Same layout as the particle storage buffer of the computeparticles example
+struct Particle {
+    glm::vec2 pos;
+    glm::vec2 vel;
+    glm::vec4 gradientPos;  // x = gradient texture position
+};
+
+// Leading members of the uniform block of particle.comp
+struct Parameters {
+    float deltaT{ 0 };
+    float destX{ 0 };
+    float destY{ 0 };
+};
+
+/**
+* @brief Attractor particles stepped on the CPU
+*
+* Structure of arrays copy of the particles, updated like particle.comp.  Every particle only depends on
+* itself and the attractor, so the update is split into large chunks across the thread pool.
+*/
+class Simulation {
+public:
+    void load(const Particle* particles, size_t count);
+    void store(Particle* particles) const;
+    void step(const Parameters& params, ThreadPool& pool, simd::Backend backend);
+
+    size_t size() const { return x.size(); }
+    // Particle updates of one step
+    uint64_t interactionsPerStep() const { return size(); }
+
+    simd::Comparison compare(const Particle* reference, const simd::Tolerance& tolerance = { 32, 1e-6f }) const;
+
+private:
+    std::vector<float> x, y, vx, vy, gradient;
+};
+
+}}  // namespace vkx::attractor
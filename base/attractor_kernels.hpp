@@ -0,0 +1,34 @@
+/*
+* Attractor particle kernel of vkx::attractor::Simulation, see simd.hpp for the backends
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "simd.hpp"
+
+namespace vkx { namespace simd {
+
+// Attractor particles, see data/shaders/computeparticles/particle.comp
+struct AttractorArrays {
+    float* x;
+    float* y;
+    float* vx;
+    float* vy;
+    float* gradient;
+    uint32_t count;
+};
+
+struct AttractorConstants {
+    float deltaT;
+    float destX;
+    float destY;
+};
+
+void attractorUpdate(Backend backend, const AttractorArrays& particles, const AttractorConstants& constants, uint32_t begin, uint32_t end);
+
+// Backend implementations, see attractor_kernels.inl
+VKX_SIMD_DECLARE_KERNEL(void attractorUpdate(const AttractorArrays& particles, const AttractorConstants& constants, uint32_t begin, uint32_t end))
+
+}}  // namespace vkx::simd
@@ -0,0 +1,64 @@
+/*
+* Attractor particle kernel, mirroring computeparticles/particle.comp
+*
+* Included into the namespace of every backend after simd_kernels.inl
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+namespace kernels {
+
+template <typename P>
+inline void attractorUpdate(const AttractorArrays& particles, const AttractorConstants& constants, uint32_t i) {
+    const P destX = P::set(constants.destX);
+    const P destY = P::set(constants.destY);
+    const P deltaT = P::set(constants.deltaT);
+    const P one = P::set(1.0f);
+
+    P x = P::load(particles.x + i);
+    P y = P::load(particles.y + i);
+    P vx = P::load(particles.vx + i);
+    P vy = P::load(particles.vy + i);
+
+    // Repulsion from the destination
+    {
+        const P dx = destX - x;
+        const P dy = destY - y;
+        const P distance = P::sqrt(dx * dx + dy * dy);
+        const P scale = one / (distance * distance * distance);
+        vx = vx + dx * scale * P::set(-0.000035f) * P::set(0.05f);
+        vy = vy + dy * scale * P::set(-0.000035f) * P::set(0.05f);
+    }
+
+    // Move by velocity
+    const P newX = x + vx * deltaT;
+    const P newY = y + vy * deltaT;
+
+    // Collide with boundary, bouncing back towards the destination
+    const P minusOne = P::set(-1.0f);
+    const auto outside = P::maskOr(P::maskOr(P::less(newX, minusOne), P::greater(newX, one)), P::maskOr(P::less(newY, minusOne), P::greater(newY, one)));
+    {
+        const P dx = destX - newX;
+        const P dy = destY - newY;
+        const P invDist = one / P::sqrt(dx * dx + dy * dy + P::set(0.5f));
+        const P invDistCubed = invDist * invDist * invDist;
+        const P attractX = dx * invDistCubed * P::set(0.0035f);
+        const P attractY = dy * invDistCubed * P::set(0.0035f);
+        vx = P::select(outside, (P::set(0.0f) - vx) * P::set(0.1f) + attractX * P::set(12.0f), vx);
+        vy = P::select(outside, (P::set(0.0f) - vy) * P::set(0.1f) + attractY * P::set(12.0f), vy);
+    }
+    P::select(outside, x, newX).store(particles.x + i);
+    P::select(outside, y, newY).store(particles.y + i);
+    vx.store(particles.vx + i);
+    vy.store(particles.vy + i);
+
+    P gradient = P::load(particles.gradient + i) + P::set(0.02f) * deltaT;
+    gradient = P::select(P::greater(gradient, one), gradient - one, gradient);
+    gradient.store(particles.gradient + i);
+}
+
+}  // namespace kernels
+
+void attractorUpdate(const AttractorArrays& particles, const AttractorConstants& constants, uint32_t begin, uint32_t end) {
+    kernels::forRange(begin, end, [&](auto p, uint32_t i) { kernels::attractorUpdate<decltype(p)>(particles, constants, i); });
+}
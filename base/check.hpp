@@ -0,0 +1,60 @@
+/*
+* Boilerplate of the headless check examples, which need no GPU and report failures through their exit code
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+#include "common.hpp"
+
+#if defined(__ANDROID__)
+#define LOG(...) ((void)__android_log_print(ANDROID_LOG_INFO, "vulkanExample", __VA_ARGS__))
+#else
+#define LOG(...) printf(__VA_ARGS__)
+#endif
+
+namespace vkx {
+
+/**
+* @brief Error counting of a check.  Derived classes implement `uint32_t run()`, which ends with `return finish();`.
+*/
+class Check {
+public:
+    uint32_t errors{ 0 };
+
+protected:
+    // Failures after this many are only counted
+    static const uint32_t MAX_LOGGED_ERRORS = 16;
+
+    void error(const std::string& message) {
+        if (errors < MAX_LOGGED_ERRORS) {
+            LOG("%s\n", message.c_str());
+        }
+        ++errors;
+    }
+
+    uint32_t finish() const {
+        LOG("%u errors\n", errors);
+        return errors;
+    }
+};
+
+}  // namespace vkx
+
+// Like RUN_EXAMPLE, but the process fails if the check found errors.  Android has no exit code to report them.
+#if defined(__ANDROID__)
+#define RUN_CHECK(CheckType) \
+    ENTRY_POINT_START        \
+    CheckType().run();       \
+    ENTRY_POINT_END
+#else
+#define RUN_CHECK(CheckType)                   \
+    int main() {                               \
+        return CheckType().run() != 0 ? 1 : 0; \
+    }
+#endif
@@ -0,0 +1,104 @@
+#include "cloth.hpp"
+
+using namespace vkx::cloth;
+
+static const size_t ROW_GRAIN = 4;
+
+vkx::simd::ClothArrays Simulation::Grid::arrays() {
+    return { x.data(), y.data(), z.data(), vx.data(), vy.data(), vz.data(), nx.data(), ny.data(), nz.data(), pinned.data() };
+}
+
+void Simulation::load(const Particle* particles, const Parameters& params) {
+    width = static_cast<uint32_t>(params.particleCount.x);
+    height = static_cast<uint32_t>(params.particleCount.y);
+    const size_t count = size();
+    Grid& grid = grids[0];
+    for (auto* values : { &grid.x, &grid.y, &grid.z, &grid.vx, &grid.vy, &grid.vz, &grid.nx, &grid.ny, &grid.nz, &grid.pinned }) {
+        values->resize(count);
+    }
+    uvs.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        const Particle& particle = particles[i];
+        grid.x[i] = particle.pos.x;
+        grid.y[i] = particle.pos.y;
+        grid.z[i] = particle.pos.z;
+        grid.vx[i] = particle.vel.x;
+        grid.vy[i] = particle.vel.y;
+        grid.vz[i] = particle.vel.z;
+        grid.nx[i] = particle.normal.x;
+        grid.ny[i] = particle.normal.y;
+        grid.nz[i] = particle.normal.z;
+        grid.pinned[i] = particle.pinned;
+        uvs[i] = particle.uv;
+    }
+    grids[1] = grids[0];
+    current = 0;
+}
+
+void Simulation::store(Particle* particles) const {
+    const Grid& grid = grids[current];
+    for (size_t i = 0; i < size(); ++i) {
+        Particle& particle = particles[i];
+        particle.pos = glm::vec4(grid.x[i], grid.y[i], grid.z[i], 1.0f);
+        particle.vel = glm::vec4(grid.vx[i], grid.vy[i], grid.vz[i], 0.0f);
+        particle.uv = uvs[i];
+        particle.normal = glm::vec4(grid.nx[i], grid.ny[i], grid.nz[i], 0.0f);
+        particle.pinned = grid.pinned[i];
+    }
+}
+
+void Simulation::step(const Parameters& params, uint32_t iterations, ThreadPool& pool, simd::Backend backend) {
+    simd::ClothConstants constants;
+    constants.deltaT = params.deltaT;
+    constants.particleMass = params.particleMass;
+    constants.springStiffness = params.springStiffness;
+    constants.damping = params.damping;
+    constants.restDistH = params.restDistH;
+    constants.restDistV = params.restDistV;
+    constants.restDistD = params.restDistD;
+    constants.sphereRadius = params.sphereRadius;
+    constants.sphereX = params.spherePos.x;
+    constants.sphereY = params.spherePos.y;
+    constants.sphereZ = params.spherePos.z;
+    constants.gravityX = params.gravity.x;
+    constants.gravityY = params.gravity.y;
+    constants.gravityZ = params.gravity.z;
+    constants.width = width;
+    constants.height = height;
+
+    for (uint32_t i = 0; i < iterations; ++i) {
+        constants.calculateNormals = (i == iterations - 1);
+        const simd::ClothArrays input = grids[current].arrays();
+        const simd::ClothArrays output = grids[1 - current].arrays();
+        pool.parallelFor(height, ROW_GRAIN, [&](size_t begin, size_t end) {
+            simd::clothStep(backend, input, output, constants, static_cast<uint32_t>(begin), static_cast<uint32_t>(end));
+        });
+        current = 1 - current;
+    }
+}
+
+vkx::simd::Comparison Simulation::compare(const Particle* reference, const simd::Tolerance& tolerance) const {
+    const Grid& grid = grids[current];
+    simd::Comparison result;
+    for (size_t i = 0; i < size(); ++i) {
+        const Particle& particle = reference[i];
+        result.add(particle.pos.x, grid.x[i], tolerance);
+        result.add(particle.pos.y, grid.y[i], tolerance);
+        result.add(particle.pos.z, grid.z[i], tolerance);
+        result.add(particle.vel.x, grid.vx[i], tolerance);
+        result.add(particle.vel.y, grid.vy[i], tolerance);
+        result.add(particle.vel.z, grid.vz[i], tolerance);
+        // Pinned particles keep whatever normal the buffer they are written to held before
+        if (grid.pinned[i] != 1.0f) {
+            result.add(particle.normal.x, grid.nx[i], tolerance);
+            result.add(particle.normal.y, grid.ny[i], tolerance);
+            result.add(particle.normal.z, grid.nz[i], tolerance);
+        }
+    }
+    return result;
+}
+
+void vkx::simd::clothStep(Backend backend, const ClothArrays& input, const ClothArrays& output, const ClothConstants& constants,
+                          uint32_t rowBegin, uint32_t rowEnd) {
+    VKX_SIMD_DISPATCH(clothStep(input, output, constants, rowBegin, rowEnd))
+}
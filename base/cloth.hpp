@@ -0,0 +1,80 @@
+/*
+* CPU implementation of the mass spring cloth of the computecloth example
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "cloth_kernels.hpp"
+#include "threadpool.hpp"
+
+namespace vkx { namespace cloth {
+
+// Same layout as the particle storage buffers of the computecloth example
+struct Particle {
+    glm::vec4 pos;
+    glm::vec4 vel;
+    glm::vec4 uv;
+    glm::vec4 normal;
+    float pinned{ 0.0 };
+    glm::vec3 _pad0;
+};
+
+// Uniform block of cloth.comp
+struct Parameters {
+    float deltaT = 0.0f;
+    float particleMass = 0.1f;
+    float springStiffness = 2000.0f;
+    float damping = 0.25f;
+    float restDistH{ 0 };
+    float restDistV{ 0 };
+    float restDistD{ 0 };
+    float sphereRadius = 0.5f;
+    glm::vec4 spherePos = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
+    glm::vec4 gravity = glm::vec4(0.0f, 9.8f, 0.0f, 0.0f);
+    glm::ivec2 particleCount;
+};
+
+/**
+* @brief Cloth grid stepped on the CPU
+*
+* Holds two structure of arrays copies of the grid that are ping-ponged between iterations, like the input
+* and output storage buffers of the example.  Each iteration is split into bands of rows across the thread
+* pool.
+*/
+class Simulation {
+public:
+    // The grid size is taken from `params.particleCount`
+    void load(const Particle* particles, const Parameters& params);
+    void store(Particle* particles) const;
+    // Run `iterations` steps, calculating normals in the last one
+    void step(const Parameters& params, uint32_t iterations, ThreadPool& pool, simd::Backend backend);
+
+    size_t size() const { return static_cast<size_t>(width) * height; }
+    // Spring evaluations of one iteration, each particle has up to eight neighbours
+    uint64_t interactionsPerStep() const { return 8 * static_cast<uint64_t>(size()); }
+
+    // Positions, velocities and normals of unpinned particles
+    simd::Comparison compare(const Particle* reference, const simd::Tolerance& tolerance = { 64, 1e-6f }) const;
+
+private:
+    struct Grid {
+        std::vector<float> x, y, z, vx, vy, vz, nx, ny, nz, pinned;
+        simd::ClothArrays arrays();
+    };
+
+    uint32_t width{ 0 };
+    uint32_t height{ 0 };
+    Grid grids[2];
+    uint32_t current{ 0 };
+    // Not touched by the simulation, kept to write complete particles
+    std::vector<glm::vec4> uvs;
+};
+
+}}  // namespace vkx::cloth
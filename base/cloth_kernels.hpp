@@ -0,0 +1,50 @@
+/*
+* Mass spring kernel of vkx::cloth::Simulation, see simd.hpp for the backends
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "simd.hpp"
+
+namespace vkx { namespace simd {
+
+// Cloth mass spring grid, see data/shaders/computecloth/cloth.comp
+struct ClothArrays {
+    float* x;
+    float* y;
+    float* z;
+    float* vx;
+    float* vy;
+    float* vz;
+    float* nx;
+    float* ny;
+    float* nz;
+    float* pinned;
+};
+
+struct ClothConstants {
+    float deltaT;
+    float particleMass;
+    float springStiffness;
+    float damping;
+    float restDistH;
+    float restDistV;
+    float restDistD;
+    float sphereRadius;
+    float sphereX, sphereY, sphereZ;
+    float gravityX, gravityY, gravityZ;
+    uint32_t width;
+    uint32_t height;
+    bool calculateNormals;
+};
+
+// One integration step for the grid rows [rowBegin, rowEnd), reading `input` and writing `output`
+void clothStep(Backend backend, const ClothArrays& input, const ClothArrays& output, const ClothConstants& constants, uint32_t rowBegin, uint32_t rowEnd);
+
+// Backend implementations, see cloth_kernels.inl
+VKX_SIMD_DECLARE_KERNEL(void clothStep(const ClothArrays& input, const ClothArrays& output, const ClothConstants& constants, uint32_t rowBegin,
+                                        uint32_t rowEnd))
+
+}}  // namespace vkx::simd
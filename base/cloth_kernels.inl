@@ -0,0 +1,147 @@
+/*
+* Cloth kernel, mirroring computecloth/cloth.comp
+*
+* Included into the namespace of every backend after simd_kernels.inl
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+namespace kernels {
+
+template <typename P>
+struct Vec3 {
+    P x, y, z;
+
+    static Vec3 load(const float* px, const float* py, const float* pz, uint32_t i) { return { P::load(px + i), P::load(py + i), P::load(pz + i) }; }
+    Vec3 operator+(const Vec3& o) const { return { x + o.x, y + o.y, z + o.z }; }
+    Vec3 operator-(const Vec3& o) const { return { x - o.x, y - o.y, z - o.z }; }
+    Vec3 operator*(const P& s) const { return { x * s, y * s, z * s }; }
+    P dot(const Vec3& o) const { return x * o.x + y * o.y + z * o.z; }
+    Vec3 cross(const Vec3& o) const { return { y * o.z - z * o.y, z * o.x - x * o.z, x * o.y - y * o.x }; }
+    Vec3 normalize() const { return *this * (P::set(1.0f) / P::sqrt(dot(*this))); }
+};
+
+template <typename P>
+inline Vec3<P> clothPosition(const ClothArrays& cloth, uint32_t i) {
+    return Vec3<P>::load(cloth.x, cloth.y, cloth.z, i);
+}
+
+template <typename P>
+inline Vec3<P> springForce(const Vec3<P>& p0, const Vec3<P>& p1, const P& stiffness, const P& restDist) {
+    const Vec3<P> dist = p0 - p1;
+    const P length = P::sqrt(dist.dot(dist));
+    return dist.normalize() * stiffness * (length - restDist);
+}
+
+// Neighbours that exist for all cells of a pack
+struct ClothNeighbours {
+    bool left, right, up, down;
+};
+
+template <typename P>
+inline void clothCells(const ClothArrays& in, const ClothArrays& out, const ClothConstants& constants, uint32_t index, const ClothNeighbours& n) {
+    const int32_t w = static_cast<int32_t>(constants.width);
+    const P stiffness = P::set(constants.springStiffness);
+    const P restH = P::set(constants.restDistH);
+    const P restV = P::set(constants.restDistV);
+    const P restD = P::set(constants.restDistD);
+    const P deltaT = P::set(constants.deltaT);
+    const P mass = P::set(constants.particleMass);
+
+    // Initial force from gravity
+    Vec3<P> force{ P::set(constants.gravityX) * mass, P::set(constants.gravityY) * mass, P::set(constants.gravityZ) * mass };
+    const Vec3<P> pos = clothPosition<P>(in, index);
+    const Vec3<P> vel = Vec3<P>::load(in.vx, in.vy, in.vz, index);
+
+    // Spring forces from neighboring particles, in the same order as the shader
+    if (n.left)
+        force = force + springForce(clothPosition<P>(in, index - 1), pos, stiffness, restH);
+    if (n.right)
+        force = force + springForce(clothPosition<P>(in, index + 1), pos, stiffness, restH);
+    if (n.up)
+        force = force + springForce(clothPosition<P>(in, index + w), pos, stiffness, restV);
+    if (n.down)
+        force = force + springForce(clothPosition<P>(in, index - w), pos, stiffness, restV);
+    if (n.left && n.up)
+        force = force + springForce(clothPosition<P>(in, index + w - 1), pos, stiffness, restD);
+    if (n.left && n.down)
+        force = force + springForce(clothPosition<P>(in, index - w - 1), pos, stiffness, restD);
+    if (n.right && n.up)
+        force = force + springForce(clothPosition<P>(in, index + w + 1), pos, stiffness, restD);
+    if (n.right && n.down)
+        force = force + springForce(clothPosition<P>(in, index - w + 1), pos, stiffness, restD);
+
+    force = force + vel * (P::set(0.0f) - P::set(constants.damping));
+
+    // Integrate
+    const Vec3<P> f = force * (P::set(1.0f) / mass);
+    Vec3<P> newPos = pos + vel * deltaT + f * P::set(0.5f) * deltaT * deltaT;
+    Vec3<P> newVel = vel + f * deltaT;
+
+    // Sphere collision
+    const Vec3<P> spherePos{ P::set(constants.sphereX), P::set(constants.sphereY), P::set(constants.sphereZ) };
+    const P radius = P::set(constants.sphereRadius + 0.01f);
+    const Vec3<P> sphereDist = newPos - spherePos;
+    const auto inside = P::less(P::sqrt(sphereDist.dot(sphereDist)), radius);
+    const Vec3<P> pushed = spherePos + sphereDist.normalize() * radius;
+    const P zero = P::set(0.0f);
+    newPos = { P::select(inside, pushed.x, newPos.x), P::select(inside, pushed.y, newPos.y), P::select(inside, pushed.z, newPos.z) };
+    newVel = { P::select(inside, zero, newVel.x), P::select(inside, zero, newVel.y), P::select(inside, zero, newVel.z) };
+
+    // Pinned particles keep their position and normal and stop
+    const auto pinned = P::equal(P::load(in.pinned + index), P::set(1.0f));
+    const Vec3<P> oldPos = clothPosition<P>(out, index);
+    P::select(pinned, oldPos.x, newPos.x).store(out.x + index);
+    P::select(pinned, oldPos.y, newPos.y).store(out.y + index);
+    P::select(pinned, oldPos.z, newPos.z).store(out.z + index);
+    P::select(pinned, zero, newVel.x).store(out.vx + index);
+    P::select(pinned, zero, newVel.y).store(out.vy + index);
+    P::select(pinned, zero, newVel.z).store(out.vz + index);
+
+    // Normals
+    if (constants.calculateNormals) {
+        Vec3<P> normal{ zero, zero, zero };
+        auto quadrant = [&](int32_t offsetA, int32_t offsetB, int32_t offsetC) {
+            const Vec3<P> a = clothPosition<P>(in, index + offsetA) - pos;
+            const Vec3<P> b = clothPosition<P>(in, index + offsetB) - pos;
+            const Vec3<P> c = clothPosition<P>(in, index + offsetC) - pos;
+            normal = normal + (a.cross(b) + b.cross(c));
+        };
+        if (n.down) {
+            if (n.left)
+                quadrant(-1, -w - 1, -w);
+            if (n.right)
+                quadrant(-w, -w + 1, 1);
+        }
+        if (n.up) {
+            if (n.left)
+                quadrant(w, w - 1, -1);
+            if (n.right)
+                quadrant(1, w + 1, w);
+        }
+        normal = normal.normalize();
+        const Vec3<P> oldNormal = Vec3<P>::load(out.nx, out.ny, out.nz, index);
+        P::select(pinned, oldNormal.x, normal.x).store(out.nx + index);
+        P::select(pinned, oldNormal.y, normal.y).store(out.ny + index);
+        P::select(pinned, oldNormal.z, normal.z).store(out.nz + index);
+    }
+}
+
+}  // namespace kernels
+
+void clothStep(const ClothArrays& input, const ClothArrays& output, const ClothConstants& constants, uint32_t rowBegin, uint32_t rowEnd) {
+    const uint32_t w = constants.width;
+    for (uint32_t y = rowBegin; y < rowEnd; ++y) {
+        const bool up = y + 1 < constants.height;
+        const bool down = y > 0;
+        const uint32_t row = y * w;
+        // Boundary columns run single lane, everything in between has both horizontal neighbours
+        kernels::clothCells<Lane>(input, output, constants, row, { false, w > 1, up, down });
+        if (w > 1) {
+            kernels::forRange(row + 1, row + w - 1, [&](auto p, uint32_t i) {
+                kernels::clothCells<decltype(p)>(input, output, constants, i, { true, true, up, down });
+            });
+            kernels::clothCells<Lane>(input, output, constants, row + w - 1, { true, false, up, down });
+        }
+    }
+}
@@ -0,0 +1,152 @@
+#include "clusterculling.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "vks/frustum.hpp"
+#include "vks/shaders.hpp"
+#include "utils.hpp"
+
+using namespace vkx;
+
+// Flags of the uniform buffer, see cull.comp
+static const uint32_t CULL_FRUSTUM = 1;
+static const uint32_t CULL_CONE = 2;
+static const uint32_t CULL_OCCLUSION = 4;
+// Largest group count of a single dimension guaranteed by the specification
+static const uint32_t MAX_GROUPS = 65535;
+
+void ClusterCulling::create(const vks::model::Model& model) {
+    meshletCount = static_cast<uint32_t>(model.meshlets.size());
+    uint32_t indexCount = 0;
+    for (const auto& meshlet : model.meshlets) {
+        indexCount += meshlet.indexCount;
+    }
+    ubo.meshletCount = meshletCount;
+
+    uniform = context.createUniformBuffer(ubo);
+    meshlets = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, model.meshlets);
+    indices = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndexBuffer,
+                                         std::max<vk::DeviceSize>(indexCount, 1) * sizeof(uint32_t));
+    arguments = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer |
+                                                vk::BufferUsageFlagBits::eTransferSrc,
+                                            Arguments{});
+    readback = context.createBuffer(vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                    sizeof(Arguments));
+    readback.map();
+    memset(readback.mapped, 0, sizeof(Arguments));
+
+    std::vector<vk::DescriptorPoolSize> poolSizes = {
+        vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 1 },
+        vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 4 },
+        vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 1 },
+    };
+    descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+    std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings = {
+        // Binding 0 : Camera and flags
+        { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 1 : Clusters
+        { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 2 : Index buffer of the model
+        { 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 3 : Compacted indices
+        { 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 4 : Draw arguments and statistics
+        { 4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 5 : Depth pyramid
+        { 5, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute },
+    };
+    descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+    descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+    std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
+        { descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniform.descriptor },
+        { descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &meshlets.descriptor },
+        { descriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &model.indices.descriptor },
+        { descriptorSet, 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &indices.descriptor },
+        { descriptorSet, 4, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &arguments.descriptor },
+    };
+    device.updateDescriptorSets(writeDescriptorSets, {});
+
+    pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+    vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+    computePipelineCreateInfo.layout = pipelineLayout;
+    computePipelineCreateInfo.stage =
+        vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/clusterculling/cull.comp.spv", vk::ShaderStageFlagBits::eCompute);
+    pipeline = device.createComputePipelines(context.pipelineCache, computePipelineCreateInfo)[0];
+    device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+}
+
+void ClusterCulling::destroy() {
+    if (!pipeline) {
+        return;
+    }
+    device.destroyPipeline(pipeline);
+    device.destroyPipelineLayout(pipelineLayout);
+    device.destroyDescriptorSetLayout(descriptorSetLayout);
+    device.destroyDescriptorPool(descriptorPool);
+    for (auto* buffer : { &uniform, &meshlets, &indices, &arguments, &readback }) {
+        buffer->destroy();
+    }
+    pipeline = nullptr;
+    meshletCount = 0;
+}
+
+void ClusterCulling::setDepthPyramid(const DepthPyramid& pyramid) {
+    const vk::Extent2D extent = pyramid.depthExtent();
+    ubo.depthSize = glm::vec2(extent.width, extent.height);
+    ubo.levelCount = pyramid.levelCount();
+    uniform.copy(ubo);
+    const vk::DescriptorImageInfo imageInfo = pyramid.descriptor();
+    device.updateDescriptorSets(vk::WriteDescriptorSet{ descriptorSet, 5, 0, 1, vk::DescriptorType::eCombinedImageSampler, &imageInfo }, nullptr);
+}
+
+void ClusterCulling::update(const glm::mat4& viewProjection, const glm::vec3& cameraPosition) {
+    // The pyramid read this frame holds the depth rendered with the previous matrix
+    ubo.occlusionViewProjection = this->viewProjection;
+    this->viewProjection = viewProjection;
+    if (!freezeFrustum) {
+        vks::Frustum frustum;
+        frustum.update(viewProjection);
+        std::copy(frustum.planes.begin(), frustum.planes.end(), ubo.frustumPlanes);
+        ubo.cameraPosition = glm::vec4(cameraPosition, 1.0f);
+    }
+    ubo.flags = (frustumCulling ? CULL_FRUSTUM : 0) | (coneCulling ? CULL_CONE : 0) | (occlusionCulling ? CULL_OCCLUSION : 0);
+    uniform.copy(ubo);
+}
+
+void ClusterCulling::record(const vk::CommandBuffer& commandBuffer) const {
+    // The draw and the statistics copy of the previous frame are done with the outputs
+    vk::MemoryBarrier barrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eTransferWrite | vk::AccessFlagBits::eShaderWrite };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eTransfer,
+                                  vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+    Arguments reset;
+    reset.draw.instanceCount = 1;
+    commandBuffer.updateBuffer(arguments.buffer, 0, sizeof(Arguments), &reset);
+    barrier = vk::MemoryBarrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+
+    if (meshletCount) {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+        const uint32_t groupsX = std::min(meshletCount, MAX_GROUPS);
+        commandBuffer.dispatch(groupsX, (meshletCount + groupsX - 1) / groupsX, 1);
+    }
+
+    barrier = vk::MemoryBarrier{ vk::AccessFlagBits::eShaderWrite,
+                                 vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eIndexRead | vk::AccessFlagBits::eTransferRead };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                  vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexInput | vk::PipelineStageFlagBits::eTransfer, {},
+                                  barrier, nullptr, nullptr);
+    commandBuffer.copyBuffer(arguments.buffer, readback.buffer, vk::BufferCopy{ 0, 0, sizeof(Arguments) });
+}
+
+void ClusterCulling::draw(const vk::CommandBuffer& commandBuffer) const {
+    commandBuffer.bindIndexBuffer(indices.buffer, 0, vk::IndexType::eUint32);
+    commandBuffer.drawIndexedIndirect(arguments.buffer, 0, 1, sizeof(vk::DrawIndexedIndirectCommand));
+}
+
+ClusterCulling::Statistics ClusterCulling::statistics() const {
+    Arguments result;
+    memcpy(&result, readback.mapped, sizeof(Arguments));
+    return result.statistics;
+}
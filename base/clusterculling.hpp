@@ -0,0 +1,104 @@
+/*
+* Per cluster frustum, backface and occlusion culling in a compute pre-pass
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "vks/context.hpp"
+#include "vks/model.hpp"
+#include "depthpyramid.hpp"
+
+namespace vkx {
+
+/**
+* @brief Draws the clusters of a model that survive culling with a single indexed indirect draw
+*
+* The model has to be loaded with ModelCreateInfo::clusters enabled.  One workgroup per cluster tests its
+* bounding sphere against the frustum, its normal cone against the camera position and its screen rectangle
+* against a vkx::DepthPyramid, and appends the indices of the clusters that pass to a compacted index buffer.
+* The index count of the draw is the running total of that append, so nothing is read back before drawing.
+*
+* The pyramid is the one built after the previous frame, and the occlusion test projects with the matrix of
+* that frame.  Clusters that become visible from behind an occluder therefore show up a frame late.
+*/
+class ClusterCulling {
+public:
+    // Clusters drawn and culled, in the order the tests run
+    struct Statistics {
+        uint32_t visible{ 0 };
+        uint32_t frustumCulled{ 0 };
+        uint32_t coneCulled{ 0 };
+        uint32_t occlusionCulled{ 0 };
+    };
+
+    ClusterCulling(const vks::Context& context)
+        : context(context) {}
+
+    // Upload the clusters of `model`, whose vertex and index buffers the draw uses
+    void create(const vks::model::Model& model);
+    void destroy();
+
+    // Hierarchical depth read by the occlusion test.  Has to be set before the first record(), and again
+    // whenever the pyramid was created anew.
+    void setDepthPyramid(const DepthPyramid& pyramid);
+    // Camera of the frame about to be recorded.  `viewProjection` is also the one the occlusion test of the
+    // next frame projects with, so pass it even while the frustum is frozen.
+    void update(const glm::mat4& viewProjection, const glm::vec3& cameraPosition);
+
+    // Cull and compact, outside of a render pass.  Reuses the output of the previous frame, so the frame that
+    // recorded it has to be done with its draw.
+    void record(const vk::CommandBuffer& commandBuffer) const;
+    // Draw the compacted indices with the vertex buffer the caller bound
+    void draw(const vk::CommandBuffer& commandBuffer) const;
+
+    // Copied to the host after every cull, a frame or two old
+    Statistics statistics() const;
+    uint32_t clusterCount() const { return meshletCount; }
+
+    bool frustumCulling{ true };
+    bool coneCulling{ true };
+    bool occlusionCulling{ true };
+    // Keep the frustum and camera position of the last update, to look at the culling from elsewhere
+    bool freezeFrustum{ false };
+
+private:
+    // Layouts of data/shaders/clusterculling/cull.comp
+    struct Arguments {
+        vk::DrawIndexedIndirectCommand draw;
+        Statistics statistics;
+    };
+
+    struct UBO {
+        glm::mat4 occlusionViewProjection;
+        glm::vec4 frustumPlanes[6];
+        glm::vec4 cameraPosition;
+        glm::vec2 depthSize;
+        uint32_t levelCount{ 0 };
+        uint32_t flags{ 0 };
+        uint32_t meshletCount{ 0 };
+    } ubo;
+
+    const vks::Context& context;
+    const vk::Device& device{ context.device };
+    uint32_t meshletCount{ 0 };
+    // Projects every point to w = 0, which the occlusion test treats as visible, until the first update
+    glm::mat4 viewProjection{ 0.0f };
+
+    vks::Buffer uniform;
+    vks::Buffer meshlets;
+    vks::Buffer indices;
+    vks::Buffer arguments;
+    vks::Buffer readback;
+
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorSet descriptorSet;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline pipeline;
+};
+
+}  // namespace vkx
@@ -0,0 +1,326 @@
+#include "clusteredlighting.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#include "vks/shaders.hpp"
+#include "utils.hpp"
+
+using namespace vkx;
+
+// Lights per workgroup of both passes, one per invocation
+static const uint32_t GROUP_SIZE = 64;
+// Size of the shared list of a cluster, see assign.comp
+static const uint32_t MAX_LIGHTS_PER_CLUSTER = 1024;
+// List entries per cluster if create() is not given a size
+static const uint32_t DEFAULT_INDICES_PER_CLUSTER = 64;
+
+ClusteredLighting::Light ClusteredLighting::Light::point(const glm::vec3& position, float range, const glm::vec3& color) {
+    Light light;
+    light.position = position;
+    light.range = range;
+    light.color = color;
+    return light;
+}
+
+ClusteredLighting::Light ClusteredLighting::Light::spot(const glm::vec3& position,
+                                                        const glm::vec3& direction,
+                                                        float range,
+                                                        float innerAngle,
+                                                        float outerAngle,
+                                                        const glm::vec3& color) {
+    Light light = point(position, range, color);
+    light.direction = glm::normalize(direction);
+    outerAngle = std::min(outerAngle, glm::radians(90.0f));
+    light.spotCosOuter = std::cos(outerAngle);
+    light.spotCosInner = std::cos(std::min(innerAngle, outerAngle));
+    return light;
+}
+
+void ClusteredLighting::create(uint32_t maxLights, const Grid& grid, uint32_t maxIndices) {
+    gridSize = grid;
+    gridSize.maxLightsPerCluster = std::min(std::max(grid.maxLightsPerCluster, 1u), MAX_LIGHTS_PER_CLUSTER);
+    maxLightCount = std::max(maxLights, 1u);
+    const uint32_t clusterCount = gridSize.clusterCount();
+
+    ubo.gridSize[0] = gridSize.width;
+    ubo.gridSize[1] = gridSize.height;
+    ubo.gridSize[2] = gridSize.depth;
+    ubo.lightCount = 0;
+    ubo.maxLightsPerCluster = gridSize.maxLightsPerCluster;
+    ubo.maxIndices = maxIndices ? maxIndices : clusterCount * DEFAULT_INDICES_PER_CLUSTER;
+    bounds.clear();
+
+    const vk::MemoryPropertyFlags hostVisible = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    uniform = context.createUniformBuffer(ubo);
+    lights = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer, hostVisible, vk::DeviceSize(maxLightCount) * sizeof(Light));
+    lights.map();
+    viewLights = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, vk::DeviceSize(maxLightCount) * sizeof(Light));
+    boundsBuffer = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer, hostVisible, vk::DeviceSize(clusterCount) * sizeof(Bounds));
+    boundsBuffer.map();
+    clusters = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc,
+                                          vk::DeviceSize(clusterCount) * sizeof(glm::uvec2));
+    indices = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc,
+                                         vk::DeviceSize(ubo.maxIndices) * sizeof(uint32_t));
+    counters = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc, Statistics{});
+    readback = context.createBuffer(vk::BufferUsageFlagBits::eTransferDst, hostVisible, sizeof(Statistics));
+    readback.map();
+    memset(readback.mapped, 0, sizeof(Statistics));
+
+    std::vector<vk::DescriptorPoolSize> poolSizes = {
+        vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 1 },
+        vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 6 },
+    };
+    descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+    std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings = {
+        // Binding 0 : Camera, grid and light count
+        { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 1 : Lights as set by the host
+        { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 2 : Lights in view space
+        { 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 3 : Bounds of the clusters
+        { 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 4 : Offset and count of every cluster
+        { 4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 5 : Light indices
+        { 5, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 6 : Statistics
+        { 6, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+    };
+    descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+    descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+    std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
+        { descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniform.descriptor },
+        { descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &lights.descriptor },
+        { descriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &viewLights.descriptor },
+        { descriptorSet, 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &boundsBuffer.descriptor },
+        { descriptorSet, 4, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &clusters.descriptor },
+        { descriptorSet, 5, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &indices.descriptor },
+        { descriptorSet, 6, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &counters.descriptor },
+    };
+    device.updateDescriptorSets(writeDescriptorSets, {});
+
+    pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+    vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+    computePipelineCreateInfo.layout = pipelineLayout;
+    computePipelineCreateInfo.stage =
+        vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/clusteredlighting/transform.comp.spv", vk::ShaderStageFlagBits::eCompute);
+    transformPipeline = device.createComputePipelines(context.pipelineCache, computePipelineCreateInfo)[0];
+    device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+    computePipelineCreateInfo.stage =
+        vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/clusteredlighting/assign.comp.spv", vk::ShaderStageFlagBits::eCompute);
+    assignPipeline = device.createComputePipelines(context.pipelineCache, computePipelineCreateInfo)[0];
+    device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+}
+
+void ClusteredLighting::destroy() {
+    if (!assignPipeline) {
+        return;
+    }
+    device.destroyPipeline(transformPipeline);
+    device.destroyPipeline(assignPipeline);
+    device.destroyPipelineLayout(pipelineLayout);
+    device.destroyDescriptorSetLayout(descriptorSetLayout);
+    device.destroyDescriptorPool(descriptorPool);
+    for (auto* buffer : { &uniform, &lights, &viewLights, &boundsBuffer, &clusters, &indices, &counters, &readback }) {
+        buffer->destroy();
+    }
+    transformPipeline = nullptr;
+    assignPipeline = nullptr;
+    hostLights.clear();
+    bounds.clear();
+}
+
+void ClusteredLighting::setLights(const std::vector<Light>& lightList) {
+    const size_t count = std::min<size_t>(lightList.size(), maxLightCount);
+    hostLights.assign(lightList.begin(), lightList.begin() + count);
+    if (count) {
+        lights.copy(count * sizeof(Light), hostLights.data());
+    }
+    ubo.lightCount = static_cast<uint32_t>(count);
+    uniform.copy(ubo);
+}
+
+void ClusteredLighting::update(const glm::mat4& projection, const glm::mat4& view, float zNear, float zFar) {
+    ubo.view = view;
+    ubo.projection = projection;
+    const float logRange = std::log(zFar / zNear);
+    ubo.sliceScale = gridSize.depth / logRange;
+    ubo.sliceBias = -(gridSize.depth * std::log(zNear)) / logRange;
+    if (bounds.empty() || projection != boundsProjection || glm::vec2(zNear, zFar) != boundsDepthRange) {
+        bounds = calculateBounds(gridSize, projection, zNear, zFar);
+        boundsBuffer.copy(bounds.size() * sizeof(Bounds), bounds.data());
+        boundsProjection = projection;
+        boundsDepthRange = glm::vec2(zNear, zFar);
+    }
+    uniform.copy(ubo);
+}
+
+void ClusteredLighting::record(const vk::CommandBuffer& commandBuffer) const {
+    // Shaders of the last frame are done reading the lists, and the statistics were copied
+    vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead,
+                               vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
+                                  vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+    const Statistics reset{};
+    commandBuffer.updateBuffer(counters.buffer, 0, sizeof(Statistics), &reset);
+    barrier = vk::MemoryBarrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+    // Sized for every light that fits, so a changed light count needs no new commands
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, transformPipeline);
+    commandBuffer.dispatch((maxLightCount + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+
+    barrier = vk::MemoryBarrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, assignPipeline);
+    commandBuffer.dispatch(gridSize.width, gridSize.height, gridSize.depth);
+
+    barrier = vk::MemoryBarrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                  vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader | vk::PipelineStageFlagBits::eTransfer,
+                                  {}, barrier, nullptr, nullptr);
+    commandBuffer.copyBuffer(counters.buffer, readback.buffer, vk::BufferCopy{ 0, 0, sizeof(Statistics) });
+}
+
+std::vector<vk::DescriptorSetLayoutBinding> ClusteredLighting::descriptorBindings(uint32_t firstBinding, vk::ShaderStageFlags stages) {
+    return {
+        { firstBinding, vk::DescriptorType::eUniformBuffer, 1, stages },
+        { firstBinding + 1, vk::DescriptorType::eStorageBuffer, 1, stages },
+        { firstBinding + 2, vk::DescriptorType::eStorageBuffer, 1, stages },
+        { firstBinding + 3, vk::DescriptorType::eStorageBuffer, 1, stages },
+    };
+}
+
+std::vector<vk::WriteDescriptorSet> ClusteredLighting::descriptorWrites(const vk::DescriptorSet& set, uint32_t firstBinding) const {
+    return {
+        { set, firstBinding, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniform.descriptor },
+        { set, firstBinding + 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &viewLights.descriptor },
+        { set, firstBinding + 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &clusters.descriptor },
+        { set, firstBinding + 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &indices.descriptor },
+    };
+}
+
+ClusteredLighting::Statistics ClusteredLighting::statistics() const {
+    Statistics result;
+    memcpy(&result, readback.mapped, sizeof(Statistics));
+    return result;
+}
+
+std::vector<ClusteredLighting::Light> ClusteredLighting::viewSpaceLights() const {
+    std::vector<Light> result;
+    result.reserve(hostLights.size());
+    for (const auto& light : hostLights) {
+        result.push_back(transform(light, ubo.view));
+    }
+    return result;
+}
+
+void ClusteredLighting::download(std::vector<glm::uvec2>& clusterList, std::vector<uint32_t>& indexList) const {
+    const vk::DeviceSize clusterSize = vk::DeviceSize(gridSize.clusterCount()) * sizeof(glm::uvec2);
+    const vk::DeviceSize indexSize = vk::DeviceSize(ubo.maxIndices) * sizeof(uint32_t);
+    vks::Buffer staging = context.createBuffer(vk::BufferUsageFlagBits::eTransferDst,
+                                               vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, clusterSize + indexSize);
+    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eTransferRead };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer, {}, barrier, nullptr, nullptr);
+        commandBuffer.copyBuffer(clusters.buffer, staging.buffer, vk::BufferCopy{ 0, 0, clusterSize });
+        commandBuffer.copyBuffer(indices.buffer, staging.buffer, vk::BufferCopy{ 0, clusterSize, indexSize });
+        barrier = vk::MemoryBarrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, barrier, nullptr, nullptr);
+    });
+    const uint8_t* mapped = staging.map<uint8_t>();
+    clusterList.resize(gridSize.clusterCount());
+    memcpy(clusterList.data(), mapped, clusterSize);
+    indexList.resize(ubo.maxIndices);
+    memcpy(indexList.data(), mapped + clusterSize, indexSize);
+    staging.unmap();
+    staging.destroy();
+}
+
+std::vector<ClusteredLighting::Bounds> ClusteredLighting::calculateBounds(const Grid& grid, const glm::mat4& projection, float zNear, float zFar) {
+    // View space rays through the corners of the tiles, scaled to a depth of one
+    const glm::mat4 inverseProjection = glm::inverse(projection);
+    std::vector<glm::vec3> rays;
+    rays.reserve((grid.width + 1) * (grid.height + 1));
+    for (uint32_t y = 0; y <= grid.height; ++y) {
+        for (uint32_t x = 0; x <= grid.width; ++x) {
+            const glm::vec2 ndc = glm::vec2(x, y) / glm::vec2(grid.width, grid.height) * 2.0f - 1.0f;
+            const glm::vec4 point = inverseProjection * glm::vec4(ndc, 0.0f, 1.0f);
+            rays.push_back(glm::vec3(point) / -point.z);
+        }
+    }
+    std::vector<float> depths(grid.depth + 1);
+    for (uint32_t z = 0; z <= grid.depth; ++z) {
+        depths[z] = zNear * std::pow(zFar / zNear, z / static_cast<float>(grid.depth));
+    }
+
+    std::vector<Bounds> result(grid.clusterCount());
+    for (uint32_t z = 0; z < grid.depth; ++z) {
+        for (uint32_t y = 0; y < grid.height; ++y) {
+            for (uint32_t x = 0; x < grid.width; ++x) {
+                Bounds& cluster = result[(z * grid.height + y) * grid.width + x];
+                cluster.min = glm::vec3(FLT_MAX);
+                cluster.max = glm::vec3(-FLT_MAX);
+                for (uint32_t corner = 0; corner < 4; ++corner) {
+                    const glm::vec3& ray = rays[(y + corner / 2) * (grid.width + 1) + x + corner % 2];
+                    for (float depth : { depths[z], depths[z + 1] }) {
+                        cluster.min = glm::min(cluster.min, ray * depth);
+                        cluster.max = glm::max(cluster.max, ray * depth);
+                    }
+                }
+            }
+        }
+    }
+    return result;
+}
+
+ClusteredLighting::Light ClusteredLighting::transform(const Light& light, const glm::mat4& view) {
+    Light result = light;
+    result.position = glm::vec3(view * glm::vec4(light.position, 1.0f));
+    result.direction = glm::normalize(glm::mat3(view) * light.direction);
+    return result;
+}
+
+bool ClusteredLighting::intersects(const Light& light, const Bounds& bounds) {
+    // Sphere of the range against the box
+    const glm::vec3 offset = glm::clamp(light.position, bounds.min, bounds.max) - light.position;
+    if (glm::dot(offset, offset) > light.range * light.range) {
+        return false;
+    }
+    if (!light.isSpot()) {
+        return true;
+    }
+    // Cone against the sphere around the box, the distance of the sphere center from the cone is measured in
+    // the plane through the axis
+    const glm::vec3 center = (bounds.min + bounds.max) * 0.5f;
+    const float radius = glm::length(bounds.max - bounds.min) * 0.5f;
+    const glm::vec3 v = center - light.position;
+    const float along = glm::dot(v, light.direction);
+    const float across = std::sqrt(std::max(glm::dot(v, v) - along * along, 0.0f));
+    const float sinOuter = std::sqrt(std::max(1.0f - light.spotCosOuter * light.spotCosOuter, 0.0f));
+    return light.spotCosOuter * across - sinOuter * along <= radius && along >= -radius;
+}
+
+void ClusteredLighting::assign(const Grid& grid,
+                               const std::vector<Bounds>& bounds,
+                               const std::vector<Light>& lights,
+                               std::vector<glm::uvec2>& clusters,
+                               std::vector<uint32_t>& indices) {
+    clusters.resize(grid.clusterCount());
+    indices.clear();
+    for (uint32_t cluster = 0; cluster < grid.clusterCount(); ++cluster) {
+        const uint32_t offset = static_cast<uint32_t>(indices.size());
+        for (uint32_t i = 0; i < lights.size(); ++i) {
+            if (intersects(lights[i], bounds[cluster])) {
+                indices.push_back(i);
+            }
+        }
+        clusters[cluster] = glm::uvec2(offset, static_cast<uint32_t>(indices.size()) - offset);
+    }
+}
@@ -0,0 +1,178 @@
+/*
+* Clustered light culling for forward and deferred shading with many point and spot lights
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vks/context.hpp"
+
+namespace vkx {
+
+/**
+* @brief Lists of the lights that can reach each cell of a froxel grid, built on the GPU every frame
+*
+* The view frustum is cut into `Grid::width` x `Grid::height` tiles of equal size in normalized device
+* coordinates and into `Grid::depth` slices whose view space depth grows exponentially from the near to the
+* far plane, so clusters are roughly as deep as they are wide.  record() runs two compute passes:
+*
+* - Every light is transformed into view space, once per frame rather than once per cluster.
+* - One workgroup per cluster tests all lights against the view space bounds of its cluster.  The range of
+*   a light is tested as a sphere against the box, spot lights also test their cone against the sphere
+*   around the box.  The indices of the lights that pass are gathered in shared memory and written to one
+*   compact list, at an offset reserved with a single atomic per cluster.
+*
+* A shading pass then finds the cluster of a view space position with the projection, the log of its depth
+* and the grid size from the uniform buffer, and loops over the `count` indices at `offset` only, so the cost
+* of a pixel follows the number of lights near it rather than the total.  Shading passes include
+* data/shaders/clusteredlighting/clusteredlighting.glsl for the bindings, the lookup and the falloff, the
+* deferred examples show how.
+*
+* A cluster keeps at most `Grid::maxLightsPerCluster` lights, and the list holds `maxIndices` in total.
+* Lights beyond either limit are dropped from the cluster, and counted in statistics().
+*
+* The lights are kept in host visible memory and can be changed every frame with setLights().  assign() is
+* a reference of the assignment on the host with the same bounds and tests, to validate download().
+*/
+class ClusteredLighting {
+public:
+    // Laid out for std430, see ClusteredLight in data/shaders/clusteredlighting/clusteredlighting.glsl
+    struct Light {
+        glm::vec3 position;
+        // Distance at which the light has faded out completely
+        float range{ 0.0f };
+        glm::vec3 color;
+        // Cosine of the angle inside which a spot light has full intensity
+        float spotCosInner{ -1.0f };
+        // Direction a spot light points in
+        glm::vec3 direction{ 0.0f, 0.0f, -1.0f };
+        // Cosine of the angle of the cone, below -1 for point lights
+        float spotCosOuter{ -2.0f };
+
+        static Light point(const glm::vec3& position, float range, const glm::vec3& color);
+        // Angles in radians from the direction, the outer one is clamped to 90 degrees
+        static Light spot(const glm::vec3& position, const glm::vec3& direction, float range, float innerAngle, float outerAngle, const glm::vec3& color);
+        bool isSpot() const { return spotCosOuter >= -1.0f; }
+    };
+
+    struct Grid {
+        uint32_t width{ 16 };
+        uint32_t height{ 9 };
+        uint32_t depth{ 24 };
+        // Length of the list of a cluster, at most 1024 as they are gathered in shared memory
+        uint32_t maxLightsPerCluster{ 256 };
+
+        uint32_t clusterCount() const { return width * height * depth; }
+    };
+
+    // View space bounds of a cluster, laid out for std430
+    struct Bounds {
+        glm::vec3 min;
+        float _pad0{ 0.0f };
+        glm::vec3 max;
+        float _pad1{ 0.0f };
+    };
+
+    // Copied to the host after every assignment
+    struct Statistics {
+        // Entries written to the list of all clusters
+        uint32_t indexCount{ 0 };
+        // Clusters that lost lights to either limit
+        uint32_t overflowCount{ 0 };
+    };
+
+    ClusteredLighting(const vks::Context& context)
+        : context(context) {}
+
+    // Room for `maxLights` lights and `maxIndices` list entries, or 64 per cluster if zero
+    void create(uint32_t maxLights, const Grid& grid = Grid{}, uint32_t maxIndices = 0);
+    void destroy();
+
+    // Lights in the space that update() transforms from, at most the `maxLights` passed to create()
+    void setLights(const std::vector<Light>& lights);
+    // Camera of the frames recorded from now on.  `view` transforms light positions into view space, e.g. the
+    // view matrix for world space lights.  The bounds of the clusters are only calculated again when the
+    // projection or the depth range changed.
+    void update(const glm::mat4& projection, const glm::mat4& view, float zNear, float zFar);
+
+    // Outside of a render pass.  Waits for earlier fragment and compute shaders that read the lists, and
+    // ends with the lists visible to fragment and compute shaders.  The recorded work reads the light count
+    // and the camera when it executes, so the command buffer can be reused.
+    void record(const vk::CommandBuffer& commandBuffer) const;
+
+    // Layout bindings for the uniform buffer, the view space lights, the offset and count of every cluster and
+    // the list of light indices, at consecutive bindings from `firstBinding`
+    static std::vector<vk::DescriptorSetLayoutBinding> descriptorBindings(uint32_t firstBinding, vk::ShaderStageFlags stages);
+    // The matching descriptor writes
+    std::vector<vk::WriteDescriptorSet> descriptorWrites(const vk::DescriptorSet& descriptorSet, uint32_t firstBinding) const;
+
+    Statistics statistics() const;
+    const Grid& grid() const { return gridSize; }
+    uint32_t lightCount() const { return ubo.lightCount; }
+    // Bounds the clusters were last assigned with, and the lights in view space
+    const std::vector<Bounds>& clusterBounds() const { return bounds; }
+    std::vector<Light> viewSpaceLights() const;
+
+    // Copy the offset and count of every cluster and the list from the device.  Waits for the queue to idle.
+    void download(std::vector<glm::uvec2>& clusters, std::vector<uint32_t>& indices) const;
+
+    // Bounds of every cluster for a projection with a depth range of zero to one
+    static std::vector<Bounds> calculateBounds(const Grid& grid, const glm::mat4& projection, float zNear, float zFar);
+    // The light in the view space of `view`
+    static Light transform(const Light& light, const glm::mat4& view);
+    // The test of assign.comp, for a light in view space
+    static bool intersects(const Light& light, const Bounds& bounds);
+    // Reference assignment of view space lights without the limits of the GPU lists.  The lists of the clusters
+    // follow each other in cluster order, with the indices in ascending order.
+    static void assign(const Grid& grid, const std::vector<Bounds>& bounds, const std::vector<Light>& lights, std::vector<glm::uvec2>& clusters,
+                       std::vector<uint32_t>& indices);
+
+private:
+    // Laid out for std140, see ClusterUBO in clusteredlighting.glsl
+    struct UBO {
+        glm::mat4 view;
+        glm::mat4 projection;
+        uint32_t gridSize[3]{ 0, 0, 0 };
+        uint32_t lightCount{ 0 };
+        // Slice of a view space depth d is log(d) * scale + bias
+        float sliceScale{ 0.0f };
+        float sliceBias{ 0.0f };
+        uint32_t maxLightsPerCluster{ 0 };
+        uint32_t maxIndices{ 0 };
+    } ubo;
+
+    const vks::Context& context;
+    const vk::Device& device{ context.device };
+    Grid gridSize;
+    uint32_t maxLightCount{ 0 };
+    std::vector<Light> hostLights;
+    std::vector<Bounds> bounds;
+    glm::mat4 boundsProjection;
+    glm::vec2 boundsDepthRange;
+
+    vks::Buffer uniform;
+    // Host visible
+    vks::Buffer lights;
+    vks::Buffer viewLights;
+    // Host visible, recalculated with the projection
+    vks::Buffer boundsBuffer;
+    // Offset and count of every cluster
+    vks::Buffer clusters;
+    vks::Buffer indices;
+    vks::Buffer counters;
+    vks::Buffer readback;
+
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorSet descriptorSet;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline transformPipeline;
+    vk::Pipeline assignPipeline;
+};
+
+}  // namespace vkx
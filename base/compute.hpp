@@ -1,4 +1,7 @@
+#pragma once
+
 #include "vks/context.hpp"
+#include "computegraph.hpp"
 
 namespace vkx {
 
@@ -12,11 +15,23 @@ struct Compute {
     vk::Queue queue;
     vk::CommandPool commandPool;
 
+    // Host visible copy of a storage buffer, for simulation steps computed on the CPU.  Submitting the
+    // recorded copy in place of the dispatches keeps the semaphores between compute and graphics unchanged.
+    struct Upload {
+        vks::Buffer staging;
+        vk::CommandBuffer commandBuffer;
+    };
+
     struct Semaphores {
         vk::Semaphore ready;
         vk::Semaphore complete;
     } semaphores;
 
+    // Passes of the simulation, recorded by buildGraphCommandBuffers() and submitted by submitGraph()
+    ComputeGraph graph;
+    std::array<vk::CommandBuffer, 2> graphCommandBuffers;
+    uint32_t graphFrame{ 0 };
+
     virtual void prepare() {
         // Create a compute capable device queue
         queue = context.device.getQueue(context.queueIndices.compute, 0);
@@ -27,6 +42,9 @@ struct Compute {
     }
 
     virtual void destroy() {
+        if (graphCommandBuffers[0]) {
+            device.freeCommandBuffers(commandPool, graphCommandBuffers);
+        }
         context.device.destroy(semaphores.complete);
         context.device.destroy(semaphores.ready);
         context.device.destroy(commandPool);
@@ -45,6 +63,75 @@ struct Compute {
         computeSubmitInfo.pSignalSemaphores = &semaphores.complete;
         queue.submit(computeSubmitInfo, {});
     }
+
+    // Record the graph again, e.g. after parameters of its passes changed.  Graphs that swap the buffers of
+    // a ping-pong resource alternate between two command buffers, one for each orientation.
+    void buildGraphCommandBuffers() {
+        if (!graphCommandBuffers[0]) {
+            auto commandBuffers = device.allocateCommandBuffers({ commandPool, vk::CommandBufferLevel::ePrimary, 2 });
+            std::copy(commandBuffers.begin(), commandBuffers.end(), graphCommandBuffers.begin());
+        }
+        const uint32_t count = graph.swapsParity() ? 2 : 1;
+        graphFrame %= count;
+        // Starting with the one submitted next, which matches the current orientation of the graph
+        for (uint32_t i = 0; i < count; ++i) {
+            const auto& commandBuffer = graphCommandBuffers[(graphFrame + i) % 2];
+            commandBuffer.begin({ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
+            graph.record(commandBuffer);
+            commandBuffer.end();
+        }
+    }
+
+    void submitGraph() {
+        submit(graphCommandBuffers[graphFrame]);
+        if (graph.swapsParity()) {
+            graph.advance();
+            graphFrame = 1 - graphFrame;
+        }
+    }
+
+    // Run commands outside of the semaphore chain of the frames and wait for them to complete
+    void submitAndWait(const vk::CommandBuffer& commandBuffer) const {
+        vk::SubmitInfo submitInfo;
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &commandBuffer;
+        queue.submit(submitInfo, {});
+        queue.waitIdle();
+    }
+
+    // Copy the first `count` elements of a device buffer to the host
+    template <typename T>
+    std::vector<T> download(const vks::Buffer& source, size_t count) const {
+        const vk::DeviceSize size = count * sizeof(T);
+        vks::Buffer readback =
+            context.createBuffer(vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, size);
+        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& copyCmd) { copyCmd.copyBuffer(source.buffer, readback.buffer, vk::BufferCopy{ 0, 0, size }); });
+        std::vector<T> result(count);
+        memcpy(result.data(), readback.map(), size);
+        readback.destroy();
+        return result;
+    }
+
+    // The target buffer needs transfer destination usage
+    Upload createUpload(const vks::Buffer& target, vk::DeviceSize size) {
+        Upload upload;
+        upload.staging =
+            context.createBuffer(vk::BufferUsageFlagBits::eTransferSrc, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, size);
+        upload.staging.map();
+        upload.commandBuffer = device.allocateCommandBuffers({ commandPool, vk::CommandBufferLevel::ePrimary, 1 })[0];
+        upload.commandBuffer.begin({ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
+        upload.commandBuffer.copyBuffer(upload.staging.buffer, target.buffer, vk::BufferCopy{ 0, 0, size });
+        upload.commandBuffer.end();
+        return upload;
+    }
+
+    void destroyUpload(Upload& upload) {
+        if (upload.staging) {
+            device.freeCommandBuffers(commandPool, upload.commandBuffer);
+            upload.staging.destroy();
+        }
+        upload = Upload{};
+    }
 };
 
 }  // namespace vkx
@@ -0,0 +1,543 @@
+/*
+* Compute dispatch graph with automatic barrier placement
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "computegraph.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+namespace vkx {
+
+namespace {
+
+bool contains(vk::PipelineStageFlags flags, vk::PipelineStageFlags required) {
+    return (flags & required) == required;
+}
+
+bool contains(vk::AccessFlags flags, vk::AccessFlags required) {
+    return (flags & required) == required;
+}
+
+const vk::AccessFlags readAccess = vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eTransferRead | vk::AccessFlagBits::eIndirectCommandRead;
+const vk::AccessFlags writeAccess = vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite;
+
+}  // namespace
+
+ComputeGraph::Pass& ComputeGraph::Pass::use(Resource resource, bool next, bool read, bool write) {
+    if (resource >= graph.resources.size()) {
+        throw std::runtime_error("Pass " + passName + " uses an unknown resource");
+    }
+    if (next && !graph.resources[resource].pingPong) {
+        throw std::runtime_error("Pass " + passName + " writes the next buffer of " + graph.resources[resource].name + ", which is not a ping-pong resource");
+    }
+    uses.push_back({ resource, next, read, write });
+    graph.compiled = false;
+    return *this;
+}
+
+ComputeGraph::Pass& ComputeGraph::Pass::transfer() {
+    isTransfer = true;
+    graph.compiled = false;
+    return *this;
+}
+
+ComputeGraph::Pass& ComputeGraph::Pass::pipeline(vk::PipelineLayout layout, vk::Pipeline pipeline) {
+    this->layout = layout;
+    boundPipeline = pipeline;
+    return *this;
+}
+
+ComputeGraph::Pass& ComputeGraph::Pass::descriptorSet(vk::DescriptorSet set) {
+    this->set = set;
+    setResource = UINT32_MAX;
+    return *this;
+}
+
+ComputeGraph::Pass& ComputeGraph::Pass::descriptorSets(Resource resource, const std::array<vk::DescriptorSet, 2>& sets) {
+    if (resource >= graph.resources.size() || !graph.resources[resource].pingPong) {
+        throw std::runtime_error("Pass " + passName + " selects descriptor sets by a resource that is not a ping-pong resource");
+    }
+    this->sets = sets;
+    setResource = resource;
+    return *this;
+}
+
+ComputeGraph::Pass& ComputeGraph::Pass::pushConstants(const void* data, uint32_t size) {
+    constants.resize(size);
+    memcpy(constants.data(), data, size);
+    return *this;
+}
+
+ComputeGraph::Pass& ComputeGraph::Pass::dispatch(uint32_t groupCountX, uint32_t groupCountY, uint32_t groupCountZ) {
+    groupCount = { { groupCountX, groupCountY, groupCountZ } };
+    return *this;
+}
+
+ComputeGraph::Pass& ComputeGraph::Pass::dispatchIndirect(Resource resource, vk::DeviceSize offset) {
+    if (resource >= graph.resources.size()) {
+        throw std::runtime_error("Pass " + passName + " dispatches from an unknown resource");
+    }
+    indirectResource = resource;
+    indirectOffset = offset;
+    graph.compiled = false;
+    return *this;
+}
+
+ComputeGraph::Pass& ComputeGraph::Pass::record(const RecordFunction& function) {
+    this->function = function;
+    return *this;
+}
+
+ComputeGraph::Resource ComputeGraph::addBuffer(const std::string& name, vk::Buffer buffer) {
+    resources.push_back({ name, { { buffer, buffer } }, false, 0 });
+    compiled = false;
+    return static_cast<Resource>(resources.size() - 1);
+}
+
+ComputeGraph::Resource ComputeGraph::addPingPong(const std::string& name, vk::Buffer first, vk::Buffer second) {
+    resources.push_back({ name, { { first, second } }, true, 0 });
+    compiled = false;
+    return static_cast<Resource>(resources.size() - 1);
+}
+
+ComputeGraph::Pass& ComputeGraph::addPass(const std::string& name) {
+    passes.emplace_back(new Pass(*this, name));
+    compiled = false;
+    return *passes.back();
+}
+
+void ComputeGraph::clear() {
+    passes.clear();
+    resources.clear();
+    steps.clear();
+    stepParities.clear();
+    compiled = false;
+}
+
+uint32_t ComputeGraph::parity(Resource resource) const {
+    return resources[resource].parity;
+}
+
+vk::Buffer ComputeGraph::front(Resource resource) const {
+    const auto& info = resources[resource];
+    return info.buffers[info.parity];
+}
+
+std::vector<ComputeGraph::Access> ComputeGraph::accesses(const Pass& pass, const std::vector<uint32_t>& parities) const {
+    const vk::PipelineStageFlags stage = pass.isTransfer ? vk::PipelineStageFlagBits::eTransfer : vk::PipelineStageFlagBits::eComputeShader;
+    std::vector<Access> result;
+    for (const auto& use : pass.uses) {
+        const auto& info = resources[use.resource];
+        const vk::Buffer buffer = info.buffers[use.next ? 1 - parities[use.resource] : parities[use.resource]];
+        vk::AccessFlags access;
+        if (use.read) {
+            access |= pass.isTransfer ? vk::AccessFlagBits::eTransferRead : vk::AccessFlagBits::eShaderRead;
+        }
+        if (use.write) {
+            access |= pass.isTransfer ? vk::AccessFlagBits::eTransferWrite : vk::AccessFlagBits::eShaderWrite;
+        }
+        // Both buffers of a ping-pong resource may be used by the same pass, merge only identical ones
+        auto existing = std::find_if(result.begin(), result.end(), [&](const Access& a) { return a.buffer == buffer; });
+        if (existing != result.end()) {
+            existing->access |= access;
+        } else {
+            result.push_back({ buffer, stage, access, info.name + (info.pingPong ? (use.next ? " (back)" : " (front)") : "") });
+        }
+    }
+    // The parameters of an indirect dispatch are read in a stage of their own, so they are tracked separately
+    if (pass.indirectResource != UINT32_MAX) {
+        const auto& info = resources[pass.indirectResource];
+        result.push_back({ info.buffers[parities[pass.indirectResource]], vk::PipelineStageFlagBits::eDrawIndirect, vk::AccessFlagBits::eIndirectCommandRead,
+                           info.name + " (indirect)" });
+    }
+    return result;
+}
+
+void ComputeGraph::schedule() {
+    const uint32_t passCount = static_cast<uint32_t>(passes.size());
+
+    // Accesses of every pass with the orientation of the ping-pong resources at that point of the program
+    std::vector<uint32_t> parities(resources.size());
+    for (size_t i = 0; i < resources.size(); ++i) {
+        parities[i] = resources[i].parity;
+    }
+    startParities = parities;
+    std::vector<std::vector<Access>> passAccesses(passCount);
+    std::vector<std::vector<uint32_t>> passParities(passCount);
+    for (uint32_t i = 0; i < passCount; ++i) {
+        passAccesses[i] = accesses(*passes[i], parities);
+        passParities[i] = parities;
+        for (const auto& use : passes[i]->uses) {
+            if (use.next && use.write) {
+                parities[use.resource] = 1 - passParities[i][use.resource];
+            }
+        }
+    }
+    parityFlips.resize(resources.size());
+    for (size_t i = 0; i < resources.size(); ++i) {
+        parityFlips[i] = parities[i] ^ startParities[i];
+    }
+
+    // Memory dependencies between passes, by physical buffer
+    struct Dependency {
+        uint32_t pass;
+        vk::Buffer buffer;
+        vk::PipelineStageFlags srcStages;
+        vk::AccessFlags srcAccess;  // Empty for write after read, which only needs an execution dependency
+        vk::PipelineStageFlags dstStages;
+        vk::AccessFlags dstAccess;
+    };
+    auto stageOf = [&](uint32_t pass) -> vk::PipelineStageFlags {
+        return passes[pass]->isTransfer ? vk::PipelineStageFlagBits::eTransfer : vk::PipelineStageFlagBits::eComputeShader;
+    };
+    // All stages a pass accesses a buffer in
+    auto stagesOf = [&](uint32_t pass, vk::Buffer buffer) {
+        vk::PipelineStageFlags stages;
+        for (const auto& access : passAccesses[pass]) {
+            if (access.buffer == buffer) {
+                stages |= access.stage;
+            }
+        }
+        return stages;
+    };
+    struct BufferState {
+        vk::Buffer buffer;
+        uint32_t writer;
+        std::vector<uint32_t> readers;
+    };
+    std::vector<BufferState> bufferStates;
+    auto bufferState = [&](vk::Buffer buffer) -> BufferState& {
+        for (auto& state : bufferStates) {
+            if (state.buffer == buffer) {
+                return state;
+            }
+        }
+        bufferStates.push_back({ buffer, UINT32_MAX, {} });
+        return bufferStates.back();
+    };
+    // Passes must also keep their order relative to the swaps of the ping-pong resources they use
+    std::vector<uint32_t> lastSwap(resources.size(), UINT32_MAX);
+    std::vector<std::vector<uint32_t>> usersSinceSwap(resources.size());
+
+    std::vector<std::vector<Dependency>> dependencies(passCount);
+    std::vector<uint32_t> levels(passCount, 0);
+    uint32_t levelCount = 0;
+    for (uint32_t i = 0; i < passCount; ++i) {
+        auto& passDependencies = dependencies[i];
+        uint32_t level = 0;
+        auto dependOn = [&](uint32_t pass) { level = std::max(level, levels[pass] + 1); };
+
+        for (const auto& access : passAccesses[i]) {
+            auto& state = bufferState(access.buffer);
+            const bool write = bool(access.access & writeAccess);
+            if (state.writer != UINT32_MAX) {
+                // Read after write and write after write
+                const auto& writerAccesses = passAccesses[state.writer];
+                auto source = std::find_if(writerAccesses.begin(), writerAccesses.end(),
+                                           [&](const Access& a) { return a.buffer == access.buffer && (a.access & writeAccess); });
+                passDependencies.push_back({ state.writer, access.buffer, stageOf(state.writer), source->access & writeAccess, access.stage, access.access });
+                dependOn(state.writer);
+            }
+            if (write) {
+                // Write after read
+                for (auto reader : state.readers) {
+                    if (reader != i) {
+                        passDependencies.push_back({ reader, access.buffer, stagesOf(reader, access.buffer), vk::AccessFlags(), access.stage, access.access });
+                        dependOn(reader);
+                    }
+                }
+            }
+        }
+        for (const auto& use : passes[i]->uses) {
+            if (!resources[use.resource].pingPong) {
+                continue;
+            }
+            if (lastSwap[use.resource] != UINT32_MAX && lastSwap[use.resource] != i) {
+                dependOn(lastSwap[use.resource]);
+            }
+            if (use.next && use.write) {
+                for (auto user : usersSinceSwap[use.resource]) {
+                    if (user != i) {
+                        dependOn(user);
+                    }
+                }
+                usersSinceSwap[use.resource].clear();
+                lastSwap[use.resource] = i;
+            } else {
+                usersSinceSwap[use.resource].push_back(i);
+            }
+        }
+        levels[i] = level;
+        levelCount = std::max(levelCount, level + 1);
+
+        for (const auto& access : passAccesses[i]) {
+            auto& state = bufferState(access.buffer);
+            if (access.access & writeAccess) {
+                state.writer = i;
+                state.readers.clear();
+            } else {
+                state.readers.push_back(i);
+            }
+        }
+    }
+
+    // Passes of a level do not depend on each other and are recorded back to back in program order
+    std::vector<uint32_t> order(passCount);
+    for (uint32_t i = 0; i < passCount; ++i) {
+        order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return levels[a] < levels[b]; });
+
+    // The barrier in front of each level only covers dependencies no earlier barrier covered already
+    struct Placed {
+        uint32_t level;
+        Barrier barrier;
+    };
+    std::vector<Placed> placed;
+    auto covered = [&](const Dependency& dependency, uint32_t level) {
+        for (const auto& p : placed) {
+            if (p.level <= levels[dependency.pass] || p.level > level) {
+                continue;
+            }
+            if (!contains(p.barrier.srcStages, dependency.srcStages) || !contains(p.barrier.dstStages, dependency.dstStages)) {
+                continue;
+            }
+            if (!dependency.srcAccess) {
+                return true;
+            }
+            for (const auto& bufferBarrier : p.barrier.bufferBarriers) {
+                if (bufferBarrier.buffer == dependency.buffer && contains(bufferBarrier.srcAccessMask, dependency.srcAccess) &&
+                    contains(bufferBarrier.dstAccessMask, dependency.dstAccess)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    };
+
+    steps.clear();
+    stepParities.clear();
+    batchCount = levelCount;
+    size_t next = 0;
+    for (uint32_t level = 0; level < levelCount; ++level) {
+        Barrier barrier;
+        for (size_t o = next; o < order.size() && levels[order[o]] == level; ++o) {
+            const uint32_t pass = order[o];
+            for (const auto& dependency : dependencies[pass]) {
+                if (covered(dependency, level)) {
+                    continue;
+                }
+                barrier.srcStages |= dependency.srcStages;
+                barrier.dstStages |= dependency.dstStages;
+                if (!dependency.srcAccess) {
+                    continue;
+                }
+                auto existing = std::find_if(barrier.bufferBarriers.begin(), barrier.bufferBarriers.end(),
+                                             [&](const vk::BufferMemoryBarrier& b) { return b.buffer == dependency.buffer; });
+                if (existing == barrier.bufferBarriers.end()) {
+                    vk::BufferMemoryBarrier bufferBarrier;
+                    bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                    bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                    bufferBarrier.buffer = dependency.buffer;
+                    bufferBarrier.offset = 0;
+                    bufferBarrier.size = VK_WHOLE_SIZE;
+                    barrier.bufferBarriers.push_back(bufferBarrier);
+                    existing = barrier.bufferBarriers.end() - 1;
+                }
+                existing->srcAccessMask |= dependency.srcAccess;
+                existing->dstAccessMask |= dependency.dstAccess & (readAccess | writeAccess);
+            }
+        }
+        if (barrier.srcStages) {
+            placed.push_back({ level, barrier });
+        }
+
+        bool first = true;
+        for (; next < order.size() && levels[order[next]] == level; ++next) {
+            const uint32_t pass = order[next];
+            steps.push_back({ pass, first ? barrier : Barrier{}, passAccesses[pass] });
+            stepParities.push_back(passParities[pass]);
+            first = false;
+        }
+    }
+}
+
+void ComputeGraph::compile() {
+    schedule();
+    compiled = true;
+}
+
+void ComputeGraph::update() {
+    // The schedule refers to physical buffers and depends on the orientation the recording starts in
+    bool orientationChanged = startParities.size() != resources.size();
+    for (size_t i = 0; !orientationChanged && i < resources.size(); ++i) {
+        orientationChanged = resources[i].parity != startParities[i];
+    }
+    if (!compiled || orientationChanged) {
+        compile();
+    }
+}
+
+void ComputeGraph::record(const vk::CommandBuffer& commandBuffer) {
+    update();
+    assert(validate().empty());
+
+    vk::Pipeline boundPipeline;
+    vk::PipelineLayout boundLayout;
+    vk::DescriptorSet boundSet;
+    const std::vector<uint8_t>* boundConstants = nullptr;
+    for (size_t s = 0; s < steps.size(); ++s) {
+        const auto& step = steps[s];
+        const auto& pass = *passes[step.pass];
+        if (step.barrier.srcStages) {
+            commandBuffer.pipelineBarrier(step.barrier.srcStages, step.barrier.dstStages, {}, nullptr, step.barrier.bufferBarriers, nullptr);
+        }
+        if (!pass.isTransfer && pass.boundPipeline) {
+            if (pass.layout != boundLayout) {
+                // Sets and push constants stay bound only for compatible layouts
+                boundLayout = pass.layout;
+                boundSet = vk::DescriptorSet();
+                boundConstants = nullptr;
+            }
+            if (pass.boundPipeline != boundPipeline) {
+                commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pass.boundPipeline);
+                boundPipeline = pass.boundPipeline;
+            }
+            const vk::DescriptorSet set = pass.setResource != UINT32_MAX ? pass.sets[stepParities[s][pass.setResource]] : pass.set;
+            if (set && set != boundSet) {
+                commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pass.layout, 0, set, nullptr);
+                boundSet = set;
+            }
+            if (!pass.constants.empty() && (!boundConstants || *boundConstants != pass.constants)) {
+                commandBuffer.pushConstants(pass.layout, vk::ShaderStageFlagBits::eCompute, 0, static_cast<uint32_t>(pass.constants.size()),
+                                            pass.constants.data());
+                boundConstants = &pass.constants;
+            }
+            if (pass.indirectResource != UINT32_MAX) {
+                const auto& info = resources[pass.indirectResource];
+                commandBuffer.dispatchIndirect(info.buffers[stepParities[s][pass.indirectResource]], pass.indirectOffset);
+            } else if (pass.groupCount[0] && pass.groupCount[1] && pass.groupCount[2]) {
+                commandBuffer.dispatch(pass.groupCount[0], pass.groupCount[1], pass.groupCount[2]);
+            }
+        }
+        if (pass.function) {
+            pass.function(commandBuffer);
+        }
+    }
+
+    advance();
+}
+
+bool ComputeGraph::swapsParity() {
+    if (!compiled) {
+        compile();
+    }
+    return std::find(parityFlips.begin(), parityFlips.end(), 1u) != parityFlips.end();
+}
+
+void ComputeGraph::advance() {
+    if (!compiled) {
+        compile();
+    }
+    // Which resources swap does not depend on the orientation, so there is no need to compile again
+    for (size_t i = 0; i < resources.size(); ++i) {
+        resources[i].parity ^= parityFlips[i];
+    }
+}
+
+std::vector<std::string> ComputeGraph::validate() {
+    update();
+    Validator validator;
+    for (const auto& step : steps) {
+        if (step.barrier.srcStages) {
+            validator.barrier(step.barrier);
+        }
+        validator.command(passes[step.pass]->name(), step.accesses);
+    }
+    return validator.hazards();
+}
+
+ComputeGraph::Statistics ComputeGraph::statistics() {
+    update();
+    Statistics result;
+    result.passes = static_cast<uint32_t>(steps.size());
+    result.batches = batchCount;
+    for (const auto& step : steps) {
+        if (step.barrier.srcStages) {
+            ++result.pipelineBarriers;
+            result.bufferBarriers += static_cast<uint32_t>(step.barrier.bufferBarriers.size());
+        }
+    }
+    return result;
+}
+
+ComputeGraph::Validator::State& ComputeGraph::Validator::state(vk::Buffer buffer) {
+    for (auto& s : states) {
+        if (s.buffer == buffer) {
+            return s;
+        }
+    }
+    states.emplace_back();
+    states.back().buffer = buffer;
+    return states.back();
+}
+
+void ComputeGraph::Validator::command(const std::string& name, const std::vector<Access>& accesses) {
+    for (const auto& access : accesses) {
+        auto& s = state(access.buffer);
+        const vk::AccessFlags reads = access.access & readAccess;
+        const vk::AccessFlags writes = access.access & writeAccess;
+        if (reads && s.written && !(contains(s.visibleStages, access.stage) && contains(s.visibleAccess, reads))) {
+            errors.push_back("Read after write hazard: " + name + " reads " + access.name + " written by " + s.writer + " without a barrier");
+        }
+        if (writes) {
+            if (s.written && !(contains(s.visibleStages, access.stage) && contains(s.visibleAccess, writes))) {
+                errors.push_back("Write after write hazard: " + name + " writes " + access.name + " written by " + s.writer + " without a barrier");
+            }
+            for (const auto& read : s.reads) {
+                if (read.command != name && !contains(read.orderedBefore, access.stage)) {
+                    errors.push_back("Write after read hazard: " + name + " writes " + access.name + " read by " + read.command + " without a barrier");
+                }
+            }
+        }
+    }
+    for (const auto& access : accesses) {
+        auto& s = state(access.buffer);
+        if (access.access & writeAccess) {
+            s.written = true;
+            s.writeStage = access.stage;
+            s.writeAccess = access.access & writeAccess;
+            s.writer = name;
+            s.visibleStages = vk::PipelineStageFlags();
+            s.visibleAccess = vk::AccessFlags();
+            s.reads.clear();
+        } else {
+            s.reads.push_back({ access.stage, vk::PipelineStageFlags(), name });
+        }
+    }
+}
+
+void ComputeGraph::Validator::barrier(const Barrier& barrier) {
+    for (auto& s : states) {
+        if (s.written && contains(barrier.srcStages, s.writeStage)) {
+            for (const auto& bufferBarrier : barrier.bufferBarriers) {
+                if (bufferBarrier.buffer == s.buffer && contains(bufferBarrier.srcAccessMask, s.writeAccess)) {
+                    s.visibleStages |= barrier.dstStages;
+                    s.visibleAccess |= bufferBarrier.dstAccessMask;
+                }
+            }
+        }
+        for (auto& read : s.reads) {
+            if (contains(barrier.srcStages, read.stage)) {
+                read.orderedBefore |= barrier.dstStages;
+            }
+        }
+    }
+}
+
+}  // namespace vkx
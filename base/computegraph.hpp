@@ -0,0 +1,222 @@
+/*
+* Compute dispatch graph with automatic barrier placement
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+namespace vkx {
+
+/**
+* @brief Sequence of compute passes that declare the buffers they access
+*
+* Passes are added in program order and state which buffers they read and write.  compile() derives the
+* dependencies between them, groups passes without dependencies on each other into batches that are
+* recorded back to back, and places a single pipeline barrier between batches that only covers the
+* buffers with a read after write, write after write or write after read hazard.
+*
+* Ping-pong resources consist of two buffers.  Passes read the front buffer and may write the back
+* buffer with writesNext(), after which the two swap.  Passes can pick a descriptor set per orientation,
+* so iterated simulations like the cloth do not have to track which buffer is current themselves.
+*
+* Only the declared accesses, pipelines, descriptor sets, push constants and dispatch sizes are kept, so
+* the graph can be recorded again whenever parameters change.  Changing the pipeline state of a pass does
+* not require compiling again, changing its accesses does.
+*/
+class ComputeGraph {
+public:
+    using Resource = uint32_t;
+    using RecordFunction = std::function<void(const vk::CommandBuffer& commandBuffer)>;
+
+    class Pass {
+    public:
+        Pass& reads(Resource resource) { return use(resource, false, true, false); }
+        Pass& writes(Resource resource) { return use(resource, false, false, true); }
+        Pass& readsWrites(Resource resource) { return use(resource, false, true, true); }
+        // Write the back buffer of a ping-pong resource, which becomes the front buffer after this pass
+        Pass& writesNext(Resource resource) { return use(resource, true, false, true); }
+        // Read and write the back buffer, e.g. to keep values of elements the pass does not update
+        Pass& readsWritesNext(Resource resource) { return use(resource, true, true, true); }
+
+        // The pass records transfer commands (fill, copy) in its record function instead of a dispatch
+        Pass& transfer();
+
+        Pass& pipeline(vk::PipelineLayout layout, vk::Pipeline pipeline);
+        Pass& descriptorSet(vk::DescriptorSet set);
+        // Bind `sets[parity(resource)]`, i.e. the first set while the buffers of the ping-pong resource are in
+        // the order they were added in
+        Pass& descriptorSets(Resource resource, const std::array<vk::DescriptorSet, 2>& sets);
+        Pass& pushConstants(const void* data, uint32_t size);
+        template <typename T>
+        Pass& pushConstants(const T& value) {
+            return pushConstants(&value, sizeof(T));
+        }
+        Pass& dispatch(uint32_t groupCountX, uint32_t groupCountY = 1, uint32_t groupCountZ = 1);
+        // Take the group counts from a vk::DispatchIndirectCommand at `offset` in the front buffer of `resource`,
+        // which counts as a read in the draw indirect stage
+        Pass& dispatchIndirect(Resource resource, vk::DeviceSize offset = 0);
+        // Called after the dispatch, e.g. for timestamps, or instead of it for transfer passes
+        Pass& record(const RecordFunction& function);
+
+        const std::string& name() const { return passName; }
+
+    private:
+        friend class ComputeGraph;
+
+        struct Use {
+            Resource resource;
+            bool next;
+            bool read;
+            bool write;
+        };
+
+        Pass(ComputeGraph& graph, const std::string& name)
+            : graph(graph)
+            , passName(name) {}
+        Pass& use(Resource resource, bool next, bool read, bool write);
+
+        ComputeGraph& graph;
+        std::string passName;
+        std::vector<Use> uses;
+        bool isTransfer{ false };
+        vk::PipelineLayout layout;
+        vk::Pipeline boundPipeline;
+        vk::DescriptorSet set;
+        Resource setResource{ UINT32_MAX };
+        std::array<vk::DescriptorSet, 2> sets;
+        std::vector<uint8_t> constants;
+        std::array<uint32_t, 3> groupCount{ { 0, 0, 0 } };
+        Resource indirectResource{ UINT32_MAX };
+        vk::DeviceSize indirectOffset{ 0 };
+        RecordFunction function;
+    };
+
+    // Buffer accesses as seen by the GPU, input of the hazard validator
+    struct Access {
+        vk::Buffer buffer;
+        vk::PipelineStageFlags stage;
+        vk::AccessFlags access;
+        std::string name;  // Used in hazard reports
+    };
+
+    struct Barrier {
+        vk::PipelineStageFlags srcStages;
+        vk::PipelineStageFlags dstStages;
+        std::vector<vk::BufferMemoryBarrier> bufferBarriers;
+    };
+
+    /**
+    * @brief Tracks synchronization of a linear command stream on the CPU
+    *
+    * Feed it the accesses of each command and the pipeline barriers between them, in submission order.
+    * Every hazard that is not covered by a barrier is reported, which checks the barriers the graph places
+    * as well as hand written ones.
+    */
+    class Validator {
+    public:
+        void command(const std::string& name, const std::vector<Access>& accesses);
+        void barrier(const Barrier& barrier);
+        const std::vector<std::string>& hazards() const { return errors; }
+
+    private:
+        struct Read {
+            vk::PipelineStageFlags stage;
+            // Stages a later write may happen in without racing this read
+            vk::PipelineStageFlags orderedBefore;
+            std::string command;
+        };
+        struct State {
+            vk::Buffer buffer;
+            bool written{ false };
+            vk::PipelineStageFlags writeStage;
+            vk::AccessFlags writeAccess;
+            std::string writer;
+            // Stages and accesses the last write has been made visible to
+            vk::PipelineStageFlags visibleStages;
+            vk::AccessFlags visibleAccess;
+            std::vector<Read> reads;
+        };
+
+        State& state(vk::Buffer buffer);
+
+        std::vector<State> states;
+        std::vector<std::string> errors;
+    };
+
+    struct Statistics {
+        uint32_t passes{ 0 };
+        uint32_t batches{ 0 };
+        uint32_t pipelineBarriers{ 0 };
+        uint32_t bufferBarriers{ 0 };
+    };
+
+    Resource addBuffer(const std::string& name, vk::Buffer buffer);
+    Resource addPingPong(const std::string& name, vk::Buffer first, vk::Buffer second);
+    // Passes are executed in the order they are added, apart from independent passes sharing a batch
+    Pass& addPass(const std::string& name);
+    // Remove all passes and resources
+    void clear();
+
+    // 0 while the front buffer of a ping-pong resource is the first one passed to addPingPong()
+    uint32_t parity(Resource resource) const;
+    // Physical buffer currently in front
+    vk::Buffer front(Resource resource) const;
+
+    // Schedule the passes and place the barriers.  Called by record() when needed.
+    void compile();
+    // Record all passes.  Ping-pong resources start in their current orientation and keep the one they end
+    // in, so recording a graph with an odd number of swaps again gives the commands for the next frame.
+    void record(const vk::CommandBuffer& commandBuffer);
+    // Whether recording changes the orientation of any ping-pong resource
+    bool swapsParity();
+    // Change the orientation of the ping-pong resources like record() does, for submitting commands that
+    // were recorded earlier
+    void advance();
+
+    // Check the compiled schedule with a Validator
+    std::vector<std::string> validate();
+    Statistics statistics();
+
+private:
+    struct ResourceInfo {
+        std::string name;
+        std::array<vk::Buffer, 2> buffers;
+        bool pingPong;
+        uint32_t parity;
+    };
+
+    struct Step {
+        uint32_t pass;
+        // Emitted before the pass, empty if no barrier is needed
+        Barrier barrier;
+        std::vector<Access> accesses;
+    };
+
+    std::vector<Access> accesses(const Pass& pass, const std::vector<uint32_t>& parities) const;
+    void schedule();
+    // Compile unless the schedule is up to date for the current orientation
+    void update();
+
+    std::vector<ResourceInfo> resources;
+    std::vector<std::unique_ptr<Pass>> passes;
+    std::vector<Step> steps;
+    // Orientation of the ping-pong resources before each step, used to pick descriptor sets
+    std::vector<std::vector<uint32_t>> stepParities;
+    // Orientations the schedule was compiled for, and the resources whose orientation a recording flips
+    std::vector<uint32_t> startParities;
+    std::vector<uint32_t> parityFlips;
+    uint32_t batchCount{ 0 };
+    bool compiled{ false };
+};
+
+}  // namespace vkx
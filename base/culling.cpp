@@ -0,0 +1,294 @@
+#include "culling.hpp"
+
+#include <algorithm>
+#include <bitset>
+#include <math.h>
+
+using namespace vkx;
+using namespace vkx::culling;
+
+// Deepest hierarchy the traversal stack holds, far more than a median split of 2^32 objects produces
+static const uint32_t MAX_DEPTH = 64;
+static const uint32_t ALL_PLANES = 0x3f;
+
+simd::CullPlanes culling::planes(const vks::Frustum& frustum, uint32_t mask) {
+    simd::CullPlanes result{};
+    for (uint32_t i = 0; i < frustum.planes.size(); ++i) {
+        if (!(mask & (1u << i))) {
+            continue;
+        }
+        const glm::vec4& plane = frustum.planes[i];
+        const uint32_t p = result.count++;
+        result.nx[p] = plane.x;
+        result.ny[p] = plane.y;
+        result.nz[p] = plane.z;
+        result.d[p] = plane.w;
+        result.ax[p] = fabsf(plane.x);
+        result.ay[p] = fabsf(plane.y);
+        result.az[p] = fabsf(plane.z);
+    }
+    return result;
+}
+
+void ObjectSet::resize(uint32_t count, Shape shape) {
+    type = shape;
+    for (auto* values : { &x, &y, &z, &ex, &ey, &ez }) {
+        values->resize(count, 0.0f);
+    }
+    visibility.assign((count + 31) / 32, 0);
+    hints.assign(visibility.size(), 0);
+}
+
+void ObjectSet::setSphere(uint32_t index, const glm::vec3& center, float radius) {
+    x[index] = center.x;
+    y[index] = center.y;
+    z[index] = center.z;
+    ex[index] = radius;
+}
+
+void ObjectSet::setBox(uint32_t index, const glm::vec3& min, const glm::vec3& max) {
+    const glm::vec3 center = (min + max) * 0.5f;
+    const glm::vec3 extent = (max - min) * 0.5f;
+    x[index] = center.x;
+    y[index] = center.y;
+    z[index] = center.z;
+    ex[index] = extent.x;
+    ey[index] = extent.y;
+    ez[index] = extent.z;
+}
+
+void ObjectSet::cull(const vks::Frustum& frustum, simd::Backend backend, ThreadPool& pool, uint32_t grain) {
+    const simd::CullPlanes cullPlanes = planes(frustum);
+    const simd::CullBounds bounds{ x.data(), y.data(), z.data(), ex.data(), ey.data(), ez.data() };
+    // Tasks cover whole words of the visibility bits, so no two threads write the same word
+    pool.parallelFor(visibility.size(), std::max(grain / 32, 1u), [&](size_t wordBegin, size_t wordEnd) {
+        const uint32_t begin = static_cast<uint32_t>(wordBegin * 32);
+        const uint32_t end = std::min(size(), static_cast<uint32_t>(wordEnd * 32));
+        if (type == Shape::box) {
+            simd::cullBoxes(backend, cullPlanes, bounds, begin, end, visibility.data() + wordBegin, hints.data() + wordBegin);
+        } else {
+            simd::cullSpheres(backend, cullPlanes, bounds, begin, end, visibility.data() + wordBegin, hints.data() + wordBegin);
+        }
+    });
+}
+
+uint32_t ObjectSet::visibleCount() const {
+    size_t count = 0;
+    for (uint32_t word : visibility) {
+        count += std::bitset<32>(word).count();
+    }
+    return static_cast<uint32_t>(count);
+}
+
+void ObjectSet::visibleIndices(std::vector<uint32_t>& indices) const {
+    indices.clear();
+    for (uint32_t word = 0; word < visibility.size(); ++word) {
+        for (uint32_t bits = visibility[word]; bits != 0; bits &= bits - 1) {
+            uint32_t bit = 0;
+            while (!(bits & (1u << bit))) {
+                ++bit;
+            }
+            indices.push_back(word * 32 + bit);
+        }
+    }
+}
+
+void Bvh::build(const std::vector<glm::vec3>& min, const std::vector<glm::vec3>& max, uint32_t leafSize) {
+    const uint32_t count = static_cast<uint32_t>(min.size());
+    objectIndices.resize(count);
+    for (uint32_t i = 0; i < count; ++i) {
+        objectIndices[i] = i;
+    }
+    nodes.clear();
+    if (count > 0) {
+        nodes.reserve(2 * count / std::max(leafSize / 2, 1u) + 1);
+        buildNode(0, count, std::min(std::max(leafSize, 1u), 32u), min, max);
+    }
+    nodeHints.assign(nodes.size(), 0);
+
+    for (auto* values : { &x, &y, &z, &ex, &ey, &ez }) {
+        values->resize(count);
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        const uint32_t object = objectIndices[i];
+        const glm::vec3 center = (min[object] + max[object]) * 0.5f;
+        const glm::vec3 extent = (max[object] - min[object]) * 0.5f;
+        x[i] = center.x;
+        y[i] = center.y;
+        z[i] = center.z;
+        ex[i] = extent.x;
+        ey[i] = extent.y;
+        ez[i] = extent.z;
+    }
+}
+
+uint32_t Bvh::buildNode(uint32_t first, uint32_t count, uint32_t leafSize, const std::vector<glm::vec3>& min, const std::vector<glm::vec3>& max) {
+    glm::vec3 lower = min[objectIndices[first]];
+    glm::vec3 upper = max[objectIndices[first]];
+    glm::vec3 centerLower = (lower + upper) * 0.5f;
+    glm::vec3 centerUpper = centerLower;
+    for (uint32_t i = first + 1; i < first + count; ++i) {
+        const uint32_t object = objectIndices[i];
+        const glm::vec3 center = (min[object] + max[object]) * 0.5f;
+        lower = glm::min(lower, min[object]);
+        upper = glm::max(upper, max[object]);
+        centerLower = glm::min(centerLower, center);
+        centerUpper = glm::max(centerUpper, center);
+    }
+
+    const uint32_t node = static_cast<uint32_t>(nodes.size());
+    nodes.push_back({ (lower + upper) * 0.5f, first, (upper - lower) * 0.5f, count, 0 });
+    if (count <= leafSize) {
+        return node;
+    }
+
+    // Split at the median of the object centers along the axis they spread the most
+    const glm::vec3 spread = centerUpper - centerLower;
+    const int axis = spread.x >= spread.y && spread.x >= spread.z ? 0 : (spread.y >= spread.z ? 1 : 2);
+    const uint32_t half = count / 2;
+    auto begin = objectIndices.begin() + first;
+    std::nth_element(begin, begin + half, begin + count, [&](uint32_t a, uint32_t b) { return min[a][axis] + max[a][axis] < min[b][axis] + max[b][axis]; });
+
+    buildNode(first, half, leafSize, min, max);
+    const uint32_t right = buildNode(first + half, count - half, leafSize, min, max);
+    nodes[node].right = right;
+    return node;
+}
+
+void Bvh::cullNode(const vks::Frustum& frustum, simd::Backend backend, uint32_t root, uint32_t rootMask, uint32_t splitCount, std::vector<uint32_t>& visible,
+                   Statistics& statistics) {
+    struct Entry {
+        uint32_t node;
+        uint32_t planeMask;
+    };
+    Entry stack[MAX_DEPTH + 1];
+    uint32_t depth = 0;
+    stack[depth++] = { root, rootMask };
+
+    while (depth > 0) {
+        const Entry entry = stack[--depth];
+        const Node& node = nodes[entry.node];
+        uint32_t planeMask = entry.planeMask;
+
+        if (planeMask != 0) {
+            ++statistics.nodesTested;
+            // Start with the plane that rejected the node last time
+            const uint32_t hint = nodeHints[entry.node];
+            bool rejected = false;
+            for (uint32_t k = 0; k < 6 && !rejected; ++k) {
+                const uint32_t p = (hint + k) % 6;
+                if (!(planeMask & (1u << p))) {
+                    continue;
+                }
+                const glm::vec4& plane = frustum.planes[p];
+                const float distance = plane.x * node.center.x + plane.y * node.center.y + plane.z * node.center.z + plane.w;
+                const float reach = fabsf(plane.x) * node.extent.x + fabsf(plane.y) * node.extent.y + fabsf(plane.z) * node.extent.z;
+                if (distance <= -reach) {
+                    nodeHints[entry.node] = static_cast<uint8_t>(p);
+                    rejected = true;
+                } else if (distance - reach > 0.0f) {
+                    // The whole box is on the inner side, so nothing below needs this plane
+                    planeMask &= ~(1u << p);
+                }
+            }
+            if (rejected) {
+                ++statistics.nodesRejected;
+                continue;
+            }
+        }
+
+        if (planeMask == 0) {
+            ++statistics.nodesAccepted;
+            visible.insert(visible.end(), objectIndices.begin() + node.first, objectIndices.begin() + node.first + node.count);
+            continue;
+        }
+
+        if (node.count <= splitCount) {
+            // Keep the result vectors of earlier frames to avoid reallocating them
+            if (taskCount == tasks.size()) {
+                tasks.emplace_back();
+            }
+            tasks[taskCount].node = entry.node;
+            tasks[taskCount].planeMask = planeMask;
+            ++taskCount;
+            continue;
+        }
+
+        if (node.right == 0) {
+            // Leaf: test the objects against the planes the node intersects, in the order of the kernels
+            uint8_t planeIndices[6];
+            uint32_t planeCount = 0;
+            for (uint32_t p = 0; p < 6; ++p) {
+                if (planeMask & (1u << p)) {
+                    planeIndices[planeCount++] = static_cast<uint8_t>(p);
+                }
+            }
+            const simd::CullPlanes cullPlanes = planes(frustum, planeMask);
+            const simd::CullBounds bounds{ x.data(), y.data(), z.data(), ex.data(), ey.data(), ez.data() };
+            uint8_t hint = 0;
+            while (hint < planeCount && planeIndices[hint] != nodeHints[entry.node]) {
+                ++hint;
+            }
+            uint32_t bits = 0;
+            simd::cullBoxes(backend, cullPlanes, bounds, node.first, node.first + node.count, &bits, &hint);
+            if (hint < planeCount) {
+                nodeHints[entry.node] = planeIndices[hint];
+            }
+            statistics.objectsTested += node.count;
+            for (; bits != 0; bits &= bits - 1) {
+                uint32_t bit = 0;
+                while (!(bits & (1u << bit))) {
+                    ++bit;
+                }
+                visible.push_back(objectIndices[node.first + bit]);
+            }
+            continue;
+        }
+
+        // The first child is visited first, so the objects come out roughly in tree order
+        stack[depth++] = { node.right, planeMask };
+        stack[depth++] = { entry.node + 1, planeMask };
+    }
+}
+
+void Bvh::cull(const vks::Frustum& frustum, simd::Backend backend, ThreadPool& pool, std::vector<uint32_t>& visible, uint32_t grain) {
+    visible.clear();
+    stats = {};
+    if (nodes.empty()) {
+        return;
+    }
+    if (pool.size() <= 1 || size() <= grain) {
+        cullNode(frustum, backend, 0, ALL_PLANES, 0, visible, stats);
+        return;
+    }
+
+    // Descend serially until the subtrees are small enough, then cull those on the pool
+    taskCount = 0;
+    cullNode(frustum, backend, 0, ALL_PLANES, grain, visible, stats);
+    pool.parallelFor(taskCount, 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            Task& task = tasks[i];
+            task.visible.clear();
+            task.stats = {};
+            cullNode(frustum, backend, task.node, task.planeMask, 0, task.visible, task.stats);
+        }
+    });
+    for (uint32_t i = 0; i < taskCount; ++i) {
+        const Task& task = tasks[i];
+        visible.insert(visible.end(), task.visible.begin(), task.visible.end());
+        stats.nodesTested += task.stats.nodesTested;
+        stats.nodesRejected += task.stats.nodesRejected;
+        stats.nodesAccepted += task.stats.nodesAccepted;
+        stats.objectsTested += task.stats.objectsTested;
+    }
+}
+
+void vkx::simd::cullSpheres(Backend backend, const CullPlanes& planes, const CullBounds& bounds, uint32_t begin, uint32_t end,
+                            uint32_t* visibility, uint8_t* hints) {
+    VKX_SIMD_DISPATCH(cullSpheres(planes, bounds, begin, end, visibility, hints))
+}
+
+void vkx::simd::cullBoxes(Backend backend, const CullPlanes& planes, const CullBounds& bounds, uint32_t begin, uint32_t end,
+                          uint32_t* visibility, uint8_t* hints) {
+    VKX_SIMD_DISPATCH(cullBoxes(planes, bounds, begin, end, visibility, hints))
+}
@@ -0,0 +1,136 @@
+/*
+* Frustum culling of many spheres or boxes at once, flat or through a bounding volume hierarchy
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vks/frustum.hpp"
+#include "culling_kernels.hpp"
+#include "threadpool.hpp"
+
+namespace vkx { namespace culling {
+
+// All six planes of `frustum`, or the ones with their bit set in `mask`, laid out for the SIMD kernels
+simd::CullPlanes planes(const vks::Frustum& frustum, uint32_t mask = 0x3f);
+
+enum class Shape
+{
+    sphere,
+    box,
+};
+
+/**
+* @brief Bounds of objects tested against the frustum all at once
+*
+* The centers and extents are kept as structure of arrays, so the kernels test 8 (AVX2) or 4 (NEON)
+* objects per instruction.  The result is a bit per object.  The objects are split into groups of 32
+* that each remember the plane that last rejected some of them, so from frame to frame most rejected
+* objects only need a single plane test.  Large sets are spread over the thread pool.
+*
+* The results are the same as the ones of vks::Frustum::checkSphere() and checkBox() for every object.
+*/
+class ObjectSet {
+public:
+    void resize(uint32_t count, Shape shape);
+    uint32_t size() const { return static_cast<uint32_t>(x.size()); }
+    Shape shape() const { return type; }
+
+    void setSphere(uint32_t index, const glm::vec3& center, float radius);
+    void setBox(uint32_t index, const glm::vec3& min, const glm::vec3& max);
+
+    // Test all objects.  Sets of more than `grain` objects are split across the pool.
+    void cull(const vks::Frustum& frustum, simd::Backend backend, ThreadPool& pool, uint32_t grain = 16 * 1024);
+
+    bool visible(uint32_t index) const { return ((visibility[index / 32] >> (index % 32)) & 1) != 0; }
+    uint32_t visibleCount() const;
+    // Replace `indices` by the visible objects in ascending order
+    void visibleIndices(std::vector<uint32_t>& indices) const;
+    // Bit i % 32 of word i / 32 is set for visible object i
+    const std::vector<uint32_t>& visibilityBits() const { return visibility; }
+
+private:
+    Shape type{ Shape::sphere };
+    // Centers, and half extents or radii in ex
+    std::vector<float> x, y, z, ex, ey, ez;
+    std::vector<uint32_t> visibility;
+    std::vector<uint8_t> hints;
+};
+
+/**
+* @brief Bounding volume hierarchy over static objects
+*
+* Built once from the boxes of the objects by splitting at the median of the longest axis.  Culling walks
+* the hierarchy from the root and rejects whole subtrees with a single test.  Each node passes down only the
+* planes its box intersects, so a subtree entirely inside the frustum is accepted without further tests, and
+* leaves test their objects against the remaining planes with the SIMD kernels.  Like the object groups of
+* ObjectSet, every node remembers the plane that rejected it last.
+*
+* Hierarchies with many objects are cut into subtrees that are culled on the thread pool.
+*/
+class Bvh {
+public:
+    struct Statistics {
+        // Nodes tested against at least one plane
+        uint32_t nodesTested{ 0 };
+        uint32_t nodesRejected{ 0 };
+        // Nodes found to be completely inside the frustum
+        uint32_t nodesAccepted{ 0 };
+        // Objects tested individually in leaves
+        uint32_t objectsTested{ 0 };
+    };
+
+    // `min` and `max` hold the bounds of object i at index i.  Leaves contain at most `leafSize` objects, up to 32.
+    void build(const std::vector<glm::vec3>& min, const std::vector<glm::vec3>& max, uint32_t leafSize = 16);
+    uint32_t size() const { return static_cast<uint32_t>(objectIndices.size()); }
+    uint32_t nodeCount() const { return static_cast<uint32_t>(nodes.size()); }
+
+    // Replace `visible` by the indices of the objects intersecting the frustum, in no particular order.
+    // Hierarchies of more than `grain` objects are culled on the pool.
+    void cull(const vks::Frustum& frustum, simd::Backend backend, ThreadPool& pool, std::vector<uint32_t>& visible, uint32_t grain = 16 * 1024);
+
+    const Statistics& statistics() const { return stats; }
+
+private:
+    struct Node {
+        glm::vec3 center;
+        // Objects of the subtree, contiguous in the reordered arrays
+        uint32_t first;
+        glm::vec3 extent;
+        uint32_t count;
+        // Second child of inner nodes, the first one directly follows the node.  0 for leaves.
+        uint32_t right;
+    };
+
+    struct Task {
+        uint32_t node;
+        uint32_t planeMask;
+        std::vector<uint32_t> visible;
+        Statistics stats;
+    };
+
+    uint32_t buildNode(uint32_t first, uint32_t count, uint32_t leafSize, const std::vector<glm::vec3>& min, const std::vector<glm::vec3>& max);
+    // Cull the subtree of `node`, testing only the planes in `planeMask`.  Subtrees of at most `splitCount`
+    // objects are added to the tasks instead of descending into them, unless `splitCount` is 0.
+    void cullNode(const vks::Frustum& frustum, simd::Backend backend, uint32_t node, uint32_t planeMask, uint32_t splitCount, std::vector<uint32_t>& visible,
+                  Statistics& statistics);
+
+    std::vector<Node> nodes;
+    // Last rejecting plane of each node
+    std::vector<uint8_t> nodeHints;
+    // Original index of each object in tree order, and the bounds in tree order
+    std::vector<uint32_t> objectIndices;
+    std::vector<float> x, y, z, ex, ey, ez;
+    // Subtrees culled on the pool, the first taskCount are used by the current cull()
+    std::vector<Task> tasks;
+    uint32_t taskCount{ 0 };
+    Statistics stats;
+};
+
+}}  // namespace vkx::culling
@@ -0,0 +1,50 @@
+/*
+* Sphere and box frustum tests of culling.hpp, see simd.hpp for the backends
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "simd.hpp"
+
+namespace vkx { namespace simd {
+
+// Frustum culling, see base/culling.hpp.  An object is visible if it reaches into the positive side of every
+// plane, i.e. dot(normal, center) + distance > -reach.  The reach of a sphere is its radius, the one of a box
+// its half extent projected onto the normal.  Like vks::Frustum, the planes are expected to be normalized.
+struct CullPlanes {
+    // Number of planes to test, e.g. fewer for a node of a hierarchy that is known to lie inside some of them
+    uint32_t count;
+    float nx[6];
+    float ny[6];
+    float nz[6];
+    float d[6];
+    // Absolute values of the normal components, for projecting box extents
+    float ax[6];
+    float ay[6];
+    float az[6];
+};
+
+struct CullBounds {
+    const float* x;
+    const float* y;
+    const float* z;
+    // Half extents of boxes.  Spheres store their radius in `ex` and leave the others unused.
+    const float* ex;
+    const float* ey;
+    const float* ez;
+};
+
+// Test the objects [begin, end) and set bit k % 32 of visibility[k / 32] for visible object begin + k.
+// hints[k / 32] holds the plane that last rejected a whole pack among each 32 objects, which is tested first
+// as it will likely reject them again.  Testing stops as soon as all objects of a pack are rejected.
+void cullSpheres(Backend backend, const CullPlanes& planes, const CullBounds& bounds, uint32_t begin, uint32_t end, uint32_t* visibility, uint8_t* hints);
+void cullBoxes(Backend backend, const CullPlanes& planes, const CullBounds& bounds, uint32_t begin, uint32_t end, uint32_t* visibility, uint8_t* hints);
+
+// Backend implementations, see culling_kernels.inl
+VKX_SIMD_DECLARE_KERNEL(void cullSpheres(const CullPlanes& planes, const CullBounds& bounds, uint32_t begin, uint32_t end, uint32_t* visibility,
+                                          uint8_t* hints))
+VKX_SIMD_DECLARE_KERNEL(void cullBoxes(const CullPlanes& planes, const CullBounds& bounds, uint32_t begin, uint32_t end, uint32_t* visibility, uint8_t* hints))
+
+}}  // namespace vkx::simd
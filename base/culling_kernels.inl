@@ -0,0 +1,62 @@
+/*
+* Frustum culling kernels with per pack plane hints
+*
+* Included into the namespace of every backend after simd_kernels.inl
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+namespace kernels {
+
+// Visibility bits of the pack at `i`.  `hint` is the plane to start with and receives the rejecting plane.
+template <typename P, bool Boxes>
+inline uint32_t cullPack(const CullPlanes& planes, const CullBounds& bounds, uint32_t i, uint32_t& hint) {
+    const P x = P::load(bounds.x + i), y = P::load(bounds.y + i), z = P::load(bounds.z + i);
+    const P ex = P::load(bounds.ex + i);
+    const P ey = Boxes ? P::load(bounds.ey + i) : ex;
+    const P ez = Boxes ? P::load(bounds.ez + i) : ex;
+    const P zero = P::set(0.0f);
+
+    typename P::Mask inside = P::equal(zero, zero);
+    for (uint32_t k = 0; k < planes.count; ++k) {
+        const uint32_t p = hint + k < planes.count ? hint + k : hint + k - planes.count;
+        const P distance = P::set(planes.nx[p]) * x + P::set(planes.ny[p]) * y + P::set(planes.nz[p]) * z + P::set(planes.d[p]);
+        // Same operations as vks::Frustum::checkSphere() and checkBox()
+        const P reach = Boxes ? P::set(planes.ax[p]) * ex + P::set(planes.ay[p]) * ey + P::set(planes.az[p]) * ez : ex;
+        inside = P::maskAnd(inside, P::greater(distance, zero - reach));
+        if (P::bits(inside) == 0) {
+            hint = p;
+            return 0;
+        }
+    }
+    return P::bits(inside);
+}
+
+template <bool Boxes>
+inline void cullRange(const CullPlanes& planes, const CullBounds& bounds, uint32_t begin, uint32_t end, uint32_t* visibility, uint8_t* hints) {
+    for (uint32_t word = 0; begin + word * 32 < end; ++word) {
+        const uint32_t first = begin + word * 32;
+        const uint32_t last = end - first < 32 ? end : first + 32;
+        uint32_t hint = hints[word] < planes.count ? hints[word] : 0;
+        uint32_t bits = 0;
+        uint32_t i = first;
+        for (; i + Pack::width <= last; i += Pack::width) {
+            bits |= cullPack<Pack, Boxes>(planes, bounds, i, hint) << (i - first);
+        }
+        for (; i < last; ++i) {
+            bits |= cullPack<Lane, Boxes>(planes, bounds, i, hint) << (i - first);
+        }
+        visibility[word] = bits;
+        hints[word] = static_cast<uint8_t>(hint);
+    }
+}
+
+}  // namespace kernels
+
+void cullSpheres(const CullPlanes& planes, const CullBounds& bounds, uint32_t begin, uint32_t end, uint32_t* visibility, uint8_t* hints) {
+    kernels::cullRange<false>(planes, bounds, begin, end, visibility, hints);
+}
+
+void cullBoxes(const CullPlanes& planes, const CullBounds& bounds, uint32_t begin, uint32_t end, uint32_t* visibility, uint8_t* hints) {
+    kernels::cullRange<true>(planes, bounds, begin, end, visibility, hints);
+}
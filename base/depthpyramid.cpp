@@ -0,0 +1,153 @@
+#include "depthpyramid.hpp"
+
+#include <algorithm>
+
+#include "vks/shaders.hpp"
+#include "utils.hpp"
+
+using namespace vkx;
+
+// Invocations per workgroup of the reduction in each direction
+static const uint32_t GROUP_SIZE = 8;
+
+static bool hasStencil(vk::Format format) {
+    return format == vk::Format::eD16UnormS8Uint || format == vk::Format::eD24UnormS8Uint || format == vk::Format::eD32SfloatS8Uint;
+}
+
+void DepthPyramid::create(const vks::Image& depth) {
+    depthImage = depth.image;
+    depthImageExtent = depth.extent;
+    depthAspect = vk::ImageAspectFlagBits::eDepth;
+    if (hasStencil(depth.format)) {
+        depthAspect |= vk::ImageAspectFlagBits::eStencil;
+    }
+    depthView = device.createImageView(vk::ImageViewCreateInfo{ {}, depth.image, vk::ImageViewType::e2D, depth.format, {},
+                                                                 vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eDepth, 0, 1, 0, 1 } });
+
+    // Halve the size, rounding up, down to a single texel
+    vk::Extent2D extent{ depth.extent.width, depth.extent.height };
+    levels.clear();
+    do {
+        extent = vk::Extent2D{ (extent.width + 1) / 2, (extent.height + 1) / 2 };
+        levels.push_back({ {}, {}, extent });
+    } while (extent.width > 1 || extent.height > 1);
+
+    vk::ImageCreateInfo imageCreateInfo;
+    imageCreateInfo.imageType = vk::ImageType::e2D;
+    imageCreateInfo.format = vk::Format::eR32Sfloat;
+    imageCreateInfo.extent = vk::Extent3D{ levels[0].extent.width, levels[0].extent.height, 1 };
+    imageCreateInfo.mipLevels = levelCount();
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.usage = vk::ImageUsageFlagBits::eStorage | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
+    pyramid = context.createImage(imageCreateInfo);
+    const vk::ImageSubresourceRange allLevels{ vk::ImageAspectFlagBits::eColor, 0, levelCount(), 0, 1 };
+    pyramid.view = device.createImageView(vk::ImageViewCreateInfo{ {}, pyramid.image, vk::ImageViewType::e2D, pyramid.format, {}, allLevels });
+    vk::SamplerCreateInfo samplerCreateInfo;
+    samplerCreateInfo.magFilter = vk::Filter::eNearest;
+    samplerCreateInfo.minFilter = vk::Filter::eNearest;
+    samplerCreateInfo.mipmapMode = vk::SamplerMipmapMode::eNearest;
+    samplerCreateInfo.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+    samplerCreateInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+    samplerCreateInfo.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+    samplerCreateInfo.maxLod = static_cast<float>(levelCount());
+    pyramid.sampler = device.createSampler(samplerCreateInfo);
+    for (uint32_t level = 0; level < levelCount(); ++level) {
+        levels[level].view = device.createImageView(vk::ImageViewCreateInfo{ {}, pyramid.image, vk::ImageViewType::e2D, pyramid.format, {},
+                                                                              vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, level, 1, 0, 1 } });
+    }
+
+    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+        vk::ImageMemoryBarrier barrier{ {},
+                                        vk::AccessFlagBits::eTransferWrite,
+                                        vk::ImageLayout::eUndefined,
+                                        vk::ImageLayout::eGeneral,
+                                        VK_QUEUE_FAMILY_IGNORED,
+                                        VK_QUEUE_FAMILY_IGNORED,
+                                        pyramid.image,
+                                        allLevels };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, barrier);
+        commandBuffer.clearColorImage(pyramid.image, vk::ImageLayout::eGeneral, vk::ClearColorValue{ std::array<float, 4>{ { 1.0f, 1.0f, 1.0f, 1.0f } } },
+                                      allLevels);
+        barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+        barrier.oldLayout = vk::ImageLayout::eGeneral;
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr, barrier);
+    });
+
+    // One set per level, reading the level below or the attachment
+    std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+        // Binding 0 : Source depth
+        { 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 1 : Level written
+        { 1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute },
+    };
+    descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+    for (uint32_t level = 0; level < levelCount(); ++level) {
+        const vk::DescriptorImageInfo source = level == 0 ? vk::DescriptorImageInfo{ pyramid.sampler, depthView, vk::ImageLayout::eDepthStencilReadOnlyOptimal }
+                                                          : vk::DescriptorImageInfo{ pyramid.sampler, levels[level - 1].view, vk::ImageLayout::eGeneral };
+        const vk::DescriptorImageInfo target{ nullptr, levels[level].view, vk::ImageLayout::eGeneral };
+        levels[level].descriptorSet = descriptorAllocator.get(
+            descriptorSetLayout,
+            vks::DescriptorBindings{}.image(0, vk::DescriptorType::eCombinedImageSampler, source).image(1, vk::DescriptorType::eStorageImage, target));
+    }
+    descriptorAllocator.flush();
+
+    vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants) };
+    pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout, 1, &pushConstantRange });
+    vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+    computePipelineCreateInfo.layout = pipelineLayout;
+    computePipelineCreateInfo.stage =
+        vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/depthpyramid/downsample.comp.spv", vk::ShaderStageFlagBits::eCompute);
+    pipeline = device.createComputePipelines(context.pipelineCache, computePipelineCreateInfo)[0];
+    device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+}
+
+void DepthPyramid::destroy() {
+    if (!pyramid) {
+        return;
+    }
+    device.destroyPipeline(pipeline);
+    device.destroyPipelineLayout(pipelineLayout);
+    device.destroyDescriptorSetLayout(descriptorSetLayout);
+    for (auto& level : levels) {
+        device.destroyImageView(level.view);
+    }
+    levels.clear();
+    device.destroyImageView(depthView);
+    pyramid.destroy();
+}
+
+void DepthPyramid::build(const vk::CommandBuffer& commandBuffer) const {
+    const vk::ImageSubresourceRange depthRange{ depthAspect, 0, 1, 0, 1 };
+    vk::ImageMemoryBarrier depthBarrier{ vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                                         vk::AccessFlagBits::eShaderRead,
+                                         vk::ImageLayout::eDepthStencilAttachmentOptimal,
+                                         vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+                                         VK_QUEUE_FAMILY_IGNORED,
+                                         VK_QUEUE_FAMILY_IGNORED,
+                                         depthImage,
+                                         depthRange };
+    // The pyramid may still be read by the culling of this frame
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eLateFragmentTests | vk::PipelineStageFlagBits::eComputeShader,
+                                  vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr, depthBarrier);
+
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+    vk::Extent2D sourceSize{ depthImageExtent.width, depthImageExtent.height };
+    for (const auto& level : levels) {
+        const PushConstants pushConstants{ { static_cast<int32_t>(sourceSize.width), static_cast<int32_t>(sourceSize.height) },
+                                           { static_cast<int32_t>(level.extent.width), static_cast<int32_t>(level.extent.height) } };
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, level.descriptorSet, nullptr);
+        commandBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants), &pushConstants);
+        commandBuffer.dispatch((level.extent.width + GROUP_SIZE - 1) / GROUP_SIZE, (level.extent.height + GROUP_SIZE - 1) / GROUP_SIZE, 1);
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderRead };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+        sourceSize = level.extent;
+    }
+
+    std::swap(depthBarrier.oldLayout, depthBarrier.newLayout);
+    depthBarrier.srcAccessMask = {};
+    depthBarrier.dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                  vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests, {}, nullptr, nullptr,
+                                  depthBarrier);
+}
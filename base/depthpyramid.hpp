@@ -0,0 +1,81 @@
+/*
+* Hierarchical depth buffer for occlusion tests in compute shaders
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+
+#include "vks/context.hpp"
+#include "vks/descriptors.hpp"
+#include "vks/image.hpp"
+
+namespace vkx {
+
+/**
+* @brief Mip chain of the farthest depth of a depth attachment
+*
+* Level 0 has half the size of the attachment, rounded up, and every level holds the largest depth of the 2x2
+* texels below it, clamped at the edges.  Texel t of level n therefore covers exactly the attachment texels
+* [t * 2^(n+1), (t + 1) * 2^(n+1)), so a screen rectangle whose corners fall into neighbouring texels of
+* some level is covered by those 2x2 texels, and an object whose nearest depth lies behind all of them is
+* hidden.  Depth is expected to grow with the distance, as with the usual less or equal depth test.
+*
+* build() records one dispatch per level after the render pass that wrote the attachment.  The pyramid stays
+* in the general layout, readers use texelFetch() on descriptor(), data/shaders/depthpyramid/depthpyramid.glsl
+* has the test of a sphere.  It starts out cleared to the far plane, so nothing counts as hidden before the
+* first build.
+*/
+class DepthPyramid {
+public:
+    // The sets of the levels are cached sets of `descriptorAllocator`
+    DepthPyramid(const vks::Context& context, vks::DescriptorAllocator& descriptorAllocator)
+        : context(context)
+        , descriptorAllocator(descriptorAllocator) {}
+
+    // `depth` needs sampled usage and is read through a depth only view.  Create the pyramid again whenever
+    // the attachment is recreated, after the cached sets of the allocator were cleared.
+    void create(const vks::Image& depth);
+    void destroy();
+
+    // Reduce the attachment, which is expected in the depth stencil attachment layout with its writes done by
+    // the fragment tests, and return it to that layout.  Ends with the pyramid visible to compute shaders.
+    void build(const vk::CommandBuffer& commandBuffer) const;
+
+    // All levels with a nearest sampler, in the general layout
+    vk::DescriptorImageInfo descriptor() const { return { pyramid.sampler, pyramid.view, vk::ImageLayout::eGeneral }; }
+    vk::Extent2D depthExtent() const { return { depthImageExtent.width, depthImageExtent.height }; }
+    uint32_t levelCount() const { return static_cast<uint32_t>(levels.size()); }
+
+private:
+    struct PushConstants {
+        int32_t sourceSize[2];
+        int32_t size[2];
+    };
+
+    struct Level {
+        vk::ImageView view;
+        vk::DescriptorSet descriptorSet;
+        vk::Extent2D extent;
+    };
+
+    const vks::Context& context;
+    const vk::Device& device{ context.device };
+    vks::DescriptorAllocator& descriptorAllocator;
+
+    vk::Image depthImage;
+    vk::Extent3D depthImageExtent;
+    vk::ImageAspectFlags depthAspect;
+    vk::ImageView depthView;
+
+    vks::Image pyramid;
+    std::vector<Level> levels;
+
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline pipeline;
+};
+
+}  // namespace vkx
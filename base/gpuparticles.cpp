@@ -0,0 +1,221 @@
+#include "gpuparticles.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <numeric>
+
+#include "vks/shaders.hpp"
+#include "utils.hpp"
+
+using namespace vkx;
+
+// Smallest list the sort handles, one workgroup of the local sort
+static const uint32_t SORT_BLOCK = 1024;
+
+void GpuParticles::create(uint32_t capacity) {
+    particleCapacity = 2 * SORT_BLOCK;
+    while (particleCapacity < capacity) {
+        particleCapacity *= 2;
+    }
+    maxEmitCount = particleCapacity / 8;
+    spawnRemainders.assign(MAX_EMITTERS, 0.0f);
+
+    uniform = context.createUniformBuffer(ubo);
+    particles = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, particleCapacity * sizeof(Particle));
+    // All slots start out free
+    std::vector<uint32_t> deadList(particleCapacity);
+    std::iota(deadList.begin(), deadList.end(), 0u);
+    dead = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, deadList);
+    alive = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, particleCapacity * sizeof(Entry));
+    survivors = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, particleCapacity * sizeof(Entry));
+    const Counters initialCounters{ static_cast<int32_t>(particleCapacity), 0, 0, 0, { 0, 1, 1, 0 }, { 0, 1, 0, 0 } };
+    counters = context.stageToDeviceBuffer(
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferSrc, initialCounters);
+    readback = context.createBuffer(vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                    sizeof(Counters));
+    readback.map();
+    memset(readback.mapped, 0, sizeof(Counters));
+
+    prepareDescriptors();
+    preparePipelines();
+}
+
+void GpuParticles::destroy() {
+    if (!particleCapacity) {
+        return;
+    }
+    for (auto pipeline : { pipelines.emit, pipelines.arguments, pipelines.simulate, pipelines.compact, pipelines.sortLocal, pipelines.sortGlobal }) {
+        device.destroyPipeline(pipeline);
+    }
+    device.destroyPipelineLayout(pipelineLayout);
+    device.destroyDescriptorSetLayout(descriptorSetLayout);
+    device.destroyDescriptorPool(descriptorPool);
+    for (auto* buffer : { &uniform, &particles, &dead, &alive, &survivors, &counters, &readback }) {
+        buffer->destroy();
+    }
+    particleCapacity = 0;
+}
+
+void GpuParticles::prepareDescriptors() {
+    std::vector<vk::DescriptorPoolSize> poolSizes = {
+        vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 1 },
+        vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 5 },
+    };
+    descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+
+    std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings = {
+        // Binding 0 : Emitters and frame parameters
+        { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 1 : Particle pool
+        { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 2 : Dead list
+        { 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 3 : Alive list
+        { 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 4 : Survivor list
+        { 4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 5 : Counters and indirect arguments
+        { 5, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+    };
+    descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+    descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+
+    std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
+        { descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniform.descriptor },
+        { descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &particles.descriptor },
+        { descriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &dead.descriptor },
+        { descriptorSet, 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &alive.descriptor },
+        { descriptorSet, 4, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &survivors.descriptor },
+        { descriptorSet, 5, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &counters.descriptor },
+    };
+    device.updateDescriptorSets(writeDescriptorSets, {});
+}
+
+void GpuParticles::preparePipelines() {
+    vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants) };
+    pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout, 1, &pushConstantRange });
+
+    auto createPipeline = [&](const std::string& name) {
+        vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+        computePipelineCreateInfo.layout = pipelineLayout;
+        computePipelineCreateInfo.stage =
+            vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/gpuparticles/" + name + ".comp.spv", vk::ShaderStageFlagBits::eCompute);
+        vk::Pipeline pipeline = device.createComputePipelines(context.pipelineCache, computePipelineCreateInfo)[0];
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+        return pipeline;
+    };
+    pipelines.emit = createPipeline("emit");
+    pipelines.arguments = createPipeline("arguments");
+    pipelines.simulate = createPipeline("simulate");
+    pipelines.compact = createPipeline("compact");
+    pipelines.sortLocal = createPipeline("sort_local");
+    pipelines.sortGlobal = createPipeline("sort_global");
+}
+
+void GpuParticles::addPasses(ComputeGraph& graph, bool sort) {
+    const auto particleResource = graph.addBuffer("particles", particles.buffer);
+    const auto deadResource = graph.addBuffer("dead list", dead.buffer);
+    const auto aliveResource = graph.addBuffer("alive list", alive.buffer);
+    const auto survivorResource = graph.addBuffer("survivors", survivors.buffer);
+    const auto counterResource = graph.addBuffer("counters", counters.buffer);
+
+    graph.addPass("Emit")
+        .pipeline(pipelineLayout, pipelines.emit)
+        .descriptorSet(descriptorSet)
+        .writes(particleResource)
+        .reads(deadResource)
+        .readsWrites(aliveResource)
+        .readsWrites(counterResource)
+        .dispatch((maxEmitCount + 63) / 64);
+    graph.addPass("Arguments").pipeline(pipelineLayout, pipelines.arguments).descriptorSet(descriptorSet).readsWrites(counterResource).dispatch(1);
+    graph.addPass("Simulate")
+        .pipeline(pipelineLayout, pipelines.simulate)
+        .descriptorSet(descriptorSet)
+        .readsWrites(particleResource)
+        .writes(deadResource)
+        .reads(aliveResource)
+        .writes(survivorResource)
+        .readsWrites(counterResource)
+        .dispatchIndirect(counterResource, offsetof(Counters, dispatch));
+    graph.addPass("Compact")
+        .pipeline(pipelineLayout, pipelines.compact)
+        .descriptorSet(descriptorSet)
+        .reads(survivorResource)
+        .writes(aliveResource)
+        .readsWrites(counterResource)
+        .dispatchIndirect(counterResource, offsetof(Counters, dispatch));
+
+    if (sort) {
+        // Bitonic sort over the whole list.  Merge steps with a distance below the block size run in shared
+        // memory, the larger ones take a pass each.
+        graph.addPass("Sort blocks")
+            .pipeline(pipelineLayout, pipelines.sortLocal)
+            .descriptorSet(descriptorSet)
+            .pushConstants(PushConstants{ 0, 0 })
+            .readsWrites(aliveResource)
+            .reads(counterResource)
+            .dispatch(particleCapacity / SORT_BLOCK);
+        for (uint32_t k = 2 * SORT_BLOCK; k <= particleCapacity; k *= 2) {
+            for (uint32_t j = k / 2; j >= SORT_BLOCK; j /= 2) {
+                graph.addPass("Sort merge " + std::to_string(k) + "/" + std::to_string(j))
+                    .pipeline(pipelineLayout, pipelines.sortGlobal)
+                    .descriptorSet(descriptorSet)
+                    .pushConstants(PushConstants{ k, j })
+                    .readsWrites(aliveResource)
+                    .dispatch(particleCapacity / 512);
+            }
+            graph.addPass("Sort merge " + std::to_string(k))
+                .pipeline(pipelineLayout, pipelines.sortLocal)
+                .descriptorSet(descriptorSet)
+                .pushConstants(PushConstants{ k, 0 })
+                .readsWrites(aliveResource)
+                .dispatch(particleCapacity / SORT_BLOCK);
+        }
+    }
+
+    // Copy the counters for the statistics, the host reads them without waiting
+    const vk::Buffer source = counters.buffer;
+    const vk::Buffer target = readback.buffer;
+    graph.addPass("Statistics").transfer().reads(counterResource).record([=](const vk::CommandBuffer& commandBuffer) {
+        commandBuffer.copyBuffer(source, target, vk::BufferCopy{ 0, 0, sizeof(Counters) });
+    });
+}
+
+void GpuParticles::update(float deltaT, const glm::mat4& view) {
+    const uint32_t emitterCount = std::min(static_cast<uint32_t>(emitters.size()), MAX_EMITTERS);
+    ubo.view = view;
+    ubo.gravity = glm::vec4(gravity, drag);
+    ubo.deltaT = deltaT;
+    ubo.emitterCount = emitterCount;
+    ++ubo.frame;
+
+    // Fractions of a particle carry over to the next frame, so low rates still spawn evenly
+    uint32_t emitCount = 0;
+    for (uint32_t i = 0; i < emitterCount; ++i) {
+        const Emitter& emitter = emitters[i];
+        const float spawn = spawnRemainders[i] + emitter.rate * deltaT;
+        const uint32_t spawnCount = std::min(static_cast<uint32_t>(spawn), maxEmitCount - emitCount);
+        spawnRemainders[i] = spawn - std::floor(spawn);
+
+        auto& target = ubo.emitters[i];
+        target.position = glm::vec4(emitter.position, emitter.radius);
+        target.velocity = glm::vec4(emitter.velocity, emitter.velocityVariation);
+        target.color = emitter.color;
+        target.lifetime = glm::vec2(emitter.minLifetime, emitter.maxLifetime);
+        target.firstSpawn = emitCount;
+        target.spawnCount = spawnCount;
+        emitCount += spawnCount;
+    }
+    ubo.emitCount = emitCount;
+    memcpy(uniform.mapped, &ubo, sizeof(ubo));
+}
+
+void GpuParticles::draw(const vk::CommandBuffer& commandBuffer) const {
+    commandBuffer.drawIndirect(counters.buffer, offsetof(Counters, draw), 1, 0);
+}
+
+uint32_t GpuParticles::aliveCount() const {
+    return static_cast<const Counters*>(readback.mapped)->draw[0];
+}
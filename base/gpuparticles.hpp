@@ -0,0 +1,156 @@
+/*
+* Particle emission, simulation and compaction running entirely in compute shaders
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vks/context.hpp"
+#include "computegraph.hpp"
+
+namespace vkx {
+
+/**
+* @brief Pool of particles that are spawned, simulated, recycled and drawn without reading anything back
+*
+* The particles live in a fixed pool.  Free slots are kept on a dead list, the slots in use on an alive list,
+* and a small counter buffer holds the list sizes next to the indirect dispatch and draw arguments.  Each
+* frame adds these passes to a vkx::ComputeGraph:
+*
+* - Emit: pop slots from the dead list, initialize them from the emitters and append them to the alive list
+* - Arguments: turn the alive count into the group count of the simulation
+* - Simulate (indirect): age and move the particles, push expired ones back onto the dead list and append
+*   the others with their view distance to the survivor list
+* - Compact (indirect): copy the survivors back to the alive list and set the vertex count of the draw
+* - Sort (optional): bitonic sort of the alive list by descending view distance, for blending modes that
+*   depend on the order.  Additive blending does not, so it can skip the sort.
+*
+* The CPU only writes the uniform buffer with the emitter parameters and the number of particles to spawn.
+* The vertex shader pulls the particles through the alive list, see draw().
+*/
+class GpuParticles {
+public:
+    static const uint32_t MAX_EMITTERS = 4;
+
+    struct Emitter {
+        glm::vec3 position;
+        float radius{ 1.0f };
+        glm::vec3 velocity;
+        // Speed added in a random direction
+        float velocityVariation{ 0.0f };
+        glm::vec4 color{ 1.0f };
+        float minLifetime{ 1.0f };
+        float maxLifetime{ 2.0f };
+        // Particles per second
+        float rate{ 1000.0f };
+    };
+
+    GpuParticles(const vks::Context& context)
+        : context(context) {}
+
+    // `capacity` is rounded up to a power of two of at least 2048, as required by the sort
+    void create(uint32_t capacity);
+    void destroy();
+
+    // Add the passes of one frame, the caller records and submits the graph
+    void addPasses(ComputeGraph& graph, bool sort);
+    // Accumulate the particles the emitters spawn within `deltaT` and update the uniform buffer.  The view
+    // matrix is used for the distances the sort orders by.
+    void update(float deltaT, const glm::mat4& view);
+    // Draw the alive particles as points, with the vertex index selecting the entry of the alive list
+    void draw(const vk::CommandBuffer& commandBuffer) const;
+
+    uint32_t capacity() const { return particleCapacity; }
+    // Read by the vertex shader: the pool of particles and the alive list
+    const vks::Buffer& particleBuffer() const { return particles; }
+    const vks::Buffer& aliveBuffer() const { return alive; }
+    // Number of particles drawn, copied to the host by the last pass and therefore a frame or two old
+    uint32_t aliveCount() const;
+
+    std::vector<Emitter> emitters;
+    // The examples look down positive y
+    glm::vec3 gravity{ 0.0f, 9.81f, 0.0f };
+    float drag{ 0.1f };
+
+private:
+    // Layouts of data/shaders/gpuparticles
+    struct Particle {
+        glm::vec4 position;
+        glm::vec4 velocity;
+        glm::vec4 color;
+    };
+
+    struct Entry {
+        float depth;
+        uint32_t index;
+    };
+
+    struct Counters {
+        int32_t dead;
+        uint32_t alive;
+        uint32_t simulate;
+        uint32_t pad0;
+        uint32_t dispatch[4];
+        uint32_t draw[4];
+    };
+
+    struct UBO {
+        glm::mat4 view;
+        glm::vec4 gravity;
+        float deltaT{ 0.0f };
+        uint32_t emitCount{ 0 };
+        uint32_t emitterCount{ 0 };
+        uint32_t frame{ 0 };
+        struct {
+            glm::vec4 position;
+            glm::vec4 velocity;
+            glm::vec4 color;
+            glm::vec2 lifetime;
+            uint32_t firstSpawn;
+            uint32_t spawnCount;
+        } emitters[MAX_EMITTERS];
+    } ubo;
+
+    struct PushConstants {
+        uint32_t k;
+        uint32_t j;
+    };
+
+    void prepareDescriptors();
+    void preparePipelines();
+
+    const vks::Context& context;
+    const vk::Device& device{ context.device };
+    uint32_t particleCapacity{ 0 };
+    // Upper bound of the particles spawned per frame, which sizes the emission dispatch
+    uint32_t maxEmitCount{ 0 };
+    std::vector<float> spawnRemainders;
+
+    vks::Buffer uniform;
+    vks::Buffer particles;
+    vks::Buffer dead;
+    vks::Buffer alive;
+    vks::Buffer survivors;
+    vks::Buffer counters;
+    vks::Buffer readback;
+
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorSet descriptorSet;
+    vk::PipelineLayout pipelineLayout;
+    struct {
+        vk::Pipeline emit;
+        vk::Pipeline arguments;
+        vk::Pipeline simulate;
+        vk::Pipeline compact;
+        vk::Pipeline sortLocal;
+        vk::Pipeline sortGlobal;
+    } pipelines;
+};
+
+}  // namespace vkx
@@ -0,0 +1,167 @@
+#include "heightmap.hpp"
+
+using namespace vkx;
+
+// Grid rows per task of the thread pool
+static const size_t ROW_TILE = 16;
+
+static_assert(sizeof(HeightMap::Vertex) == 8 * sizeof(float), "The heightmap kernel writes 8 tightly packed floats per vertex");
+
+void HeightMap::destroy() {
+    vertexBuffer.destroy();
+    indexBuffer.destroy();
+    staging.destroy();
+    vertexBufferSize = indexBufferSize = 0;
+}
+
+float HeightMap::getHeight(uint32_t x, uint32_t y) const {
+    glm::ivec2 rpos = glm::ivec2(x, y) * glm::ivec2(scale);
+    rpos.x = std::max(0, std::min(rpos.x, (int)heightDim - 1));
+    rpos.y = std::max(0, std::min(rpos.y, (int)heightDim - 1));
+    rpos /= glm::ivec2(scale);
+    size_t offset = (rpos.x + rpos.y * heightDim) * scale;
+    return heightdata[offset] / 65535.0f * heightScale;
+}
+
+void HeightMap::loadFromFile(const vks::Context& context, const std::string& filename, uint32_t patchsize, glm::vec3 scale, Topology topology) {
+    std::shared_ptr<gli::texture2d> tex2Dptr;
+    vks::file::withBinaryFileContents(filename, [&](size_t size, const void* data) {
+        tex2Dptr = std::make_shared<gli::texture2d>(gli::load((const char*)data, size));
+    });
+
+    const auto& heightTex = *tex2Dptr;
+    heightDim = static_cast<uint32_t>(heightTex.extent().x);
+    heightdata.resize(heightDim * heightDim);
+    memcpy(heightdata.data(), heightTex.data(), heightTex.size());
+
+    ThreadPool pool;
+    generate(context, patchsize, scale, topology, pool);
+}
+
+void HeightMap::generateVertices(uint32_t patchsize, glm::vec3 scale, ThreadPool& pool, simd::Backend backend, Vertex* target) {
+    assert(patchsize > 1 && heightDim >= patchsize);
+    this->scale = heightDim / patchsize;
+    this->heightScale = scale.y;
+
+    const float wx = 2.0f;
+    const float wy = 2.0f;
+    columnX.resize(patchsize);
+    columnU.resize(patchsize);
+    for (uint32_t x = 0; x < patchsize; x++) {
+        columnX[x] = (x * wx + wx / 2.0f - (float)patchsize * wx / 2.0f) * scale.x;
+        columnU[x] = (float)x / patchsize * uvScale;
+    }
+
+    // Row y of the grid is row y + 1 of the padded heights.  The border continues the slope of the edge, which
+    // gives twice the one sided difference there.
+    const size_t stride = patchsize + 2;
+    padded.resize(stride * stride);
+    pool.parallelFor(patchsize, ROW_TILE, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            float* row = padded.data() + (y + 1) * stride + 1;
+            const uint16_t* source = heightdata.data() + y * this->scale * heightDim;
+            for (uint32_t x = 0; x < patchsize; x++) {
+                row[x] = source[x * this->scale] / 65535.0f * heightScale;
+            }
+            row[-1] = 2.0f * row[0] - row[1];
+            row[patchsize] = 2.0f * row[patchsize - 1] - row[patchsize - 2];
+        }
+    });
+    float* first = padded.data() + stride + 1;
+    float* last = padded.data() + patchsize * stride + 1;
+    for (uint32_t x = 0; x < patchsize; x++) {
+        first[x - stride] = 2.0f * first[x] - first[x + stride];
+        last[x + stride] = 2.0f * last[x] - last[x - stride];
+    }
+
+    pool.parallelFor(patchsize, ROW_TILE, [&](size_t begin, size_t end) {
+        for (size_t y = begin; y < end; ++y) {
+            const simd::HeightmapRow row{ padded.data() + (y + 1) * stride + 1,
+                                          stride,
+                                          columnX.data(),
+                                          columnU.data(),
+                                          (y * wy + wy / 2.0f - (float)patchsize * wy / 2.0f) * scale.z,
+                                          (float)y / patchsize * uvScale };
+            simd::heightmapRow(backend, row, reinterpret_cast<float*>(target + y * patchsize), 0, patchsize);
+        }
+    });
+}
+
+uint32_t HeightMap::indexCountFor(uint32_t patchsize, Topology topology) {
+    return (patchsize - 1) * (patchsize - 1) * (topology == topologyTriangles ? 6 : 4);
+}
+
+void HeightMap::generateIndices(uint32_t patchsize, Topology topology, uint32_t* target) {
+    const uint32_t w = (patchsize - 1);
+    for (uint32_t y = 0; y < w; y++) {
+        for (uint32_t x = 0; x < w; x++) {
+            const uint32_t vertex = x + y * patchsize;
+            switch (topology) {
+                // Indices for triangles
+                case topologyTriangles: {
+                    uint32_t* indices = target + (x + y * w) * 6;
+                    indices[0] = vertex;
+                    indices[1] = vertex + patchsize;
+                    indices[2] = vertex + patchsize + 1;
+                    indices[3] = vertex + patchsize + 1;
+                    indices[4] = vertex + 1;
+                    indices[5] = vertex;
+                    break;
+                }
+                // Indices for quad patches (tessellation)
+                case topologyQuads: {
+                    uint32_t* indices = target + (x + y * w) * 4;
+                    indices[0] = vertex;
+                    indices[1] = vertex + patchsize;
+                    indices[2] = vertex + patchsize + 1;
+                    indices[3] = vertex + 1;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void HeightMap::generate(const vks::Context& context, uint32_t patchsize, glm::vec3 scale, Topology topology, ThreadPool& pool, simd::Backend backend) {
+    const size_t vertexSize = static_cast<size_t>(patchsize) * patchsize * sizeof(Vertex);
+    const uint32_t newIndexCount = indexCountFor(patchsize, topology);
+    const size_t indexSize = newIndexCount * sizeof(uint32_t);
+    assert(indexSize > 0);
+
+    // Buffers of the same sizes are kept, and so are the indices if the topology did not change either
+    const bool reuse = vertexBuffer && vertexSize == vertexBufferSize && indexSize == indexBufferSize;
+    const bool writeIndices = !reuse || topology != this->topology;
+    if (!reuse) {
+        destroy();
+        vertexBufferSize = vertexSize;
+        indexBufferSize = indexSize;
+        staging = context.createStagingBuffer(vertexBufferSize + indexBufferSize);
+        staging.map();
+        vertexBuffer = context.createDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst, vertexBufferSize);
+        indexBuffer = context.createDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst, indexBufferSize);
+    }
+
+    generateVertices(patchsize, scale, pool, backend, static_cast<Vertex*>(staging.mapped));
+    if (writeIndices) {
+        generateIndices(patchsize, topology, reinterpret_cast<uint32_t*>(static_cast<uint8_t*>(staging.mapped) + vertexBufferSize));
+    }
+    this->topology = topology;
+    indexCount = newIndexCount;
+
+    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& copyCmd) {
+        if (reuse) {
+            // Frames submitted before may still be drawing from the buffers
+            copyCmd.pipelineBarrier(vk::PipelineStageFlagBits::eVertexInput, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, nullptr);
+        }
+        copyCmd.copyBuffer(staging.buffer, vertexBuffer.buffer, vk::BufferCopy(0, 0, vertexBufferSize));
+        if (writeIndices) {
+            copyCmd.copyBuffer(staging.buffer, indexBuffer.buffer, vk::BufferCopy(vertexBufferSize, 0, indexBufferSize));
+        }
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eVertexAttributeRead | vk::AccessFlagBits::eIndexRead };
+        copyCmd.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eVertexInput, {}, barrier, nullptr, nullptr);
+    });
+}
+
+void vkx::simd::heightmapRow(Backend backend, const HeightmapRow& row, float* vertices, uint32_t begin, uint32_t end) {
+    VKX_SIMD_DISPATCH(heightmapRow(row, vertices, begin, end))
+}
@@ -0,0 +1,33 @@
+/*
+* Vertex generation kernel of vkx::HeightMap, see simd.hpp for the backends
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "simd.hpp"
+
+namespace vkx { namespace simd {
+
+// Heightmap terrain, see base/heightmap.hpp.  The heights are in world units and have a border of one sample
+// around the grid, so every vertex finds all four neighbours for its central differences without clamping.
+struct HeightmapRow {
+    // Height of the row's first column, the rows above and below start `stride` floats before and after it
+    const float* heights;
+    size_t stride;
+    // Positions along x and texture coordinates along u of the columns
+    const float* x;
+    const float* u;
+    float z;
+    float v;
+};
+
+// Write the vertices of the columns [begin, end) of `row`, vertex i at `vertices` + 8 * i as position, normal and
+// texture coordinate.  Positions are displaced along -y, normals are packed to [0, 1] like HeightMap always did.
+void heightmapRow(Backend backend, const HeightmapRow& row, float* vertices, uint32_t begin, uint32_t end);
+
+// Backend implementations, see heightmap_kernels.inl
+VKX_SIMD_DECLARE_KERNEL(void heightmapRow(const HeightmapRow& row, float* vertices, uint32_t begin, uint32_t end))
+
+}}  // namespace vkx::simd
@@ -0,0 +1,45 @@
+/*
+* Heightmap vertex kernel with central difference normals
+*
+* Included into the namespace of every backend after simd_kernels.inl
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+namespace kernels {
+
+template <typename P>
+inline void heightmapRow(const HeightmapRow& row, float* vertices, uint32_t i) {
+    const float* center = row.heights + i;
+    const P dx = P::load(center + 1) - P::load(center - 1);
+    const P dy = P::load(center + row.stride) - P::load(center - row.stride);
+    const P zero = P::set(0.0f), one = P::set(1.0f), half = P::set(0.5f);
+
+    // Same operations as (glm::normalize(glm::cross(vec3(1, 0, dx), vec3(0, 1, dy))) + 1) * 0.5, swizzled to xzy
+    const P inverseLength = one / P::sqrt(dx * dx + dy * dy + one);
+    float components[6][P::width];
+    P::load(row.x + i).store(components[0]);
+    (zero - P::load(center)).store(components[1]);
+    (((zero - dx) * inverseLength + one) * half).store(components[2]);
+    ((inverseLength + one) * half).store(components[3]);
+    (((zero - dy) * inverseLength + one) * half).store(components[4]);
+    P::load(row.u + i).store(components[5]);
+
+    for (uint32_t lane = 0; lane < P::width; ++lane) {
+        float* vertex = vertices + (i + lane) * 8;
+        vertex[0] = components[0][lane];
+        vertex[1] = components[1][lane];
+        vertex[2] = row.z;
+        vertex[3] = components[2][lane];
+        vertex[4] = components[3][lane];
+        vertex[5] = components[4][lane];
+        vertex[6] = components[5][lane];
+        vertex[7] = row.v;
+    }
+}
+
+}  // namespace kernels
+
+void heightmapRow(const HeightmapRow& row, float* vertices, uint32_t begin, uint32_t end) {
+    kernels::forRange(begin, end, [&](auto p, uint32_t i) { kernels::heightmapRow<decltype(p)>(row, vertices, i); });
+}
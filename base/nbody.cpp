@@ -0,0 +1,219 @@
+#include "nbody.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace vkx::nbody;
+
+// Bodies per task of the force pass, which touches every other body for each of them
+static const size_t FORCE_GRAIN = 64;
+static const size_t INTEGRATE_GRAIN = 16 * 1024;
+
+// Cells deeper than this only occur for (nearly) coincident particles and are kept as oversized leaves
+static const uint32_t MAX_TREE_DEPTH = 32;
+
+glm::vec3 vkx::nbody::accelerationExact(const std::vector<Particle>& particles, const glm::vec3& position, const Parameters& params) {
+    glm::vec3 result{ 0.0f };
+    for (const auto& particle : particles) {
+        result += interaction(position, particle.pos, params);
+    }
+    return result;
+}
+
+void Octree::build(const std::vector<Particle>& particles) {
+    nodes.clear();
+    maxDepth = 0;
+    bodies.resize(particles.size());
+    order.resize(particles.size());
+    if (particles.empty()) {
+        return;
+    }
+
+    glm::vec3 boundsMin{ particles[0].pos }, boundsMax{ particles[0].pos };
+    for (size_t i = 0; i < particles.size(); ++i) {
+        bodies[i] = particles[i].pos;
+        order[i] = static_cast<uint32_t>(i);
+        boundsMin = glm::min(boundsMin, glm::vec3(particles[i].pos));
+        boundsMax = glm::max(boundsMax, glm::vec3(particles[i].pos));
+    }
+    glm::vec3 extent = boundsMax - boundsMin;
+    float halfSize = std::max(std::max(extent.x, extent.y), extent.z) * 0.5f;
+    nodes.reserve(particles.size() / leafSize * 2 + 1);
+    buildNode((boundsMin + boundsMax) * 0.5f, halfSize, 0, static_cast<uint32_t>(particles.size()), 0);
+}
+
+uint32_t Octree::buildNode(const glm::vec3& center, float halfSize, uint32_t first, uint32_t count, uint32_t depth) {
+    const uint32_t index = static_cast<uint32_t>(nodes.size());
+    nodes.push_back({});
+    maxDepth = std::max(maxDepth, depth);
+
+    Node node;
+    node.center = center;
+    node.halfSize = halfSize;
+    node.first = first;
+    node.count = count;
+    std::fill(std::begin(node.children), std::end(node.children), -1);
+
+    // Mass and center of mass over all contained particles
+    glm::vec3 weighted{ 0.0f };
+    float mass = 0.0f;
+    for (uint32_t i = first; i < first + count; ++i) {
+        const auto& body = bodies[order[i]];
+        weighted += glm::vec3(body) * body.w;
+        mass += body.w;
+    }
+    node.centerOfMass = glm::vec4(mass > 0.0f ? weighted / mass : center, mass);
+
+    if (count > leafSize && depth < MAX_TREE_DEPTH) {
+        // Partition the range into octants, split on x, then y within each half, then z within each quarter
+        auto begin = order.begin() + first;
+        auto end = begin + count;
+        auto side = [&](int axis) { return [&, axis](uint32_t i) { return bodies[i][axis] < center[axis]; }; };
+        decltype(begin) bounds[9];
+        bounds[0] = begin;
+        bounds[8] = end;
+        bounds[4] = std::partition(bounds[0], bounds[8], side(0));
+        bounds[2] = std::partition(bounds[0], bounds[4], side(1));
+        bounds[6] = std::partition(bounds[4], bounds[8], side(1));
+        for (int i = 1; i < 8; i += 2) {
+            bounds[i] = std::partition(bounds[i - 1], bounds[i + 1], side(2));
+        }
+
+        const float childHalfSize = halfSize * 0.5f;
+        for (int octant = 0; octant < 8; ++octant) {
+            uint32_t childCount = static_cast<uint32_t>(bounds[octant + 1] - bounds[octant]);
+            if (childCount == 0) {
+                continue;
+            }
+            // Octant bits are x:4, y:2, z:1 with a set bit meaning the upper half
+            glm::vec3 offset{ (octant & 4) ? childHalfSize : -childHalfSize, (octant & 2) ? childHalfSize : -childHalfSize,
+                              (octant & 1) ? childHalfSize : -childHalfSize };
+            uint32_t childFirst = static_cast<uint32_t>(bounds[octant] - order.begin());
+            node.children[octant] = static_cast<int32_t>(buildNode(center + offset, childHalfSize, childFirst, childCount, depth + 1));
+        }
+    }
+
+    nodes[index] = node;
+    return index;
+}
+
+glm::vec3 Octree::acceleration(const glm::vec3& position, float theta, const Parameters& params) const {
+    glm::vec3 result{ 0.0f };
+    if (nodes.empty()) {
+        return result;
+    }
+
+    const float theta2 = theta * theta;
+    std::vector<uint32_t> stack;
+    stack.reserve(8 * (maxDepth + 1));
+    stack.push_back(0);
+    while (!stack.empty()) {
+        const Node& node = nodes[stack.back()];
+        stack.pop_back();
+
+        glm::vec3 delta = glm::vec3(node.centerOfMass) - position;
+        float size = node.halfSize * 2.0f;
+        if (size * size < theta2 * glm::dot(delta, delta)) {
+            // Far enough away to act as a single body
+            result += interaction(position, node.centerOfMass, params);
+            continue;
+        }
+
+        bool leaf = true;
+        for (auto child : node.children) {
+            if (child >= 0) {
+                stack.push_back(static_cast<uint32_t>(child));
+                leaf = false;
+            }
+        }
+        if (leaf) {
+            for (uint32_t i = node.first; i < node.first + node.count; ++i) {
+                result += interaction(position, bodies[order[i]], params);
+            }
+        }
+    }
+    return result;
+}
+
+ErrorStats vkx::nbody::compare(const std::vector<glm::vec3>& reference, const std::vector<glm::vec3>& approximation) {
+    ErrorStats result;
+    const size_t count = std::min(reference.size(), approximation.size());
+    double sum = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        float magnitude = glm::length(reference[i]);
+        if (magnitude <= 0.0f) {
+            continue;
+        }
+        float error = glm::length(approximation[i] - reference[i]) / magnitude;
+        result.maxRelative = std::max(result.maxRelative, error);
+        sum += error;
+        ++result.samples;
+    }
+    if (result.samples > 0) {
+        result.meanRelative = static_cast<float>(sum / result.samples);
+    }
+    return result;
+}
+
+void Simulation::load(const Particle* particles, size_t count) {
+    for (auto* values : { &x, &y, &z, &mass, &vx, &vy, &vz, &gradient, &ax, &ay, &az }) {
+        values->resize(count);
+    }
+    for (size_t i = 0; i < count; ++i) {
+        x[i] = particles[i].pos.x;
+        y[i] = particles[i].pos.y;
+        z[i] = particles[i].pos.z;
+        mass[i] = particles[i].pos.w;
+        vx[i] = particles[i].vel.x;
+        vy[i] = particles[i].vel.y;
+        vz[i] = particles[i].vel.z;
+        gradient[i] = particles[i].vel.w;
+    }
+}
+
+void Simulation::store(Particle* particles) const {
+    for (size_t i = 0; i < size(); ++i) {
+        particles[i].pos = glm::vec4(x[i], y[i], z[i], mass[i]);
+        particles[i].vel = glm::vec4(vx[i], vy[i], vz[i], gradient[i]);
+    }
+}
+
+vkx::simd::NBodyArrays Simulation::arrays() {
+    return { x.data(), y.data(), z.data(), mass.data(), vx.data(), vy.data(), vz.data(), gradient.data(), ax.data(), ay.data(), az.data(),
+             static_cast<uint32_t>(size()) };
+}
+
+void Simulation::step(float deltaT, const Parameters& params, ThreadPool& pool, simd::Backend backend) {
+    const simd::NBodyArrays bodies = arrays();
+    const simd::NBodyConstants constants{ params.gravity, params.power, params.soften, deltaT };
+    // All forces have to be known before the first body moves
+    pool.parallelFor(size(), FORCE_GRAIN, [&](size_t begin, size_t end) {
+        simd::nbodyForces(backend, bodies, constants, static_cast<uint32_t>(begin), static_cast<uint32_t>(end));
+    });
+    pool.parallelFor(size(), INTEGRATE_GRAIN, [&](size_t begin, size_t end) {
+        simd::nbodyIntegrate(backend, bodies, constants, static_cast<uint32_t>(begin), static_cast<uint32_t>(end));
+    });
+}
+
+vkx::simd::Comparison Simulation::compare(const Particle* reference, const simd::Tolerance& tolerance) const {
+    simd::Comparison result;
+    for (size_t i = 0; i < size(); ++i) {
+        result.add(reference[i].pos.x, x[i], tolerance);
+        result.add(reference[i].pos.y, y[i], tolerance);
+        result.add(reference[i].pos.z, z[i], tolerance);
+        result.add(reference[i].pos.w, mass[i], tolerance);
+        result.add(reference[i].vel.x, vx[i], tolerance);
+        result.add(reference[i].vel.y, vy[i], tolerance);
+        result.add(reference[i].vel.z, vz[i], tolerance);
+        result.add(reference[i].vel.w, gradient[i], tolerance);
+    }
+    return result;
+}
+
+void vkx::simd::nbodyForces(Backend backend, const NBodyArrays& bodies, const NBodyConstants& constants, uint32_t begin, uint32_t end) {
+    VKX_SIMD_DISPATCH(nbodyForces(bodies, constants, begin, end))
+}
+
+void vkx::simd::nbodyIntegrate(Backend backend, const NBodyArrays& bodies, const NBodyConstants& constants, uint32_t begin, uint32_t end) {
+    VKX_SIMD_DISPATCH(nbodyIntegrate(bodies, constants, begin, end))
+}
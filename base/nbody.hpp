@@ -0,0 +1,115 @@
+/*
+* CPU reference for the N-body compute examples
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "nbody_kernels.hpp"
+#include "threadpool.hpp"
+
+namespace vkx { namespace nbody {
+
+// Same layout as the particle storage buffer of the computenbody example
+struct Particle {
+    glm::vec4 pos;  // xyz = position, w = mass
+    glm::vec4 vel;  // xyz = velocity, w = gradient texture position
+};
+
+// Force parameters, matching the specialization constants of the compute shaders
+struct Parameters {
+    float gravity{ 0.002f };
+    float power{ 0.75f };
+    float soften{ 0.05f };
+};
+
+// Acceleration a body of the given mass (w) at `source` induces at `position`
+inline glm::vec3 interaction(const glm::vec3& position, const glm::vec4& source, const Parameters& params) {
+    glm::vec3 len = glm::vec3(source) - position;
+    return params.gravity * len * source.w / powf(glm::dot(len, len) + params.soften, params.power);
+}
+
+// All pairs acceleration at `position`, the same sum particle_calculate.comp evaluates
+glm::vec3 accelerationExact(const std::vector<Particle>& particles, const glm::vec3& position, const Parameters& params);
+
+/**
+* @brief Octree for Barnes-Hut force approximation
+*
+* Cells are split until they hold at most `leafSize` particles.  A cell is treated as a single body at its
+* center of mass when its size divided by the distance to that center is below the opening angle `theta`.
+* This CPU reference and the GPU tree kernel are both checked against accelerationExact().
+*/
+class Octree {
+public:
+    explicit Octree(uint32_t leafSize = 8)
+        : leafSize(leafSize) {}
+
+    void build(const std::vector<Particle>& particles);
+    glm::vec3 acceleration(const glm::vec3& position, float theta, const Parameters& params) const;
+
+    size_t nodeCount() const { return nodes.size(); }
+    uint32_t depth() const { return maxDepth; }
+
+private:
+    struct Node {
+        glm::vec4 centerOfMass;  // w = total mass
+        glm::vec3 center;
+        float halfSize;
+        int32_t children[8];  // -1 when absent, all absent for leaves
+        uint32_t first;       // Leaves : range of `order`
+        uint32_t count;
+    };
+
+    uint32_t buildNode(const glm::vec3& center, float halfSize, uint32_t first, uint32_t count, uint32_t depth);
+
+    uint32_t leafSize;
+    uint32_t maxDepth{ 0 };
+    std::vector<Node> nodes;
+    std::vector<uint32_t> order;
+    std::vector<glm::vec4> bodies;
+};
+
+// Relative error of a set of approximated accelerations against reference values
+struct ErrorStats {
+    float maxRelative{ 0.0f };
+    float meanRelative{ 0.0f };
+    uint32_t samples{ 0 };
+};
+
+ErrorStats compare(const std::vector<glm::vec3>& reference, const std::vector<glm::vec3>& approximation);
+
+/**
+* @brief All pairs simulation on the CPU
+*
+* Keeps the particles as structure of arrays and steps them with the same two passes as
+* particle_calculate.comp and particle_integrate.comp, spread over a thread pool.  Used as an alternative
+* to the GPU and to check its results.
+*/
+class Simulation {
+public:
+    void load(const Particle* particles, size_t count);
+    void store(Particle* particles) const;
+    void step(float deltaT, const Parameters& params, ThreadPool& pool, simd::Backend backend);
+
+    size_t size() const { return x.size(); }
+    // Pairwise interactions evaluated by one step
+    uint64_t interactionsPerStep() const { return static_cast<uint64_t>(size()) * size(); }
+
+    // Positions and velocities against the same step computed elsewhere, e.g. downloaded from the GPU
+    simd::Comparison compare(const Particle* reference, const simd::Tolerance& tolerance = { 64, 1e-6f }) const;
+
+private:
+    simd::NBodyArrays arrays();
+
+    std::vector<float> x, y, z, mass;
+    std::vector<float> vx, vy, vz, gradient;
+    std::vector<float> ax, ay, az;
+};
+
+}}  // namespace vkx::nbody
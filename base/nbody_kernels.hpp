@@ -0,0 +1,46 @@
+/*
+* N-body force and integration kernels of vkx::nbody::Simulation, see simd.hpp for the backends
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "simd.hpp"
+
+namespace vkx { namespace simd {
+
+// N-body, see data/shaders/computenbody/particle_calculate.comp and particle_integrate.comp
+struct NBodyArrays {
+    float* x;
+    float* y;
+    float* z;
+    float* mass;
+    float* vx;
+    float* vy;
+    float* vz;
+    float* gradient;
+    // Accelerations of the last force pass
+    float* ax;
+    float* ay;
+    float* az;
+    uint32_t count;
+};
+
+struct NBodyConstants {
+    float gravity;
+    float power;
+    float soften;
+    float deltaT;
+};
+
+// Accumulate the forces on the bodies in [begin, end) from all bodies and update their velocities
+void nbodyForces(Backend backend, const NBodyArrays& bodies, const NBodyConstants& constants, uint32_t begin, uint32_t end);
+// Move the bodies in [begin, end) by their velocities
+void nbodyIntegrate(Backend backend, const NBodyArrays& bodies, const NBodyConstants& constants, uint32_t begin, uint32_t end);
+
+// Backend implementations, see nbody_kernels.inl
+VKX_SIMD_DECLARE_KERNEL(void nbodyForces(const NBodyArrays& bodies, const NBodyConstants& constants, uint32_t begin, uint32_t end))
+VKX_SIMD_DECLARE_KERNEL(void nbodyIntegrate(const NBodyArrays& bodies, const NBodyConstants& constants, uint32_t begin, uint32_t end))
+
+}}  // namespace vkx::simd
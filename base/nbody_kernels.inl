@@ -0,0 +1,75 @@
+/*
+* N-body kernels, mirroring particle_calculate.comp and particle_integrate.comp
+*
+* Included into the namespace of every backend after simd_kernels.inl
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+namespace kernels {
+
+template <typename P>
+inline P nbodyPower(const P& value, float power) {
+    // The example uses an exponent of 0.75, which only needs two square roots
+    if (power == 0.75f) {
+        P root = P::sqrt(value);
+        return root * P::sqrt(root);
+    }
+    return P::pow(value, power);
+}
+
+template <typename P>
+inline void nbodyForces(const NBodyArrays& bodies, const NBodyConstants& constants, uint32_t i) {
+    const P px = P::load(bodies.x + i);
+    const P py = P::load(bodies.y + i);
+    const P pz = P::load(bodies.z + i);
+    const P gravity = P::set(constants.gravity);
+    const P soften = P::set(constants.soften);
+    P ax = P::set(0.0f), ay = P::set(0.0f), az = P::set(0.0f);
+
+    for (uint32_t j = 0; j < bodies.count; ++j) {
+        const P dx = P::set(bodies.x[j]) - px;
+        const P dy = P::set(bodies.y[j]) - py;
+        const P dz = P::set(bodies.z[j]) - pz;
+        const P distance2 = dx * dx + dy * dy + dz * dz + soften;
+        const P scale = gravity * P::set(bodies.mass[j]) / nbodyPower(distance2, constants.power);
+        ax = ax + dx * scale;
+        ay = ay + dy * scale;
+        az = az + dz * scale;
+    }
+
+    ax.store(bodies.ax + i);
+    ay.store(bodies.ay + i);
+    az.store(bodies.az + i);
+
+    const P deltaT = P::set(constants.deltaT);
+    (P::load(bodies.vx + i) + deltaT * ax).store(bodies.vx + i);
+    (P::load(bodies.vy + i) + deltaT * ay).store(bodies.vy + i);
+    (P::load(bodies.vz + i) + deltaT * az).store(bodies.vz + i);
+
+    // Gradient texture position
+    const P one = P::set(1.0f);
+    P gradient = P::load(bodies.gradient + i) + P::set(0.1f) * deltaT;
+    gradient = P::select(P::greater(gradient, one), gradient - one, gradient);
+    gradient.store(bodies.gradient + i);
+}
+
+template <typename P>
+inline void nbodyIntegrate(const NBodyArrays& bodies, const NBodyConstants& constants, uint32_t i) {
+    const P deltaT = P::set(constants.deltaT);
+    (P::load(bodies.x + i) + deltaT * P::load(bodies.vx + i)).store(bodies.x + i);
+    (P::load(bodies.y + i) + deltaT * P::load(bodies.vy + i)).store(bodies.y + i);
+    (P::load(bodies.z + i) + deltaT * P::load(bodies.vz + i)).store(bodies.z + i);
+    // The shader integrates the whole vec4, so the mass drifts with the gradient position
+    (P::load(bodies.mass + i) + deltaT * P::load(bodies.gradient + i)).store(bodies.mass + i);
+}
+
+}  // namespace kernels
+
+void nbodyForces(const NBodyArrays& bodies, const NBodyConstants& constants, uint32_t begin, uint32_t end) {
+    kernels::forRange(begin, end, [&](auto p, uint32_t i) { kernels::nbodyForces<decltype(p)>(bodies, constants, i); });
+}
+
+void nbodyIntegrate(const NBodyArrays& bodies, const NBodyConstants& constants, uint32_t begin, uint32_t end) {
+    kernels::forRange(begin, end, [&](auto p, uint32_t i) { kernels::nbodyIntegrate<decltype(p)>(bodies, constants, i); });
+}
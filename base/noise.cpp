@@ -0,0 +1,290 @@
+#include "noise.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <numeric>
+#include <utility>
+
+#include "vks/shaders.hpp"
+#include "random.hpp"
+#include "utils.hpp"
+
+using namespace vkx::noise;
+
+// Rows per task of the thread pool
+static const size_t ROW_TILE = 16;
+
+Tables::Tables(uint64_t seed) {
+    // Fisher-Yates shuffle of 0..255
+    std::array<uint32_t, 256> lookup;
+    std::iota(lookup.begin(), lookup.end(), 0u);
+    Random random(seed);
+    for (uint32_t i = 255; i > 0; --i) {
+        std::swap(lookup[i], lookup[random.next() % (i + 1)]);
+    }
+
+    for (uint32_t i = 0; i < 512; ++i) {
+        const uint32_t hash = lookup[i & 255];
+        indices[i] = hash;
+        permutation[i] = static_cast<float>(hash);
+
+        // The low 4 bits select one of 12 gradient directions, written out as the vector the reference
+        // implementation forms from the hash
+        const uint32_t h = hash & 15;
+        float gradient[3]{ 0.0f, 0.0f, 0.0f };
+        const uint32_t u = h < 8 ? 0 : 1;
+        const uint32_t v = h < 4 ? 1 : (h == 12 || h == 14) ? 0 : 2;
+        gradient[u] = (h & 1) == 0 ? 1.0f : -1.0f;
+        gradient[v] = (h & 2) == 0 ? 1.0f : -1.0f;
+        gradientX[i] = gradient[0];
+        gradientY[i] = gradient[1];
+        gradientZ[i] = gradient[2];
+    }
+}
+
+static float fade(float t) {
+    return t * t * t * (t * (t * 6.0f - 15.0f) + 10.0f);
+}
+
+static float lerp(float t, float a, float b) {
+    return a + t * (b - a);
+}
+
+static float grad(uint32_t hash, float x, float y, float z) {
+    // Convert LO 4 bits of hash code into 12 gradient directions
+    uint32_t h = hash & 15;
+    float u = h < 8 ? x : y;
+    float v = h < 4 ? y : h == 12 || h == 14 ? x : z;
+    return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
+}
+
+// Translation of Ken Perlin's JAVA implementation (http://mrl.nyu.edu/~perlin/noise/)
+float vkx::noise::referencePerlin(const Tables& tables, float x, float y, float z) {
+    const auto& p = tables.indices;
+    // Find unit cube that contains point
+    int32_t X = (int32_t)std::floor(x) & 255;
+    int32_t Y = (int32_t)std::floor(y) & 255;
+    int32_t Z = (int32_t)std::floor(z) & 255;
+    // Find relative x,y,z of point in cube
+    x -= std::floor(x);
+    y -= std::floor(y);
+    z -= std::floor(z);
+
+    // Compute fade curves for each of x,y,z
+    float u = fade(x);
+    float v = fade(y);
+    float w = fade(z);
+
+    // Hash coordinates of the 8 cube corners
+    uint32_t A = p[X] + Y;
+    uint32_t AA = p[A] + Z;
+    uint32_t AB = p[A + 1] + Z;
+    uint32_t B = p[X + 1] + Y;
+    uint32_t BA = p[B] + Z;
+    uint32_t BB = p[B + 1] + Z;
+
+    // And add blended results for 8 corners of the cube;
+    return lerp(w,
+                lerp(v, lerp(u, grad(p[AA], x, y, z), grad(p[BA], x - 1, y, z)), lerp(u, grad(p[AB], x, y - 1, z), grad(p[BB], x - 1, y - 1, z))),
+                lerp(v, lerp(u, grad(p[AA + 1], x, y, z - 1), grad(p[BA + 1], x - 1, y, z - 1)),
+                     lerp(u, grad(p[AB + 1], x, y - 1, z - 1), grad(p[BB + 1], x - 1, y - 1, z - 1))));
+}
+
+float vkx::noise::referenceFractal(const Tables& tables, const Parameters& parameters, float x, float y, float z) {
+    float sum = 0;
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    float max = 0.0f;
+    for (uint32_t i = 0; i < parameters.octaves; i++) {
+        sum += referencePerlin(tables, x * frequency, y * frequency, z * frequency) * amplitude;
+        max += amplitude;
+        amplitude *= parameters.persistence;
+        frequency *= parameters.lacunarity;
+    }
+
+    sum = sum / max;
+    return (sum + 1.0f) / 2.0f;
+}
+
+static vkx::simd::NoiseConstants constants(const Parameters& parameters) {
+    return { parameters.type == Type::simplex, parameters.octaves, parameters.persistence, parameters.lacunarity };
+}
+
+// Noise space coordinate of voxel `i` out of `count`
+static float coordinate(uint32_t i, uint32_t count, float scale) {
+    return ((float)i / (float)count) * scale;
+}
+
+// Only the fractional part is kept, which wraps the rare values of one and above around
+static uint8_t toByte(float n) {
+    n = n - std::floor(n);
+    return static_cast<uint8_t>(std::floor(n * 255));
+}
+
+void vkx::noise::generate(const Tables& tables,
+                          const Parameters& parameters,
+                          uint32_t width,
+                          uint32_t height,
+                          uint32_t depth,
+                          ThreadPool& pool,
+                          simd::Backend backend,
+                          uint8_t* target) {
+    const simd::NoiseTables view = tables.view();
+    const simd::NoiseConstants noiseConstants = constants(parameters);
+    std::vector<float> columns(width);
+    for (uint32_t x = 0; x < width; ++x) {
+        columns[x] = coordinate(x, width, parameters.scale);
+    }
+
+    pool.parallelFor(static_cast<size_t>(height) * depth, ROW_TILE, [&](size_t begin, size_t end) {
+        std::vector<float> values(width);
+        for (size_t rowIndex = begin; rowIndex < end; ++rowIndex) {
+            const uint32_t y = static_cast<uint32_t>(rowIndex % height);
+            const uint32_t z = static_cast<uint32_t>(rowIndex / height);
+            const simd::NoiseRow row{ columns.data(), coordinate(y, height, parameters.scale), coordinate(z, depth, parameters.scale), values.data() };
+            simd::noiseFractal(backend, view, noiseConstants, row, 0, width);
+            uint8_t* bytes = target + rowIndex * width;
+            for (uint32_t x = 0; x < width; ++x) {
+                bytes[x] = toByte(values[x]);
+            }
+        }
+    });
+}
+
+Quality vkx::noise::compareWithReference(const Tables& tables,
+                                         const Parameters& parameters,
+                                         uint32_t width,
+                                         uint32_t height,
+                                         uint32_t depth,
+                                         ThreadPool& pool,
+                                         simd::Backend backend,
+                                         uint32_t stride) {
+    Parameters perlin = parameters;
+    perlin.type = Type::perlin;
+    const simd::NoiseTables view = tables.view();
+    const simd::NoiseConstants noiseConstants = constants(perlin);
+    std::vector<float> columns(width);
+    for (uint32_t x = 0; x < width; ++x) {
+        columns[x] = coordinate(x, width, perlin.scale);
+    }
+
+    // Both sides are evaluated in parallel, the comparison runs afterwards
+    const uint32_t rowsY = (height + stride - 1) / stride;
+    const uint32_t rowsZ = (depth + stride - 1) / stride;
+    const uint32_t samplesX = (width + stride - 1) / stride;
+    std::vector<float> expected(static_cast<size_t>(rowsY) * rowsZ * samplesX);
+    std::vector<float> actual(expected.size());
+    pool.parallelFor(static_cast<size_t>(rowsY) * rowsZ, 1, [&](size_t begin, size_t end) {
+        std::vector<float> values(width);
+        for (size_t rowIndex = begin; rowIndex < end; ++rowIndex) {
+            const uint32_t y = static_cast<uint32_t>(rowIndex % rowsY) * stride;
+            const uint32_t z = static_cast<uint32_t>(rowIndex / rowsY) * stride;
+            const float ny = coordinate(y, height, perlin.scale);
+            const float nz = coordinate(z, depth, perlin.scale);
+            simd::noiseFractal(backend, view, noiseConstants, { columns.data(), ny, nz, values.data() }, 0, width);
+            for (uint32_t i = 0; i < samplesX; ++i) {
+                expected[rowIndex * samplesX + i] = referenceFractal(tables, perlin, columns[i * stride], ny, nz);
+                actual[rowIndex * samplesX + i] = values[i * stride];
+            }
+        }
+    });
+
+    Quality quality;
+    for (size_t i = 0; i < expected.size(); ++i) {
+        quality.values.add(expected[i], actual[i], simd::Tolerance{});
+        const int32_t difference = std::abs(static_cast<int32_t>(toByte(expected[i])) - static_cast<int32_t>(toByte(actual[i])));
+        ++quality.bytesCompared;
+        if (difference != 0) {
+            ++quality.bytesDiffering;
+            quality.maxByteDifference = std::max(quality.maxByteDifference, static_cast<uint32_t>(difference));
+        }
+    }
+    return quality;
+}
+
+void ComputeGenerator::create() {
+    permutation = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer,
+                                       vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, sizeof(Tables::indices));
+    permutation.map();
+
+    vk::DescriptorPoolSize poolSize{ vk::DescriptorType::eStorageBuffer, 2 };
+    descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 1, 1, &poolSize });
+    std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+        // Binding 0 : Permutation
+        { 0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 1 : Voxels, four per word
+        { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+    };
+    descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+    descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+    vk::WriteDescriptorSet writeDescriptorSet{ descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &permutation.descriptor };
+    device.updateDescriptorSets(writeDescriptorSet, nullptr);
+
+    vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants) };
+    pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout, 1, &pushConstantRange });
+    vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+    computePipelineCreateInfo.layout = pipelineLayout;
+    computePipelineCreateInfo.stage =
+        vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/noise/fractal.comp.spv", vk::ShaderStageFlagBits::eCompute);
+    pipeline = device.createComputePipelines(context.pipelineCache, computePipelineCreateInfo)[0];
+    device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+}
+
+void ComputeGenerator::destroy() {
+    device.destroyPipeline(pipeline);
+    device.destroyPipelineLayout(pipelineLayout);
+    device.destroyDescriptorSetLayout(descriptorSetLayout);
+    device.destroyDescriptorPool(descriptorPool);
+    permutation.destroy();
+    voxels.destroy();
+}
+
+double ComputeGenerator::generate(const Tables& tables, const Parameters& parameters, const vk::Extent3D& extent, const vk::Image& image) {
+    const vk::DeviceSize size = static_cast<vk::DeviceSize>(extent.width) * extent.height * extent.depth;
+    if (!voxels || voxels.size < size) {
+        context.device.waitIdle();
+        voxels.destroy();
+        voxels = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc, size);
+        vk::WriteDescriptorSet writeDescriptorSet{ descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &voxels.descriptor };
+        device.updateDescriptorSets(writeDescriptorSet, nullptr);
+    }
+    memcpy(permutation.mapped, tables.indices.data(), sizeof(tables.indices));
+
+    PushConstants pushConstants;
+    pushConstants.width = extent.width;
+    pushConstants.height = extent.height;
+    pushConstants.depth = extent.depth;
+    pushConstants.octaves = parameters.octaves;
+    pushConstants.scale = parameters.scale;
+    pushConstants.persistence = parameters.persistence;
+    pushConstants.lacunarity = parameters.lacunarity;
+    pushConstants.simplex = parameters.type == Type::simplex ? 1 : 0;
+
+    auto tStart = std::chrono::high_resolution_clock::now();
+    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+        commandBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants), &pushConstants);
+        // 8 x 8 invocations per group, each covering four voxels of a row
+        commandBuffer.dispatch((extent.width / 4 + 7) / 8, (extent.height + 7) / 8, extent.depth);
+
+        vk::BufferMemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eTransferRead, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED,
+                                         voxels.buffer, 0, size };
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, barrier, nullptr);
+
+        context.setImageLayout(commandBuffer, image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
+        vk::BufferImageCopy bufferCopyRegion;
+        bufferCopyRegion.imageSubresource.aspectMask = vk::ImageAspectFlagBits::eColor;
+        bufferCopyRegion.imageSubresource.layerCount = 1;
+        bufferCopyRegion.imageExtent = extent;
+        commandBuffer.copyBufferToImage(voxels.buffer, image, vk::ImageLayout::eTransferDstOptimal, bufferCopyRegion);
+        context.setImageLayout(commandBuffer, image, vk::ImageAspectFlagBits::eColor, vk::ImageLayout::eTransferDstOptimal,
+                               vk::ImageLayout::eShaderReadOnlyOptimal);
+    });
+    return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+}
+
+void vkx::simd::noiseFractal(Backend backend, const NoiseTables& tables, const NoiseConstants& constants, const NoiseRow& row, uint32_t begin, uint32_t end) {
+    VKX_SIMD_DISPATCH(noiseFractal(tables, constants, row, begin, end))
+}
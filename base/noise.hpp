@@ -0,0 +1,123 @@
+/*
+* Procedural Perlin and simplex noise volumes, generated on the CPU or with a compute shader
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "vks/context.hpp"
+#include "noise_kernels.hpp"
+#include "threadpool.hpp"
+
+namespace vkx { namespace noise {
+
+enum class Type
+{
+    perlin = 0,
+    simplex = 1,
+};
+
+struct Parameters {
+    Type type{ Type::perlin };
+    // Noise cells across the volume at the lowest octave
+    float scale{ 8.0f };
+    uint32_t octaves{ 6 };
+    // Amplitude and frequency factors from one octave to the next
+    float persistence{ 0.5f };
+    float lacunarity{ 2.0f };
+};
+
+// Permutation of the lattice hashes and the gradients they select, shared by all implementations
+struct Tables {
+    explicit Tables(uint64_t seed = 0);
+
+    simd::NoiseTables view() const { return { permutation.data(), gradientX.data(), gradientY.data(), gradientZ.data() }; }
+
+    // The permutation of 0..255 repeated twice, as uploaded to the compute shader
+    std::array<uint32_t, 512> indices;
+    // The same as floats for the SIMD kernels, and the gradient of each entry
+    std::array<float, 512> permutation;
+    std::array<float, 512> gradientX;
+    std::array<float, 512> gradientY;
+    std::array<float, 512> gradientZ;
+};
+
+// Ken Perlin's improved noise as the texture3d example evaluated it so far, one voxel at a time.  Kept as
+// the reference the vectorized kernels are compared against.
+float referencePerlin(const Tables& tables, float x, float y, float z);
+float referenceFractal(const Tables& tables, const Parameters& parameters, float x, float y, float z);
+
+/**
+* @brief Fill an 8 bit volume with fractal noise
+*
+* Rows of voxels are distributed over the thread pool in tiles of a few rows and evaluated with the SIMD
+* kernels, which process 8 (AVX2) or 4 (NEON) voxels at a time.  The bytes are written straight to
+* `target`, e.g. a mapped staging buffer, in x-major order.  The result does not depend on the number of
+* threads, and only in the last bits of the intermediate values on the backend.
+*/
+void generate(const Tables& tables,
+              const Parameters& parameters,
+              uint32_t width,
+              uint32_t height,
+              uint32_t depth,
+              ThreadPool& pool,
+              simd::Backend backend,
+              uint8_t* target);
+
+// Differences of the vectorized Perlin noise to referenceFractal(), over every `stride`th voxel in each dimension
+struct Quality {
+    simd::Comparison values;
+    size_t bytesCompared{ 0 };
+    size_t bytesDiffering{ 0 };
+    uint32_t maxByteDifference{ 0 };
+};
+Quality compareWithReference(const Tables& tables, const Parameters& parameters, uint32_t width, uint32_t height, uint32_t depth, ThreadPool& pool,
+                             simd::Backend backend, uint32_t stride = 4);
+
+/**
+* @brief Compute shader version of generate()
+*
+* Each invocation evaluates four consecutive voxels of a row and packs them into one word of a storage
+* buffer, which is then copied to the image.  Going through a buffer avoids the optional storage image
+* support for 8 bit formats.
+*/
+class ComputeGenerator {
+public:
+    ComputeGenerator(const vks::Context& context)
+        : context(context) {}
+
+    void create();
+    void destroy();
+
+    // Fill the R8 `image` and leave it in shader read only layout.  The image needs transfer destination
+    // usage and a width that is a multiple of four.  Waits for the GPU and returns the time taken in ms.
+    double generate(const Tables& tables, const Parameters& parameters, const vk::Extent3D& extent, const vk::Image& image);
+
+private:
+    struct PushConstants {
+        uint32_t width;
+        uint32_t height;
+        uint32_t depth;
+        uint32_t octaves;
+        float scale;
+        float persistence;
+        float lacunarity;
+        uint32_t simplex;
+    };
+
+    const vks::Context& context;
+    const vk::Device& device{ context.device };
+    vks::Buffer permutation;
+    vks::Buffer voxels;
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorSet descriptorSet;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline pipeline;
+};
+
+}}  // namespace vkx::noise
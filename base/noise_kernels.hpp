@@ -0,0 +1,46 @@
+/*
+* Fractal noise kernel of the volume generators in noise.hpp, see simd.hpp for the backends
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "simd.hpp"
+
+namespace vkx { namespace simd {
+
+// Procedural noise, see base/noise.hpp and data/shaders/noise/fractal.comp.  The tables hold 512 entries
+// indexed by lattice coordinates: the permutation of 0..255 repeated twice, and for each entry the gradient
+// its permuted hash selects.  All values are integers or gradient components stored as floats, so the kernels
+// can look them up with float indices.
+struct NoiseTables {
+    const float* permutation;
+    const float* gradientX;
+    const float* gradientY;
+    const float* gradientZ;
+};
+
+// One row of a volume: noise space coordinates of its columns in `x`, results in `values`
+struct NoiseRow {
+    const float* x;
+    float y;
+    float z;
+    float* values;
+};
+
+struct NoiseConstants {
+    // Simplex instead of improved Perlin noise
+    bool simplex;
+    uint32_t octaves;
+    float persistence;
+    float lacunarity;
+};
+
+// Fractal sum of the noise octaves for the columns [begin, end) of `row`, scaled to [0, 1]
+void noiseFractal(Backend backend, const NoiseTables& tables, const NoiseConstants& constants, const NoiseRow& row, uint32_t begin, uint32_t end);
+
+// Backend implementations, see noise_kernels.inl
+VKX_SIMD_DECLARE_KERNEL(void noiseFractal(const NoiseTables& tables, const NoiseConstants& constants, const NoiseRow& row, uint32_t begin, uint32_t end))
+
+}}  // namespace vkx::simd
@@ -0,0 +1,142 @@
+/*
+* Improved Perlin and simplex noise kernels, matching the references in noise.hpp
+*
+* Included into the namespace of every backend after simd_kernels.inl
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+namespace kernels {
+
+template <typename P>
+inline P noiseFade(const P& t) {
+    return t * t * t * (t * (t * P::set(6.0f) - P::set(15.0f)) + P::set(10.0f));
+}
+
+template <typename P>
+inline P noiseLerp(const P& t, const P& a, const P& b) {
+    return a + t * (b - a);
+}
+
+// Integral lattice coordinate modulo 256.  All steps are exact, so this matches `(int)value & 255`.
+template <typename P>
+inline P noiseWrap(const P& value) {
+    return value - P::floor(value * P::set(1.0f / 256.0f)) * P::set(256.0f);
+}
+
+// Dot product with the gradient selected by the permuted hash of `index`.  The gradients have two non-zero
+// components of magnitude one, so the sum is the same as the one of the reference implementation.
+template <typename P>
+inline P noiseGradient(const NoiseTables& tables, const P& index, const P& x, const P& y, const P& z) {
+    return P::gather(tables.gradientX, index) * x + P::gather(tables.gradientY, index) * y + P::gather(tables.gradientZ, index) * z;
+}
+
+// Improved Perlin noise, operation by operation like vkx::noise::referencePerlin()
+template <typename P>
+inline P perlinNoise(const NoiseTables& tables, P x, P y, P z) {
+    const P one = P::set(1.0f);
+    // Unit cube containing the point, and the position within it
+    const P fx = P::floor(x);
+    const P fy = P::floor(y);
+    const P fz = P::floor(z);
+    const P X = noiseWrap(fx);
+    const P Y = noiseWrap(fy);
+    const P Z = noiseWrap(fz);
+    x = x - fx;
+    y = y - fy;
+    z = z - fz;
+    const P u = noiseFade(x);
+    const P v = noiseFade(y);
+    const P w = noiseFade(z);
+
+    // Hash coordinates of the 8 cube corners
+    const P A = P::gather(tables.permutation, X) + Y;
+    const P AA = P::gather(tables.permutation, A) + Z;
+    const P AB = P::gather(tables.permutation, A + one) + Z;
+    const P B = P::gather(tables.permutation, X + one) + Y;
+    const P BA = P::gather(tables.permutation, B) + Z;
+    const P BB = P::gather(tables.permutation, B + one) + Z;
+
+    const P x1 = x - one;
+    const P y1 = y - one;
+    const P z1 = z - one;
+    return noiseLerp(w,
+                     noiseLerp(v, noiseLerp(u, noiseGradient(tables, AA, x, y, z), noiseGradient(tables, BA, x1, y, z)),
+                               noiseLerp(u, noiseGradient(tables, AB, x, y1, z), noiseGradient(tables, BB, x1, y1, z))),
+                     noiseLerp(v, noiseLerp(u, noiseGradient(tables, AA + one, x, y, z1), noiseGradient(tables, BA + one, x1, y, z1)),
+                               noiseLerp(u, noiseGradient(tables, AB + one, x, y1, z1), noiseGradient(tables, BB + one, x1, y1, z1))));
+}
+
+// Simplex noise on the same tables, with the simplex picked from the coordinate order without branches
+template <typename P>
+inline P simplexNoise(const NoiseTables& tables, const P& x, const P& y, const P& z) {
+    const P zero = P::set(0.0f);
+    const P one = P::set(1.0f);
+    const P G3 = P::set(1.0f / 6.0f);
+
+    // Skew to find the cell, then unskew its origin back to get the offset to the first corner
+    const P s = (x + y + z) * P::set(1.0f / 3.0f);
+    const P i = P::floor(x + s);
+    const P j = P::floor(y + s);
+    const P k = P::floor(z + s);
+    const P t = (i + j + k) * G3;
+    const P x0 = x - (i - t);
+    const P y0 = y - (j - t);
+    const P z0 = z - (k - t);
+
+    // Offsets of the second and third corner, from comparisons stored as 0 and 1
+    const P xy = P::select(P::less(x0, y0), zero, one);
+    const P yz = P::select(P::less(y0, z0), zero, one);
+    const P xz = P::select(P::less(x0, z0), zero, one);
+    const P i1 = xy * xz;
+    const P j1 = (one - xy) * yz;
+    const P k1 = (one - xz) * (one - yz);
+    const P i2 = xy + xz - xy * xz;
+    const P j2 = (one - xy) + yz - (one - xy) * yz;
+    const P k2 = one - xz * yz;
+
+    const P ii = noiseWrap(i);
+    const P jj = noiseWrap(j);
+    const P kk = noiseWrap(k);
+    auto corner = [&](const P& di, const P& dj, const P& dk, const P& cx, const P& cy, const P& cz) {
+        const P index = ii + di + P::gather(tables.permutation, jj + dj + P::gather(tables.permutation, kk + dk));
+        P falloff = P::set(0.6f) - cx * cx - cy * cy - cz * cz;
+        falloff = P::select(P::less(falloff, zero), zero, falloff);
+        falloff = falloff * falloff;
+        return falloff * falloff * noiseGradient(tables, index, cx, cy, cz);
+    };
+    const P G3x2 = G3 * P::set(2.0f);
+    const P G3x3 = P::set(0.5f);
+    const P n0 = corner(zero, zero, zero, x0, y0, z0);
+    const P n1 = corner(i1, j1, k1, x0 - i1 + G3, y0 - j1 + G3, z0 - k1 + G3);
+    const P n2 = corner(i2, j2, k2, x0 - i2 + G3x2, y0 - j2 + G3x2, z0 - k2 + G3x2);
+    const P n3 = corner(one, one, one, x0 - one + G3x3, y0 - one + G3x3, z0 - one + G3x3);
+    return P::set(32.0f) * (n0 + n1 + n2 + n3);
+}
+
+template <typename P>
+inline void noiseFractal(const NoiseTables& tables, const NoiseConstants& constants, const NoiseRow& row, uint32_t i) {
+    const P x = P::load(row.x + i);
+    const P y = P::set(row.y);
+    const P z = P::set(row.z);
+    P sum = P::set(0.0f);
+    // Octave parameters are the same for all lanes
+    float frequency = 1.0f;
+    float amplitude = 1.0f;
+    float max = 0.0f;
+    for (uint32_t octave = 0; octave < constants.octaves; ++octave) {
+        const P f = P::set(frequency);
+        const P n = constants.simplex ? simplexNoise(tables, x * f, y * f, z * f) : perlinNoise(tables, x * f, y * f, z * f);
+        sum = sum + n * P::set(amplitude);
+        max += amplitude;
+        amplitude *= constants.persistence;
+        frequency *= constants.lacunarity;
+    }
+    ((sum / P::set(max) + P::set(1.0f)) / P::set(2.0f)).store(row.values + i);
+}
+
+}  // namespace kernels
+
+void noiseFractal(const NoiseTables& tables, const NoiseConstants& constants, const NoiseRow& row, uint32_t begin, uint32_t end) {
+    kernels::forRange(begin, end, [&](auto p, uint32_t i) { kernels::noiseFractal<decltype(p)>(tables, constants, row, i); });
+}
@@ -0,0 +1,202 @@
+#include "occlusionculling.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "vks/frustum.hpp"
+#include "vks/shaders.hpp"
+#include "utils.hpp"
+
+using namespace vkx;
+
+// Flags of the uniform buffer, see cull.comp
+static const uint32_t CULL_FRUSTUM = 1;
+static const uint32_t CULL_OCCLUSION = 2;
+// Objects per workgroup, one per invocation
+static const uint32_t GROUP_SIZE = 64;
+
+void OcclusionCulling::create(const std::vector<Object>& objectList) {
+    count = static_cast<uint32_t>(objectList.size());
+    ubo.objectCount = count;
+    const uint32_t slots = std::max(count, 1u);
+    // Every buffer gets at least one slot
+    std::vector<Object> initialObjects = objectList;
+    initialObjects.resize(slots);
+    firstInstances.clear();
+    if (!context.enabledFeatures.drawIndirectFirstInstance) {
+        // The draws rebind the instance buffer instead, see drawPhase()
+        for (const auto& object : objectList) {
+            firstInstances.push_back(object.firstInstance);
+        }
+        for (auto& object : initialObjects) {
+            object.firstInstance = 0;
+        }
+    }
+
+    uniform = context.createUniformBuffer(ubo);
+    objects = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, initialObjects);
+    visibility = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, std::vector<uint32_t>(slots, 1));
+    draws = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer,
+                                       vk::DeviceSize(2 * slots) * sizeof(vk::DrawIndexedIndirectCommand));
+    counters = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc, Statistics{});
+    readback = context.createBuffer(vk::BufferUsageFlagBits::eTransferDst, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                    sizeof(Statistics));
+    readback.map();
+    memset(readback.mapped, 0, sizeof(Statistics));
+
+    std::vector<vk::DescriptorPoolSize> poolSizes = {
+        vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 1 },
+        vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 4 },
+        vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 1 },
+    };
+    descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+    std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings = {
+        // Binding 0 : Camera and flags
+        { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 1 : Bounds and draws of the objects
+        { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 2 : Visibility of the last frame
+        { 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 3 : Draw commands of both phases
+        { 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 4 : Statistics
+        { 4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 5 : Depth pyramid
+        { 5, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute },
+    };
+    descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+    descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+    std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
+        { descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniform.descriptor },
+        { descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &objects.descriptor },
+        { descriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &visibility.descriptor },
+        { descriptorSet, 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &draws.descriptor },
+        { descriptorSet, 4, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &counters.descriptor },
+    };
+    device.updateDescriptorSets(writeDescriptorSets, {});
+
+    vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants) };
+    pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout, 1, &pushConstantRange });
+    vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+    computePipelineCreateInfo.layout = pipelineLayout;
+    computePipelineCreateInfo.stage =
+        vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/occlusionculling/cull.comp.spv", vk::ShaderStageFlagBits::eCompute);
+    pipeline = device.createComputePipelines(context.pipelineCache, computePipelineCreateInfo)[0];
+    device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+}
+
+void OcclusionCulling::destroy() {
+    if (!pipeline) {
+        return;
+    }
+    device.destroyPipeline(pipeline);
+    device.destroyPipelineLayout(pipelineLayout);
+    device.destroyDescriptorSetLayout(descriptorSetLayout);
+    device.destroyDescriptorPool(descriptorPool);
+    for (auto* buffer : { &uniform, &objects, &visibility, &draws, &counters, &readback }) {
+        buffer->destroy();
+    }
+    pipeline = nullptr;
+    count = 0;
+    firstInstances.clear();
+}
+
+void OcclusionCulling::setDepthPyramid(const DepthPyramid& pyramid) {
+    const vk::Extent2D extent = pyramid.depthExtent();
+    ubo.depthSize = glm::vec2(extent.width, extent.height);
+    ubo.levelCount = pyramid.levelCount();
+    uniform.copy(ubo);
+    const vk::DescriptorImageInfo imageInfo = pyramid.descriptor();
+    device.updateDescriptorSets(vk::WriteDescriptorSet{ descriptorSet, 5, 0, 1, vk::DescriptorType::eCombinedImageSampler, &imageInfo }, nullptr);
+}
+
+void OcclusionCulling::setInstanceBuffer(uint32_t binding, const vk::Buffer& buffer, vk::DeviceSize stride) {
+    instanceBinding = binding;
+    instanceBuffer = buffer;
+    instanceStride = stride;
+}
+
+void OcclusionCulling::update(const glm::mat4& viewProjection) {
+    ubo.viewProjection = viewProjection;
+    vks::Frustum frustum;
+    frustum.update(viewProjection);
+    std::copy(frustum.planes.begin(), frustum.planes.end(), ubo.frustumPlanes);
+    ubo.flags = (frustumCulling ? CULL_FRUSTUM : 0) | (occlusionCulling ? CULL_OCCLUSION : 0);
+    uniform.copy(ubo);
+}
+
+void OcclusionCulling::dispatch(const vk::CommandBuffer& commandBuffer, uint32_t phase) const {
+    if (!count) {
+        return;
+    }
+    const PushConstants pushConstants{ phase };
+    commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+    commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+    commandBuffer.pushConstants(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants), &pushConstants);
+    commandBuffer.dispatch((count + GROUP_SIZE - 1) / GROUP_SIZE, 1, 1);
+}
+
+void OcclusionCulling::cullFirstPhase(const vk::CommandBuffer& commandBuffer) const {
+    // The draws, the statistics copy and the visibility writes of the previous frame are done
+    vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite,
+                               vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite | vk::AccessFlagBits::eTransferWrite };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader,
+                                  vk::PipelineStageFlagBits::eTransfer | vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+    const Statistics reset{};
+    commandBuffer.updateBuffer(counters.buffer, 0, sizeof(Statistics), &reset);
+    barrier = vk::MemoryBarrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+
+    dispatch(commandBuffer, 0);
+
+    // The second phase updates the statistics again
+    barrier = vk::MemoryBarrier{ vk::AccessFlagBits::eShaderWrite,
+                                 vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                  vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+}
+
+void OcclusionCulling::cullSecondPhase(const vk::CommandBuffer& commandBuffer) const {
+    // DepthPyramid::build() made the pyramid visible to compute shaders
+    dispatch(commandBuffer, 1);
+
+    vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eIndirectCommandRead | vk::AccessFlagBits::eTransferRead };
+    commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader,
+                                  vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eTransfer, {}, barrier, nullptr, nullptr);
+    commandBuffer.copyBuffer(counters.buffer, readback.buffer, vk::BufferCopy{ 0, 0, sizeof(Statistics) });
+}
+
+void OcclusionCulling::drawPhase(const vk::CommandBuffer& commandBuffer, uint32_t phase) const {
+    const uint32_t stride = sizeof(vk::DrawIndexedIndirectCommand);
+    const vk::DeviceSize offset = vk::DeviceSize(phase) * std::max(count, 1u) * stride;
+    if (!context.enabledFeatures.drawIndirectFirstInstance) {
+        // The commands start at instance 0, so every object gets its instance data bound at its first instance
+        for (uint32_t i = 0; i < count; ++i) {
+            if (instanceBuffer) {
+                const vk::DeviceSize instanceOffset = firstInstances[i] * instanceStride;
+                commandBuffer.bindVertexBuffers(instanceBinding, instanceBuffer, instanceOffset);
+            }
+            commandBuffer.drawIndexedIndirect(draws.buffer, offset + i * stride, 1, stride);
+        }
+    } else if (context.enabledFeatures.multiDrawIndirect) {
+        commandBuffer.drawIndexedIndirect(draws.buffer, offset, count, stride);
+    } else {
+        for (uint32_t i = 0; i < count; ++i) {
+            commandBuffer.drawIndexedIndirect(draws.buffer, offset + i * stride, 1, stride);
+        }
+    }
+}
+
+void OcclusionCulling::drawFirstPhase(const vk::CommandBuffer& commandBuffer) const {
+    drawPhase(commandBuffer, 0);
+}
+
+void OcclusionCulling::drawSecondPhase(const vk::CommandBuffer& commandBuffer) const {
+    drawPhase(commandBuffer, 1);
+}
+
+OcclusionCulling::Statistics OcclusionCulling::statistics() const {
+    Statistics result;
+    memcpy(&result, readback.mapped, sizeof(Statistics));
+    return result;
+}
@@ -0,0 +1,132 @@
+/*
+* Two phase occlusion culling of many objects against a hierarchical depth buffer
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vks/context.hpp"
+#include "depthpyramid.hpp"
+
+namespace vkx {
+
+/**
+* @brief Visibility of objects decided on the GPU, written straight into indexed indirect draws
+*
+* Every object is a bounding sphere with the draw that renders it.  A frame draws in two phases:
+*
+* - cullFirstPhase(): the objects that were visible in the last frame and lie inside the frustum
+* - drawFirstPhase(), in a render pass that clears the attachments, together with any occluders that are
+*   never culled.  Then build the vkx::DepthPyramid from that depth.
+* - cullSecondPhase(): every object in the frustum is tested against the new pyramid with the matrix of this
+*   frame.  The result is remembered for the next frame, and the objects that pass but were not drawn in the
+*   first phase go to the second draw.
+* - drawSecondPhase(), in a render pass that loads the attachments of the first one.
+*
+* Objects that come out from behind an occluder are therefore drawn in the frame they become visible, and
+* objects that stop being visible are dropped a frame later.  Each draw command gets an instance count of one
+* or zero, the objects keep their slots, and the host never waits for a result.
+*
+* The commands start at the first instance of their object only if the device has drawIndirectFirstInstance
+* enabled.  Without it they start at instance 0 and every object is drawn by its own call, with the buffer
+* given to setInstanceBuffer() bound at the object's first instance.
+*/
+class OcclusionCulling {
+public:
+    // Laid out for std430, see data/shaders/occlusionculling/cull.comp
+    struct Object {
+        glm::vec3 center;
+        float radius{ 0.0f };
+        uint32_t indexCount{ 0 };
+        uint32_t firstIndex{ 0 };
+        int32_t vertexOffset{ 0 };
+        // Usually the object number, to fetch per object data through instanced attributes, see setInstanceBuffer()
+        uint32_t firstInstance{ 0 };
+    };
+
+    // Objects drawn in each phase and culled by each test, copied to the host after every second phase
+    struct Statistics {
+        uint32_t firstPhase{ 0 };
+        uint32_t secondPhase{ 0 };
+        uint32_t frustumCulled{ 0 };
+        uint32_t occlusionCulled{ 0 };
+    };
+
+    OcclusionCulling(const vks::Context& context)
+        : context(context) {}
+
+    // All objects start out visible, so the first frame draws everything in the frustum in the first phase
+    void create(const std::vector<Object>& objects);
+    void destroy();
+
+    // Pyramid built between the phases.  Has to be set before the first frame, and again whenever the pyramid
+    // was created anew.
+    void setDepthPyramid(const DepthPyramid& pyramid);
+    // Vertex buffer of the instanced attributes, rebound at every object's first instance by the draws when the
+    // device lacks drawIndirectFirstInstance.  The binding is left at the data of the last object.
+    void setInstanceBuffer(uint32_t binding, const vk::Buffer& buffer, vk::DeviceSize stride);
+    // Camera of the frame about to be recorded
+    void update(const glm::mat4& viewProjection);
+
+    // Both outside of a render pass
+    void cullFirstPhase(const vk::CommandBuffer& commandBuffer) const;
+    void cullSecondPhase(const vk::CommandBuffer& commandBuffer) const;
+    // Draw with the index and vertex buffers the caller bound.  A single multi draw if the device has
+    // multiDrawIndirect and drawIndirectFirstInstance enabled, one indirect draw per object otherwise.
+    void drawFirstPhase(const vk::CommandBuffer& commandBuffer) const;
+    void drawSecondPhase(const vk::CommandBuffer& commandBuffer) const;
+
+    Statistics statistics() const;
+    uint32_t objectCount() const { return count; }
+
+    bool frustumCulling{ true };
+    bool occlusionCulling{ true };
+
+private:
+    struct UBO {
+        glm::mat4 viewProjection;
+        glm::vec4 frustumPlanes[6];
+        glm::vec2 depthSize;
+        uint32_t levelCount{ 0 };
+        uint32_t flags{ 0 };
+        uint32_t objectCount{ 0 };
+    } ubo;
+
+    struct PushConstants {
+        uint32_t phase;
+    };
+
+    void dispatch(const vk::CommandBuffer& commandBuffer, uint32_t phase) const;
+    void drawPhase(const vk::CommandBuffer& commandBuffer, uint32_t phase) const;
+
+    const vks::Context& context;
+    const vk::Device& device{ context.device };
+    uint32_t count{ 0 };
+    // Kept on the host for devices without drawIndirectFirstInstance, whose commands start at instance 0
+    std::vector<uint32_t> firstInstances;
+    uint32_t instanceBinding{ 0 };
+    vk::Buffer instanceBuffer;
+    vk::DeviceSize instanceStride{ 0 };
+
+    vks::Buffer uniform;
+    vks::Buffer objects;
+    // Result of the last second phase, one value per object
+    vks::Buffer visibility;
+    // The commands of the first phase followed by the ones of the second
+    vks::Buffer draws;
+    vks::Buffer counters;
+    vks::Buffer readback;
+
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorSet descriptorSet;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline pipeline;
+};
+
+}  // namespace vkx
@@ -0,0 +1,186 @@
+#include "particles.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+using namespace vkx::particles;
+
+static const size_t UPDATE_GRAIN = 16 * 1024;
+static const float PI = 3.14159265358979f;
+
+void FireSystem::create(size_t count, const Emitter& emitter, uint64_t seed) {
+    this->emitter = emitter;
+    this->seed = seed;
+    frame = 0;
+    for (auto* values : { &x, &y, &z, &vx, &vy, &vz, &shade, &alpha, &pointSize, &rotation, &rotationSpeed }) {
+        values->resize(count);
+    }
+    chunks.resize((count + UPDATE_GRAIN - 1) / UPDATE_GRAIN);
+
+    // Start with flames only, faded by their height
+    Random random(seed);
+    for (uint32_t i = 0; i < count; ++i) {
+        spawnFlame(i, random);
+        alpha[i] = 1.0f - (std::abs(y[i]) / (emitter.radius * 2.0f));
+    }
+    flames = count;
+}
+
+vkx::simd::FireArrays FireSystem::arrays() {
+    return {
+        x.data(), y.data(), z.data(), vx.data(), vy.data(), vz.data(), shade.data(), alpha.data(), pointSize.data(), rotation.data(), rotationSpeed.data(),
+    };
+}
+
+void FireSystem::spawnFlame(uint32_t i, Random& random) {
+    vx[i] = 0.0f;
+    vy[i] = emitter.minVel.y + random.uniform(emitter.maxVel.y - emitter.minVel.y);
+    vz[i] = 0.0f;
+    alpha[i] = random.uniform(0.75f);
+    pointSize[i] = 1.0f + random.uniform(0.5f);
+    shade[i] = 1.0f;
+    rotation[i] = random.uniform(2.0f * PI);
+    rotationSpeed[i] = random.uniform(2.0f) - random.uniform(2.0f);
+
+    // Random point in the emitter sphere
+    const float theta = random.uniform(2.0f * PI);
+    const float phi = random.uniform(PI) - PI / 2.0f;
+    const float r = random.uniform(emitter.radius);
+    x[i] = emitter.position.x + r * std::cos(theta) * std::cos(phi);
+    y[i] = emitter.position.y + r * std::sin(phi);
+    z[i] = emitter.position.z + r * std::sin(theta) * std::cos(phi);
+}
+
+void FireSystem::spawnSmoke(uint32_t target, uint32_t source, Random& random) {
+    x[target] = x[source] * 0.5f;
+    y[target] = y[source];
+    z[target] = z[source] * 0.5f;
+    rotation[target] = rotation[source];
+    alpha[target] = 0.0f;
+    shade[target] = 0.25f + random.uniform(0.25f);
+    vx[target] = random.uniform(1.0f) - random.uniform(1.0f);
+    vy[target] = (emitter.minVel.y * 2.0f) + random.uniform(emitter.maxVel.y - emitter.minVel.y);
+    vz[target] = random.uniform(1.0f) - random.uniform(1.0f);
+    pointSize[target] = 1.0f + random.uniform(0.5f);
+    rotationSpeed[target] = random.uniform(1.0f) - random.uniform(1.0f);
+}
+
+void FireSystem::swap(uint32_t a, uint32_t b) {
+    for (auto* values : { &x, &y, &z, &vx, &vy, &vz, &shade, &alpha, &pointSize, &rotation, &rotationSpeed }) {
+        std::swap((*values)[a], (*values)[b]);
+    }
+}
+
+void FireSystem::writeVertices(Vertex* vertices, size_t begin, size_t end) const {
+    for (size_t i = begin; i < end; ++i) {
+        Vertex& vertex = vertices[i];
+        vertex.pos = glm::vec3(x[i], y[i], z[i]);
+        vertex.color = glm::vec3(shade[i]);
+        vertex.alpha = alpha[i];
+        vertex.size = pointSize[i];
+        vertex.rotation = rotation[i];
+        vertex.type = i < flames ? Type::flame : Type::smoke;
+    }
+}
+
+void FireSystem::update(float deltaT, ThreadPool& pool, simd::Backend backend, Vertex* vertices) {
+    const simd::FireConstants constants{ deltaT, deltaT * 0.45f };
+    const uint64_t frameSeed = seed ^ Random::mix(++frame);
+
+    // Chunks are handed out one by one, so their boundaries do not depend on the size of the pool
+    pool.parallelFor(chunks.size(), 1, [&](size_t chunkBegin, size_t chunkEnd) {
+        for (size_t chunkIndex = chunkBegin; chunkIndex < chunkEnd; ++chunkIndex) {
+            updateChunk(chunkIndex, constants, backend, frameSeed, vertices);
+        }
+    });
+
+    resolveTransitions(vertices);
+}
+
+void FireSystem::updateChunk(size_t chunkIndex, const simd::FireConstants& constants, simd::Backend backend, uint64_t frameSeed, Vertex* vertices) {
+    const size_t begin = chunkIndex * UPDATE_GRAIN;
+    const size_t end = std::min(size(), begin + UPDATE_GRAIN);
+    Chunk& chunk = chunks[chunkIndex];
+    chunk.toSmoke.clear();
+    chunk.toFlame.clear();
+    Random random(frameSeed, chunkIndex);
+
+    const simd::FireArrays particles = arrays();
+    const size_t split = std::min(std::max(flames, begin), end);
+    simd::fireFlameUpdate(backend, particles, constants, static_cast<uint32_t>(begin), static_cast<uint32_t>(split));
+    simd::fireSmokeUpdate(backend, particles, constants, static_cast<uint32_t>(split), static_cast<uint32_t>(end));
+
+    // Transition burnt out particles
+    for (uint32_t i = static_cast<uint32_t>(begin); i < split; ++i) {
+        if (alpha[i] > 2.0f) {
+            if (random.uniform() < emitter.smokeChance) {
+                chunk.toSmoke.push_back(i);
+            } else {
+                spawnFlame(i, random);
+            }
+        }
+    }
+    for (uint32_t i = static_cast<uint32_t>(split); i < end; ++i) {
+        if (alpha[i] > 2.0f) {
+            chunk.toFlame.push_back(i);
+        }
+    }
+
+    writeVertices(vertices, begin, end);
+}
+
+void FireSystem::resolveTransitions(Vertex* vertices) {
+    std::vector<uint32_t> toSmoke, toFlame;
+    for (const auto& chunk : chunks) {
+        toSmoke.insert(toSmoke.end(), chunk.toSmoke.begin(), chunk.toSmoke.end());
+        toFlame.insert(toFlame.end(), chunk.toFlame.begin(), chunk.toFlame.end());
+    }
+    if (toSmoke.empty() && toFlame.empty()) {
+        return;
+    }
+
+    // Stream after the ones of the chunks
+    Random random(seed ^ Random::mix(frame), chunks.size());
+    auto rewrite = [&](uint32_t i) { writeVertices(vertices, i, i + 1); };
+
+    // Pairs trade places, so both ranges keep their size
+    const size_t pairs = std::min(toSmoke.size(), toFlame.size());
+    for (size_t i = 0; i < pairs; ++i) {
+        spawnSmoke(toFlame[i], toSmoke[i], random);
+        spawnFlame(toSmoke[i], random);
+        rewrite(toFlame[i]);
+        rewrite(toSmoke[i]);
+    }
+
+    // Surplus flames move to the end of the flame range, which then shrinks by one.  Going from the highest
+    // index down, the last flame is never one that still waits for its transition.
+    for (size_t i = toSmoke.size(); i-- > pairs;) {
+        const uint32_t last = static_cast<uint32_t>(--flames);
+        swap(toSmoke[i], last);
+        spawnSmoke(last, last, random);
+        rewrite(toSmoke[i]);
+        rewrite(last);
+    }
+
+    // Surplus smoke moves to the start of the smoke range, which then becomes a flame
+    for (size_t i = pairs; i < toFlame.size(); ++i) {
+        const uint32_t first = static_cast<uint32_t>(flames++);
+        swap(toFlame[i], first);
+        spawnFlame(first, random);
+        rewrite(toFlame[i]);
+        rewrite(first);
+    }
+}
+
+void FireSystem::write(ThreadPool& pool, Vertex* vertices) const {
+    pool.parallelFor(size(), UPDATE_GRAIN, [&](size_t begin, size_t end) { writeVertices(vertices, begin, end); });
+}
+
+void vkx::simd::fireFlameUpdate(Backend backend, const FireArrays& particles, const FireConstants& constants, uint32_t begin, uint32_t end) {
+    VKX_SIMD_DISPATCH(fireFlameUpdate(particles, constants, begin, end))
+}
+
+void vkx::simd::fireSmokeUpdate(Backend backend, const FireArrays& particles, const FireConstants& constants, uint32_t begin, uint32_t end) {
+    VKX_SIMD_DISPATCH(fireSmokeUpdate(particles, constants, begin, end))
+}
@@ -0,0 +1,96 @@
+/*
+* CPU fire and smoke particle system of the particlefire example
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "random.hpp"
+#include "particles_kernels.hpp"
+#include "threadpool.hpp"
+
+namespace vkx { namespace particles {
+
+enum class Type : int32_t
+{
+    flame = 0,
+    smoke = 1,
+};
+
+// Vertex layout of the particlefire shaders, written directly into mapped memory
+struct Vertex {
+    glm::vec3 pos;
+    glm::vec3 color;
+    float alpha;
+    float size;
+    float rotation;
+    Type type;
+};
+
+struct Emitter {
+    glm::vec3 position{ 0.0f };
+    // Flames spawn inside a sphere of this radius around the position
+    float radius{ 8.0f };
+    glm::vec3 minVel{ -3.0f, 0.5f, -3.0f };
+    glm::vec3 maxVel{ 3.0f, 7.0f, 3.0f };
+    // Chance of a burnt out flame to turn into smoke instead of respawning
+    float smokeChance{ 0.05f };
+};
+
+/**
+* @brief Flames and smoke, updated on the CPU
+*
+* The particles are kept as a structure of arrays partitioned by type: flames occupy the indices below
+* flameCount(), smoke the ones above.  Each type is integrated without branches by a SIMD kernel over its
+* range, split into chunks across the thread pool.
+*
+* Burnt out flames mostly respawn in place.  Particles that change their type are collected per chunk
+* and processed afterwards on the calling thread: a flame turning into smoke and a smoke particle turning
+* into a flame trade places, and any surplus moves the boundary between the ranges.
+*
+* Each chunk draws random numbers from its own generator, seeded from the frame and chunk number, so
+* the simulation is deterministic for a given seed regardless of the number of threads.
+*/
+class FireSystem {
+public:
+    void create(size_t count, const Emitter& emitter, uint64_t seed = 0);
+    // Advance by `deltaT` seconds and write all particles to `vertices`, which must hold size() elements
+    void update(float deltaT, ThreadPool& pool, simd::Backend backend, Vertex* vertices);
+    // Write all particles without advancing them
+    void write(ThreadPool& pool, Vertex* vertices) const;
+
+    size_t size() const { return x.size(); }
+    size_t flameCount() const { return flames; }
+
+    Emitter emitter;
+
+private:
+    struct Chunk {
+        std::vector<uint32_t> toSmoke;
+        std::vector<uint32_t> toFlame;
+    };
+
+    simd::FireArrays arrays();
+    void spawnFlame(uint32_t index, Random& random);
+    // Turn the flame at `source` into smoke at `target`
+    void spawnSmoke(uint32_t target, uint32_t source, Random& random);
+    void swap(uint32_t a, uint32_t b);
+    // Integrate one chunk of particles, respawn its flames and collect its type changes
+    void updateChunk(size_t chunkIndex, const simd::FireConstants& constants, simd::Backend backend, uint64_t frameSeed, Vertex* vertices);
+    void writeVertices(Vertex* vertices, size_t begin, size_t end) const;
+    void resolveTransitions(Vertex* vertices);
+
+    std::vector<float> x, y, z, vx, vy, vz, shade, alpha, pointSize, rotation, rotationSpeed;
+    size_t flames{ 0 };
+    uint64_t seed{ 0 };
+    uint64_t frame{ 0 };
+    std::vector<Chunk> chunks;
+};
+
+}}  // namespace vkx::particles
@@ -0,0 +1,42 @@
+/*
+* Flame and smoke kernels of the fire particle system, see simd.hpp for the backends
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "simd.hpp"
+
+namespace vkx { namespace simd {
+
+// Fire particles, see examples/particlefire.  Flames rise along y only, smoke drifts along its velocity
+// and darkens.  `shade` is the gray level of the particle color.
+struct FireArrays {
+    float* x;
+    float* y;
+    float* z;
+    float* vx;
+    float* vy;
+    float* vz;
+    float* shade;
+    float* alpha;
+    float* size;
+    float* rotation;
+    float* rotationSpeed;
+};
+
+struct FireConstants {
+    float deltaT;
+    // Scaled time step driving the fade, growth and rotation of the particles
+    float particleT;
+};
+
+void fireFlameUpdate(Backend backend, const FireArrays& particles, const FireConstants& constants, uint32_t begin, uint32_t end);
+void fireSmokeUpdate(Backend backend, const FireArrays& particles, const FireConstants& constants, uint32_t begin, uint32_t end);
+
+// Backend implementations, see particles_kernels.inl
+VKX_SIMD_DECLARE_KERNEL(void fireFlameUpdate(const FireArrays& particles, const FireConstants& constants, uint32_t begin, uint32_t end))
+VKX_SIMD_DECLARE_KERNEL(void fireSmokeUpdate(const FireArrays& particles, const FireConstants& constants, uint32_t begin, uint32_t end))
+
+}}  // namespace vkx::simd
@@ -0,0 +1,41 @@
+/*
+* Fire particle kernels, the CPU update of examples/particlefire
+*
+* Included into the namespace of every backend after simd_kernels.inl
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+namespace kernels {
+
+template <typename P>
+inline void fireFlameUpdate(const FireArrays& particles, const FireConstants& constants, uint32_t i) {
+    const P t = P::set(constants.particleT);
+    (P::load(particles.y + i) - P::load(particles.vy + i) * t * P::set(3.5f)).store(particles.y + i);
+    (P::load(particles.alpha + i) + t * P::set(2.5f)).store(particles.alpha + i);
+    (P::load(particles.size + i) - t * P::set(0.5f)).store(particles.size + i);
+    (P::load(particles.rotation + i) + t * P::load(particles.rotationSpeed + i)).store(particles.rotation + i);
+}
+
+template <typename P>
+inline void fireSmokeUpdate(const FireArrays& particles, const FireConstants& constants, uint32_t i) {
+    const P t = P::set(constants.particleT);
+    const P deltaT = P::set(constants.deltaT);
+    (P::load(particles.x + i) - P::load(particles.vx + i) * deltaT).store(particles.x + i);
+    (P::load(particles.y + i) - P::load(particles.vy + i) * deltaT).store(particles.y + i);
+    (P::load(particles.z + i) - P::load(particles.vz + i) * deltaT).store(particles.z + i);
+    (P::load(particles.alpha + i) + t * P::set(1.25f)).store(particles.alpha + i);
+    (P::load(particles.size + i) + t * P::set(0.125f)).store(particles.size + i);
+    (P::load(particles.shade + i) - t * P::set(0.05f)).store(particles.shade + i);
+    (P::load(particles.rotation + i) + t * P::load(particles.rotationSpeed + i)).store(particles.rotation + i);
+}
+
+}  // namespace kernels
+
+void fireFlameUpdate(const FireArrays& particles, const FireConstants& constants, uint32_t begin, uint32_t end) {
+    kernels::forRange(begin, end, [&](auto p, uint32_t i) { kernels::fireFlameUpdate<decltype(p)>(particles, constants, i); });
+}
+
+void fireSmokeUpdate(const FireArrays& particles, const FireConstants& constants, uint32_t begin, uint32_t end) {
+    kernels::forRange(begin, end, [&](auto p, uint32_t i) { kernels::fireSmokeUpdate<decltype(p)>(particles, constants, i); });
+}
@@ -1,24 +1,34 @@
 #include "pbr.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <mutex>
+#include <unordered_map>
 #include "vks/texture.hpp"
 #include "vks/context.hpp"
 #include "vks/pipelines.hpp"
+#include "vks/filesystem.hpp"
 #include "utils.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
 // Generate a BRDF integration map used as a look-up-table (stores roughness / NdotV)
-void vkx::pbr::generateBRDFLUT(const vks::Context& context, vks::texture::Texture2D& target) {
+void vkx::pbr::generateBRDFLUT(const vks::Context& context, vks::texture::Texture2D& target, const BakeParameters& parameters) {
     auto tStart = std::chrono::high_resolution_clock::now();
 
     const vk::Format format = vk::Format::eR16G16Sfloat;  // R16G16 is supported pretty much everywhere
-    const int32_t dim = 512;
+    const int32_t dim = static_cast<int32_t>(parameters.brdfLutDim);
 
     const auto& device = context.device;
     target.device = device;
     target.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+    target.mipLevels = 1;
+    target.layerCount = 1;
 
     {
         // Image
@@ -30,7 +40,8 @@ void vkx::pbr::generateBRDFLUT(const vks::Context& context, vks::texture::Textur
         imageCI.extent.depth = 1;
         imageCI.mipLevels = 1;
         imageCI.arrayLayers = 1;
-        imageCI.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled;
+        // Transfer source to read the map back for the cache
+        imageCI.usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferSrc;
         (vks::Image&)target = context.createImage(imageCI);
         // Image view
         vk::ImageViewCreateInfo viewCI;
@@ -127,7 +138,12 @@ void vkx::pbr::generateBRDFLUT(const vks::Context& context, vks::texture::Textur
     // Look-up-table (from BRDF) pipeline
     pipelineBuilder.loadShader(vkx::getAssetPath() + "shaders/pbr/genbrdflut.vert.spv", vk::ShaderStageFlagBits::eVertex);
     pipelineBuilder.loadShader(vkx::getAssetPath() + "shaders/pbr/genbrdflut.frag.spv", vk::ShaderStageFlagBits::eFragment);
-    vk::Pipeline pipeline = pipelineBuilder.create(context.pipelineCache);
+    // Sample count of the integration
+    vk::SpecializationMapEntry specializationEntry{ 0, 0, sizeof(uint32_t) };
+    vk::SpecializationInfo specializationInfo{ 1, &specializationEntry, sizeof(uint32_t), &parameters.brdfLutSamples };
+    pipelineBuilder.update();
+    vk::Pipeline pipeline = pipelineBuilder.createSpecialized(context.pipelineCache, vk::ShaderStageFlagBits::eFragment, specializationInfo);
+    pipelineBuilder.destroyShaderModules();
 
     // Render
     vk::ClearValue clearValues[1];
@@ -166,20 +182,201 @@ void vkx::pbr::generateBRDFLUT(const vks::Context& context, vks::texture::Textur
     std::cout << "Generating BRDF LUT took " << tDiff << " ms" << std::endl;
 }
 
+namespace {
+
+// Push constants of the cube filtering compute shaders
+struct FilterConstants {
+    uint32_t size;
+    uint32_t firstSample;
+    uint32_t sampleCount;
+};
+
+}  // namespace
+
+// Radical inverse based on http://holger.dammertz.org/stuff/notes_HammersleyOnHemisphere.html
+static glm::vec2 hammersley2d(uint32_t i, uint32_t n) {
+    uint32_t bits = (i << 16u) | (i >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return glm::vec2(float(i) / float(n), float(bits) * 2.3283064365386963e-10f);
+}
+
+// Convolution directions of the irradiance cube in tangent space with z along the normal, as x, y, the weight
+// including the normalization and the level of detail term of the sample's solid angle.  The shader recovers z
+// and samples the environment level whose texels cover about that solid angle, which takes the place of the
+// derivative based level selection of the render pass path.
+static std::vector<glm::vec4> irradianceSamples(const vkx::pbr::BakeParameters& parameters) {
+    const float TWO_PI = 2.0f * float(M_PI);
+    const float HALF_PI = 0.5f * float(M_PI);
+    std::vector<glm::vec4> samples;
+    for (float phi = 0.0f; phi < TWO_PI; phi += parameters.irradianceDeltaPhi) {
+        for (float theta = 0.0f; theta < HALF_PI; theta += parameters.irradianceDeltaTheta) {
+            const float solidAngle = parameters.irradianceDeltaPhi * parameters.irradianceDeltaTheta * sinf(theta);
+            samples.emplace_back(sinf(theta) * cosf(phi), sinf(theta) * sinf(phi), cosf(theta) * sinf(theta), 0.5f * log2f(std::max(solidAngle, 1e-8f)));
+        }
+    }
+    for (auto& sample : samples) {
+        sample.z *= float(M_PI) / static_cast<float>(samples.size());
+    }
+    return samples;
+}
+
+// GGX importance samples of each level of the pre-filtered cube in tangent space with N = V along z, as the
+// reflected direction and the level of detail term of the sample's solid angle.  Samples below the horizon are
+// dropped, `levelSamples` receives the first sample and the count of each level.
+static std::vector<glm::vec4> prefilterSamples(const vkx::pbr::BakeParameters& parameters, uint32_t numMips, std::vector<glm::uvec2>& levelSamples) {
+    std::vector<glm::vec4> samples;
+    levelSamples.clear();
+    for (uint32_t m = 0; m < numMips; m++) {
+        const uint32_t first = static_cast<uint32_t>(samples.size());
+        const float roughness = (float)m / (float)(numMips - 1);
+        if (roughness == 0.0f) {
+            // A mirror reflects the full resolution environment
+            samples.emplace_back(0.0f, 0.0f, 1.0f, -1000.0f);
+        } else {
+            // Based on http://blog.selfshadow.com/publications/s2013-shading-course/karis/s2013_pbs_epic_slides.pdf
+            const float alpha = roughness * roughness;
+            const float alpha2 = alpha * alpha;
+            for (uint32_t i = 0; i < parameters.prefilteredSamples; i++) {
+                const glm::vec2 xi = hammersley2d(i, parameters.prefilteredSamples);
+                const float phi = 2.0f * float(M_PI) * xi.x;
+                const float cosTheta = sqrtf((1.0f - xi.y) / (1.0f + (alpha2 - 1.0f) * xi.y));
+                const float sinTheta = sqrtf(1.0f - cosTheta * cosTheta);
+                const glm::vec3 halfVector{ sinTheta * cosf(phi), sinTheta * sinf(phi), cosTheta };
+                const glm::vec3 light = 2.0f * cosTheta * halfVector - glm::vec3(0.0f, 0.0f, 1.0f);
+                if (light.z <= 0.0f) {
+                    continue;
+                }
+                // With N = V the pdf D * NdotH / (4 * VdotH) reduces to D / 4
+                const float denom = cosTheta * cosTheta * (alpha2 - 1.0f) + 1.0f;
+                const float pdf = alpha2 / (float(M_PI) * denom * denom) / 4.0f + 0.0001f;
+                const float solidAngle = 1.0f / (float(parameters.prefilteredSamples) * pdf);
+                // Biased (+1.0) mip level for better result
+                samples.emplace_back(light, 0.5f * log2f(solidAngle) + 1.0f);
+            }
+        }
+        levelSamples.emplace_back(first, static_cast<uint32_t>(samples.size()) - first);
+    }
+    return samples;
+}
+
+// Filter the environment into all levels of `target`, which needs storage usage.  Each level takes one dispatch
+// of `shader` over a 2D array view of its six faces, reading `levelSamples[level]` (first and count) of `samples`.
+static void computeCube(const vks::Context& context,
+                        vks::texture::Texture& target,
+                        const vk::DescriptorImageInfo& skyboxDescriptor,
+                        const std::string& shader,
+                        const std::vector<glm::vec4>& samples,
+                        const std::vector<glm::uvec2>& levelSamples) {
+    const auto& device = context.device;
+    const uint32_t numMips = static_cast<uint32_t>(levelSamples.size());
+    vks::Buffer sampleBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, samples);
+
+    // Descriptors
+    std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+        // Binding 0 : Environment
+        { 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 1 : Faces of the level
+        { 1, vk::DescriptorType::eStorageImage, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 2 : Sample table
+        { 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+    };
+    vk::DescriptorSetLayout descriptorsetlayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+    std::vector<vk::DescriptorPoolSize> poolSizes{
+        { vk::DescriptorType::eCombinedImageSampler, numMips },
+        { vk::DescriptorType::eStorageImage, numMips },
+        { vk::DescriptorType::eStorageBuffer, numMips },
+    };
+    vk::DescriptorPool descriptorpool = device.createDescriptorPool({ {}, numMips, (uint32_t)poolSizes.size(), poolSizes.data() });
+    const std::vector<vk::DescriptorSetLayout> setLayouts(numMips, descriptorsetlayout);
+    const std::vector<vk::DescriptorSet> descriptorsets = device.allocateDescriptorSets({ descriptorpool, numMips, setLayouts.data() });
+
+    std::vector<vk::ImageView> levelViews(numMips);
+    for (uint32_t m = 0; m < numMips; m++) {
+        vk::ImageViewCreateInfo viewCI;
+        viewCI.viewType = vk::ImageViewType::e2DArray;
+        viewCI.format = target.format;
+        viewCI.subresourceRange = { vk::ImageAspectFlagBits::eColor, m, 1, 0, 6 };
+        viewCI.image = target.image;
+        levelViews[m] = device.createImageView(viewCI);
+
+        vk::DescriptorImageInfo levelDescriptor{ nullptr, levelViews[m], vk::ImageLayout::eGeneral };
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
+            { descriptorsets[m], 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &skyboxDescriptor },
+            { descriptorsets[m], 1, 0, 1, vk::DescriptorType::eStorageImage, &levelDescriptor },
+            { descriptorsets[m], 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &sampleBuffer.descriptor },
+        };
+        device.updateDescriptorSets(writeDescriptorSets, nullptr);
+    }
+
+    // Pipeline
+    vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(FilterConstants) };
+    vk::PipelineLayout pipelinelayout = device.createPipelineLayout({ {}, 1, &descriptorsetlayout, 1, &pushConstantRange });
+    vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+    computePipelineCreateInfo.layout = pipelinelayout;
+    computePipelineCreateInfo.stage = vks::shaders::loadShader(device, vkx::getAssetPath() + shader, vk::ShaderStageFlagBits::eCompute);
+    vk::Pipeline pipeline = device.createComputePipelines(context.pipelineCache, computePipelineCreateInfo)[0];
+    device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+
+    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuf) {
+        vk::ImageSubresourceRange subresourceRange{ vk::ImageAspectFlagBits::eColor, 0, numMips, 0, 6 };
+        vk::ImageMemoryBarrier barrier{ {},
+                                        vk::AccessFlagBits::eShaderWrite,
+                                        vk::ImageLayout::eUndefined,
+                                        vk::ImageLayout::eGeneral,
+                                        VK_QUEUE_FAMILY_IGNORED,
+                                        VK_QUEUE_FAMILY_IGNORED,
+                                        target.image,
+                                        subresourceRange };
+        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTopOfPipe, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, nullptr, barrier);
+
+        cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        // Each dispatch writes its own level, so they need no barriers in between
+        for (uint32_t m = 0; m < numMips; m++) {
+            const FilterConstants constants{ std::max(1u, target.extent.width >> m), levelSamples[m].x, levelSamples[m].y };
+            cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelinelayout, 0, descriptorsets[m], nullptr);
+            cmdBuf.pushConstants<FilterConstants>(pipelinelayout, vk::ShaderStageFlagBits::eCompute, 0, constants);
+            // 8 x 8 texels per group, one face per z
+            cmdBuf.dispatch((constants.size + 7) / 8, (constants.size + 7) / 8, 6);
+        }
+
+        barrier.srcAccessMask = vk::AccessFlagBits::eShaderWrite;
+        barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+        barrier.oldLayout = vk::ImageLayout::eGeneral;
+        barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+        const vk::PipelineStageFlags readers = vk::PipelineStageFlagBits::eFragmentShader | vk::PipelineStageFlagBits::eComputeShader;
+        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, readers, {}, nullptr, nullptr, barrier);
+    });
+
+    for (auto levelView : levelViews) {
+        device.destroyImageView(levelView);
+    }
+    device.destroyPipeline(pipeline);
+    device.destroyPipelineLayout(pipelinelayout);
+    device.destroyDescriptorPool(descriptorpool);
+    device.destroyDescriptorSetLayout(descriptorsetlayout);
+    sampleBuffer.destroy();
+}
+
 // Generate an irradiance cube map from the environment cube map
 void vkx::pbr::generateIrradianceCube(const vks::Context& context,
                                       vks::texture::Texture& target,
                                       const vks::model::Model& skybox,
                                       const vks::model::VertexLayout& vertexLayout,
-                                      const vk::DescriptorImageInfo& skyboxDescriptor) {
+                                      const vk::DescriptorImageInfo& skyboxDescriptor,
+                                      const BakeParameters& parameters) {
     auto tStart = std::chrono::high_resolution_clock::now();
 
     const auto& device = context.device;
     target.device = device;
 
     const vk::Format format = vk::Format::eR32G32B32A32Sfloat;
-    const int32_t dim = 64;
+    const int32_t dim = static_cast<int32_t>(parameters.irradianceDim);
     const uint32_t numMips = static_cast<uint32_t>(floor(log2(dim))) + 1;
+    target.mipLevels = numMips;
+    target.layerCount = 6;
 
     {
         // Pre-filtered cube map
@@ -192,7 +389,10 @@ void vkx::pbr::generateIrradianceCube(const vks::Context& context,
         imageCI.extent.depth = 1;
         imageCI.mipLevels = numMips;
         imageCI.arrayLayers = 6;
-        imageCI.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
+        imageCI.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc;
+        if (parameters.method == Method::compute) {
+            imageCI.usage |= vk::ImageUsageFlagBits::eStorage;
+        }
         imageCI.flags = vk::ImageCreateFlagBits::eCubeCompatible;
 
         target = context.createImage(imageCI);
@@ -221,6 +421,18 @@ void vkx::pbr::generateIrradianceCube(const vks::Context& context,
         target.updateDescriptor();
     }
 
+    if (parameters.method == Method::compute) {
+        const std::vector<glm::vec4> samples = irradianceSamples(parameters);
+        // Every level convolves with the same directions
+        const std::vector<glm::uvec2> levelSamples(numMips, glm::uvec2(0, static_cast<uint32_t>(samples.size())));
+        computeCube(context, target, skyboxDescriptor, "shaders/pbr/irradiancecube.comp.spv", samples, levelSamples);
+
+        auto tEnd = std::chrono::high_resolution_clock::now();
+        auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+        std::cout << "Computing irradiance cube with " << numMips << " mip levels took " << tDiff << " ms" << std::endl;
+        return;
+    }
+
     vk::RenderPass renderpass;
     {
         // FB, Att, RP, Pipe, etc.
@@ -314,9 +526,11 @@ void vkx::pbr::generateIrradianceCube(const vks::Context& context,
     struct PushBlock {
         glm::mat4 mvp;
         // Sampling deltas
-        float deltaPhi = (2.0f * float(M_PI)) / 180.0f;
-        float deltaTheta = (0.5f * float(M_PI)) / 64.0f;
+        float deltaPhi;
+        float deltaTheta;
     } pushBlock;
+    pushBlock.deltaPhi = parameters.irradianceDeltaPhi;
+    pushBlock.deltaTheta = parameters.irradianceDeltaTheta;
     vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, sizeof(PushBlock) };
 
     vk::PipelineLayout pipelinelayout = device.createPipelineLayout(vk::PipelineLayoutCreateInfo{ {}, 1, &descriptorsetlayout, 1, &pushConstantRange });
@@ -446,7 +660,8 @@ void vkx::pbr::generatePrefilteredCube(const vks::Context& context,
                                        vks::texture::Texture& target,
                                        const vks::model::Model& skybox,
                                        const vks::model::VertexLayout& vertexLayout,
-                                       const vk::DescriptorImageInfo& skyboxDescriptor) {
+                                       const vk::DescriptorImageInfo& skyboxDescriptor,
+                                       const BakeParameters& parameters) {
     auto tStart = std::chrono::high_resolution_clock::now();
 
     const auto& device = context.device;
@@ -454,8 +669,10 @@ void vkx::pbr::generatePrefilteredCube(const vks::Context& context,
     target.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
 
     const vk::Format format = vk::Format::eR16G16B16A16Sfloat;
-    const int32_t dim = 512;
+    const int32_t dim = static_cast<int32_t>(parameters.prefilteredDim);
     const uint32_t numMips = static_cast<uint32_t>(floor(log2(dim))) + 1;
+    target.mipLevels = numMips;
+    target.layerCount = 6;
 
     // Pre-filtered cube map
     // Image
@@ -468,7 +685,10 @@ void vkx::pbr::generatePrefilteredCube(const vks::Context& context,
         imageCI.extent.depth = 1;
         imageCI.mipLevels = numMips;
         imageCI.arrayLayers = 6;
-        imageCI.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
+        imageCI.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst | vk::ImageUsageFlagBits::eTransferSrc;
+        if (parameters.method == Method::compute) {
+            imageCI.usage |= vk::ImageUsageFlagBits::eStorage;
+        }
         imageCI.flags = vk::ImageCreateFlagBits::eCubeCompatible;
         target = context.createImage(imageCI);
         // Image view
@@ -495,6 +715,17 @@ void vkx::pbr::generatePrefilteredCube(const vks::Context& context,
         target.updateDescriptor();
     }
 
+    if (parameters.method == Method::compute) {
+        std::vector<glm::uvec2> levelSamples;
+        const std::vector<glm::vec4> samples = prefilterSamples(parameters, numMips, levelSamples);
+        computeCube(context, target, skyboxDescriptor, "shaders/pbr/prefilterenvmap.comp.spv", samples, levelSamples);
+
+        auto tEnd = std::chrono::high_resolution_clock::now();
+        auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+        std::cout << "Computing pre-filtered environment cube with " << numMips << " mip levels took " << tDiff << " ms" << std::endl;
+        return;
+    }
+
     vk::RenderPass renderpass;
     {
         // FB, Att, RP, Pipe, etc.
@@ -582,8 +813,9 @@ void vkx::pbr::generatePrefilteredCube(const vks::Context& context,
     struct PushBlock {
         glm::mat4 mvp;
         float roughness;
-        uint32_t numSamples = 32u;
+        uint32_t numSamples;
     } pushBlock;
+    pushBlock.numSamples = parameters.prefilteredSamples;
 
     vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, sizeof(PushBlock) };
     vk::PipelineLayout pipelinelayout = device.createPipelineLayout({ {}, 1, &descriptorsetlayout, 1, &pushConstantRange });
@@ -706,3 +938,457 @@ void vkx::pbr::generatePrefilteredCube(const vks::Context& context,
     auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
     std::cout << "Generating pre-filtered enivornment cube with " << numMips << " mip levels took " << tDiff << " ms" << std::endl;
 }
+
+// Real spherical harmonics basis of the first three bands
+static std::array<float, 9> shBasis(const glm::vec3& n) {
+    return { 0.282095f,
+             0.488603f * n.y,
+             0.488603f * n.z,
+             0.488603f * n.x,
+             1.092548f * n.x * n.y,
+             1.092548f * n.y * n.z,
+             0.315392f * (3.0f * n.z * n.z - 1.0f),
+             1.092548f * n.x * n.z,
+             0.546274f * (n.x * n.x - n.y * n.y) };
+}
+
+// Direction through the center of texel (x, y) of a face, in the face order and orientation of Vulkan cube maps.
+// `uv` receives the texel center in [-1, 1] face coordinates.
+static glm::vec3 cubeDirection(uint32_t face, uint32_t x, uint32_t y, uint32_t size, glm::vec2& uv) {
+    uv = (glm::vec2(x, y) + 0.5f) / float(size) * 2.0f - 1.0f;
+    switch (face) {
+        case 0:
+            return glm::normalize(glm::vec3(1.0f, -uv.y, -uv.x));
+        case 1:
+            return glm::normalize(glm::vec3(-1.0f, -uv.y, uv.x));
+        case 2:
+            return glm::normalize(glm::vec3(uv.x, 1.0f, uv.y));
+        case 3:
+            return glm::normalize(glm::vec3(uv.x, -1.0f, -uv.y));
+        case 4:
+            return glm::normalize(glm::vec3(uv.x, -uv.y, 1.0f));
+        default:
+            return glm::normalize(glm::vec3(-uv.x, -uv.y, -1.0f));
+    }
+}
+
+// Scale the texel weighted sums of a projection to the solid angle of the sphere and convolve them with the
+// clamped cosine, see Ramamoorthi and Hanrahan, "An Efficient Representation for Irradiance Environment Maps"
+static vkx::pbr::IrradianceSH convolveSH(const std::array<glm::vec3, 9>& sums, float weightSum) {
+    // Cosine lobe of each band, divided by pi
+    static const float BAND_FACTORS[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+    const float scale = 4.0f * float(M_PI) / weightSum;
+    vkx::pbr::IrradianceSH result;
+    for (uint32_t i = 0; i < 9; i++) {
+        result.coefficients[i] = glm::vec4(sums[i] * scale * BAND_FACTORS[i], 0.0f);
+    }
+    return result;
+}
+
+glm::vec3 vkx::pbr::IrradianceSH::evaluate(const glm::vec3& normal) const {
+    const auto basis = shBasis(normal);
+    glm::vec3 result{ 0.0f };
+    for (uint32_t i = 0; i < 9; i++) {
+        result += glm::vec3(coefficients[i]) * basis[i];
+    }
+    return result;
+}
+
+vkx::pbr::IrradianceSH vkx::pbr::projectIrradianceSH(const gli::texture_cube& environment, const BakeParameters& parameters) {
+    auto tStart = std::chrono::high_resolution_clock::now();
+    if (gli::is_compressed(environment.format())) {
+        throw std::runtime_error("Compressed environments can not be projected on the CPU");
+    }
+
+    size_t level = 0;
+    while (level + 1 < environment.levels() && static_cast<uint32_t>(environment.extent(level).x) > parameters.shProjectionDim) {
+        ++level;
+    }
+    const gli::texture_cube texels =
+        gli::convert(gli::texture_cube(environment, 0, environment.max_face(), level, level), gli::FORMAT_RGBA32_SFLOAT_PACK32);
+    const uint32_t size = static_cast<uint32_t>(texels.extent().x);
+
+    std::array<glm::vec3, 9> sums;
+    sums.fill(glm::vec3(0.0f));
+    float weightSum = 0.0f;
+    for (uint32_t face = 0; face < 6; face++) {
+        for (uint32_t y = 0; y < size; y++) {
+            for (uint32_t x = 0; x < size; x++) {
+                glm::vec2 uv;
+                const glm::vec3 direction = cubeDirection(face, x, y, size, uv);
+                // Solid angle of the texel, up to the constant factor the normalization removes
+                const float weight = 1.0f / powf(1.0f + glm::dot(uv, uv), 1.5f);
+                const glm::vec3 color = glm::vec3(texels.load<glm::vec4>(gli::extent2d(x, y), face, 0)) * weight;
+                const auto basis = shBasis(direction);
+                for (uint32_t i = 0; i < 9; i++) {
+                    sums[i] += color * basis[i];
+                }
+                weightSum += weight;
+            }
+        }
+    }
+
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+    std::cout << "Projecting irradiance into spherical harmonics on the CPU took " << tDiff << " ms" << std::endl;
+    return convolveSH(sums, weightSum);
+}
+
+vkx::pbr::IrradianceSH vkx::pbr::generateIrradianceSH(const vks::Context& context,
+                                                      const vk::DescriptorImageInfo& skyboxDescriptor,
+                                                      const BakeParameters& parameters) {
+    auto tStart = std::chrono::high_resolution_clock::now();
+    const auto& device = context.device;
+
+    // Each 8 x 8 group writes its 9 weighted coefficients and its weight sum
+    const uint32_t size = parameters.shProjectionDim;
+    const uint32_t groups = (size + 7) / 8;
+    const uint32_t groupCount = groups * groups * 6;
+    const vk::DeviceSize partialsSize = groupCount * 10 * sizeof(glm::vec4);
+    vks::Buffer partials = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer,
+                                                vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, partialsSize);
+
+    // Descriptors
+    std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+        // Binding 0 : Environment
+        { 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eCompute },
+        // Binding 1 : Sums of the workgroups
+        { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+    };
+    vk::DescriptorSetLayout descriptorsetlayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+    std::vector<vk::DescriptorPoolSize> poolSizes{ { vk::DescriptorType::eCombinedImageSampler, 1 }, { vk::DescriptorType::eStorageBuffer, 1 } };
+    vk::DescriptorPool descriptorpool = device.createDescriptorPool({ {}, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+    vk::DescriptorSet descriptorset = device.allocateDescriptorSets({ descriptorpool, 1, &descriptorsetlayout })[0];
+    std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
+        { descriptorset, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &skyboxDescriptor },
+        { descriptorset, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &partials.descriptor },
+    };
+    device.updateDescriptorSets(writeDescriptorSets, nullptr);
+
+    // Pipeline
+    vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(uint32_t) };
+    vk::PipelineLayout pipelinelayout = device.createPipelineLayout({ {}, 1, &descriptorsetlayout, 1, &pushConstantRange });
+    vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+    computePipelineCreateInfo.layout = pipelinelayout;
+    computePipelineCreateInfo.stage =
+        vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/pbr/shprojection.comp.spv", vk::ShaderStageFlagBits::eCompute);
+    vk::Pipeline pipeline = device.createComputePipelines(context.pipelineCache, computePipelineCreateInfo)[0];
+    device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+
+    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuf) {
+        cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelinelayout, 0, descriptorset, nullptr);
+        cmdBuf.pushConstants<uint32_t>(pipelinelayout, vk::ShaderStageFlagBits::eCompute, 0, size);
+        cmdBuf.dispatch(groups, groups, 6);
+        // Make the sums visible to the host
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eHostRead };
+        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eHost, {}, barrier, nullptr, nullptr);
+    });
+
+    std::array<glm::vec3, 9> sums;
+    sums.fill(glm::vec3(0.0f));
+    float weightSum = 0.0f;
+    const auto* groupSums = partials.map<glm::vec4>();
+    for (uint32_t group = 0; group < groupCount; group++) {
+        for (uint32_t i = 0; i < 9; i++) {
+            sums[i] += glm::vec3(groupSums[group * 10 + i]);
+        }
+        weightSum += groupSums[group * 10 + 9].x;
+    }
+
+    device.destroyPipeline(pipeline);
+    device.destroyPipelineLayout(pipelinelayout);
+    device.destroyDescriptorPool(descriptorpool);
+    device.destroyDescriptorSetLayout(descriptorsetlayout);
+    partials.destroy();
+
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+    std::cout << "Projecting irradiance into spherical harmonics on the GPU took " << tDiff << " ms" << std::endl;
+    return convolveSH(sums, weightSum);
+}
+
+// Bump when the maps change in a way the cache keys cannot see, e.g. a different format
+static const uint32_t CACHE_VERSION = 1;
+
+namespace {
+
+// 64 bit FNV-1a over everything the maps are made from
+struct CacheKey {
+    uint64_t value{ 14695981039346656037ull };
+
+    void add(const void* data, size_t size) {
+        const auto* bytes = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; ++i) {
+            value = (value ^ bytes[i]) * 1099511628211ull;
+        }
+    }
+
+    template <typename T>
+    void add(const T& data) {
+        add(&data, sizeof(T));
+    }
+
+    // Adds the hash of the file contents, which is computed once per run and file.  The irradiance and the
+    // pre-filtered cube share the environment file and filtercube.vert, which would otherwise be read and
+    // hashed again for every map.
+    void addFile(const std::string& filename) {
+        static std::mutex mutex;
+        static std::unordered_map<std::string, uint64_t> fileHashes;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto hash = fileHashes.find(filename);
+        if (hash == fileHashes.end()) {
+            CacheKey contents;
+            vks::file::withBinaryFileContents(filename, [&](size_t size, const void* data) { contents.add(data, size); });
+            hash = fileHashes.emplace(filename, contents.value).first;
+        }
+        add(hash->second);
+    }
+
+    std::string hex() const {
+        std::ostringstream result;
+        result << std::hex << std::setw(16) << std::setfill('0') << value;
+        return result.str();
+    }
+};
+
+}  // namespace
+
+static bool fileExists(const std::string& filename) {
+    return std::ifstream(filename, std::ios::binary).good();
+}
+
+// Name of the environment file without its directory and extension
+static std::string baseName(const std::string& filename) {
+    const auto separator = filename.find_last_of("/\\");
+    std::string result = separator == std::string::npos ? filename : filename.substr(separator + 1);
+    const auto extension = result.find_last_of('.');
+    return extension == std::string::npos ? result : result.substr(0, extension);
+}
+
+static std::string cacheFile(const std::string& directory, const std::string& name, const std::string& hex) {
+    const char last = directory.back();
+    return directory + (last == '/' || last == '\\' ? "" : "/") + name + "." + hex + ".ktx";
+}
+
+static std::string cacheFile(const std::string& directory, const std::string& name, const CacheKey& key) {
+    return cacheFile(directory, name, key.hex());
+}
+
+// Delete the maps of `name` baked with any other key, they can never be loaded again
+static void removeStaleEntries(const std::string& directory, const std::string& name, const CacheKey& key) {
+    const std::string prefix = name + ".";
+    const std::string suffix = ".ktx";
+    const std::string current = key.hex();
+    for (const auto& entry : vks::file::listDirectory(directory)) {
+        if (entry.size() != prefix.size() + current.size() + suffix.size() || entry.compare(0, prefix.size(), prefix) != 0 ||
+            entry.compare(entry.size() - suffix.size(), suffix.size(), suffix) != 0) {
+            continue;
+        }
+        const std::string hex = entry.substr(prefix.size(), current.size());
+        if (hex != current && hex.find_first_not_of("0123456789abcdef") == std::string::npos) {
+            std::remove(cacheFile(directory, name, hex).c_str());
+        }
+    }
+}
+
+static gli::format cacheFormat(vk::Format format) {
+    switch (format) {
+        case vk::Format::eR16G16Sfloat:
+            return gli::FORMAT_RG16_SFLOAT_PACK16;
+        case vk::Format::eR16G16B16A16Sfloat:
+            return gli::FORMAT_RGBA16_SFLOAT_PACK16;
+        case vk::Format::eR32G32B32A32Sfloat:
+            return gli::FORMAT_RGBA32_SFLOAT_PACK32;
+        default:
+            throw std::runtime_error("Unsupported format of a precomputed map");
+    }
+}
+
+gli::texture vkx::pbr::readBack(const vks::Context& context, const vks::texture::Texture& source, bool cube) {
+    const gli::format format = cacheFormat(source.format);
+    const gli::extent2d extent(source.extent.width, source.extent.height);
+    gli::texture texture = cube ? gli::texture(gli::texture_cube(format, extent, source.mipLevels))
+                                : gli::texture(gli::texture2d(format, extent, source.mipLevels));
+
+    // Same face major order the loaders of vks::texture upload the files in
+    std::vector<vk::BufferImageCopy> regions;
+    const auto* base = static_cast<const uint8_t*>(texture.data());
+    for (uint32_t face = 0; face < static_cast<uint32_t>(texture.faces()); ++face) {
+        for (uint32_t level = 0; level < source.mipLevels; ++level) {
+            vk::BufferImageCopy region;
+            region.bufferOffset = static_cast<const uint8_t*>(texture.data(0, face, level)) - base;
+            region.imageSubresource = { vk::ImageAspectFlagBits::eColor, level, face, 1 };
+            region.imageExtent = vk::Extent3D{ std::max(1u, source.extent.width >> level), std::max(1u, source.extent.height >> level), 1 };
+            regions.push_back(region);
+        }
+    }
+
+    vks::Buffer readback = context.createBuffer(vk::BufferUsageFlagBits::eTransferDst,
+                                                vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, texture.size());
+    context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& cmdBuf) {
+        vk::ImageSubresourceRange subresourceRange{ vk::ImageAspectFlagBits::eColor, 0, source.mipLevels, 0, static_cast<uint32_t>(texture.faces()) };
+        context.setImageLayout(cmdBuf, source.image, vk::ImageLayout::eShaderReadOnlyOptimal, vk::ImageLayout::eTransferSrcOptimal, subresourceRange);
+        cmdBuf.copyImageToBuffer(source.image, vk::ImageLayout::eTransferSrcOptimal, readback.buffer, regions);
+        context.setImageLayout(cmdBuf, source.image, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eShaderReadOnlyOptimal, subresourceRange);
+        // Make the copy visible to the host
+        vk::MemoryBarrier barrier{ vk::AccessFlagBits::eTransferWrite, vk::AccessFlagBits::eHostRead };
+        cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, vk::PipelineStageFlagBits::eHost, {}, barrier, nullptr, nullptr);
+    });
+    memcpy(texture.data(), readback.map(), texture.size());
+    readback.destroy();
+    return texture;
+}
+
+// Read all faces and levels of a generated map back and write them to the KTX file of `key`, replacing the
+// ones of older keys
+static void saveMap(const vks::Context& context,
+                    const vks::texture::Texture& source,
+                    bool cube,
+                    const std::string& directory,
+                    const std::string& name,
+                    const CacheKey& key) {
+    const gli::texture texture = vkx::pbr::readBack(context, source, cube);
+
+    // Write to a temporary file first, so an interrupted run does not leave a truncated map behind
+    const std::string filename = cacheFile(directory, name, key);
+    const std::string temporary = filename + ".tmp";
+    if (!gli::save_ktx(texture, temporary) || std::rename(temporary.c_str(), filename.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        std::cout << "Could not write " << filename << std::endl;
+        return;
+    }
+    removeStaleEntries(directory, name, key);
+}
+
+// Key of a cube filtered from `environmentFile` by the shader of the given name, a compute shader or a
+// fragment shader behind filtercube.vert depending on the method
+static CacheKey environmentKey(const std::string& environmentFile, const std::string& shader, vkx::pbr::Method method) {
+    CacheKey key;
+    key.add(CACHE_VERSION);
+    key.add(method);
+    key.addFile(environmentFile);
+    if (method == vkx::pbr::Method::compute) {
+        key.addFile(vkx::getAssetPath() + "shaders/pbr/" + shader + ".comp.spv");
+    } else {
+        key.addFile(vkx::getAssetPath() + "shaders/pbr/filtercube.vert.spv");
+        key.addFile(vkx::getAssetPath() + "shaders/pbr/" + shader + ".frag.spv");
+    }
+    return key;
+}
+
+static void reportLoad(const char* map, const std::string& filename, std::chrono::high_resolution_clock::time_point tStart) {
+    auto tEnd = std::chrono::high_resolution_clock::now();
+    auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
+    std::cout << "Loading " << map << " from " << filename << " took " << tDiff << " ms" << std::endl;
+}
+
+void vkx::pbr::loadOrGenerateBRDFLUT(const vks::Context& context,
+                                     const std::string& cacheDirectory,
+                                     vks::texture::Texture2D& target,
+                                     const BakeParameters& parameters) {
+    if (cacheDirectory.empty()) {
+        generateBRDFLUT(context, target, parameters);
+        return;
+    }
+
+    auto tStart = std::chrono::high_resolution_clock::now();
+    CacheKey key;
+    key.add(CACHE_VERSION);
+    key.add(parameters.brdfLutDim);
+    key.add(parameters.brdfLutSamples);
+    key.addFile(vkx::getAssetPath() + "shaders/pbr/genbrdflut.vert.spv");
+    key.addFile(vkx::getAssetPath() + "shaders/pbr/genbrdflut.frag.spv");
+    const std::string filename = cacheFile(cacheDirectory, "brdflut", key);
+    if (!fileExists(filename)) {
+        generateBRDFLUT(context, target, parameters);
+        saveMap(context, target, false, cacheDirectory, "brdflut", key);
+        return;
+    }
+
+    target.loadFromFile(context, filename, vk::Format::eR16G16Sfloat);
+    // The loader's sampler repeats, look-ups at the edges of the table must not wrap around
+    vk::SamplerCreateInfo samplerCI;
+    samplerCI.magFilter = vk::Filter::eLinear;
+    samplerCI.minFilter = vk::Filter::eLinear;
+    samplerCI.mipmapMode = vk::SamplerMipmapMode::eLinear;
+    samplerCI.addressModeU = vk::SamplerAddressMode::eClampToEdge;
+    samplerCI.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+    samplerCI.addressModeW = vk::SamplerAddressMode::eClampToEdge;
+    samplerCI.maxLod = 1.0f;
+    samplerCI.borderColor = vk::BorderColor::eFloatOpaqueWhite;
+    context.device.destroySampler(target.sampler);
+    target.sampler = context.device.createSampler(samplerCI);
+    target.updateDescriptor();
+    reportLoad("BRDF LUT", filename, tStart);
+}
+
+void vkx::pbr::loadOrGenerateIrradianceCube(const vks::Context& context,
+                                            const std::string& cacheDirectory,
+                                            const std::string& environmentFile,
+                                            vks::texture::TextureCubeMap& target,
+                                            const vks::model::Model& skybox,
+                                            const vks::model::VertexLayout& vertexLayout,
+                                            const vk::DescriptorImageInfo& skyboxDescriptor,
+                                            const BakeParameters& parameters) {
+    if (cacheDirectory.empty()) {
+        generateIrradianceCube(context, target, skybox, vertexLayout, skyboxDescriptor, parameters);
+        return;
+    }
+
+    auto tStart = std::chrono::high_resolution_clock::now();
+    CacheKey key = environmentKey(environmentFile, "irradiancecube", parameters.method);
+    key.add(parameters.irradianceDim);
+    key.add(parameters.irradianceDeltaPhi);
+    key.add(parameters.irradianceDeltaTheta);
+    const std::string name = baseName(environmentFile) + ".irradiance";
+    const std::string filename = cacheFile(cacheDirectory, name, key);
+    if (!fileExists(filename)) {
+        generateIrradianceCube(context, target, skybox, vertexLayout, skyboxDescriptor, parameters);
+        saveMap(context, target, true, cacheDirectory, name, key);
+        return;
+    }
+
+    target.loadFromFile(context, filename, vk::Format::eR32G32B32A32Sfloat);
+    reportLoad("irradiance cube", filename, tStart);
+}
+
+void vkx::pbr::loadOrGeneratePrefilteredCube(const vks::Context& context,
+                                             const std::string& cacheDirectory,
+                                             const std::string& environmentFile,
+                                             vks::texture::TextureCubeMap& target,
+                                             const vks::model::Model& skybox,
+                                             const vks::model::VertexLayout& vertexLayout,
+                                             const vk::DescriptorImageInfo& skyboxDescriptor,
+                                             const BakeParameters& parameters) {
+    if (cacheDirectory.empty()) {
+        generatePrefilteredCube(context, target, skybox, vertexLayout, skyboxDescriptor, parameters);
+        return;
+    }
+
+    auto tStart = std::chrono::high_resolution_clock::now();
+    CacheKey key = environmentKey(environmentFile, "prefilterenvmap", parameters.method);
+    key.add(parameters.prefilteredDim);
+    key.add(parameters.prefilteredSamples);
+    const std::string name = baseName(environmentFile) + ".prefiltered";
+    const std::string filename = cacheFile(cacheDirectory, name, key);
+    if (!fileExists(filename)) {
+        generatePrefilteredCube(context, target, skybox, vertexLayout, skyboxDescriptor, parameters);
+        saveMap(context, target, true, cacheDirectory, name, key);
+        return;
+    }
+
+    target.loadFromFile(context, filename, vk::Format::eR16G16B16A16Sfloat);
+    reportLoad("pre-filtered environment cube", filename, tStart);
+}
+
+std::string vkx::pbr::environmentCacheDirectory(const std::string& environmentFile) {
+#if defined(__ANDROID__)
+    return {};
+#else
+    const auto separator = environmentFile.find_last_of("/\\");
+    const std::string directory = (separator == std::string::npos ? std::string{ "./" } : environmentFile.substr(0, separator + 1)) + "cache/";
+    // Without a cache directory the maps are generated every time
+    return vks::file::createDirectory(directory) ? directory : std::string{};
+#endif
+}
@@ -1,23 +1,101 @@
 #pragma once
 
+#include <array>
+
 #include "vks/context.hpp"
 #include "vks/texture.hpp"
 #include "vks/model.hpp"
 
 namespace vkx { namespace pbr {
+
+// How the cube maps are filtered
+enum class Method
+{
+    // A render pass per face and level, copied into the cube
+    renderPass,
+    // A compute dispatch per level writing all six faces, reading the sample directions from precomputed tables
+    compute,
+};
+
+// Sizes and sample counts of the precomputed maps.  They are part of the cache keys, so changing them
+// bakes new maps instead of loading ones made with other values.
+struct BakeParameters {
+    uint32_t brdfLutDim{ 512 };
+    uint32_t brdfLutSamples{ 1024 };
+    uint32_t irradianceDim{ 64 };
+    // Sampling deltas of the irradiance convolution
+    float irradianceDeltaPhi{ (2.0f * float(M_PI)) / 180.0f };
+    float irradianceDeltaTheta{ (0.5f * float(M_PI)) / 64.0f };
+    uint32_t prefilteredDim{ 512 };
+    uint32_t prefilteredSamples{ 32 };
+    Method method{ Method::compute };
+    // Face size the environment is sampled at for the spherical harmonics projection
+    uint32_t shProjectionDim{ 64 };
+};
+
+// Irradiance of an environment as the 9 spherical harmonics coefficients of the first three bands.  They are
+// convolved with the clamped cosine and divided by pi like the irradiance cube, so evaluating them at a normal
+// gives what the cube returns there.  One vec4 per coefficient to match std140 arrays, w is unused.
+struct IrradianceSH {
+    std::array<glm::vec4, 9> coefficients;
+
+    glm::vec3 evaluate(const glm::vec3& normal) const;
+};
+
 // Generate a BRDF integration map used as a look-up-table (stores roughness / NdotV)
-void generateBRDFLUT(const vks::Context& context, vks::texture::Texture2D& target);
+void generateBRDFLUT(const vks::Context& context, vks::texture::Texture2D& target, const BakeParameters& parameters = {});
 // Generate an irradiance cube map from the environment cube map
 void generateIrradianceCube(const vks::Context& context,
                             vks::texture::Texture& target,
                             const vks::model::Model& skybox,
                             const vks::model::VertexLayout& vertexLayout,
-                            const vk::DescriptorImageInfo& skyboxDescriptor);
+                            const vk::DescriptorImageInfo& skyboxDescriptor,
+                            const BakeParameters& parameters = {});
 // Prefilter environment cubemap
 // See https://placeholderart.wordpress.com/2015/07/28/implementation-notes-runtime-environment-map-filtering-for-image-based-lighting/
 void generatePrefilteredCube(const vks::Context& context,
                              vks::texture::Texture& target,
                              const vks::model::Model& skybox,
                              const vks::model::VertexLayout& vertexLayout,
-                             const vk::DescriptorImageInfo& skyboxDescriptor);
+                             const vk::DescriptorImageInfo& skyboxDescriptor,
+                             const BakeParameters& parameters = {});
+// Project the environment into spherical harmonics on the CPU, from the first level no larger than
+// `parameters.shProjectionDim`.  Replaces the irradiance cube where the low frequency approximation is enough.
+IrradianceSH projectIrradianceSH(const gli::texture_cube& environment, const BakeParameters& parameters = {});
+// Same projection with a compute shader that reduces each workgroup's contribution, summed up on the CPU
+IrradianceSH generateIrradianceSH(const vks::Context& context, const vk::DescriptorImageInfo& skyboxDescriptor, const BakeParameters& parameters = {});
+
+// Cached variants of the functions above.  The maps are loaded from KTX files in `cacheDirectory` if a
+// previous run baked them from the same environment file, parameters and shaders.  Otherwise they are
+// generated, read back and written there, so only the first run pays for the GPU work, and the files of
+// other keys for the same map are deleted.  The directory has to exist; with an empty directory the maps are
+// always generated.  The cube maps do not depend on the
+// vertex layout, the skybox model or the descriptor, only on `environmentFile` they were loaded from.
+void loadOrGenerateBRDFLUT(const vks::Context& context,
+                           const std::string& cacheDirectory,
+                           vks::texture::Texture2D& target,
+                           const BakeParameters& parameters = {});
+void loadOrGenerateIrradianceCube(const vks::Context& context,
+                                  const std::string& cacheDirectory,
+                                  const std::string& environmentFile,
+                                  vks::texture::TextureCubeMap& target,
+                                  const vks::model::Model& skybox,
+                                  const vks::model::VertexLayout& vertexLayout,
+                                  const vk::DescriptorImageInfo& skyboxDescriptor,
+                                  const BakeParameters& parameters = {});
+void loadOrGeneratePrefilteredCube(const vks::Context& context,
+                                   const std::string& cacheDirectory,
+                                   const std::string& environmentFile,
+                                   vks::texture::TextureCubeMap& target,
+                                   const vks::model::Model& skybox,
+                                   const vks::model::VertexLayout& vertexLayout,
+                                   const vk::DescriptorImageInfo& skyboxDescriptor,
+                                   const BakeParameters& parameters = {});
+
+// Copy all faces and levels of a generated map to the host, as a gli::texture_cube or gli::texture2d
+gli::texture readBack(const vks::Context& context, const vks::texture::Texture& source, bool cube);
+
+// Directory the examples cache the maps of an environment in, `cache/` next to the environment file, created
+// if missing.  Empty on Android, where the assets are read only, or if it cannot be created.
+std::string environmentCacheDirectory(const std::string& environmentFile);
 }}  // namespace vkx::pbr
@@ -0,0 +1,70 @@
+/*
+* Small, fast pseudo random number generator for CPU simulations
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+
+namespace vkx {
+
+/**
+* @brief xoshiro128+ generator, seeded through splitmix64
+*
+* Unlike rand() the generator has no global state, so every thread or work chunk uses its own instance.
+* Instances created from the same seed and different stream numbers produce unrelated sequences, which
+* makes parallel results independent of how the work was distributed over the threads.
+*/
+class Random {
+public:
+    explicit Random(uint64_t seed = 0, uint64_t stream = 0) {
+        uint64_t state = seed ^ mix(stream + 0x632BE59BD9B4E019ull);
+        const uint64_t a = splitmix64(state);
+        const uint64_t b = splitmix64(state);
+        s[0] = static_cast<uint32_t>(a);
+        s[1] = static_cast<uint32_t>(a >> 32);
+        s[2] = static_cast<uint32_t>(b);
+        s[3] = static_cast<uint32_t>(b >> 32);
+        // The all zero state would only produce zeros
+        if ((s[0] | s[1] | s[2] | s[3]) == 0) {
+            s[0] = 1;
+        }
+    }
+
+    uint32_t next() {
+        const uint32_t result = s[0] + s[3];
+        const uint32_t t = s[1] << 9;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 11);
+        return result;
+    }
+
+    // Uniform in [0, 1), using the upper bits which are the best ones of xoshiro128+
+    float uniform() { return static_cast<float>(next() >> 8) * (1.0f / 16777216.0f); }
+    // Uniform in [0, range)
+    float uniform(float range) { return range * uniform(); }
+
+    // Finalizer of splitmix64, e.g. to derive seeds from frame and chunk numbers
+    static uint64_t mix(uint64_t value) {
+        value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+        value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+        return value ^ (value >> 31);
+    }
+
+private:
+    static uint64_t splitmix64(uint64_t& state) {
+        state += 0x9E3779B97F4A7C15ull;
+        return mix(state);
+    }
+    static uint32_t rotl(uint32_t x, int k) { return (x << k) | (x >> (32 - k)); }
+
+    uint32_t s[4];
+};
+
+}  // namespace vkx
@@ -0,0 +1,146 @@
+/*
+* Draw sorting and batching
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+namespace vkx { namespace render {
+
+// Location of a mesh inside merged vertex and index buffers
+struct MeshRange {
+    uint32_t firstIndex{ 0 };
+    uint32_t indexCount{ 0 };
+    int32_t vertexOffset{ 0 };
+};
+
+/**
+* 64 bit sort keys.  Sorting draws by key groups them by state, cheapest to change in the lowest bits.
+*
+* Opaque:      | 0 | pipeline:15 | material:16 | depth:32 |              front to back within a material
+* Translucent: | 1 | ~depth:32   | pipeline:15 | material:16 |           back to front, always after opaque
+*/
+namespace sortkey {
+
+// Non-negative floats compare the same as their bit patterns
+inline uint32_t depthBits(float depth) {
+    depth = std::max(depth, 0.0f);
+    uint32_t result;
+    memcpy(&result, &depth, sizeof(result));
+    return result;
+}
+
+inline uint64_t opaque(uint32_t pipeline, uint32_t material, float depth) {
+    return (uint64_t(pipeline & 0x7fff) << 48) | (uint64_t(material & 0xffff) << 32) | depthBits(depth);
+}
+
+inline uint64_t translucent(uint32_t pipeline, uint32_t material, float depth) {
+    return (uint64_t(1) << 63) | (uint64_t(~depthBits(depth)) << 31) | (uint64_t(pipeline & 0x7fff) << 16) | (material & 0xffff);
+}
+
+}  // namespace sortkey
+
+// A single requested draw of a mesh
+struct DrawItem {
+    uint64_t key;
+    uint32_t pipeline;
+    uint32_t material;
+    uint32_t mesh;
+    // Per instance value made available to shaders (object, transform or material index)
+    uint32_t payload;
+};
+
+// One (possibly instanced) draw of a mesh.  Instance i reads payloads()[firstInstance + i].
+struct DrawCommand {
+    uint32_t mesh;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+};
+
+// Consecutive draw commands sharing pipeline and material state
+struct Batch {
+    uint32_t pipeline;
+    uint32_t material;
+    uint32_t firstCommand;
+    uint32_t commandCount;
+};
+
+/**
+* @brief Collects draws for a frame and turns them into the minimum number of state changes and draw commands
+*
+* Draws are sorted by key.  Runs of draws of the same mesh with the same state collapse into one instanced
+* command, and runs of commands with the same state form a batch that can be issued as a single
+* multi-draw-indirect call.  Nothing here touches the device, so the ordering and batching can be
+* exercised without a GPU.
+*/
+class RenderQueue {
+public:
+    void clear() {
+        items.clear();
+        sortedPayloads.clear();
+        drawCommands.clear();
+        drawBatches.clear();
+    }
+
+    void push(const DrawItem& item) { items.push_back(item); }
+
+    // Sort and batch the pushed draws.  With `mergeMaterials` shaders are expected to fetch material data
+    // through the payload, so material changes no longer split batches.
+    void build(bool mergeMaterials = false) {
+        std::stable_sort(items.begin(), items.end(), [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+
+        sortedPayloads.clear();
+        drawCommands.clear();
+        drawBatches.clear();
+        sortedPayloads.reserve(items.size());
+
+        const DrawItem* previous = nullptr;
+        for (const auto& item : items) {
+            const bool sameState = previous && previous->pipeline == item.pipeline && (mergeMaterials || previous->material == item.material);
+            if (!sameState) {
+                drawBatches.push_back({ item.pipeline, item.material, static_cast<uint32_t>(drawCommands.size()), 0 });
+            }
+            if (sameState && previous->mesh == item.mesh) {
+                ++drawCommands.back().instanceCount;
+            } else {
+                drawCommands.push_back({ item.mesh, static_cast<uint32_t>(sortedPayloads.size()), 1 });
+                ++drawBatches.back().commandCount;
+            }
+            sortedPayloads.push_back(item.payload);
+            previous = &item;
+        }
+    }
+
+    size_t size() const { return items.size(); }
+    const std::vector<DrawItem>& sortedItems() const { return items; }
+    const std::vector<uint32_t>& payloads() const { return sortedPayloads; }
+    const std::vector<DrawCommand>& commands() const { return drawCommands; }
+    const std::vector<Batch>& batches() const { return drawBatches; }
+
+    // Indirect commands for all draws, in the same order as commands()
+    std::vector<vk::DrawIndexedIndirectCommand> indirectCommands(const std::vector<MeshRange>& meshes) const {
+        std::vector<vk::DrawIndexedIndirectCommand> result;
+        result.reserve(drawCommands.size());
+        for (const auto& command : drawCommands) {
+            const auto& mesh = meshes[command.mesh];
+            result.push_back({ mesh.indexCount, command.instanceCount, mesh.firstIndex, mesh.vertexOffset, command.firstInstance });
+        }
+        return result;
+    }
+
+private:
+    std::vector<DrawItem> items;
+    std::vector<uint32_t> sortedPayloads;
+    std::vector<DrawCommand> drawCommands;
+    std::vector<Batch> drawBatches;
+};
+
+}}  // namespace vkx::render
@@ -0,0 +1,463 @@
+#include "scene.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+#include <assimp/Importer.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "vks/filesystem.hpp"
+
+using namespace vkx;
+
+const vks::model::VertexLayout Scene::vertexLayout{ {
+    vks::model::VERTEX_COMPONENT_POSITION,
+    vks::model::VERTEX_COMPONENT_NORMAL,
+    vks::model::VERTEX_COMPONENT_UV,
+    vks::model::VERTEX_COMPONENT_COLOR,
+} };
+
+void Scene::loadMaterials() {
+    materials.resize(aScene->mNumMaterials);
+
+    for (size_t i = 0; i < materials.size(); i++) {
+        materials[i] = {};
+
+        aiString name;
+        aScene->mMaterials[i]->Get(AI_MATKEY_NAME, name);
+
+        // Properties
+        aiColor4D color;
+        aScene->mMaterials[i]->Get(AI_MATKEY_COLOR_AMBIENT, color);
+        materials[i].properties.ambient = glm::make_vec4(&color.r) + glm::vec4(0.1f);
+        aScene->mMaterials[i]->Get(AI_MATKEY_COLOR_DIFFUSE, color);
+        materials[i].properties.diffuse = glm::make_vec4(&color.r);
+        aScene->mMaterials[i]->Get(AI_MATKEY_COLOR_SPECULAR, color);
+        materials[i].properties.specular = glm::make_vec4(&color.r);
+        aScene->mMaterials[i]->Get(AI_MATKEY_OPACITY, materials[i].properties.opacity);
+
+        if ((materials[i].properties.opacity) > 0.0f)
+            materials[i].properties.specular = glm::vec4(0.0f);
+
+        materials[i].name = name.C_Str();
+        std::cout << "Material \"" << materials[i].name << "\"" << std::endl;
+
+        // Textures
+        aiString texturefile;
+        // Diffuse
+        aScene->mMaterials[i]->GetTexture(aiTextureType_DIFFUSE, 0, &texturefile);
+        if (aScene->mMaterials[i]->GetTextureCount(aiTextureType_DIFFUSE) > 0) {
+            std::cout << "  Diffuse: \"" << texturefile.C_Str() << "\"" << std::endl;
+            std::string fileName = std::string(texturefile.C_Str());
+            std::replace(fileName.begin(), fileName.end(), '\\', '/');
+            materials[i].diffuse.loadFromFile(context, assetPath + fileName, vk::Format::eBc3UnormBlock);
+        } else {
+            std::cout << "  Material has no diffuse, using dummy texture!" << std::endl;
+            // todo : separate pipeline and layout
+            materials[i].diffuse.loadFromFile(context, assetPath + "dummy.ktx", vk::Format::eBc2UnormBlock);
+        }
+
+        // For scenes with multiple textures per material we would need to check for additional texture types, e.g.:
+        // aiTextureType_HEIGHT, aiTextureType_OPACITY, aiTextureType_SPECULAR, etc.
+
+        // Assign pipeline
+        materials[i].pipeline = (materials[i].properties.opacity == 0.0f) ? &pipelines.solid : &pipelines.blending;
+    }
+
+    // Generate descriptor sets for the materials
+
+    // Descriptor pool
+    std::vector<vk::DescriptorPoolSize> poolSizes{
+        { vk::DescriptorType::eUniformBuffer, static_cast<uint32_t>(materials.size()) },
+        { vk::DescriptorType::eCombinedImageSampler, static_cast<uint32_t>(materials.size()) },
+    };
+
+    vk::DescriptorPoolCreateInfo descriptorPoolInfo{ {},
+                                                     static_cast<uint32_t>(materials.size()) + 1,
+                                                     static_cast<uint32_t>(poolSizes.size()),
+                                                     poolSizes.data() };
+
+    descriptorPool = device.createDescriptorPool(descriptorPoolInfo);
+
+    // Descriptor set and pipeline layouts
+    // Set 0: Scene matrices
+    std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+        { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex, 0 },
+    };
+    descriptorSetLayouts.scene = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+
+    // Set 1: Material data
+    setLayoutBindings = {
+        { 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
+    };
+    descriptorSetLayouts.material = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+
+    // Setup pipeline layout
+    std::array<vk::DescriptorSetLayout, 2> setLayouts = { descriptorSetLayouts.scene, descriptorSetLayouts.material };
+    // We will be using a push constant block to pass material properties to the fragment shaders
+    vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eFragment, 0, sizeof(SceneMaterialProperites) };
+    pipelineLayout = device.createPipelineLayout({ {}, static_cast<uint32_t>(setLayouts.size()), setLayouts.data(), 1, &pushConstantRange });
+
+    // Material descriptor sets
+    for (size_t i = 0; i < materials.size(); i++) {
+        // Descriptor set
+        materials[i].descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.material })[0];
+
+        vk::DescriptorImageInfo texDescriptor{ materials[i].diffuse.sampler, materials[i].diffuse.view, vk::ImageLayout::eGeneral };
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
+            // Binding 0: Diffuse texture
+            { materials[i].descriptorSet, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texDescriptor },
+        };
+
+        device.updateDescriptorSets(writeDescriptorSets, nullptr);
+    }
+
+    // Scene descriptor set
+    descriptorSetScene = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.scene })[0];
+    std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
+        // Binding 0 : SceneVertex shader uniform buffer
+        { descriptorSetScene, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffer.descriptor },
+    };
+    device.updateDescriptorSets(writeDescriptorSets, nullptr);
+
+    if (bindless) {
+        loadBindlessMaterials();
+    }
+}
+
+void Scene::loadBindlessMaterials() {
+    std::vector<SceneMaterialData> materialData(materials.size());
+    for (size_t i = 0; i < materials.size(); i++) {
+        materials[i].diffuseSlot = bindless->addTexture({ materials[i].diffuse.sampler, materials[i].diffuse.view, vk::ImageLayout::eGeneral });
+        materialData[i] = {};
+        materialData[i].properties = materials[i].properties;
+        materialData[i].diffuseSlot = materials[i].diffuseSlot;
+    }
+    materialBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, materialData);
+    materialBufferSlot = bindless->addBuffer({ materialBuffer.buffer, 0, VK_WHOLE_SIZE });
+    bindless->flush();
+
+    // Set 0: Scene matrices, set 1: bindless table
+    std::array<vk::DescriptorSetLayout, 2> setLayouts = { descriptorSetLayouts.scene, bindless->layout };
+    vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0, sizeof(SceneBindlessPushConstants) };
+    bindlessPipelineLayout = device.createPipelineLayout({ {}, static_cast<uint32_t>(setLayouts.size()), setLayouts.data(), 1, &pushConstantRange });
+}
+
+void Scene::loadMeshes(vk::CommandBuffer copyCmd) {
+    // All meshes are merged into a single vertex and index buffer
+    std::vector<SceneVertex> vertices;
+    std::vector<uint32_t> indices;
+
+    meshes.resize(aScene->mNumMeshes);
+    meshRanges.resize(aScene->mNumMeshes);
+    for (uint32_t i = 0; i < meshes.size(); i++) {
+        aiMesh* aMesh = aScene->mMeshes[i];
+
+        std::cout << "Mesh \"" << aMesh->mName.C_Str() << "\"" << std::endl;
+        std::cout << "    Material: \"" << materials[aMesh->mMaterialIndex].name << "\"" << std::endl;
+        std::cout << "    Faces: " << aMesh->mNumFaces << std::endl;
+
+        meshes[i].material = &materials[aMesh->mMaterialIndex];
+
+        auto& range = meshes[i].range;
+        range.vertexOffset = static_cast<int32_t>(vertices.size());
+        range.firstIndex = static_cast<uint32_t>(indices.size());
+        range.indexCount = aMesh->mNumFaces * 3;
+
+        // Vertices
+        bool hasUV = aMesh->HasTextureCoords(0);
+        bool hasColor = aMesh->HasVertexColors(0);
+        bool hasNormals = aMesh->HasNormals();
+
+        glm::vec3 minPos{ std::numeric_limits<float>::max() };
+        glm::vec3 maxPos{ -std::numeric_limits<float>::max() };
+        for (uint32_t v = 0; v < aMesh->mNumVertices; v++) {
+            SceneVertex vertex;
+            vertex.pos = glm::make_vec3(&aMesh->mVertices[v].x);
+            vertex.pos.y = -vertex.pos.y;
+            vertex.uv = hasUV ? glm::make_vec2(&aMesh->mTextureCoords[0][v].x) : glm::vec2(0.0f);
+            vertex.normal = hasNormals ? glm::make_vec3(&aMesh->mNormals[v].x) : glm::vec3(0.0f);
+            vertex.normal.y = -vertex.normal.y;
+            vertex.color = hasColor ? glm::make_vec3(&aMesh->mColors[0][v].r) : glm::vec3(1.0f);
+            minPos = glm::min(minPos, vertex.pos);
+            maxPos = glm::max(maxPos, vertex.pos);
+            vertices.push_back(vertex);
+        }
+        meshes[i].center = (minPos + maxPos) * 0.5f;
+
+        // Indices, relative to the first vertex of the mesh
+        for (uint32_t f = 0; f < aMesh->mNumFaces; f++) {
+            indices.insert(indices.end(), aMesh->mFaces[f].mIndices, aMesh->mFaces[f].mIndices + 3);
+        }
+        meshRanges[i] = range;
+    }
+    vertexBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertices);
+    indexBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indices);
+}
+
+void Scene::destroyFrameDraws() {
+    for (auto& frame : frameDraws) {
+        context.trash<vks::Buffer>(frame.indirectBuffer);
+        context.trash<vks::Buffer>(frame.drawDataBuffer);
+        bindless->releaseBuffer(frame.drawDataSlot);
+    }
+    frameDraws.clear();
+}
+
+void Scene::writeFrameDraws(const FrameDraws& frame) const {
+    const auto commands = renderQueue.indirectCommands(meshRanges);
+    const auto& payloads = renderQueue.payloads();
+    memcpy(frame.indirectBuffer.mapped, commands.data(), commands.size() * sizeof(vk::DrawIndexedIndirectCommand));
+    memcpy(frame.drawDataBuffer.mapped, payloads.data(), payloads.size() * sizeof(uint32_t));
+}
+
+Scene::Scene(const vks::Context& context, vks::BindlessTable* bindless)
+    : context(context)
+    , bindless(bindless) {
+    uniformBuffer = context.createUniformBuffer(uniformData);
+}
+
+Scene::~Scene() {
+    vertexBuffer.destroy();
+    indexBuffer.destroy();
+    for (auto& frame : frameDraws) {
+        frame.indirectBuffer.destroy();
+        frame.drawDataBuffer.destroy();
+    }
+    for (auto material : materials) {
+        material.diffuse.destroy();
+    }
+    if (bindless) {
+        materialBuffer.destroy();
+        device.destroyPipelineLayout(bindlessPipelineLayout);
+        device.destroyPipeline(bindlessPipelines.solid);
+        device.destroyPipeline(bindlessPipelines.blending);
+        device.destroyPipeline(bindlessPipelines.wireframe);
+    }
+    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.material, nullptr);
+    vkDestroyDescriptorSetLayout(device, descriptorSetLayouts.scene, nullptr);
+    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+    vkDestroyPipeline(device, pipelines.solid, nullptr);
+    vkDestroyPipeline(device, pipelines.blending, nullptr);
+    vkDestroyPipeline(device, pipelines.wireframe, nullptr);
+    uniformBuffer.destroy();
+}
+
+void Scene::load(const std::string& filename, vk::CommandBuffer copyCmd) {
+    Assimp::Importer Importer;
+    vks::file::withBinaryFileContents(filename, [&](size_t size, const void* data) {
+        int flags = aiProcess_PreTransformVertices | aiProcess_Triangulate | aiProcess_GenNormals;
+        aScene = Importer.ReadFileFromMemory(data, size, flags);
+    });
+
+    if (aScene) {
+        loadMaterials();
+        loadMeshes(copyCmd);
+    } else {
+        printf("Error parsing '%s': '%s'\n", filename.c_str(), Importer.GetErrorString());
+    }
+}
+
+uint64_t Scene::sortKey(uint32_t mesh, const glm::vec3& cameraPosition) const {
+    const auto& material = *meshes[mesh].material;
+    const auto materialIndex = static_cast<uint32_t>(&material - materials.data());
+    const float depth = glm::distance(cameraPosition, meshes[mesh].center);
+    return isTranslucent(mesh) ? vkx::render::sortkey::translucent(1, materialIndex, depth) : vkx::render::sortkey::opaque(0, materialIndex, depth);
+}
+
+void Scene::prepareFrames(uint32_t imageCount) {
+    if (!bindless || frameDraws.size() == imageCount) {
+        return;
+    }
+    destroyFrameDraws();
+    const auto meshCount = static_cast<vk::DeviceSize>(std::max<size_t>(meshes.size(), 1));
+    const vk::MemoryPropertyFlags hostVisible = vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+    frameDraws.resize(imageCount);
+    for (auto& frame : frameDraws) {
+        frame.indirectBuffer =
+            context.createBuffer(vk::BufferUsageFlagBits::eIndirectBuffer, hostVisible, meshCount * sizeof(vk::DrawIndexedIndirectCommand));
+        frame.indirectBuffer.map();
+        frame.drawDataBuffer = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer, hostVisible, meshCount * sizeof(uint32_t));
+        frame.drawDataBuffer.map();
+        frame.drawDataSlot = bindless->addBuffer({ frame.drawDataBuffer.buffer, 0, VK_WHOLE_SIZE });
+    }
+    bindless->flush();
+}
+
+void Scene::buildRenderQueue(const glm::vec3& cameraPosition, SceneRenderMode mode) {
+    renderQueue.clear();
+    for (uint32_t i = 0; i < meshes.size(); i++) {
+        if (!isDrawn(i))
+            continue;
+
+        const auto materialIndex = static_cast<uint32_t>(meshes[i].material - materials.data());
+        const uint32_t pipeline = isTranslucent(i) ? 1 : 0;
+        renderQueue.push({ sortKey(i, cameraPosition), pipeline, materialIndex, i, materialIndex });
+    }
+    renderQueue.build(mode == SceneRenderMode::bindless);
+    translucentOrder.clear();
+    for (const auto& item : renderQueue.sortedItems()) {
+        if (item.pipeline == 1) {
+            translucentOrder.push_back(item.mesh);
+        }
+    }
+}
+
+bool Scene::translucentOrderChanged(const glm::vec3& cameraPosition) const {
+    if (translucentOrder.size() < 2) {
+        return false;
+    }
+    std::vector<std::pair<uint64_t, uint32_t>> order;
+    order.reserve(translucentOrder.size());
+    for (uint32_t i = 0; i < meshes.size(); i++) {
+        if (isDrawn(i) && isTranslucent(i)) {
+            order.push_back({ sortKey(i, cameraPosition), i });
+        }
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [](const std::pair<uint64_t, uint32_t>& a, const std::pair<uint64_t, uint32_t>& b) { return a.first < b.first; });
+    for (size_t i = 0; i < order.size(); ++i) {
+        if (order[i].second != translucentOrder[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Scene::render(vk::CommandBuffer cmdBuffer, uint32_t image, bool wireframe, SceneRenderMode mode) {
+    stats = {};
+    switch (mode) {
+        case SceneRenderMode::fileOrder:
+            renderFileOrder(cmdBuffer, wireframe);
+            break;
+        case SceneRenderMode::sorted:
+            renderSorted(cmdBuffer, wireframe);
+            break;
+        case SceneRenderMode::bindless:
+            renderBindless(cmdBuffer, frameDraws[image], wireframe);
+            break;
+    }
+}
+
+void Scene::renderFileOrder(vk::CommandBuffer cmdBuffer, bool wireframe) {
+    for (size_t i = 0; i < meshes.size(); i++) {
+        if ((renderSingleScenePart) && (i != scenePartIndex))
+            continue;
+
+        // We will be using multiple descriptor sets for rendering
+        // In GLSL the selection is done via the set and binding keywords
+        // VS: layout (set = 0, binding = 0) uniform UBO;
+        // FS: layout (set = 1, binding = 0) uniform sampler2D samplerColorMap;
+
+        std::array<vk::DescriptorSet, 2> descriptorSets;
+        // Set 0: Scene descriptor set containing global matrices
+        descriptorSets[0] = descriptorSetScene;
+        // Set 1: Per-Material descriptor set containing bound images
+        descriptorSets[1] = meshes[i].material->descriptorSet;
+
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, wireframe ? pipelines.wireframe : *meshes[i].material->pipeline);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets, {});
+
+        // Pass material properies via push constants
+        vkCmdPushConstants(cmdBuffer, pipelineLayout, VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(SceneMaterialProperites), &meshes[i].material->properties);
+
+        cmdBuffer.bindVertexBuffers(0, vertexBuffer.buffer, { 0 });
+        cmdBuffer.bindIndexBuffer(indexBuffer.buffer, 0, vk::IndexType::eUint32);
+        const auto& range = meshes[i].range;
+        cmdBuffer.drawIndexed(range.indexCount, 1, range.firstIndex, range.vertexOffset, 0);
+        ++stats.pipelineBinds;
+        ++stats.descriptorBinds;
+        ++stats.draws;
+    }
+}
+
+vk::Pipeline Scene::batchPipeline(const vkx::render::Batch& batch, bool wireframe, bool bindlessVariant) const {
+    const auto& set = bindlessVariant ? bindlessPipelines : pipelines;
+    if (wireframe) {
+        return set.wireframe;
+    }
+    return batch.pipeline == 0 ? set.solid : set.blending;
+}
+
+void Scene::renderSorted(vk::CommandBuffer cmdBuffer, bool wireframe) {
+    cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSetScene, nullptr);
+    cmdBuffer.bindVertexBuffers(0, vertexBuffer.buffer, { 0 });
+    cmdBuffer.bindIndexBuffer(indexBuffer.buffer, 0, vk::IndexType::eUint32);
+    ++stats.descriptorBinds;
+
+    vk::Pipeline boundPipeline;
+    uint32_t boundMaterial = ~0u;
+    const auto& commands = renderQueue.commands();
+    for (const auto& batch : renderQueue.batches()) {
+        vk::Pipeline pipeline = batchPipeline(batch, wireframe, false);
+        if (pipeline != boundPipeline) {
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+            boundPipeline = pipeline;
+            ++stats.pipelineBinds;
+        }
+        if (batch.material != boundMaterial) {
+            const auto& material = materials[batch.material];
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 1, material.descriptorSet, nullptr);
+            cmdBuffer.pushConstants<SceneMaterialProperites>(pipelineLayout, vk::ShaderStageFlagBits::eFragment, 0, material.properties);
+            boundMaterial = batch.material;
+            ++stats.descriptorBinds;
+        }
+        for (uint32_t c = 0; c < batch.commandCount; ++c) {
+            const auto& command = commands[batch.firstCommand + c];
+            const auto& range = meshRanges[command.mesh];
+            cmdBuffer.drawIndexed(range.indexCount, command.instanceCount, range.firstIndex, range.vertexOffset, command.firstInstance);
+            ++stats.draws;
+        }
+    }
+}
+
+void Scene::renderBindless(vk::CommandBuffer cmdBuffer, const FrameDraws& frame, bool wireframe) {
+    if (renderQueue.commands().empty()) {
+        return;
+    }
+    writeFrameDraws(frame);
+    cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, bindlessPipelineLayout, 0, descriptorSetScene, nullptr);
+    bindless->bind(cmdBuffer, vk::PipelineBindPoint::eGraphics, bindlessPipelineLayout, 1);
+    stats.descriptorBinds += 2;
+    SceneBindlessPushConstants pushConstants{ materialBufferSlot, frame.drawDataSlot };
+    cmdBuffer.pushConstants<SceneBindlessPushConstants>(bindlessPipelineLayout, vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eFragment, 0,
+                                                        pushConstants);
+    cmdBuffer.bindVertexBuffers(0, vertexBuffer.buffer, { 0 });
+    cmdBuffer.bindIndexBuffer(indexBuffer.buffer, 0, vk::IndexType::eUint32);
+
+    const vk::DeviceSize stride = sizeof(vk::DrawIndexedIndirectCommand);
+    const auto& commands = renderQueue.commands();
+    vk::Pipeline boundPipeline;
+    for (const auto& batch : renderQueue.batches()) {
+        vk::Pipeline pipeline = batchPipeline(batch, wireframe, true);
+        if (pipeline != boundPipeline) {
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+            boundPipeline = pipeline;
+            ++stats.pipelineBinds;
+        }
+        if (!drawIndirectFirstInstance) {
+            // Direct draws may always start at a non-zero instance
+            for (uint32_t c = 0; c < batch.commandCount; ++c) {
+                const auto& command = commands[batch.firstCommand + c];
+                const auto& range = meshRanges[command.mesh];
+                cmdBuffer.drawIndexed(range.indexCount, command.instanceCount, range.firstIndex, range.vertexOffset, command.firstInstance);
+                ++stats.draws;
+            }
+        } else if (multiDrawIndirect) {
+            cmdBuffer.drawIndexedIndirect(frame.indirectBuffer.buffer, batch.firstCommand * stride, batch.commandCount, static_cast<uint32_t>(stride));
+            ++stats.draws;
+        } else {
+            // Without multi draw indirect every command needs its own call
+            for (uint32_t c = 0; c < batch.commandCount; ++c) {
+                cmdBuffer.drawIndexedIndirect(frame.indirectBuffer.buffer, (batch.firstCommand + c) * stride, 1, static_cast<uint32_t>(stride));
+                ++stats.draws;
+            }
+        }
+    }
+}
@@ -0,0 +1,248 @@
+/*
+* Scene of many meshes and materials loaded with assimp into shared vertex and index buffers, drawn in file
+* order, sorted by a vkx::render::RenderQueue or with materials read through a vks::BindlessTable
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vks/context.hpp"
+#include "vks/bindless.hpp"
+#include "vks/model.hpp"
+#include "vks/texture.hpp"
+#include "renderqueue.hpp"
+
+struct aiScene;
+
+namespace vkx {
+
+// Scene related structs
+
+// Vertex of the merged scene geometry, see Scene::vertexLayout
+struct SceneVertex {
+    glm::vec3 pos;
+    glm::vec3 normal;
+    glm::vec2 uv;
+    glm::vec3 color;
+};
+
+// Shader properites for a material
+// Will be passed to the shaders using push constant
+struct SceneMaterialProperites {
+    glm::vec4 ambient;
+    glm::vec4 diffuse;
+    glm::vec4 specular;
+    float opacity;
+};
+
+// Stores info on the materials used in the scene
+struct SceneMaterial {
+    std::string name;
+    // Material properties
+    SceneMaterialProperites properties;
+    // The scene only uses a diffuse channel
+    vks::texture::Texture2D diffuse;
+    // The material's descriptor contains the material descriptors
+    vk::DescriptorSet descriptorSet;
+    // Pointer to the pipeline used by this material
+    vk::Pipeline* pipeline;
+    // Index of this material's diffuse texture in the bindless table
+    uint32_t diffuseSlot;
+};
+
+// Material as stored in the bindless material buffer (std430)
+struct SceneMaterialData {
+    SceneMaterialProperites properties;
+    uint32_t diffuseSlot;
+    uint32_t padding[2];
+};
+
+// Buffers used by the bindless path, referenced by their table slots.  The draw data buffer
+// holds one material index per instance.
+struct SceneBindlessPushConstants {
+    uint32_t materialBufferSlot;
+    uint32_t drawDataSlot;
+};
+
+// Stores per-mesh data, the geometry of all meshes lives in shared vertex and index buffers
+struct SceneMesh {
+    vkx::render::MeshRange range;
+    // Bounding box center, used for depth sorting
+    glm::vec3 center;
+
+    // Pointer to the material used by this mesh
+    SceneMaterial* material;
+};
+
+enum class SceneRenderMode
+{
+    // One draw with full state setup per mesh, in file order
+    fileOrder,
+    // Draws sorted by state, state only changes between batches
+    sorted,
+    // Sorted, with materials read through the bindless table and every batch issued as a single indirect draw
+    bindless,
+};
+
+// Class for loading the scene and generating all Vulkan resources
+class Scene {
+private:
+    const vks::Context& context;
+    const vk::Device& device{ context.device };
+    const vk::Queue& queue{ context.queue };
+
+    vk::DescriptorPool descriptorPool;
+
+    // We will be using separate descriptor sets (and bindings)
+    // for material and scene related uniforms
+    struct {
+        vk::DescriptorSetLayout material;
+        vk::DescriptorSetLayout scene;
+    } descriptorSetLayouts;
+
+    vk::DescriptorSet descriptorSetScene;
+
+    // Optional global resource table, when set materials are bound by index instead of per-material sets
+    vks::BindlessTable* bindless{ nullptr };
+    vks::Buffer materialBuffer;
+    uint32_t materialBufferSlot{ 0 };
+
+    const aiScene* aScene;
+
+    // Get materials from the assimp scene and map to our scene structures
+    void loadMaterials();
+
+    // Register all material textures and a buffer with all material properties in the bindless table
+    void loadBindlessMaterials();
+
+    // Load all meshes from the scene and generate the Vulkan resources
+    // for rendering them
+    void loadMeshes(vk::CommandBuffer copyCmd);
+
+    // Indirect commands and per instance material indices of the bindless path, written by the host before
+    // the command buffer of a swap chain image is recorded.  Every image has its own, so they can be rewritten
+    // while the frames of the other images are in flight.
+    struct FrameDraws {
+        vks::Buffer indirectBuffer;
+        vks::Buffer drawDataBuffer;
+        uint32_t drawDataSlot;
+    };
+
+    void destroyFrameDraws();
+
+    // Copy the depth sorted draws of the queue into the buffers of a swap chain image
+    void writeFrameDraws(const FrameDraws& frame) const;
+
+    // Merged geometry of all meshes
+    vks::Buffer vertexBuffer;
+    vks::Buffer indexBuffer;
+    std::vector<vkx::render::MeshRange> meshRanges;
+
+    vkx::render::RenderQueue renderQueue;
+    // Translucent meshes of the queue, back to front
+    std::vector<uint32_t> translucentOrder;
+    std::vector<FrameDraws> frameDraws;
+
+public:
+    // Layout of SceneVertex, for the pipelines drawing the scene
+    static const vks::model::VertexLayout vertexLayout;
+
+    std::string assetPath = "";
+
+    std::vector<SceneMaterial> materials;
+    std::vector<SceneMesh> meshes;
+
+    // Shared ubo containing matrices used by all
+    // materials and meshes
+    vks::Buffer uniformBuffer;
+    struct {
+        glm::mat4 projection;
+        glm::mat4 view;
+        glm::mat4 model;
+        glm::vec4 lightPos = glm::vec4(1.25f, 8.35f, 0.0f, 0.0f);
+    } uniformData;
+
+    // Scene uses multiple pipelines
+    struct {
+        vk::Pipeline solid;
+        vk::Pipeline blending;
+        vk::Pipeline wireframe;
+    } pipelines;
+
+    // Same pipelines, reading materials from the bindless table
+    struct {
+        vk::Pipeline solid;
+        vk::Pipeline blending;
+        vk::Pipeline wireframe;
+    } bindlessPipelines;
+
+    // Shared pipeline layout
+    vk::PipelineLayout pipelineLayout;
+    vk::PipelineLayout bindlessPipelineLayout;
+
+    // For displaying only a single part of the scene
+    bool renderSingleScenePart = false;
+    uint32_t scenePartIndex = 0;
+
+    // Multi draw indirect lets a whole batch be issued with a single call
+    bool multiDrawIndirect = false;
+    // The bindless shaders find the payload of an instance through gl_InstanceIndex, which indirect draws can only
+    // offset by a first instance with this feature.  Without it the commands are issued as direct draws.
+    bool drawIndirectFirstInstance = false;
+
+    // Work done by the last recorded command buffer
+    struct RecordStats {
+        uint32_t draws{ 0 };
+        uint32_t pipelineBinds{ 0 };
+        uint32_t descriptorBinds{ 0 };
+    } stats;
+
+    Scene(const vks::Context& context, vks::BindlessTable* bindless = nullptr);
+    ~Scene();
+
+    void load(const std::string& filename, vk::CommandBuffer copyCmd);
+
+    // Sort key of a mesh, seen from the given position
+    uint64_t sortKey(uint32_t mesh, const glm::vec3& cameraPosition) const;
+
+    bool isTranslucent(uint32_t mesh) const { return meshes[mesh].material->pipeline == &pipelines.blending; }
+
+    bool isDrawn(uint32_t mesh) const { return !renderSingleScenePart || mesh == scenePartIndex; }
+
+    // Create the draw buffers of the bindless path for every swap chain image, large enough for all meshes.
+    // Needs to be called before recording command buffers in SceneRenderMode::bindless.
+    void prepareFrames(uint32_t imageCount);
+
+    // Sort and batch the visible meshes, viewed from the given position.  Needs to be called before
+    // recording command buffers in any mode other than SceneRenderMode::fileOrder.  Only touches host memory,
+    // command buffers recorded earlier stay valid.
+    void buildRenderQueue(const glm::vec3& cameraPosition, SceneRenderMode mode);
+
+    // Whether the translucent meshes seen from the given position are in a different order than in the queue, which
+    // then needs to be built again.  Opaque meshes are only sorted front to back for speed and are left alone.
+    bool translucentOrderChanged(const glm::vec3& cameraPosition) const;
+
+    // Renders the scene into an active command buffer of the given swap chain image, whose previous
+    // submission has to be complete.  In a real world application we would do some visibility culling in here.
+    void render(vk::CommandBuffer cmdBuffer, uint32_t image, bool wireframe, SceneRenderMode mode);
+
+private:
+    // Every mesh sets up all of its state, regardless of what the previous mesh used
+    void renderFileOrder(vk::CommandBuffer cmdBuffer, bool wireframe);
+
+    vk::Pipeline batchPipeline(const vkx::render::Batch& batch, bool wireframe, bool bindlessVariant) const;
+
+    // Draws sorted by state, pipelines and material sets are only bound when they change
+    void renderSorted(vk::CommandBuffer cmdBuffer, bool wireframe);
+
+    // All state is bound once, materials are fetched per instance by the shaders and every batch is one indirect draw
+    void renderBindless(vk::CommandBuffer cmdBuffer, const FrameDraws& frame, bool wireframe);
+};
+
+}  // namespace vkx
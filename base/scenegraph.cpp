@@ -0,0 +1,145 @@
+#include "scenegraph.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+using namespace vkx;
+
+// Nodes per task when exporting the world matrices
+static const size_t EXPORT_GRAIN = 4096;
+
+void SceneGraph::clear() {
+    parents.clear();
+    subtreeEnds.clear();
+    names.clear();
+    locals.clear();
+    worlds.clear();
+    dirty.clear();
+    changes.clear();
+    taskGrain = 0;
+}
+
+void SceneGraph::reserve(uint32_t count) {
+    parents.reserve(count);
+    subtreeEnds.reserve(count);
+    names.reserve(count);
+    locals.reserve(count);
+    worlds.reserve(count);
+    dirty.reserve(count);
+    changes.reserve(count);
+}
+
+uint32_t SceneGraph::addNode(uint32_t parent, const glm::mat4& local, const std::string& name) {
+    const uint32_t node = size();
+    // Only the last node and its ancestors have subtrees that end at the new node
+    assert(parent == INVALID_NODE || (parent < node && subtreeEnds[parent] == node));
+
+    parents.push_back(parent);
+    subtreeEnds.push_back(node + 1);
+    names.push_back(name);
+    locals.push_back(local);
+    worlds.push_back(local);
+    dirty.push_back(1);
+    changes.push_back(0);
+    for (uint32_t ancestor = parent; ancestor != INVALID_NODE; ancestor = parents[ancestor]) {
+        subtreeEnds[ancestor] = node + 1;
+    }
+    taskGrain = 0;
+    return node;
+}
+
+uint32_t SceneGraph::find(const std::string& name) const {
+    auto it = std::find(names.begin(), names.end(), name);
+    return it == names.end() ? INVALID_NODE : static_cast<uint32_t>(it - names.begin());
+}
+
+void SceneGraph::setLocal(uint32_t node, const glm::mat4& local) {
+    locals[node] = local;
+    dirty[node] = 1;
+}
+
+void SceneGraph::updateRange(uint32_t begin, uint32_t end) {
+    for (uint32_t node = begin; node < end; ++node) {
+        // The parent comes first, so its world matrix and change flag are already up to date
+        const uint32_t parent = parents[node];
+        const bool parentChanged = parent != INVALID_NODE && changes[parent];
+        if (dirty[node] || parentChanged) {
+            worlds[node] = parent == INVALID_NODE ? locals[node] : worlds[parent] * locals[node];
+            changes[node] = 1;
+        } else {
+            changes[node] = 0;
+        }
+        dirty[node] = 0;
+    }
+}
+
+void SceneGraph::update() {
+    updateRange(0, size());
+}
+
+void SceneGraph::buildTasks(uint32_t grain) {
+    serialNodes.clear();
+    tasks.clear();
+
+    // Depth first over the nodes with large subtrees.  Those are updated one by one before all others, the
+    // subtrees below them become tasks.
+    std::vector<uint32_t> stack;
+    for (uint32_t root = 0; root < size(); root = subtreeEnds[root]) {
+        stack.push_back(root);
+        while (!stack.empty()) {
+            const uint32_t node = stack.back();
+            stack.pop_back();
+            const uint32_t end = subtreeEnds[node];
+            if (end - node <= grain) {
+                // Neighbouring subtrees are independent of each other, so small ones share a task
+                if (!tasks.empty() && tasks.back().end == node && end - tasks.back().begin <= grain) {
+                    tasks.back().end = end;
+                } else {
+                    tasks.push_back({ node, end });
+                }
+                continue;
+            }
+            serialNodes.push_back(node);
+            // Push the children in reverse, so they are visited and the tasks created in ascending order
+            const size_t firstChild = stack.size();
+            for (uint32_t child = node + 1; child < end; child = subtreeEnds[child]) {
+                stack.push_back(child);
+            }
+            std::reverse(stack.begin() + firstChild, stack.end());
+        }
+    }
+    taskGrain = grain;
+}
+
+void SceneGraph::update(ThreadPool& pool, uint32_t grain) {
+    grain = std::max(grain, 1u);
+    if (taskGrain != grain) {
+        buildTasks(grain);
+    }
+    for (uint32_t node : serialNodes) {
+        updateRange(node, node + 1);
+    }
+    pool.parallelFor(tasks.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            updateRange(tasks[i].begin, tasks[i].end);
+        }
+    });
+}
+
+uint32_t SceneGraph::changedCount() const {
+    return static_cast<uint32_t>(std::count(changes.begin(), changes.end(), 1));
+}
+
+void SceneGraph::exportWorldMatrices(ThreadPool& pool, void* target, size_t stride) const {
+    pool.parallelFor(size(), EXPORT_GRAIN, [&](size_t begin, size_t end) {
+        uint8_t* output = static_cast<uint8_t*>(target);
+        if (stride == sizeof(glm::mat4)) {
+            memcpy(output + begin * stride, worlds.data() + begin, (end - begin) * sizeof(glm::mat4));
+            return;
+        }
+        for (size_t node = begin; node < end; ++node) {
+            memcpy(output + node * stride, &worlds[node], sizeof(glm::mat4));
+        }
+    });
+}
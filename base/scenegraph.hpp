@@ -0,0 +1,101 @@
+/*
+* Transform hierarchy stored as flat arrays, with incremental world matrix updates
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "threadpool.hpp"
+
+namespace vkx {
+
+/**
+* @brief Nodes with local transforms and the world transforms derived from them
+*
+* The nodes are kept in depth first order: every parent comes before its children, and the subtree of a
+* node occupies the indices [node, subtreeEnd(node)).  Updating the world matrices is then a single pass
+* over the arrays instead of a recursive walk, and each subtree is a contiguous range that can be handed
+* to a thread on its own.
+*
+* Changing a local transform only marks the node.  update() recomputes the world matrices of marked
+* nodes and their descendants and leaves all others untouched.  changed() reports which nodes the last
+* update() touched, e.g. to only rewrite their part of an instance buffer.
+*/
+class SceneGraph {
+public:
+    static const uint32_t INVALID_NODE = UINT32_MAX;
+
+    void clear();
+    void reserve(uint32_t count);
+
+    /**
+    * @brief Add a node below `parent`, or a root node for INVALID_NODE
+    *
+    * Nodes have to be added in depth first order, so the parent must be the last added node or one of its
+    * ancestors.  A recursive walk over another hierarchy, e.g. an aiNode tree, naturally does that.
+    *
+    * @return The index of the node, which is also its handle
+    */
+    uint32_t addNode(uint32_t parent, const glm::mat4& local = glm::mat4(1.0f), const std::string& name = {});
+
+    uint32_t size() const { return static_cast<uint32_t>(parents.size()); }
+    uint32_t parent(uint32_t node) const { return parents[node]; }
+    uint32_t subtreeEnd(uint32_t node) const { return subtreeEnds[node]; }
+    const std::string& name(uint32_t node) const { return names[node]; }
+    // First node with the given name, or INVALID_NODE
+    uint32_t find(const std::string& name) const;
+
+    const glm::mat4& local(uint32_t node) const { return locals[node]; }
+    void setLocal(uint32_t node, const glm::mat4& local);
+    // Valid after update()
+    const glm::mat4& world(uint32_t node) const { return worlds[node]; }
+    const std::vector<glm::mat4>& worldMatrices() const { return worlds; }
+
+    // Recompute the world matrices of all changed nodes on the calling thread
+    void update();
+    // Same as update(), with subtrees of more than `grain` nodes split across the thread pool
+    void update(ThreadPool& pool, uint32_t grain = 1024);
+
+    // Whether the world matrix of a node was recomputed by the last update
+    bool changed(uint32_t node) const { return changes[node] != 0; }
+    uint32_t changedCount() const;
+
+    // Copy the world matrices of all nodes to `target`, the one of node i to `target` + i * `stride`, e.g. into
+    // a mapped instance buffer
+    void exportWorldMatrices(ThreadPool& pool, void* target, size_t stride = sizeof(glm::mat4)) const;
+
+private:
+    // Nodes whose world matrix depends on no other node in the range, so the range can be updated on its own
+    struct Task {
+        uint32_t begin;
+        uint32_t end;
+    };
+
+    void updateRange(uint32_t begin, uint32_t end);
+    // Split the hierarchy into a serial part and independent subtrees of at most `grain` nodes
+    void buildTasks(uint32_t grain);
+
+    std::vector<uint32_t> parents;
+    std::vector<uint32_t> subtreeEnds;
+    std::vector<std::string> names;
+    std::vector<glm::mat4> locals;
+    std::vector<glm::mat4> worlds;
+    // Local transform changed since the last update
+    std::vector<uint8_t> dirty;
+    // World matrix recomputed by the last update
+    std::vector<uint8_t> changes;
+
+    // Cached split of the hierarchy for the parallel update, rebuilt when nodes are added or the grain changes
+    std::vector<uint32_t> serialNodes;
+    std::vector<Task> tasks;
+    uint32_t taskGrain{ 0 };
+};
+
+}  // namespace vkx
@@ -0,0 +1,105 @@
+#include "shadowcascades.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+using namespace vkx;
+
+ShadowCascades::ShadowCascades(uint32_t count, uint32_t resolution)
+    : resolution(resolution)
+    , cascades(count)
+    , cachedViewProjections(count) {}
+
+void ShadowCascades::update(const glm::mat4& projection, const glm::mat4& view, float nearClip, float farClip, const glm::vec3& lightDirection) {
+    const uint32_t count = size();
+    const float range = farClip - nearClip;
+    const float ratio = farClip / nearClip;
+    // Half extents of the view frustum at unit distance, for a symmetric projection
+    const glm::vec2 tanHalf = glm::vec2(1.0f / std::abs(projection[0][0]), 1.0f / std::abs(projection[1][1]));
+    const glm::mat4 inverseView = glm::inverse(view);
+
+    // Only rotates, the translation of a cascade goes into its projection so it can be snapped
+    const glm::vec3 up = std::abs(lightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    const glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), lightDirection, up);
+
+    // Keep at least three quarters of the texels for the slice itself
+    const uint32_t snap = std::max(1u, std::min(snapTexels, resolution / 8));
+
+    float lastSplit = nearClip;
+    for (uint32_t i = 0; i < count; i++) {
+        // Split distances as presented in https://developer.nvidia.com/gpugems/GPUGems3/gpugems3_ch10.html
+        const float p = (i + 1) / static_cast<float>(count);
+        const float logarithmic = nearClip * std::pow(ratio, p);
+        const float uniform = nearClip + range * p;
+        const float split = splitLambda * (logarithmic - uniform) + uniform;
+
+        // Bounding sphere of the slice in view space.  The center lies on the view axis, and the farthest
+        // points are corners of the near or far rectangle.
+        const float center = 0.5f * (lastSplit + split);
+        float radius = 0.0f;
+        for (float distance : { lastSplit, split }) {
+            radius = std::max(radius, glm::length(glm::vec3(tanHalf * distance, distance - center)));
+        }
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        // Widen by half a grid step, then a step is exactly `snap` texels of the widened cascade
+        const float halfExtent = radius * resolution / static_cast<float>(resolution - snap);
+        const float step = 2.0f * halfExtent * snap / static_cast<float>(resolution);
+        glm::vec3 lightCenter = glm::vec3(lightView * inverseView * glm::vec4(0.0f, 0.0f, -center, 1.0f));
+        lightCenter = glm::floor(lightCenter / step + 0.5f) * step;
+
+        // The light looks down its negative z axis
+        const glm::mat4 lightProjection = glm::ortho(lightCenter.x - halfExtent, lightCenter.x + halfExtent, lightCenter.y - halfExtent,
+                                                     lightCenter.y + halfExtent, -(lightCenter.z + halfExtent), halfExtent - lightCenter.z);
+
+        Cascade& cascade = cascades[i];
+        cascade.splitDepth = -split;
+        cascade.viewProjection = lightProjection * lightView;
+        cascade.frustum.update(cascade.viewProjection);
+        lastSplit = split;
+    }
+}
+
+uint32_t ShadowCascades::staleMask() const {
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < size(); i++) {
+        if (!(cachedMask & (1u << i)) || cachedViewProjections[i] != cascades[i].viewProjection) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
+
+void ShadowCascades::markCached(uint32_t mask) {
+    for (uint32_t i = 0; i < size(); i++) {
+        if (mask & (1u << i)) {
+            cachedViewProjections[i] = cascades[i].viewProjection;
+        }
+    }
+    cachedMask |= mask;
+}
+
+void ShadowCascades::invalidate() {
+    cachedMask = 0;
+}
+
+uint32_t ShadowCascades::casterMask(const glm::vec3& center, float radius, bool towardsLight) const {
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < size(); i++) {
+        const auto& planes = cascades[i].frustum.planes;
+        bool inside = true;
+        for (uint32_t side = 0; side < planes.size() && inside; side++) {
+            // The plane on the side of the light
+            if (towardsLight && side == vks::Frustum::BACK) {
+                continue;
+            }
+            inside = glm::dot(glm::vec3(planes[side]), center) + planes[side].w > -radius;
+        }
+        if (inside) {
+            mask |= 1u << i;
+        }
+    }
+    return mask;
+}
@@ -0,0 +1,74 @@
+/*
+* Stable shadow map cascades for a directional light, with per cascade caster culling
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vks/frustum.hpp"
+
+namespace vkx {
+
+/**
+* @brief Splits of the view frustum into cascades and the light matrices that render them
+*
+* Each slice of the view frustum is enclosed in a sphere whose radius only depends on the projection and the
+* split distances, so the extent of a cascade does not change while the camera moves or turns.  The center of
+* the cascade is snapped in light space to a grid of `snapTexels` shadow map texels, and the cascade is widened
+* by half a grid step so the slice stays covered.  The matrix of a cascade therefore only changes when the
+* light turns, the projection or the splits change, or the camera crosses a grid line.  Edges of shadows do not
+* shimmer as the camera moves, and a cascade whose matrix did not change can reuse the depth of the static
+* geometry rendered into it before.
+*
+* staleMask() has a bit set for every cascade whose matrix differs from the one it was last cached with, see
+* markCached().  casterMask() tells which cascades a bounding sphere can cast a shadow into.
+*/
+class ShadowCascades {
+public:
+    struct Cascade {
+        // View space depth where the cascade ends, negative in front of the camera
+        float splitDepth{ 0.0f };
+        glm::mat4 viewProjection;
+        vks::Frustum frustum;
+    };
+
+    // Up to 32 cascades, each rendered into a square shadow map of `resolution` texels
+    ShadowCascades(uint32_t count, uint32_t resolution);
+
+    // Recalculate the splits and matrices for the camera and the direction the light travels in
+    void update(const glm::mat4& projection, const glm::mat4& view, float nearClip, float farClip, const glm::vec3& lightDirection);
+
+    const Cascade& operator[](uint32_t index) const { return cascades[index]; }
+    uint32_t size() const { return static_cast<uint32_t>(cascades.size()); }
+
+    // Cascades whose cached depth was rendered with a different matrix, or not at all
+    uint32_t staleMask() const;
+    // The cascades in `mask` were rendered with their current matrices
+    void markCached(uint32_t mask);
+    // Drop all cached depth, e.g. after static geometry moved
+    void invalidate();
+
+    // Bit i is set if the sphere intersects cascade i.  Casters between the light and a cascade are kept when
+    // `towardsLight` is set, for shadow passes that clamp depth instead of clipping at the near plane.
+    uint32_t casterMask(const glm::vec3& center, float radius, bool towardsLight = true) const;
+
+    // Blend between logarithmic (1) and uniform (0) split distances
+    float splitLambda{ 0.95f };
+    // Grid the cascades are snapped to, in shadow map texels.  Larger steps keep cached depth valid for longer
+    // camera moves, but spread a cascade over more texels.
+    uint32_t snapTexels{ 64 };
+
+private:
+    uint32_t resolution;
+    std::vector<Cascade> cascades;
+    std::vector<glm::mat4> cachedViewProjections;
+    uint32_t cachedMask{ 0 };
+};
+
+}  // namespace vkx
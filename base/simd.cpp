@@ -0,0 +1,152 @@
+#include "simd.hpp"
+#include "attractor_kernels.hpp"
+#include "cloth_kernels.hpp"
+#include "culling_kernels.hpp"
+#include "heightmap_kernels.hpp"
+#include "nbody_kernels.hpp"
+#include "noise_kernels.hpp"
+#include "particles_kernels.hpp"
+#include "transforms_kernels.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if VKX_SIMD_AVX2 && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace vkx { namespace simd {
+
+float detail::powScalar(float value, float exponent) {
+    return std::pow(value, exponent);
+}
+
+// Scalar backend, always available
+namespace scalar {
+
+inline float sqrtLane(float value) {
+    return std::sqrt(value);
+}
+
+inline float floorLane(float value) {
+    return std::floor(value);
+}
+
+// One float at a time, Lane is defined by the kernels
+struct Lane;
+using Pack = Lane;
+
+#include "simd_kernels.inl"
+#include "nbody_kernels.inl"
+#include "attractor_kernels.inl"
+#include "cloth_kernels.inl"
+#include "particles_kernels.inl"
+#include "noise_kernels.inl"
+#include "transforms_kernels.inl"
+#include "culling_kernels.inl"
+#include "heightmap_kernels.inl"
+
+}  // namespace scalar
+
+static bool cpuSupportsAvx2() {
+#if VKX_SIMD_AVX2 && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+        return false;
+    }
+    // The OS has to save the YMM registers as well
+    __cpuid(info, 1);
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave || (_xgetbv(0) & 0x6) != 0x6) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif VKX_SIMD_AVX2
+    return __builtin_cpu_supports("avx2") != 0;
+#else
+    return false;
+#endif
+}
+
+bool available(Backend backend) {
+    switch (backend) {
+        case Backend::scalar:
+            return true;
+        case Backend::avx2: {
+            static const bool supported = cpuSupportsAvx2();
+            return supported;
+        }
+        case Backend::neon:
+#if VKX_SIMD_NEON
+            return true;
+#else
+            return false;
+#endif
+    }
+    return false;
+}
+
+Backend best() {
+    if (available(Backend::avx2)) {
+        return Backend::avx2;
+    }
+    if (available(Backend::neon)) {
+        return Backend::neon;
+    }
+    return Backend::scalar;
+}
+
+const char* name(Backend backend) {
+    switch (backend) {
+        case Backend::scalar:
+            return "scalar";
+        case Backend::avx2:
+            return "AVX2";
+        case Backend::neon:
+            return "NEON";
+    }
+    return "unknown";
+}
+
+uint32_t width(Backend backend) {
+    switch (backend) {
+        case Backend::avx2:
+            return 8;
+        case Backend::neon:
+            return 4;
+        default:
+            return 1;
+    }
+}
+
+uint32_t ulpDistance(float a, float b) {
+    if (a == b) {
+        return 0;
+    }
+    if (std::isnan(a) || std::isnan(b) || (a < 0.0f) != (b < 0.0f)) {
+        return UINT32_MAX;
+    }
+    int32_t ia, ib;
+    std::memcpy(&ia, &a, sizeof(float));
+    std::memcpy(&ib, &b, sizeof(float));
+    // Same sign, so the integer representations are ordered like the floats
+    return static_cast<uint32_t>(std::abs(static_cast<int64_t>(ia) - static_cast<int64_t>(ib)));
+}
+
+void Comparison::add(float expected, float actual, const Tolerance& tolerance) {
+    const uint32_t ulps = ulpDistance(expected, actual);
+    const float absolute = std::abs(expected - actual);
+    ++count;
+    maxUlps = std::max(maxUlps, ulps);
+    if (!std::isnan(absolute)) {
+        maxAbsolute = std::max(maxAbsolute, absolute);
+    }
+    if (ulps > tolerance.maxUlps && !(absolute <= tolerance.absolute)) {
+        ++mismatches;
+    }
+}
+
+}}  // namespace vkx::simd
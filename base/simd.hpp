@@ -0,0 +1,120 @@
+/*
+* Runtime selection of the AVX2 / NEON backends of the CPU simulation kernels
+*
+* The kernels themselves are declared next to the code using them (nbody_kernels.hpp, cloth_kernels.hpp, ...)
+* and implemented once in the matching *_kernels.inl, which every backend translation unit includes into its own
+* namespace.  Kernel headers only include this file, as the AVX2 translation unit must not pull in inline code
+* shared with the rest of the program.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define VKX_SIMD_AVX2 1
+#endif
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+#define VKX_SIMD_NEON 1
+#endif
+
+namespace vkx { namespace simd {
+
+enum class Backend
+{
+    scalar,
+    avx2,
+    neon,
+};
+
+// Whether the backend was compiled in and is supported by the running CPU
+bool available(Backend backend);
+// The widest available backend
+Backend best();
+const char* name(Backend backend);
+// Floats processed per instruction
+uint32_t width(Backend backend);
+
+// Distance between two floats in units in the last place, saturated for NaNs and differing signs
+uint32_t ulpDistance(float a, float b);
+
+// Values match if they are within `maxUlps` of each other or closer than `absolute`, which covers
+// results that cancel out to (almost) zero
+struct Tolerance {
+    uint32_t maxUlps{ 16 };
+    float absolute{ 1e-6f };
+};
+
+// Accumulated result of comparing CPU against GPU values
+struct Comparison {
+    size_t count{ 0 };
+    size_t mismatches{ 0 };
+    uint32_t maxUlps{ 0 };
+    float maxAbsolute{ 0.0f };
+
+    void add(float expected, float actual, const Tolerance& tolerance);
+    bool passed() const { return mismatches == 0; }
+};
+
+// Kernels operate on structure of arrays views of the simulation state.  All of them process the index
+// range [begin, end) only, so they can be split across threads.
+
+namespace detail {
+// powf compiled without any extended instruction set, shared by all backends so they agree bit for bit
+float powScalar(float value, float exponent);
+}  // namespace detail
+
+// Declare a kernel in the namespace of every backend compiled in.  Kernel headers use this inside vkx::simd for the
+// functions their .inl defines, which take the arguments of the public function without the backend.
+#if VKX_SIMD_AVX2
+#define VKX_SIMD_DECLARE_AVX2(signature) \
+    namespace avx2 {                     \
+    signature;                           \
+    }
+#define VKX_SIMD_CASE_AVX2(call)  \
+    case Backend::avx2:           \
+        if (available(backend)) { \
+            avx2::call;           \
+            return;               \
+        }                         \
+        break;
+#else
+#define VKX_SIMD_DECLARE_AVX2(signature)
+#define VKX_SIMD_CASE_AVX2(call)
+#endif
+#if VKX_SIMD_NEON
+#define VKX_SIMD_DECLARE_NEON(signature) \
+    namespace neon {                     \
+    signature;                           \
+    }
+#define VKX_SIMD_CASE_NEON(call) \
+    case Backend::neon:          \
+        neon::call;              \
+        return;
+#else
+#define VKX_SIMD_DECLARE_NEON(signature)
+#define VKX_SIMD_CASE_NEON(call)
+#endif
+#define VKX_SIMD_DECLARE_KERNEL(signature) \
+    namespace scalar {                     \
+    signature;                             \
+    }                                      \
+    VKX_SIMD_DECLARE_AVX2(signature)       \
+    VKX_SIMD_DECLARE_NEON(signature)
+
+// Body of a public kernel function with a `backend` parameter: forward `call` to the requested backend, falling
+// back to scalar code if it is not supported
+#define VKX_SIMD_DISPATCH(call)  \
+    switch (backend) {           \
+        VKX_SIMD_CASE_AVX2(call) \
+        VKX_SIMD_CASE_NEON(call) \
+        default:                 \
+            break;               \
+    }                            \
+    scalar::call;
+
+}}  // namespace vkx::simd
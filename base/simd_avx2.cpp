@@ -0,0 +1,81 @@
+/*
+* AVX2 backend of the CPU simulation kernels
+*
+* This file is compiled with AVX2 code generation enabled and is only called after simd::available()
+* confirmed CPU support.  It must not use any inline function from the standard library, as the linker
+* could pick this translation unit's copy for the rest of the program as well.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+
+#include "simd.hpp"
+#include "attractor_kernels.hpp"
+#include "cloth_kernels.hpp"
+#include "culling_kernels.hpp"
+#include "heightmap_kernels.hpp"
+#include "nbody_kernels.hpp"
+#include "noise_kernels.hpp"
+#include "particles_kernels.hpp"
+#include "transforms_kernels.hpp"
+
+#include <immintrin.h>
+
+namespace vkx { namespace simd { namespace avx2 {
+
+inline float sqrtLane(float value) {
+    return _mm_cvtss_f32(_mm_sqrt_ss(_mm_set_ss(value)));
+}
+
+inline float floorLane(float value) {
+    return _mm_cvtss_f32(_mm_floor_ss(_mm_setzero_ps(), _mm_set_ss(value)));
+}
+
+struct Pack {
+    using Mask = __m256;
+    enum { width = 8 };
+    __m256 v;
+
+    static Pack set(float value) { return { _mm256_set1_ps(value) }; }
+    static Pack load(const float* source) { return { _mm256_loadu_ps(source) }; }
+    static Pack gather(const float* table, const Pack& index) { return { _mm256_i32gather_ps(table, _mm256_cvttps_epi32(index.v), 4) }; }
+    void store(float* target) const { _mm256_storeu_ps(target, v); }
+
+    Pack operator+(const Pack& o) const { return { _mm256_add_ps(v, o.v) }; }
+    Pack operator-(const Pack& o) const { return { _mm256_sub_ps(v, o.v) }; }
+    Pack operator*(const Pack& o) const { return { _mm256_mul_ps(v, o.v) }; }
+    Pack operator/(const Pack& o) const { return { _mm256_div_ps(v, o.v) }; }
+
+    static Pack sqrt(const Pack& a) { return { _mm256_sqrt_ps(a.v) }; }
+    static Pack pow(const Pack& a, float exponent) {
+        alignas(32) float values[width];
+        _mm256_store_ps(values, a.v);
+        for (float& value : values) {
+            value = detail::powScalar(value, exponent);
+        }
+        return { _mm256_load_ps(values) };
+    }
+    static Pack floor(const Pack& a) { return { _mm256_floor_ps(a.v) }; }
+    static Mask less(const Pack& a, const Pack& b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+    static Mask greater(const Pack& a, const Pack& b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+    static Mask equal(const Pack& a, const Pack& b) { return _mm256_cmp_ps(a.v, b.v, _CMP_EQ_OQ); }
+    static Mask maskOr(const Mask& a, const Mask& b) { return _mm256_or_ps(a, b); }
+    static Mask maskAnd(const Mask& a, const Mask& b) { return _mm256_and_ps(a, b); }
+    static uint32_t bits(const Mask& mask) { return static_cast<uint32_t>(_mm256_movemask_ps(mask)); }
+    static Pack select(const Mask& mask, const Pack& a, const Pack& b) { return { _mm256_blendv_ps(b.v, a.v, mask) }; }
+};
+
+#include "simd_kernels.inl"
+#include "nbody_kernels.inl"
+#include "attractor_kernels.inl"
+#include "cloth_kernels.inl"
+#include "particles_kernels.inl"
+#include "noise_kernels.inl"
+#include "transforms_kernels.inl"
+#include "culling_kernels.inl"
+#include "heightmap_kernels.inl"
+
+}}}  // namespace vkx::simd::avx2
+
+#endif
@@ -0,0 +1,59 @@
+/*
+* Core of the simulation kernels shared by all CPU backends
+*
+* This file is included into a backend specific namespace by simd.cpp, simd_avx2.cpp and simd_neon.cpp,
+* each of which first defines `sqrtLane(float)` and `floorLane(float)` functions and a `Pack` type holding
+* as many floats as one register of the instruction set.  Pack has the same interface as Lane below: static
+* members width, set, load, gather, sqrt, pow, floor, less, greater, equal, maskOr, maskAnd, bits and select, a store
+* member and the arithmetic operators.  The kernels of the individual modules (nbody_kernels.inl, cloth_kernels.inl,
+* ...) are included after this file and build on Lane, Pack and forRange().  They mirror the GLSL of the compute
+* examples operation by operation, so the results stay within a few ulps of the GPU.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+// A single float, used for remainders and grid boundaries
+struct Lane {
+    using Mask = bool;
+    enum { width = 1 };
+    float v;
+
+    static Lane set(float value) { return { value }; }
+    static Lane load(const float* source) { return { *source }; }
+    // Load `table[index]`, the index being a non-negative integer stored as float
+    static Lane gather(const float* table, const Lane& index) { return { table[static_cast<int32_t>(index.v)] }; }
+    void store(float* target) const { *target = v; }
+
+    Lane operator+(const Lane& o) const { return { v + o.v }; }
+    Lane operator-(const Lane& o) const { return { v - o.v }; }
+    Lane operator*(const Lane& o) const { return { v * o.v }; }
+    Lane operator/(const Lane& o) const { return { v / o.v }; }
+
+    static Lane sqrt(const Lane& a) { return { sqrtLane(a.v) }; }
+    static Lane pow(const Lane& a, float exponent) { return { detail::powScalar(a.v, exponent) }; }
+    static Lane floor(const Lane& a) { return { floorLane(a.v) }; }
+    static bool less(const Lane& a, const Lane& b) { return a.v < b.v; }
+    static bool greater(const Lane& a, const Lane& b) { return a.v > b.v; }
+    static bool equal(const Lane& a, const Lane& b) { return a.v == b.v; }
+    static bool maskOr(bool a, bool b) { return a || b; }
+    static bool maskAnd(bool a, bool b) { return a && b; }
+    // One bit per lane, set where the mask is true
+    static uint32_t bits(bool mask) { return mask ? 1u : 0u; }
+    static Lane select(bool mask, const Lane& a, const Lane& b) { return mask ? a : b; }
+};
+
+namespace kernels {
+
+// Run `kernel` on [begin, end) with full packs first and single lanes for the remainder
+template <typename Kernel>
+inline void forRange(uint32_t begin, uint32_t end, Kernel kernel) {
+    uint32_t i = begin;
+    for (; i + Pack::width <= end; i += Pack::width) {
+        kernel(Pack(), i);
+    }
+    for (; i < end; ++i) {
+        kernel(Lane(), i);
+    }
+}
+
+}  // namespace kernels
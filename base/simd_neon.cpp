@@ -0,0 +1,89 @@
+/*
+* NEON backend of the CPU simulation kernels
+*
+* NEON is part of the AArch64 baseline, so unlike AVX2 this needs neither special compiler flags nor a
+* runtime check.  32 bit ARM lacks vector division and square roots and uses the scalar backend.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#if defined(__aarch64__) || defined(_M_ARM64)
+
+#include "simd.hpp"
+#include "attractor_kernels.hpp"
+#include "cloth_kernels.hpp"
+#include "culling_kernels.hpp"
+#include "heightmap_kernels.hpp"
+#include "nbody_kernels.hpp"
+#include "noise_kernels.hpp"
+#include "particles_kernels.hpp"
+#include "transforms_kernels.hpp"
+
+#include <arm_neon.h>
+#include <cmath>
+
+namespace vkx { namespace simd { namespace neon {
+
+inline float sqrtLane(float value) {
+    return std::sqrt(value);
+}
+
+inline float floorLane(float value) {
+    return std::floor(value);
+}
+
+struct Pack {
+    using Mask = uint32x4_t;
+    enum { width = 4 };
+    float32x4_t v;
+
+    static Pack set(float value) { return { vdupq_n_f32(value) }; }
+    static Pack load(const float* source) { return { vld1q_f32(source) }; }
+    static Pack gather(const float* table, const Pack& index) {
+        const int32x4_t i = vcvtq_s32_f32(index.v);
+        const float values[width]{ table[vgetq_lane_s32(i, 0)], table[vgetq_lane_s32(i, 1)], table[vgetq_lane_s32(i, 2)], table[vgetq_lane_s32(i, 3)] };
+        return { vld1q_f32(values) };
+    }
+    void store(float* target) const { vst1q_f32(target, v); }
+
+    Pack operator+(const Pack& o) const { return { vaddq_f32(v, o.v) }; }
+    Pack operator-(const Pack& o) const { return { vsubq_f32(v, o.v) }; }
+    Pack operator*(const Pack& o) const { return { vmulq_f32(v, o.v) }; }
+    Pack operator/(const Pack& o) const { return { vdivq_f32(v, o.v) }; }
+
+    static Pack sqrt(const Pack& a) { return { vsqrtq_f32(a.v) }; }
+    static Pack pow(const Pack& a, float exponent) {
+        float values[width];
+        vst1q_f32(values, a.v);
+        for (float& value : values) {
+            value = detail::powScalar(value, exponent);
+        }
+        return { vld1q_f32(values) };
+    }
+    static Pack floor(const Pack& a) { return { vrndmq_f32(a.v) }; }
+    static Mask less(const Pack& a, const Pack& b) { return vcltq_f32(a.v, b.v); }
+    static Mask greater(const Pack& a, const Pack& b) { return vcgtq_f32(a.v, b.v); }
+    static Mask equal(const Pack& a, const Pack& b) { return vceqq_f32(a.v, b.v); }
+    static Mask maskOr(const Mask& a, const Mask& b) { return vorrq_u32(a, b); }
+    static Mask maskAnd(const Mask& a, const Mask& b) { return vandq_u32(a, b); }
+    static uint32_t bits(const Mask& mask) {
+        // Move the sign bit of lane i to bit i and add them up
+        static const int32_t shifts[width]{ 0, 1, 2, 3 };
+        return vaddvq_u32(vshlq_u32(vshrq_n_u32(mask, 31), vld1q_s32(shifts)));
+    }
+    static Pack select(const Mask& mask, const Pack& a, const Pack& b) { return { vbslq_f32(mask, a.v, b.v) }; }
+};
+
+#include "simd_kernels.inl"
+#include "nbody_kernels.inl"
+#include "attractor_kernels.inl"
+#include "cloth_kernels.inl"
+#include "particles_kernels.inl"
+#include "noise_kernels.inl"
+#include "transforms_kernels.inl"
+#include "culling_kernels.inl"
+#include "heightmap_kernels.inl"
+
+}}}  // namespace vkx::simd::neon
+
+#endif
@@ -0,0 +1,472 @@
+#include "terrain.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cstdio>
+#include <cstring>
+
+using namespace vkx;
+using namespace vkx::terrain;
+
+static const char MAGIC[4]{ 'V', 'K', 'T', 'R' };
+static const uint32_t VERSION = 1;
+static const uint32_t ALL_PLANES = 0x3f;
+static const uint32_t CULLED = ~0u;
+
+// Value noise lattice values in [-1, 1]
+static float latticeValue(uint32_t x, uint32_t y, uint32_t seed) {
+    uint32_t hash = x * 0x8da6b343u ^ y * 0xd8163841u ^ seed * 0xcb1ab31fu;
+    hash = (hash ^ (hash >> 16)) * 0x45d9f3bu;
+    hash ^= hash >> 16;
+    return float(hash & 0xffff) / 32767.5f - 1.0f;
+}
+
+std::vector<uint16_t> terrain::upsample(const std::vector<uint16_t>& heights, uint32_t sourceDim, uint32_t dim, float detail, uint32_t seed, ThreadPool& pool) {
+    std::vector<uint16_t> result(size_t(dim) * dim);
+    const float sourceScale = float(sourceDim - 1) / float(dim - 1);
+    pool.parallelFor(dim, 16, [&](size_t begin, size_t end) {
+        for (uint32_t y = static_cast<uint32_t>(begin); y < end; ++y) {
+            for (uint32_t x = 0; x < dim; ++x) {
+                const float sx = x * sourceScale, sy = y * sourceScale;
+                const uint32_t ix = std::min(uint32_t(sx), sourceDim - 2), iy = std::min(uint32_t(sy), sourceDim - 2);
+                const float fx = sx - ix, fy = sy - iy;
+                const uint16_t* source = heights.data() + size_t(iy) * sourceDim + ix;
+                const float top = source[0] + (source[1] - source[0]) * fx;
+                const float bottom = source[sourceDim] + (source[sourceDim + 1] - source[sourceDim]) * fx;
+                float height = top + (bottom - top) * fy;
+
+                // Octaves from twice the source frequency up to the target's
+                float amplitude = detail;
+                for (uint32_t cells = (sourceDim - 1) * 2, octave = 0; cells < dim; cells *= 2, ++octave, amplitude *= 0.5f) {
+                    const float cellScale = float(cells) / float(dim - 1);
+                    const float nx = x * cellScale, ny = y * cellScale;
+                    const uint32_t cx = uint32_t(nx), cy = uint32_t(ny);
+                    // Smoothstep between the lattice values to hide the cell borders
+                    float tx = nx - cx, ty = ny - cy;
+                    tx = tx * tx * (3.0f - 2.0f * tx);
+                    ty = ty * ty * (3.0f - 2.0f * ty);
+                    const uint32_t octaveSeed = seed + octave;
+                    const float l00 = latticeValue(cx, cy, octaveSeed), l10 = latticeValue(cx + 1, cy, octaveSeed);
+                    const float l01 = latticeValue(cx, cy + 1, octaveSeed), l11 = latticeValue(cx + 1, cy + 1, octaveSeed);
+                    const float v0 = l00 + (l10 - l00) * tx;
+                    const float v1 = l01 + (l11 - l01) * tx;
+                    height += (v0 + (v1 - v0) * ty) * amplitude;
+                }
+                result[size_t(y) * dim + x] = static_cast<uint16_t>(std::max(0.0f, std::min(height + 0.5f, 65535.0f)));
+            }
+        }
+    });
+    return result;
+}
+
+bool terrain::buildTileFile(const std::string& filename, const std::vector<uint16_t>& heights, uint32_t dim, uint32_t tileSize, ThreadPool& pool) {
+    uint32_t levels = 1;
+    while ((tileSize << (levels - 1)) < dim - 1) {
+        ++levels;
+    }
+    if (tileSize == 0 || (tileSize << (levels - 1)) != dim - 1 || heights.size() != size_t(dim) * dim) {
+        return false;
+    }
+
+    const uint32_t tileDim = tileSize + 3;
+    const size_t tileSamples = size_t(tileDim) * tileDim;
+    std::vector<NodeInfo> nodes(nodeCount(levels));
+    std::vector<std::vector<uint16_t>> tiles(levels);
+
+    for (uint32_t level = 0; level < levels; ++level) {
+        // Full resolution samples between the grid samples of this level
+        const uint32_t step = 1u << (levels - 1 - level);
+        const uint32_t edgeNodes = 1u << level;
+        tiles[level].resize(size_t(edgeNodes) * edgeNodes * tileSamples);
+        pool.parallelFor(size_t(edgeNodes) * edgeNodes, 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                const uint32_t x0 = static_cast<uint32_t>(i % edgeNodes) * tileSize * step;
+                const uint32_t y0 = static_cast<uint32_t>(i / edgeNodes) * tileSize * step;
+                auto sample = [&](int32_t x, int32_t y) {
+                    x = std::max(0, std::min(x, int32_t(dim) - 1));
+                    y = std::max(0, std::min(y, int32_t(dim) - 1));
+                    return heights[size_t(y) * dim + x];
+                };
+
+                uint16_t* tile = tiles[level].data() + i * tileSamples;
+                for (uint32_t ty = 0; ty < tileDim; ++ty) {
+                    for (uint32_t tx = 0; tx < tileDim; ++tx) {
+                        tile[ty * tileDim + tx] = sample(int32_t(x0) + (int32_t(tx) - 1) * int32_t(step), int32_t(y0) + (int32_t(ty) - 1) * int32_t(step));
+                    }
+                }
+
+                // Compare all full resolution samples of the node with the bilinear interpolation of its grid
+                NodeInfo& info = nodes[levelStart(level) + i];
+                info.minHeight = 0xffff;
+                info.maxHeight = 0;
+                info.error = 0.0f;
+                const uint32_t span = tileSize * step;
+                for (uint32_t y = 0; y <= span; ++y) {
+                    const uint32_t gy = std::min(y / step, tileSize - 1);
+                    const float fy = float(y - gy * step) / float(step);
+                    for (uint32_t x = 0; x <= span; ++x) {
+                        const uint16_t height = heights[size_t(y0 + y) * dim + x0 + x];
+                        info.minHeight = std::min(info.minHeight, height);
+                        info.maxHeight = std::max(info.maxHeight, height);
+                        if (step == 1) {
+                            continue;
+                        }
+                        const uint32_t gx = std::min(x / step, tileSize - 1);
+                        const float fx = float(x - gx * step) / float(step);
+                        const uint16_t* grid = tile + (gy + 1) * tileDim + gx + 1;
+                        const float top = grid[0] + (grid[1] - grid[0]) * fx;
+                        const float bottom = grid[tileDim] + (grid[tileDim + 1] - grid[tileDim]) * fx;
+                        info.error = std::max(info.error, fabsf(float(height) - (top + (bottom - top) * fy)));
+                    }
+                }
+            }
+        });
+    }
+
+    // A node is never more accurate than its children, so the selection never splits a node into coarser ones
+    for (uint32_t level = levels - 1; level-- > 0;) {
+        const uint32_t edgeNodes = 1u << level;
+        for (uint32_t y = 0; y < edgeNodes; ++y) {
+            for (uint32_t x = 0; x < edgeNodes; ++x) {
+                NodeInfo& info = nodes[nodeIndex(level, x, y)];
+                for (uint32_t child = 0; child < 4; ++child) {
+                    info.error = std::max(info.error, nodes[nodeIndex(level + 1, x * 2 + (child & 1), y * 2 + (child >> 1))].error);
+                }
+            }
+        }
+    }
+
+    const std::string temporary = filename + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        return false;
+    }
+    FileHeader header;
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.tileSize = tileSize;
+    header.levels = levels;
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1;
+    written = written && fwrite(nodes.data(), sizeof(NodeInfo), nodes.size(), file) == nodes.size();
+    for (const auto& levelTiles : tiles) {
+        written = written && fwrite(levelTiles.data(), sizeof(uint16_t), levelTiles.size(), file) == levelTiles.size();
+    }
+    written = fclose(file) == 0 && written;
+    if (!written || std::rename(temporary.c_str(), filename.c_str()) != 0) {
+        std::remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool TileFile::open(const std::string& path) {
+    std::ifstream stream(path, std::ios::binary);
+    FileHeader fileHeader;
+    if (!stream.read(reinterpret_cast<char*>(&fileHeader), sizeof(fileHeader)) || memcmp(fileHeader.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        fileHeader.version != VERSION || fileHeader.levels == 0 || fileHeader.levels > 16) {
+        return false;
+    }
+    std::vector<NodeInfo> infos(nodeCount(fileHeader.levels));
+    if (!stream.read(reinterpret_cast<char*>(infos.data()), infos.size() * sizeof(NodeInfo))) {
+        return false;
+    }
+    filename = path;
+    header = fileHeader;
+    nodeInfos = std::move(infos);
+    dataOffset = sizeof(FileHeader) + nodeInfos.size() * sizeof(NodeInfo);
+    return true;
+}
+
+bool TileFile::readTile(std::ifstream& stream, uint32_t node, uint16_t* target) const {
+    stream.clear();
+    stream.seekg(dataOffset + node * tileBytes());
+    return static_cast<bool>(stream.read(reinterpret_cast<char*>(target), tileBytes()));
+}
+
+const uint32_t TileCache::INVALID;
+
+TileCache::~TileCache() {
+    destroy();
+}
+
+void TileCache::create(const TileFile& tileFile, uint32_t slotCount) {
+    destroy();
+    file = &tileFile;
+    frame = 0;
+    nodeSlots.assign(tileFile.nodes().size(), INVALID);
+    slotNodes.assign(slotCount, INVALID);
+    slotFrames.assign(slotCount, 0);
+    stream.open(tileFile.path(), std::ios::binary);
+    loadedCount = 0;
+    evictedCount = 0;
+    stopping = false;
+    loader = std::thread(&TileCache::loaderLoop, this);
+}
+
+void TileCache::destroy() {
+    if (loader.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        loader.join();
+    }
+    queue.clear();
+    queued.clear();
+    loaded.clear();
+    stream.close();
+    nodeSlots.clear();
+    slotNodes.clear();
+    slotFrames.clear();
+    file = nullptr;
+}
+
+void TileCache::markUsed(uint32_t node) {
+    const uint32_t slot = nodeSlots[node];
+    if (slot != INVALID) {
+        slotFrames[slot] = frame;
+    }
+}
+
+void TileCache::request(const std::vector<uint32_t>& nodes) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto node : nodes) {
+            if (resident(node) || node == loading) {
+                continue;
+            }
+            auto found = queued.find(node);
+            if (found != queued.end()) {
+                found->second = frame;
+                continue;
+            }
+            if (std::any_of(loaded.begin(), loaded.end(), [&](const Loaded& entry) { return entry.node == node; })) {
+                continue;
+            }
+            queued[node] = frame;
+            queue.push_back(node);
+        }
+        queue.erase(std::remove_if(queue.begin(), queue.end(),
+                                   [&](uint32_t node) {
+                                       auto found = queued.find(node);
+                                       if (found->second != frame) {
+                                           queued.erase(found);
+                                           return true;
+                                       }
+                                       return false;
+                                   }),
+                    queue.end());
+        // Lower node indices are coarser levels
+        std::sort(queue.begin(), queue.end());
+    }
+    wake.notify_one();
+}
+
+void TileCache::loaderLoop() {
+    std::ifstream loaderStream(file->path(), std::ios::binary);
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [&] { return stopping || !queue.empty(); });
+        if (stopping) {
+            break;
+        }
+        const uint32_t node = queue.front();
+        queue.pop_front();
+        queued.erase(node);
+        loading = node;
+        lock.unlock();
+
+        Loaded entry{ node, std::vector<uint16_t>(file->tileBytes() / sizeof(uint16_t)) };
+        const bool read = file->readTile(loaderStream, node, entry.samples.data());
+
+        lock.lock();
+        loading = INVALID;
+        if (read) {
+            loaded.push_back(std::move(entry));
+        }
+    }
+}
+
+void TileCache::preload(const std::vector<uint32_t>& nodes) {
+    for (auto node : nodes) {
+        Loaded entry{ node, std::vector<uint16_t>(file->tileBytes() / sizeof(uint16_t)) };
+        if (!resident(node) && file->readTile(stream, node, entry.samples.data())) {
+            std::lock_guard<std::mutex> lock(mutex);
+            loaded.push_back(std::move(entry));
+        }
+    }
+}
+
+uint32_t TileCache::allocateSlot() {
+    uint32_t best = INVALID;
+    for (uint32_t slot = 0; slot < slotCount(); ++slot) {
+        if (slotNodes[slot] == INVALID) {
+            return slot;
+        }
+        if (slotFrames[slot] < frame && slotNodes[slot] != 0 && (best == INVALID || slotFrames[slot] < slotFrames[best])) {
+            best = slot;
+        }
+    }
+    if (best != INVALID) {
+        nodeSlots[slotNodes[best]] = INVALID;
+        slotNodes[best] = INVALID;
+        ++evictedCount;
+    }
+    return best;
+}
+
+void TileCache::collect(uint32_t maxUploads, std::vector<Upload>& uploads, std::vector<uint16_t>& data) {
+    uploads.clear();
+    data.clear();
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t taken = 0;
+    for (; taken < loaded.size() && uploads.size() < maxUploads; ++taken) {
+        Loaded& entry = loaded[taken];
+        if (resident(entry.node)) {
+            continue;
+        }
+        const uint32_t slot = allocateSlot();
+        if (slot == INVALID) {
+            break;
+        }
+        nodeSlots[entry.node] = slot;
+        slotNodes[slot] = entry.node;
+        // A new tile counts as used, so the next collect() this frame does not evict it again
+        slotFrames[slot] = frame;
+        uploads.push_back({ entry.node, slot, data.size() });
+        data.insert(data.end(), entry.samples.begin(), entry.samples.end());
+        ++loadedCount;
+    }
+    loaded.erase(loaded.begin(), loaded.begin() + taken);
+}
+
+TileCache::Statistics TileCache::statistics() const {
+    Statistics result;
+    result.resident = static_cast<uint32_t>(std::count_if(slotNodes.begin(), slotNodes.end(), [](uint32_t node) { return node != INVALID; }));
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        result.pending = static_cast<uint32_t>(queue.size() + loaded.size()) + (loading != INVALID ? 1 : 0);
+    }
+    result.loaded = loadedCount;
+    result.evicted = evictedCount;
+    return result;
+}
+
+struct Quadtree::Context {
+    const View& view;
+    std::vector<Tile>& tiles;
+    TileCache* cache;
+    std::vector<uint32_t>* missing;
+};
+
+void Quadtree::create(const TileFile& file, const glm::vec3& terrainOrigin, float size, float heightScale) {
+    levelCount = file.levels();
+    tileQuads = file.tileSize();
+    origin = terrainOrigin;
+    terrainSize = size;
+    const auto& infos = file.nodes();
+    minBounds.resize(infos.size());
+    maxBounds.resize(infos.size());
+    errors.resize(infos.size());
+    for (uint32_t level = 0; level < levelCount; ++level) {
+        const uint32_t edgeNodes = 1u << level;
+        const float nodeSize = size / float(edgeNodes);
+        for (uint32_t y = 0; y < edgeNodes; ++y) {
+            for (uint32_t x = 0; x < edgeNodes; ++x) {
+                const uint32_t node = nodeIndex(level, x, y);
+                const NodeInfo& info = infos[node];
+                minBounds[node] = origin + glm::vec3(x * nodeSize, -info.maxHeight / 65535.0f * heightScale, y * nodeSize);
+                maxBounds[node] = origin + glm::vec3((x + 1) * nodeSize, -info.minHeight / 65535.0f * heightScale, (y + 1) * nodeSize);
+                errors[node] = info.error / 65535.0f * heightScale;
+            }
+        }
+    }
+}
+
+float Quadtree::distance(uint32_t node, const glm::vec3& eye) const {
+    return glm::length(eye - glm::clamp(eye, minBounds[node], maxBounds[node]));
+}
+
+uint32_t Quadtree::cull(const vks::Frustum& frustum, uint32_t node, uint32_t planeMask) const {
+    const glm::vec3 center = (minBounds[node] + maxBounds[node]) * 0.5f;
+    const glm::vec3 extent = (maxBounds[node] - minBounds[node]) * 0.5f;
+    for (uint32_t p = 0; p < 6; ++p) {
+        if (!(planeMask & (1u << p))) {
+            continue;
+        }
+        const glm::vec4& plane = frustum.planes[p];
+        const float distance = plane.x * center.x + plane.y * center.y + plane.z * center.z + plane.w;
+        const float reach = fabsf(plane.x) * extent.x + fabsf(plane.y) * extent.y + fabsf(plane.z) * extent.z;
+        if (distance <= -reach) {
+            return CULLED;
+        }
+        if (distance - reach > 0.0f) {
+            // The whole node is on the inner side, so nothing below needs this plane
+            planeMask &= ~(1u << p);
+        }
+    }
+    return planeMask;
+}
+
+void Quadtree::select(const View& view, std::vector<Tile>& tiles, TileCache* cache, std::vector<uint32_t>* missing) const {
+    tiles.clear();
+    if (levelCount == 0) {
+        return;
+    }
+    const uint32_t planeMask = cull(view.frustum, 0, ALL_PLANES);
+    if (planeMask == CULLED) {
+        return;
+    }
+    if (cache && !cache->resident(0)) {
+        if (missing) {
+            missing->push_back(0);
+        }
+        return;
+    }
+    Context context{ view, tiles, cache, missing };
+    // The root has no parent to morph to
+    selectNode(context, 0, 0, 0, planeMask, FLT_MAX);
+}
+
+void Quadtree::selectNode(Context& context, uint32_t level, uint32_t x, uint32_t y, uint32_t planeMask, float parentSplit) const {
+    const uint32_t node = nodeIndex(level, x, y);
+    if (context.cache) {
+        // Ancestors of the drawn tiles stay resident as well, so moving away merges without waiting for loads
+        context.cache->markUsed(node);
+    }
+
+    const float split = splitDistance(node, context.view);
+    if (level + 1 < levelCount && distance(node, context.view.eye) < split) {
+        uint32_t childMasks[4];
+        bool ready = true;
+        for (uint32_t child = 0; child < 4; ++child) {
+            const uint32_t childNode = nodeIndex(level + 1, x * 2 + (child & 1), y * 2 + (child >> 1));
+            childMasks[child] = planeMask != 0 ? cull(context.view.frustum, childNode, planeMask) : 0;
+            if (childMasks[child] != CULLED && context.cache && !context.cache->resident(childNode)) {
+                ready = false;
+                if (context.missing) {
+                    context.missing->push_back(childNode);
+                }
+            }
+        }
+        if (ready) {
+            for (uint32_t child = 0; child < 4; ++child) {
+                if (childMasks[child] != CULLED) {
+                    selectNode(context, level + 1, x * 2 + (child & 1), y * 2 + (child >> 1), childMasks[child], split);
+                }
+            }
+            return;
+        }
+    }
+
+    Tile tile;
+    tile.node = node;
+    tile.level = level;
+    tile.offset = glm::vec2(minBounds[node].x, minBounds[node].z);
+    tile.size = terrainSize / float(1u << level);
+    // Vertices closer than the node's own split distance keep their shape, the morph ends where the parent would merge
+    tile.morphEnd = parentSplit;
+    tile.morphStart = std::min(std::max(split, parentSplit * (1.0f - context.view.morphRange)), parentSplit);
+    context.tiles.push_back(tile);
+}
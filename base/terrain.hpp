@@ -0,0 +1,245 @@
+/*
+* Chunked terrain: a quadtree of height tiles with screen space error LOD selection, streamed from a tile file
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <math.h>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "vks/frustum.hpp"
+#include "threadpool.hpp"
+
+namespace vkx { namespace terrain {
+
+// Level 0 is the root covering the whole terrain, every level splits the nodes of the one above into 4.  The
+// nodes are numbered level by level and row by row within a level.
+inline uint32_t levelStart(uint32_t level) {
+    return ((1u << (2 * level)) - 1) / 3;
+}
+inline uint32_t nodeIndex(uint32_t level, uint32_t x, uint32_t y) {
+    return levelStart(level) + y * (1u << level) + x;
+}
+inline uint32_t nodeCount(uint32_t levels) {
+    return levelStart(levels);
+}
+
+struct FileHeader {
+    char magic[4];
+    uint32_t version;
+    // Quads along the edge of a tile.  A tile stores (tileSize + 3)^2 samples, its grid plus a border of one
+    // sample the normals are taken from.
+    uint32_t tileSize;
+    uint32_t levels;
+};
+
+// Per node information read up front, so the selection never waits for the height data
+struct NodeInfo {
+    uint16_t minHeight;
+    uint16_t maxHeight;
+    // Largest difference between the heights of the full resolution terrain and the node's grid, in height units
+    float error;
+};
+
+// Bilinearly enlarge a square grid of `sourceDim` x `sourceDim` heights to `dim` x `dim` and add value noise at
+// the frequencies the source does not have.  `detail` is the amplitude of the coarsest noise octave in height
+// units, every finer octave has half the amplitude of the one before.
+std::vector<uint16_t> upsample(const std::vector<uint16_t>& heights, uint32_t sourceDim, uint32_t dim, float detail, uint32_t seed, ThreadPool& pool);
+
+// Split a square grid of `dim` x `dim` heights into a tile file, with `dim` = tileSize * 2^n + 1.  Each level
+// takes every other sample of the one below, and the error of a node is measured against all full resolution
+// samples it covers.  The file is written to a temporary name first and renamed, so a partly written file is
+// never picked up.  Returns false if it could not be written.
+bool buildTileFile(const std::string& filename, const std::vector<uint16_t>& heights, uint32_t dim, uint32_t tileSize, ThreadPool& pool);
+
+/**
+* @brief Read access to the header, the node table and the tiles of a tile file
+*
+* Tiles are read with their own file handle, so the streaming thread and the caller can read at the same time.
+*/
+class TileFile {
+public:
+    // Returns false if the file is missing or not a tile file of this version
+    bool open(const std::string& filename);
+
+    uint32_t tileSize() const { return header.tileSize; }
+    uint32_t levels() const { return header.levels; }
+    // Samples along the edge of a stored tile
+    uint32_t tileDim() const { return header.tileSize + 3; }
+    size_t tileBytes() const { return size_t(tileDim()) * tileDim() * sizeof(uint16_t); }
+    const std::vector<NodeInfo>& nodes() const { return nodeInfos; }
+
+    // Read the samples of `node` into `target`, which holds tileDim()^2 values
+    bool readTile(std::ifstream& stream, uint32_t node, uint16_t* target) const;
+    const std::string& path() const { return filename; }
+
+private:
+    std::string filename;
+    FileHeader header{};
+    std::vector<NodeInfo> nodeInfos;
+    size_t dataOffset{ 0 };
+};
+
+/**
+* @brief Keeps the most recently used tiles within a fixed number of slots and loads missing ones in the background
+*
+* The slots are the layers of the height texture array the tiles are drawn from, so the memory budget is the
+* slot count times TileFile::tileBytes().  request() queues nodes for the loading thread, collect() hands out the
+* loaded tiles together with the slot they were given.  Slots are reused least recently used first, but never
+* for a node used in the current frame, and the root is never evicted so there is always something to draw.
+*/
+class TileCache {
+public:
+    struct Upload {
+        uint32_t node;
+        uint32_t slot;
+        // Offset of the samples in the data returned by collect()
+        size_t offset;
+    };
+
+    struct Statistics {
+        uint32_t resident{ 0 };
+        uint32_t pending{ 0 };
+        uint32_t loaded{ 0 };
+        uint32_t evicted{ 0 };
+    };
+
+    ~TileCache();
+
+    void create(const TileFile& file, uint32_t slotCount);
+    void destroy();
+
+    uint32_t slotCount() const { return static_cast<uint32_t>(slotNodes.size()); }
+    bool resident(uint32_t node) const { return nodeSlots[node] != INVALID; }
+    uint32_t slot(uint32_t node) const { return nodeSlots[node]; }
+
+    // Start a frame, nodes marked used from now on keep their slots
+    void beginFrame() { ++frame; }
+    void markUsed(uint32_t node);
+    // Queue missing nodes for loading, coarser levels first.  Requests that are still waiting and were not
+    // repeated this frame are dropped, so the queue follows the camera.
+    void request(const std::vector<uint32_t>& nodes);
+
+    // Move up to `maxUploads` loaded tiles into slots.  `data` receives their samples, the uploads say where
+    // they go.  Loads that find no free slot wait for a later frame.
+    void collect(uint32_t maxUploads, std::vector<Upload>& uploads, std::vector<uint16_t>& data);
+
+    // Load nodes synchronously, to have the coarse levels ready before the first frame
+    void preload(const std::vector<uint32_t>& nodes);
+
+    Statistics statistics() const;
+
+private:
+    static const uint32_t INVALID = ~0u;
+
+    struct Loaded {
+        uint32_t node;
+        std::vector<uint16_t> samples;
+    };
+
+    uint32_t allocateSlot();
+    void loaderLoop();
+
+    const TileFile* file{ nullptr };
+    uint64_t frame{ 0 };
+    std::vector<uint32_t> nodeSlots;
+    std::vector<uint32_t> slotNodes;
+    std::vector<uint64_t> slotFrames;
+    std::ifstream stream;
+    uint32_t loadedCount{ 0 };
+    uint32_t evictedCount{ 0 };
+
+    // Shared with the loading thread
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<uint32_t> queue;
+    std::unordered_map<uint32_t, uint64_t> queued;
+    std::vector<Loaded> loaded;
+    uint32_t loading{ INVALID };
+    bool stopping{ false };
+    std::thread loader;
+};
+
+// What the LOD selection looks at.  A node is split while its error, projected at the distance of its bounds,
+// covers more than `maxPixelError` pixels.
+struct View {
+    vks::Frustum frustum;
+    glm::vec3 eye;
+    // Pixels one unit covers at unit distance, see projectionScale()
+    float projectionScale{ 1.0f };
+    float maxPixelError{ 2.0f };
+    // Share of a tile's parent split distance, ending at that distance, over which the tile morphs to the parent's grid
+    float morphRange{ 0.3f };
+};
+
+inline float projectionScale(float fovyRadians, float viewportHeight) {
+    return viewportHeight / (2.0f * tanf(fovyRadians * 0.5f));
+}
+
+// A selected node to draw, with the eye distances between which its vertices morph to the parent's grid
+struct Tile {
+    uint32_t node;
+    uint32_t level;
+    glm::vec2 offset;
+    float size;
+    float morphStart;
+    float morphEnd;
+};
+
+/**
+* @brief World space bounds of the tile file's nodes and the LOD selection over them
+*
+* The terrain covers the square from `origin` to `origin + size` in x and z.  Heights displace along -y, like
+* the terrain of terraintessellation, by up to `heightScale`.  select() walks the tree from the root, skips
+* nodes outside the frustum and stops at the nodes that are accurate enough.  Nodes whose children are not all
+* resident yet are drawn themselves and the children are reported as missing.
+*/
+class Quadtree {
+public:
+    void create(const TileFile& file, const glm::vec3& origin, float size, float heightScale);
+
+    uint32_t levels() const { return levelCount; }
+    uint32_t tileSize() const { return tileQuads; }
+    float size() const { return terrainSize; }
+    const glm::vec3& boundsMin(uint32_t node) const { return minBounds[node]; }
+    const glm::vec3& boundsMax(uint32_t node) const { return maxBounds[node]; }
+    // World space error of a node
+    float error(uint32_t node) const { return errors[node]; }
+    // Eye distance below which a node is split
+    float splitDistance(uint32_t node, const View& view) const { return errors[node] * view.projectionScale / view.maxPixelError; }
+    // Distance from `eye` to the bounds of `node`
+    float distance(uint32_t node, const glm::vec3& eye) const;
+
+    // Replace `tiles` by the nodes to draw.  Without a cache all nodes count as resident, otherwise the nodes
+    // used are marked in the cache and the ones missing are added to `missing`.
+    void select(const View& view, std::vector<Tile>& tiles, TileCache* cache = nullptr, std::vector<uint32_t>* missing = nullptr) const;
+
+private:
+    struct Context;
+
+    void selectNode(Context& context, uint32_t level, uint32_t x, uint32_t y, uint32_t planeMask, float parentSplit) const;
+    // Remaining planes of `planeMask` that `node` is not fully inside of, or ~0 if it is outside one of them
+    uint32_t cull(const vks::Frustum& frustum, uint32_t node, uint32_t planeMask) const;
+
+    uint32_t levelCount{ 0 };
+    uint32_t tileQuads{ 0 };
+    glm::vec3 origin;
+    float terrainSize{ 0.0f };
+    std::vector<glm::vec3> minBounds;
+    std::vector<glm::vec3> maxBounds;
+    std::vector<float> errors;
+};
+
+}}  // namespace vkx::terrain
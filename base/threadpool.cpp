@@ -0,0 +1,115 @@
+#include "threadpool.hpp"
+
+#include <algorithm>
+
+using namespace vkx;
+
+ThreadPool::ThreadPool(uint32_t threadCount) {
+    threadCount = std::max(1u, threadCount);
+    for (uint32_t i = 0; i < threadCount; ++i) {
+        queues.emplace_back(new Queue());
+    }
+    for (uint32_t i = 0; i + 1 < threadCount; ++i) {
+        workers.emplace_back([this, i] { workerLoop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+void ThreadPool::parallelFor(size_t count, size_t grain, const RangeFunction& function) {
+    if (count == 0) {
+        return;
+    }
+    grain = std::max<size_t>(1, grain);
+    if (workers.empty() || count <= grain) {
+        function(0, count);
+        return;
+    }
+
+    // Deal the chunks out round robin, so every queue starts with a similar share of the work
+    const size_t chunkCount = (count + grain - 1) / grain;
+    const uint32_t queueCount = size();
+    remaining = chunkCount;
+    // Counted before the chunks are visible, so taking a chunk never drops the count below zero
+    queued = chunkCount;
+    for (uint32_t q = 0; q < queueCount; ++q) {
+        std::lock_guard<std::mutex> lock(queues[q]->mutex);
+        for (size_t chunk = q; chunk < chunkCount; chunk += queueCount) {
+            const size_t begin = chunk * grain;
+            queues[q]->tasks.push_back({ &function, begin, std::min(count, begin + grain) });
+        }
+    }
+    {
+        // Taking the lock orders the wake up after any worker that is about to wait
+        std::lock_guard<std::mutex> lock(wakeMutex);
+    }
+    wake.notify_all();
+
+    // Help out until every chunk has finished, including the ones other threads are still running
+    const uint32_t callerQueue = queueCount - 1;
+    Task task;
+    while (remaining.load() != 0) {
+        if (pop(callerQueue, task) || steal(callerQueue, task)) {
+            execute(task);
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
+
+bool ThreadPool::pop(uint32_t queueIndex, Task& task) {
+    auto& queue = *queues[queueIndex];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.tasks.empty()) {
+        return false;
+    }
+    task = queue.tasks.back();
+    queue.tasks.pop_back();
+    --queued;
+    return true;
+}
+
+bool ThreadPool::steal(uint32_t thiefIndex, Task& task) {
+    const uint32_t queueCount = size();
+    for (uint32_t offset = 1; offset < queueCount; ++offset) {
+        auto& queue = *queues[(thiefIndex + offset) % queueCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = queue.tasks.front();
+            queue.tasks.pop_front();
+            --queued;
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::execute(const Task& task) {
+    (*task.function)(task.begin, task.end);
+    --remaining;
+}
+
+void ThreadPool::workerLoop(uint32_t queueIndex) {
+    Task task;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(wakeMutex);
+            wake.wait(lock, [this] { return stopping || queued.load() != 0; });
+            if (stopping) {
+                return;
+            }
+        }
+        while (pop(queueIndex, task) || steal(queueIndex, task)) {
+            execute(task);
+        }
+    }
+}
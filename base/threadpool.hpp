@@ -0,0 +1,76 @@
+/*
+* Work stealing thread pool for data parallel CPU work
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vkx {
+
+/**
+* @brief Fixed set of worker threads executing ranges of a parallel loop
+*
+* parallelFor() splits the index range into chunks and deals them out to one queue per worker.  Workers
+* take chunks from the back of their own queue and, once it runs dry, steal from the front of the
+* others, so uneven chunks (e.g. cloth rows with and without boundary handling) still balance out.  The
+* calling thread works on the loop as well until all chunks have completed.
+*
+* Only one thread may call parallelFor() at a time.
+*/
+class ThreadPool {
+public:
+    using RangeFunction = std::function<void(size_t begin, size_t end)>;
+
+    // `threadCount` includes the calling thread, so a pool of size 1 runs everything inline
+    explicit ThreadPool(uint32_t threadCount = std::max(1u, std::thread::hardware_concurrency()));
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    uint32_t size() const { return static_cast<uint32_t>(queues.size()); }
+
+    // Call `function` for consecutive ranges of at most `grain` indices covering [0, count) and wait for all of them
+    void parallelFor(size_t count, size_t grain, const RangeFunction& function);
+
+private:
+    struct Task {
+        const RangeFunction* function;
+        size_t begin;
+        size_t end;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    bool pop(uint32_t queueIndex, Task& task);
+    bool steal(uint32_t thiefIndex, Task& task);
+    void execute(const Task& task);
+    void workerLoop(uint32_t queueIndex);
+
+    // The last queue belongs to the thread calling parallelFor()
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::atomic<size_t> queued{ 0 };
+    std::atomic<size_t> remaining{ 0 };
+    bool stopping{ false };
+};
+
+}  // namespace vkx
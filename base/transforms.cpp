@@ -0,0 +1,137 @@
+#include "transforms.hpp"
+
+#include <algorithm>
+
+using namespace vkx;
+
+// Blocks per task of the thread pool
+static const size_t BLOCK_GRAIN = 8;
+
+void TransformSystem::resize(uint32_t count) {
+    for (auto* values : { &px, &py, &pz, &qx, &qy, &qz, &wx, &wy, &wz }) {
+        values->resize(count, 0.0f);
+    }
+    for (auto* values : { &qw, &sx, &sy, &sz }) {
+        values->resize(count, 1.0f);
+    }
+    const size_t blockCount = (count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    dirty.assign(blockCount, 1);
+    spinning.resize(blockCount);
+    spinningValid = false;
+}
+
+simd::TransformArrays TransformSystem::arrays() {
+    return {
+        px.data(), py.data(), pz.data(), qx.data(), qy.data(), qz.data(), qw.data(), sx.data(), sy.data(), sz.data(), wx.data(), wy.data(), wz.data(),
+    };
+}
+
+void TransformSystem::setPosition(uint32_t index, const glm::vec3& position) {
+    px[index] = position.x;
+    py[index] = position.y;
+    pz[index] = position.z;
+    markDirty(index);
+}
+
+void TransformSystem::setRotation(uint32_t index, const glm::quat& rotation) {
+    qx[index] = rotation.x;
+    qy[index] = rotation.y;
+    qz[index] = rotation.z;
+    qw[index] = rotation.w;
+    markDirty(index);
+}
+
+void TransformSystem::setScale(uint32_t index, const glm::vec3& scale) {
+    sx[index] = scale.x;
+    sy[index] = scale.y;
+    sz[index] = scale.z;
+    markDirty(index);
+}
+
+void TransformSystem::setAngularVelocity(uint32_t index, const glm::vec3& angularVelocity) {
+    wx[index] = angularVelocity.x;
+    wy[index] = angularVelocity.y;
+    wz[index] = angularVelocity.z;
+    spinningValid = false;
+}
+
+void TransformSystem::markAllDirty() {
+    std::fill(dirty.begin(), dirty.end(), 1);
+}
+
+void TransformSystem::findSpinningBlocks(ThreadPool& pool) {
+    pool.parallelFor(spinning.size(), BLOCK_GRAIN, [&](size_t blockBegin, size_t blockEnd) {
+        for (size_t block = blockBegin; block < blockEnd; ++block) {
+            const size_t end = std::min(px.size(), (block + 1) * BLOCK_SIZE);
+            uint8_t rotating = 0;
+            for (size_t i = block * BLOCK_SIZE; i < end; ++i) {
+                rotating |= (wx[i] != 0.0f) | (wy[i] != 0.0f) | (wz[i] != 0.0f);
+            }
+            spinning[block] = rotating;
+        }
+    });
+    spinningValid = true;
+}
+
+void TransformSystem::spin(float deltaT, ThreadPool& pool, simd::Backend backend) {
+    if (!spinningValid) {
+        findSpinningBlocks(pool);
+    }
+    blocks.clear();
+    for (uint32_t block = 0; block < spinning.size(); ++block) {
+        if (spinning[block]) {
+            blocks.push_back(block);
+        }
+    }
+
+    const simd::TransformArrays transforms = arrays();
+    const simd::TransformConstants constants{ deltaT };
+    pool.parallelFor(blocks.size(), BLOCK_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const uint32_t block = blocks[i];
+            const uint32_t first = block * BLOCK_SIZE;
+            simd::transformSpin(backend, transforms, constants, first, std::min(size(), first + BLOCK_SIZE));
+            dirty[block] = 1;
+        }
+    });
+}
+
+const std::vector<TransformSystem::Range>& TransformSystem::update(ThreadPool& pool, simd::Backend backend, void* matrices, size_t stride) {
+    blocks.clear();
+    ranges.clear();
+    updated = 0;
+    for (uint32_t block = 0; block < dirty.size(); ++block) {
+        if (!dirty[block]) {
+            continue;
+        }
+        dirty[block] = 0;
+        blocks.push_back(block);
+
+        const uint32_t first = block * BLOCK_SIZE;
+        const uint32_t count = std::min(size(), first + BLOCK_SIZE) - first;
+        if (!ranges.empty() && ranges.back().first + ranges.back().count == first) {
+            ranges.back().count += count;
+        } else {
+            ranges.push_back({ first, count });
+        }
+        updated += count;
+    }
+
+    const simd::TransformArrays transforms = arrays();
+    const simd::MatrixTarget target{ matrices, stride };
+    pool.parallelFor(blocks.size(), BLOCK_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const uint32_t first = blocks[i] * BLOCK_SIZE;
+            simd::transformMatrices(backend, transforms, target, first, std::min(size(), first + BLOCK_SIZE));
+        }
+    });
+    return ranges;
+}
+
+void vkx::simd::transformSpin(Backend backend, const TransformArrays& transforms, const TransformConstants& constants, uint32_t begin, uint32_t end) {
+    VKX_SIMD_DISPATCH(transformSpin(transforms, constants, begin, end))
+}
+
+void vkx::simd::transformMatrices(Backend backend, const TransformArrays& transforms, const MatrixTarget& target, uint32_t begin, uint32_t end) {
+    VKX_SIMD_DISPATCH(transformMatrices(transforms, target, begin, end))
+}
@@ -0,0 +1,86 @@
+/*
+* Structure of arrays storage for the transforms of many objects, turned into model matrices on the CPU
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include "transforms_kernels.hpp"
+#include "threadpool.hpp"
+
+namespace vkx {
+
+/**
+* @brief Positions, rotations and scales of objects, written out as model matrices
+*
+* The components live in one array each, so the SIMD kernels convert 8 (AVX2) or 4 (NEON) quaternions to
+* matrices at a time.  Objects are grouped into blocks of BLOCK_SIZE, and every change marks its block as
+* dirty.  update() only rewrites the matrices of dirty blocks, spread over the thread pool, and reports
+* them as ranges of consecutive objects, so the caller can flush just those parts of a mapped buffer.
+*
+* Objects may also be given an angular velocity, which spin() integrates for all blocks that contain a
+* rotating object.
+*/
+class TransformSystem {
+public:
+    // Objects per dirty flag
+    static const uint32_t BLOCK_SIZE = 256;
+
+    // Consecutive objects whose matrices were rewritten
+    struct Range {
+        uint32_t first;
+        uint32_t count;
+    };
+
+    // Resize to `count` objects.  New objects are at the origin, unrotated, unscaled and at rest.
+    void resize(uint32_t count);
+    uint32_t size() const { return static_cast<uint32_t>(px.size()); }
+
+    void setPosition(uint32_t index, const glm::vec3& position);
+    void setRotation(uint32_t index, const glm::quat& rotation);
+    void setScale(uint32_t index, const glm::vec3& scale);
+    // Radians per second around a world space axis
+    void setAngularVelocity(uint32_t index, const glm::vec3& angularVelocity);
+
+    glm::vec3 position(uint32_t index) const { return { px[index], py[index], pz[index] }; }
+    glm::quat rotation(uint32_t index) const { return { qw[index], qx[index], qy[index], qz[index] }; }
+    glm::vec3 scale(uint32_t index) const { return { sx[index], sy[index], sz[index] }; }
+
+    // Force the matrices of all objects to be written by the next update(), e.g. into a new buffer
+    void markAllDirty();
+
+    // Advance the rotations of all objects with an angular velocity by `deltaT` seconds
+    void spin(float deltaT, ThreadPool& pool, simd::Backend backend);
+
+    // Write the model matrices of all changed objects, the one of object i to `matrices` + i * `stride`.
+    // Returns the rewritten objects in ascending order, with adjacent blocks merged.
+    const std::vector<Range>& update(ThreadPool& pool, simd::Backend backend, void* matrices, size_t stride);
+
+    // Objects written by the last update()
+    uint32_t updatedCount() const { return updated; }
+
+private:
+    simd::TransformArrays arrays();
+    void markDirty(uint32_t index) { dirty[index / BLOCK_SIZE] = 1; }
+    // Recompute which blocks contain rotating objects after angular velocities changed
+    void findSpinningBlocks(ThreadPool& pool);
+
+    std::vector<float> px, py, pz, qx, qy, qz, qw, sx, sy, sz, wx, wy, wz;
+    // One flag per block.  uint8_t instead of bool, so threads can write neighbouring flags.
+    std::vector<uint8_t> dirty;
+    std::vector<uint8_t> spinning;
+    bool spinningValid{ true };
+    // Scratch lists reused from frame to frame
+    std::vector<uint32_t> blocks;
+    std::vector<Range> ranges;
+    uint32_t updated{ 0 };
+};
+
+}  // namespace vkx
@@ -0,0 +1,50 @@
+/*
+* Spin and matrix kernels of vkx::TransformSystem, see simd.hpp for the backends
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include "simd.hpp"
+
+namespace vkx { namespace simd {
+
+// Object transforms, see base/transforms.hpp.  Rotations are unit quaternions, angular velocities are
+// in radians per second around world space axes.
+struct TransformArrays {
+    float* px;
+    float* py;
+    float* pz;
+    float* qx;
+    float* qy;
+    float* qz;
+    float* qw;
+    float* sx;
+    float* sy;
+    float* sz;
+    float* wx;
+    float* wy;
+    float* wz;
+};
+
+struct TransformConstants {
+    float deltaT;
+};
+
+// Column major 4x4 matrices, the one of object i starting `stride` * i bytes after `matrices`
+struct MatrixTarget {
+    void* matrices;
+    size_t stride;
+};
+
+// Rotate the objects in [begin, end) by their angular velocity and renormalize the quaternions
+void transformSpin(Backend backend, const TransformArrays& transforms, const TransformConstants& constants, uint32_t begin, uint32_t end);
+// Write translation * rotation * scale of the objects in [begin, end) to `target`
+void transformMatrices(Backend backend, const TransformArrays& transforms, const MatrixTarget& target, uint32_t begin, uint32_t end);
+
+// Backend implementations, see transforms_kernels.inl
+VKX_SIMD_DECLARE_KERNEL(void transformSpin(const TransformArrays& transforms, const TransformConstants& constants, uint32_t begin, uint32_t end))
+VKX_SIMD_DECLARE_KERNEL(void transformMatrices(const TransformArrays& transforms, const MatrixTarget& target, uint32_t begin, uint32_t end))
+
+}}  // namespace vkx::simd
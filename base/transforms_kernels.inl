@@ -0,0 +1,73 @@
+/*
+* Quaternion spin and TRS matrix kernels
+*
+* Included into the namespace of every backend after simd_kernels.inl
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+namespace kernels {
+
+// First order integration of dq/dt = 0.5 * (w, 0) * q, followed by renormalization
+template <typename P>
+inline void transformSpin(const TransformArrays& t, const TransformConstants& constants, uint32_t i) {
+    const P qx = P::load(t.qx + i), qy = P::load(t.qy + i), qz = P::load(t.qz + i), qw = P::load(t.qw + i);
+    const P wx = P::load(t.wx + i), wy = P::load(t.wy + i), wz = P::load(t.wz + i);
+    const P halfT = P::set(0.5f * constants.deltaT);
+
+    const P x = qx + (wx * qw + wy * qz - wz * qy) * halfT;
+    const P y = qy + (wy * qw + wz * qx - wx * qz) * halfT;
+    const P z = qz + (wz * qw + wx * qy - wy * qx) * halfT;
+    const P w = qw - (wx * qx + wy * qy + wz * qz) * halfT;
+    const P scale = P::set(1.0f) / P::sqrt(x * x + y * y + z * z + w * w);
+
+    (x * scale).store(t.qx + i);
+    (y * scale).store(t.qy + i);
+    (z * scale).store(t.qz + i);
+    (w * scale).store(t.qw + i);
+}
+
+// Same elements as glm::translate(position) * glm::mat4_cast(rotation) * glm::scale(scale)
+template <typename P>
+inline void transformMatrices(const TransformArrays& t, const MatrixTarget& target, uint32_t i) {
+    const P qx = P::load(t.qx + i), qy = P::load(t.qy + i), qz = P::load(t.qz + i), qw = P::load(t.qw + i);
+    const P sx = P::load(t.sx + i), sy = P::load(t.sy + i), sz = P::load(t.sz + i);
+    const P one = P::set(1.0f), two = P::set(2.0f);
+
+    const P xx = qx * qx, yy = qy * qy, zz = qz * qz;
+    const P xy = qx * qy, xz = qx * qz, yz = qy * qz;
+    const P wx = qw * qx, wy = qw * qy, wz = qw * qz;
+
+    // The matrix is computed column by column for all lanes, then written out object by object
+    float columns[16][P::width];
+    (sx * (one - two * (yy + zz))).store(columns[0]);
+    (sx * (two * (xy + wz))).store(columns[1]);
+    (sx * (two * (xz - wy))).store(columns[2]);
+    (sy * (two * (xy - wz))).store(columns[4]);
+    (sy * (one - two * (xx + zz))).store(columns[5]);
+    (sy * (two * (yz + wx))).store(columns[6]);
+    (sz * (two * (xz + wy))).store(columns[8]);
+    (sz * (two * (yz - wx))).store(columns[9]);
+    (sz * (one - two * (xx + yy))).store(columns[10]);
+    P::load(t.px + i).store(columns[12]);
+    P::load(t.py + i).store(columns[13]);
+    P::load(t.pz + i).store(columns[14]);
+
+    for (uint32_t lane = 0; lane < P::width; ++lane) {
+        float* matrix = reinterpret_cast<float*>(static_cast<uint8_t*>(target.matrices) + (i + lane) * target.stride);
+        for (uint32_t element = 0; element < 15; ++element) {
+            matrix[element] = (element & 3) == 3 ? 0.0f : columns[element][lane];
+        }
+        matrix[15] = 1.0f;
+    }
+}
+
+}  // namespace kernels
+
+void transformSpin(const TransformArrays& transforms, const TransformConstants& constants, uint32_t begin, uint32_t end) {
+    kernels::forRange(begin, end, [&](auto p, uint32_t i) { kernels::transformSpin<decltype(p)>(transforms, constants, i); });
+}
+
+void transformMatrices(const TransformArrays& transforms, const MatrixTarget& target, uint32_t begin, uint32_t end) {
+    kernels::forRange(begin, end, [&](auto p, uint32_t i) { kernels::transformMatrices<decltype(p)>(transforms, target, i); });
+}
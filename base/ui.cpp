@@ -70,7 +70,6 @@ void UIOverlay::destroy() {
         indexBuffer.destroy();
         font.destroy();
         context.device.destroyDescriptorSetLayout(descriptorSetLayout);
-        context.device.destroyDescriptorPool(descriptorPool);
         context.device.destroyPipelineLayout(pipelineLayout);
         context.device.destroyPipeline(pipeline);
         if (!createInfo.renderPass) {
@@ -138,35 +137,11 @@ void UIOverlay::prepareResources() {
     cmdPoolInfo.flags = vk::CommandPoolCreateFlagBits::eResetCommandBuffer;
     commandPool = context.device.createCommandPool(cmdPoolInfo);
 
-    // Descriptor pool
-    vk::DescriptorPoolSize poolSize;
-    poolSize.type = vk::DescriptorType::eCombinedImageSampler;
-    poolSize.descriptorCount = 1;
-    descriptorPool = context.device.createDescriptorPool({ {}, 2, 1, &poolSize });
-
-    // Descriptor set layout
+    // Descriptor set layout, the set itself comes from the descriptor allocator
     vk::DescriptorSetLayoutBinding setLayoutBinding{ 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment };
 
     descriptorSetLayout = context.device.createDescriptorSetLayout({ {}, 1, &setLayoutBinding });
 
-    // Descriptor set
-    vk::DescriptorSetAllocateInfo allocInfo;
-    allocInfo.descriptorPool = descriptorPool;
-    allocInfo.pSetLayouts = &descriptorSetLayout;
-    allocInfo.descriptorSetCount = 1;
-    descriptorSet = context.device.allocateDescriptorSets(allocInfo)[0];
-
-    vk::DescriptorImageInfo fontDescriptor;
-    fontDescriptor.imageView = font.view;
-    fontDescriptor.sampler = font.sampler;
-    fontDescriptor.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
-    vk::WriteDescriptorSet writeDescriptorSet;
-    writeDescriptorSet.descriptorType = vk::DescriptorType::eCombinedImageSampler;
-    writeDescriptorSet.pImageInfo = &fontDescriptor;
-    writeDescriptorSet.descriptorCount = 1;
-    writeDescriptorSet.dstSet = descriptorSet;
-    context.device.updateDescriptorSets(writeDescriptorSet, {});
-
     // Pipeline layout
     // Push constants for UI rendering parameters
     vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex, 0, sizeof(PushConstBlock) };
@@ -298,6 +273,12 @@ void UIOverlay::updateCommandBuffers() {
 
     cmdBuffers = context.device.allocateCommandBuffers({ commandPool, vk::CommandBufferLevel::ePrimary, (uint32_t)createInfo.framebuffers.size() });
 
+    // Allocated again if the cache was cleared since the last recording
+    const vk::DescriptorSet descriptorSet = descriptorAllocator.get(
+        descriptorSetLayout,
+        vks::DescriptorBindings{}.image(0, vk::DescriptorType::eCombinedImageSampler, { font.sampler, font.view, vk::ImageLayout::eShaderReadOnlyOptimal }));
+    descriptorAllocator.flush();
+
     for (size_t i = 0; i < cmdBuffers.size(); ++i) {
         renderPassBeginInfo.framebuffer = createInfo.framebuffers[i];
 
@@ -9,6 +9,7 @@
 #pragma once
 
 #include "vks/context.hpp"
+#include "vks/descriptors.hpp"
 #ifdef __ANDROID__
 #include <android/native_activity.h>
 #endif
@@ -38,9 +39,9 @@ private:
     int32_t vertexCount = 0;
     int32_t indexCount = 0;
 
-    vk::DescriptorPool descriptorPool;
+    // The font set is a cached set of the allocator, fetched again whenever the command buffers are recorded
+    vks::DescriptorAllocator& descriptorAllocator;
     vk::DescriptorSetLayout descriptorSetLayout;
-    vk::DescriptorSet descriptorSet;
     vk::PipelineLayout pipelineLayout;
     const vk::PipelineCache& pipelineCache{ context.pipelineCache };
     vk::Pipeline pipeline;
@@ -66,8 +67,9 @@ public:
 
     std::vector<vk::CommandBuffer> cmdBuffers;
 
-    UIOverlay(const vks::Context& context)
-        : context(context) {}
+    UIOverlay(const vks::Context& context, vks::DescriptorAllocator& descriptorAllocator)
+        : context(context)
+        , descriptorAllocator(descriptorAllocator) {}
     ~UIOverlay();
 
     void create(const UIOverlayCreateInfo& createInfo);
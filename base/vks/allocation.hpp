@@ -55,6 +55,33 @@ struct Allocation {
         return device.flushMappedMemoryRanges(vk::MappedMemoryRange{ memory, offset, size });
     }
 
+    struct Range {
+        vk::DeviceSize offset;
+        vk::DeviceSize size;
+    };
+
+    /**
+        * Flush several memory ranges of the buffer with a single call, e.g. the parts of a large buffer changed in a frame
+        *
+        * @note Only required for non-coherent memory
+        *
+        * @param ranges Byte ranges from the beginning of the allocation
+        * @param atomSize The nonCoherentAtomSize limit of the device, the ranges are widened to multiples of it
+        */
+    void flush(const std::vector<Range>& ranges, vk::DeviceSize atomSize) {
+        std::vector<vk::MappedMemoryRange> memoryRanges;
+        memoryRanges.reserve(ranges.size());
+        for (const auto& range : ranges) {
+            const vk::DeviceSize begin = range.offset / atomSize * atomSize;
+            const vk::DeviceSize end = (range.offset + range.size + atomSize - 1) / atomSize * atomSize;
+            // A range reaching the end of the allocation does not need to be a multiple of the atom size
+            memoryRanges.push_back({ memory, begin, end < allocSize ? end - begin : VK_WHOLE_SIZE });
+        }
+        if (!memoryRanges.empty()) {
+            device.flushMappedMemoryRanges(memoryRanges);
+        }
+    }
+
     /**
         * Invalidate a memory range of the buffer to make it visible to the host
         *
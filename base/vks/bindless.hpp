@@ -0,0 +1,311 @@
+/*
+* Global bindless resource table built on VK_EXT_descriptor_indexing
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "context.hpp"
+#include "vku.hpp"
+
+namespace vks {
+
+/**
+* @brief Hands out stable indices in [0, capacity) and takes them back for reuse
+*
+* Released slots are reused most recently released first.  There is no GPU state involved,
+* deferring reuse until the GPU is done with a slot is the caller's responsibility.
+*/
+class SlotAllocator {
+public:
+    SlotAllocator(uint32_t capacity = 0)
+        : slotCapacity(capacity) {}
+
+    // @throws std::runtime_error if every slot is in use
+    uint32_t allocate() {
+        if (!freeSlots.empty()) {
+            auto slot = freeSlots.back();
+            freeSlots.pop_back();
+            return slot;
+        }
+        if (next == slotCapacity) {
+            throw std::runtime_error("Slot allocator exhausted");
+        }
+        return next++;
+    }
+
+    void release(uint32_t slot) {
+        assert(slot < next);
+        assert(std::find(freeSlots.begin(), freeSlots.end(), slot) == freeSlots.end());
+        freeSlots.push_back(slot);
+    }
+
+    uint32_t capacity() const { return slotCapacity; }
+
+    // Number of slots currently handed out
+    uint32_t size() const { return next - static_cast<uint32_t>(freeSlots.size()); }
+
+private:
+    uint32_t slotCapacity;
+    uint32_t next{ 0 };
+    std::vector<uint32_t> freeSlots;
+};
+
+/**
+* @brief One descriptor set holding every texture and storage buffer of a scene
+*
+* Binding 0 is an array of combined image samplers and binding 1 an array of storage buffers.  Both are
+* partially bound and update-after-bind, so resources can be added while command buffers that use the
+* set are still pending.  Shaders address resources by the slot index returned when they were added:
+*
+*   #extension GL_EXT_nonuniform_qualifier : require
+*   layout (set = 1, binding = 0) uniform sampler2D textures[];
+*   layout (set = 1, binding = 1) readonly buffer Materials { Material materials[]; } buffers[];
+*   ...
+*   texture(textures[nonuniformEXT(index)], uv)
+*   buffers[pushConsts.materialBuffer].materials[i]
+*
+* Storage buffers may be indexed with dynamically uniform values, such as push constants, and textures with
+* non-uniform ones.
+*
+* Released slots are only handed out again once every frame submitted before the release has retired,
+* so a slot is never rewritten while the GPU may still be reading it.
+*
+* Usage: return getDeviceExtensions() from the context's device extensions picker, call enableFeatures()
+* from ExampleBase::getEnabledFeatures(), then create() once the device exists.
+*/
+class BindlessTable {
+public:
+    static const uint32_t TEXTURE_BINDING = 0;
+    static const uint32_t BUFFER_BINDING = 1;
+
+    BindlessTable(const vks::Context& context)
+        : context(context)
+        , state(std::make_shared<State>()) {}
+
+    BindlessTable(const BindlessTable&) = delete;
+    BindlessTable& operator=(const BindlessTable&) = delete;
+
+    // The device extensions needed by the table, or an empty set if the device does not offer them
+    static std::set<std::string> getDeviceExtensions(const vk::PhysicalDevice& physicalDevice) {
+        std::set<std::string> result;
+        if (vks::Context::isDeviceExtensionPresent(physicalDevice, VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) &&
+            vks::Context::isDeviceExtensionPresent(physicalDevice, VK_KHR_MAINTENANCE3_EXTENSION_NAME)) {
+            result.insert(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+            result.insert(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+        }
+        return result;
+    }
+
+    // Chain the descriptor indexing features the table relies on into the device creation, and enable dynamic
+    // indexing of the storage buffer array.  Returns false, leaving the context untouched, if the device does not
+    // support them.  `deviceContext` is the (mutable) context the table was constructed with.
+    bool enableFeatures(vks::Context& deviceContext) {
+        assert(&deviceContext == &context);
+        if (getDeviceExtensions(context.physicalDevice).empty() || !context.deviceFeatures.shaderStorageBufferArrayDynamicIndexing) {
+            return false;
+        }
+        const auto supported = context.physicalDevice
+                                   .getFeatures2<vk::PhysicalDeviceFeatures2, vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>(context.dynamicDispatch)
+                                   .get<vk::PhysicalDeviceDescriptorIndexingFeaturesEXT>();
+        if (!supported.runtimeDescriptorArray || !supported.descriptorBindingPartiallyBound ||
+            !supported.shaderSampledImageArrayNonUniformIndexing || !supported.descriptorBindingSampledImageUpdateAfterBind ||
+            !supported.descriptorBindingStorageBufferUpdateAfterBind) {
+            return false;
+        }
+        // Without robustBufferAccessUpdateAfterBind, update-after-bind storage buffers and robust buffer access
+        // cannot both be enabled
+        const auto properties = context.physicalDevice
+                                    .getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>(context.dynamicDispatch)
+                                    .get<vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+        if (deviceContext.enabledFeatures.robustBufferAccess && !properties.robustBufferAccessUpdateAfterBind) {
+            return false;
+        }
+
+        deviceContext.enabledFeatures.shaderStorageBufferArrayDynamicIndexing = VK_TRUE;
+        features = vk::PhysicalDeviceDescriptorIndexingFeaturesEXT{};
+        features.runtimeDescriptorArray = VK_TRUE;
+        features.descriptorBindingPartiallyBound = VK_TRUE;
+        features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+        features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+        features.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+        features.shaderStorageBufferArrayNonUniformIndexing = supported.shaderStorageBufferArrayNonUniformIndexing;
+        features.pNext = deviceContext.enabledFeatures2.pNext;
+        deviceContext.enabledFeatures2.pNext = &features;
+        return true;
+    }
+
+    // Create the layout, pool and set.  The requested capacities are clamped to the update-after-bind limits of the
+    // device, since the whole array is declared in the layout however few slots are ever written.
+    void create(uint32_t maxTextures = 4096, uint32_t maxBuffers = 1024) {
+        const auto properties = context.physicalDevice
+                                    .getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>(context.dynamicDispatch)
+                                    .get<vk::PhysicalDeviceDescriptorIndexingPropertiesEXT>();
+        // Combined image samplers count against both the sampled image and the sampler limits
+        maxTextures = std::min({ maxTextures, properties.maxDescriptorSetUpdateAfterBindSampledImages,
+                                 properties.maxPerStageDescriptorUpdateAfterBindSampledImages, properties.maxDescriptorSetUpdateAfterBindSamplers,
+                                 properties.maxPerStageDescriptorUpdateAfterBindSamplers });
+        maxBuffers = std::min({ maxBuffers, properties.maxDescriptorSetUpdateAfterBindStorageBuffers,
+                                properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers });
+        // Both arrays are visible to every stage, so together they must fit the resources of a single stage.  The
+        // textures give way first, keeping at least a quarter of the budget for the buffers.
+        const uint32_t maxResources = properties.maxPerStageUpdateAfterBindResources;
+        maxBuffers = std::min(maxBuffers, std::max(maxResources / 4, maxResources - std::min(maxResources, maxTextures)));
+        maxTextures = std::min(maxTextures, maxResources - maxBuffers);
+        if (maxTextures == 0 || maxBuffers == 0) {
+            throw std::runtime_error("Bindless table does not fit the update-after-bind limits of the device");
+        }
+        textureSlots = SlotAllocator{ maxTextures };
+        bufferSlots = SlotAllocator{ maxBuffers };
+
+        const vk::ShaderStageFlags stages = vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eCompute;
+        std::array<vk::DescriptorSetLayoutBinding, 2> bindings{ {
+            { TEXTURE_BINDING, vk::DescriptorType::eCombinedImageSampler, maxTextures, stages },
+            { BUFFER_BINDING, vk::DescriptorType::eStorageBuffer, maxBuffers, stages },
+        } };
+        const vk::DescriptorBindingFlagsEXT bindingFlag = vk::DescriptorBindingFlagBitsEXT::ePartiallyBound | vk::DescriptorBindingFlagBitsEXT::eUpdateAfterBind;
+        std::array<vk::DescriptorBindingFlagsEXT, 2> bindingFlags{ { bindingFlag, bindingFlag } };
+        vk::DescriptorSetLayoutBindingFlagsCreateInfoEXT bindingFlagsInfo{ static_cast<uint32_t>(bindingFlags.size()), bindingFlags.data() };
+        vk::DescriptorSetLayoutCreateInfo layoutInfo{ vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPoolEXT,
+                                                      static_cast<uint32_t>(bindings.size()), bindings.data() };
+        layoutInfo.pNext = &bindingFlagsInfo;
+        layout = context.device.createDescriptorSetLayout(layoutInfo);
+
+        std::array<vk::DescriptorPoolSize, 2> poolSizes{ {
+            { vk::DescriptorType::eCombinedImageSampler, maxTextures },
+            { vk::DescriptorType::eStorageBuffer, maxBuffers },
+        } };
+        pool = context.device.createDescriptorPool(
+            { vk::DescriptorPoolCreateFlagBits::eUpdateAfterBindEXT, 1, static_cast<uint32_t>(poolSizes.size()), poolSizes.data() });
+        descriptorSet = context.device.allocateDescriptorSets({ pool, 1, &layout })[0];
+    }
+
+    // Register a texture, returning the index shaders use to sample it
+    uint32_t addTexture(const vk::DescriptorImageInfo& imageInfo) {
+        reclaim();
+        auto slot = textureSlots.allocate();
+        updateTexture(slot, imageInfo);
+        return slot;
+    }
+
+    // Register a storage buffer, returning the index shaders use to access it
+    uint32_t addBuffer(const vk::DescriptorBufferInfo& bufferInfo) {
+        reclaim();
+        auto slot = bufferSlots.allocate();
+        updateBuffer(slot, bufferInfo);
+        return slot;
+    }
+
+    // Point an existing slot at a different resource
+    void updateTexture(uint32_t slot, const vk::DescriptorImageInfo& imageInfo) { pendingWrites.push_back({ TEXTURE_BINDING, slot, {}, imageInfo }); }
+    void updateBuffer(uint32_t slot, const vk::DescriptorBufferInfo& bufferInfo) { pendingWrites.push_back({ BUFFER_BINDING, slot, bufferInfo, {} }); }
+
+    // Give a slot back once the frames currently being recorded or in flight have retired
+    void releaseTexture(uint32_t slot) { deferRelease(&State::textureSlots, slot); }
+    void releaseBuffer(uint32_t slot) { deferRelease(&State::bufferSlots, slot); }
+
+    // Apply all pending slot writes in a single vkUpdateDescriptorSets call.  Must be called before the
+    // submission of any command buffer that reads the new slots.
+    void flush() {
+        reclaim();
+        if (pendingWrites.empty()) {
+            return;
+        }
+        const auto bufferCount = std::count_if(pendingWrites.begin(), pendingWrites.end(), [](const Write& write) { return write.binding == BUFFER_BINDING; });
+        vku::DescriptorSetUpdater updater{ static_cast<int>(bufferCount), static_cast<int>(pendingWrites.size() - bufferCount) };
+        updater.beginDescriptorSet(descriptorSet);
+        for (const auto& write : pendingWrites) {
+            if (write.binding == TEXTURE_BINDING) {
+                updater.beginImages(TEXTURE_BINDING, write.slot, vk::DescriptorType::eCombinedImageSampler);
+                updater.image(write.imageInfo.sampler, write.imageInfo.imageView, write.imageInfo.imageLayout);
+            } else {
+                updater.beginBuffers(BUFFER_BINDING, write.slot, vk::DescriptorType::eStorageBuffer);
+                updater.buffer(write.bufferInfo.buffer, write.bufferInfo.offset, write.bufferInfo.range);
+            }
+        }
+        assert(updater.ok());
+        updater.update(context.device);
+        pendingWrites.clear();
+    }
+
+    void bind(const vk::CommandBuffer& commandBuffer, vk::PipelineBindPoint bindPoint, vk::PipelineLayout pipelineLayout, uint32_t setIndex) const {
+        commandBuffer.bindDescriptorSets(bindPoint, pipelineLayout, setIndex, descriptorSet, nullptr);
+    }
+
+    uint32_t textureCount() const { return textureSlots.size(); }
+    uint32_t bufferCount() const { return bufferSlots.size(); }
+
+    void destroy() {
+        pendingWrites.clear();
+        if (pool) {
+            context.device.destroyDescriptorPool(pool);
+            pool = nullptr;
+            descriptorSet = nullptr;
+        }
+        if (layout) {
+            context.device.destroyDescriptorSetLayout(layout);
+            layout = nullptr;
+        }
+        // Releases still waiting in the dumpster must not touch the allocators of a later create()
+        state = std::make_shared<State>();
+    }
+
+    vk::DescriptorSetLayout layout;
+    vk::DescriptorSet descriptorSet;
+
+private:
+    struct Write {
+        uint32_t binding;
+        uint32_t slot;
+        vk::DescriptorBufferInfo bufferInfo;
+        vk::DescriptorImageInfo imageInfo;
+    };
+
+    // Slots whose frames have retired, waiting to be returned to the allocators
+    struct State {
+        std::vector<uint32_t> textureSlots;
+        std::vector<uint32_t> bufferSlots;
+    };
+
+    void deferRelease(std::vector<uint32_t> State::*retired, uint32_t slot) {
+        std::weak_ptr<State> weakState = state;
+        context.dumpster.push_back([weakState, retired, slot] {
+            if (auto state = weakState.lock()) {
+                ((*state).*retired).push_back(slot);
+            }
+        });
+    }
+
+    void reclaim() {
+        for (const auto& slot : state->textureSlots) {
+            textureSlots.release(slot);
+        }
+        for (const auto& slot : state->bufferSlots) {
+            bufferSlots.release(slot);
+        }
+        state->textureSlots.clear();
+        state->bufferSlots.clear();
+    }
+
+    const vks::Context& context;
+    vk::PhysicalDeviceDescriptorIndexingFeaturesEXT features;
+    vk::DescriptorPool pool;
+    SlotAllocator textureSlots;
+    SlotAllocator bufferSlots;
+    std::shared_ptr<State> state;
+    std::vector<Write> pendingWrites;
+};
+
+}  // namespace vks
@@ -0,0 +1,303 @@
+/*
+* Descriptor set allocation with per-frame pool recycling and content-keyed set caching
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+#include "context.hpp"
+#include "vku.hpp"
+
+namespace vks {
+
+namespace util {
+// Reinterpret a (non-dispatchable) Vulkan handle as an integer for hashing
+template <typename HandleType>
+inline uint64_t handleBits(const HandleType& handle) {
+    uint64_t result = 0;
+    auto raw = static_cast<typename HandleType::CType>(handle);
+    memcpy(&result, &raw, sizeof(raw));
+    return result;
+}
+}  // namespace util
+
+/**
+* @brief The resources to write into a descriptor set, one entry per binding
+*
+* Also serves as the key for cached sets, so two sets with identical layouts and resources share one
+* vk::DescriptorSet.
+*/
+struct DescriptorBindings {
+    struct Entry {
+        uint32_t binding;
+        vk::DescriptorType type;
+        vk::DescriptorBufferInfo bufferInfo;
+        vk::DescriptorImageInfo imageInfo;
+        bool isImage;
+    };
+    std::vector<Entry> entries;
+
+    DescriptorBindings& buffer(uint32_t binding, vk::DescriptorType type, const vk::DescriptorBufferInfo& bufferInfo) {
+        entries.push_back({ binding, type, bufferInfo, {}, false });
+        return *this;
+    }
+
+    DescriptorBindings& image(uint32_t binding, vk::DescriptorType type, const vk::DescriptorImageInfo& imageInfo) {
+        entries.push_back({ binding, type, {}, imageInfo, true });
+        return *this;
+    }
+
+    size_t bufferCount() const {
+        return std::count_if(entries.begin(), entries.end(), [](const Entry& entry) { return !entry.isImage; });
+    }
+
+    size_t imageCount() const { return entries.size() - bufferCount(); }
+
+    std::vector<uint64_t> key(vk::DescriptorSetLayout layout) const {
+        std::vector<uint64_t> result;
+        result.reserve(1 + entries.size() * 5);
+        result.push_back(util::handleBits(layout));
+        for (const auto& entry : entries) {
+            result.push_back((uint64_t(entry.binding) << 32) | static_cast<uint32_t>(entry.type));
+            if (entry.isImage) {
+                result.push_back(util::handleBits(entry.imageInfo.sampler));
+                result.push_back(util::handleBits(entry.imageInfo.imageView));
+                result.push_back(static_cast<uint64_t>(entry.imageInfo.imageLayout));
+            } else {
+                result.push_back(util::handleBits(entry.bufferInfo.buffer));
+                result.push_back(entry.bufferInfo.offset);
+                result.push_back(entry.bufferInfo.range);
+            }
+        }
+        return result;
+    }
+
+    // Queue the writes for this set on an updater, one write per entry
+    void write(vku::DescriptorSetUpdater& updater, vk::DescriptorSet descriptorSet) const {
+        updater.beginDescriptorSet(descriptorSet);
+        for (const auto& entry : entries) {
+            if (entry.isImage) {
+                updater.beginImages(entry.binding, 0, entry.type);
+                updater.image(entry.imageInfo.sampler, entry.imageInfo.imageView, entry.imageInfo.imageLayout);
+            } else {
+                updater.beginBuffers(entry.binding, 0, entry.type);
+                updater.buffer(entry.bufferInfo.buffer, entry.bufferInfo.offset, entry.bufferInfo.range);
+            }
+        }
+    }
+};
+
+/**
+* @brief Allocates descriptor sets from growable chains of pools
+*
+* Two kinds of sets are handed out:
+*
+* - Transient sets, from allocate().  These live for a single frame.  endFrame() hands every pool used
+*   since the previous call to the context dumpster, so the whole chain is reset with one
+*   vkResetDescriptorPool per pool once the fence of the submitting frame signals, and is then reused.
+*   No individual set is ever freed, so the cost per frame does not depend on how many sets were allocated.
+*   Transient sets may only be bound in command buffers that are recorded again every frame: a command
+*   buffer recorded once and submitted repeatedly would bind a set whose pool has since been reset.
+*
+* - Cached sets, from get().  These are allocated once per distinct combination of layout and resources
+*   and live until clearCache() or destroy(), so they suit command buffers that are recorded once.  Rebuilding
+*   descriptor sets after a resize only allocates sets for the resources that actually changed.
+*
+* Writes for both kinds are batched through a vku::DescriptorSetUpdater and applied by flush(), which
+* must be called before recording commands that bind the returned sets.
+*/
+class DescriptorAllocator {
+public:
+    struct PoolSizeRatio {
+        vk::DescriptorType type;
+        float ratio;
+    };
+
+    DescriptorAllocator(const vks::Context& context, uint32_t setsPerPool = 128)
+        : context(context)
+        , setsPerPool(setsPerPool)
+        , state(std::make_shared<State>()) {}
+
+    DescriptorAllocator(const DescriptorAllocator&) = delete;
+    DescriptorAllocator& operator=(const DescriptorAllocator&) = delete;
+
+    // Descriptors of each type per set reserved in every new pool
+    std::vector<PoolSizeRatio> poolRatios{
+        { vk::DescriptorType::eSampler, 0.5f },
+        { vk::DescriptorType::eCombinedImageSampler, 4.0f },
+        { vk::DescriptorType::eSampledImage, 4.0f },
+        { vk::DescriptorType::eStorageImage, 1.0f },
+        { vk::DescriptorType::eUniformTexelBuffer, 1.0f },
+        { vk::DescriptorType::eStorageTexelBuffer, 1.0f },
+        { vk::DescriptorType::eUniformBuffer, 2.0f },
+        { vk::DescriptorType::eStorageBuffer, 2.0f },
+        { vk::DescriptorType::eUniformBufferDynamic, 1.0f },
+        { vk::DescriptorType::eStorageBufferDynamic, 1.0f },
+        { vk::DescriptorType::eInputAttachment, 0.5f },
+    };
+
+    // Allocate a set that is only valid for the current frame, for command buffers recorded in this frame only
+    vk::DescriptorSet allocate(vk::DescriptorSetLayout layout, const DescriptorBindings& bindings = {}) {
+        auto result = allocateFrom(frameChain, layout);
+        queueWrite(result, bindings);
+        return result;
+    }
+
+    // Fetch the set for the given layout and resources, allocating and writing it the first time it is requested
+    vk::DescriptorSet get(vk::DescriptorSetLayout layout, const DescriptorBindings& bindings) {
+        auto key = bindings.key(layout);
+        auto itr = cachedSets.find(key);
+        if (itr != cachedSets.end()) {
+            return itr->second;
+        }
+        auto result = allocateFrom(persistentChain, layout);
+        queueWrite(result, bindings);
+        cachedSets.insert({ key, result });
+        return result;
+    }
+
+    // Apply all queued writes in a single vkUpdateDescriptorSets call
+    void flush() {
+        if (pendingWrites.empty()) {
+            return;
+        }
+        size_t bufferCount = 0, imageCount = 0;
+        for (const auto& pending : pendingWrites) {
+            bufferCount += pending.second.bufferCount();
+            imageCount += pending.second.imageCount();
+        }
+        vku::DescriptorSetUpdater updater{ static_cast<int>(bufferCount), static_cast<int>(imageCount) };
+        for (const auto& pending : pendingWrites) {
+            pending.second.write(updater, pending.first);
+        }
+        assert(updater.ok());
+        updater.update(context.device);
+        pendingWrites.clear();
+    }
+
+    // Retire the transient sets of the frame about to be submitted.  Must be called before the
+    // context dumpster is emptied with that frame's fence.
+    void endFrame() {
+        flush();
+        if (frameChain.empty()) {
+            return;
+        }
+        std::weak_ptr<State> weakState = state;
+        const vk::Device device = context.device;
+        std::vector<vk::DescriptorPool> retired;
+        retired.swap(frameChain);
+        context.dumpster.push_back([weakState, device, retired] {
+            auto state = weakState.lock();
+            if (!state) {
+                return;
+            }
+            for (const auto& pool : retired) {
+                device.resetDescriptorPool(pool);
+                state->freePools.push_back(pool);
+            }
+        });
+    }
+
+    // Drop all cached sets, for instance after the resources they reference were recreated.  The pools are reset
+    // immediately, so no submitted work may still use the sets and command buffers binding them need recording again.
+    void clearCache() {
+        cachedSets.clear();
+        for (const auto& pool : persistentChain) {
+            context.device.resetDescriptorPool(pool);
+            state->freePools.push_back(pool);
+        }
+        persistentChain.clear();
+    }
+
+    void destroy() {
+        pendingWrites.clear();
+        cachedSets.clear();
+        for (const auto& pool : allPools) {
+            context.device.destroyDescriptorPool(pool);
+        }
+        allPools.clear();
+        frameChain.clear();
+        persistentChain.clear();
+        // Any chains still waiting in the dumpster now refer to destroyed pools
+        state = std::make_shared<State>();
+    }
+
+private:
+    struct State {
+        std::vector<vk::DescriptorPool> freePools;
+    };
+
+    struct KeyHash {
+        size_t operator()(const std::vector<uint64_t>& key) const {
+            uint64_t hash = 14695981039346656037ULL;
+            for (const auto& word : key) {
+                hash ^= word;
+                hash *= 1099511628211ULL;
+            }
+            return static_cast<size_t>(hash);
+        }
+    };
+
+    vk::DescriptorPool createPool() {
+        std::vector<vk::DescriptorPoolSize> sizes;
+        sizes.reserve(poolRatios.size());
+        for (const auto& ratio : poolRatios) {
+            sizes.push_back({ ratio.type, std::max(1u, static_cast<uint32_t>(ratio.ratio * setsPerPool)) });
+        }
+        auto pool = context.device.createDescriptorPool({ {}, setsPerPool, static_cast<uint32_t>(sizes.size()), sizes.data() });
+        allPools.push_back(pool);
+        // Each new pool is larger than the last, so a busy allocator converges on a short chain
+        setsPerPool = std::min(setsPerPool * 2, 4096u);
+        return pool;
+    }
+
+    vk::DescriptorPool nextPool() {
+        if (state->freePools.empty()) {
+            return createPool();
+        }
+        auto pool = state->freePools.back();
+        state->freePools.pop_back();
+        return pool;
+    }
+
+    vk::DescriptorSet allocateFrom(std::vector<vk::DescriptorPool>& chain, vk::DescriptorSetLayout layout) {
+        if (chain.empty()) {
+            chain.push_back(nextPool());
+        }
+        try {
+            return context.device.allocateDescriptorSets({ chain.back(), 1, &layout })[0];
+        } catch (const vk::OutOfPoolMemoryError&) {
+        } catch (const vk::FragmentedPoolError&) {
+        }
+        // The current pool is exhausted, grow the chain and retry once
+        chain.push_back(nextPool());
+        return context.device.allocateDescriptorSets({ chain.back(), 1, &layout })[0];
+    }
+
+    void queueWrite(vk::DescriptorSet descriptorSet, const DescriptorBindings& bindings) {
+        if (!bindings.entries.empty()) {
+            pendingWrites.push_back({ descriptorSet, bindings });
+        }
+    }
+
+    const vks::Context& context;
+    uint32_t setsPerPool;
+    std::shared_ptr<State> state;
+    std::vector<vk::DescriptorPool> allPools;
+    std::vector<vk::DescriptorPool> frameChain;
+    std::vector<vk::DescriptorPool> persistentChain;
+    std::unordered_map<std::vector<uint64_t>, vk::DescriptorSet, KeyHash> cachedSets;
+    std::vector<std::pair<vk::DescriptorSet, DescriptorBindings>> pendingWrites;
+};
+
+}  // namespace vks
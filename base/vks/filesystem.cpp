@@ -1,5 +1,6 @@
 #include "filesystem.hpp"
 
+#include <algorithm>
 #include <cstring>
 #include <fstream>
 #include <istream>
@@ -8,6 +9,13 @@
 
 #include "storage.hpp"
 
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
 namespace vks { namespace file {
 
 void withBinaryFileContents(const std::string& filename, std::function<void(size_t size, const void* data)> handler) {
@@ -44,4 +52,37 @@ std::string readTextFile(const std::string& fileName) {
     return fileContent;
 }
 
+std::vector<std::string> listDirectory(const std::string& path) {
+    std::vector<std::string> result;
+#if defined(_WIN32)
+    WIN32_FIND_DATAA data;
+    HANDLE find = FindFirstFileA((path + "\\*").c_str(), &data);
+    if (find != INVALID_HANDLE_VALUE) {
+        do {
+            result.emplace_back(data.cFileName);
+        } while (FindNextFileA(find, &data));
+        FindClose(find);
+    }
+#else
+    if (DIR* dir = opendir(path.c_str())) {
+        while (const dirent* entry = readdir(dir)) {
+            result.emplace_back(entry->d_name);
+        }
+        closedir(dir);
+    }
+#endif
+    result.erase(std::remove_if(result.begin(), result.end(), [](const std::string& name) { return name == "." || name == ".."; }), result.end());
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+bool createDirectory(const std::string& path) {
+#if defined(_WIN32)
+    return CreateDirectoryA(path.c_str(), nullptr) || GetLastError() == ERROR_ALREADY_EXISTS;
+#else
+    struct stat info;
+    return mkdir(path.c_str(), 0755) == 0 || (stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode));
+#endif
+}
+
 }}  // namespace vks::file
@@ -13,4 +13,10 @@ void withBinaryFileContents(const std::string& filename, std::function<void(size
 
 std::string readTextFile(const std::string& fileName);
 
+// Names of the entries of a directory, without "." and "..", sorted.  Empty if the directory does not exist.
+std::vector<std::string> listDirectory(const std::string& path);
+
+// Create a directory whose parent exists.  Returns true if it exists afterwards.
+bool createDirectory(const std::string& path);
+
 }}  // namespace vks::file
@@ -6,67 +6,82 @@
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
 */
 
+#pragma once
+
 #include <array>
 #include <math.h>
 #include <glm/glm.hpp>
 
-namespace vks
-{
-	class Frustum
-	{
-	public:
-		enum side { LEFT = 0, RIGHT = 1, TOP = 2, BOTTOM = 3, BACK = 4, FRONT = 5 };
-		std::array<glm::vec4, 6> planes;
+namespace vks {
+class Frustum {
+public:
+    enum side
+    {
+        LEFT = 0,
+        RIGHT = 1,
+        TOP = 2,
+        BOTTOM = 3,
+        BACK = 4,
+        FRONT = 5
+    };
+    std::array<glm::vec4, 6> planes;
+
+    void update(glm::mat4 matrix) {
+        planes[LEFT].x = matrix[0].w + matrix[0].x;
+        planes[LEFT].y = matrix[1].w + matrix[1].x;
+        planes[LEFT].z = matrix[2].w + matrix[2].x;
+        planes[LEFT].w = matrix[3].w + matrix[3].x;
+
+        planes[RIGHT].x = matrix[0].w - matrix[0].x;
+        planes[RIGHT].y = matrix[1].w - matrix[1].x;
+        planes[RIGHT].z = matrix[2].w - matrix[2].x;
+        planes[RIGHT].w = matrix[3].w - matrix[3].x;
 
-		void update(glm::mat4 matrix)
-		{
-			planes[LEFT].x = matrix[0].w + matrix[0].x;
-			planes[LEFT].y = matrix[1].w + matrix[1].x;
-			planes[LEFT].z = matrix[2].w + matrix[2].x;
-			planes[LEFT].w = matrix[3].w + matrix[3].x;
+        planes[TOP].x = matrix[0].w - matrix[0].y;
+        planes[TOP].y = matrix[1].w - matrix[1].y;
+        planes[TOP].z = matrix[2].w - matrix[2].y;
+        planes[TOP].w = matrix[3].w - matrix[3].y;
 
-			planes[RIGHT].x = matrix[0].w - matrix[0].x;
-			planes[RIGHT].y = matrix[1].w - matrix[1].x;
-			planes[RIGHT].z = matrix[2].w - matrix[2].x;
-			planes[RIGHT].w = matrix[3].w - matrix[3].x;
+        planes[BOTTOM].x = matrix[0].w + matrix[0].y;
+        planes[BOTTOM].y = matrix[1].w + matrix[1].y;
+        planes[BOTTOM].z = matrix[2].w + matrix[2].y;
+        planes[BOTTOM].w = matrix[3].w + matrix[3].y;
 
-			planes[TOP].x = matrix[0].w - matrix[0].y;
-			planes[TOP].y = matrix[1].w - matrix[1].y;
-			planes[TOP].z = matrix[2].w - matrix[2].y;
-			planes[TOP].w = matrix[3].w - matrix[3].y;
+        planes[BACK].x = matrix[0].w + matrix[0].z;
+        planes[BACK].y = matrix[1].w + matrix[1].z;
+        planes[BACK].z = matrix[2].w + matrix[2].z;
+        planes[BACK].w = matrix[3].w + matrix[3].z;
 
-			planes[BOTTOM].x = matrix[0].w + matrix[0].y;
-			planes[BOTTOM].y = matrix[1].w + matrix[1].y;
-			planes[BOTTOM].z = matrix[2].w + matrix[2].y;
-			planes[BOTTOM].w = matrix[3].w + matrix[3].y;
+        planes[FRONT].x = matrix[0].w - matrix[0].z;
+        planes[FRONT].y = matrix[1].w - matrix[1].z;
+        planes[FRONT].z = matrix[2].w - matrix[2].z;
+        planes[FRONT].w = matrix[3].w - matrix[3].z;
 
-			planes[BACK].x = matrix[0].w + matrix[0].z;
-			planes[BACK].y = matrix[1].w + matrix[1].z;
-			planes[BACK].z = matrix[2].w + matrix[2].z;
-			planes[BACK].w = matrix[3].w + matrix[3].z;
+        for (auto i = 0; i < planes.size(); i++) {
+            float length = sqrtf(planes[i].x * planes[i].x + planes[i].y * planes[i].y + planes[i].z * planes[i].z);
+            planes[i] /= length;
+        }
+    }
 
-			planes[FRONT].x = matrix[0].w - matrix[0].z;
-			planes[FRONT].y = matrix[1].w - matrix[1].z;
-			planes[FRONT].z = matrix[2].w - matrix[2].z;
-			planes[FRONT].w = matrix[3].w - matrix[3].z;
+    bool checkSphere(glm::vec3 pos, float radius) const {
+        for (auto i = 0; i < planes.size(); i++) {
+            if ((planes[i].x * pos.x) + (planes[i].y * pos.y) + (planes[i].z * pos.z) + planes[i].w <= -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
 
-			for (auto i = 0; i < planes.size(); i++)
-			{
-				float length = sqrtf(planes[i].x * planes[i].x + planes[i].y * planes[i].y + planes[i].z * planes[i].z);
-				planes[i] /= length;
-			}
-		}
-		
-		bool checkSphere(glm::vec3 pos, float radius)
-		{
-			for (auto i = 0; i < planes.size(); i++)
-			{
-				if ((planes[i].x * pos.x) + (planes[i].y * pos.y) + (planes[i].z * pos.z) + planes[i].w <= -radius)
-				{
-					return false;
-				}
-			}
-			return true;
-		}
-	};
-}
+    // Axis aligned box given by its center and half extent.  See vkx::culling for testing many boxes at once.
+    bool checkBox(glm::vec3 center, glm::vec3 extent) const {
+        for (auto i = 0; i < planes.size(); i++) {
+            // Distance the box reaches towards the negative side of the plane
+            float reach = fabsf(planes[i].x) * extent.x + fabsf(planes[i].y) * extent.y + fabsf(planes[i].z) * extent.z;
+            if ((planes[i].x * center.x) + (planes[i].y * center.y) + (planes[i].z * center.z) + planes[i].w <= -reach) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+}  // namespace vks
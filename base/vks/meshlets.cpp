@@ -0,0 +1,222 @@
+/*
+* Splitting of triangle lists into small clusters with bounds for culling
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "meshlets.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+using namespace vks;
+using namespace vks::model;
+
+namespace {
+
+const uint32_t INVALID = ~0u;
+// Normal cones wider than this (cosine of the half angle) are not worth testing
+const float MIN_CONE_COSINE = 0.1f;
+
+// Spread the lower 10 bits of `v` to every third bit
+uint32_t spreadBits(uint32_t v) {
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+}  // namespace
+
+void model::computeMeshletBounds(Meshlet& meshlet, const uint32_t* indices, const uint8_t* positions, size_t positionStride) {
+    auto position = [&](uint32_t vertex) { return *reinterpret_cast<const glm::vec3*>(positions + vertex * positionStride); };
+    const uint32_t* corners = indices + meshlet.indexBase;
+
+    glm::vec3 lower{ FLT_MAX }, upper{ -FLT_MAX };
+    for (uint32_t i = 0; i < meshlet.indexCount; ++i) {
+        lower = glm::min(lower, position(corners[i]));
+        upper = glm::max(upper, position(corners[i]));
+    }
+    meshlet.center = (lower + upper) * 0.5f;
+    float radius = 0.0f;
+    for (uint32_t i = 0; i < meshlet.indexCount; ++i) {
+        radius = std::max(radius, glm::length(position(corners[i]) - meshlet.center));
+    }
+    meshlet.radius = radius;
+
+    glm::vec3 normals{ 0.0f };
+    for (uint32_t i = 0; i + 2 < meshlet.indexCount; i += 3) {
+        const glm::vec3 p0 = position(corners[i]);
+        const glm::vec3 normal = glm::cross(position(corners[i + 1]) - p0, position(corners[i + 2]) - p0);
+        const float length = glm::length(normal);
+        if (length > 0.0f) {
+            normals += normal / length;
+        }
+    }
+    const float axisLength = glm::length(normals);
+    meshlet.coneAxis = axisLength > 0.0f ? normals / axisLength : glm::vec3(0.0f, 0.0f, 1.0f);
+    meshlet.coneCutoff = 1.0f;
+    if (axisLength == 0.0f) {
+        return;
+    }
+    float minDot = 1.0f;
+    for (uint32_t i = 0; i + 2 < meshlet.indexCount; i += 3) {
+        const glm::vec3 p0 = position(corners[i]);
+        const glm::vec3 normal = glm::cross(position(corners[i + 1]) - p0, position(corners[i + 2]) - p0);
+        const float length = glm::length(normal);
+        if (length > 0.0f) {
+            minDot = std::min(minDot, glm::dot(normal / length, meshlet.coneAxis));
+        }
+    }
+    // The test compares against the sine of the half angle of the cone
+    if (minDot >= MIN_CONE_COSINE) {
+        meshlet.coneCutoff = sqrtf(1.0f - minDot * minDot);
+    }
+}
+
+void model::buildMeshlets(std::vector<Meshlet>& meshlets,
+                          uint32_t* destination,
+                          const uint32_t* indices,
+                          size_t indexCount,
+                          const uint8_t* positions,
+                          size_t positionStride,
+                          uint32_t vertexCount,
+                          uint32_t maxTriangles,
+                          uint32_t minTriangles) {
+    const uint32_t triangleCount = static_cast<uint32_t>(indexCount / 3);
+    if (triangleCount == 0) {
+        return;
+    }
+    auto position = [&](uint32_t vertex) { return *reinterpret_cast<const glm::vec3*>(positions + vertex * positionStride); };
+
+    // Centers, unit normals and the Morton order of the triangles
+    std::vector<glm::vec3> centers(triangleCount), normals(triangleCount);
+    glm::vec3 lower{ FLT_MAX }, upper{ -FLT_MAX };
+    for (uint32_t triangle = 0; triangle < triangleCount; ++triangle) {
+        const glm::vec3 p0 = position(indices[triangle * 3]);
+        const glm::vec3 p1 = position(indices[triangle * 3 + 1]);
+        const glm::vec3 p2 = position(indices[triangle * 3 + 2]);
+        centers[triangle] = (p0 + p1 + p2) / 3.0f;
+        const glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+        const float length = glm::length(normal);
+        normals[triangle] = length > 0.0f ? normal / length : glm::vec3(0.0f);
+        lower = glm::min(lower, centers[triangle]);
+        upper = glm::max(upper, centers[triangle]);
+    }
+    const glm::vec3 extent = glm::max(upper - lower, glm::vec3(FLT_MIN));
+    std::vector<uint64_t> order(triangleCount);
+    for (uint32_t triangle = 0; triangle < triangleCount; ++triangle) {
+        const glm::vec3 cell = (centers[triangle] - lower) / extent * 1023.0f;
+        const uint32_t code = spreadBits(static_cast<uint32_t>(cell.x)) | spreadBits(static_cast<uint32_t>(cell.y)) << 1 |
+                              spreadBits(static_cast<uint32_t>(cell.z)) << 2;
+        order[triangle] = static_cast<uint64_t>(code) << 32 | triangle;
+    }
+    std::sort(order.begin(), order.end());
+    // Position of every triangle along the curve, the last tie breaker of the growth
+    std::vector<uint32_t> rank(triangleCount);
+    for (uint32_t i = 0; i < triangleCount; ++i) {
+        rank[static_cast<uint32_t>(order[i])] = i;
+    }
+
+    // Triangles of every vertex
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+        ++adjacencyOffsets[indices[i] + 1];
+    }
+    for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+        adjacencyOffsets[vertex + 1] += adjacencyOffsets[vertex];
+    }
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    {
+        std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (size_t i = 0; i < triangleCount * 3; ++i) {
+            adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+        }
+    }
+
+    std::vector<bool> used(triangleCount, false);
+    // Cluster number + 1 of the cluster a vertex was last added to
+    std::vector<uint32_t> vertexCluster(vertexCount, 0);
+    std::vector<uint32_t> candidates;
+    uint32_t cursor = 0;
+    uint32_t output = 0;
+    const uint32_t firstMeshlet = static_cast<uint32_t>(meshlets.size());
+    uint32_t clusterId = 0;
+
+    while (output < triangleCount) {
+        ++clusterId;
+        Meshlet meshlet;
+        meshlet.indexBase = output * 3;
+        glm::vec3 clusterNormal{ 0.0f };
+        uint32_t clusterTriangles = 0;
+        candidates.clear();
+
+        auto addTriangle = [&](uint32_t triangle) {
+            used[triangle] = true;
+            memcpy(destination + output * 3, indices + triangle * 3, 3 * sizeof(uint32_t));
+            ++output;
+            ++clusterTriangles;
+            clusterNormal += normals[triangle];
+            for (uint32_t k = 0; k < 3; ++k) {
+                const uint32_t vertex = indices[triangle * 3 + k];
+                if (vertexCluster[vertex] != clusterId) {
+                    vertexCluster[vertex] = clusterId;
+                    for (uint32_t a = adjacencyOffsets[vertex]; a < adjacencyOffsets[vertex + 1]; ++a) {
+                        if (!used[adjacency[a]]) {
+                            candidates.push_back(adjacency[a]);
+                        }
+                    }
+                }
+            }
+        };
+
+        while (clusterTriangles < maxTriangles && output < triangleCount) {
+            // Best neighbour: fewest new vertices, then the normal closest to the cluster's, then curve order
+            uint32_t best = INVALID;
+            uint32_t bestNew = 4;
+            float bestDot = 0.0f;
+            size_t live = 0;
+            for (size_t c = 0; c < candidates.size(); ++c) {
+                const uint32_t triangle = candidates[c];
+                if (used[triangle]) {
+                    continue;
+                }
+                candidates[live++] = triangle;
+                uint32_t newVertices = 0;
+                for (uint32_t k = 0; k < 3; ++k) {
+                    newVertices += vertexCluster[indices[triangle * 3 + k]] != clusterId ? 1 : 0;
+                }
+                const float dot = glm::dot(normals[triangle], clusterNormal);
+                const bool better = newVertices < bestNew || (newVertices == bestNew && (dot > bestDot || (dot == bestDot && rank[triangle] < rank[best])));
+                if (better) {
+                    best = triangle;
+                    bestNew = newVertices;
+                    bestDot = dot;
+                }
+            }
+            candidates.resize(live);
+
+            if (best == INVALID) {
+                if (clusterTriangles >= minTriangles && clusterTriangles > 0) {
+                    break;
+                }
+                while (used[static_cast<uint32_t>(order[cursor])]) {
+                    ++cursor;
+                }
+                best = static_cast<uint32_t>(order[cursor]);
+            }
+            addTriangle(best);
+        }
+
+        meshlet.indexCount = clusterTriangles * 3;
+        meshlets.push_back(meshlet);
+    }
+
+    for (size_t m = firstMeshlet; m < meshlets.size(); ++m) {
+        computeMeshletBounds(meshlets[m], destination, positions, positionStride);
+    }
+}
@@ -0,0 +1,53 @@
+/*
+* Splitting of triangle lists into small clusters with bounds for culling
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+namespace vks { namespace model {
+
+/** @brief Cluster of consecutive triangles in an index buffer, laid out for std430 storage buffers */
+struct Meshlet {
+    // Bounding sphere of the vertices
+    glm::vec3 center;
+    float radius{ 0.0f };
+    // Cone containing the normals of all triangles, taken as cross(p1 - p0, p2 - p0).  The cluster faces away
+    // from a camera at c if dot(center - c, coneAxis) >= coneCutoff * length(center - c) + radius.  A cutoff of
+    // 1 never passes that test, it is used for clusters whose normals spread too far.
+    glm::vec3 coneAxis;
+    float coneCutoff{ 1.0f };
+    uint32_t indexBase{ 0 };
+    uint32_t indexCount{ 0 };
+    uint32_t pad0{ 0 };
+    uint32_t pad1{ 0 };
+};
+
+// Reorder the triangles of `indices` into clusters of at most `maxTriangles` triangles.  A cluster grows across
+// shared vertices, preferring the triangles that add the fewest new vertices and then the ones facing the way
+// the cluster does.  Clusters with fewer than `minTriangles` triangles and no neighbours left continue with
+// the next unused triangle along a Morton curve through the triangle centers, so disconnected pieces that lie
+// close together share clusters.  The result only depends on the input.  `positions` are three floats each,
+// `positionStride` bytes apart.  The meshlets are appended to `meshlets` with index ranges relative to
+// `destination`, which may not alias `indices`.
+void buildMeshlets(std::vector<Meshlet>& meshlets,
+                   uint32_t* destination,
+                   const uint32_t* indices,
+                   size_t indexCount,
+                   const uint8_t* positions,
+                   size_t positionStride,
+                   uint32_t vertexCount,
+                   uint32_t maxTriangles = 124,
+                   uint32_t minTriangles = 64);
+
+// Bounding sphere and normal cone of the triangles of `meshlet`, from its index range in `indices`
+void computeMeshletBounds(Meshlet& meshlet, const uint32_t* indices, const uint8_t* positions, size_t positionStride);
+
+}}  // namespace vks::model
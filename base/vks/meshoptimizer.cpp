@@ -0,0 +1,365 @@
+/*
+* Mesh optimization: vertex deduplication, vertex cache and overdraw ordering of triangles and vertex fetch ordering
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "meshoptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+#include <glm/glm.hpp>
+
+using namespace vks;
+using namespace vks::model;
+
+namespace {
+
+const uint32_t INVALID = ~0u;
+
+// Forsyth's scoring: an LRU cache of this many entries, the three vertices of the last triangle get a fixed
+// score, older entries one falling off with the position, and vertices with few remaining triangles a boost
+const uint32_t SCORE_CACHE_SIZE = 32;
+const float CACHE_DECAY_POWER = 1.5f;
+const float LAST_TRIANGLE_SCORE = 0.75f;
+const float VALENCE_BOOST_SCALE = 2.0f;
+const float VALENCE_BOOST_POWER = 0.5f;
+
+float vertexScore(int32_t cachePosition, uint32_t liveTriangles) {
+    if (liveTriangles == 0) {
+        return 0.0f;
+    }
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            score = LAST_TRIANGLE_SCORE;
+        } else {
+            const float scaler = 1.0f / (SCORE_CACHE_SIZE - 3);
+            score = powf(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+        }
+    }
+    return score + VALENCE_BOOST_SCALE * powf(static_cast<float>(liveTriangles), -VALENCE_BOOST_POWER);
+}
+
+// FIFO cache: a vertex is cached if it was added within the last `size` misses
+struct FifoCache {
+    std::vector<uint32_t> timestamps;
+    uint32_t timestamp;
+    uint32_t size;
+
+    FifoCache(uint32_t vertexCount, uint32_t size)
+        : timestamps(vertexCount, 0)
+        , timestamp(size + 1)
+        , size(size) {}
+
+    // Returns 1 on a miss
+    uint32_t access(uint32_t vertex) {
+        if (timestamp - timestamps[vertex] > size) {
+            timestamps[vertex] = timestamp++;
+            return 1;
+        }
+        return 0;
+    }
+
+    uint32_t triangle(const uint32_t* corners) { return access(corners[0]) + access(corners[1]) + access(corners[2]); }
+
+    void flush() { timestamp += size + 1; }
+};
+
+// Hashes and compares vertices by their bytes
+struct VertexHasher {
+    const uint8_t* vertices;
+    size_t vertexSize;
+
+    size_t operator()(uint32_t vertex) const {
+        // FNV-1a
+        const uint8_t* bytes = vertices + vertex * vertexSize;
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < vertexSize; ++i) {
+            hash = (hash ^ bytes[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    bool operator()(uint32_t a, uint32_t b) const { return memcmp(vertices + a * vertexSize, vertices + b * vertexSize, vertexSize) == 0; }
+};
+
+}  // namespace
+
+CacheStatistics model::analyzeVertexCache(const uint32_t* indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize) {
+    CacheStatistics result;
+    FifoCache cache(vertexCount, cacheSize);
+    for (size_t i = 0; i < indexCount; ++i) {
+        result.vertexTransforms += cache.access(indices[i]);
+    }
+    if (indexCount >= 3) {
+        result.acmr = static_cast<float>(result.vertexTransforms) / (indexCount / 3);
+    }
+    if (vertexCount > 0) {
+        result.atvr = static_cast<float>(result.vertexTransforms) / vertexCount;
+    }
+    return result;
+}
+
+uint32_t model::generateVertexRemap(uint32_t* remap,
+                                    const uint32_t* indices,
+                                    size_t indexCount,
+                                    const uint8_t* vertices,
+                                    uint32_t vertexCount,
+                                    size_t vertexSize) {
+    const VertexHasher hasher{ vertices, vertexSize };
+    std::unordered_map<uint32_t, uint32_t, VertexHasher, VertexHasher> unique(vertexCount, hasher, hasher);
+    std::fill(remap, remap + vertexCount, INVALID);
+    uint32_t uniqueCount = 0;
+    for (size_t i = 0; i < indexCount; ++i) {
+        const uint32_t vertex = indices[i];
+        if (remap[vertex] == INVALID) {
+            auto inserted = unique.emplace(vertex, uniqueCount);
+            remap[vertex] = inserted.first->second;
+            uniqueCount += inserted.second ? 1 : 0;
+        }
+    }
+    return uniqueCount;
+}
+
+void model::remapIndices(uint32_t* indices, size_t indexCount, const uint32_t* remap) {
+    for (size_t i = 0; i < indexCount; ++i) {
+        indices[i] = remap[indices[i]];
+    }
+}
+
+void model::remapVertices(uint8_t* destination, const uint8_t* vertices, uint32_t vertexCount, size_t vertexSize, const uint32_t* remap) {
+    for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+        if (remap[vertex] != INVALID) {
+            memcpy(destination + remap[vertex] * vertexSize, vertices + vertex * vertexSize, vertexSize);
+        }
+    }
+}
+
+void model::optimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, uint32_t vertexCount) {
+    const size_t triangleCount = indexCount / 3;
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // Triangles of each vertex, the ones not emitted yet come first
+    std::vector<uint32_t> liveTriangles(vertexCount, 0);
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+        ++liveTriangles[indices[i]];
+    }
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1, 0);
+    for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+        adjacencyOffsets[vertex + 1] = adjacencyOffsets[vertex] + liveTriangles[vertex];
+    }
+    std::vector<uint32_t> adjacency(triangleCount * 3);
+    std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+        adjacency[fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+    }
+
+    std::vector<float> vertexScores(vertexCount);
+    std::vector<int32_t> cachePositions(vertexCount, -1);
+    for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+        vertexScores[vertex] = vertexScore(-1, liveTriangles[vertex]);
+    }
+    auto triangleScore = [&](uint32_t triangle) {
+        const uint32_t* corners = indices + triangle * 3;
+        return vertexScores[corners[0]] + vertexScores[corners[1]] + vertexScores[corners[2]];
+    };
+
+    std::vector<bool> emitted(triangleCount, false);
+    uint32_t cache[SCORE_CACHE_SIZE + 3];
+    uint32_t newCache[SCORE_CACHE_SIZE + 3];
+    uint32_t cacheCount = 0;
+    size_t cursor = 0;
+
+    // Start with the best triangle overall
+    uint32_t current = 0;
+    float bestScore = triangleScore(0);
+    for (uint32_t triangle = 1; triangle < triangleCount; ++triangle) {
+        const float score = triangleScore(triangle);
+        if (score > bestScore) {
+            current = triangle;
+            bestScore = score;
+        }
+    }
+
+    for (size_t output = 0; output < triangleCount; ++output) {
+        if (current == INVALID) {
+            // No triangle touches the cache anymore, continue with the next one in the input order
+            while (emitted[cursor]) {
+                ++cursor;
+            }
+            current = static_cast<uint32_t>(cursor);
+        }
+        const uint32_t* corners = indices + current * 3;
+        memcpy(destination + output * 3, corners, 3 * sizeof(uint32_t));
+        emitted[current] = true;
+
+        // The corners move to the front of the cache, the other entries keep their order behind them
+        uint32_t newCount = 0;
+        for (uint32_t k = 0; k < 3; ++k) {
+            const uint32_t vertex = corners[k];
+            if (std::find(newCache, newCache + newCount, vertex) == newCache + newCount) {
+                newCache[newCount++] = vertex;
+            }
+            // Remove the triangle from the live ones of the vertex
+            uint32_t* triangles = adjacency.data() + adjacencyOffsets[vertex];
+            uint32_t* found = std::find(triangles, triangles + liveTriangles[vertex], current);
+            std::swap(*found, triangles[--liveTriangles[vertex]]);
+        }
+        for (uint32_t i = 0; i < cacheCount; ++i) {
+            if (cache[i] != corners[0] && cache[i] != corners[1] && cache[i] != corners[2]) {
+                newCache[newCount++] = cache[i];
+            }
+        }
+
+        // Rescore the cached vertices, the ones that dropped out of the cache included
+        for (uint32_t i = 0; i < newCount; ++i) {
+            const uint32_t vertex = newCache[i];
+            cachePositions[vertex] = i < SCORE_CACHE_SIZE ? static_cast<int32_t>(i) : -1;
+            vertexScores[vertex] = vertexScore(cachePositions[vertex], liveTriangles[vertex]);
+        }
+
+        // Continue with the best triangle using a cached vertex
+        cacheCount = std::min(newCount, SCORE_CACHE_SIZE);
+        current = INVALID;
+        bestScore = -1.0f;
+        for (uint32_t i = 0; i < cacheCount; ++i) {
+            const uint32_t vertex = newCache[i];
+            cache[i] = vertex;
+            const uint32_t* triangles = adjacency.data() + adjacencyOffsets[vertex];
+            for (uint32_t t = 0; t < liveTriangles[vertex]; ++t) {
+                const float score = triangleScore(triangles[t]);
+                if (score > bestScore) {
+                    current = triangles[t];
+                    bestScore = score;
+                }
+            }
+        }
+    }
+}
+
+void model::optimizeOverdraw(uint32_t* destination,
+                             const uint32_t* indices,
+                             size_t indexCount,
+                             const uint8_t* positions,
+                             size_t positionStride,
+                             uint32_t vertexCount,
+                             float threshold) {
+    const uint32_t triangleCount = static_cast<uint32_t>(indexCount / 3);
+    if (triangleCount == 0) {
+        return;
+    }
+
+    // Hard boundaries: a triangle whose corners all miss the cache most likely starts a new patch of the mesh
+    FifoCache cache(vertexCount, STATISTICS_CACHE_SIZE);
+    std::vector<uint32_t> patches;
+    for (uint32_t triangle = 0; triangle < triangleCount; ++triangle) {
+        if (cache.triangle(indices + triangle * 3) == 3 || triangle == 0) {
+            patches.push_back(triangle);
+        }
+    }
+    patches.push_back(triangleCount);
+
+    // Soft boundaries: split a patch as soon as its cache miss ratio so far is within the threshold of the
+    // one of the whole patch, restarting the cache at every split
+    std::vector<uint32_t> clusterStarts;
+    for (size_t patch = 0; patch + 1 < patches.size(); ++patch) {
+        const uint32_t begin = patches[patch], end = patches[patch + 1];
+        cache.flush();
+        uint32_t patchMisses = 0;
+        for (uint32_t triangle = begin; triangle < end; ++triangle) {
+            patchMisses += cache.triangle(indices + triangle * 3);
+        }
+        const float clusterThreshold = threshold * patchMisses / (end - begin);
+
+        cache.flush();
+        clusterStarts.push_back(begin);
+        uint32_t misses = 0, triangles = 0;
+        for (uint32_t triangle = begin; triangle + 1 < end; ++triangle) {
+            misses += cache.triangle(indices + triangle * 3);
+            ++triangles;
+            if (misses <= clusterThreshold * triangles) {
+                clusterStarts.push_back(triangle + 1);
+                cache.flush();
+                misses = triangles = 0;
+            }
+        }
+    }
+    clusterStarts.push_back(triangleCount);
+
+    auto position = [&](uint32_t vertex) { return *reinterpret_cast<const glm::vec3*>(positions + vertex * positionStride); };
+    glm::vec3 meshCenter{ 0.0f };
+    for (size_t i = 0; i < triangleCount * 3; ++i) {
+        meshCenter += position(indices[i]);
+    }
+    meshCenter /= static_cast<float>(triangleCount * 3);
+
+    // Sort key of a cluster: how far its area weighted center lies in front of the mesh center, along its
+    // average normal
+    struct Cluster {
+        uint32_t begin;
+        uint32_t end;
+        float key;
+    };
+    std::vector<Cluster> clusters;
+    clusters.reserve(clusterStarts.size() - 1);
+    float orientation = 0.0f;
+    for (size_t c = 0; c + 1 < clusterStarts.size(); ++c) {
+        Cluster cluster{ clusterStarts[c], clusterStarts[c + 1], 0.0f };
+        glm::vec3 weightedCenter{ 0.0f }, cornerSum{ 0.0f }, normal{ 0.0f };
+        float area = 0.0f;
+        for (uint32_t triangle = cluster.begin; triangle < cluster.end; ++triangle) {
+            const glm::vec3 p0 = position(indices[triangle * 3]);
+            const glm::vec3 p1 = position(indices[triangle * 3 + 1]);
+            const glm::vec3 p2 = position(indices[triangle * 3 + 2]);
+            const glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            const float triangleArea = glm::length(n);
+            weightedCenter += (p0 + p1 + p2) * (triangleArea / 3.0f);
+            cornerSum += p0 + p1 + p2;
+            normal += n;
+            area += triangleArea;
+        }
+        const glm::vec3 center = area > 0.0f ? weightedCenter / area : cornerSum / (3.0f * (cluster.end - cluster.begin));
+        const float normalLength = glm::length(normal);
+        if (normalLength > 0.0f) {
+            cluster.key = glm::dot(center - meshCenter, normal / normalLength);
+            orientation += glm::dot(center - meshCenter, normal);
+        }
+        clusters.push_back(cluster);
+    }
+
+    // With the winding giving inward normals, the keys are negated to still put the outward facing clusters first
+    const float sign = orientation < 0.0f ? -1.0f : 1.0f;
+    std::stable_sort(clusters.begin(), clusters.end(), [&](const Cluster& a, const Cluster& b) { return a.key * sign > b.key * sign; });
+
+    uint32_t* output = destination;
+    for (const auto& cluster : clusters) {
+        const size_t count = (cluster.end - cluster.begin) * 3;
+        memcpy(output, indices + cluster.begin * 3, count * sizeof(uint32_t));
+        output += count;
+    }
+}
+
+uint32_t model::optimizeVertexFetch(uint8_t* destination,
+                                    uint32_t* indices,
+                                    size_t indexCount,
+                                    const uint8_t* vertices,
+                                    uint32_t vertexCount,
+                                    size_t vertexSize) {
+    std::vector<uint32_t> remap(vertexCount, INVALID);
+    uint32_t next = 0;
+    for (size_t i = 0; i < indexCount; ++i) {
+        const uint32_t vertex = indices[i];
+        if (remap[vertex] == INVALID) {
+            memcpy(destination + next * vertexSize, vertices + vertex * vertexSize, vertexSize);
+            remap[vertex] = next++;
+        }
+        indices[i] = remap[vertex];
+    }
+    return next;
+}
@@ -0,0 +1,60 @@
+/*
+* Mesh optimization: vertex deduplication, vertex cache and overdraw ordering of triangles and vertex fetch ordering
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace vks { namespace model {
+
+// Entries of the FIFO post transform cache the statistics are measured with
+static const uint32_t STATISTICS_CACHE_SIZE = 16;
+
+/** @brief Post transform cache behaviour of an index buffer */
+struct CacheStatistics {
+    uint32_t vertexTransforms{ 0 };
+    // Average cache miss ratio, transformed vertices per triangle.  0.5 is the optimum of a regular grid, 3 the worst.
+    float acmr{ 0.0f };
+    // Average transform to vertex ratio, 1 if every vertex is transformed once
+    float atvr{ 0.0f };
+};
+
+CacheStatistics analyzeVertexCache(const uint32_t* indices, size_t indexCount, uint32_t vertexCount, uint32_t cacheSize = STATISTICS_CACHE_SIZE);
+
+// Map every vertex to the first vertex with the same `vertexSize` bytes, numbered in order of first use by
+// `indices`.  Vertices no index refers to are mapped to ~0.  Returns the number of unique vertices.
+uint32_t generateVertexRemap(uint32_t* remap, const uint32_t* indices, size_t indexCount, const uint8_t* vertices, uint32_t vertexCount, size_t vertexSize);
+// Apply a remap to an index buffer, in place
+void remapIndices(uint32_t* indices, size_t indexCount, const uint32_t* remap);
+// Apply a remap to a vertex buffer, `destination` holds as many vertices as the remap has unique ones
+void remapVertices(uint8_t* destination, const uint8_t* vertices, uint32_t vertexCount, size_t vertexSize, const uint32_t* remap);
+
+// Reorder the triangles for the post transform cache with Tom Forsyth's "Linear-Speed Vertex Cache Optimisation".
+// `destination` may not alias `indices`.
+void optimizeVertexCache(uint32_t* destination, const uint32_t* indices, size_t indexCount, uint32_t vertexCount);
+
+// Reorder clusters of the cache optimized triangles to reduce overdraw, after Sander, Nehab and Barczak, "Fast
+// Triangle Reordering for Vertex Locality and Reduced Overdraw".  The triangles are split into clusters wherever
+// the cache restarts and wherever the cache miss ratio so far is within `threshold` of the one of the whole
+// run, so the ACMR grows by at most that factor.  Clusters facing away from the mesh center are drawn first, as
+// they are more likely to occlude the others.  Which way the triangles face is taken from their winding
+// relative to the mesh center, so either front face convention works.  `positions` are three floats each,
+// `positionStride` bytes apart.  `destination` may not alias `indices`.
+void optimizeOverdraw(uint32_t* destination,
+                      const uint32_t* indices,
+                      size_t indexCount,
+                      const uint8_t* positions,
+                      size_t positionStride,
+                      uint32_t vertexCount,
+                      float threshold = 1.05f);
+
+// Number the vertices in the order the indices first use them and reorder the vertex data to match, so the
+// vertex fetch walks the buffer front to back.  Unused vertices are dropped.  Returns the new vertex count.
+uint32_t optimizeVertexFetch(uint8_t* destination, uint32_t* indices, size_t indexCount, const uint8_t* vertices, uint32_t vertexCount, size_t vertexSize);
+
+}}  // namespace vks::model
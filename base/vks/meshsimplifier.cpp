@@ -0,0 +1,329 @@
+/*
+* Mesh simplification with edge collapses ordered by the quadric error metric
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "meshsimplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+using namespace vks;
+using namespace vks::model;
+
+namespace {
+
+// Border edges are held in place by a plane through the edge, perpendicular to its triangle, weighted this much
+// more than the triangle planes
+const float BORDER_WEIGHT = 10.0f;
+// A collapse is skipped if it turns a remaining triangle further than this cosine allows, against its normal
+// before the collapse as well as against its normal in the input, so the turns cannot add up over passes
+const float MIN_NORMAL_COSINE = 0.25f;
+
+// Sum of squared plane distances, weighted by area, as a symmetric 4x4 matrix
+struct Quadric {
+    double a00{ 0 }, a01{ 0 }, a02{ 0 }, a03{ 0 };
+    double a11{ 0 }, a12{ 0 }, a13{ 0 };
+    double a22{ 0 }, a23{ 0 };
+    double a33{ 0 };
+    double weight{ 0 };
+
+    void addPlane(const glm::vec3& normal, float distance, float planeWeight) {
+        const double a = normal.x, b = normal.y, c = normal.z, d = distance, w = planeWeight;
+        a00 += w * a * a, a01 += w * a * b, a02 += w * a * c, a03 += w * a * d;
+        a11 += w * b * b, a12 += w * b * c, a13 += w * b * d;
+        a22 += w * c * c, a23 += w * c * d;
+        a33 += w * d * d;
+        weight += w;
+    }
+
+    void add(const Quadric& other) {
+        a00 += other.a00, a01 += other.a01, a02 += other.a02, a03 += other.a03;
+        a11 += other.a11, a12 += other.a12, a13 += other.a13;
+        a22 += other.a22, a23 += other.a23;
+        a33 += other.a33;
+        weight += other.weight;
+    }
+
+    // Weighted mean of the squared distances of `p` to the planes
+    float error(const Quadric& other, const glm::vec3& p) const {
+        const double x = p.x, y = p.y, z = p.z;
+        const double r = (a00 + other.a00) * x * x + 2 * (a01 + other.a01) * x * y + 2 * (a02 + other.a02) * x * z +
+                         2 * (a03 + other.a03) * x + (a11 + other.a11) * y * y + 2 * (a12 + other.a12) * y * z + 2 * (a13 + other.a13) * y +
+                         (a22 + other.a22) * z * z + 2 * (a23 + other.a23) * z + (a33 + other.a33);
+        const double w = weight + other.weight;
+        return w > 0.0 ? static_cast<float>(std::fabs(r) / w) : 0.0f;
+    }
+};
+
+// Hashes and compares vertices by the bits of their position
+struct PositionHasher {
+    const uint8_t* positions;
+    size_t stride;
+
+    const float* get(uint32_t vertex) const { return reinterpret_cast<const float*>(positions + vertex * stride); }
+
+    size_t operator()(uint32_t vertex) const {
+        uint32_t bits[3];
+        memcpy(bits, get(vertex), sizeof(bits));
+        return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+    }
+
+    bool operator()(uint32_t a, uint32_t b) const { return memcmp(get(a), get(b), 3 * sizeof(float)) == 0; }
+};
+
+struct Collapse {
+    uint32_t from;
+    uint32_t to;
+    float error;
+
+    bool operator<(const Collapse& other) const {
+        if (error != other.error) {
+            return error < other.error;
+        }
+        return from != other.from ? from < other.from : to < other.to;
+    }
+};
+
+}  // namespace
+
+size_t model::simplify(uint32_t* destination,
+                       const uint32_t* indices,
+                       size_t indexCount,
+                       const uint8_t* positions,
+                       size_t positionStride,
+                       uint32_t vertexCount,
+                       size_t targetIndexCount,
+                       float targetError,
+                       float* resultError) {
+    const PositionHasher hasher{ positions, positionStride };
+    auto position = [&](uint32_t vertex) {
+        const float* p = hasher.get(vertex);
+        return glm::vec3(p[0], p[1], p[2]);
+    };
+
+    // Collapses work on the first vertex of every position, the corners refer to the vertices of the input
+    std::vector<uint32_t> welded(vertexCount);
+    {
+        std::unordered_map<uint32_t, uint32_t, PositionHasher, PositionHasher> unique(vertexCount, hasher, hasher);
+        for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+            welded[vertex] = unique.emplace(vertex, vertex).first->second;
+        }
+    }
+    auto degenerate = [&](const uint32_t* corners) {
+        const uint32_t a = welded[corners[0]], b = welded[corners[1]], c = welded[corners[2]];
+        return a == b || b == c || c == a;
+    };
+
+    std::vector<uint32_t> result;
+    result.reserve(indexCount);
+    for (size_t i = 0; i + 2 < indexCount; i += 3) {
+        if (!degenerate(indices + i)) {
+            result.insert(result.end(), indices + i, indices + i + 3);
+        }
+    }
+
+    // Quadrics of the triangle planes, and of the border edges found as the edges only one triangle uses
+    std::vector<Quadric> quadrics(vertexCount);
+    struct Edge {
+        uint64_t key;
+        uint32_t triangle;
+        uint32_t corner;
+    };
+    std::vector<Edge> edges;
+    edges.reserve(result.size());
+    std::vector<glm::vec3> normals(result.size() / 3);
+    for (uint32_t triangle = 0; triangle < result.size() / 3; ++triangle) {
+        const uint32_t* corners = result.data() + triangle * 3;
+        const glm::vec3 p0 = position(corners[0]);
+        const glm::vec3 normal = glm::cross(position(corners[1]) - p0, position(corners[2]) - p0);
+        const float length = glm::length(normal);
+        if (length > 0.0f) {
+            normals[triangle] = normal / length;
+            for (uint32_t k = 0; k < 3; ++k) {
+                quadrics[welded[corners[k]]].addPlane(normals[triangle], -glm::dot(normals[triangle], p0), length * 0.5f);
+            }
+        }
+        for (uint32_t k = 0; k < 3; ++k) {
+            const uint64_t a = welded[corners[k]], b = welded[corners[(k + 1) % 3]];
+            edges.push_back({ std::min(a, b) << 32 | std::max(a, b), triangle, k });
+        }
+    }
+    std::sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) { return a.key < b.key; });
+    for (size_t i = 0; i < edges.size(); ++i) {
+        const bool shared = (i > 0 && edges[i - 1].key == edges[i].key) || (i + 1 < edges.size() && edges[i + 1].key == edges[i].key);
+        if (shared) {
+            continue;
+        }
+        const uint32_t* corners = result.data() + edges[i].triangle * 3;
+        const uint32_t a = welded[corners[edges[i].corner]], b = welded[corners[(edges[i].corner + 1) % 3]];
+        const glm::vec3 pa = position(a), pb = position(b);
+        const glm::vec3 normal = glm::cross(pb - pa, normals[edges[i].triangle]);
+        const float length = glm::length(normal);
+        if (length > 0.0f) {
+            const glm::vec3 borderNormal = normal / length;
+            const float weight = glm::dot(pb - pa, pb - pa) * BORDER_WEIGHT;
+            quadrics[a].addPlane(borderNormal, -glm::dot(borderNormal, pa), weight);
+            quadrics[b].addPlane(borderNormal, -glm::dot(borderNormal, pa), weight);
+        }
+    }
+
+    const float maxError = targetError * targetError;
+    float error = 0.0f;
+    std::vector<uint32_t> adjacencyOffsets(vertexCount + 1), adjacency, remap(vertexCount);
+    std::vector<Collapse> collapses;
+    std::vector<bool> locked(vertexCount);
+    std::vector<uint64_t> keys;
+
+    // Every pass collapses an independent set of the cheapest edges: the vertices around a collapse are locked
+    // for the rest of the pass, so the errors and triangles the later collapses are checked against stay valid
+    while (result.size() > targetIndexCount) {
+        const uint32_t triangleCount = static_cast<uint32_t>(result.size() / 3);
+
+        // Triangles around every welded vertex
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (uint32_t index : result) {
+            ++adjacencyOffsets[welded[index] + 1];
+        }
+        for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+            adjacencyOffsets[vertex + 1] += adjacencyOffsets[vertex];
+        }
+        adjacency.resize(result.size());
+        {
+            std::vector<uint32_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t i = 0; i < result.size(); ++i) {
+                adjacency[fill[welded[result[i]]]++] = static_cast<uint32_t>(i / 3);
+            }
+        }
+
+        // Every edge collapses in the direction with the smaller error
+        keys.clear();
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (uint32_t k = 0; k < 3; ++k) {
+                const uint64_t a = welded[result[i + k]], b = welded[result[i + (k + 1) % 3]];
+                keys.push_back(std::min(a, b) << 32 | std::max(a, b));
+            }
+        }
+        std::sort(keys.begin(), keys.end());
+        keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+        collapses.clear();
+        for (uint64_t key : keys) {
+            const uint32_t a = static_cast<uint32_t>(key >> 32), b = static_cast<uint32_t>(key);
+            const float errorAB = quadrics[a].error(quadrics[b], position(b));
+            const float errorBA = quadrics[a].error(quadrics[b], position(a));
+            collapses.push_back(errorAB <= errorBA ? Collapse{ a, b, errorAB } : Collapse{ b, a, errorBA });
+        }
+        std::sort(collapses.begin(), collapses.end());
+
+        for (uint32_t vertex = 0; vertex < vertexCount; ++vertex) {
+            remap[vertex] = vertex;
+        }
+        std::fill(locked.begin(), locked.end(), false);
+        const size_t removable = (result.size() - targetIndexCount + 2) / 3;
+        size_t removed = 0;
+        uint32_t collapsed = 0;
+        for (const auto& collapse : collapses) {
+            if (collapse.error > maxError || removed >= removable) {
+                break;
+            }
+            if (locked[collapse.from] || locked[collapse.to]) {
+                continue;
+            }
+            const uint32_t* around = adjacency.data() + adjacencyOffsets[collapse.from];
+            const uint32_t aroundCount = adjacencyOffsets[collapse.from + 1] - adjacencyOffsets[collapse.from];
+            auto contains = [&](const uint32_t* corners, uint32_t vertex) {
+                return welded[corners[0]] == vertex || welded[corners[1]] == vertex || welded[corners[2]] == vertex;
+            };
+
+            // The triangles that remain may not turn over
+            const glm::vec3 target = position(collapse.to);
+            bool flips = false;
+            uint32_t removes = 0;
+            for (uint32_t t = 0; t < aroundCount && !flips; ++t) {
+                const uint32_t* corners = result.data() + around[t] * 3;
+                if (contains(corners, collapse.to)) {
+                    ++removes;
+                    continue;
+                }
+                glm::vec3 p[3];
+                for (uint32_t k = 0; k < 3; ++k) {
+                    p[k] = welded[corners[k]] == collapse.from ? target : position(corners[k]);
+                }
+                const glm::vec3 before = glm::cross(position(corners[1]) - position(corners[0]), position(corners[2]) - position(corners[0]));
+                const glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+                flips = glm::dot(before, after) <= MIN_NORMAL_COSINE * glm::length(before) * glm::length(after) ||
+                        glm::dot(normals[around[t]], after) < MIN_NORMAL_COSINE * glm::length(normals[around[t]]) * glm::length(after);
+            }
+            if (flips) {
+                continue;
+            }
+
+            // Every corner of the collapsed position takes a target corner of a triangle they share, or else the
+            // first target corner around
+            uint32_t fallback = ~0u;
+            for (uint32_t pass = 0; pass < 2; ++pass) {
+                for (uint32_t t = 0; t < aroundCount; ++t) {
+                    const uint32_t* corners = result.data() + around[t] * 3;
+                    uint32_t shared = ~0u;
+                    for (uint32_t k = 0; k < 3; ++k) {
+                        if (welded[corners[k]] == collapse.to) {
+                            shared = corners[k];
+                        }
+                    }
+                    if (shared == ~0u && pass == 0) {
+                        continue;
+                    }
+                    if (fallback == ~0u) {
+                        fallback = shared != ~0u ? shared : collapse.to;
+                    }
+                    for (uint32_t k = 0; k < 3; ++k) {
+                        if (welded[corners[k]] == collapse.from && remap[corners[k]] == corners[k]) {
+                            remap[corners[k]] = shared != ~0u ? shared : fallback;
+                        }
+                    }
+                }
+            }
+
+            quadrics[collapse.to].add(quadrics[collapse.from]);
+            locked[collapse.to] = true;
+            for (uint32_t t = 0; t < aroundCount; ++t) {
+                const uint32_t* corners = result.data() + around[t] * 3;
+                for (uint32_t k = 0; k < 3; ++k) {
+                    locked[welded[corners[k]]] = true;
+                }
+            }
+            error = std::max(error, collapse.error);
+            removed += removes;
+            ++collapsed;
+        }
+        if (collapsed == 0) {
+            break;
+        }
+
+        size_t output = 0;
+        for (uint32_t triangle = 0; triangle < triangleCount; ++triangle) {
+            uint32_t corners[3];
+            for (uint32_t k = 0; k < 3; ++k) {
+                corners[k] = remap[result[triangle * 3 + k]];
+            }
+            if (!degenerate(corners)) {
+                memcpy(result.data() + output, corners, sizeof(corners));
+                normals[output / 3] = normals[triangle];
+                output += 3;
+            }
+        }
+        result.resize(output);
+    }
+
+    if (resultError) {
+        *resultError = sqrtf(error);
+    }
+    memcpy(destination, result.data(), result.size() * sizeof(uint32_t));
+    return result.size();
+}
@@ -0,0 +1,33 @@
+/*
+* Mesh simplification with edge collapses ordered by the quadric error metric
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vks { namespace model {
+
+// Reduce a triangle list to at most `targetIndexCount` indices with the edge collapses of Garland and Heckbert,
+// "Surface Simplification Using Quadric Error Metrics".  Every vertex moves onto a neighbour, so the result
+// refers to the vertices of `indices` and can share their buffer.  Vertices with equal positions are collapsed
+// together, a vertex taking the attributes of a target corner it shares a triangle with where there is one.
+// Collapses that would turn a triangle over are skipped, as are the ones with an error above `targetError`, the
+// distance in position units the surface may move.  The collapses are ordered by error with ties broken by
+// vertex numbers, so the result only depends on the input.  `positions` are three floats each,
+// `positionStride` bytes apart.  Returns the index count, and the largest error in `resultError` if given.
+// `destination` may alias `indices`.
+size_t simplify(uint32_t* destination,
+                const uint32_t* indices,
+                size_t indexCount,
+                const uint8_t* positions,
+                size_t positionStride,
+                uint32_t vertexCount,
+                size_t targetIndexCount,
+                float targetError,
+                float* resultError = nullptr);
+
+}}  // namespace vks::model
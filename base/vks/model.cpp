@@ -9,6 +9,10 @@
 #include "model.hpp"
 #include "filesystem.hpp"
 
+#include <chrono>
+
+#include <glm/gtc/packing.hpp>
+
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
@@ -81,21 +85,239 @@ void Model::loadFromFile(const Context& context, const std::string& filename, co
             const aiFace& Face = paiMesh->mFaces[j];
             if (Face.mNumIndices != 3)
                 continue;
-            indexBuffer.push_back(part.indexBase + Face.mIndices[0]);
-            indexBuffer.push_back(part.indexBase + Face.mIndices[1]);
-            indexBuffer.push_back(part.indexBase + Face.mIndices[2]);
+            indexBuffer.push_back(part.vertexBase + Face.mIndices[0]);
+            indexBuffer.push_back(part.vertexBase + Face.mIndices[1]);
+            indexBuffer.push_back(part.vertexBase + Face.mIndices[2]);
             part.indexCount += 3;
         }
         indexCount += part.indexCount;
     }
 
+    optimizationReport = {};
+    if (createInfo.optimization.enabled) {
+        optimizationReport = optimize(layout, createInfo.optimization, vertexBuffer, indexBuffer, parts);
+        vertexCount = optimizationReport.vertexCountAfter;
+    }
+    meshlets.clear();
+    if (createInfo.clusters.enabled) {
+        buildClusters(layout, createInfo.clusters, vertexBuffer, indexBuffer, parts, meshlets);
+    }
+    lods.clear();
+    lodReport = {};
+    if (createInfo.lod.levels > 0) {
+        lodReport = generateLods(layout, createInfo.lod, vertexBuffer, indexBuffer, parts, lods);
+    }
 
     // Vertex buffer
     vertices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertexBuffer);
     // Index buffer
-    indices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indexBuffer);
+    indexType = vk::IndexType::eUint32;
+    vk::BufferUsageFlags indexUsage = vk::BufferUsageFlagBits::eIndexBuffer;
+    if (createInfo.clusters.enabled) {
+        indexUsage |= vk::BufferUsageFlagBits::eStorageBuffer;
+    }
+    // Culling passes read the indices of the clusters as 32 bit values
+    if (createInfo.optimization.enabled && createInfo.optimization.shortIndices && !createInfo.clusters.enabled && vertexCount <= 0x10000) {
+        const std::vector<uint16_t> shortIndexBuffer(indexBuffer.begin(), indexBuffer.end());
+        indexType = vk::IndexType::eUint16;
+        optimizationReport.bytesAfter -= indexBuffer.size() * sizeof(uint16_t);
+        indices = context.stageToDeviceBuffer(indexUsage, shortIndexBuffer);
+    } else {
+        indices = context.stageToDeviceBuffer(indexUsage, indexBuffer);
+    }
 };
 
+OptimizationReport Model::optimize(const VertexLayout& layout,
+                                   const MeshOptimization& optimization,
+                                   std::vector<uint8_t>& vertexData,
+                                   std::vector<uint32_t>& indexData,
+                                   std::vector<ModelPart>& parts) {
+    auto tStart = std::chrono::high_resolution_clock::now();
+    const uint32_t stride = layout.stride();
+    const uint32_t positionIndex = layout.componentIndex(VERTEX_COMPONENT_POSITION);
+
+    OptimizationReport report;
+    report.triangleCount = static_cast<uint32_t>(indexData.size() / 3);
+    report.vertexCountBefore = static_cast<uint32_t>(vertexData.size() / stride);
+    report.cacheBefore = analyzeVertexCache(indexData.data(), indexData.size(), report.vertexCountBefore);
+    report.bytesPerVertex = stride;
+    report.floatBytesPerVertex = layout.floatStride();
+    report.bytesBefore = size_t(report.vertexCountBefore) * report.floatBytesPerVertex + indexData.size() * sizeof(uint32_t);
+
+    std::vector<uint8_t> optimizedVertices;
+    optimizedVertices.reserve(vertexData.size());
+    std::vector<uint8_t> partVertices, scratchVertices;
+    std::vector<uint32_t> scratchIndices, remap;
+    for (auto& part : parts) {
+        // Work on part local vertex numbers
+        uint32_t* indices = indexData.data() + part.indexBase;
+        uint32_t vertexCount = part.vertexCount;
+        for (uint32_t i = 0; i < part.indexCount; ++i) {
+            indices[i] -= part.vertexBase;
+        }
+        const uint8_t* source = vertexData.data() + size_t(part.vertexBase) * stride;
+        partVertices.assign(source, source + size_t(vertexCount) * stride);
+
+        if (optimization.deduplicate) {
+            remap.resize(vertexCount);
+            const uint32_t uniqueCount = generateVertexRemap(remap.data(), indices, part.indexCount, partVertices.data(), vertexCount, stride);
+            scratchVertices.resize(size_t(uniqueCount) * stride);
+            remapVertices(scratchVertices.data(), partVertices.data(), vertexCount, stride, remap.data());
+            remapIndices(indices, part.indexCount, remap.data());
+            partVertices.swap(scratchVertices);
+            vertexCount = uniqueCount;
+        }
+        if (optimization.vertexCache) {
+            scratchIndices.assign(indices, indices + part.indexCount);
+            optimizeVertexCache(indices, scratchIndices.data(), part.indexCount, vertexCount);
+        }
+        if (optimization.overdrawThreshold > 0.0f && positionIndex != static_cast<uint32_t>(-1)) {
+            scratchIndices.assign(indices, indices + part.indexCount);
+            optimizeOverdraw(indices, scratchIndices.data(), part.indexCount, partVertices.data() + layout.offset(positionIndex), stride, vertexCount,
+                             optimization.overdrawThreshold);
+        }
+        if (optimization.vertexFetch) {
+            scratchVertices.resize(size_t(vertexCount) * stride);
+            vertexCount = optimizeVertexFetch(scratchVertices.data(), indices, part.indexCount, partVertices.data(), vertexCount, stride);
+            partVertices.swap(scratchVertices);
+        }
+
+        part.vertexBase = static_cast<uint32_t>(optimizedVertices.size() / stride);
+        part.vertexCount = vertexCount;
+        for (uint32_t i = 0; i < part.indexCount; ++i) {
+            indices[i] += part.vertexBase;
+        }
+        optimizedVertices.insert(optimizedVertices.end(), partVertices.begin(), partVertices.begin() + size_t(vertexCount) * stride);
+    }
+    vertexData.swap(optimizedVertices);
+
+    report.vertexCountAfter = static_cast<uint32_t>(vertexData.size() / stride);
+    report.cacheAfter = analyzeVertexCache(indexData.data(), indexData.size(), report.vertexCountAfter);
+    report.bytesAfter = vertexData.size() + indexData.size() * sizeof(uint32_t);
+    report.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+    return report;
+}
+
+void Model::buildClusters(const VertexLayout& layout,
+                          const ClusterGeneration& generation,
+                          const std::vector<uint8_t>& vertexData,
+                          std::vector<uint32_t>& indexData,
+                          std::vector<ModelPart>& parts,
+                          std::vector<Meshlet>& meshlets) {
+    const uint32_t stride = layout.stride();
+    const uint32_t positionIndex = layout.componentIndex(VERTEX_COMPONENT_POSITION);
+    if (positionIndex == static_cast<uint32_t>(-1)) {
+        return;
+    }
+    std::vector<uint32_t> source;
+    for (auto& part : parts) {
+        // Work on part local vertex numbers
+        source.assign(indexData.begin() + part.indexBase, indexData.begin() + part.indexBase + part.indexCount);
+        for (auto& index : source) {
+            index -= part.vertexBase;
+        }
+        const uint8_t* positions = vertexData.data() + size_t(part.vertexBase) * stride + layout.offset(positionIndex);
+        uint32_t* destination = indexData.data() + part.indexBase;
+        part.meshletBase = static_cast<uint32_t>(meshlets.size());
+        buildMeshlets(meshlets, destination, source.data(), source.size(), positions, stride, part.vertexCount, generation.maxTriangles,
+                      generation.minTriangles);
+        part.meshletCount = static_cast<uint32_t>(meshlets.size()) - part.meshletBase;
+        for (uint32_t m = part.meshletBase; m < meshlets.size(); ++m) {
+            meshlets[m].indexBase += part.indexBase;
+        }
+        for (uint32_t i = 0; i < part.indexCount; ++i) {
+            destination[i] += part.vertexBase;
+        }
+    }
+}
+
+LodReport Model::generateLods(const VertexLayout& layout,
+                              const LodGeneration& generation,
+                              const std::vector<uint8_t>& vertexData,
+                              std::vector<uint32_t>& indexData,
+                              std::vector<ModelPart>& parts,
+                              std::vector<LodRange>& lods) {
+    auto tStart = std::chrono::high_resolution_clock::now();
+    const uint32_t stride = layout.stride();
+    const uint32_t positionIndex = layout.componentIndex(VERTEX_COMPONENT_POSITION);
+    const uint32_t levelCount = generation.levels + 1;
+
+    LodReport report;
+    lods.clear();
+    if (positionIndex == static_cast<uint32_t>(-1)) {
+        return report;
+    }
+    report.levels.resize(levelCount);
+    lods.resize(levelCount);
+    lods[0].indexCount = static_cast<uint32_t>(indexData.size());
+    report.levels[0].triangleCount = lods[0].indexCount / 3;
+
+    // Part local indices of every level above 0, per part
+    std::vector<std::vector<uint32_t>> levelIndices(parts.size() * generation.levels);
+    std::vector<uint32_t> source, scratch;
+    for (size_t p = 0; p < parts.size(); ++p) {
+        auto& part = parts[p];
+        part.lods.assign(levelCount, LodRange{});
+        part.lods[0] = { part.indexBase, part.indexCount, 0.0f };
+
+        source.assign(indexData.begin() + part.indexBase, indexData.begin() + part.indexBase + part.indexCount);
+        for (auto& index : source) {
+            index -= part.vertexBase;
+        }
+        const uint8_t* positions = vertexData.data() + size_t(part.vertexBase) * stride + layout.offset(positionIndex);
+        glm::vec3 lower{ FLT_MAX }, upper{ -FLT_MAX };
+        for (uint32_t vertex = 0; vertex < part.vertexCount; ++vertex) {
+            const glm::vec3& position = *reinterpret_cast<const glm::vec3*>(positions + size_t(vertex) * stride);
+            lower = glm::min(lower, position);
+            upper = glm::max(upper, position);
+        }
+        const float diagonal = part.vertexCount > 0 ? glm::length(upper - lower) : 0.0f;
+
+        const std::vector<uint32_t>* previous = &source;
+        float previousError = 0.0f;
+        double targetTriangles = part.indexCount / 3;
+        for (uint32_t level = 1; level < levelCount; ++level) {
+            targetTriangles *= generation.reduction;
+            auto& indices = levelIndices[p * generation.levels + level - 1];
+            indices.resize(source.size());
+            float error = 0.0f;
+            const size_t count = simplify(indices.data(), source.data(), source.size(), positions, stride, part.vertexCount,
+                                          static_cast<size_t>(targetTriangles) * 3, generation.maxError * diagonal, &error);
+            indices.resize(count);
+            // Simplifying from level 0 again may stop short of the level before when the error limit is reached
+            if (count >= previous->size()) {
+                indices = *previous;
+                error = previousError;
+            } else if (generation.vertexCache) {
+                scratch = indices;
+                optimizeVertexCache(indices.data(), scratch.data(), count, part.vertexCount);
+            }
+            part.lods[level].indexCount = static_cast<uint32_t>(indices.size());
+            part.lods[level].error = error;
+            report.levels[level].error = std::max(report.levels[level].error, error);
+            report.levels[level].relativeError = std::max(report.levels[level].relativeError, diagonal > 0.0f ? error / diagonal : 0.0f);
+            previous = &indices;
+            previousError = error;
+        }
+    }
+
+    for (uint32_t level = 1; level < levelCount; ++level) {
+        lods[level].indexBase = static_cast<uint32_t>(indexData.size());
+        for (size_t p = 0; p < parts.size(); ++p) {
+            auto& part = parts[p];
+            part.lods[level].indexBase = static_cast<uint32_t>(indexData.size());
+            for (uint32_t index : levelIndices[p * generation.levels + level - 1]) {
+                indexData.push_back(index + part.vertexBase);
+            }
+            lods[level].error = std::max(lods[level].error, part.lods[level].error);
+        }
+        lods[level].indexCount = static_cast<uint32_t>(indexData.size()) - lods[level].indexBase;
+        report.levels[level].triangleCount = lods[level].indexCount / 3;
+    }
+    report.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+    return report;
+}
+
 void Model::appendVertex(std::vector<uint8_t>& outputBuffer, const aiScene* pScene, uint32_t meshIndex, uint32_t vertexIndex) {
     static const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
     const aiMesh* paiMesh = pScene->mMeshes[meshIndex];
@@ -107,60 +329,60 @@ void Model::appendVertex(std::vector<uint8_t>& outputBuffer, const aiScene* pSce
     const aiVector3D* pTexCoord = (paiMesh->HasTextureCoords(0)) ? &(paiMesh->mTextureCoords[0][j]) : &Zero3D;
     const aiVector3D* pTangent = (paiMesh->HasTangentsAndBitangents()) ? &(paiMesh->mTangents[j]) : &Zero3D;
     const aiVector3D* pBiTangent = (paiMesh->HasTangentsAndBitangents()) ? &(paiMesh->mBitangents[j]) : &Zero3D;
-    std::vector<float> vertexBuffer;
     glm::vec3 scaledPos{ pPos->x, -pPos->y, pPos->z };
     scaledPos *= scale;
     scaledPos += center;
 
-    // preallocate float buffer with approximate size
-    vertexBuffer.reserve(layout.components.size() * 4);
+    const glm::vec3 normal{ pNormal->x, -pNormal->y, pNormal->z };
+    const glm::vec3 tangent{ pTangent->x, pTangent->y, pTangent->z };
+    const glm::vec3 bitangent{ pBiTangent->x, pBiTangent->y, pBiTangent->z };
+    const glm::vec2 uv{ pTexCoord->x * uvscale.s, pTexCoord->y * uvscale.t };
+
     for (auto& component : layout.components) {
         switch (component) {
             case VERTEX_COMPONENT_POSITION:
-                vertexBuffer.push_back(scaledPos.x);
-                vertexBuffer.push_back(scaledPos.y);
-                vertexBuffer.push_back(scaledPos.z);
+                appendOutput(outputBuffer, scaledPos);
                 break;
             case VERTEX_COMPONENT_NORMAL:
-                vertexBuffer.push_back(pNormal->x);
-                vertexBuffer.push_back(-pNormal->y);
-                vertexBuffer.push_back(pNormal->z);
+                appendOutput(outputBuffer, normal);
                 break;
             case VERTEX_COMPONENT_UV:
-                vertexBuffer.push_back(pTexCoord->x * uvscale.s);
-                vertexBuffer.push_back(pTexCoord->y * uvscale.t);
+                appendOutput(outputBuffer, uv);
                 break;
             case VERTEX_COMPONENT_COLOR:
-                vertexBuffer.push_back(pColor.r);
-                vertexBuffer.push_back(pColor.g);
-                vertexBuffer.push_back(pColor.b);
+                appendOutput(outputBuffer, glm::vec3(pColor.r, pColor.g, pColor.b));
                 break;
             case VERTEX_COMPONENT_TANGENT:
-                vertexBuffer.push_back(pTangent->x);
-                vertexBuffer.push_back(pTangent->y);
-                vertexBuffer.push_back(pTangent->z);
+                appendOutput(outputBuffer, tangent);
                 break;
             case VERTEX_COMPONENT_BITANGENT:
-                vertexBuffer.push_back(pBiTangent->x);
-                vertexBuffer.push_back(pBiTangent->y);
-                vertexBuffer.push_back(pBiTangent->z);
+                appendOutput(outputBuffer, bitangent);
                 break;
             // Dummy components for padding
             case VERTEX_COMPONENT_DUMMY_INT:
             case VERTEX_COMPONENT_DUMMY_FLOAT:
-                vertexBuffer.push_back(0.0f);
+                appendOutput(outputBuffer, 0.0f);
                 break;
             case VERTEX_COMPONENT_DUMMY_INT4:
             case VERTEX_COMPONENT_DUMMY_UINT4:
             case VERTEX_COMPONENT_DUMMY_VEC4:
-                vertexBuffer.push_back(0.0f);
-                vertexBuffer.push_back(0.0f);
-                vertexBuffer.push_back(0.0f);
-                vertexBuffer.push_back(0.0f);
+                appendOutput(outputBuffer, glm::vec4(0.0f));
+                break;
+            // Quantized components
+            case VERTEX_COMPONENT_NORMAL_SNORM16:
+                appendOutput(outputBuffer, glm::packSnorm4x16(glm::vec4(normal, 0.0f)));
+                break;
+            case VERTEX_COMPONENT_TANGENT_SNORM16:
+                appendOutput(outputBuffer, glm::packSnorm4x16(glm::vec4(tangent, 0.0f)));
+                break;
+            case VERTEX_COMPONENT_BITANGENT_SNORM16:
+                appendOutput(outputBuffer, glm::packSnorm4x16(glm::vec4(bitangent, 0.0f)));
+                break;
+            case VERTEX_COMPONENT_UV_HALF:
+                appendOutput(outputBuffer, glm::packHalf2x16(uv));
                 break;
         };
     }
-    appendOutput(outputBuffer, vertexBuffer);
 
     dim.max = glm::max(scaledPos, dim.max);
     dim.min = glm::min(scaledPos, dim.min);
@@ -14,6 +14,9 @@
 
 #include "buffer.hpp"
 #include "context.hpp"
+#include "meshoptimizer.hpp"
+#include "meshsimplifier.hpp"
+#include "meshlets.hpp"
 
 struct aiScene;
 namespace Assimp {
@@ -36,6 +39,12 @@ enum Component
     VERTEX_COMPONENT_DUMMY_VEC4 = 0x8,
     VERTEX_COMPONENT_DUMMY_INT4 = 0x9,
     VERTEX_COMPONENT_DUMMY_UINT4 = 0xA,
+    // Quantized variants of the components above: unit vectors as 16 bit signed normalized values with w = 0,
+    // texture coordinates as half floats.  Shaders read them through the same vec3 / vec2 inputs.
+    VERTEX_COMPONENT_NORMAL_SNORM16 = 0xB,
+    VERTEX_COMPONENT_TANGENT_SNORM16 = 0xC,
+    VERTEX_COMPONENT_BITANGENT_SNORM16 = 0xD,
+    VERTEX_COMPONENT_UV_HALF = 0xE,
 };
 
 /** @brief Stores vertex layout components for model loading and Vulkan vertex input and atribute bindings  */
@@ -70,6 +79,12 @@ public:
                 return vk::Format::eR32G32B32A32Sint;
             case VERTEX_COMPONENT_DUMMY_UINT4:
                 return vk::Format::eR32G32B32A32Uint;
+            case VERTEX_COMPONENT_NORMAL_SNORM16:
+            case VERTEX_COMPONENT_TANGENT_SNORM16:
+            case VERTEX_COMPONENT_BITANGENT_SNORM16:
+                return vk::Format::eR16G16B16A16Snorm;
+            case VERTEX_COMPONENT_UV_HALF:
+                return vk::Format::eR16G16Sfloat;
             default:
                 return vk::Format::eR32G32B32Sfloat;
         }
@@ -89,12 +104,32 @@ public:
                 return 4 * sizeof(int32_t);
             case VERTEX_COMPONENT_DUMMY_UINT4:
                 return 4 * sizeof(uint32_t);
+            case VERTEX_COMPONENT_NORMAL_SNORM16:
+            case VERTEX_COMPONENT_TANGENT_SNORM16:
+            case VERTEX_COMPONENT_BITANGENT_SNORM16:
+                return 4 * sizeof(int16_t);
+            case VERTEX_COMPONENT_UV_HALF:
+                return 2 * sizeof(uint16_t);
             default:
                 // All components except the ones listed above are made up of 3 floats
                 return 3 * sizeof(float);
         }
     }
 
+    // Size of the component stored as 32 bit floats, to measure what the quantized components save
+    static uint32_t floatComponentSize(Component component) {
+        switch (component) {
+            case VERTEX_COMPONENT_NORMAL_SNORM16:
+            case VERTEX_COMPONENT_TANGENT_SNORM16:
+            case VERTEX_COMPONENT_BITANGENT_SNORM16:
+                return 3 * sizeof(float);
+            case VERTEX_COMPONENT_UV_HALF:
+                return 2 * sizeof(float);
+            default:
+                return componentSize(component);
+        }
+    }
+
     uint32_t stride() const {
         uint32_t res = 0;
         for (auto& component : components) {
@@ -103,6 +138,14 @@ public:
         return res;
     }
 
+    uint32_t floatStride() const {
+        uint32_t res = 0;
+        for (auto& component : components) {
+            res += floatComponentSize(component);
+        }
+        return res;
+    }
+
     uint32_t offset(uint32_t index) const {
         uint32_t res = 0;
         assert(index < components.size());
@@ -113,11 +156,83 @@ public:
     }
 };
 
+/** @brief Optional load time optimization of the vertex and index buffers, see meshoptimizer.hpp */
+struct MeshOptimization {
+    bool enabled{ false };
+    // Merge vertices whose attributes are identical
+    bool deduplicate{ true };
+    bool vertexCache{ true };
+    // Reorder triangle clusters for less overdraw, letting the ACMR grow by at most this factor.  0 disables it.
+    float overdrawThreshold{ 1.05f };
+    bool vertexFetch{ true };
+    // Store 16 bit indices if the model has few enough vertices.  Bind the index buffer with Model::indexType.
+    bool shortIndices{ false };
+};
+
+/** @brief Effect of the mesh optimization on the buffers of a model */
+struct OptimizationReport {
+    uint32_t triangleCount{ 0 };
+    uint32_t vertexCountBefore{ 0 };
+    uint32_t vertexCountAfter{ 0 };
+    CacheStatistics cacheBefore;
+    CacheStatistics cacheAfter;
+    // Stride of the layout, and of the same components stored as 32 bit floats
+    uint32_t bytesPerVertex{ 0 };
+    uint32_t floatBytesPerVertex{ 0 };
+    // Buffer sizes of the unoptimized float vertices with 32 bit indices and of the result
+    size_t bytesBefore{ 0 };
+    size_t bytesAfter{ 0 };
+    double milliseconds{ 0.0 };
+};
+
+/** @brief Optional load time split of the parts into clusters for GPU culling, see meshlets.hpp */
+struct ClusterGeneration {
+    bool enabled{ false };
+    uint32_t maxTriangles{ 124 };
+    uint32_t minTriangles{ 64 };
+};
+
+/** @brief Optional load time generation of discrete levels of detail, see meshsimplifier.hpp */
+struct LodGeneration {
+    // Levels added to the loaded mesh, 0 disables the generation
+    uint32_t levels{ 0 };
+    // Triangles of every level relative to the level before
+    float reduction{ 0.5f };
+    // Largest error of a level, relative to the bounding box diagonal of its part.  A level that reaches it
+    // keeps the triangles it got to, so the following levels may repeat it.
+    float maxError{ 0.05f };
+    // Reorder the triangles of every level for the post transform cache
+    bool vertexCache{ true };
+};
+
+/** @brief Index range of a level of detail, drawn with the vertices of the level 0 mesh */
+struct LodRange {
+    uint32_t indexBase{ 0 };
+    uint32_t indexCount{ 0 };
+    // Largest distance the simplification moved the surface, in model units
+    float error{ 0.0f };
+};
+
+/** @brief Triangle counts and errors of the generated levels of a model, level 0 being the loaded mesh */
+struct LodReport {
+    struct Level {
+        uint32_t triangleCount{ 0 };
+        // Largest error of the parts, in model units and relative to the bounding box diagonal of the part
+        float error{ 0.0f };
+        float relativeError{ 0.0f };
+    };
+    std::vector<Level> levels;
+    double milliseconds{ 0.0 };
+};
+
 /** @brief Used to parametrize model loading */
 struct ModelCreateInfo {
     glm::vec3 center{ 0 };
     glm::vec3 scale{ 1 };
     glm::vec2 uvscale{ 1 };
+    MeshOptimization optimization;
+    ClusterGeneration clusters;
+    LodGeneration lod;
 
     ModelCreateInfo() = default;
 
@@ -136,6 +251,7 @@ struct Model {
     Buffer indices;
     uint32_t indexCount = 0;
     uint32_t vertexCount = 0;
+    vk::IndexType indexType = vk::IndexType::eUint32;
     VertexLayout layout;
     glm::vec3 scale{ 1.0f };
     glm::vec3 center{ 0.0f };
@@ -148,8 +264,24 @@ struct Model {
         uint32_t vertexCount;
         uint32_t indexBase;
         uint32_t indexCount;
+        // Clusters of the level 0 triangles, in Model::meshlets
+        uint32_t meshletBase;
+        uint32_t meshletCount;
+        // Levels of detail, level 0 being the range above.  Empty unless ModelCreateInfo::lod requested levels.
+        std::vector<LodRange> lods;
     };
     std::vector<ModelPart> parts;
+    // Clusters of all parts, with index ranges into the index buffer.  Filled in if the model was loaded with
+    // ModelCreateInfo::clusters enabled, which also gives the index buffer storage buffer usage for culling
+    // passes that read it.
+    std::vector<Meshlet> meshlets;
+    // Index ranges of the levels of detail of the whole model.  The index buffer holds all parts of level 0,
+    // followed by all parts of every further level, so indexCount still covers level 0 only.
+    std::vector<LodRange> lods;
+    // Filled in if the model was loaded with ModelCreateInfo::optimization enabled
+    OptimizationReport optimizationReport;
+    // Filled in if the model was loaded with levels of detail
+    LodReport lodReport;
 
     static const int defaultFlags;
 
@@ -195,6 +327,40 @@ struct Model {
         loadFromFile(context, filename, layout, ModelCreateInfo{ scale, 1.0f, 0.0f }, flags);
     }
 
+    /**
+    * Optimize vertices and indices built with `layout`, e.g. at load or bake time.  Every part is processed on
+    * its own and keeps its index range, its vertices stay consecutive starting at its vertexBase.  The report
+    * counts 32 bit indices, the caller decides on the index type.
+    */
+    static OptimizationReport optimize(const VertexLayout& layout,
+                                       const MeshOptimization& optimization,
+                                       std::vector<uint8_t>& vertexData,
+                                       std::vector<uint32_t>& indexData,
+                                       std::vector<ModelPart>& parts);
+
+    /**
+    * Reorder the level 0 triangles of every part into clusters and append them to `meshlets`, with index
+    * ranges relative to the start of `indexData`.  Fills in ModelPart::meshletBase and meshletCount.
+    */
+    static void buildClusters(const VertexLayout& layout,
+                              const ClusterGeneration& generation,
+                              const std::vector<uint8_t>& vertexData,
+                              std::vector<uint32_t>& indexData,
+                              std::vector<ModelPart>& parts,
+                              std::vector<Meshlet>& meshlets);
+
+    /**
+    * Append `generation.levels` levels of detail of every part to `indexData`, simplified from the level 0
+    * triangles of the part and sharing its vertices.  The levels are stored one after the other, every level
+    * holding the ranges of all parts in their order.  Fills in ModelPart::lods and `lods`.
+    */
+    static LodReport generateLods(const VertexLayout& layout,
+                                  const LodGeneration& generation,
+                                  const std::vector<uint8_t>& vertexData,
+                                  std::vector<uint32_t>& indexData,
+                                  std::vector<ModelPart>& parts,
+                                  std::vector<LodRange>& lods);
+
     virtual void onLoad(const Context& context, Assimp::Importer& importer, const aiScene* pScene) {}
 
     virtual void appendVertex(std::vector<uint8_t>& outputBuffer, const aiScene* pScene, uint32_t meshIndex, uint32_t vertexIndex);
@@ -192,5 +192,21 @@ public:
     }
 
     vk::Pipeline create() { return create(pipelineCache); }
+
+    // Create a pipeline with the given specialization applied to every shader stage in `stages`.
+    // Leaves the builder untouched, so once update() has been called this may be invoked from several
+    // threads at once (see vks::pipelines::PipelineVariantCache)
+    vk::Pipeline createSpecialized(const vk::PipelineCache& cache, vk::ShaderStageFlags stages, const vk::SpecializationInfo& specializationInfo) const {
+        auto specializedStages = shaderStages;
+        for (auto& shaderStage : specializedStages) {
+            if (stages & shaderStage.stage) {
+                shaderStage.pSpecializationInfo = &specializationInfo;
+            }
+        }
+        auto specializedCreateInfo = pipelineCreateInfo;
+        specializedCreateInfo.stageCount = static_cast<uint32_t>(specializedStages.size());
+        specializedCreateInfo.pStages = specializedStages.data();
+        return device.createGraphicsPipeline(cache, specializedCreateInfo);
+    }
 };
 }}  // namespace vks::pipelines
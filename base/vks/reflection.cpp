@@ -0,0 +1,588 @@
+/*
+* SPIR-V reflection for descriptor set layouts, push constants and vertex inputs
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include "reflection.hpp"
+#include "storage.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+using namespace vks;
+using namespace vks::reflection;
+
+namespace {
+
+// The subset of the SPIR-V grammar needed to recover the resource interface of a module
+namespace spv {
+const uint32_t MagicNumber = 0x07230203;
+
+enum Op : uint32_t
+{
+    OpEntryPoint = 15,
+    OpTypeBool = 20,
+    OpTypeInt = 21,
+    OpTypeFloat = 22,
+    OpTypeVector = 23,
+    OpTypeMatrix = 24,
+    OpTypeImage = 25,
+    OpTypeSampler = 26,
+    OpTypeSampledImage = 27,
+    OpTypeArray = 28,
+    OpTypeRuntimeArray = 29,
+    OpTypeStruct = 30,
+    OpTypePointer = 32,
+    OpConstant = 43,
+    OpSpecConstant = 50,
+    OpVariable = 59,
+    OpDecorate = 71,
+    OpMemberDecorate = 72,
+    OpTypeAccelerationStructure = 5341,
+};
+
+enum Decoration : uint32_t
+{
+    Block = 2,
+    BufferBlock = 3,
+    ArrayStride = 6,
+    MatrixStride = 7,
+    BuiltIn = 11,
+    Location = 30,
+    Binding = 33,
+    DescriptorSet = 34,
+    Offset = 35,
+};
+
+enum StorageClass : uint32_t
+{
+    UniformConstant = 0,
+    Input = 1,
+    Uniform = 2,
+    PushConstant = 9,
+    StorageBuffer = 12,
+};
+
+enum Dim : uint32_t
+{
+    DimBuffer = 5,
+    DimSubpassData = 6,
+};
+}  // namespace spv
+
+struct Instruction {
+    uint32_t op{ 0 };
+    // Operand words following the result id
+    const uint32_t* operands{ nullptr };
+    uint32_t operandCount{ 0 };
+};
+
+using Decorations = std::unordered_map<uint32_t, uint32_t>;
+
+struct Module {
+    vk::ShaderStageFlagBits stage{ vk::ShaderStageFlagBits::eVertex };
+    std::string entryPoint;
+    std::unordered_map<uint32_t, Instruction> types;
+    std::unordered_map<uint32_t, uint32_t> constants;
+    std::unordered_map<uint32_t, Decorations> decorations;
+    std::unordered_map<uint64_t, Decorations> memberDecorations;
+    // result type, result id, storage class
+    std::vector<std::array<uint32_t, 3>> variables;
+
+    static uint64_t memberKey(uint32_t id, uint32_t member) { return (uint64_t(id) << 32) | member; }
+
+    bool hasDecoration(uint32_t id, spv::Decoration decoration) const {
+        auto itr = decorations.find(id);
+        return itr != decorations.end() && itr->second.count(decoration) != 0;
+    }
+
+    uint32_t decoration(uint32_t id, spv::Decoration decoration, uint32_t defaultValue = 0) const {
+        auto itr = decorations.find(id);
+        if (itr == decorations.end()) {
+            return defaultValue;
+        }
+        auto valueItr = itr->second.find(decoration);
+        return valueItr == itr->second.end() ? defaultValue : valueItr->second;
+    }
+
+    uint32_t memberDecoration(uint32_t id, uint32_t member, spv::Decoration decoration, uint32_t defaultValue = 0) const {
+        auto itr = memberDecorations.find(memberKey(id, member));
+        if (itr == memberDecorations.end()) {
+            return defaultValue;
+        }
+        auto valueItr = itr->second.find(decoration);
+        return valueItr == itr->second.end() ? defaultValue : valueItr->second;
+    }
+
+    const Instruction& type(uint32_t id) const {
+        auto itr = types.find(id);
+        if (itr == types.end()) {
+            throw std::runtime_error("SPIR-V reflection: unknown type id " + std::to_string(id));
+        }
+        return itr->second;
+    }
+
+    // Length of an array type.  Lengths given by a specialization constant are its default value, lengths computed from
+    // specialization constants are unknown and the array is treated like a runtime array.
+    bool arrayLength(const Instruction& t, uint32_t& length) const {
+        auto itr = constants.find(t.operands[1]);
+        if (itr == constants.end()) {
+            return false;
+        }
+        length = itr->second;
+        return true;
+    }
+
+    // Size in bytes of a type as laid out in a buffer block.  Runtime arrays contribute nothing.
+    uint32_t typeSize(uint32_t id, uint32_t matrixStride = 0) const {
+        const auto& t = type(id);
+        switch (t.op) {
+            case spv::OpTypeBool:
+                return 4;
+            case spv::OpTypeInt:
+            case spv::OpTypeFloat:
+                return t.operands[0] / 8;
+            case spv::OpTypeVector:
+                return t.operands[1] * typeSize(t.operands[0]);
+            case spv::OpTypeMatrix:
+                return t.operands[1] * (matrixStride ? matrixStride : typeSize(t.operands[0]));
+            case spv::OpTypeArray: {
+                uint32_t length = 0;
+                if (!arrayLength(t, length)) {
+                    return 0;
+                }
+                uint32_t stride = decoration(id, spv::ArrayStride);
+                return length * (stride ? stride : typeSize(t.operands[0], matrixStride));
+            }
+            case spv::OpTypeRuntimeArray:
+                return 0;
+            case spv::OpTypeStruct: {
+                uint32_t end = 0;
+                uint32_t offset = 0;
+                for (uint32_t member = 0; member < t.operandCount; ++member) {
+                    offset = memberDecoration(id, member, spv::Offset, offset);
+                    offset += typeSize(t.operands[member], memberDecoration(id, member, spv::MatrixStride));
+                    end = std::max(end, offset);
+                }
+                return end;
+            }
+            default:
+                throw std::runtime_error("SPIR-V reflection: cannot size type with opcode " + std::to_string(t.op));
+        }
+    }
+
+    // Strip (possibly nested) arrays from a type, accumulating the total element count
+    uint32_t unwrapArrays(uint32_t id, uint32_t& count) const {
+        count = 1;
+        for (;;) {
+            const auto& t = type(id);
+            uint32_t length = 0;
+            if (t.op == spv::OpTypeArray && arrayLength(t, length)) {
+                count *= length;
+            } else if (t.op != spv::OpTypeArray && t.op != spv::OpTypeRuntimeArray) {
+                return id;
+            }
+            // Runtime (unbounded) arrays, and arrays of unknown length, are reported with a count of one, callers
+            // wanting a bindless table need to size the binding themselves
+            id = t.operands[0];
+        }
+    }
+
+    vk::DescriptorType descriptorType(uint32_t typeId, spv::StorageClass storageClass) const {
+        const auto& t = type(typeId);
+        switch (storageClass) {
+            case spv::StorageBuffer:
+                return vk::DescriptorType::eStorageBuffer;
+            case spv::Uniform:
+                // Pre SPIR-V 1.3 GLSL compilers mark storage buffers as BufferBlock in the Uniform storage class
+                return hasDecoration(typeId, spv::BufferBlock) ? vk::DescriptorType::eStorageBuffer : vk::DescriptorType::eUniformBuffer;
+            default:
+                break;
+        }
+
+        switch (t.op) {
+            case spv::OpTypeSampledImage:
+                return vk::DescriptorType::eCombinedImageSampler;
+            case spv::OpTypeSampler:
+                return vk::DescriptorType::eSampler;
+            case spv::OpTypeImage: {
+                // sampled type, dim, depth, arrayed, ms, sampled, format
+                const auto dim = t.operands[1];
+                const auto sampled = t.operands[5];
+                if (dim == spv::DimSubpassData) {
+                    return vk::DescriptorType::eInputAttachment;
+                } else if (dim == spv::DimBuffer) {
+                    return sampled == 2 ? vk::DescriptorType::eStorageTexelBuffer : vk::DescriptorType::eUniformTexelBuffer;
+                }
+                return sampled == 2 ? vk::DescriptorType::eStorageImage : vk::DescriptorType::eSampledImage;
+            }
+            case spv::OpTypeAccelerationStructure:
+                return vk::DescriptorType::eAccelerationStructureNV;
+            default:
+                throw std::runtime_error("SPIR-V reflection: unsupported descriptor type with opcode " + std::to_string(t.op));
+        }
+    }
+
+    vk::Format vertexFormat(uint32_t id, uint32_t& size) const {
+        const auto& t = type(id);
+        uint32_t componentCount = 1;
+        const Instruction* component = &t;
+        if (t.op == spv::OpTypeVector) {
+            componentCount = t.operands[1];
+            component = &type(t.operands[0]);
+        }
+        size = componentCount * (component->operands[0] / 8);
+
+        static const vk::Format floatFormats[] = { vk::Format::eR32Sfloat, vk::Format::eR32G32Sfloat, vk::Format::eR32G32B32Sfloat,
+                                                   vk::Format::eR32G32B32A32Sfloat };
+        static const vk::Format doubleFormats[] = { vk::Format::eR64Sfloat, vk::Format::eR64G64Sfloat, vk::Format::eR64G64B64Sfloat,
+                                                    vk::Format::eR64G64B64A64Sfloat };
+        static const vk::Format intFormats[] = { vk::Format::eR32Sint, vk::Format::eR32G32Sint, vk::Format::eR32G32B32Sint, vk::Format::eR32G32B32A32Sint };
+        static const vk::Format uintFormats[] = { vk::Format::eR32Uint, vk::Format::eR32G32Uint, vk::Format::eR32G32B32Uint, vk::Format::eR32G32B32A32Uint };
+
+        if (componentCount < 1 || componentCount > 4) {
+            throw std::runtime_error("SPIR-V reflection: unsupported vertex input vector size");
+        }
+        if (component->op == spv::OpTypeFloat) {
+            return component->operands[0] == 64 ? doubleFormats[componentCount - 1] : floatFormats[componentCount - 1];
+        } else if (component->op == spv::OpTypeInt && component->operands[0] == 32) {
+            return component->operands[1] ? intFormats[componentCount - 1] : uintFormats[componentCount - 1];
+        }
+        throw std::runtime_error("SPIR-V reflection: unsupported vertex input type with opcode " + std::to_string(component->op));
+    }
+};
+
+vk::ShaderStageFlagBits stageForExecutionModel(uint32_t executionModel) {
+    switch (executionModel) {
+        case 0:
+            return vk::ShaderStageFlagBits::eVertex;
+        case 1:
+            return vk::ShaderStageFlagBits::eTessellationControl;
+        case 2:
+            return vk::ShaderStageFlagBits::eTessellationEvaluation;
+        case 3:
+            return vk::ShaderStageFlagBits::eGeometry;
+        case 4:
+            return vk::ShaderStageFlagBits::eFragment;
+        case 5:
+            return vk::ShaderStageFlagBits::eCompute;
+        default:
+            throw std::runtime_error("SPIR-V reflection: unsupported execution model " + std::to_string(executionModel));
+    }
+}
+
+Module parse(const uint32_t* code, size_t wordCount) {
+    if (wordCount < 5 || code[0] != spv::MagicNumber) {
+        throw std::runtime_error("SPIR-V reflection: invalid module header");
+    }
+
+    Module module;
+    bool foundEntryPoint = false;
+    for (size_t i = 5; i < wordCount;) {
+        const uint32_t op = code[i] & 0xffff;
+        const uint32_t length = code[i] >> 16;
+        if (length == 0 || i + length > wordCount) {
+            throw std::runtime_error("SPIR-V reflection: truncated instruction");
+        }
+        const uint32_t* words = code + i;
+
+        switch (op) {
+            case spv::OpEntryPoint:
+                // Modules with several entry points are reflected through the first one
+                if (!foundEntryPoint) {
+                    foundEntryPoint = true;
+                    module.stage = stageForExecutionModel(words[1]);
+                    module.entryPoint = reinterpret_cast<const char*>(words + 3);
+                }
+                break;
+            case spv::OpTypeBool:
+            case spv::OpTypeInt:
+            case spv::OpTypeFloat:
+            case spv::OpTypeVector:
+            case spv::OpTypeMatrix:
+            case spv::OpTypeImage:
+            case spv::OpTypeSampler:
+            case spv::OpTypeSampledImage:
+            case spv::OpTypeArray:
+            case spv::OpTypeRuntimeArray:
+            case spv::OpTypeStruct:
+            case spv::OpTypeAccelerationStructure:
+                module.types[words[1]] = Instruction{ op, words + 2, length - 2 };
+                break;
+            case spv::OpTypePointer:
+                // Pointers are recorded as their pointee so lookups transparently see through them
+                module.types[words[1]] = Instruction{ op, words + 2, length - 2 };
+                break;
+            case spv::OpConstant:
+            case spv::OpSpecConstant:
+                module.constants[words[2]] = words[3];
+                break;
+            case spv::OpVariable:
+                module.variables.push_back({ words[1], words[2], words[3] });
+                break;
+            case spv::OpDecorate:
+                module.decorations[words[1]][words[2]] = length > 3 ? words[3] : 0;
+                break;
+            case spv::OpMemberDecorate:
+                module.memberDecorations[Module::memberKey(words[1], words[2])][words[3]] = length > 4 ? words[4] : 0;
+                break;
+            default:
+                break;
+        }
+        i += length;
+    }
+
+    if (!foundEntryPoint) {
+        throw std::runtime_error("SPIR-V reflection: module has no entry point");
+    }
+    return module;
+}
+
+}  // namespace
+
+ShaderReflection vks::reflection::reflect(const uint32_t* code, size_t wordCount) {
+    const Module module = parse(code, wordCount);
+
+    ShaderReflection result;
+    result.stage = module.stage;
+    result.entryPoint = module.entryPoint;
+
+    for (const auto& variable : module.variables) {
+        const uint32_t id = variable[1];
+        const auto storageClass = static_cast<spv::StorageClass>(variable[2]);
+        // OpTypePointer operands: storage class, pointee type
+        const uint32_t pointeeId = module.type(variable[0]).operands[1];
+
+        switch (storageClass) {
+            case spv::UniformConstant:
+            case spv::Uniform:
+            case spv::StorageBuffer: {
+                vk::DescriptorSetLayoutBinding binding;
+                uint32_t elementId = module.unwrapArrays(pointeeId, binding.descriptorCount);
+                binding.binding = module.decoration(id, spv::Binding);
+                binding.descriptorType = module.descriptorType(elementId, storageClass);
+                binding.stageFlags = module.stage;
+                result.sets[module.decoration(id, spv::DescriptorSet)].push_back(binding);
+                break;
+            }
+            case spv::PushConstant: {
+                const auto& block = module.type(pointeeId);
+                uint32_t begin = UINT32_MAX;
+                for (uint32_t member = 0; member < block.operandCount; ++member) {
+                    begin = std::min(begin, module.memberDecoration(pointeeId, member, spv::Offset));
+                }
+                if (begin == UINT32_MAX) {
+                    begin = 0;
+                }
+                const uint32_t end = module.typeSize(pointeeId);
+                result.pushConstantRanges.push_back({ module.stage, begin, end - begin });
+                break;
+            }
+            case spv::Input: {
+                if (module.stage != vk::ShaderStageFlagBits::eVertex || module.hasDecoration(id, spv::BuiltIn) || !module.hasDecoration(id, spv::Location)) {
+                    break;
+                }
+                uint32_t location = module.decoration(id, spv::Location);
+                const auto& inputType = module.type(pointeeId);
+                // Matrix inputs occupy one location per column
+                uint32_t columnType = pointeeId;
+                uint32_t columns = 1;
+                if (inputType.op == spv::OpTypeMatrix) {
+                    columnType = inputType.operands[0];
+                    columns = inputType.operands[1];
+                }
+                for (uint32_t column = 0; column < columns; ++column) {
+                    VertexInput input;
+                    input.location = location + column;
+                    input.format = module.vertexFormat(columnType, input.size);
+                    result.vertexInputs.push_back(input);
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    for (auto& set : result.sets) {
+        std::sort(set.second.begin(), set.second.end(),
+                  [](const vk::DescriptorSetLayoutBinding& a, const vk::DescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+    }
+    std::sort(result.vertexInputs.begin(), result.vertexInputs.end(), [](const VertexInput& a, const VertexInput& b) { return a.location < b.location; });
+    return result;
+}
+
+ShaderReflection vks::reflection::reflectFile(const std::string& filename) {
+    auto storage = storage::Storage::readFile(filename);
+    std::vector<uint32_t> code(storage->size() / sizeof(uint32_t));
+    memcpy(code.data(), storage->data(), code.size() * sizeof(uint32_t));
+    return reflect(code);
+}
+
+PipelineReflection& PipelineReflection::add(const ShaderReflection& shader) {
+    for (const auto& shaderSet : shader.sets) {
+        auto& bindings = sets[shaderSet.first];
+        for (const auto& shaderBinding : shaderSet.second) {
+            auto itr = std::find_if(bindings.begin(), bindings.end(),
+                                    [&](const vk::DescriptorSetLayoutBinding& binding) { return binding.binding == shaderBinding.binding; });
+            if (itr == bindings.end()) {
+                bindings.push_back(shaderBinding);
+                continue;
+            }
+            if (itr->descriptorType != shaderBinding.descriptorType || itr->descriptorCount != shaderBinding.descriptorCount) {
+                throw std::runtime_error("SPIR-V reflection: stages disagree on set " + std::to_string(shaderSet.first) + " binding " +
+                                         std::to_string(shaderBinding.binding));
+            }
+            itr->stageFlags |= shaderBinding.stageFlags;
+        }
+        std::sort(bindings.begin(), bindings.end(),
+                  [](const vk::DescriptorSetLayoutBinding& a, const vk::DescriptorSetLayoutBinding& b) { return a.binding < b.binding; });
+    }
+
+    for (const auto& shaderRange : shader.pushConstantRanges) {
+        auto itr = std::find_if(pushConstantRanges.begin(), pushConstantRanges.end(), [&](const vk::PushConstantRange& range) {
+            return range.offset == shaderRange.offset && range.size == shaderRange.size;
+        });
+        if (itr == pushConstantRanges.end()) {
+            pushConstantRanges.push_back(shaderRange);
+        } else {
+            itr->stageFlags |= shaderRange.stageFlags;
+        }
+    }
+
+    if (!shader.vertexInputs.empty()) {
+        vertexInputs = shader.vertexInputs;
+    }
+    return *this;
+}
+
+PipelineReflection& PipelineReflection::overrideDescriptorType(uint32_t set, uint32_t binding, vk::DescriptorType descriptorType) {
+    auto& bindings = sets.at(set);
+    auto itr = std::find_if(bindings.begin(), bindings.end(), [&](const vk::DescriptorSetLayoutBinding& b) { return b.binding == binding; });
+    if (itr == bindings.end()) {
+        throw std::runtime_error("SPIR-V reflection: no binding " + std::to_string(binding) + " in set " + std::to_string(set));
+    }
+    itr->descriptorType = descriptorType;
+    return *this;
+}
+
+std::vector<vk::DescriptorPoolSize> PipelineReflection::poolSizes(uint32_t copies) const {
+    std::map<vk::DescriptorType, uint32_t> counts;
+    for (const auto& set : sets) {
+        for (const auto& binding : set.second) {
+            counts[binding.descriptorType] += binding.descriptorCount * copies;
+        }
+    }
+    std::vector<vk::DescriptorPoolSize> result;
+    result.reserve(counts.size());
+    for (const auto& count : counts) {
+        result.push_back({ count.first, count.second });
+    }
+    return result;
+}
+
+vk::DescriptorPool PipelineReflection::createDescriptorPool(const vk::Device& device, uint32_t copies, vk::DescriptorPoolCreateFlags flags) const {
+    auto sizes = poolSizes(copies);
+    const uint32_t maxSets = std::max<uint32_t>(1, static_cast<uint32_t>(sets.size()) * copies);
+    return device.createDescriptorPool({ flags, maxSets, static_cast<uint32_t>(sizes.size()), sizes.data() });
+}
+
+std::vector<vk::VertexInputAttributeDescription> PipelineReflection::vertexAttributes(uint32_t binding) const {
+    std::vector<vk::VertexInputAttributeDescription> result;
+    result.reserve(vertexInputs.size());
+    uint32_t offset = 0;
+    for (const auto& input : vertexInputs) {
+        result.push_back({ input.location, binding, input.format, offset });
+        offset += input.size;
+    }
+    return result;
+}
+
+uint32_t PipelineReflection::vertexStride() const {
+    uint32_t stride = 0;
+    for (const auto& input : vertexInputs) {
+        stride += input.size;
+    }
+    return stride;
+}
+
+size_t LayoutCache::KeyHash::operator()(const Key& key) const {
+    // FNV-1a over the key words
+    uint64_t hash = 14695981039346656037ULL;
+    for (const auto& word : key) {
+        hash ^= word;
+        hash *= 1099511628211ULL;
+    }
+    return static_cast<size_t>(hash);
+}
+
+vk::DescriptorSetLayout LayoutCache::getSetLayout(const BindingList& bindings) {
+    Key key;
+    key.reserve(bindings.size() * 4);
+    for (const auto& binding : bindings) {
+        key.push_back(binding.binding);
+        key.push_back(static_cast<uint64_t>(binding.descriptorType));
+        key.push_back(binding.descriptorCount);
+        key.push_back(static_cast<VkShaderStageFlags>(binding.stageFlags));
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    auto itr = setLayouts.find(key);
+    if (itr != setLayouts.end()) {
+        return itr->second;
+    }
+    auto layout = device.createDescriptorSetLayout({ {}, static_cast<uint32_t>(bindings.size()), bindings.data() });
+    setLayouts.insert({ key, layout });
+    return layout;
+}
+
+std::vector<vk::DescriptorSetLayout> LayoutCache::getSetLayouts(const PipelineReflection& reflection) {
+    std::vector<vk::DescriptorSetLayout> result;
+    result.reserve(reflection.setCount());
+    for (uint32_t set = 0; set < reflection.setCount(); ++set) {
+        auto itr = reflection.sets.find(set);
+        result.push_back(getSetLayout(itr == reflection.sets.end() ? BindingList{} : itr->second));
+    }
+    return result;
+}
+
+vk::PipelineLayout LayoutCache::getPipelineLayout(const PipelineReflection& reflection) {
+    const auto layouts = getSetLayouts(reflection);
+
+    Key key;
+    for (const auto& layout : layouts) {
+        uint64_t handle = 0;
+        VkDescriptorSetLayout rawLayout = layout;
+        memcpy(&handle, &rawLayout, sizeof(rawLayout));
+        key.push_back(handle);
+    }
+    for (const auto& range : reflection.pushConstantRanges) {
+        key.push_back(static_cast<VkShaderStageFlags>(range.stageFlags));
+        key.push_back((uint64_t(range.offset) << 32) | range.size);
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    auto itr = pipelineLayouts.find(key);
+    if (itr != pipelineLayouts.end()) {
+        return itr->second;
+    }
+    auto pipelineLayout = device.createPipelineLayout({ {}, static_cast<uint32_t>(layouts.size()), layouts.data(),
+                                                        static_cast<uint32_t>(reflection.pushConstantRanges.size()), reflection.pushConstantRanges.data() });
+    pipelineLayouts.insert({ key, pipelineLayout });
+    return pipelineLayout;
+}
+
+void LayoutCache::destroy() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (const auto& entry : pipelineLayouts) {
+        device.destroyPipelineLayout(entry.second);
+    }
+    pipelineLayouts.clear();
+    for (const auto& entry : setLayouts) {
+        device.destroyDescriptorSetLayout(entry.second);
+    }
+    setLayouts.clear();
+}
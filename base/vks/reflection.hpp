@@ -0,0 +1,128 @@
+/*
+* SPIR-V reflection for descriptor set layouts, push constants and vertex inputs
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <initializer_list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+namespace vks { namespace reflection {
+
+using BindingList = std::vector<vk::DescriptorSetLayoutBinding>;
+// Descriptor set index -> bindings in that set, ordered by binding number
+using SetBindings = std::map<uint32_t, BindingList>;
+
+/** @brief A vertex shader input attribute */
+struct VertexInput {
+    uint32_t location;
+    vk::Format format;
+    uint32_t size;
+};
+
+/** @brief Interface of a single shader stage as declared in its SPIR-V */
+struct ShaderReflection {
+    vk::ShaderStageFlagBits stage{ vk::ShaderStageFlagBits::eVertex };
+    std::string entryPoint;
+    SetBindings sets;
+    std::vector<vk::PushConstantRange> pushConstantRanges;
+    // Only populated for vertex shaders, sorted by location
+    std::vector<VertexInput> vertexInputs;
+};
+
+/**
+* Parse a SPIR-V module
+*
+* Only the resources still present in the module are reported, so anything the optimizer stripped
+* because it was never used will not show up in the reflected layout.
+*
+* Arrays sized by a specialization constant are reported with its default value, a pipeline that specializes
+* the constant needs to adjust the descriptor count or push constant range itself.
+*
+* @throws std::runtime_error if the code is not a valid SPIR-V module
+*/
+ShaderReflection reflect(const uint32_t* code, size_t wordCount);
+
+inline ShaderReflection reflect(const std::vector<uint32_t>& code) {
+    return reflect(code.data(), code.size());
+}
+
+ShaderReflection reflectFile(const std::string& filename);
+
+/** @brief Merged interface of all the stages of a pipeline */
+struct PipelineReflection {
+    SetBindings sets;
+    std::vector<vk::PushConstantRange> pushConstantRanges;
+    std::vector<VertexInput> vertexInputs;
+
+    PipelineReflection() = default;
+    PipelineReflection(std::initializer_list<ShaderReflection> shaders) {
+        for (const auto& shader : shaders) {
+            add(shader);
+        }
+    }
+
+    // Merge a stage into the pipeline interface.  Bindings shared between stages have their stage flags combined.
+    // @throws std::runtime_error if two stages disagree on the type or count of a binding
+    PipelineReflection& add(const ShaderReflection& shader);
+
+    PipelineReflection& addFile(const std::string& filename) { return add(reflectFile(filename)); }
+
+    // SPIR-V cannot tell dynamic uniform or storage buffers apart from static ones, so those need to be flagged by hand
+    PipelineReflection& overrideDescriptorType(uint32_t set, uint32_t binding, vk::DescriptorType descriptorType);
+
+    // Number of set layouts a pipeline layout needs (the highest set index used plus one)
+    uint32_t setCount() const { return sets.empty() ? 0 : sets.rbegin()->first + 1; }
+
+    // Pool sizes for allocating `copies` instances of every set of this pipeline
+    std::vector<vk::DescriptorPoolSize> poolSizes(uint32_t copies = 1) const;
+
+    vk::DescriptorPool createDescriptorPool(const vk::Device& device, uint32_t copies = 1, vk::DescriptorPoolCreateFlags flags = {}) const;
+
+    // Tightly packed attribute descriptions for all vertex inputs, sourced from a single binding
+    std::vector<vk::VertexInputAttributeDescription> vertexAttributes(uint32_t binding = 0) const;
+    uint32_t vertexStride() const;
+};
+
+/**
+* @brief Deduplicating cache of descriptor set layouts and pipeline layouts
+*
+* Layouts are keyed on the contents of their bindings (and push constant ranges for pipeline layouts),
+* so every pipeline with the same interface shares the same Vulkan objects.  All objects are owned by
+* the cache and released by destroy().
+*/
+class LayoutCache {
+public:
+    LayoutCache(const vk::Device& device)
+        : device(device) {}
+
+    vk::DescriptorSetLayout getSetLayout(const BindingList& bindings);
+
+    // Set layouts for sets 0..setCount()-1, with empty layouts filling any unused set indices
+    std::vector<vk::DescriptorSetLayout> getSetLayouts(const PipelineReflection& reflection);
+
+    vk::PipelineLayout getPipelineLayout(const PipelineReflection& reflection);
+
+    void destroy();
+
+private:
+    using Key = std::vector<uint64_t>;
+    struct KeyHash {
+        size_t operator()(const Key& key) const;
+    };
+
+    const vk::Device& device;
+    std::mutex mutex;
+    std::unordered_map<Key, vk::DescriptorSetLayout, KeyHash> setLayouts;
+    std::unordered_map<Key, vk::PipelineLayout, KeyHash> pipelineLayouts;
+};
+
+}}  // namespace vks::reflection
@@ -0,0 +1,200 @@
+/*
+* Typed specialization constants and pipeline variant caching
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <future>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <vulkan/vulkan.hpp>
+
+// Build a map entry for a member of a specialization data struct from its offset and size, so the
+// entry can never drift out of sync with the struct definition
+#define VKS_SPECIALIZATION_ENTRY(CONSTANT_ID, TYPE, MEMBER) \
+    vk::SpecializationMapEntry { CONSTANT_ID, static_cast<uint32_t>(offsetof(TYPE, MEMBER)), sizeof(TYPE::MEMBER) }
+
+namespace vks { namespace pipelines {
+
+/**
+* @brief Describes how the members of a host side struct map onto the specialization constants of a shader
+*
+* Entries are either given explicitly (see VKS_SPECIALIZATION_ENTRY) or derived from a list of member
+* pointers, in which case the constant IDs are assigned in the order the members are listed:
+*
+*   struct Data { uint32_t lightingModel; float toonDesaturationFactor; };
+*   SpecializationLayout<Data> layout{ &Data::lightingModel, &Data::toonDesaturationFactor };
+*
+* matches a shader declaring
+*
+*   layout (constant_id = 0) const int LIGHTING_MODEL = 0;
+*   layout (constant_id = 1) const float PARAM_TOON_DESATURATION = 0.0f;
+*/
+template <typename T>
+class SpecializationLayout {
+    static_assert(std::is_trivially_copyable<T>::value, "Specialization data must be trivially copyable");
+    static_assert(std::is_default_constructible<T>::value, "Specialization data must be default constructible");
+
+public:
+    SpecializationLayout(std::initializer_list<vk::SpecializationMapEntry> entries)
+        : mapEntries(entries) {}
+
+    template <typename... Members>
+    SpecializationLayout(Members T::*... members) {
+        mapEntries.reserve(sizeof...(members));
+        append(members...);
+    }
+
+    const std::vector<vk::SpecializationMapEntry>& entries() const { return mapEntries; }
+
+    // The returned info references both this layout and the given values, both must outlive any pipeline creation using it
+    vk::SpecializationInfo info(const T& values) const {
+        return vk::SpecializationInfo{ static_cast<uint32_t>(mapEntries.size()), mapEntries.data(), sizeof(T), &values };
+    }
+
+    // Packs only the bytes referenced by the map entries, so struct padding never leaks into variant keys
+    std::string key(const T& values) const {
+        std::string result;
+        const char* data = reinterpret_cast<const char*>(&values);
+        for (const auto& entry : mapEntries) {
+            result.append(data + entry.offset, entry.size);
+        }
+        return result;
+    }
+
+private:
+    template <typename M>
+    static uint32_t memberOffset(M T::*member) {
+        // offsetof does not accept member pointers, so measure against a probe instance instead
+        static const T probe{};
+        return static_cast<uint32_t>(reinterpret_cast<const char*>(&(probe.*member)) - reinterpret_cast<const char*>(&probe));
+    }
+
+    void append() {}
+
+    template <typename M, typename... Members>
+    void append(M T::*member, Members T::*... members) {
+        static_assert(std::is_arithmetic<M>::value, "Specialization constants must be scalar values");
+        mapEntries.push_back({ static_cast<uint32_t>(mapEntries.size()), memberOffset(member), sizeof(M) });
+        append(members...);
+    }
+
+    std::vector<vk::SpecializationMapEntry> mapEntries;
+};
+
+/**
+* @brief Caches pipelines keyed on the values of their specialization constants
+*
+* Every distinct set of constant values is compiled exactly once.  Lookups for a variant that is still
+* being compiled (for instance by prewarm()) block until that compilation finishes rather than
+* starting a second one.  The factory receives the specialization info to apply and must be safe to
+* call from a background thread (see GraphicsPipelineBuilder::createSpecialized).
+*/
+template <typename T>
+class PipelineVariantCache {
+public:
+    using Factory = std::function<vk::Pipeline(const vk::SpecializationInfo&)>;
+
+    PipelineVariantCache(const vk::Device& device, const SpecializationLayout<T>& layout, const Factory& factory)
+        : device(device)
+        , layout(layout)
+        , factory(factory) {}
+
+    PipelineVariantCache(const PipelineVariantCache&) = delete;
+    PipelineVariantCache& operator=(const PipelineVariantCache&) = delete;
+
+    ~PipelineVariantCache() { destroy(); }
+
+    // Fetch the pipeline for the given constant values, compiling it on first use
+    vk::Pipeline get(const T& values) {
+        const auto key = layout.key(values);
+        std::shared_future<vk::Pipeline> variant;
+        std::promise<vk::Pipeline> promise;
+        bool owner = false;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            auto itr = variants.find(key);
+            if (itr == variants.end()) {
+                variant = promise.get_future().share();
+                variants.insert({ key, variant });
+                owner = true;
+            } else {
+                variant = itr->second;
+            }
+        }
+
+        if (owner) {
+            try {
+                promise.set_value(factory(layout.info(values)));
+            } catch (...) {
+                // Forget the failed variant so a later request can retry it
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    variants.erase(key);
+                }
+                promise.set_exception(std::current_exception());
+            }
+        }
+        return variant.get();
+    }
+
+    // Compile the given variants on a background thread so later calls to get() find them ready
+    void prewarm(const std::vector<T>& likelyValues) {
+        std::unique_lock<std::mutex> lock(mutex);
+        prewarmTasks.push_back(std::async(std::launch::async, [this, likelyValues] {
+            for (const auto& values : likelyValues) {
+                try {
+                    get(values);
+                } catch (...) {
+                    // Failures resurface when the variant is actually requested
+                }
+            }
+        }));
+    }
+
+    // Block until all pending prewarm requests have completed
+    void wait() {
+        std::vector<std::future<void>> tasks;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            tasks.swap(prewarmTasks);
+        }
+        for (auto& task : tasks) {
+            task.get();
+        }
+    }
+
+    size_t size() const {
+        std::unique_lock<std::mutex> lock(mutex);
+        return variants.size();
+    }
+
+    void destroy() {
+        wait();
+        std::unique_lock<std::mutex> lock(mutex);
+        for (auto& variant : variants) {
+            device.destroyPipeline(variant.second.get());
+        }
+        variants.clear();
+    }
+
+private:
+    const vk::Device& device;
+    const SpecializationLayout<T> layout;
+    const Factory factory;
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::shared_future<vk::Pipeline>> variants;
+    std::vector<std::future<void>> prewarmTasks;
+};
+
+}}  // namespace vks::pipelines
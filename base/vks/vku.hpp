@@ -1135,7 +1135,10 @@ public:
     }
 
     /// Set the compute shader module.
-    ComputePipelineMaker& module(const vk::PipelineShaderStageCreateInfo& value) { stage_ = value; }
+    ComputePipelineMaker& module(const vk::PipelineShaderStageCreateInfo& value) {
+        stage_ = value;
+        return *this;
+    }
 
     /// Create a managed handle to a compute shader.
     vk::UniquePipeline createUnique(vk::Device device, const vk::PipelineCache& pipelineCache, const vk::PipelineLayout& pipelineLayout) {
@@ -1147,6 +1150,21 @@ public:
         return device.createComputePipelineUnique(pipelineCache, pipelineInfo);
     }
 
+    /// Create an unmanaged compute pipeline with the given specialization constants.
+    /// This does not modify the maker, so it may be called from several threads at once (see vks::pipelines::PipelineVariantCache).
+    vk::Pipeline createSpecialized(vk::Device device,
+                                   const vk::PipelineCache& pipelineCache,
+                                   const vk::PipelineLayout& pipelineLayout,
+                                   const vk::SpecializationInfo& specializationInfo) const {
+        vk::ComputePipelineCreateInfo pipelineInfo{};
+
+        pipelineInfo.stage = stage_;
+        pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
+        pipelineInfo.layout = pipelineLayout;
+
+        return device.createComputePipeline(pipelineCache, pipelineInfo);
+    }
+
 private:
     vk::PipelineShaderStageCreateInfo stage_;
 };
@@ -39,6 +39,7 @@ ExampleBase::~ExampleBase() {
     if (descriptorPool) {
         device.destroyDescriptorPool(descriptorPool);
     }
+    descriptorAllocator.destroy();
     if (!commandBuffers.empty()) {
         device.freeCommandBuffers(cmdPool, commandBuffers);
         commandBuffers.clear();
@@ -387,7 +388,7 @@ void ExampleBase::setupDepthStencil() {
     depthStencilCreateInfo.format = depthFormat;
     depthStencilCreateInfo.mipLevels = 1;
     depthStencilCreateInfo.arrayLayers = 1;
-    depthStencilCreateInfo.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransferSrc;
+    depthStencilCreateInfo.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eTransferSrc | depthStencilUsage;
     depthStencil = context.createImage(depthStencilCreateInfo);
 
     context.setImageLayout(depthStencil.image, aspect, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal);
@@ -446,7 +447,7 @@ void ExampleBase::setupRenderPass() {
     // Depth attachment
     attachments[1].format = depthFormat;
     attachments[1].loadOp = vk::AttachmentLoadOp::eClear;
-    attachments[1].storeOp = vk::AttachmentStoreOp::eDontCare;
+    attachments[1].storeOp = (depthStencilUsage & vk::ImageUsageFlagBits::eSampled) ? vk::AttachmentStoreOp::eStore : vk::AttachmentStoreOp::eDontCare;
     attachments[1].stencilLoadOp = vk::AttachmentLoadOp::eClear;
     attachments[1].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
     attachments[1].initialLayout = vk::ImageLayout::eUndefined;
@@ -518,6 +519,9 @@ void ExampleBase::drawCurrentCommandBuffer() {
         context.dumpster.push_back([fenceIndex, this] { swapChain.clearSubmitFence(fenceIndex); });
     }
 
+    // Transient descriptor pools used by this frame are reset once its fence signals
+    descriptorAllocator.endFrame();
+
     // Command buffer(s) to be sumitted to the queue
     context.emptyDumpster(fence);
     {
@@ -629,6 +633,9 @@ void ExampleBase::windowResize(const glm::uvec2& newSize) {
     setupFrameBuffer();
     setupRenderPassBeginInfo();
 
+    // The device is idle, so cached sets can be dropped right away and are allocated again as they are requested
+    descriptorAllocator.clearCache();
+
     if (settings.overlay) {
         ui.resize(size, framebuffers);
     }
@@ -16,12 +16,17 @@
 #include "vks/model.hpp"
 #include "vks/shaders.hpp"
 #include "vks/pipelines.hpp"
+#include "vks/specialization.hpp"
+#include "vks/reflection.hpp"
+#include "vks/descriptors.hpp"
+#include "vks/bindless.hpp"
 #include "vks/texture.hpp"
 
 #include "ui.hpp"
 #include "utils.hpp"
 #include "camera.hpp"
 #include "compute.hpp"
+#include "renderqueue.hpp"
 
 #if defined(__ANDROID__)
 #include "AndroidNativeApp.hpp"
@@ -119,7 +124,7 @@ protected:
     std::vector<vk::Framebuffer> framebuffers;
     // Active frame buffer index
     uint32_t currentBuffer = 0;
-    // Descriptor set pool
+    // Descriptor pool of examples that size their own, other sets come from descriptorAllocator
     vk::DescriptorPool descriptorPool;
 
     void addRenderWaitSemaphore(const vk::Semaphore& semaphore, const vk::PipelineStageFlags& waitStages = vk::PipelineStageFlagBits::eBottomOfPipe);
@@ -134,7 +139,10 @@ protected:
     const vk::Queue& queue{ context.queue };
     const vk::PhysicalDeviceFeatures& deviceFeatures{ context.deviceFeatures };
     vk::PhysicalDeviceFeatures& enabledFeatures{ context.enabledFeatures };
-    vkx::ui::UIOverlay ui{ context };
+    // Per-frame and cached descriptor sets, recycled as submitted frames retire.  The cached sets are dropped when the
+    // window is resized, so sets referencing size dependent resources are fetched again in windowResized().
+    vks::DescriptorAllocator descriptorAllocator{ context };
+    vkx::ui::UIOverlay ui{ context, descriptorAllocator };
 
     vk::SurfaceKHR surface;
     // Wraps the swap chain to present images (framebuffers) to the windowing system
@@ -211,6 +219,9 @@ protected:
     std::string title = "Vulkan Example";
     std::string name = "vulkanExample";
     vks::Image depthStencil;
+    // Usage of the depth attachment on top of the default one, set before prepare().  Sampled depth attachments
+    // are also stored at the end of the render pass, for examples that read the depth of the last frame.
+    vk::ImageUsageFlags depthStencilUsage;
 
     // Gamepad state (only one pad supported)
     struct {
@@ -7,6 +7,7 @@
 #  See the accompanying file LICENSE or http://www.apache.org/licenses/LICENSE-2.0.html
 # 
 
+# Further arguments are files the shader includes, it is compiled again when they change
 function(COMPILE_SPIRV_SHADER SHADER_FILE)
     # Define the final name of the generated shader file
     find_program(GLSLANG_EXECUTABLE glslangValidator
@@ -20,7 +21,7 @@ function(COMPILE_SPIRV_SHADER SHADER_FILE)
     add_custom_command(
         OUTPUT ${COMPILE_OUTPUT} 
         COMMAND ${GLSLANG_EXECUTABLE} -V ${SHADER_FILE} -o ${COMPILE_OUTPUT} 
-        DEPENDS ${SHADER_FILE})
+        DEPENDS ${SHADER_FILE} ${ARGN})
     add_custom_command(
         OUTPUT ${OPTIMIZE_OUTPUT} 
         COMMAND ${SPIRV_OPT_EXECUTABLE} -O ${COMPILE_OUTPUT} -o ${OPTIMIZE_OUTPUT} 
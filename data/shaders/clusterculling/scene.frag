@@ -0,0 +1,20 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (location = 0) in vec3 inNormal;
+layout (location = 1) in vec3 inColor;
+layout (location = 2) in vec3 inViewVec;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main()
+{
+	// Headlight, so the surfaces facing the camera are lit
+	vec3 N = normalize(inNormal);
+	vec3 V = normalize(inViewVec);
+	vec3 ambient = vec3(0.2);
+	vec3 diffuse = vec3(abs(dot(N, V)));
+	outFragColor = vec4((ambient + 0.8 * diffuse) * inColor, 1.0);
+}
@@ -0,0 +1,32 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec3 inColor;
+
+layout (binding = 0) uniform UBO
+{
+	mat4 projection;
+	mat4 view;
+} ubo;
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec3 outViewVec;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+void main()
+{
+	outColor = inColor;
+	vec4 viewPos = ubo.view * vec4(inPos, 1.0);
+	outNormal = mat3(ubo.view) * inNormal;
+	outViewVec = -viewPos.xyz;
+	gl_Position = ubo.projection * viewPos;
+}
@@ -0,0 +1,91 @@
+// Clustered lighting : Declarations shared by the passes of vkx::ClusteredLighting and the shading passes that
+// read its lists.  A shading pass includes them with
+//
+//     #extension GL_GOOGLE_include_directive : require
+//     #define CLUSTERED_LIGHTING_BINDING 4
+//     #include "../clusteredlighting/clusteredlighting.glsl"
+//
+// where CLUSTERED_LIGHTING_BINDING is the `firstBinding` given to vkx::ClusteredLighting::descriptorBindings().
+// It declares the uniform buffer, the view space lights, the offset and count of every cluster and the list of
+// light indices at consecutive bindings from there, and clusterIndex() to find the cluster of a position.
+// The compute passes of vkx::ClusteredLighting only define CLUSTERED_LIGHTING_UBO_BINDING, for the uniform buffer,
+// and declare their buffers themselves.
+
+// Same layout as vkx::ClusteredLighting::Light (std430)
+struct ClusteredLight
+{
+	vec3 position;
+	float range;
+	vec3 color;
+	float spotCosInner;
+	vec3 direction;
+	// Below -1 for point lights
+	float spotCosOuter;
+};
+
+#if defined(CLUSTERED_LIGHTING_BINDING)
+#define CLUSTERED_LIGHTING_UBO_BINDING CLUSTERED_LIGHTING_BINDING
+#endif
+
+#if defined(CLUSTERED_LIGHTING_UBO_BINDING)
+// Camera, grid and light count
+layout (binding = CLUSTERED_LIGHTING_UBO_BINDING) uniform ClusterUBO
+{
+	mat4 view;
+	mat4 projection;
+	uvec3 gridSize;
+	uint lightCount;
+	float sliceScale;
+	float sliceBias;
+	uint maxLightsPerCluster;
+	uint maxIndices;
+} clusterUbo;
+#endif
+
+#if defined(CLUSTERED_LIGHTING_BINDING)
+// Lights in view space
+layout (binding = CLUSTERED_LIGHTING_BINDING + 1, std430) readonly buffer ClusteredLights
+{
+	ClusteredLight clusteredLights[ ];
+};
+
+// Offset and count of every cluster
+layout (binding = CLUSTERED_LIGHTING_BINDING + 2, std430) readonly buffer Clusters
+{
+	uvec2 clusters[ ];
+};
+
+// Light indices of all clusters
+layout (binding = CLUSTERED_LIGHTING_BINDING + 3, std430) readonly buffer Indices
+{
+	uint lightIndices[ ];
+};
+
+// Cluster of a view space position, same cells as vkx::ClusteredLighting.  Its lights are
+// clusteredLights[lightIndices[clusters[cluster].x + i]] for i below clusters[cluster].y.
+uint clusterIndex(vec3 position)
+{
+	vec4 clip = clusterUbo.projection * vec4(position, 1.0);
+	vec2 tile = (clip.xy / clip.w * 0.5 + 0.5) * vec2(clusterUbo.gridSize.xy);
+	float slice = log(-position.z) * clusterUbo.sliceScale + clusterUbo.sliceBias;
+	uvec3 cell = uvec3(clamp(ivec3(tile, slice), ivec3(0), ivec3(clusterUbo.gridSize) - 1));
+	return (cell.z * clusterUbo.gridSize.y + cell.y) * clusterUbo.gridSize.x + cell.x;
+}
+#endif
+
+// Inverse square falloff, faded to zero at the range of the light
+float lightFalloff(ClusteredLight light, float dist)
+{
+	float window = clamp(1.0 - pow(dist / light.range, 4.0), 0.0, 1.0);
+	return window * window / (dist * dist + 1.0);
+}
+
+// Spot lights fade out between their inner and outer cone, L points from the shaded position to the light
+float spotFade(ClusteredLight light, vec3 L)
+{
+	if (light.spotCosOuter < -1.0)
+	{
+		return 1.0;
+	}
+	return smoothstep(light.spotCosOuter, light.spotCosInner, dot(-L, light.direction));
+}
@@ -0,0 +1,21 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (binding = 3) uniform sampler2D samplerColorMap;
+layout (binding = 4) uniform sampler2D samplerGradientRamp;
+
+layout (location = 0) in vec4 inColor;
+layout (location = 1) in float inAge;
+
+layout (location = 0) out vec4 outFragColor;
+
+void main () 
+{
+	vec3 color = texture(samplerGradientRamp, vec2(inAge, 0.0)).rgb * inColor.rgb;
+	// The sprite is used as a gray scale mask
+	float alpha = texture(samplerColorMap, gl_PointCoord).r * inColor.a * (1.0 - inAge);
+	// Premultiplied alpha, usable with additive as well as over blending
+	outFragColor = vec4(color * alpha, alpha);
+}
@@ -0,0 +1,57 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Pulls the particles from the storage buffers of the GPU particle system, drawn with the vertex count its
+// compute passes wrote to the indirect draw arguments
+
+struct Particle
+{
+	vec4 position;	// xyz, w = age
+	vec4 velocity;	// xyz, w = lifetime
+	vec4 color;
+};
+
+struct Entry
+{
+	float depth;
+	uint index;
+};
+
+layout (binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 view;
+	vec2 viewportDim;
+	float pointSize;
+} ubo;
+
+layout(std430, binding = 1) readonly buffer Particles 
+{
+	Particle particles[ ];
+};
+
+layout(std430, binding = 2) readonly buffer AliveList 
+{
+	Entry alive[ ];
+};
+
+layout (location = 0) out vec4 outColor;
+layout (location = 1) out float outAge;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+	float gl_PointSize;
+};
+
+void main () 
+{
+	Particle particle = particles[alive[gl_VertexIndex].index];
+	outColor = particle.color;
+	outAge = particle.position.w / particle.velocity.w;
+	gl_Position = ubo.projection * ubo.view * vec4(particle.position.xyz, 1.0);
+	// World space size, shrinking with distance
+	gl_PointSize = max(1.0, 0.5 * ubo.pointSize * ubo.viewportDim.y * ubo.projection[1][1] / gl_Position.w);
+}
@@ -2,6 +2,7 @@
 
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
+#extension GL_GOOGLE_include_directive : require
 
 layout (binding = 1) uniform sampler2D samplerposition;
 layout (binding = 2) uniform sampler2D samplerNormal;
@@ -11,58 +12,44 @@ layout (location = 0) in vec2 inUV;
 
 layout (location = 0) out vec4 outFragcolor;
 
-struct Light {
-    vec4 position;
-    vec4 color;
-	float radius;
-	float quadraticFalloff;
-	float linearFalloff;
-	float _pad;
-};
-
-layout (binding = 4) uniform UBO 
-{
-	Light lights[6];
-	vec4 viewPos;
-} ubo;
+// Clustered lights in view space at bindings 4 - 7
+#define CLUSTERED_LIGHTING_BINDING 4
+#include "../clusteredlighting/clusteredlighting.glsl"
 
+#define ambient 0.05
+#define specularStrength 0.15
 
 void main() 
 {
-    // Get G-Buffer values
-    vec3 fragPos = texture(samplerposition, inUV).rgb;
-    vec3 normal = texture(samplerNormal, inUV).rgb;
-    vec4 albedo = texture(samplerAlbedo, inUV);
-    
-	#define lightCount 5
-	#define ambient 0.05
-	#define specularStrength 0.15
-	
+	// Get G-Buffer values
+	vec3 fragPos = texture(samplerposition, inUV).rgb;
+	vec3 normal = texture(samplerNormal, inUV).rgb;
+	vec4 albedo = texture(samplerAlbedo, inUV);
+
+	// Light in view space.  Positions are stored with y flipped, normals are not, see mrt.vert
+	vec3 position = vec3(clusterUbo.view * vec4(fragPos, 1.0));
+	vec3 N = normalize(mat3(clusterUbo.view) * (normal * vec3(1.0, -1.0, 1.0)));
+	vec3 viewVec = normalize(-position);
+
 	// Ambient part
-    vec3 fragcolor  = albedo.rgb * ambient;
-	
-    vec3 viewVec = normalize(ubo.viewPos.xyz - fragPos);
-	
-    for(int i = 0; i < lightCount; ++i)
-    {
-        // Distance from light to fragment position
-        float dist = length(ubo.lights[i].position.xyz - fragPos);
-		
-        if(dist < ubo.lights[i].radius)
-        {
-			// Get vector from current light source to fragment position
-            vec3 lightVec = normalize(ubo.lights[i].position.xyz - fragPos);
-            // Diffuse part
-            vec3 diffuse = max(dot(normal, lightVec), 0.0) * albedo.rgb * ubo.lights[i].color.rgb;
-            // Specular part (specular texture part stored in albedo alpha channel)
-            vec3 halfVec = normalize(lightVec + viewVec);  
-            vec3 specular = ubo.lights[i].color.rgb * pow(max(dot(normal, halfVec), 0.0), 16.0) * albedo.a * specularStrength;
-            // Attenuation with linearFalloff and quadraticFalloff falloff
-            float attenuation = 1.0 / (1.0 + ubo.lights[i].linearFalloff * dist + ubo.lights[i].quadraticFalloff * dist * dist);
-            fragcolor += (diffuse + specular) * attenuation;
-        }
-		
-    }    	
-   
-  outFragcolor = vec4(fragcolor, 1.0);	
-}
\ No newline at end of file
+	vec3 fragcolor  = albedo.rgb * ambient;
+
+	// Only the lights that reach the cluster of the fragment
+	uvec2 cluster = clusters[clusterIndex(position)];
+	for (uint i = 0; i < cluster.y; ++i)
+	{
+		ClusteredLight light = clusteredLights[lightIndices[cluster.x + i]];
+		// Distance from light to fragment position
+		vec3 lightVec = light.position - position;
+		float dist = length(lightVec);
+		lightVec = normalize(lightVec);
+		// Diffuse part
+		vec3 diffuse = max(dot(N, lightVec), 0.0) * albedo.rgb * light.color;
+		// Specular part (specular texture part stored in albedo alpha channel)
+		vec3 halfVec = normalize(lightVec + viewVec);
+		vec3 specular = light.color * pow(max(dot(N, halfVec), 0.0), 16.0) * albedo.a * specularStrength;
+		fragcolor += (diffuse + specular) * lightFalloff(light, dist) * spotFade(light, lightVec);
+	}
+
+	outFragcolor = vec4(fragcolor, 1.0);
+}
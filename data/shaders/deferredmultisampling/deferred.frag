@@ -2,6 +2,7 @@
 
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
+#extension GL_GOOGLE_include_directive : require
 
 layout (binding = 1) uniform sampler2DMS samplerPosition;
 layout (binding = 2) uniform sampler2DMS samplerNormal;
@@ -11,23 +12,12 @@ layout (location = 0) in vec2 inUV;
 
 layout (location = 0) out vec4 outFragcolor;
 
-struct Light {
-	vec4 position;
-	vec3 color;
-	float radius;
-};
-
-layout (binding = 4) uniform UBO 
-{
-	Light lights[6];
-	vec4 viewPos;
-	ivec2 windowSize;
-} ubo;
+// Clustered lights in view space at bindings 4 - 7
+#define CLUSTERED_LIGHTING_BINDING 4
+#include "../clusteredlighting/clusteredlighting.glsl"
 
 layout (constant_id = 0) const int NUM_SAMPLES = 8;
 
-#define NUM_LIGHTS 6
-
 // Manual resolve for MSAA samples 
 vec4 resolve(sampler2DMS tex, ivec2 uv)
 {
@@ -45,32 +35,36 @@ vec3 calculateLighting(vec3 pos, vec3 normal, vec4 albedo)
 {
 	vec3 result = vec3(0.0);
 
-	for(int i = 0; i < NUM_LIGHTS; ++i)
+	// Light in view space, positions and normals are both stored with y flipped
+	vec3 position = vec3(clusterUbo.view * vec4(pos, 1.0));
+	vec3 N = normalize(mat3(clusterUbo.view) * normal);
+	// Viewer to fragment
+	vec3 V = normalize(-position);
+
+	// Only the lights that reach the cluster of the sample
+	uvec2 cluster = clusters[clusterIndex(position)];
+	for (uint i = 0; i < cluster.y; ++i)
 	{
+		ClusteredLight light = clusteredLights[lightIndices[cluster.x + i]];
 		// Vector to light
-		vec3 L = ubo.lights[i].position.xyz - pos;
+		vec3 L = light.position - position;
 		// Distance from light to fragment position
 		float dist = length(L);
 
-		// Viewer to fragment
-		vec3 V = ubo.viewPos.xyz - pos;
-		V = normalize(V);
-		
 		// Light to fragment
 		L = normalize(L);
 
 		// Attenuation
-		float atten = ubo.lights[i].radius / (pow(dist, 2.0) + 1.0);
+		float atten = lightFalloff(light, dist) * spotFade(light, L);
 
 		// Diffuse part
-		vec3 N = normalize(normal);
 		float NdotL = max(0.0, dot(N, L));
-		vec3 diff = ubo.lights[i].color * albedo.rgb * NdotL * atten;
+		vec3 diff = light.color * albedo.rgb * NdotL * atten;
 
 		// Specular part
 		vec3 R = reflect(-L, N);
 		float NdotR = max(0.0, dot(R, V));
-		vec3 spec = ubo.lights[i].color * albedo.a * pow(NdotR, 8.0) * atten;
+		vec3 spec = light.color * albedo.a * pow(NdotR, 8.0) * atten;
 
 		result += diff + spec;	
 	}
@@ -2,6 +2,7 @@
 
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
+#extension GL_GOOGLE_include_directive : require
 
 layout (binding = 1) uniform sampler2D samplerposition;
 layout (binding = 2) uniform sampler2D samplerNormal;
@@ -34,6 +35,10 @@ layout (binding = 4) uniform UBO
 	int useShadows;
 } ubo;
 
+// Unshadowed lights in view space at bindings 6 - 9
+#define CLUSTERED_LIGHTING_BINDING 6
+#include "../clusteredlighting/clusteredlighting.glsl"
+
 float textureProj(vec4 P, float layer, vec2 offset)
 {
 	float shadow = 1.0;
@@ -74,6 +79,34 @@ float filterPCF(vec4 sc, float layer)
 	return shadowFactor / count;
 }
 
+// Lights of the cluster of a world space position
+vec3 clusteredLighting(vec3 fragPos, vec3 normal, vec4 albedo)
+{
+	vec3 position = vec3(clusterUbo.view * vec4(fragPos, 1.0));
+	vec3 N = normalize(mat3(clusterUbo.view) * normal);
+	vec3 V = normalize(-position);
+
+	vec3 result = vec3(0.0);
+	uvec2 cluster = clusters[clusterIndex(position)];
+	for (uint i = 0; i < cluster.y; ++i)
+	{
+		ClusteredLight light = clusteredLights[lightIndices[cluster.x + i]];
+		vec3 L = light.position - position;
+		float dist = length(L);
+		L = normalize(L);
+
+		float atten = lightFalloff(light, dist) * spotFade(light, L);
+
+		float NdotL = max(0.0, dot(N, L));
+		vec3 R = reflect(-L, N);
+		float NdotR = max(0.0, dot(R, V));
+		vec3 spec = vec3(pow(NdotR, 16.0) * albedo.a * 2.5);
+
+		result += (vec3(NdotL) + spec) * atten * light.color * albedo.rgb;
+	}
+	return result;
+}
+
 void main() 
 {
 	// Get G-Buffer values
@@ -142,5 +175,8 @@ void main()
 		}
 	}
 
+	// The clustered lights cast no shadows
+	fragcolor += clusteredLighting(fragPos, normal, albedo);
+
 	outFragColor.rgb = fragcolor;
 }
\ No newline at end of file
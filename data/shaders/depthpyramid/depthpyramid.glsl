@@ -0,0 +1,50 @@
+// Depth pyramid : Occlusion test against the pyramid of vkx::DepthPyramid, shared by the culling passes.
+// A pass includes it with
+//
+//     #extension GL_GOOGLE_include_directive : require
+//     #include "../depthpyramid/depthpyramid.glsl"
+//
+// and passes the view projection the pyramid was rendered with, vkx::DepthPyramid::depthExtent() and
+// levelCount(), and the pyramid bound as vkx::DepthPyramid::descriptor().
+
+// Whether a world space sphere lies behind the farthest depth of the texels covering its screen rectangle
+bool sphereOccluded(vec3 center, float radius, mat4 viewProjection, vec2 depthSize, uint levelCount, sampler2D pyramid)
+{
+	// Screen rectangle and nearest depth of the box around the sphere
+	vec2 lower = vec2(1.0);
+	vec2 upper = vec2(-1.0);
+	float nearest = 1.0;
+	for (int i = 0; i < 8; i++)
+	{
+		vec3 corner = center + radius * vec3((i & 1) != 0 ? 1.0 : -1.0, (i & 2) != 0 ? 1.0 : -1.0, (i & 4) != 0 ? 1.0 : -1.0);
+		vec4 clip = viewProjection * vec4(corner, 1.0);
+		// Reaching behind the camera, the rectangle is unbounded
+		if (clip.w <= 1e-5)
+		{
+			return false;
+		}
+		vec3 ndc = clip.xyz / clip.w;
+		lower = min(lower, ndc.xy);
+		upper = max(upper, ndc.xy);
+		nearest = min(nearest, ndc.z);
+	}
+	lower = clamp(lower * 0.5 + 0.5, 0.0, 1.0);
+	upper = clamp(upper * 0.5 + 0.5, 0.0, 1.0);
+
+	// Coarsest level at which the rectangle spans at most 2x2 texels, a texel of level n covering 2^(n+1) pixels
+	ivec2 lowerPixel = ivec2(lower * depthSize);
+	ivec2 upperPixel = min(ivec2(upper * depthSize), ivec2(depthSize) - 1);
+	int level = 0;
+	while (level + 1 < int(levelCount) && any(greaterThan((upperPixel >> (level + 1)) - (lowerPixel >> (level + 1)), ivec2(1))))
+	{
+		level++;
+	}
+
+	ivec2 last = textureSize(pyramid, level) - 1;
+	ivec2 texel = min(lowerPixel >> (level + 1), last);
+	float farthest = texelFetch(pyramid, texel, level).r;
+	farthest = max(farthest, texelFetch(pyramid, min(texel + ivec2(1, 0), last), level).r);
+	farthest = max(farthest, texelFetch(pyramid, min(texel + ivec2(0, 1), last), level).r);
+	farthest = max(farthest, texelFetch(pyramid, min(texel + ivec2(1, 1), last), level).r);
+	return nearest > farthest;
+}
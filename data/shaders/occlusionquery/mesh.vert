@@ -7,19 +7,21 @@ layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec3 inNormal;
 layout (location = 2) in vec3 inColor;
 
+// Instanced attributes, the object number is the first instance of its indirect draw
+layout (location = 4) in vec4 instancePosScale;
+layout (location = 5) in vec4 instanceColor;
+
 layout (binding = 0) uniform UBO 
 {
 	mat4 projection;
 	mat4 modelview;
 	vec4 lightPos;
-	float visible;
 } ubo;
 
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec3 outColor;
-layout (location = 2) out float outVisible;
-layout (location = 3) out vec3 outViewVec;
-layout (location = 4) out vec3 outLightVec;
+layout (location = 2) out vec3 outViewVec;
+layout (location = 3) out vec3 outLightVec;
 
 out gl_PerVertex
 {
@@ -28,14 +30,12 @@ out gl_PerVertex
 
 void main() 
 {
-	outNormal = inNormal;
-	outColor = inColor;
-	outVisible = ubo.visible;
-	
-	gl_Position = ubo.projection * ubo.modelview * vec4(inPos.xyz, 1.0);
-	
-    vec4 pos = ubo.modelview * vec4(inPos, 1.0);
-    outNormal = mat3(ubo.modelview) * inNormal;
-    outLightVec = ubo.lightPos.xyz - pos.xyz;
-    outViewVec = -pos.xyz;
-}
\ No newline at end of file
+	outColor = inColor * instanceColor.rgb;
+
+	vec4 pos = ubo.modelview * vec4(inPos * instancePosScale.w + instancePosScale.xyz, 1.0);
+	gl_Position = ubo.projection * pos;
+
+	outNormal = mat3(ubo.modelview) * inNormal;
+	outLightVec = ubo.lightPos.xyz - pos.xyz;
+	outViewVec = -pos.xyz;
+}
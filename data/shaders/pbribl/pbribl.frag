@@ -15,6 +15,9 @@ layout (binding = 1) uniform UBOParams {
 	vec4 lights[4];
 	float exposure;
 	float gamma;
+	uint sphericalHarmonics;
+	// Irradiance as spherical harmonics, see vkx::pbr::IrradianceSH
+	vec4 irradianceSH[9];
 } uboParams;
 
 layout(push_constant) uniform PushConsts {
@@ -76,6 +79,19 @@ vec3 F_SchlickR(float cosTheta, vec3 F0, float roughness)
 	return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(1.0 - cosTheta, 5.0);
 }
 
+vec3 irradianceSH(vec3 n)
+{
+	return uboParams.irradianceSH[0].rgb * 0.282095
+		+ uboParams.irradianceSH[1].rgb * 0.488603 * n.y
+		+ uboParams.irradianceSH[2].rgb * 0.488603 * n.z
+		+ uboParams.irradianceSH[3].rgb * 0.488603 * n.x
+		+ uboParams.irradianceSH[4].rgb * 1.092548 * n.x * n.y
+		+ uboParams.irradianceSH[5].rgb * 1.092548 * n.y * n.z
+		+ uboParams.irradianceSH[6].rgb * 0.315392 * (3.0 * n.z * n.z - 1.0)
+		+ uboParams.irradianceSH[7].rgb * 1.092548 * n.x * n.z
+		+ uboParams.irradianceSH[8].rgb * 0.546274 * (n.x * n.x - n.y * n.y);
+}
+
 vec3 prefilteredReflection(vec3 R, float roughness)
 {
 	const float MAX_REFLECTION_LOD = 9.0; // todo: param/const
@@ -135,7 +151,7 @@ void main()
 	
 	vec2 brdf = texture(samplerBRDFLUT, vec2(max(dot(N, V), 0.0), roughness)).rg;
 	vec3 reflection = prefilteredReflection(R, roughness).rgb;	
-	vec3 irradiance = texture(samplerIrradiance, N).rgb;
+	vec3 irradiance = uboParams.sphericalHarmonics != 0u ? max(irradianceSH(N), vec3(0.0)) : texture(samplerIrradiance, N).rgb;
 
 	// Diffuse based on irradiance
 	vec3 diffuse = irradiance * ALBEDO;	
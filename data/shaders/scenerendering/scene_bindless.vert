@@ -0,0 +1,53 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec3 inNormal;
+layout (location = 2) in vec2 inUV;
+layout (location = 3) in vec3 inColor;
+
+layout (set = 0, binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 view;
+	mat4 model;
+	vec4 lightPos;
+} ubo;
+
+// Bindless table storage buffers, the draw data buffer holds one material index per instance
+layout (set = 1, binding = 1) readonly buffer DrawData 
+{
+	uint materialIndices[];
+} buffers[];
+
+layout(push_constant) uniform PushConsts 
+{
+	uint materialBuffer;
+	uint drawDataBuffer;
+} pushConsts;
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec3 outColor;
+layout (location = 2) out vec2 outUV;
+layout (location = 3) out vec3 outViewVec;
+layout (location = 4) out vec3 outLightVec;
+layout (location = 5) flat out uint outMaterialIndex;
+
+void main() 
+{
+	outColor = inColor;
+	outUV = inUV;
+	outMaterialIndex = buffers[pushConsts.drawDataBuffer].materialIndices[gl_InstanceIndex];
+
+	mat4 modelView = ubo.view * ubo.model;
+
+	gl_Position = ubo.projection * modelView * vec4(inPos.xyz, 1.0);
+	
+	outNormal = mat3(ubo.model) * inNormal;
+	vec3 lPos = mat3(ubo.model) * ubo.lightPos.xyz;
+	outLightVec = lPos - (ubo.model * vec4(inPos, 0.0)).xyz;
+	outViewVec = -(ubo.model * vec4(inPos, 0.0)).xyz;		
+}
\ No newline at end of file
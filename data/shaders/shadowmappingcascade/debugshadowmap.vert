@@ -1,8 +1,9 @@
 #version 450
 
 layout(push_constant) uniform PushConsts {
-	vec4 position;
+	uint objectIndex;
 	uint cascadeIndex;
+	uint cascadeMask;
 } pushConsts;
 
 layout (location = 0) out vec2 outUV;
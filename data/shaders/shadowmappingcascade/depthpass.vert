@@ -7,15 +7,22 @@ layout (location = 1) in vec2 inUV;
 #define SHADOW_MAP_CASCADE_COUNT 4
 
 layout(push_constant) uniform PushConsts {
-	vec4 position;
+	uint objectIndex;
 	uint cascadeIndex;
+	uint cascadeMask;
 } pushConsts;
 
 layout (binding = 0) uniform UBO {
 	mat4[SHADOW_MAP_CASCADE_COUNT] cascadeViewProjMat;
 } ubo;
 
+layout (binding = 3) readonly buffer Objects {
+	vec4 positions[];
+} objects;
+
 layout (location = 0) out vec2 outUV;
+// World position for the layered pass, which projects in the geometry shader
+layout (location = 1) out vec3 outPos;
 
 out gl_PerVertex {
 	vec4 gl_Position;   
@@ -24,6 +31,7 @@ out gl_PerVertex {
 void main()
 {
 	outUV = inUV;
-	vec3 pos = inPos + pushConsts.position.xyz;
+	vec3 pos = inPos + objects.positions[pushConsts.objectIndex].xyz;
+	outPos = pos;
 	gl_Position =  ubo.cascadeViewProjMat[pushConsts.cascadeIndex] * vec4(pos, 1.0);
 }
\ No newline at end of file
@@ -11,6 +11,10 @@ layout (binding = 0) uniform UBO {
 	mat4 model;
 } ubo;
 
+layout (binding = 3) readonly buffer Objects {
+	vec4 positions[];
+} objects;
+
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec3 outColor;
 layout (location = 2) out vec3 outViewPos;
@@ -18,8 +22,9 @@ layout (location = 3) out vec3 outPos;
 layout (location = 4) out vec2 outUV;
 
 layout(push_constant) uniform PushConsts {
-	vec4 position;
+	uint objectIndex;
 	uint cascadeIndex;
+	uint cascadeMask;
 } pushConsts;
 
 out gl_PerVertex {
@@ -31,7 +36,7 @@ void main()
 	outColor = inColor;
 	outNormal = inNormal;
 	outUV = inUV;
-	vec3 pos = inPos + pushConsts.position.xyz;
+	vec3 pos = inPos + objects.positions[pushConsts.objectIndex].xyz;
 	outPos = pos;
 	outViewPos = (ubo.view * vec4(pos.xyz, 1.0)).xyz;
 	gl_Position = ubo.projection * ubo.view * ubo.model * vec4(pos.xyz, 1.0);
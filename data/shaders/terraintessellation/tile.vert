@@ -0,0 +1,73 @@
+#version 450
+
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Grid position within the tile, z is 1 for the skirt vertices
+layout (location = 0) in vec3 inPos;
+// Per tile: offset in x and z, size and layer of the height texture array
+layout (location = 1) in vec4 inOffsetSize;
+// Per tile: eye distances the morph to the parent's grid starts and ends at
+layout (location = 2) in vec2 inMorph;
+
+layout (set = 0, binding = 0) uniform UBO 
+{
+	mat4 projection;
+	mat4 modelview;
+	vec4 eye;
+	vec2 origin;
+	float size;
+	float heightScale;
+	float tileSize;
+	float skirtDepth;
+} ubo; 
+
+layout (set = 0, binding = 1) uniform sampler2DArray tileHeights; 
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec2 outUV;
+layout (location = 2) out float outHeight;
+
+out gl_PerVertex
+{
+	vec4 gl_Position;
+};
+
+float sampleHeight(vec2 grid)
+{
+	// The tiles store a border of one sample around their grid
+	vec2 uv = (grid + 1.5) / (ubo.tileSize + 3.0);
+	return textureLod(tileHeights, vec3(uv, inOffsetSize.w), 0.0).r;
+}
+
+vec3 worldPos(vec2 grid, float height)
+{
+	float spacing = inOffsetSize.z / ubo.tileSize;
+	return vec3(inOffsetSize.x + grid.x * spacing, -height * ubo.heightScale, inOffsetSize.y + grid.y * spacing);
+}
+
+void main(void)
+{
+	vec2 grid = inPos.xy;
+
+	// Move the odd vertices onto the edges of the parent's grid as the eye distance nears the parent's split distance,
+	// so the tile has the parent's shape by the time the parent replaces it
+	float distance = length(ubo.eye.xyz - worldPos(grid, sampleHeight(grid)));
+	float morph = clamp((distance - inMorph.x) / max(inMorph.y - inMorph.x, 0.0001), 0.0, 1.0);
+	grid -= fract(grid * 0.5) * 2.0 * morph;
+
+	float height = sampleHeight(grid);
+	vec3 pos = worldPos(grid, height);
+	// Skirts hang down to cover cracks towards neighbours of other levels
+	pos.y += inPos.z * ubo.skirtDepth * inOffsetSize.z;
+
+	// Central differences over the neighbouring samples, heights displace along -y
+	float spacing = inOffsetSize.z / ubo.tileSize;
+	float dx = sampleHeight(grid - vec2(1.0, 0.0)) - sampleHeight(grid + vec2(1.0, 0.0));
+	float dz = sampleHeight(grid - vec2(0.0, 1.0)) - sampleHeight(grid + vec2(0.0, 1.0));
+	outNormal = normalize(vec3(dx * ubo.heightScale, -2.0 * spacing, dz * ubo.heightScale));
+
+	outUV = (pos.xz - ubo.origin) / ubo.size;
+	outHeight = height;
+	gl_Position = ubo.projection * ubo.modelview * vec4(pos, 1.0);
+}
@@ -0,0 +1,169 @@
+/*
+* Vulkan Example - Cluster culling with a compute pre-pass and a single indirect draw
+*
+* The scene is split into clusters of up to 124 triangles at load time.  Every frame a compute shader tests
+* the clusters against the frustum, their normal cones against the camera and their screen rectangles
+* against the depth pyramid of the previous frame, and draws the survivors with one indexed indirect draw.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <vulkanExampleBase.h>
+#include <clusterculling.hpp>
+#include <depthpyramid.hpp>
+
+// Vertex layout for the models
+static const vks::model::VertexLayout vertexLayout{ {
+    vks::model::VERTEX_COMPONENT_POSITION,
+    vks::model::VERTEX_COMPONENT_NORMAL,
+    vks::model::VERTEX_COMPONENT_COLOR,
+} };
+
+class VulkanExample : public vkx::ExampleBase {
+public:
+    vks::model::Model scene;
+    vkx::DepthPyramid pyramid{ context, descriptorAllocator };
+    vkx::ClusterCulling culling{ context };
+
+    struct {
+        glm::mat4 projection;
+        glm::mat4 view;
+    } uboScene;
+
+    vks::Buffer uniformBuffer;
+    vk::Pipeline pipeline;
+    vk::PipelineLayout pipelineLayout;
+    vk::DescriptorSet descriptorSet;
+    vk::DescriptorSetLayout descriptorSetLayout;
+
+    VulkanExample() {
+        title = "Cluster culling";
+        camera.type = Camera::CameraType::firstperson;
+        camera.movementSpeed = 5.0f;
+        camera.rotationSpeed = 0.25f;
+        camera.position = { 7.5f, -6.75f, 0.0f };
+        camera.setRotation(glm::vec3(5.0f, 90.0f, 0.0f));
+        camera.setPerspective(60.0f, (float)size.width / (float)size.height, 0.1f, 64.0f);
+        settings.overlay = true;
+        // The depth pyramid is built from the depth attachment after every frame
+        depthStencilUsage = vk::ImageUsageFlagBits::eSampled;
+    }
+
+    ~VulkanExample() {
+        device.destroyPipeline(pipeline);
+        device.destroyPipelineLayout(pipelineLayout);
+        device.destroyDescriptorSetLayout(descriptorSetLayout);
+        uniformBuffer.destroy();
+        culling.destroy();
+        pyramid.destroy();
+        scene.destroy();
+    }
+
+    void loadAssets() override {
+        vks::model::ModelCreateInfo createInfo;
+        createInfo.scale = glm::vec3(0.5f);
+        createInfo.optimization.enabled = true;
+        createInfo.clusters.enabled = true;
+        scene.loadFromFile(context, getAssetPath() + "models/sibenik/sibenik.dae", vertexLayout, createInfo);
+    }
+
+    void updateCommandBufferPreDraw(const vk::CommandBuffer& commandBuffer) override { culling.record(commandBuffer); }
+
+    void updateDrawCommandBuffer(const vk::CommandBuffer& drawCommandBuffer) override {
+        drawCommandBuffer.setViewport(0, viewport());
+        drawCommandBuffer.setScissor(0, scissor());
+        drawCommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
+        drawCommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+        drawCommandBuffer.bindVertexBuffers(0, scene.vertices.buffer, { 0 });
+        culling.draw(drawCommandBuffer);
+    }
+
+    // Read by the occlusion test of the next frame
+    void updateCommandBufferPostDraw(const vk::CommandBuffer& commandBuffer) override { pyramid.build(commandBuffer); }
+
+    void setupDescriptors() {
+        std::vector<vk::DescriptorPoolSize> poolSizes = {
+            { vk::DescriptorType::eUniformBuffer, 1 },
+        };
+        descriptorPool = device.createDescriptorPool({ {}, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+            // Binding 0: Vertex shader uniform buffer
+            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+        };
+        descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+        pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+
+        descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
+            // Binding 0: Vertex shader uniform buffer
+            { descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffer.descriptor },
+        };
+        device.updateDescriptorSets(writeDescriptorSets, nullptr);
+    }
+
+    void preparePipelines() {
+        vks::pipelines::GraphicsPipelineBuilder builder{ device, pipelineLayout, renderPass };
+        builder.rasterizationState.frontFace = vk::FrontFace::eClockwise;
+        builder.vertexInputState.appendVertexLayout(vertexLayout);
+        builder.loadShader(getAssetPath() + "shaders/clusterculling/scene.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        builder.loadShader(getAssetPath() + "shaders/clusterculling/scene.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipeline = builder.create(context.pipelineCache);
+    }
+
+    void updateUniformBuffers() {
+        uboScene.projection = camera.matrices.perspective;
+        uboScene.view = camera.matrices.view;
+        uniformBuffer.copy(uboScene);
+    }
+
+    void prepare() override {
+        ExampleBase::prepare();
+        uniformBuffer = context.createUniformBuffer(uboScene);
+        updateUniformBuffers();
+        pyramid.create(depthStencil);
+        culling.create(scene);
+        culling.setDepthPyramid(pyramid);
+        setupDescriptors();
+        preparePipelines();
+        buildCommandBuffers();
+        prepared = true;
+    }
+
+    void windowResized() override {
+        pyramid.destroy();
+        pyramid.create(depthStencil);
+        culling.setDepthPyramid(pyramid);
+    }
+
+    void render() override {
+        if (!prepared) {
+            return;
+        }
+        // Every frame, the occlusion test projects with the matrix of the frame before
+        const glm::mat4 inverseView = glm::inverse(camera.matrices.view);
+        culling.update(camera.matrices.perspective * camera.matrices.view, glm::vec3(inverseView[3]));
+        draw();
+    }
+
+    void viewChanged() override { updateUniformBuffers(); }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            ui.checkBox("Frustum culling", &culling.frustumCulling);
+            ui.checkBox("Backface cone culling", &culling.coneCulling);
+            ui.checkBox("Occlusion culling", &culling.occlusionCulling);
+            ui.checkBox("Freeze frustum", &culling.freezeFrustum);
+        }
+        if (ui.header("Statistics")) {
+            const auto statistics = culling.statistics();
+            ui.text("Clusters: %d", culling.clusterCount());
+            ui.text("Visible: %d", statistics.visible);
+            ui.text("Outside the frustum: %d", statistics.frustumCulled);
+            ui.text("Facing away: %d", statistics.coneCulled);
+            ui.text("Occluded: %d", statistics.occlusionCulled);
+        }
+    }
+};
+
+VULKAN_EXAMPLE_MAIN()
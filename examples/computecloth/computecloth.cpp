@@ -9,56 +9,59 @@
 */
 
 #include <vulkanExampleBase.h>
+#include <cloth.hpp>
 
 struct Cloth {
     glm::uvec2 gridsize = glm::uvec2(60, 60);
     glm::vec2 size = glm::vec2(2.5f, 2.5f);
 } cloth;
 
+// SSBO cloth grid particle declaration
+using Particle = vkx::cloth::Particle;
+
 // Resources for the compute part of the example
 struct Compute : public vkx::Compute {
     using Parent = vkx::Compute;
     Compute(const vks::Context& context)
         : vkx::Compute(context) {}
 
-    uint32_t readSet = 0;
     struct StorageBuffers {
         vks::Buffer input;
         vks::Buffer output;
     } storageBuffers;
 
     vks::Buffer uniformBuffer;
-    std::vector<vk::CommandBuffer> commandBuffers;
     vk::DescriptorPool descriptorPool;
     vk::DescriptorSetLayout descriptorSetLayout;
     std::array<vk::DescriptorSet, 2> descriptorSets;
     vk::PipelineLayout pipelineLayout;
     vk::Pipeline pipeline;
 
-    struct UBO {
-        float deltaT = 0.0f;
-        float particleMass = 0.1f;
-        float springStiffness = 2000.0f;
-        float damping = 0.25f;
-        float restDistH{ 0 };
-        float restDistV{ 0 };
-        float restDistD{ 0 };
-        float sphereRadius = 0.5f;
-        glm::vec4 spherePos = glm::vec4(0.0f, 0.0f, 0.0f, 0.0f);
-        glm::vec4 gravity = glm::vec4(0.0f, 9.8f, 0.0f, 0.0f);
-        glm::ivec2 particleCount;
-    } ubo;
+    using UBO = vkx::cloth::Parameters;
+    UBO ubo;
+
+    // Simulation steps per frame
+    const uint32_t iterations{ 64 };
+
+    // Simulation on the CPU instead of the compute shader, uploading the final iteration into the output
+    // buffer every frame
+    bool cpu{ false };
+    vkx::simd::Backend cpuBackend{ vkx::simd::best() };
+    vkx::cloth::Simulation cpuSimulation;
+    vkx::ThreadPool threadPool;
+    Upload upload;
+    float cpuStepMilliseconds{ 0.0f };
 
     void prepare() override {
         Parent::prepare();
-        // Create a command buffer for compute operations
-        commandBuffers = device.allocateCommandBuffers(vk::CommandBufferAllocateInfo{ commandPool, vk::CommandBufferLevel::ePrimary, 2 });
         prepareDescriptors();
         preparePipeline();
-        buildCommandBuffer();
+        buildGraph();
+        buildGraphCommandBuffers();
     }
 
     void destroy() override {
+        destroyUpload(upload);
         storageBuffers.input.destroy();
         storageBuffers.output.destroy();
         uniformBuffer.destroy();
@@ -66,7 +69,6 @@ struct Compute : public vkx::Compute {
         context.device.destroyDescriptorSetLayout(descriptorSetLayout, nullptr);
         context.device.destroyPipeline(pipeline);
         context.device.destroyDescriptorPool(descriptorPool);
-        context.device.freeCommandBuffers(commandPool, commandBuffers);
         Parent::destroy();
     }
 
@@ -120,47 +122,86 @@ struct Compute : public vkx::Compute {
         device.destroyShaderModule(computePipelineCreateInfo.stage.module);
     }
 
-    void buildCommandBuffer() {
-        for (const auto& cmdBuf : commandBuffers) {
-            cmdBuf.begin({ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
-
-            std::vector<vk::BufferMemoryBarrier> bufferBarriers;
-            {
-                vk::BufferMemoryBarrier bufferBarrier;
-                bufferBarrier.srcAccessMask = vk::AccessFlagBits::eShaderRead;
-                bufferBarrier.dstAccessMask = vk::AccessFlagBits::eShaderWrite;
-                bufferBarrier.srcQueueFamilyIndex = context.queueIndices.graphics;
-                bufferBarrier.dstQueueFamilyIndex = context.queueIndices.compute;
-                bufferBarrier.size = VK_WHOLE_SIZE;
-
-                bufferBarrier.buffer = storageBuffers.input.buffer;
-                bufferBarriers.push_back(bufferBarrier);
-                bufferBarrier.buffer = storageBuffers.output.buffer;
-                bufferBarriers.push_back(bufferBarrier);
-            }
-            cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, bufferBarriers, nullptr);
-            cmdBuf.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
-            uint32_t calculateNormals = 0;
-            cmdBuf.pushConstants<uint32_t>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, calculateNormals);
-
-            // Dispatch the compute job
-            const uint32_t iterations = 64;
-            for (uint32_t j = 0; j < iterations; j++) {
-                readSet = 1 - readSet;
-                cmdBuf.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSets[readSet], nullptr);
-                if (j == iterations - 1) {
-                    calculateNormals = 1;
-                    cmdBuf.pushConstants<uint32_t>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, calculateNormals);
-                }
-                cmdBuf.dispatch(cloth.gridsize.x / 10, cloth.gridsize.y / 10, 1);
-                cmdBuf.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, bufferBarriers,
-                                       nullptr);
-            }
-            cmdBuf.end();
+    // One pass per iteration, reading the front buffer of the particles and writing the back buffer.  The
+    // even number of iterations leaves the result in the output buffer, which the graphics pipeline draws.
+    void buildGraph() {
+        graph.clear();
+        const auto particles = graph.addPingPong("particles", storageBuffers.output.buffer, storageBuffers.input.buffer);
+        for (uint32_t j = 0; j < iterations; j++) {
+            const uint32_t calculateNormals = j == iterations - 1 ? 1 : 0;
+            graph.addPass("Iteration " + std::to_string(j))
+                .pipeline(pipelineLayout, pipeline)
+                // Set 1 reads the output buffer
+                .descriptorSets(particles, { { descriptorSets[1], descriptorSets[0] } })
+                .pushConstants(calculateNormals)
+                .reads(particles)
+                // Pinned particles keep their previous position in the back buffer
+                .readsWritesNext(particles)
+                .dispatch(cloth.gridsize.x / 10, cloth.gridsize.y / 10);
+        }
+    }
+
+    void submit() {
+        if (!cpu) {
+            submitGraph();
+            return;
+        }
+
+        // The previous upload has to complete before the staging buffer is overwritten
+        queue.waitIdle();
+        auto tStart = std::chrono::high_resolution_clock::now();
+        cpuSimulation.step(ubo, iterations, threadPool, cpuBackend);
+        cpuStepMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+        cpuSimulation.store(static_cast<Particle*>(upload.staging.mapped));
+        Parent::submit(upload.commandBuffer);
+    }
+
+    void setBackend(bool useCpu, vkx::simd::Backend backend) {
+        const size_t count = cloth.gridsize.x * cloth.gridsize.y;
+        device.waitIdle();
+        if (useCpu && !cpu) {
+            // Continue from the current GPU state.  The first GPU iteration reads the output buffer, so that
+            // is the only one the CPU has to write when switching back.
+            auto particles = download<Particle>(storageBuffers.output, count);
+            cpuSimulation.load(particles.data(), ubo);
+            upload = createUpload(storageBuffers.output, count * sizeof(Particle));
+        } else if (!useCpu && cpu) {
+            destroyUpload(upload);
         }
+        cpu = useCpu;
+        cpuBackend = backend;
     }
 
-    void submit() { Parent::submit(commandBuffers[readSet]); }
+    // Run a single iteration, including normals, on the GPU and with the given CPU backend from the same
+    // state, and compare the results
+    vkx::simd::Comparison compareBackends(vkx::simd::Backend backend, float deltaT = 0.000005f) {
+        const size_t count = cloth.gridsize.x * cloth.gridsize.y;
+        device.waitIdle();
+        auto initial = download<Particle>(storageBuffers.output, count);
+
+        UBO savedUbo = ubo;
+        ubo.deltaT = deltaT;
+        memcpy(uniformBuffer.mapped, &ubo, sizeof(ubo));
+        // Read the output buffer and write the input buffer, which the next frame overwrites anyway
+        vk::CommandBuffer stepCmd = device.allocateCommandBuffers({ commandPool, vk::CommandBufferLevel::ePrimary, 1 })[0];
+        stepCmd.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+        stepCmd.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        const uint32_t calculateNormals = 1;
+        stepCmd.pushConstants<uint32_t>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, calculateNormals);
+        stepCmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSets[1], nullptr);
+        stepCmd.dispatch(cloth.gridsize.x / 10, cloth.gridsize.y / 10, 1);
+        stepCmd.end();
+        submitAndWait(stepCmd);
+        device.freeCommandBuffers(commandPool, stepCmd);
+        auto gpu = download<Particle>(storageBuffers.input, count);
+
+        vkx::cloth::Simulation reference;
+        reference.load(initial.data(), ubo);
+        reference.step(ubo, 1, threadPool, backend);
+        ubo = savedUbo;
+        memcpy(uniformBuffer.mapped, &ubo, sizeof(ubo));
+        return reference.compare(gpu.data());
+    }
 };
 
 class VulkanExample : public vkx::ExampleBase {
@@ -198,16 +239,8 @@ public:
     } graphics;
 
     Compute compute{ context };
-
-    // SSBO cloth grid particle declaration
-    struct Particle {
-        glm::vec4 pos;
-        glm::vec4 vel;
-        glm::vec4 uv;
-        glm::vec4 normal;
-        float pinned{ 0.0 };
-        glm::vec3 _pad0;
-    };
+    vkx::simd::Comparison backendComparison;
+    bool backendsCompared{ false };
 
     VulkanExample() {
         title = "Compute shader cloth simulation";
@@ -468,6 +501,29 @@ public:
     void OnUpdateUIOverlay() override {
         if (ui.header("Settings")) {
             ui.checkBox("Simulate wind", &simulateWind);
+            // 0 = GPU, 1 = CPU scalar, 2 = CPU with the widest instruction set
+            std::vector<std::string> backendNames{ "GPU", "CPU scalar" };
+            if (vkx::simd::best() != vkx::simd::Backend::scalar) {
+                backendNames.push_back(std::string("CPU ") + vkx::simd::name(vkx::simd::best()));
+            }
+            int32_t backendIndex = !compute.cpu ? 0 : (compute.cpuBackend == vkx::simd::Backend::scalar ? 1 : 2);
+            if (ui.comboBox("Backend", &backendIndex, backendNames)) {
+                compute.setBackend(backendIndex > 0, backendIndex == 2 ? vkx::simd::best() : vkx::simd::Backend::scalar);
+            }
+            if (ui.button("Compare CPU and GPU step")) {
+                backendComparison = compute.compareBackends(vkx::simd::best());
+                backendsCompared = true;
+            }
+        }
+        if (ui.header("Statistics")) {
+            if (compute.cpu) {
+                ui.text("CPU step (%u threads): %.3f ms", compute.threadPool.size(), compute.cpuStepMilliseconds);
+            }
+            if (backendsCompared) {
+                ui.text("CPU %s vs GPU: %s, max %u ulps / %.2e", vkx::simd::name(vkx::simd::best()), backendComparison.passed() ? "match" : "MISMATCH",
+                        backendComparison.maxUlps, backendComparison.maxAbsolute);
+                ui.text("%zu of %zu values outside tolerance", backendComparison.mismatches, backendComparison.count);
+            }
         }
     }
 };
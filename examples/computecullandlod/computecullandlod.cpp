@@ -137,13 +137,13 @@ struct Compute : public vkx::Compute {
         computePipelineCreateInfo.stage =
             vks::shaders::loadShader(context.device, vkx::getAssetPath() + "shaders/computecullandlod/cull.comp.spv", vk::ShaderStageFlagBits::eCompute);
 
-        // Use specialization constants to pass max. level of detail (determined by no. of meshes)
+        // Use specialization constants to pass max. level of detail (determined by no. of generated levels)
         vk::SpecializationMapEntry specializationEntry;
         specializationEntry.constantID = 0;
         specializationEntry.offset = 0;
         specializationEntry.size = sizeof(uint32_t);
 
-        uint32_t specializationData = static_cast<uint32_t>(models.lodObject.parts.size()) - 1;
+        uint32_t specializationData = static_cast<uint32_t>(models.lodObject.lods.size()) - 1;
 
         vk::SpecializationInfo specializationInfo;
         specializationInfo.mapEntryCount = 1;
@@ -325,7 +325,13 @@ public:
     }
 #endif
 
-    void loadAssets() override { compute.models.lodObject.loadFromFile(context, getAssetPath() + "models/suzanne_lods.dae", vertexLayout, 0.1f); }
+    void loadAssets() override {
+        // The levels of detail are simplified from the full resolution mesh at load time, one after the other in the index buffer
+        vks::model::ModelCreateInfo createInfo{ 0.01f, 1.0f, 0.0f };
+        createInfo.optimization.enabled = true;
+        createInfo.lod.levels = MAX_LOD_LEVEL;
+        compute.models.lodObject.loadFromFile(context, getAssetPath() + "models/suzanne.obj", vertexLayout, createInfo);
+    }
 
     void setupDescriptorPool() {
         std::vector<vk::DescriptorPoolSize> poolSizes = {
@@ -421,11 +427,11 @@ public:
         };
         std::vector<LOD> LODLevels;
         uint32_t n = 0;
-        for (auto modelPart : compute.models.lodObject.parts) {
+        for (const auto& range : compute.models.lodObject.lods) {
             LOD lod;
-            lod.firstIndex = modelPart.indexBase;   // First index for this LOD
-            lod.indexCount = modelPart.indexCount;  // Index count for this LOD
-            lod.distance = 5.0f + n * 5.0f;         // Starting distance (to viewer) for this LOD
+            lod.firstIndex = range.indexBase;   // First index for this LOD
+            lod.indexCount = range.indexCount;  // Index count for this LOD
+            lod.distance = 5.0f + n * 5.0f;     // Starting distance (to viewer) for this LOD
             n++;
             LODLevels.push_back(lod);
         }
@@ -503,7 +509,8 @@ public:
         if (ui.header("Statistics")) {
             ui.text("Visible objects: %d", indirectStats.drawCount);
             for (uint32_t i = 0; i < MAX_LOD_LEVEL + 1; i++) {
-                ui.text("LOD %d: %d", i, indirectStats.lodCount[i]);
+                const auto& level = compute.models.lodObject.lodReport.levels[i];
+                ui.text("LOD %d: %d (%d triangles, error %.4f)", i, indirectStats.lodCount[i], level.triangleCount, level.error);
             }
         }
     }
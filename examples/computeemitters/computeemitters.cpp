@@ -0,0 +1,310 @@
+/*
+* Vulkan Example - Particle emitters spawning, simulating and recycling particles entirely on the GPU
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <vulkanExampleBase.h>
+#include <gpuparticles.hpp>
+
+class ComputeEmitters : public vkx::Compute {
+    using Parent = vkx::Compute;
+
+public:
+    ComputeEmitters(const vks::Context& context)
+        : Parent(context) {}
+
+    vkx::GpuParticles particles{ context };
+    // Sort the particles back to front, needed for the order dependent blending mode
+    bool sort{ false };
+
+    void prepare() override {
+        Parent::prepare();
+        particles.create(256 * 1024);
+        buildGraph();
+    }
+
+    void destroy() override {
+        particles.destroy();
+        Parent::destroy();
+    }
+
+    void buildGraph() {
+        graph.clear();
+        particles.addPasses(graph, sort);
+        buildGraphCommandBuffers();
+    }
+
+    void submit() { submitGraph(); }
+};
+
+class VulkanExample : public vkx::ExampleBase {
+public:
+    enum class Blending
+    {
+        // Order independent, no sorting required
+        additive = 0,
+        // Premultiplied alpha "over" blending, drawn back to front after the sort
+        alpha = 1,
+    };
+
+    ComputeEmitters compute{ context };
+    Blending blending{ Blending::additive };
+    int32_t capacityIndex{ 2 };
+    float timer{ 0.0f };
+    bool animate{ true };
+
+    struct {
+        vk::Pipeline additive;
+        vk::Pipeline alpha;
+    } pipelines;
+    vk::PipelineLayout pipelineLayout;
+    vk::DescriptorSet descriptorSet;
+    vk::DescriptorSetLayout descriptorSetLayout;
+
+    struct {
+        vks::texture::Texture2D particle;
+        vks::texture::Texture2D gradient;
+    } textures;
+
+    struct UBO {
+        glm::mat4 projection;
+        glm::mat4 view;
+        glm::vec2 viewportDim;
+        float pointSize{ 0.5f };
+    } ubo;
+    vks::Buffer uniformBuffer;
+
+    VulkanExample() {
+        title = "Vulkan Example - GPU particle emitters";
+        camera.type = Camera::CameraType::lookat;
+        camera.setRotation({ -20.0f, 30.0f, 0.0f });
+        camera.setTranslation({ 0.0f, 5.0f, -40.0f });
+        camera.setPerspective(60.0f, (float)size.width / (float)size.height, 0.1f, 256.0f);
+    }
+
+    ~VulkanExample() {
+        compute.destroy();
+        device.destroyPipeline(pipelines.additive);
+        device.destroyPipeline(pipelines.alpha);
+        device.destroyPipelineLayout(pipelineLayout);
+        device.destroyDescriptorSetLayout(descriptorSetLayout);
+        uniformBuffer.destroy();
+        textures.particle.destroy();
+        textures.gradient.destroy();
+    }
+
+    void loadAssets() override {
+        textures.particle.loadFromFile(context, getAssetPath() + "textures/particle01_rgba.ktx", vk::Format::eR8G8B8A8Unorm);
+        textures.gradient.loadFromFile(context, getAssetPath() + "textures/particle_gradient_rgba.ktx", vk::Format::eR8G8B8A8Unorm);
+    }
+
+    void setupEmitters() {
+        auto& emitters = compute.particles.emitters;
+        emitters.resize(3);
+        // Fountain
+        emitters[0].position = glm::vec3(0.0f, 0.0f, 0.0f);
+        emitters[0].radius = 0.5f;
+        emitters[0].velocity = glm::vec3(0.0f, -18.0f, 0.0f);
+        emitters[0].velocityVariation = 3.0f;
+        emitters[0].color = glm::vec4(0.2f, 0.5f, 1.0f, 0.8f);
+        emitters[0].minLifetime = 2.0f;
+        emitters[0].maxLifetime = 3.5f;
+        emitters[0].rate = 20000.0f;
+        // Sparks, moved around by animate()
+        emitters[1].radius = 0.25f;
+        emitters[1].velocityVariation = 8.0f;
+        emitters[1].color = glm::vec4(1.0f, 0.6f, 0.1f, 1.0f);
+        emitters[1].minLifetime = 0.5f;
+        emitters[1].maxLifetime = 1.5f;
+        emitters[1].rate = 30000.0f;
+        // Slow cloud
+        emitters[2].position = glm::vec3(-12.0f, -6.0f, 6.0f);
+        emitters[2].radius = 4.0f;
+        emitters[2].velocity = glm::vec3(1.0f, -1.0f, 0.0f);
+        emitters[2].velocityVariation = 0.5f;
+        emitters[2].color = glm::vec4(0.6f, 0.9f, 0.4f, 0.35f);
+        emitters[2].minLifetime = 4.0f;
+        emitters[2].maxLifetime = 8.0f;
+        emitters[2].rate = 8000.0f;
+    }
+
+    void animateEmitters() {
+        auto& sparks = compute.particles.emitters[1];
+        sparks.position = glm::vec3(sinf(glm::radians(timer * 360.0f)) * 10.0f, -4.0f, cosf(glm::radians(timer * 360.0f)) * 10.0f);
+        sparks.velocity = glm::vec3(0.0f, -6.0f, 0.0f);
+    }
+
+    void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+        cmdBuffer.setViewport(0, vks::util::viewport(size));
+        cmdBuffer.setScissor(0, vks::util::rect2D(size));
+        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, blending == Blending::additive ? pipelines.additive : pipelines.alpha);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
+        // No vertex buffers, the vertex shader fetches the particles through the alive list
+        compute.particles.draw(cmdBuffer);
+    }
+
+    void prepareUniformBuffers() {
+        uniformBuffer = context.createUniformBuffer(ubo);
+        updateUniformBuffers();
+    }
+
+    void updateUniformBuffers() {
+        ubo.projection = camera.matrices.perspective;
+        ubo.view = camera.matrices.view;
+        ubo.viewportDim = glm::vec2((float)size.width, (float)size.height);
+        memcpy(uniformBuffer.mapped, &ubo, sizeof(ubo));
+    }
+
+    void setupDescriptorSetLayout() {
+        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
+            // Binding 0 : Vertex shader uniform buffer
+            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+            // Binding 1 : Particle pool
+            { 1, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+            // Binding 2 : Alive list
+            { 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+            // Binding 3 : Particle color map
+            { 3, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
+            // Binding 4 : Particle gradient ramp
+            { 4, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
+        };
+        descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
+        pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+    }
+
+    void setupDescriptorPool() {
+        std::vector<vk::DescriptorPoolSize> poolSizes = {
+            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 1 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 2 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 2 },
+        };
+        descriptorPool = device.createDescriptorPool(
+            vk::DescriptorPoolCreateInfo{ vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet, 1, (uint32_t)poolSizes.size(), poolSizes.data() });
+    }
+
+    // Called again when the particle buffers are recreated
+    void setupDescriptorSet() {
+        if (descriptorSet) {
+            device.freeDescriptorSets(descriptorPool, descriptorSet);
+        }
+        descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+        std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
+            { descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffer.descriptor },
+            { descriptorSet, 1, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &compute.particles.particleBuffer().descriptor },
+            { descriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &compute.particles.aliveBuffer().descriptor },
+            { descriptorSet, 3, 0, 1, vk::DescriptorType::eCombinedImageSampler, &textures.particle.descriptor },
+            { descriptorSet, 4, 0, 1, vk::DescriptorType::eCombinedImageSampler, &textures.gradient.descriptor },
+        };
+        device.updateDescriptorSets(writeDescriptorSets, {});
+    }
+
+    void preparePipelines() {
+        vks::pipelines::GraphicsPipelineBuilder pipelineBuilder{ device, pipelineLayout, renderPass };
+        pipelineBuilder.inputAssemblyState.topology = vk::PrimitiveTopology::ePointList;
+        pipelineBuilder.depthStencilState = { false };
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/computeemitters/particle.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        pipelineBuilder.loadShader(getAssetPath() + "shaders/computeemitters/particle.frag.spv", vk::ShaderStageFlagBits::eFragment);
+
+        // The fragment shader outputs premultiplied colors, which both modes blend with a source factor of one
+        auto& blendAttachmentState = pipelineBuilder.colorBlendState.blendAttachmentStates[0];
+        blendAttachmentState.blendEnable = VK_TRUE;
+        blendAttachmentState.colorBlendOp = vk::BlendOp::eAdd;
+        blendAttachmentState.srcColorBlendFactor = vk::BlendFactor::eOne;
+        blendAttachmentState.alphaBlendOp = vk::BlendOp::eAdd;
+        blendAttachmentState.srcAlphaBlendFactor = vk::BlendFactor::eOne;
+
+        // Additive blending
+        blendAttachmentState.dstColorBlendFactor = vk::BlendFactor::eOne;
+        blendAttachmentState.dstAlphaBlendFactor = vk::BlendFactor::eOne;
+        pipelines.additive = pipelineBuilder.create(context.pipelineCache);
+
+        // Alpha blending
+        blendAttachmentState.dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
+        blendAttachmentState.dstAlphaBlendFactor = vk::BlendFactor::eOneMinusSrcAlpha;
+        pipelines.alpha = pipelineBuilder.create(context.pipelineCache);
+    }
+
+    void prepare() override {
+        ExampleBase::prepare();
+        compute.prepare();
+        setupEmitters();
+        prepareUniformBuffers();
+        setupDescriptorSetLayout();
+        setupDescriptorPool();
+        setupDescriptorSet();
+        preparePipelines();
+        buildCommandBuffers();
+        renderSignalSemaphores.push_back(compute.semaphores.ready);
+        prepared = true;
+    }
+
+    void draw() override {
+        // Submit graphics commands
+        ExampleBase::draw();
+
+        // The indirect draw reads the arguments written by the compact pass
+        static std::once_flag once;
+        std::call_once(once, [&] {
+            addRenderWaitSemaphore(compute.semaphores.complete, vk::PipelineStageFlagBits::eDrawIndirect | vk::PipelineStageFlagBits::eVertexShader);
+        });
+
+        compute.submit();
+    }
+
+    void update(float deltaTime) override {
+        vkx::ExampleBase::update(deltaTime);
+        if (animate && !paused) {
+            timer += frameTimer * 0.1f;
+            if (timer > 1.0f) {
+                timer -= 1.0f;
+            }
+        }
+        animateEmitters();
+        compute.particles.update(paused ? 0.0f : frameTimer, camera.matrices.view);
+    }
+
+    void viewChanged() override { updateUniformBuffers(); }
+
+    void windowResized() override { updateUniformBuffers(); }
+
+    void setCapacity(uint32_t capacity) {
+        device.waitIdle();
+        auto emitters = compute.particles.emitters;
+        compute.particles.destroy();
+        compute.particles.create(capacity);
+        compute.particles.emitters = emitters;
+        compute.buildGraph();
+        setupDescriptorSet();
+        buildCommandBuffers();
+    }
+
+    void setBlending(Blending mode) {
+        device.waitIdle();
+        blending = mode;
+        compute.sort = blending == Blending::alpha;
+        compute.buildGraph();
+        buildCommandBuffers();
+    }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            ui.checkBox("Moving emitter", &animate);
+            int32_t blendingIndex = static_cast<int32_t>(blending);
+            if (ui.comboBox("Blending", &blendingIndex, { "Additive (unsorted)", "Alpha (depth sorted)" })) {
+                setBlending(static_cast<Blending>(blendingIndex));
+            }
+            if (ui.comboBox("Capacity", &capacityIndex, { "64K", "128K", "256K", "512K", "1M" })) {
+                setCapacity((64 * 1024) << capacityIndex);
+            }
+            if (ui.sliderFloat("Point size", &ubo.pointSize, 0.1f, 2.0f)) {
+                updateUniformBuffers();
+            }
+        }
+        if (ui.header("Statistics")) {
+            ui.text("%u of %u particles alive", compute.particles.aliveCount(), compute.particles.capacity());
+        }
+    }
+};
+
+VULKAN_EXAMPLE_MAIN()
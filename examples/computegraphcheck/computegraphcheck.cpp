@@ -0,0 +1,310 @@
+/*
+* Vulkan Example - CPU checks of the compute graph and its hazard validator
+*
+* Feeds vkx::ComputeGraph::Validator hand written command streams with and without the barriers they need and
+* checks that exactly the unsynchronized ones report a hazard.  Then compiles fixed graphs (chains, independent
+* passes, write after read, indirect dispatches, ping-pong iterations) and compares batches and barriers against
+* the expected schedule, and compiles random graphs in both orientations of their ping-pong resources, whose
+* schedules must validate without hazards.  The buffers are placeholder handles, nothing is recorded.  Needs no GPU.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <check.hpp>
+#include <computegraph.hpp>
+
+#define RANDOM_GRAPH_COUNT 512
+#define RANDOM_RESOURCE_COUNT 6
+// The first resources of a random graph are ping-pong resources
+#define RANDOM_PING_PONG_COUNT 2
+#define RANDOM_PASS_COUNT 24
+
+using vkx::ComputeGraph;
+using Stage = vk::PipelineStageFlagBits;
+using AccessBit = vk::AccessFlagBits;
+
+// Distinct handles that are never passed to Vulkan
+static vk::Buffer placeholderBuffer(uint64_t id) {
+    VkBuffer buffer;
+    static_assert(sizeof(buffer) == sizeof(id), "Non-dispatchable handles are 64 bit");
+    memcpy(&buffer, &id, sizeof(buffer));
+    return vk::Buffer(buffer);
+}
+
+static ComputeGraph::Barrier executionBarrier(vk::PipelineStageFlags srcStages, vk::PipelineStageFlags dstStages) {
+    ComputeGraph::Barrier barrier;
+    barrier.srcStages = srcStages;
+    barrier.dstStages = dstStages;
+    return barrier;
+}
+
+static ComputeGraph::Barrier memoryBarrier(vk::PipelineStageFlags srcStages,
+                                           vk::PipelineStageFlags dstStages,
+                                           vk::Buffer buffer,
+                                           vk::AccessFlags srcAccess,
+                                           vk::AccessFlags dstAccess) {
+    ComputeGraph::Barrier barrier = executionBarrier(srcStages, dstStages);
+    vk::BufferMemoryBarrier bufferBarrier;
+    bufferBarrier.srcAccessMask = srcAccess;
+    bufferBarrier.dstAccessMask = dstAccess;
+    bufferBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    bufferBarrier.buffer = buffer;
+    bufferBarrier.size = VK_WHOLE_SIZE;
+    barrier.bufferBarriers.push_back(bufferBarrier);
+    return barrier;
+}
+
+class ComputeGraphCheck : public vkx::Check {
+public:
+    std::default_random_engine rndGen{ 0 };
+
+    const vk::Buffer a = placeholderBuffer(1);
+    const vk::Buffer b = placeholderBuffer(2);
+
+    // `expected` is the start of the first hazard, or nullptr if there must be none
+    void expectHazard(const char* test, const ComputeGraph::Validator& validator, const char* expected) {
+        const auto& hazards = validator.hazards();
+        if (!expected && !hazards.empty()) {
+            error(std::string(test) + ": unexpected " + hazards[0]);
+        } else if (expected && hazards.empty()) {
+            error(std::string(test) + ": missed the " + expected + " hazard");
+        } else if (expected && hazards[0].compare(0, strlen(expected), expected) != 0) {
+            error(std::string(test) + ": expected " + expected + ", got " + hazards[0]);
+        }
+    }
+
+    void checkValidator() {
+        const ComputeGraph::Access writeA{ a, Stage::eComputeShader, AccessBit::eShaderWrite, "a" };
+        const ComputeGraph::Access readA{ a, Stage::eComputeShader, AccessBit::eShaderRead, "a" };
+        const ComputeGraph::Access readWriteA{ a, Stage::eComputeShader, AccessBit::eShaderRead | AccessBit::eShaderWrite, "a" };
+        const ComputeGraph::Access indirectA{ a, Stage::eDrawIndirect, AccessBit::eIndirectCommandRead, "a (indirect)" };
+        const ComputeGraph::Access transferWriteA{ a, Stage::eTransfer, AccessBit::eTransferWrite, "a" };
+        const ComputeGraph::Access writeB{ b, Stage::eComputeShader, AccessBit::eShaderWrite, "b" };
+        const auto computeToCompute = memoryBarrier(Stage::eComputeShader, Stage::eComputeShader, a, AccessBit::eShaderWrite, AccessBit::eShaderRead);
+
+        struct Case {
+            const char* name;
+            std::vector<std::function<void(ComputeGraph::Validator&)>> stream;
+            const char* hazard;
+        };
+        using V = ComputeGraph::Validator;
+        const std::vector<Case> cases{
+            { "read after write", { [&](V& v) { v.command("write", { writeA }); }, [&](V& v) { v.command("read", { readA }); } }, "Read after write" },
+            { "read after write with barrier",
+              { [&](V& v) { v.command("write", { writeA }); }, [&](V& v) { v.barrier(computeToCompute); }, [&](V& v) { v.command("read", { readA }); } },
+              nullptr },
+            { "read after write with execution barrier only",
+              { [&](V& v) { v.command("write", { writeA }); }, [&](V& v) { v.barrier(executionBarrier(Stage::eComputeShader, Stage::eComputeShader)); },
+                [&](V& v) { v.command("read", { readA }); } },
+              "Read after write" },
+            { "read after write with barrier of another buffer",
+              { [&](V& v) { v.command("write", { writeA }); },
+                [&](V& v) { v.barrier(memoryBarrier(Stage::eComputeShader, Stage::eComputeShader, b, AccessBit::eShaderWrite, AccessBit::eShaderRead)); },
+                [&](V& v) { v.command("read", { readA }); } },
+              "Read after write" },
+            { "read after transfer with compute source stage",
+              { [&](V& v) { v.command("fill", { transferWriteA }); },
+                [&](V& v) { v.barrier(memoryBarrier(Stage::eComputeShader, Stage::eComputeShader, a, AccessBit::eTransferWrite, AccessBit::eShaderRead)); },
+                [&](V& v) { v.command("read", { readA }); } },
+              "Read after write" },
+            { "read after transfer",
+              { [&](V& v) { v.command("fill", { transferWriteA }); },
+                [&](V& v) { v.barrier(memoryBarrier(Stage::eTransfer, Stage::eComputeShader, a, AccessBit::eTransferWrite, AccessBit::eShaderRead)); },
+                [&](V& v) { v.command("read", { readA }); } },
+              nullptr },
+            { "write after write", { [&](V& v) { v.command("first", { writeA }); }, [&](V& v) { v.command("second", { writeA }); } }, "Write after write" },
+            { "write after write with read barrier",
+              { [&](V& v) { v.command("first", { writeA }); }, [&](V& v) { v.barrier(computeToCompute); }, [&](V& v) { v.command("second", { writeA }); } },
+              "Write after write" },
+            { "write after write with barrier",
+              { [&](V& v) { v.command("first", { writeA }); },
+                [&](V& v) { v.barrier(memoryBarrier(Stage::eComputeShader, Stage::eComputeShader, a, AccessBit::eShaderWrite, AccessBit::eShaderWrite)); },
+                [&](V& v) { v.command("second", { writeA }); } },
+              nullptr },
+            { "write after read", { [&](V& v) { v.command("read", { readA }); }, [&](V& v) { v.command("write", { writeA }); } }, "Write after read" },
+            { "write after read with execution barrier",
+              { [&](V& v) { v.command("read", { readA }); }, [&](V& v) { v.barrier(executionBarrier(Stage::eComputeShader, Stage::eComputeShader)); },
+                [&](V& v) { v.command("write", { writeA }); } },
+              nullptr },
+            { "read and write in one command", { [&](V& v) { v.command("update", { readWriteA }); } }, nullptr },
+            { "indirect read after write with compute barrier",
+              { [&](V& v) { v.command("write", { writeA }); }, [&](V& v) { v.barrier(computeToCompute); },
+                [&](V& v) { v.command("dispatch", { indirectA }); } },
+              "Read after write" },
+            { "indirect read after write",
+              { [&](V& v) { v.command("write", { writeA }); },
+                [&](V& v) {
+                    v.barrier(memoryBarrier(Stage::eComputeShader, Stage::eDrawIndirect, a, AccessBit::eShaderWrite, AccessBit::eIndirectCommandRead));
+                },
+                [&](V& v) { v.command("dispatch", { indirectA }); } },
+              nullptr },
+            { "independent buffers", { [&](V& v) { v.command("write a", { writeA }); }, [&](V& v) { v.command("write b", { writeB }); } }, nullptr },
+        };
+        for (const auto& c : cases) {
+            ComputeGraph::Validator validator;
+            for (const auto& step : c.stream) {
+                step(validator);
+            }
+            expectHazard(c.name, validator, c.hazard);
+        }
+        LOG("%u validator streams\n", static_cast<uint32_t>(cases.size()));
+    }
+
+    void expectSchedule(const char* test, ComputeGraph& graph, uint32_t batches, uint32_t pipelineBarriers, uint32_t bufferBarriers) {
+        const auto hazards = graph.validate();
+        if (!hazards.empty()) {
+            error(std::string(test) + ": " + hazards[0]);
+        }
+        const auto statistics = graph.statistics();
+        if (statistics.batches != batches || statistics.pipelineBarriers != pipelineBarriers || statistics.bufferBarriers != bufferBarriers) {
+            char message[256];
+            snprintf(message, sizeof(message), "%s: %u batches, %u barriers of %u buffers instead of %u, %u, %u", test, statistics.batches,
+                     statistics.pipelineBarriers, statistics.bufferBarriers, batches, pipelineBarriers, bufferBarriers);
+            error(message);
+        }
+    }
+
+    void checkSchedules() {
+        {
+            ComputeGraph graph;
+            const auto x = graph.addBuffer("x", placeholderBuffer(1));
+            const auto y = graph.addBuffer("y", placeholderBuffer(2));
+            graph.addPass("produce").writes(x);
+            graph.addPass("transform").reads(x).writes(y);
+            graph.addPass("consume").reads(y);
+            expectSchedule("chain", graph, 3, 2, 2);
+        }
+        {
+            ComputeGraph graph;
+            const auto x = graph.addBuffer("x", placeholderBuffer(1));
+            const auto y = graph.addBuffer("y", placeholderBuffer(2));
+            const auto z = graph.addBuffer("z", placeholderBuffer(3));
+            graph.addPass("write x").writes(x);
+            graph.addPass("write y").writes(y);
+            graph.addPass("combine").reads(x).reads(y).writes(z);
+            expectSchedule("independent passes", graph, 2, 1, 2);
+        }
+        {
+            ComputeGraph graph;
+            const auto x = graph.addBuffer("x", placeholderBuffer(1));
+            graph.addPass("read").reads(x);
+            graph.addPass("overwrite").writes(x);
+            expectSchedule("write after read", graph, 2, 1, 0);
+        }
+        {
+            ComputeGraph graph;
+            const auto args = graph.addBuffer("args", placeholderBuffer(1));
+            const auto data = graph.addBuffer("data", placeholderBuffer(2));
+            graph.addPass("count").writes(args);
+            graph.addPass("process").dispatchIndirect(args).readsWrites(data);
+            expectSchedule("indirect dispatch", graph, 2, 1, 1);
+        }
+        {
+            ComputeGraph graph;
+            const auto x = graph.addBuffer("x", placeholderBuffer(1));
+            graph.addPass("clear").transfer().writes(x);
+            graph.addPass("accumulate").readsWrites(x);
+            expectSchedule("transfer then compute", graph, 2, 1, 1);
+        }
+        {
+            // Cloth style iterations, every pass reading the front and writing the back buffer
+            ComputeGraph graph;
+            const auto state = graph.addPingPong("state", placeholderBuffer(1), placeholderBuffer(2));
+            const uint32_t iterations = 5;
+            for (uint32_t i = 0; i < iterations; ++i) {
+                graph.addPass("step").reads(state).writesNext(state);
+            }
+            // From the third pass on, each barrier also makes the write two passes back visible to the next write
+            const uint32_t bufferBarriers = 2 * (iterations - 1) - 1;
+            expectSchedule("ping-pong", graph, iterations, iterations - 1, bufferBarriers);
+            if (!graph.swapsParity()) {
+                error("ping-pong: an odd number of swaps has to flip the orientation");
+            }
+            graph.advance();
+            if (graph.parity(state) != 1 || graph.front(state) != placeholderBuffer(2)) {
+                error("ping-pong: advance() did not swap the buffers");
+            }
+            expectSchedule("ping-pong, second orientation", graph, iterations, iterations - 1, bufferBarriers);
+        }
+        LOG("6 fixed graphs\n");
+    }
+
+    // Random passes over a few resources, in both orientations of the ping-pong resources
+    void checkRandomGraphs() {
+        std::uniform_int_distribution<uint32_t> rndResource(0, RANDOM_RESOURCE_COUNT - 1);
+        std::uniform_int_distribution<uint32_t> rndUseCount(1, 3);
+        std::uniform_int_distribution<uint32_t> rndUse(0, 4);
+        std::uniform_int_distribution<uint32_t> rndPercent(0, 99);
+        uint32_t passes = 0, batches = 0, barriers = 0;
+        for (uint32_t g = 0; g < RANDOM_GRAPH_COUNT; ++g) {
+            ComputeGraph graph;
+            for (uint32_t r = 0; r < RANDOM_RESOURCE_COUNT; ++r) {
+                const std::string name = "r" + std::to_string(r);
+                if (r < RANDOM_PING_PONG_COUNT) {
+                    graph.addPingPong(name, placeholderBuffer(2 * r + 1), placeholderBuffer(2 * r + 2));
+                } else {
+                    graph.addBuffer(name, placeholderBuffer(2 * r + 1));
+                }
+            }
+            for (uint32_t p = 0; p < RANDOM_PASS_COUNT; ++p) {
+                auto& pass = graph.addPass("p" + std::to_string(p));
+                if (rndPercent(rndGen) < 10) {
+                    pass.transfer();
+                } else if (rndPercent(rndGen) < 10) {
+                    pass.dispatchIndirect(rndResource(rndGen));
+                }
+                for (uint32_t u = rndUseCount(rndGen); u > 0; --u) {
+                    const uint32_t resource = rndResource(rndGen);
+                    const bool pingPong = resource < RANDOM_PING_PONG_COUNT;
+                    switch (rndUse(rndGen)) {
+                        case 0:
+                            pass.reads(resource);
+                            break;
+                        case 1:
+                            pass.writes(resource);
+                            break;
+                        case 2:
+                            pass.readsWrites(resource);
+                            break;
+                        case 3:
+                            pingPong ? pass.writesNext(resource) : pass.writes(resource);
+                            break;
+                        default:
+                            pingPong ? pass.readsWritesNext(resource) : pass.readsWrites(resource);
+                            break;
+                    }
+                }
+            }
+            for (uint32_t orientation = 0; orientation < 2; ++orientation) {
+                const auto hazards = graph.validate();
+                if (!hazards.empty()) {
+                    error("Random graph " + std::to_string(g) + ": " + hazards[0]);
+                }
+                const auto statistics = graph.statistics();
+                if (statistics.passes != RANDOM_PASS_COUNT || statistics.batches > statistics.passes ||
+                    statistics.pipelineBarriers + 1 > std::max(statistics.batches, 1u)) {
+                    error("Random graph " + std::to_string(g) + ": inconsistent statistics");
+                }
+                passes += statistics.passes;
+                batches += statistics.batches;
+                barriers += statistics.pipelineBarriers;
+                // Start from the other orientation if the graph swaps any buffers, which compiles it again
+                if (!graph.swapsParity()) {
+                    break;
+                }
+                graph.advance();
+            }
+        }
+        LOG("%u random graphs: %u passes in %u batches with %u barriers\n", RANDOM_GRAPH_COUNT, passes, batches, barriers);
+    }
+
+    uint32_t run() {
+        checkValidator();
+        checkSchedules();
+        checkRandomGraphs();
+        return finish();
+    }
+};
+
+RUN_CHECK(ComputeGraphCheck)
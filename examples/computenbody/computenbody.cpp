@@ -7,6 +7,8 @@
 */
 
 #include <vulkanExampleBase.h>
+#include <nbody.hpp>
+#include <asynccompute.hpp>
 
 #if defined(__ANDROID__)
 // Lower particle count on Android for performance reasons
@@ -15,6 +17,12 @@
 #define PARTICLES_PER_ATTRACTOR 4 * 1024
 #endif
 
+// The all pairs solver is quadratic in the particle count, larger systems are only offered with the tree solver
+#define MAX_EXACT_PARTICLES_PER_ATTRACTOR 16 * 1024
+
+// Timestamps for the longest sequence of stages (tree solver) plus the start of the frame
+#define MAX_TIMESTAMPS 8
+
 class ComputeNBody : public vkx::Compute {
     using Parent = vkx::Compute;
 
@@ -22,20 +30,54 @@ public:
     ComputeNBody(const vks::Context& context)
         : Parent(context) {}
     // SSBO particle declaration
-    struct Particle {
-        glm::vec4 pos;  // xyz = position, w = mass
-        glm::vec4 vel;  // xyz = velocity, w = gradient texture position
+    using Particle = vkx::nbody::Particle;
+
+    enum class Solver
+    {
+        exact,  // All pairs with tiles in shared memory, O(N^2)
+        tree,   // Barnes-Hut over a linear BVH built every frame, O(N log N)
+    };
+
+    // Linear BVH node, see bh_build.comp
+    struct Node {
+        glm::vec4 centerOfMass;
+        glm::vec4 boundsMin;
+        glm::vec4 boundsMax;
+        int32_t left, right, parent, visits;
     };
+
+    Solver solver{ Solver::exact };
+    vkx::nbody::Parameters parameters;
+    uint32_t particlesPerAttractor{ PARTICLES_PER_ATTRACTOR };
     uint32_t numParticles;
     vks::Buffer storageBuffer;        // (Shader) storage buffer object containing the particles
     vks::Buffer uniformBuffer;        // Uniform buffer object containing particle system parameters
-    vk::CommandBuffer commandBuffer;  // Command buffer storing the dispatch commands and barriers
+    vks::Buffer accelerationBuffer;   // Accelerations of the last force pass, used for validation
+    // Barnes-Hut tree construction
+    struct {
+        vks::Buffer bounds;       // Scene bounds
+        vks::Buffer keys[2];      // Morton codes, ping-ponged by the radix sort
+        vks::Buffer values[2];    // Particle indices sorted along with the keys
+        vks::Buffer histogram;    // Radix digit counts per workgroup
+        vks::Buffer nodes;        // N - 1 internal nodes
+        vks::Buffer leafParents;  // Parent node of each sorted particle
+    } tree;
     vk::DescriptorPool descriptorPool;
     vk::DescriptorSetLayout descriptorSetLayout;  // Compute shader binding layout
     vk::DescriptorSet descriptorSet;              // Compute shader bindings
     vk::PipelineLayout pipelineLayout;            // Layout of the compute pipeline
     vk::Pipeline pipelineCalculate;               // Compute pipeline for N-Body velocity calculation (1st pass)
     vk::Pipeline pipelineIntegrate;               // Compute pipeline for euler integration (2nd pass)
+    struct {
+        vk::Pipeline bounds;
+        vk::Pipeline morton;
+        vk::Pipeline histogram;
+        vk::Pipeline scan;
+        vk::Pipeline scatter;
+        vk::Pipeline build;
+        vk::Pipeline summarize;
+        vk::Pipeline calculate;  // Replaces pipelineCalculate in tree mode
+    } pipelinesTree;
     vk::Pipeline blur;
     vk::PipelineLayout pipelineLayoutBlur;
     vk::DescriptorSetLayout descriptorSetLayoutBlur;
@@ -45,33 +87,80 @@ public:
         float destX{ 0 };   //		x position of the attractor
         float destY{ 0 };   //		y position of the attractor
         int32_t particleCount;
+        float theta{ 0.5f };  //		Barnes-Hut opening angle
     } ubo;
 
+    // Per stage GPU timings in milliseconds, only available if the compute queue supports timestamps
+    vk::QueryPool queryPool;
+    std::vector<std::string> stageNames;
+    std::vector<float> stageTimings;
+
+    // Accuracy of the last force pass compared to the CPU reference
+    struct Validation {
+        vkx::nbody::ErrorStats gpu;      // GPU accelerations against the exact CPU sum
+        vkx::nbody::ErrorStats cpuTree;  // CPU octree at the same opening angle against the exact CPU sum
+        float cpuMilliseconds{ 0.0f };
+    };
+
+    // Simulation on the CPU instead of the compute shaders.  The CPU always evaluates all pairs and uploads
+    // the particles every frame.
+    bool cpu{ false };
+    vkx::simd::Backend cpuBackend{ vkx::simd::best() };
+    vkx::nbody::Simulation cpuSimulation;
+    vkx::ThreadPool threadPool;
+    Upload upload;
+    float cpuStepMilliseconds{ 0.0f };
+
+    // Overlap of the simulation with the graphics queue, used instead of the semaphores of vkx::Compute if
+    // the device supports timeline semaphores.  The graphics pipeline then draws from the target buffer.
+    bool asyncCompute{ false };
+    vkx::AsyncCompute async{ *this };
+
     void prepare() {
         Parent::prepare();
 
         // Create compute pipeline
         // Compute pipelines are created separate from graphics pipelines even if they use the same queue (family index)
+        prepareQueryPool();
         prepareStorageBuffers();
         prepareDescriptors();
         preparePipelines();
     }
 
     void destroy() {
-        storageBuffer.destroy();
+        destroyUpload(upload);
+        destroyStorageBuffers();
         uniformBuffer.destroy();
         device.destroy(pipelineCalculate);
         device.destroy(pipelineIntegrate);
+        device.destroy(pipelinesTree.bounds);
+        device.destroy(pipelinesTree.morton);
+        device.destroy(pipelinesTree.histogram);
+        device.destroy(pipelinesTree.scan);
+        device.destroy(pipelinesTree.scatter);
+        device.destroy(pipelinesTree.build);
+        device.destroy(pipelinesTree.summarize);
+        device.destroy(pipelinesTree.calculate);
         device.destroy(pipelineLayout);
         device.destroy(descriptorSetLayout);
         device.destroy(descriptorPool);
+        if (queryPool) {
+            device.destroy(queryPool);
+        }
         Parent::destroy();
     }
 
+    void prepareQueryPool() {
+        if (context.queueFamilyProperties[context.queueIndices.compute].timestampValidBits == 0) {
+            return;
+        }
+        queryPool = device.createQueryPool({ {}, vk::QueryType::eTimestamp, MAX_TIMESTAMPS });
+    }
+
     void prepareDescriptors() {
         std::vector<vk::DescriptorPoolSize> poolSizes = {
             { vk::DescriptorType::eUniformBuffer, 2 },
-            { vk::DescriptorType::eStorageBuffer, 1 },
+            { vk::DescriptorType::eStorageBuffer, 10 },
             { vk::DescriptorType::eCombinedImageSampler, 2 },
         };
 
@@ -81,17 +170,46 @@ public:
             { 0, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
             // Binding 1 : Uniform buffer
             { 1, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 2 : Accelerations
+            { 2, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            // Binding 3 - 10 : Tree construction, only used by the Barnes-Hut solver
+            { 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            { 4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            { 5, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            { 6, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            { 7, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            { 8, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            { 9, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
+            { 10, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute },
         };
 
         descriptorSetLayout =
             device.createDescriptorSetLayout(vk::DescriptorSetLayoutCreateInfo{ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
         descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+        updateDescriptorSet();
+    }
 
+    void updateDescriptorSet() {
         std::vector<vk::WriteDescriptorSet> computeWriteDescriptorSets{
             // Binding 0 : Particle position storage buffer
             { descriptorSet, 0, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &storageBuffer.descriptor },
             // Binding 1 : Uniform buffer
             { descriptorSet, 1, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffer.descriptor },
+            // Binding 2 : Accelerations
+            { descriptorSet, 2, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &accelerationBuffer.descriptor },
+            // Binding 3 : Scene bounds
+            { descriptorSet, 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &tree.bounds.descriptor },
+            // Binding 4 - 7 : Sort keys and values, A and B
+            { descriptorSet, 4, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &tree.keys[0].descriptor },
+            { descriptorSet, 5, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &tree.values[0].descriptor },
+            { descriptorSet, 6, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &tree.keys[1].descriptor },
+            { descriptorSet, 7, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &tree.values[1].descriptor },
+            // Binding 8 : Radix histogram
+            { descriptorSet, 8, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &tree.histogram.descriptor },
+            // Binding 9 : Tree nodes
+            { descriptorSet, 9, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &tree.nodes.descriptor },
+            // Binding 10 : Leaf parents
+            { descriptorSet, 10, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &tree.leafParents.descriptor },
         };
 
         device.updateDescriptorSets(computeWriteDescriptorSets, nullptr);
@@ -99,12 +217,11 @@ public:
 
     void preparePipelines() {
         // Create pipelines
-        pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+        // The radix sort passes select the digit and the ping-pong direction via push constants
+        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, 2 * sizeof(uint32_t) };
+        pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout, 1, &pushConstantRange });
         vk::ComputePipelineCreateInfo computePipelineCreateInfo;
         computePipelineCreateInfo.layout = pipelineLayout;
-        // 1st pass
-        computePipelineCreateInfo.stage =
-            vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/computenbody/particle_calculate.comp.spv", vk::ShaderStageFlagBits::eCompute);
         // Set shader parameters via specialization constants
         struct SpecializationData {
             uint32_t sharedDataSize;
@@ -113,33 +230,45 @@ public:
             float soften;
         } specializationData;
 
-        std::vector<vk::SpecializationMapEntry> specializationMapEntries{
-            { 0, offsetof(SpecializationData, sharedDataSize), sizeof(uint32_t) },
-            { 1, offsetof(SpecializationData, gravity), sizeof(float) },
-            { 2, offsetof(SpecializationData, power), sizeof(float) },
-            { 3, offsetof(SpecializationData, soften), sizeof(float) },
+        vks::pipelines::SpecializationLayout<SpecializationData> specializationLayout{
+            &SpecializationData::sharedDataSize,
+            &SpecializationData::gravity,
+            &SpecializationData::power,
+            &SpecializationData::soften,
         };
 
         specializationData.sharedDataSize =
             std::min((uint32_t)1024, (uint32_t)(context.deviceProperties.limits.maxComputeSharedMemorySize / sizeof(glm::vec4)));
 
-        specializationData.gravity = 0.002f;
-        specializationData.power = 0.75f;
-        specializationData.soften = 0.05f;
+        specializationData.gravity = parameters.gravity;
+        specializationData.power = parameters.power;
+        specializationData.soften = parameters.soften;
 
-        vk::SpecializationInfo specializationInfo{ static_cast<uint32_t>(specializationMapEntries.size()), specializationMapEntries.data(),
-                                                   sizeof(specializationData), &specializationData };
-        computePipelineCreateInfo.stage.pSpecializationInfo = &specializationInfo;
-        pipelineCalculate = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
-        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+        vk::SpecializationInfo specializationInfo = specializationLayout.info(specializationData);
+
+        auto createPipeline = [&](const std::string& shaderName, const vk::SpecializationInfo* pSpecializationInfo) {
+            computePipelineCreateInfo.stage = vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/computenbody/" + shaderName + ".comp.spv",
+                                                                      vk::ShaderStageFlagBits::eCompute);
+            computePipelineCreateInfo.stage.pSpecializationInfo = pSpecializationInfo;
+            auto pipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+            device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+            return pipeline;
+        };
+
+        // 1st pass
+        pipelineCalculate = createPipeline("particle_calculate", &specializationInfo);
         // 2nd pass
-        computePipelineCreateInfo.stage =
-            vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/computenbody/particle_integrate.comp.spv", vk::ShaderStageFlagBits::eCompute);
-        pipelineIntegrate = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
-        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+        pipelineIntegrate = createPipeline("particle_integrate", nullptr);
 
-        // Create a command buffer for compute operations
-        commandBuffer = device.allocateCommandBuffers({ commandPool, vk::CommandBufferLevel::ePrimary, 1 })[0];
+        // Barnes-Hut tree construction and force approximation, replacing the 1st pass in tree mode
+        pipelinesTree.bounds = createPipeline("bh_bounds", nullptr);
+        pipelinesTree.morton = createPipeline("bh_morton", nullptr);
+        pipelinesTree.histogram = createPipeline("bh_radix_histogram", nullptr);
+        pipelinesTree.scan = createPipeline("bh_radix_scan", nullptr);
+        pipelinesTree.scatter = createPipeline("bh_radix_scatter", nullptr);
+        pipelinesTree.build = createPipeline("bh_build", nullptr);
+        pipelinesTree.summarize = createPipeline("bh_summarize", nullptr);
+        pipelinesTree.calculate = createPipeline("bh_calculate", &specializationInfo);
 
         // Build a single command buffer containing the compute dispatch commands
         buildComputeCommandBuffer();
@@ -159,10 +288,12 @@ public:
         };
 #endif
 
-        numParticles = static_cast<uint32_t>(attractors.size()) * PARTICLES_PER_ATTRACTOR;
+        numParticles = static_cast<uint32_t>(attractors.size()) * particlesPerAttractor;
         ubo.particleCount = numParticles;
         // Compute shader uniform buffer block
-        uniformBuffer = context.createUniformBuffer(ubo);
+        if (!uniformBuffer) {
+            uniformBuffer = context.createUniformBuffer(ubo);
+        }
 
         // Initial particle positions
         std::vector<Particle> particleBuffer(numParticles);
@@ -171,8 +302,8 @@ public:
         std::normal_distribution<float> rndDist(0.0f, 1.0f);
 
         for (uint32_t i = 0; i < static_cast<uint32_t>(attractors.size()); i++) {
-            for (uint32_t j = 0; j < PARTICLES_PER_ATTRACTOR; j++) {
-                Particle& particle = particleBuffer[i * PARTICLES_PER_ATTRACTOR + j];
+            for (uint32_t j = 0; j < particlesPerAttractor; j++) {
+                Particle& particle = particleBuffer[i * particlesPerAttractor + j];
 
                 // First particle in group as heavy center of gravity
                 if (j == 0) {
@@ -199,40 +330,369 @@ public:
             }
         }
 
-        storageBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer, particleBuffer);
+        storageBuffer = context.stageToDeviceBuffer(
+            vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc, particleBuffer);
+
+        const vk::BufferUsageFlags usage = vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eTransferSrc;
+        const uint32_t groupCount = (numParticles + 255) / 256;
+        accelerationBuffer = context.createDeviceBuffer(usage, numParticles * sizeof(glm::vec4));
+        tree.bounds = context.createDeviceBuffer(usage | vk::BufferUsageFlagBits::eTransferDst, 2 * sizeof(glm::uvec4));
+        for (uint32_t i = 0; i < 2; ++i) {
+            tree.keys[i] = context.createDeviceBuffer(usage, numParticles * sizeof(uint32_t));
+            tree.values[i] = context.createDeviceBuffer(usage, numParticles * sizeof(uint32_t));
+        }
+        tree.histogram = context.createDeviceBuffer(usage, 16 * groupCount * sizeof(uint32_t));
+        tree.nodes = context.createDeviceBuffer(usage, (numParticles - 1) * sizeof(Node));
+        tree.leafParents = context.createDeviceBuffer(usage, numParticles * sizeof(int32_t));
+
+        if (asyncCompute) {
+            async.create(storageBuffer, numParticles * sizeof(Particle));
+        }
+    }
+
+    const vks::Buffer& vertexBuffer() const { return async ? async.target() : storageBuffer; }
+
+    void destroyStorageBuffers() {
+        async.destroy();
+        storageBuffer.destroy();
+        accelerationBuffer.destroy();
+        tree.bounds.destroy();
+        for (uint32_t i = 0; i < 2; ++i) {
+            tree.keys[i].destroy();
+            tree.values[i].destroy();
+        }
+        tree.histogram.destroy();
+        tree.nodes.destroy();
+        tree.leafParents.destroy();
+    }
+
+    // Recreate the particle system with a different size.  The caller has to rebuild any graphics
+    // command buffers that draw the particles.
+    void resize(uint32_t newParticlesPerAttractor) {
+        device.waitIdle();
+        particlesPerAttractor = newParticlesPerAttractor;
+        destroyUpload(upload);
+        destroyStorageBuffers();
+        prepareStorageBuffers();
+        updateDescriptorSet();
+        // The asynchronous step commands upload CPU steps from the staging buffer
+        if (cpu) {
+            startCpu();
+        }
+        buildComputeCommandBuffer();
+    }
+
+    // Continue the simulation on the CPU from the current GPU state
+    void startCpu() {
+        auto particles = download<Particle>(storageBuffer, numParticles);
+        cpuSimulation.load(particles.data(), particles.size());
+        upload = createUpload(storageBuffer, numParticles * sizeof(Particle));
+    }
+
+    void setBackend(bool useCpu, vkx::simd::Backend backend) {
+        device.waitIdle();
+        if (useCpu && !cpu) {
+            startCpu();
+        } else if (!useCpu && cpu) {
+            // The storage buffer already holds the last CPU step
+            destroyUpload(upload);
+        }
+        cpu = useCpu;
+        cpuBackend = backend;
+        if (async) {
+            recordAsync();
+        }
+    }
+
+    void setSolver(Solver newSolver) {
+        queue.waitIdle();
+        solver = newSolver;
+        buildComputeCommandBuffer();
+    }
+
+    // Ends a timed stage after `pass`.  `query` stays zero for graphs that are not timed.
+    void timestamp(vkx::ComputeGraph::Pass& pass, uint32_t& query, const std::string& stageName) {
+        if (query == 0) {
+            return;
+        }
+        const vk::QueryPool pool = queryPool;
+        const uint32_t index = query++;
+        pass.record([=](const vk::CommandBuffer& cmdBuffer) { cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eComputeShader, pool, index); });
+        stageNames.push_back(stageName);
+    }
+
+    // Add the force calculation of `forceSolver` to `graph`, followed by the integration when `integrate` is
+    // set.  The graph places the barriers between the passes from the buffers they access.
+    void buildSimulation(vkx::ComputeGraph& graph, Solver forceSolver, bool integrate, bool timed) {
+        const uint32_t groupCount = (numParticles + 255) / 256;
+        graph.clear();
+        const auto particles = graph.addBuffer("particles", storageBuffer.buffer);
+        const auto accelerations = graph.addBuffer("accelerations", accelerationBuffer.buffer);
+
+        uint32_t query = 0;
+        if (timed) {
+            stageNames.clear();
+            if (queryPool) {
+                const vk::QueryPool pool = queryPool;
+                graph.addPass("Timestamps").record([=](const vk::CommandBuffer& cmdBuffer) {
+                    cmdBuffer.resetQueryPool(pool, 0, MAX_TIMESTAMPS);
+                    cmdBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, pool, 0);
+                });
+                query = 1;
+            }
+        }
+
+        if (forceSolver == Solver::exact) {
+            // First pass: Calculate particle movement
+            // -------------------------------------------------------------------------------------------------------
+            auto& calculate = graph.addPass("Forces (all pairs)")
+                                  .pipeline(pipelineLayout, pipelineCalculate)
+                                  .descriptorSet(descriptorSet)
+                                  .readsWrites(particles)
+                                  .writes(accelerations)
+                                  .dispatch(groupCount);
+            timestamp(calculate, query, "Forces (all pairs)");
+        } else {
+            const auto bounds = graph.addBuffer("bounds", tree.bounds.buffer);
+            const vkx::ComputeGraph::Resource keys[2]{ graph.addBuffer("keys A", tree.keys[0].buffer), graph.addBuffer("keys B", tree.keys[1].buffer) };
+            const vkx::ComputeGraph::Resource values[2]{ graph.addBuffer("values A", tree.values[0].buffer),
+                                                         graph.addBuffer("values B", tree.values[1].buffer) };
+            const auto histogram = graph.addBuffer("histogram", tree.histogram.buffer);
+            const auto nodes = graph.addBuffer("nodes", tree.nodes.buffer);
+            const auto leafParents = graph.addBuffer("leaf parents", tree.leafParents.buffer);
+
+            // Scene bounds, reset to an empty box first
+            const vk::Buffer boundsBuffer = tree.bounds.buffer;
+            graph.addPass("Reset bounds").transfer().writes(bounds).record([=](const vk::CommandBuffer& cmdBuffer) {
+                cmdBuffer.fillBuffer(boundsBuffer, 0, sizeof(glm::uvec4), 0xFFFFFFFF);
+                cmdBuffer.fillBuffer(boundsBuffer, sizeof(glm::uvec4), sizeof(glm::uvec4), 0);
+            });
+            auto& boundsPass = graph.addPass("Bounds")
+                                   .pipeline(pipelineLayout, pipelinesTree.bounds)
+                                   .descriptorSet(descriptorSet)
+                                   .reads(particles)
+                                   .readsWrites(bounds)
+                                   .dispatch(groupCount);
+            timestamp(boundsPass, query, "Bounds");
+
+            auto& morton = graph.addPass("Morton codes")
+                               .pipeline(pipelineLayout, pipelinesTree.morton)
+                               .descriptorSet(descriptorSet)
+                               .reads(particles)
+                               .reads(bounds)
+                               .writes(keys[0])
+                               .writes(values[0])
+                               .dispatch(groupCount);
+            timestamp(morton, query, "Morton codes");
+
+            // Least significant digit first radix sort, 4 bits per pass.  The even number of passes leaves the
+            // result in the A buffers.
+            vkx::ComputeGraph::Pass* scatter = nullptr;
+            for (uint32_t pass = 0; pass < 8; ++pass) {
+                const uint32_t source = pass % 2;
+                const std::array<uint32_t, 2> pushConstants{ { pass * 4, source } };
+                const std::string digit = " " + std::to_string(pass);
+                graph.addPass("Radix histogram" + digit)
+                    .pipeline(pipelineLayout, pipelinesTree.histogram)
+                    .descriptorSet(descriptorSet)
+                    .pushConstants(pushConstants)
+                    .reads(keys[source])
+                    .writes(histogram)
+                    .dispatch(groupCount);
+                graph.addPass("Radix scan" + digit)
+                    .pipeline(pipelineLayout, pipelinesTree.scan)
+                    .descriptorSet(descriptorSet)
+                    .pushConstants(pushConstants)
+                    .readsWrites(histogram)
+                    .dispatch(1);
+                scatter = &graph.addPass("Radix scatter" + digit)
+                               .pipeline(pipelineLayout, pipelinesTree.scatter)
+                               .descriptorSet(descriptorSet)
+                               .pushConstants(pushConstants)
+                               .reads(keys[source])
+                               .reads(values[source])
+                               .reads(histogram)
+                               .writes(keys[1 - source])
+                               .writes(values[1 - source])
+                               .dispatch(groupCount);
+            }
+            timestamp(*scatter, query, "Radix sort");
+
+            auto& build = graph.addPass("Tree build")
+                              .pipeline(pipelineLayout, pipelinesTree.build)
+                              .descriptorSet(descriptorSet)
+                              .reads(keys[0])
+                              .writes(nodes)
+                              .writes(leafParents)
+                              .dispatch((numParticles - 1 + 255) / 256);
+            timestamp(build, query, "Tree build");
+
+            auto& summarize = graph.addPass("Tree summary")
+                                  .pipeline(pipelineLayout, pipelinesTree.summarize)
+                                  .descriptorSet(descriptorSet)
+                                  .reads(particles)
+                                  .reads(values[0])
+                                  .reads(leafParents)
+                                  .readsWrites(nodes)
+                                  .dispatch(groupCount);
+            timestamp(summarize, query, "Tree summary");
+
+            auto& calculate = graph.addPass("Forces (tree)")
+                                  .pipeline(pipelineLayout, pipelinesTree.calculate)
+                                  .descriptorSet(descriptorSet)
+                                  .readsWrites(particles)
+                                  .reads(values[0])
+                                  .reads(nodes)
+                                  .writes(accelerations)
+                                  .dispatch(groupCount);
+            timestamp(calculate, query, "Forces (tree)");
+        }
+
+        if (integrate) {
+            // Second pass: Integrate particles
+            // -------------------------------------------------------------------------------------------------------
+            auto& integratePass = graph.addPass("Integrate")
+                                      .pipeline(pipelineLayout, pipelineIntegrate)
+                                      .descriptorSet(descriptorSet)
+                                      .readsWrites(particles)
+                                      .dispatch(groupCount);
+            timestamp(integratePass, query, "Integrate");
+        }
+    }
+
+    // Record a graph built by buildSimulation() into a one time command buffer and wait for it
+    void runSimulation(vkx::ComputeGraph& simulation) {
+        vk::CommandBuffer cmdBuffer = device.allocateCommandBuffers({ commandPool, vk::CommandBufferLevel::ePrimary, 1 })[0];
+        cmdBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+        simulation.record(cmdBuffer);
+        cmdBuffer.end();
+        submitAndWait(cmdBuffer);
+        device.freeCommandBuffers(commandPool, cmdBuffer);
     }
 
     void buildComputeCommandBuffer() {
         // Compute particle movement
-        commandBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
-
-        // First pass: Calculate particle movement
-        // -------------------------------------------------------------------------------------------------------
-        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelineCalculate);
-        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
-        commandBuffer.dispatch(numParticles / 256, 1, 1);
-
-        // Add memory barrier to ensure that compute shader has finished writing to the buffer
-        vk::BufferMemoryBarrier bufferBarrier{ vk::AccessFlagBits::eShaderWrite,
-                                               vk::AccessFlagBits::eShaderRead,
-                                               VK_QUEUE_FAMILY_IGNORED,
-                                               VK_QUEUE_FAMILY_IGNORED,
-                                               storageBuffer.buffer,
-                                               0,
-                                               VK_WHOLE_SIZE };
-
-        // Second pass: Integrate particles
-        // -------------------------------------------------------------------------------------------------------
-        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, nullptr, bufferBarrier,
-                                      nullptr);
-        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipelineIntegrate);
-        commandBuffer.dispatch(numParticles / 256, 1, 1);
-        commandBuffer.end();
+        buildSimulation(graph, solver, true, true);
+        if (async) {
+            recordAsync();
+        } else {
+            buildGraphCommandBuffers();
+        }
+        stageTimings.assign(stageNames.size(), 0.0f);
+    }
+
+    // A step of the scheduler either runs the graph or uploads the step computed on the CPU
+    void recordAsync() {
+        async.record([this](const vk::CommandBuffer& cmdBuffer) {
+            if (cpu) {
+                cmdBuffer.copyBuffer(upload.staging.buffer, storageBuffer.buffer, vk::BufferCopy{ 0, 0, numParticles * sizeof(Particle) });
+            } else {
+                graph.record(cmdBuffer);
+            }
+        });
+    }
+
+    // Advance the CPU simulation and write the result to the staging buffer
+    void stepCpu() {
+        // The previous upload has to complete before the staging buffer is overwritten
+        queue.waitIdle();
+        auto tStart = std::chrono::high_resolution_clock::now();
+        cpuSimulation.step(ubo.deltaT, parameters, threadPool, cpuBackend);
+        cpuStepMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+        cpuSimulation.store(static_cast<Particle*>(upload.staging.mapped));
     }
 
     void submit() {
-        // Submit compute commands
-        Parent::submit(commandBuffer);
+        if (!cpu) {
+            // Submit compute commands
+            submitGraph();
+            return;
+        }
+        stepCpu();
+        Parent::submit(upload.commandBuffer);
+    }
+
+    // Fetch the timestamps of the last completed frame without waiting for the current one
+    void updateTimings() {
+        if (!queryPool || stageNames.empty() || cpu) {
+            return;
+        }
+        std::vector<uint64_t> timestamps(stageNames.size() + 1);
+        auto result = device.getQueryPoolResults(queryPool, 0, static_cast<uint32_t>(timestamps.size()), vk::ArrayProxy<uint64_t>{ timestamps },
+                                                 sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+        if (result != vk::Result::eSuccess) {
+            return;
+        }
+        const float period = context.deviceProperties.limits.timestampPeriod;
+        for (size_t i = 0; i < stageTimings.size(); ++i) {
+            stageTimings[i] = static_cast<float>(timestamps[i + 1] - timestamps[i]) * period / 1e6f;
+        }
+    }
+
+    // Run the force pass of the current solver once without moving any particles, and compare the resulting
+    // accelerations of `sampleCount` particles against the CPU reference
+    Validation validate(uint32_t sampleCount = 256) {
+        device.waitIdle();
+
+        // A zero time step leaves positions and velocities untouched
+        computeUBO savedUbo = ubo;
+        ubo.deltaT = 0.0f;
+        memcpy(uniformBuffer.mapped, &ubo, sizeof(ubo));
+
+        vkx::ComputeGraph simulation;
+        buildSimulation(simulation, solver, false, false);
+        runSimulation(simulation);
+
+        ubo = savedUbo;
+        memcpy(uniformBuffer.mapped, &ubo, sizeof(ubo));
+
+        auto particles = download<Particle>(storageBuffer, numParticles);
+        auto accelerations = download<glm::vec4>(accelerationBuffer, numParticles);
+
+        auto tStart = std::chrono::high_resolution_clock::now();
+        vkx::nbody::Octree octree;
+        octree.build(particles);
+        std::vector<glm::vec3> exact, gpu, cpuTree;
+        const uint32_t stride = std::max(1u, numParticles / sampleCount);
+        for (uint32_t i = 0; i < numParticles; i += stride) {
+            const glm::vec3 position{ particles[i].pos };
+            exact.push_back(vkx::nbody::accelerationExact(particles, position, parameters));
+            gpu.push_back(glm::vec3(accelerations[i]));
+            cpuTree.push_back(octree.acceleration(position, ubo.theta, parameters));
+        }
+        auto tEnd = std::chrono::high_resolution_clock::now();
+
+        Validation result;
+        result.gpu = vkx::nbody::compare(exact, gpu);
+        result.cpuTree = vkx::nbody::compare(exact, cpuTree);
+        result.cpuMilliseconds = std::chrono::duration<float, std::milli>(tEnd - tStart).count();
+        return result;
+    }
+
+    // Advance the particles by one all pairs step on the GPU and with the given CPU backend from the same
+    // state, and compare the results
+    vkx::simd::Comparison compareBackends(vkx::simd::Backend backend, float deltaT = 0.001f) {
+        device.waitIdle();
+        auto initial = download<Particle>(storageBuffer, numParticles);
+
+        computeUBO savedUbo = ubo;
+        ubo.deltaT = deltaT;
+        memcpy(uniformBuffer.mapped, &ubo, sizeof(ubo));
+        vkx::ComputeGraph simulation;
+        buildSimulation(simulation, Solver::exact, true, false);
+        runSimulation(simulation);
+        ubo = savedUbo;
+        memcpy(uniformBuffer.mapped, &ubo, sizeof(ubo));
+        auto gpu = download<Particle>(storageBuffer, numParticles);
+
+        vkx::nbody::Simulation reference;
+        reference.load(initial.data(), initial.size());
+        reference.step(deltaT, parameters, threadPool, backend);
+        if (cpu) {
+            // Continue from what is in the storage buffer now
+            cpuSimulation.load(gpu.data(), gpu.size());
+        }
+        return reference.compare(gpu.data());
     }
 };
 
@@ -260,8 +720,15 @@ public:
     // Resources for the compute part of the example
     ComputeNBody compute{ context };
 
+    const std::vector<uint32_t> particleCounts{ 1024, 4 * 1024, 16 * 1024, 64 * 1024, 256 * 1024 };
+    ComputeNBody::Validation validation;
+    bool validated{ false };
+    vkx::simd::Comparison backendComparison;
+    bool backendsCompared{ false };
+
     VulkanExample() {
         title = "Compute shader N-body system";
+        context.setDeviceExtensionsPicker([](const vk::PhysicalDevice& physicalDevice) { return vkx::AsyncCompute::getDeviceExtensions(physicalDevice); });
         settings.overlay = true;
         camera.type = Camera::CameraType::lookat;
         camera.setPerspective(60.0f, (float)width / (float)height, 0.1f, 512.0f);
@@ -284,6 +751,8 @@ public:
         textures.gradient.destroy();
     }
 
+    void getEnabledFeatures() override { compute.asyncCompute = compute.async.enableFeatures(context); }
+
     void loadAssets() override {
         textures.particle.loadFromFile(context, getAssetPath() + "textures/particle01_rgba.ktx", vF::eR8G8B8A8Unorm);
         textures.gradient.loadFromFile(context, getAssetPath() + "textures/particle_gradient_rgba.ktx", vF::eR8G8B8A8Unorm);
@@ -298,7 +767,7 @@ public:
         cmdBuffer.setScissor(0, scissor());
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, graphics.pipeline);
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, graphics.pipelineLayout, 0, graphics.descriptorSet, nullptr);
-        cmdBuffer.bindVertexBuffers(0, compute.storageBuffer.buffer, { 0 });
+        cmdBuffer.bindVertexBuffers(0, compute.vertexBuffer().buffer, { 0 });
         cmdBuffer.draw(compute.numParticles, 1, 0, 0);
     }
 
@@ -386,6 +855,18 @@ public:
     }
 
     void draw() override {
+        if (compute.async) {
+            if (compute.cpu) {
+                compute.stepCpu();
+            }
+            // Submits the steps this frame depends on before the graphics commands
+            compute.async.beginFrame();
+            ExampleBase::draw();
+            compute.async.endFrame();
+            compute.updateTimings();
+            return;
+        }
+
         // Submit graphics commands
         ExampleBase::draw();
 
@@ -393,12 +874,41 @@ public:
         std::call_once(once, [&] { addRenderWaitSemaphore(compute.semaphores.complete, vk::PipelineStageFlagBits::eComputeShader); });
         static const std::vector<vk::PipelineStageFlags> waitStages{ vk::PipelineStageFlagBits::eComputeShader };
         compute.submit();
+        compute.updateTimings();
+    }
+
+    void setSolver(ComputeNBody::Solver solver) {
+        // Keep the all pairs solver within interactive frame times
+        if (solver == ComputeNBody::Solver::exact && compute.particlesPerAttractor > MAX_EXACT_PARTICLES_PER_ATTRACTOR) {
+            setParticlesPerAttractor(PARTICLES_PER_ATTRACTOR);
+        }
+        compute.setSolver(solver);
+        validated = false;
+    }
+
+    void setParticlesPerAttractor(uint32_t count) {
+        compute.resize(count);
+        // The draw command buffers reference the particle buffer and count
+        buildCommandBuffers();
+        validated = false;
+        backendsCompared = false;
+    }
+
+    // 0 = GPU, 1 = CPU scalar, 2 = CPU with the widest instruction set
+    void setBackend(int32_t index) {
+        if (index > 0) {
+            // Same particle count limit as the all pairs solver on the GPU
+            setSolver(ComputeNBody::Solver::exact);
+        }
+        compute.setBackend(index > 0, index == 2 ? vkx::simd::best() : vkx::simd::Backend::scalar);
     }
 
     void prepare() override {
         ExampleBase::prepare();
         compute.prepare();
-        renderSignalSemaphores.push_back(compute.semaphores.ready);
+        if (!compute.async) {
+            renderSignalSemaphores.push_back(compute.semaphores.ready);
+        }
 
         prepareUniformBuffers();
         setupDescriptorSetLayout();
@@ -415,6 +925,104 @@ public:
     }
 
     void viewChanged() override { updateGraphicsUniformBuffers(); }
+
+    void keyPressed(uint32_t key) override {
+        switch (key) {
+            case KEY_T:
+                if (!compute.cpu) {
+                    setSolver(compute.solver == ComputeNBody::Solver::exact ? ComputeNBody::Solver::tree : ComputeNBody::Solver::exact);
+                }
+                break;
+        }
+    }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            std::vector<std::string> backendNames{ "GPU", "CPU scalar" };
+            if (vkx::simd::best() != vkx::simd::Backend::scalar) {
+                backendNames.push_back(std::string("CPU ") + vkx::simd::name(vkx::simd::best()));
+            }
+            int32_t backendIndex = !compute.cpu ? 0 : (compute.cpuBackend == vkx::simd::Backend::scalar ? 1 : 2);
+            if (ui.comboBox("Backend", &backendIndex, backendNames)) {
+                setBackend(backendIndex);
+            }
+            int32_t solverIndex = static_cast<int32_t>(compute.solver);
+            if (!compute.cpu && ui.comboBox("Solver", &solverIndex, { "All pairs", "Barnes-Hut" })) {
+                setSolver(static_cast<ComputeNBody::Solver>(solverIndex));
+            }
+            if (compute.solver == ComputeNBody::Solver::tree) {
+                // Read by the shaders through the uniform buffer, which is updated every frame
+                ui.sliderFloat("Opening angle", &compute.ubo.theta, 0.0f, 1.5f);
+            }
+            std::vector<std::string> countNames;
+            int32_t countIndex = 0;
+            for (const auto& count : particleCounts) {
+                if (compute.solver == ComputeNBody::Solver::exact && count > MAX_EXACT_PARTICLES_PER_ATTRACTOR) {
+                    break;
+                }
+                if (count == compute.particlesPerAttractor) {
+                    countIndex = static_cast<int32_t>(countNames.size());
+                }
+                countNames.push_back(std::to_string(count / 1024) + "K");
+            }
+            if (ui.comboBox("Particles per attractor", &countIndex, countNames)) {
+                setParticlesPerAttractor(particleCounts[countIndex]);
+            }
+            if (ui.button("Validate against CPU")) {
+                validation = compute.validate();
+                validated = true;
+            }
+            if (compute.particlesPerAttractor <= MAX_EXACT_PARTICLES_PER_ATTRACTOR && ui.button("Compare CPU and GPU step")) {
+                backendComparison = compute.compareBackends(vkx::simd::best());
+                backendsCompared = true;
+            }
+        }
+        if (ui.header("Statistics")) {
+            ui.text("%u particles", compute.numParticles);
+            if (compute.cpu) {
+                ui.text("CPU step (%u threads): %.3f ms", compute.threadPool.size(), compute.cpuStepMilliseconds);
+            } else if (!compute.queryPool) {
+                ui.text("Timestamps not supported by the compute queue");
+            } else {
+                float total = 0.0f;
+                for (size_t i = 0; i < compute.stageTimings.size(); ++i) {
+                    ui.text("%s: %.3f ms", compute.stageNames[i].c_str(), compute.stageTimings[i]);
+                    total += compute.stageTimings[i];
+                }
+                ui.text("Compute total: %.3f ms", total);
+            }
+            if (compute.async) {
+                bool overlap = compute.async.mode == vkx::AsyncCompute::Mode::overlapped;
+                if (ui.checkBox("Overlap with graphics", &overlap)) {
+                    compute.async.mode = overlap ? vkx::AsyncCompute::Mode::overlapped : vkx::AsyncCompute::Mode::serialized;
+                    compute.async.resetStatistics();
+                }
+                if (compute.async.measurementAvailable()) {
+                    const auto overlapStatistics = compute.async.statistics();
+                    ui.text("Step %.3f ms, frame %.3f ms", overlapStatistics.computeMilliseconds, overlapStatistics.graphicsMilliseconds);
+                    ui.text("Overlap %.3f ms (%.0f%% of the step), %u frames", overlapStatistics.overlapMilliseconds, overlapStatistics.overlap() * 100.0f,
+                            overlapStatistics.frames);
+                    if (ui.button("Reset overlap measurement")) {
+                        compute.async.resetStatistics();
+                    }
+                }
+            } else {
+                ui.text("Timeline semaphores not supported, compute and graphics alternate");
+            }
+            if (validated) {
+                ui.text("GPU error: max %.2e, mean %.2e", validation.gpu.maxRelative, validation.gpu.meanRelative);
+                if (compute.solver == ComputeNBody::Solver::tree) {
+                    ui.text("CPU octree error: max %.2e, mean %.2e", validation.cpuTree.maxRelative, validation.cpuTree.meanRelative);
+                }
+                ui.text("%u samples, CPU reference %.0f ms", validation.gpu.samples, validation.cpuMilliseconds);
+            }
+            if (backendsCompared) {
+                ui.text("CPU %s vs GPU: %s, max %u ulps / %.2e", vkx::simd::name(vkx::simd::best()), backendComparison.passed() ? "match" : "MISMATCH",
+                        backendComparison.maxUlps, backendComparison.maxAbsolute);
+                ui.text("%zu of %zu values outside tolerance", backendComparison.mismatches, backendComparison.count);
+            }
+        }
+    }
 };
 
 VULKAN_EXAMPLE_MAIN()
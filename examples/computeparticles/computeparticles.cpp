@@ -9,6 +9,7 @@
 */
 
 #include <vulkanExampleBase.h>
+#include <attractor.hpp>
 
 #if defined(__ANDROID__)
 // Lower particle count on Android for performance reasons
@@ -17,11 +18,7 @@
 #define PARTICLE_COUNT 256 * 1024
 #endif
 
-struct Particle {
-    glm::vec2 pos;
-    glm::vec2 vel;
-    glm::vec4 gradientPos;
-};
+using Particle = vkx::attractor::Particle;
 
 class ComputeParticles : public vkx::Compute {
     using Parent = vkx::Compute;
@@ -48,6 +45,14 @@ public:
         int32_t particleCount = PARTICLE_COUNT;
     } ubo;
 
+    // Simulation on the CPU instead of the compute shader, uploading the particles every frame
+    bool cpu{ false };
+    vkx::simd::Backend cpuBackend{ vkx::simd::best() };
+    vkx::attractor::Simulation cpuSimulation;
+    vkx::ThreadPool threadPool;
+    Upload upload;
+    float cpuStepMilliseconds{ 0.0f };
+
     void prepare() {
         Parent::prepare();
         prepareBuffers();
@@ -63,6 +68,7 @@ public:
     }
 
     void destroy() {
+        destroyUpload(upload);
         buffers.storage.destroy();
         buffers.uniform.destroy();
         device.destroy(pipelineLayout);
@@ -147,7 +153,66 @@ public:
         buffers.storage = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer, particleBuffer);
     }
 
-    void submit() { Parent::submit(commandBuffer); }
+    void submit() {
+        if (!cpu) {
+            Parent::submit(commandBuffer);
+            return;
+        }
+
+        // The previous upload has to complete before the staging buffer is overwritten
+        queue.waitIdle();
+        auto tStart = std::chrono::high_resolution_clock::now();
+        cpuSimulation.step(parameters(), threadPool, cpuBackend);
+        cpuStepMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+        cpuSimulation.store(static_cast<Particle*>(upload.staging.mapped));
+        Parent::submit(upload.commandBuffer);
+    }
+
+    vkx::attractor::Parameters parameters() const {
+        vkx::attractor::Parameters result;
+        result.deltaT = ubo.deltaT;
+        result.destX = ubo.destX;
+        result.destY = ubo.destY;
+        return result;
+    }
+
+    void setBackend(bool useCpu, vkx::simd::Backend backend) {
+        device.waitIdle();
+        if (useCpu && !cpu) {
+            // Continue from the current GPU state
+            auto particles = download<Particle>(buffers.storage, PARTICLE_COUNT);
+            cpuSimulation.load(particles.data(), particles.size());
+            upload = createUpload(buffers.storage, PARTICLE_COUNT * sizeof(Particle));
+        } else if (!useCpu && cpu) {
+            destroyUpload(upload);
+        }
+        cpu = useCpu;
+        cpuBackend = backend;
+    }
+
+    // Advance the particles by one step on the GPU and with the given CPU backend from the same state, and
+    // compare the results
+    vkx::simd::Comparison compareBackends(vkx::simd::Backend backend, float deltaT = 0.04f) {
+        device.waitIdle();
+        auto initial = download<Particle>(buffers.storage, PARTICLE_COUNT);
+
+        UBO savedUbo = ubo;
+        ubo.deltaT = deltaT;
+        memcpy(buffers.uniform.mapped, &ubo, sizeof(ubo));
+        submitAndWait(commandBuffer);
+        auto gpu = download<Particle>(buffers.storage, PARTICLE_COUNT);
+
+        vkx::attractor::Simulation reference;
+        reference.load(initial.data(), initial.size());
+        reference.step(parameters(), threadPool, backend);
+        ubo = savedUbo;
+        memcpy(buffers.uniform.mapped, &ubo, sizeof(ubo));
+        if (cpu) {
+            // Continue from what is in the storage buffer now
+            cpuSimulation.load(gpu.data(), gpu.size());
+        }
+        return reference.compare(gpu.data());
+    }
 };
 
 class VulkanExample : public vkx::ExampleBase {
@@ -155,6 +220,8 @@ public:
     float timer = 0.0f;
     float animStart = 20.0f;
     bool animate = true;
+    vkx::simd::Comparison backendComparison;
+    bool backendsCompared{ false };
 
     ComputeParticles compute{ context };
     struct {
@@ -327,6 +394,30 @@ public:
     void OnUpdateUIOverlay() override {
         if (ui.header("Settings")) {
             ui.checkBox("Moving attractor", &animate);
+            // 0 = GPU, 1 = CPU scalar, 2 = CPU with the widest instruction set
+            std::vector<std::string> backendNames{ "GPU", "CPU scalar" };
+            if (vkx::simd::best() != vkx::simd::Backend::scalar) {
+                backendNames.push_back(std::string("CPU ") + vkx::simd::name(vkx::simd::best()));
+            }
+            int32_t backendIndex = !compute.cpu ? 0 : (compute.cpuBackend == vkx::simd::Backend::scalar ? 1 : 2);
+            if (ui.comboBox("Backend", &backendIndex, backendNames)) {
+                compute.setBackend(backendIndex > 0, backendIndex == 2 ? vkx::simd::best() : vkx::simd::Backend::scalar);
+            }
+            if (ui.button("Compare CPU and GPU step")) {
+                backendComparison = compute.compareBackends(vkx::simd::best());
+                backendsCompared = true;
+            }
+        }
+        if (ui.header("Statistics")) {
+            ui.text("%u particles", PARTICLE_COUNT);
+            if (compute.cpu) {
+                ui.text("CPU step (%u threads): %.3f ms", compute.threadPool.size(), compute.cpuStepMilliseconds);
+            }
+            if (backendsCompared) {
+                ui.text("CPU %s vs GPU: %s, max %u ulps / %.2e", vkx::simd::name(vkx::simd::best()), backendComparison.passed() ? "match" : "MISMATCH",
+                        backendComparison.maxUlps, backendComparison.maxAbsolute);
+                ui.text("%zu of %zu values outside tolerance", backendComparison.mismatches, backendComparison.count);
+            }
         }
     }
 };
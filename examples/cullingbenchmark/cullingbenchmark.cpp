@@ -0,0 +1,176 @@
+/*
+* Vulkan Example - CPU benchmark of frustum culling
+*
+* Culls a large scene of spheres and boxes against a camera turning in place, one view per step, with the
+* per object vks::Frustum tests, the SIMD kernels of vkx::culling::ObjectSet and the vkx::culling::Bvh.  Every
+* available instruction set is run single threaded and on all cores, and the visible objects are compared
+* against vks::Frustum.  Needs no GPU.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <common.hpp>
+#include <culling.hpp>
+
+#include <numeric>
+
+#if defined(__ANDROID__)
+#define LOG(...) ((void)__android_log_print(ANDROID_LOG_INFO, "vulkanExample", __VA_ARGS__))
+#else
+#define LOG(...) printf(__VA_ARGS__)
+#endif
+
+#define OBJECT_COUNT 1024 * 1024
+// Half the side of the square the objects are spread over
+#define SCENE_EXTENT 512.0f
+// Views the camera cycles through, turning a little between each
+#define VIEW_COUNT 64
+
+// Minimum time to run each configuration
+static const double MIN_SECONDS = 1.0;
+
+class CullingBenchmark {
+public:
+    std::vector<vkx::simd::Backend> backends;
+    std::vector<uint32_t> threadCounts;
+
+    std::vector<glm::vec3> centers;
+    std::vector<glm::vec3> extents;
+    std::vector<float> radii;
+    std::vector<glm::vec3> boundsMin, boundsMax;
+    std::vector<vks::Frustum> views;
+    // Visible objects of each view according to vks::Frustum
+    std::vector<uint32_t> referenceSpheres, referenceBoxes;
+    uint32_t mismatches = 0;
+
+    CullingBenchmark() {
+        backends.push_back(vkx::simd::Backend::scalar);
+        if (vkx::simd::best() != vkx::simd::Backend::scalar) {
+            backends.push_back(vkx::simd::best());
+        }
+        threadCounts.push_back(1);
+        const uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+        if (hardwareThreads > 1) {
+            threadCounts.push_back(hardwareThreads);
+        }
+        prepareScene();
+    }
+
+    void prepareScene() {
+        std::default_random_engine rndGen(0);
+        std::uniform_real_distribution<float> rndDist(-1.0f, 1.0f);
+        std::uniform_real_distribution<float> rndSize(0.25f, 4.0f);
+
+        centers.resize(OBJECT_COUNT);
+        extents.resize(OBJECT_COUNT);
+        radii.resize(OBJECT_COUNT);
+        boundsMin.resize(OBJECT_COUNT);
+        boundsMax.resize(OBJECT_COUNT);
+        for (uint32_t i = 0; i < OBJECT_COUNT; ++i) {
+            centers[i] = glm::vec3(rndDist(rndGen), rndDist(rndGen) * 0.1f, rndDist(rndGen)) * SCENE_EXTENT;
+            extents[i] = glm::vec3(rndSize(rndGen), rndSize(rndGen), rndSize(rndGen));
+            radii[i] = glm::length(extents[i]);
+            boundsMin[i] = centers[i] - extents[i];
+            boundsMax[i] = centers[i] + extents[i];
+        }
+
+        const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, SCENE_EXTENT);
+        views.resize(VIEW_COUNT);
+        referenceSpheres.resize(VIEW_COUNT);
+        referenceBoxes.resize(VIEW_COUNT);
+        for (uint32_t v = 0; v < VIEW_COUNT; ++v) {
+            const float angle = glm::radians(360.0f) * v / VIEW_COUNT;
+            const glm::vec3 eye{ 0.0f, 8.0f, 0.0f };
+            const glm::mat4 view = glm::lookAt(eye, eye + glm::vec3(sinf(angle), -0.1f, cosf(angle)), glm::vec3(0.0f, 1.0f, 0.0f));
+            views[v].update(projection * view);
+            referenceSpheres[v] = countSpheres(views[v]);
+            referenceBoxes[v] = countBoxes(views[v]);
+        }
+    }
+
+    uint32_t countSpheres(const vks::Frustum& frustum) const {
+        uint32_t visible = 0;
+        for (uint32_t i = 0; i < OBJECT_COUNT; ++i) {
+            visible += frustum.checkSphere(centers[i], radii[i]) ? 1 : 0;
+        }
+        return visible;
+    }
+
+    // Boxes are tested the way ObjectSet and Bvh store them, as center and half extent of their bounds
+    uint32_t countBoxes(const vks::Frustum& frustum) const {
+        uint32_t visible = 0;
+        for (uint32_t i = 0; i < OBJECT_COUNT; ++i) {
+            visible += frustum.checkBox((boundsMin[i] + boundsMax[i]) * 0.5f, (boundsMax[i] - boundsMin[i]) * 0.5f) ? 1 : 0;
+        }
+        return visible;
+    }
+
+    // Count a step whose visible objects differ from the reference
+    void check(const char* test, uint32_t view, uint32_t visible, uint32_t expected) {
+        if (visible != expected) {
+            if (mismatches == 0) {
+                LOG("%s: %u visible objects in view %u instead of %u\n", test, visible, view, expected);
+            }
+            ++mismatches;
+        }
+    }
+
+    // Cull the views one after the other until MIN_SECONDS have passed and print the throughput.  `step`
+    // culls the view with the given index.
+    template <typename StepFunction>
+    void measure(const char* test, vkx::simd::Backend backend, uint32_t threads, StepFunction step) {
+        // Warm up caches, the thread pool and the plane hints
+        for (uint32_t v = 0; v < VIEW_COUNT; ++v) {
+            step(v);
+        }
+        uint32_t steps = 0;
+        auto tStart = std::chrono::high_resolution_clock::now();
+        double seconds = 0.0;
+        do {
+            step(steps % VIEW_COUNT);
+            ++steps;
+            seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+        } while (seconds < MIN_SECONDS);
+
+        const double objectsPerSecond = static_cast<double>(OBJECT_COUNT) * steps / seconds;
+        LOG("%-10s %-8s %7u %7u %11.3f %16.3e\n", test, vkx::simd::name(backend), threads, steps, seconds * 1000.0 / steps, objectsPerSecond);
+    }
+
+    void run() {
+        LOG("%u objects, %u of them visible on average\n", OBJECT_COUNT, std::accumulate(referenceBoxes.begin(), referenceBoxes.end(), 0u) / VIEW_COUNT);
+        LOG("%-10s %-8s %7s %7s %11s %16s\n", "Test", "Backend", "Threads", "Steps", "ms/step", "Objects/s");
+        measure("Frustum", vkx::simd::Backend::scalar, 1, [&](uint32_t view) { check("Frustum", view, countSpheres(views[view]), referenceSpheres[view]); });
+
+        vkx::culling::ObjectSet spheres, boxes;
+        spheres.resize(OBJECT_COUNT, vkx::culling::Shape::sphere);
+        boxes.resize(OBJECT_COUNT, vkx::culling::Shape::box);
+        for (uint32_t i = 0; i < OBJECT_COUNT; ++i) {
+            spheres.setSphere(i, centers[i], radii[i]);
+            boxes.setBox(i, boundsMin[i], boundsMax[i]);
+        }
+        vkx::culling::Bvh bvh;
+        bvh.build(boundsMin, boundsMax);
+        std::vector<uint32_t> visible;
+
+        for (auto threads : threadCounts) {
+            vkx::ThreadPool pool(threads);
+            for (auto backend : backends) {
+                measure("Spheres", backend, threads, [&](uint32_t view) {
+                    spheres.cull(views[view], backend, pool);
+                    check("Spheres", view, spheres.visibleCount(), referenceSpheres[view]);
+                });
+                measure("Boxes", backend, threads, [&](uint32_t view) {
+                    boxes.cull(views[view], backend, pool);
+                    check("Boxes", view, boxes.visibleCount(), referenceBoxes[view]);
+                });
+                measure("BVH", backend, threads, [&](uint32_t view) {
+                    bvh.cull(views[view], backend, pool, visible);
+                    check("BVH", view, static_cast<uint32_t>(visible.size()), referenceBoxes[view]);
+                });
+            }
+        }
+        LOG("%u culled views differ from vks::Frustum\n", mismatches);
+    }
+};
+
+RUN_EXAMPLE(CullingBenchmark)
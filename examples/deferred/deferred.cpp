@@ -8,9 +8,14 @@
 
 #include <vulkanOffscreenExampleBase.hpp>
 #include <vks/model.hpp>
+#include <clusteredlighting.hpp>
+
+#include <random>
 
 // Texture properties
 #define TEX_DIM 1024
+// Lights the clusters have room for
+#define MAX_LIGHT_COUNT 16384
 
 // Vertex layout for this example
 vks::model::VertexLayout vertexLayout{ {
@@ -41,24 +46,15 @@ public:
         glm::mat4 view;
     } uboVS, uboOffscreenVS;
 
-    struct Light {
-        glm::vec4 position;
-        glm::vec4 color;
-        float radius;
-        float quadraticFalloff;
-        float linearFalloff;
-        float _pad;
-    };
-
-    struct {
-        Light lights[5];
-        glm::vec4 viewPos;
-    } uboFragmentLights;
+    // The five lights of the scene come first, the rest are spread around the model
+    int32_t lightCount = 1024;
+    // Culled into the clusters of the view frustum every frame, the composition only shades the lights of the
+    // cluster a pixel falls into
+    vkx::ClusteredLighting clusteredLighting{ context };
 
     struct {
         vks::Buffer vsFullScreen;
         vks::Buffer vsOffscreen;
-        vks::Buffer fsLights;
     } uniformData;
 
     struct {
@@ -88,6 +84,7 @@ public:
         camera.setRotation(glm::vec3(-0.75f, 12.5f, 0.0f));
         camera.setPerspective(60.0f, size, 0.1f, 256.0f);
         title = "Vulkan Example - Deferred shading";
+        settings.overlay = true;
     }
 
     ~VulkanExample() {
@@ -110,7 +107,7 @@ public:
         // Uniform buffers
         uniformData.vsOffscreen.destroy();
         uniformData.vsFullScreen.destroy();
-        uniformData.fsLights.destroy();
+        clusteredLighting.destroy();
         textures.colorMap.destroy();
     }
 
@@ -141,6 +138,8 @@ public:
         renderPassBeginInfo.pClearValues = clearValues.data();
 
         offscreen.cmdBuffer.begin(cmdBufInfo);
+        // Only reads the camera and the light count when it executes
+        clusteredLighting.record(offscreen.cmdBuffer);
         offscreen.cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
 
         vk::Viewport viewport = vks::util::viewport(offscreen.size);
@@ -244,6 +243,7 @@ public:
         std::vector<vk::DescriptorPoolSize> poolSizes{
             { vk::DescriptorType::eUniformBuffer, 8 },
             { vk::DescriptorType::eCombinedImageSampler, 8 },
+            { vk::DescriptorType::eStorageBuffer, 6 },
         };
         descriptorPool = device.createDescriptorPool({ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
     }
@@ -259,9 +259,10 @@ public:
             { 2, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
             // Binding 3 : Albedo texture target
             { 3, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
-            // Binding 4 : Fragment shader uniform buffer
-            { 4, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment },
         };
+        // Binding 4 - 7 : Clusters and their lights
+        auto clusterBindings = vkx::ClusteredLighting::descriptorBindings(4, vk::ShaderStageFlagBits::eFragment);
+        setLayoutBindings.insert(setLayoutBindings.end(), clusterBindings.begin(), clusterBindings.end());
 
         descriptorSetLayout = device.createDescriptorSetLayout({ {}, (uint32_t)setLayoutBindings.size(), setLayoutBindings.data() });
         pipelineLayouts.deferred = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
@@ -293,9 +294,10 @@ public:
             { descriptorSet, 2, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texDescriptorNormal },
             // Binding 3 : Albedo texture target
             { descriptorSet, 3, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texDescriptorAlbedo },
-            // Binding 4 : Fragment shader uniform buffer
-            { descriptorSet, 4, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.fsLights.descriptor },
         };
+        // Binding 4 - 7 : Clusters and their lights
+        auto clusterWrites = clusteredLighting.descriptorWrites(descriptorSet, 4);
+        writeDescriptorSets.insert(writeDescriptorSets.end(), clusterWrites.begin(), clusterWrites.end());
 
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
 
@@ -354,13 +356,13 @@ public:
         uniformData.vsFullScreen = context.createUniformBuffer(uboVS);
         // Deferred vertex shader
         uniformData.vsOffscreen = context.createUniformBuffer(uboOffscreenVS);
-        // Deferred fragment shader
-        uniformData.fsLights = context.createUniformBuffer(uboFragmentLights);
+        // Lights of the deferred fragment shader
+        clusteredLighting.create(MAX_LIGHT_COUNT);
 
         // Update
         updateUniformBuffersScreen();
         updateUniformBufferDeferredMatrices();
-        updateUniformBufferDeferredLights();
+        updateLights();
     }
 
     void updateUniformBuffersScreen() {
@@ -378,45 +380,42 @@ public:
         uboOffscreenVS.view = camera.matrices.view;
         uboOffscreenVS.model = glm::translate(glm::mat4(), glm::vec3(0.0f, 0.25f, 0.0f));
         uniformData.vsOffscreen.copy(uboOffscreenVS);
+        // The G-Buffer stores positions with y flipped, see mrt.vert
+        const glm::mat4 lightView = camera.matrices.view * glm::scale(glm::mat4(), glm::vec3(1.0f, -1.0f, 1.0f));
+        clusteredLighting.update(camera.matrices.perspective, lightView, camera.getNearClip(), camera.getFarClip());
     }
 
-    // Update fragment shader light position uniform block
-    void updateUniformBufferDeferredLights() {
-        // White light from above
-        uboFragmentLights.lights[0].position = glm::vec4(0.0f, 3.0f, 1.0f, 0.0f);
-        uboFragmentLights.lights[0].color = glm::vec4(1.5f);
-        uboFragmentLights.lights[0].radius = 15.0f;
-        uboFragmentLights.lights[0].linearFalloff = 0.3f;
-        uboFragmentLights.lights[0].quadraticFalloff = 0.4f;
-        // Red light
-        uboFragmentLights.lights[1].position = glm::vec4(-2.0f, 0.0f, 0.0f, 0.0f);
-        uboFragmentLights.lights[1].color = glm::vec4(1.5f, 0.0f, 0.0f, 0.0f);
-        uboFragmentLights.lights[1].radius = 15.0f;
-        uboFragmentLights.lights[1].linearFalloff = 0.4f;
-        uboFragmentLights.lights[1].quadraticFalloff = 0.3f;
-        // Blue light
-        uboFragmentLights.lights[2].position = glm::vec4(2.0f, 1.0f, 0.0f, 0.0f);
-        uboFragmentLights.lights[2].color = glm::vec4(0.0f, 0.0f, 2.5f, 0.0f);
-        uboFragmentLights.lights[2].radius = 10.0f;
-        uboFragmentLights.lights[2].linearFalloff = 0.45f;
-        uboFragmentLights.lights[2].quadraticFalloff = 0.35f;
-        // Belt glow
-        uboFragmentLights.lights[3].position = glm::vec4(0.0f, 0.7f, 0.5f, 0.0f);
-        uboFragmentLights.lights[3].color = glm::vec4(2.5f, 2.5f, 0.0f, 0.0f);
-        uboFragmentLights.lights[3].radius = 5.0f;
-        uboFragmentLights.lights[3].linearFalloff = 8.0f;
-        uboFragmentLights.lights[3].quadraticFalloff = 6.0f;
-        // Green light
-        uboFragmentLights.lights[4].position = glm::vec4(3.0f, 2.0f, 1.0f, 0.0f);
-        uboFragmentLights.lights[4].color = glm::vec4(0.0f, 1.5f, 0.0f, 0.0f);
-        uboFragmentLights.lights[4].radius = 10.0f;
-        uboFragmentLights.lights[4].linearFalloff = 0.8f;
-        uboFragmentLights.lights[4].quadraticFalloff = 0.6f;
-
-        // Current view position
-        uboFragmentLights.viewPos = glm::vec4(0.0f, 0.0f, -camera.position.z, 0.0f);
-
-        uniformData.fsLights.copy(uboFragmentLights);
+    // Lights in the space of the G-Buffer positions, see mrt.vert
+    void updateLights() {
+        using Light = vkx::ClusteredLighting::Light;
+        std::vector<Light> lights{
+            // White light from above
+            Light::point(glm::vec3(0.0f, 3.0f, 1.0f), 15.0f, glm::vec3(1.5f)),
+            // Red light
+            Light::point(glm::vec3(-2.0f, 0.0f, 0.0f), 15.0f, glm::vec3(1.5f, 0.0f, 0.0f)),
+            // Blue light
+            Light::point(glm::vec3(2.0f, 1.0f, 0.0f), 10.0f, glm::vec3(0.0f, 0.0f, 2.5f)),
+            // Belt glow
+            Light::point(glm::vec3(0.0f, 0.7f, 0.5f), 1.0f, glm::vec3(2.5f, 2.5f, 0.0f)),
+            // Green light
+            Light::point(glm::vec3(3.0f, 2.0f, 1.0f), 10.0f, glm::vec3(0.0f, 1.5f, 0.0f)),
+        };
+
+        // Small colored lights around the model, every fourth one a spot light facing it
+        std::default_random_engine rndGen(0);
+        std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
+        for (int32_t i = static_cast<int32_t>(lights.size()); i < lightCount; ++i) {
+            const glm::vec3 position{ rndDist(rndGen) * 12.0f - 6.0f, rndDist(rndGen) * 3.0f, rndDist(rndGen) * 12.0f - 6.0f };
+            const glm::vec3 color = glm::vec3(rndDist(rndGen), rndDist(rndGen), rndDist(rndGen)) * 0.5f;
+            const float range = 0.25f + rndDist(rndGen) * 0.75f;
+            if (i % 4 == 0) {
+                const glm::vec3 direction{ -position.x, 0.0f, -position.z };
+                lights.push_back(Light::spot(position, direction, range * 3.0f, glm::radians(15.0f), glm::radians(30.0f), color * 2.0f));
+            } else {
+                lights.push_back(Light::point(position, range, color));
+            }
+        }
+        clusteredLighting.setLights(lights);
     }
 
     void prepare() override {
@@ -451,6 +450,25 @@ public:
                 break;
         }
     }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            bool display = debugDisplay;
+            if (ui.checkBox("Display render targets", &display)) {
+                toggleDebugDisplay();
+            }
+            if (ui.sliderInt("Lights", &lightCount, 5, MAX_LIGHT_COUNT)) {
+                updateLights();
+            }
+        }
+        if (ui.header("Clusters")) {
+            const auto& grid = clusteredLighting.grid();
+            const auto statistics = clusteredLighting.statistics();
+            ui.text("Grid: %d x %d x %d", grid.width, grid.height, grid.depth);
+            ui.text("Lights per cluster: %.1f", statistics.indexCount / static_cast<float>(grid.clusterCount()));
+            ui.text("Clusters over the limit: %d", statistics.overflowCount);
+        }
+    }
 };
 
 RUN_EXAMPLE(VulkanExample)
@@ -7,9 +7,14 @@
 */
 
 #include "vulkanExampleBase.h"
+#include "clusteredlighting.hpp"
+
+#include <random>
 
 // todo: check if hardware supports sample number (or select max. supported)
 #define SAMPLE_COUNT vk::SampleCountFlagBits::e8;
+// Lights the clusters have room for
+#define MAX_LIGHT_COUNT 16384
 
 class VulkanExample : public vkx::ExampleBase {
 public:
@@ -49,22 +54,15 @@ public:
         glm::vec4 instancePos[3];
     } uboVS, uboOffscreenVS;
 
-    struct Light {
-        glm::vec4 position;
-        glm::vec3 color;
-        float radius;
-    };
-
-    struct {
-        Light lights[6];
-        glm::vec4 viewPos;
-        vk::Extent2D windowSize;
-    } uboFragmentLights;
+    // The six animated lights come first, followed by static ones spread over the floor
+    int32_t lightCount = 4096;
+    std::vector<vkx::ClusteredLighting::Light> lights;
+    // Culled into the clusters of the view frustum every frame, each sample is only lit by the lights of its cluster
+    vkx::ClusteredLighting clusteredLighting{ context };
 
     struct {
         vks::Buffer vsFullScreen;
         vks::Buffer vsOffscreen;
-        vks::Buffer fsLights;
     } uniformBuffers;
 
     struct {
@@ -148,7 +146,7 @@ public:
         // Uniform buffers
         uniformBuffers.vsOffscreen.destroy();
         uniformBuffers.vsFullScreen.destroy();
-        uniformBuffers.fsLights.destroy();
+        clusteredLighting.destroy();
 
         textures.model.colorMap.destroy();
         textures.model.normalMap.destroy();
@@ -328,6 +326,8 @@ public:
         clearValues[3].depthStencil = defaultClearDepth;
 
         offscreen.commandBuffer.begin({ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
+        // Only reads the camera and the light count when it executes
+        clusteredLighting.record(offscreen.commandBuffer);
 
         vk::RenderPassBeginInfo renderPassBeginInfo{ offscreen.renderPass,
                                                      offscreen.frameBuffer,
@@ -423,6 +423,7 @@ public:
         std::vector<vk::DescriptorPoolSize> poolSizes{
             vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 8 },
             vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 9 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 9 },
         };
         descriptorPool = device.createDescriptorPool({ {}, 3, static_cast<uint32_t>(poolSizes.size()), poolSizes.data() });
     }
@@ -438,9 +439,10 @@ public:
             vk::DescriptorSetLayoutBinding{ 2, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
             // Binding 3 : Albedo texture target
             vk::DescriptorSetLayoutBinding{ 3, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
-            // Binding 4 : Fragment shader uniform buffer
-            vk::DescriptorSetLayoutBinding{ 4, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment },
         };
+        // Binding 4 - 7 : Clusters and their lights
+        auto clusterBindings = vkx::ClusteredLighting::descriptorBindings(4, vk::ShaderStageFlagBits::eFragment);
+        setLayoutBindings.insert(setLayoutBindings.end(), clusterBindings.begin(), clusterBindings.end());
 
         descriptorSetLayout = device.createDescriptorSetLayout({ {}, static_cast<uint32_t>(setLayoutBindings.size()), setLayoutBindings.data() });
         pipelineLayouts.deferred = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
@@ -469,8 +471,6 @@ public:
             { descriptorSet, 2, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texDescriptorNormal },
             // Binding 3 : Albedo texture target
             { descriptorSet, 3, 0, 1, vk::DescriptorType::eCombinedImageSampler, &texDescriptorAlbedo },
-            // Binding 4 : Fragment shader uniform buffer
-            { descriptorSet, 4, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.fsLights.descriptor },
             // Binding 0: Vertex shader uniform buffer
             { descriptorSets.model, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.vsOffscreen.descriptor },
             // Binding 1: Color map
@@ -484,6 +484,9 @@ public:
             // Binding 2: Normal map
             { descriptorSets.floor, 2, 0, 1, vk::DescriptorType::eCombinedImageSampler, &textures.floor.normalMap.descriptor },
         };
+        // Binding 4 - 7 : Clusters and their lights
+        auto clusterWrites = clusteredLighting.descriptorWrites(descriptorSet, 4);
+        writeDescriptorSets.insert(writeDescriptorSets.end(), clusterWrites.begin(), clusterWrites.end());
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
     }
 
@@ -547,8 +550,8 @@ public:
         uniformBuffers.vsFullScreen = context.createUniformBuffer(uboVS);
         // Deferred vertex shader
         uniformBuffers.vsOffscreen = context.createUniformBuffer(uboOffscreenVS);
-        // Deferred fragment shader
-        uniformBuffers.fsLights = context.createUniformBuffer(uboFragmentLights);
+        // Lights of the deferred fragment shader
+        clusteredLighting.create(MAX_LIGHT_COUNT);
 
         // Init some values
         uboOffscreenVS.instancePos[0] = glm::vec4(0.0f);
@@ -558,6 +561,7 @@ public:
         // Update
         updateUniformBuffersScreen();
         updateUniformBufferDeferredMatrices();
+        generateLights();
         updateUniformBufferDeferredLights();
     }
 
@@ -577,54 +581,67 @@ public:
         uboOffscreenVS.view = camera.matrices.view;
         uboOffscreenVS.model = glm::mat4(1.0f);
         memcpy(uniformBuffers.vsOffscreen.mapped, &uboOffscreenVS, sizeof(uboOffscreenVS));
+        // The G-Buffer stores positions and normals with y flipped, see mrt.vert
+        const glm::mat4 lightView = camera.matrices.view * glm::scale(glm::mat4(1.0f), glm::vec3(1.0f, -1.0f, 1.0f));
+        clusteredLighting.update(uboOffscreenVS.projection, lightView, camera.getNearClip(), camera.getFarClip());
     }
 
-    // Update fragment shader light position uniform block
+    // Lights in the space of the G-Buffer positions
+    void generateLights() {
+        using Light = vkx::ClusteredLighting::Light;
+        // Fades out where it has dropped to 2% of its intensity at a distance of one
+        auto light = [](const glm::vec3& position, const glm::vec3& color, float intensity) {
+            return Light::point(position, std::sqrt(intensity * 50.0f), color * intensity);
+        };
+        lights = {
+            // White
+            light(glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(1.5f), 15.0f * 0.25f),
+            // Red
+            light(glm::vec3(-2.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f), 15.0f),
+            // Blue
+            light(glm::vec3(2.0f, 1.0f, 0.0f), glm::vec3(0.0f, 0.0f, 2.5f), 5.0f),
+            // Yellow
+            light(glm::vec3(0.0f, 0.9f, 0.5f), glm::vec3(1.0f, 1.0f, 0.0f), 2.0f),
+            // Green
+            light(glm::vec3(0.0f, 0.5f, 0.0f), glm::vec3(0.0f, 1.0f, 0.2f), 5.0f),
+            // Yellow
+            light(glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(1.0f, 0.7f, 0.3f), 25.0f),
+        };
+
+        // Small lights close to the floor, every fourth one a spot light
+        std::default_random_engine rndGen(0);
+        std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
+        for (int32_t i = static_cast<int32_t>(lights.size()); i < lightCount; ++i) {
+            const glm::vec3 position{ rndDist(rndGen) * 20.0f - 10.0f, rndDist(rndGen) * 2.0f, rndDist(rndGen) * 20.0f - 10.0f };
+            const glm::vec3 color = glm::vec3(rndDist(rndGen), rndDist(rndGen), rndDist(rndGen));
+            const float range = 0.5f + rndDist(rndGen);
+            if (i % 4 == 0) {
+                const glm::vec3 direction{ rndDist(rndGen) - 0.5f, 1.0f, rndDist(rndGen) - 0.5f };
+                lights.push_back(Light::spot(position, direction, range * 3.0f, glm::radians(20.0f), glm::radians(35.0f), color * 2.0f));
+            } else {
+                lights.push_back(Light::point(position, range, color));
+            }
+        }
+    }
+
+    // Animate the first lights
     void updateUniformBufferDeferredLights() {
-        // White
-        uboFragmentLights.lights[0].position = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
-        uboFragmentLights.lights[0].color = glm::vec3(1.5f);
-        uboFragmentLights.lights[0].radius = 15.0f * 0.25f;
-        // Red
-        uboFragmentLights.lights[1].position = glm::vec4(-2.0f, 0.0f, 0.0f, 0.0f);
-        uboFragmentLights.lights[1].color = glm::vec3(1.0f, 0.0f, 0.0f);
-        uboFragmentLights.lights[1].radius = 15.0f;
-        // Blue
-        uboFragmentLights.lights[2].position = glm::vec4(2.0f, 1.0f, 0.0f, 0.0f);
-        uboFragmentLights.lights[2].color = glm::vec3(0.0f, 0.0f, 2.5f);
-        uboFragmentLights.lights[2].radius = 5.0f;
-        // Yellow
-        uboFragmentLights.lights[3].position = glm::vec4(0.0f, 0.9f, 0.5f, 0.0f);
-        uboFragmentLights.lights[3].color = glm::vec3(1.0f, 1.0f, 0.0f);
-        uboFragmentLights.lights[3].radius = 2.0f;
-        // Green
-        uboFragmentLights.lights[4].position = glm::vec4(0.0f, 0.5f, 0.0f, 0.0f);
-        uboFragmentLights.lights[4].color = glm::vec3(0.0f, 1.0f, 0.2f);
-        uboFragmentLights.lights[4].radius = 5.0f;
-        // Yellow
-        uboFragmentLights.lights[5].position = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
-        uboFragmentLights.lights[5].color = glm::vec3(1.0f, 0.7f, 0.3f);
-        uboFragmentLights.lights[5].radius = 25.0f;
-
-        uboFragmentLights.lights[0].position.x = sin(glm::radians(360.0f * timer)) * 5.0f;
-        uboFragmentLights.lights[0].position.z = cos(glm::radians(360.0f * timer)) * 5.0f;
-
-        uboFragmentLights.lights[1].position.x = -4.0f + sin(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
-        uboFragmentLights.lights[1].position.z = 0.0f + cos(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
-
-        uboFragmentLights.lights[2].position.x = 4.0f + sin(glm::radians(360.0f * timer)) * 2.0f;
-        uboFragmentLights.lights[2].position.z = 0.0f + cos(glm::radians(360.0f * timer)) * 2.0f;
-
-        uboFragmentLights.lights[4].position.x = 0.0f + sin(glm::radians(360.0f * timer + 90.0f)) * 5.0f;
-        uboFragmentLights.lights[4].position.z = 0.0f - cos(glm::radians(360.0f * timer + 45.0f)) * 5.0f;
-
-        uboFragmentLights.lights[5].position.x = 0.0f + sin(glm::radians(-360.0f * timer + 135.0f)) * 10.0f;
-        uboFragmentLights.lights[5].position.z = 0.0f - cos(glm::radians(-360.0f * timer - 45.0f)) * 10.0f;
-
-        // Current view position
-        uboFragmentLights.viewPos = glm::vec4(camera.position, 0.0f) * glm::vec4(-1.0f, 1.0f, -1.0f, 1.0f);
-
-        memcpy(uniformBuffers.fsLights.mapped, &uboFragmentLights, sizeof(uboFragmentLights));
+        lights[0].position.x = sin(glm::radians(360.0f * timer)) * 5.0f;
+        lights[0].position.z = cos(glm::radians(360.0f * timer)) * 5.0f;
+
+        lights[1].position.x = -4.0f + sin(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
+        lights[1].position.z = 0.0f + cos(glm::radians(360.0f * timer) + 45.0f) * 2.0f;
+
+        lights[2].position.x = 4.0f + sin(glm::radians(360.0f * timer)) * 2.0f;
+        lights[2].position.z = 0.0f + cos(glm::radians(360.0f * timer)) * 2.0f;
+
+        lights[4].position.x = 0.0f + sin(glm::radians(360.0f * timer + 90.0f)) * 5.0f;
+        lights[4].position.z = 0.0f - cos(glm::radians(360.0f * timer + 45.0f)) * 5.0f;
+
+        lights[5].position.x = 0.0f + sin(glm::radians(-360.0f * timer + 135.0f)) * 10.0f;
+        lights[5].position.z = 0.0f - cos(glm::radians(-360.0f * timer - 45.0f)) * 10.0f;
+
+        clusteredLighting.setLights(lights);
     }
 
     void draw() override {
@@ -657,10 +674,7 @@ public:
         updateUniformBufferDeferredLights();
     }
 
-    void viewChanged() override {
-        updateUniformBufferDeferredMatrices();
-        uboFragmentLights.windowSize = size;
-    }
+    void viewChanged() override { updateUniformBufferDeferredMatrices(); }
 
     void OnUpdateUIOverlay() override {
         if (ui.header("Settings")) {
@@ -676,6 +690,17 @@ public:
                     buildDeferredCommandBuffer();
                 }
             }
+            if (ui.sliderInt("Lights", &lightCount, 6, MAX_LIGHT_COUNT)) {
+                generateLights();
+                updateUniformBufferDeferredLights();
+            }
+        }
+        if (ui.header("Clusters")) {
+            const auto& grid = clusteredLighting.grid();
+            const auto statistics = clusteredLighting.statistics();
+            ui.text("Grid: %d x %d x %d", grid.width, grid.height, grid.depth);
+            ui.text("Lights per cluster: %.1f", statistics.indexCount / static_cast<float>(grid.clusterCount()));
+            ui.text("Clusters over the limit: %d", statistics.overflowCount);
         }
     }
 };
@@ -8,6 +8,9 @@
 
 #include <vulkanExampleBase.h>
 #include <vks/framebuffer2.hpp>
+#include <clusteredlighting.hpp>
+
+#include <random>
 
 // Shadowmap properties
 #if defined(__ANDROID__)
@@ -27,6 +30,8 @@
 
 // Must match the LIGHT_COUNT define in the shadow and deferred shaders
 #define LIGHT_COUNT 3
+// Unshadowed lights the clusters have room for
+#define MAX_CLUSTERED_LIGHT_COUNT 16384
 
 class VulkanExample : public vkx::ExampleBase {
 public:
@@ -96,6 +101,10 @@ public:
         uint32_t useShadows = 1;
     } uboFragmentLights;
 
+    // Small unshadowed lights on top of the shadowed spots, each fragment is only lit by the ones of its cluster
+    int32_t clusteredLightCount = 1024;
+    vkx::ClusteredLighting clusteredLighting{ context };
+
     struct {
         vks::Buffer vsFullScreen;
         vks::Buffer vsOffscreen;
@@ -184,6 +193,7 @@ public:
         uniformBuffers.vsFullScreen.destroy();
         uniformBuffers.fsLights.destroy();
         uniformBuffers.uboShadowGS.destroy();
+        clusteredLighting.destroy();
 
         device.freeCommandBuffers(cmdPool, commandBuffers.deferred);
 
@@ -323,6 +333,9 @@ public:
 
         commandBuffers.deferred.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
 
+        // Assign the clustered lights, only reads the camera and the light count when it executes
+        clusteredLighting.record(commandBuffers.deferred);
+
         commandBuffers.deferred.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
         // Set depth bias (aka "Polygon offset")
         commandBuffers.deferred.setDepthBias(depthBiasConstant, 0.0f, depthBiasSlope);
@@ -442,8 +455,9 @@ public:
 
     void setupDescriptorPool() {
         std::vector<vk::DescriptorPoolSize> poolSizes{
-            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 12 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 16 },
             vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 16 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 12 },
         };
 
         descriptorPool = device.createDescriptorPool({ {}, 4, static_cast<uint32_t>(poolSizes.size()), poolSizes.data() });
@@ -466,6 +480,9 @@ public:
             // Binding 5: Shadow map
             vk::DescriptorSetLayoutBinding{ 5, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
         };
+        // Binding 6 - 9: Clusters and their lights
+        auto clusterBindings = vkx::ClusteredLighting::descriptorBindings(6, vk::ShaderStageFlagBits::eFragment);
+        setLayoutBindings.insert(setLayoutBindings.end(), clusterBindings.begin(), clusterBindings.end());
 
         descriptorSetLayout = device.createDescriptorSetLayout({ {}, static_cast<uint32_t>(setLayoutBindings.size()), setLayoutBindings.data() });
         pipelineLayouts.deferred = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
@@ -527,6 +544,9 @@ public:
             // Binding 0: Vertex shader uniform buffer
             { descriptorSets.shadow, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.uboShadowGS.descriptor },
         };
+        // Binding 6 - 9: Clusters and their lights
+        auto clusterWrites = clusteredLighting.descriptorWrites(descriptorSet, 6);
+        writeDescriptorSets.insert(writeDescriptorSets.end(), clusterWrites.begin(), clusterWrites.end());
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
     }
 
@@ -593,6 +613,9 @@ public:
         // Shadow map vertex shader (matrices from shadow's pov)
         uniformBuffers.uboShadowGS = context.createUniformBuffer(uboShadowGS);
 
+        // Unshadowed lights of the deferred fragment shader
+        clusteredLighting.create(MAX_CLUSTERED_LIGHT_COUNT);
+
         // Init some values
         uboOffscreenVS.instancePos[0] = glm::vec4(0.0f);
         uboOffscreenVS.instancePos[1] = glm::vec4(-4.0f, 0.0, -4.0f, 0.0f);
@@ -605,6 +628,7 @@ public:
         updateUniformBuffersScreen();
         updateUniformBufferDeferredMatrices();
         updateUniformBufferDeferredLights();
+        updateClusteredLights();
     }
 
     void updateUniformBuffersScreen() {
@@ -618,6 +642,8 @@ public:
         uboOffscreenVS.view = camera.matrices.view;
         uboOffscreenVS.model = glm::mat4(1.0f);
         memcpy(uniformBuffers.vsOffscreen.mapped, &uboOffscreenVS, sizeof(uboOffscreenVS));
+        // G-Buffer positions are in world space
+        clusteredLighting.update(uboOffscreenVS.projection, uboOffscreenVS.view, zNear, zFar);
     }
 
     Light initLight(const glm::vec3& pos, const glm::vec3& target, const glm::vec3& color) {
@@ -669,6 +695,28 @@ public:
         memcpy(uniformBuffers.fsLights.mapped, &uboFragmentLights, sizeof(uboFragmentLights));
     }
 
+    // Random world space lights above the floor, every fourth one a spot light
+    void updateClusteredLights() {
+        using Light = vkx::ClusteredLighting::Light;
+        std::vector<Light> lights;
+        lights.reserve(clusteredLightCount);
+        std::default_random_engine rndGen(0);
+        std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
+        for (int32_t i = 0; i < clusteredLightCount; ++i) {
+            // Up is negative y
+            const glm::vec3 position{ rndDist(rndGen) * 14.0f - 7.0f, -rndDist(rndGen) * 2.0f, rndDist(rndGen) * 14.0f - 7.0f };
+            const glm::vec3 color = glm::vec3(rndDist(rndGen), rndDist(rndGen), rndDist(rndGen));
+            const float range = 0.5f + rndDist(rndGen);
+            if (i % 4 == 0) {
+                const glm::vec3 direction{ rndDist(rndGen) - 0.5f, 1.0f, rndDist(rndGen) - 0.5f };
+                lights.push_back(Light::spot(position, direction, range * 3.0f, glm::radians(20.0f), glm::radians(35.0f), color * 2.0f));
+            } else {
+                lights.push_back(Light::point(position, range, color));
+            }
+        }
+        clusteredLighting.setLights(lights);
+    }
+
     void draw() override {
         ExampleBase::prepareFrame();
 
@@ -718,6 +766,16 @@ public:
                 uboFragmentLights.useShadows = shadows;
                 updateUniformBufferDeferredLights();
             }
+            if (ui.sliderInt("Unshadowed lights", &clusteredLightCount, 0, MAX_CLUSTERED_LIGHT_COUNT)) {
+                updateClusteredLights();
+            }
+        }
+        if (ui.header("Clusters")) {
+            const auto& grid = clusteredLighting.grid();
+            const auto statistics = clusteredLighting.statistics();
+            ui.text("Grid: %d x %d x %d", grid.width, grid.height, grid.depth);
+            ui.text("Lights per cluster: %.1f", statistics.indexCount / static_cast<float>(grid.clusterCount()));
+            ui.text("Clusters over the limit: %d", statistics.overflowCount);
         }
     }
 };
@@ -0,0 +1,554 @@
+/*
+* Vulkan Example - Benchmark of recording a scene in file order and through vkx::render::RenderQueue
+*
+* Records the draws of a synthetic scene with the pipelines and materials of the scene rendering example three
+* ways: in file order with the full state set up for every object, as before, sorted and batched by the render
+* queue with direct draws, and sorted with one indirect call per batch.  For growing object counts the draw
+* calls, pipeline and descriptor binds and the host time to sort and to record a command buffer are reported.
+* The Sibenik cathedral the scene rendering example shows is measured too, loaded and drawn by the same
+* vkx::Scene in file order and sorted.  The command buffers are only recorded, never submitted, so no frame time
+* is measured.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <common.hpp>
+#include <vks/context.hpp>
+#include <vks/pipelines.hpp>
+#include <utils.hpp>
+#include <renderqueue.hpp>
+#include <scene.hpp>
+#include <camera.hpp>
+
+#include <memory>
+#include <random>
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+#define LOG(...) ((void)__android_log_print(ANDROID_LOG_INFO, "vulkanExample", __VA_ARGS__))
+#else
+#define LOG(...) printf(__VA_ARGS__)
+#endif
+
+#define MESH_COUNT 256
+#define MATERIAL_COUNT 64
+// Every eighth material is blended
+#define TRANSLUCENT_MATERIAL_STRIDE 8
+#define MIN_OBJECT_COUNT 1024
+#define MAX_OBJECT_COUNT 32768
+// Half the size of the box the objects are spread over
+#define SCENE_EXTENT 64.0f
+#define WIDTH 1280
+#define HEIGHT 720
+
+// Minimum time to sort and to record for every object count and mode
+static const double MIN_SECONDS = 0.25;
+
+// Same vertex layout and material push constants as the scene rendering example
+using Vertex = vkx::SceneVertex;
+using MaterialProperties = vkx::SceneMaterialProperites;
+
+enum class RecordMode
+{
+    // Full state setup for every object, the way the scene rendering example drew before the render queue
+    fileOrder,
+    // Sorted and batched, pipelines and materials bound when they change, one direct draw per command
+    sorted,
+    // Sorted and batched, one indirect draw per batch (or per command without multi draw indirect)
+    indirect,
+};
+
+class DrawBenchmark {
+public:
+    vks::Context context;
+    vk::Device& device{ context.device };
+
+    struct Material {
+        MaterialProperties properties;
+        vk::DescriptorSet descriptorSet;
+        bool translucent;
+    };
+
+    struct Object {
+        uint32_t mesh;
+        glm::vec3 position;
+    };
+
+    struct RecordStats {
+        uint32_t draws{ 0 };
+        uint32_t pipelineBinds{ 0 };
+        uint32_t descriptorBinds{ 0 };
+    };
+
+    std::vector<vkx::render::MeshRange> meshes;
+    std::vector<Material> materials;
+    vkx::render::RenderQueue renderQueue;
+
+    vks::Buffer vertexBuffer;
+    vks::Buffer indexBuffer;
+    vks::Buffer uniformBuffer;
+    vks::Buffer indirectBuffer;
+    vks::Image texture;
+    vks::Image colorAttachment;
+    vks::Image depthAttachment;
+    vk::RenderPass renderPass;
+    vk::Framebuffer framebuffer;
+    vk::DescriptorPool descriptorPool;
+    struct {
+        vk::DescriptorSetLayout scene;
+        vk::DescriptorSetLayout material;
+    } descriptorSetLayouts;
+    vk::DescriptorSet descriptorSetScene;
+    vk::PipelineLayout pipelineLayout;
+    struct {
+        vk::Pipeline solid;
+        vk::Pipeline blending;
+    } pipelines;
+    vk::CommandBuffer commandBuffer;
+    // Sibenik, with the shaders of the scene rendering example
+    std::unique_ptr<vkx::Scene> scene;
+
+    bool multiDrawIndirect = false;
+    bool drawIndirectFirstInstance = false;
+    bool textureCompressionBC = false;
+
+    ~DrawBenchmark() {
+        if (!device) {
+            return;
+        }
+        device.waitIdle();
+        scene.reset();
+        vertexBuffer.destroy();
+        indexBuffer.destroy();
+        uniformBuffer.destroy();
+        indirectBuffer.destroy();
+        texture.destroy();
+        colorAttachment.destroy();
+        depthAttachment.destroy();
+        device.destroy(framebuffer);
+        device.destroy(renderPass);
+        device.destroy(pipelines.solid);
+        device.destroy(pipelines.blending);
+        device.destroy(pipelineLayout);
+        device.destroy(descriptorSetLayouts.scene);
+        device.destroy(descriptorSetLayouts.material);
+        device.destroy(descriptorPool);
+        context.destroy();
+    }
+
+    void prepare() {
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+        vks::android::loadVulkanLibrary();
+#endif
+        context.setDeviceFeaturesPicker([](const vk::PhysicalDevice& physicalDevice, vk::PhysicalDeviceFeatures2& features) {
+            const auto supported = physicalDevice.getFeatures();
+            features.features.multiDrawIndirect = supported.multiDrawIndirect;
+            features.features.drawIndirectFirstInstance = supported.drawIndirectFirstInstance;
+            features.features.textureCompressionBC = supported.textureCompressionBC;
+        });
+        context.createInstance();
+        context.createDevice();
+        multiDrawIndirect = context.enabledFeatures.multiDrawIndirect == VK_TRUE;
+        drawIndirectFirstInstance = context.enabledFeatures.drawIndirectFirstInstance == VK_TRUE;
+        textureCompressionBC = context.enabledFeatures.textureCompressionBC == VK_TRUE;
+        LOG("GPU: %s, multi draw indirect %s, indirect first instance %s\n", context.deviceProperties.deviceName, multiDrawIndirect ? "yes" : "no",
+            drawIndirectFirstInstance ? "yes" : "no");
+
+        prepareGeometry();
+        prepareFramebuffer();
+        prepareMaterials();
+        preparePipelines();
+        indirectBuffer = context.createBuffer(vk::BufferUsageFlagBits::eIndirectBuffer,
+                                              vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                              MAX_OBJECT_COUNT * sizeof(vk::DrawIndexedIndirectCommand));
+        indirectBuffer.map();
+        commandBuffer = context.allocateCommandBuffers(1)[0];
+    }
+
+    // Every mesh is a box of its own size, stored one after the other in shared vertex and index buffers
+    void prepareGeometry() {
+        static const glm::vec3 normals[6] = { { 1.0f, 0.0f, 0.0f }, { -1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f },
+                                              { 0.0f, -1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, -1.0f } };
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        meshes.resize(MESH_COUNT);
+        for (uint32_t i = 0; i < MESH_COUNT; ++i) {
+            const glm::vec3 extent{ 0.25f + (i % 4) * 0.25f, 0.25f + (i / 4 % 4) * 0.25f, 0.25f + (i / 16 % 4) * 0.25f };
+            meshes[i] = { static_cast<uint32_t>(indices.size()), 36, static_cast<int32_t>(vertices.size()) };
+            for (uint32_t face = 0; face < 6; ++face) {
+                const glm::vec3& n = normals[face];
+                const glm::vec3 u = face < 2 ? glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f);
+                const glm::vec3 v = glm::cross(n, u);
+                const uint32_t base = face * 4;
+                for (uint32_t corner = 0; corner < 4; ++corner) {
+                    const glm::vec2 uv{ static_cast<float>(corner & 1), static_cast<float>(corner >> 1) };
+                    const glm::vec3 position = (n + u * (uv.x * 2.0f - 1.0f) + v * (uv.y * 2.0f - 1.0f)) * extent;
+                    vertices.push_back({ position, n, uv, glm::vec3(1.0f) });
+                }
+                for (uint32_t index : { 0u, 1u, 2u, 2u, 1u, 3u }) {
+                    indices.push_back(base + index);
+                }
+            }
+        }
+        vertexBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertices);
+        indexBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indices);
+    }
+
+    void prepareFramebuffer() {
+        const vk::Format colorFormat = vk::Format::eR8G8B8A8Unorm;
+        const vk::Format depthFormat = context.getSupportedDepthFormat();
+
+        vk::ImageCreateInfo image;
+        image.imageType = vk::ImageType::e2D;
+        image.format = colorFormat;
+        image.extent = vk::Extent3D{ WIDTH, HEIGHT, 1 };
+        image.mipLevels = 1;
+        image.arrayLayers = 1;
+        image.usage = vk::ImageUsageFlagBits::eColorAttachment;
+        colorAttachment = context.createImage(image);
+        vk::ImageViewCreateInfo view{ {}, colorAttachment.image, vk::ImageViewType::e2D, colorFormat, {}, { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 } };
+        colorAttachment.view = device.createImageView(view);
+
+        image.format = depthFormat;
+        image.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment;
+        depthAttachment = context.createImage(image);
+        view.image = depthAttachment.image;
+        view.format = depthFormat;
+        view.subresourceRange.aspectMask = vk::ImageAspectFlagBits::eDepth;
+        depthAttachment.view = device.createImageView(view);
+
+        std::array<vk::AttachmentDescription, 2> attachmentDescriptions;
+        attachmentDescriptions[0].format = colorFormat;
+        attachmentDescriptions[0].loadOp = vk::AttachmentLoadOp::eClear;
+        attachmentDescriptions[0].storeOp = vk::AttachmentStoreOp::eStore;
+        attachmentDescriptions[0].finalLayout = vk::ImageLayout::eColorAttachmentOptimal;
+        attachmentDescriptions[1].format = depthFormat;
+        attachmentDescriptions[1].loadOp = vk::AttachmentLoadOp::eClear;
+        attachmentDescriptions[1].storeOp = vk::AttachmentStoreOp::eDontCare;
+        attachmentDescriptions[1].finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+        vk::AttachmentReference colorReference{ 0, vk::ImageLayout::eColorAttachmentOptimal };
+        vk::AttachmentReference depthReference{ 1, vk::ImageLayout::eDepthStencilAttachmentOptimal };
+        vk::SubpassDescription subpass;
+        subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &colorReference;
+        subpass.pDepthStencilAttachment = &depthReference;
+        renderPass = device.createRenderPass({ {}, static_cast<uint32_t>(attachmentDescriptions.size()), attachmentDescriptions.data(), 1, &subpass });
+
+        std::array<vk::ImageView, 2> attachments{ colorAttachment.view, depthAttachment.view };
+        framebuffer = device.createFramebuffer({ {}, renderPass, static_cast<uint32_t>(attachments.size()), attachments.data(), WIDTH, HEIGHT, 1 });
+    }
+
+    // The materials differ in their properties and descriptor sets, which all point to the same white texel
+    void prepareMaterials() {
+        vk::ImageCreateInfo image;
+        image.imageType = vk::ImageType::e2D;
+        image.format = vk::Format::eR8G8B8A8Unorm;
+        image.extent = vk::Extent3D{ 1, 1, 1 };
+        image.mipLevels = 1;
+        image.arrayLayers = 1;
+        image.usage = vk::ImageUsageFlagBits::eSampled;
+        const std::vector<uint8_t> white{ 255, 255, 255, 255 };
+        texture = context.stageToDeviceImage(image, white);
+        texture.view = device.createImageView({ {}, texture.image, vk::ImageViewType::e2D, image.format, {}, { vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1 } });
+        vk::SamplerCreateInfo samplerCreateInfo;
+        samplerCreateInfo.magFilter = samplerCreateInfo.minFilter = vk::Filter::eLinear;
+        texture.sampler = device.createSampler(samplerCreateInfo);
+
+        struct {
+            glm::mat4 projection;
+            glm::mat4 view;
+            glm::mat4 model;
+            glm::vec4 lightPos;
+        } uniformData;
+        uniformData.projection = glm::perspective(glm::radians(60.0f), static_cast<float>(WIDTH) / HEIGHT, 0.1f, SCENE_EXTENT * 2.0f);
+        uniformData.view = glm::mat4(1.0f);
+        uniformData.model = glm::mat4(1.0f);
+        uniformData.lightPos = glm::vec4(0.0f, 8.0f, 0.0f, 0.0f);
+        uniformBuffer = context.createUniformBuffer(uniformData);
+
+        std::vector<vk::DescriptorPoolSize> poolSizes{
+            { vk::DescriptorType::eUniformBuffer, 1 },
+            { vk::DescriptorType::eCombinedImageSampler, MATERIAL_COUNT },
+        };
+        descriptorPool = device.createDescriptorPool({ {}, MATERIAL_COUNT + 1, static_cast<uint32_t>(poolSizes.size()), poolSizes.data() });
+
+        // Set 0: Scene matrices
+        vk::DescriptorSetLayoutBinding binding{ 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex };
+        descriptorSetLayouts.scene = device.createDescriptorSetLayout({ {}, 1, &binding });
+        // Set 1: Material texture
+        binding = { 0, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment };
+        descriptorSetLayouts.material = device.createDescriptorSetLayout({ {}, 1, &binding });
+
+        descriptorSetScene = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.scene })[0];
+        vk::WriteDescriptorSet writeDescriptorSet{ descriptorSetScene, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffer.descriptor };
+        device.updateDescriptorSets(writeDescriptorSet, nullptr);
+
+        const vk::DescriptorImageInfo imageInfo{ texture.sampler, texture.view, vk::ImageLayout::eShaderReadOnlyOptimal };
+        std::default_random_engine rndGen(0);
+        std::uniform_real_distribution<float> rndColor(0.0f, 1.0f);
+        materials.resize(MATERIAL_COUNT);
+        for (uint32_t i = 0; i < MATERIAL_COUNT; ++i) {
+            auto& material = materials[i];
+            material.translucent = i % TRANSLUCENT_MATERIAL_STRIDE == TRANSLUCENT_MATERIAL_STRIDE - 1;
+            material.properties.ambient = glm::vec4(0.1f);
+            material.properties.diffuse = glm::vec4(rndColor(rndGen), rndColor(rndGen), rndColor(rndGen), 1.0f);
+            material.properties.specular = glm::vec4(0.5f);
+            material.properties.opacity = material.translucent ? 0.5f : 1.0f;
+            material.descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.material })[0];
+            writeDescriptorSet = vk::WriteDescriptorSet{ material.descriptorSet, 0, 0, 1, vk::DescriptorType::eCombinedImageSampler, &imageInfo };
+            device.updateDescriptorSets(writeDescriptorSet, nullptr);
+        }
+    }
+
+    void preparePipelines() {
+        std::array<vk::DescriptorSetLayout, 2> setLayouts{ descriptorSetLayouts.scene, descriptorSetLayouts.material };
+        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eFragment, 0, sizeof(MaterialProperties) };
+        pipelineLayout = device.createPipelineLayout({ {}, static_cast<uint32_t>(setLayouts.size()), setLayouts.data(), 1, &pushConstantRange });
+        createScenePipelines(pipelineLayout, pipelines.solid, pipelines.blending);
+    }
+
+    // Solid and blended pipelines of the scene rendering example
+    void createScenePipelines(vk::PipelineLayout layout, vk::Pipeline& solid, vk::Pipeline& blending) {
+        vks::pipelines::GraphicsPipelineBuilder pipelineBuilder{ device, layout, renderPass };
+        pipelineBuilder.vertexInputState.appendVertexLayout(vkx::Scene::vertexLayout);
+        pipelineBuilder.loadShader(vkx::getAssetPath() + "shaders/scenerendering/scene.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        pipelineBuilder.loadShader(vkx::getAssetPath() + "shaders/scenerendering/scene.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        solid = pipelineBuilder.create(context.pipelineCache);
+
+        pipelineBuilder.rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
+        auto& blendAttachmentState = pipelineBuilder.colorBlendState.blendAttachmentStates[0];
+        blendAttachmentState.blendEnable = VK_TRUE;
+        blendAttachmentState.colorBlendOp = vk::BlendOp::eAdd;
+        blendAttachmentState.srcColorBlendFactor = vk::BlendFactor::eSrcColor;
+        blendAttachmentState.dstColorBlendFactor = vk::BlendFactor::eOneMinusSrcColor;
+        blending = pipelineBuilder.create(context.pipelineCache);
+    }
+
+    // Load Sibenik the way the scene rendering example does, without the bindless table
+    bool prepareScene() {
+        // The textures of the model are BC3 compressed
+        if (!textureCompressionBC) {
+            return false;
+        }
+        scene.reset(new vkx::Scene(context));
+        scene->multiDrawIndirect = multiDrawIndirect;
+        scene->drawIndirectFirstInstance = drawIndirectFirstInstance;
+        scene->assetPath = vkx::getAssetPath() + "models/sibenik/";
+        context.withPrimaryCommandBuffer(
+            [&](const vk::CommandBuffer& cmdBuffer) { scene->load(vkx::getAssetPath() + "models/sibenik/sibenik.dae", cmdBuffer); });
+        createScenePipelines(scene->pipelineLayout, scene->pipelines.solid, scene->pipelines.blending);
+        return true;
+    }
+
+    const Material& materialOf(uint32_t mesh) const { return materials[mesh % MATERIAL_COUNT]; }
+
+    // Objects spread around the camera at the origin, in the order a scene file would list them
+    std::vector<Object> generateObjects(uint32_t count) const {
+        std::default_random_engine rndGen(count);
+        std::uniform_int_distribution<uint32_t> rndMesh(0, MESH_COUNT - 1);
+        std::uniform_real_distribution<float> rndPosition(-SCENE_EXTENT, SCENE_EXTENT);
+        std::vector<Object> objects(count);
+        for (auto& object : objects) {
+            object.mesh = rndMesh(rndGen);
+            object.position = glm::vec3(rndPosition(rndGen), rndPosition(rndGen), rndPosition(rndGen));
+        }
+        return objects;
+    }
+
+    // Same keys as the scene rendering example, with the materials of translucent objects drawn back to front
+    void buildRenderQueue(const std::vector<Object>& objects) {
+        renderQueue.clear();
+        for (uint32_t i = 0; i < objects.size(); ++i) {
+            const auto& object = objects[i];
+            const uint32_t materialIndex = object.mesh % MATERIAL_COUNT;
+            const float depth = glm::length(object.position);
+            if (materials[materialIndex].translucent) {
+                renderQueue.push({ vkx::render::sortkey::translucent(1, materialIndex, depth), 1, materialIndex, object.mesh, i });
+            } else {
+                renderQueue.push({ vkx::render::sortkey::opaque(0, materialIndex, depth), 0, materialIndex, object.mesh, i });
+            }
+        }
+        renderQueue.build();
+    }
+
+    void uploadIndirectCommands() {
+        const auto commands = renderQueue.indirectCommands(meshes);
+        indirectBuffer.copy(commands);
+    }
+
+    void recordFileOrder(const std::vector<Object>& objects, RecordStats& stats) {
+        for (const auto& object : objects) {
+            const auto& material = materialOf(object.mesh);
+            std::array<vk::DescriptorSet, 2> descriptorSets{ descriptorSetScene, material.descriptorSet };
+            commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, material.translucent ? pipelines.blending : pipelines.solid);
+            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets, nullptr);
+            commandBuffer.pushConstants<MaterialProperties>(pipelineLayout, vk::ShaderStageFlagBits::eFragment, 0, material.properties);
+            commandBuffer.bindVertexBuffers(0, vertexBuffer.buffer, { 0 });
+            commandBuffer.bindIndexBuffer(indexBuffer.buffer, 0, vk::IndexType::eUint32);
+            const auto& range = meshes[object.mesh];
+            commandBuffer.drawIndexed(range.indexCount, 1, range.firstIndex, range.vertexOffset, 0);
+            ++stats.pipelineBinds;
+            ++stats.descriptorBinds;
+            ++stats.draws;
+        }
+    }
+
+    void recordSorted(bool indirect, RecordStats& stats) {
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSetScene, nullptr);
+        commandBuffer.bindVertexBuffers(0, vertexBuffer.buffer, { 0 });
+        commandBuffer.bindIndexBuffer(indexBuffer.buffer, 0, vk::IndexType::eUint32);
+        ++stats.descriptorBinds;
+
+        const vk::DeviceSize stride = sizeof(vk::DrawIndexedIndirectCommand);
+        const auto& commands = renderQueue.commands();
+        vk::Pipeline boundPipeline;
+        uint32_t boundMaterial = ~0u;
+        for (const auto& batch : renderQueue.batches()) {
+            vk::Pipeline pipeline = batch.pipeline == 0 ? pipelines.solid : pipelines.blending;
+            if (pipeline != boundPipeline) {
+                commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+                boundPipeline = pipeline;
+                ++stats.pipelineBinds;
+            }
+            if (batch.material != boundMaterial) {
+                const auto& material = materials[batch.material];
+                commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 1, material.descriptorSet, nullptr);
+                commandBuffer.pushConstants<MaterialProperties>(pipelineLayout, vk::ShaderStageFlagBits::eFragment, 0, material.properties);
+                boundMaterial = batch.material;
+                ++stats.descriptorBinds;
+            }
+            if (indirect && multiDrawIndirect) {
+                commandBuffer.drawIndexedIndirect(indirectBuffer.buffer, batch.firstCommand * stride, batch.commandCount, static_cast<uint32_t>(stride));
+                ++stats.draws;
+            } else if (indirect) {
+                for (uint32_t c = 0; c < batch.commandCount; ++c) {
+                    commandBuffer.drawIndexedIndirect(indirectBuffer.buffer, (batch.firstCommand + c) * stride, 1, static_cast<uint32_t>(stride));
+                    ++stats.draws;
+                }
+            } else {
+                for (uint32_t c = 0; c < batch.commandCount; ++c) {
+                    const auto& command = commands[batch.firstCommand + c];
+                    const auto& range = meshes[command.mesh];
+                    commandBuffer.drawIndexed(range.indexCount, command.instanceCount, range.firstIndex, range.vertexOffset, command.firstInstance);
+                    ++stats.draws;
+                }
+            }
+        }
+    }
+
+    // Record the draws of `function` into the render pass
+    template <typename Function>
+    void recordPass(Function function) {
+        vk::ClearValue clearValues[2];
+        clearValues[0].color = vks::util::clearColor({ 0.0f, 0.0f, 0.0f, 1.0f });
+        clearValues[1].depthStencil = vk::ClearDepthStencilValue{ 1.0f, 0 };
+        commandBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+        commandBuffer.beginRenderPass({ renderPass, framebuffer, vks::util::rect2D(WIDTH, HEIGHT), 2, clearValues }, vk::SubpassContents::eInline);
+        commandBuffer.setViewport(0, vks::util::viewport(static_cast<float>(WIDTH), static_cast<float>(HEIGHT)));
+        commandBuffer.setScissor(0, vks::util::rect2D(WIDTH, HEIGHT));
+        function();
+        commandBuffer.endRenderPass();
+        commandBuffer.end();
+    }
+
+    RecordStats record(RecordMode mode, const std::vector<Object>& objects) {
+        RecordStats stats;
+        recordPass([&] {
+            switch (mode) {
+                case RecordMode::fileOrder:
+                    recordFileOrder(objects, stats);
+                    break;
+                case RecordMode::sorted:
+                    recordSorted(false, stats);
+                    break;
+                case RecordMode::indirect:
+                    recordSorted(true, stats);
+                    break;
+            }
+        });
+        return stats;
+    }
+
+    // Milliseconds per call, run until MIN_SECONDS have passed
+    template <typename Function>
+    double measure(Function function) {
+        uint32_t runs = 0;
+        auto tStart = std::chrono::high_resolution_clock::now();
+        double seconds = 0.0;
+        do {
+            function();
+            ++runs;
+            seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+        } while (seconds < MIN_SECONDS);
+        return seconds * 1000.0 / runs;
+    }
+
+    void runObjectCount(uint32_t objectCount) {
+        const auto objects = generateObjects(objectCount);
+        const double sortMs = measure([&] { buildRenderQueue(objects); });
+        uploadIndirectCommands();
+
+        static const char* modeNames[] = { "file order", "sorted", "indirect" };
+        for (const auto mode : { RecordMode::fileOrder, RecordMode::sorted, RecordMode::indirect }) {
+            const char* name = modeNames[static_cast<uint32_t>(mode)];
+            // Indirect commands past the first instance need the feature, the queue starts every command at its payloads
+            if (mode == RecordMode::indirect && !drawIndirectFirstInstance) {
+                LOG("%7u %-10s %8s %10s %10s %9s %10s\n", objectCount, name, "-", "-", "-", "-", "-");
+                continue;
+            }
+            RecordStats stats;
+            const double recordMs = measure([&] { stats = record(mode, objects); });
+            if (mode == RecordMode::fileOrder) {
+                LOG("%7u %-10s %8u %10u %10u %9s %10.3f\n", objectCount, name, stats.draws, stats.pipelineBinds, stats.descriptorBinds, "-", recordMs);
+            } else {
+                LOG("%7u %-10s %8u %10u %10u %9.3f %10.3f\n", objectCount, name, stats.draws, stats.pipelineBinds, stats.descriptorBinds, sortMs, recordMs);
+            }
+        }
+    }
+
+    // Sibenik seen from the start position of the scene rendering example's camera
+    void runScene() {
+        Camera camera;
+        camera.type = Camera::CameraType::firstperson;
+        camera.position = { 15.0f, -13.5f, 0.0f };
+        camera.setRotation(glm::vec3(5.0f, 90.0f, 0.0f));
+        const glm::vec3 cameraPosition = glm::vec3(glm::inverse(camera.matrices.view)[3]);
+        const auto meshCount = static_cast<uint32_t>(scene->meshes.size());
+        uint32_t translucentCount = 0;
+        for (uint32_t i = 0; i < meshCount; ++i) {
+            translucentCount += scene->isTranslucent(i) ? 1 : 0;
+        }
+        LOG("Sibenik: %u meshes, %u materials, %u blended\n", meshCount, static_cast<uint32_t>(scene->materials.size()), translucentCount);
+        LOG("%7s %-10s %8s %10s %10s %9s %10s\n", "Meshes", "Mode", "Draws", "Pipelines", "Sets", "Sort ms", "Record ms");
+
+        const double sortMs = measure([&] { scene->buildRenderQueue(cameraPosition, vkx::SceneRenderMode::sorted); });
+        static const char* modeNames[] = { "file order", "sorted" };
+        for (const auto mode : { vkx::SceneRenderMode::fileOrder, vkx::SceneRenderMode::sorted }) {
+            const char* name = modeNames[static_cast<uint32_t>(mode)];
+            const double recordMs = measure([&] { recordPass([&] { scene->render(commandBuffer, 0, false, mode); }); });
+            const auto& stats = scene->stats;
+            if (mode == vkx::SceneRenderMode::fileOrder) {
+                LOG("%7u %-10s %8u %10u %10u %9s %10.3f\n", meshCount, name, stats.draws, stats.pipelineBinds, stats.descriptorBinds, "-", recordMs);
+            } else {
+                LOG("%7u %-10s %8u %10u %10u %9.3f %10.3f\n", meshCount, name, stats.draws, stats.pipelineBinds, stats.descriptorBinds, sortMs, recordMs);
+            }
+        }
+    }
+
+    void run() {
+        prepare();
+        LOG("%u meshes, %u materials, 1 in %u blended\n", MESH_COUNT, MATERIAL_COUNT, TRANSLUCENT_MATERIAL_STRIDE);
+        LOG("%7s %-10s %8s %10s %10s %9s %10s\n", "Objects", "Mode", "Draws", "Pipelines", "Sets", "Sort ms", "Record ms");
+        for (uint32_t objectCount = MIN_OBJECT_COUNT; objectCount <= MAX_OBJECT_COUNT; objectCount *= 2) {
+            runObjectCount(objectCount);
+        }
+
+        if (!prepareScene()) {
+            LOG("Sibenik skipped, its textures need BC texture compression\n");
+            return;
+        }
+        runScene();
+    }
+};
+
+RUN_EXAMPLE(DrawBenchmark)
@@ -14,11 +14,20 @@
 *
 * The used descriptor type VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC then allows to set a dynamic
 * offset used to pass data from the single uniform buffer to the connected shader binding point.
+*
+* The object transforms are kept in a vkx::TransformSystem, which converts them to matrices with SIMD code
+* on all cores and writes them straight into the mapped buffer.  Only the blocks of objects that moved are
+* rewritten and flushed.
 */
 
 #include <vulkanExampleBase.h>
+#include <transforms.hpp>
+
+#include <chrono>
 
-#define OBJECT_INSTANCES 125
+// Objects per side of the cube they are arranged in
+#define OBJECT_GRID 47
+#define OBJECT_INSTANCES (OBJECT_GRID * OBJECT_GRID * OBJECT_GRID)
 
 // Vertex layout for this example
 struct Vertex {
@@ -26,28 +35,6 @@ struct Vertex {
     float color[3];
 };
 
-// Wrapper functions for aligned memory allocation
-// There is currently no standard for this in C++ that works across all platforms and vendors, so we abstract this
-void* alignedAlloc(size_t size, size_t alignment) {
-    void* data = nullptr;
-#if defined(_MSC_VER) || defined(__MINGW32__)
-    data = _aligned_malloc(size, alignment);
-#else
-    int res = posix_memalign(&data, alignment, size);
-    if (res != 0)
-        data = nullptr;
-#endif
-    return data;
-}
-
-void alignedFree(void* data) {
-#if defined(_MSC_VER) || defined(__MINGW32__)
-    _aligned_free(data);
-#else
-    free(data);
-#endif
-}
-
 class VulkanExample : public vkx::ExampleBase {
 public:
     vks::Buffer vertexBuffer;
@@ -64,15 +51,23 @@ public:
         glm::mat4 view;
     } uboVS;
 
-    // Store random per-object rotations
-    glm::vec3 rotations[OBJECT_INSTANCES];
-    glm::vec3 rotationSpeeds[OBJECT_INSTANCES];
+    // Per-object transforms, written into one big uniform buffer that contains all matrices
+    vkx::TransformSystem transforms;
+    // Random angular velocities of the objects, applied to the first animatedFraction of them
+    std::vector<glm::vec3> rotationSpeeds;
+    float animatedFraction = 1.0f;
+    const std::vector<float> animatedFractions{ 1.0f, 0.1f, 0.01f, 0.0f };
 
-    // One big uniform buffer that contains all matrices
-    // Note that we need to manually allocate the data to cope for GPU-specific uniform buffer offset alignments
-    struct UboDataDynamic {
-        glm::mat4* model = nullptr;
-    } uboDataDynamic;
+    vkx::ThreadPool threadPool;
+    vkx::simd::Backend backend = vkx::simd::best();
+    // Flushed parts of the dynamic uniform buffer, reused every update
+    std::vector<vks::Allocation::Range> flushRanges;
+
+    struct {
+        float milliseconds = 0.0f;
+        uint32_t objects = 0;
+        uint32_t ranges = 0;
+    } updateStatistics;
 
     vk::Pipeline pipeline;
     vk::PipelineLayout pipelineLayout;
@@ -86,17 +81,13 @@ public:
     VulkanExample() {
         title = "Vulkan Example - Dynamic uniform buffers";
         camera.type = Camera::CameraType::lookat;
-        camera.setPosition(glm::vec3(0.0f, 0.0f, -30.0f));
+        camera.setPosition(glm::vec3(0.0f, 0.0f, -200.0f));
         camera.setRotation(glm::vec3(0.0f));
-        camera.setPerspective(60.0f, (float)size.width / (float)size.height, 0.1f, 256.0f);
+        camera.setPerspective(60.0f, (float)size.width / (float)size.height, 0.1f, 512.0f);
         settings.overlay = true;
     }
 
     ~VulkanExample() {
-        if (uboDataDynamic.model) {
-            alignedFree(uboDataDynamic.model);
-        }
-
         // Clean up used Vulkan resources
         // Note : Inherited destructor cleans up resources stored in base class
         vkDestroyPipeline(device, pipeline, nullptr);
@@ -231,9 +222,6 @@ public:
 
         size_t bufferSize = OBJECT_INSTANCES * dynamicAlignment;
 
-        uboDataDynamic.model = (glm::mat4*)alignedAlloc(bufferSize, dynamicAlignment);
-        assert(uboDataDynamic.model);
-
         std::cout << "minUniformBufferOffsetAlignment = " << minUboAlignment << std::endl;
         std::cout << "dynamicAlignment = " << dynamicAlignment << std::endl;
 
@@ -244,16 +232,29 @@ public:
 
         // Uniform buffer object with per-object matrices
         uniformBuffers.dynamic = context.createBuffer(vk::BufferUsageFlagBits::eUniformBuffer, vk::MemoryPropertyFlagBits::eHostVisible, bufferSize);
-        // Map persistent
+        // Each draw only sees one matrix, the whole buffer would exceed maxUniformBufferRange
+        uniformBuffers.dynamic.descriptor.range = sizeof(glm::mat4);
+        // Map persistent, the matrices are written directly into the buffer
         uniformBuffers.dynamic.map();
 
-        // Prepare per-object matrices with offsets and random rotations
+        // Prepare per-object transforms with offsets and random rotations
         std::mt19937 rndGen(static_cast<uint32_t>(time(0)));
         std::normal_distribution<float> rndDist(-1.0f, 1.0f);
-        for (uint32_t i = 0; i < OBJECT_INSTANCES; i++) {
-            rotations[i] = glm::vec3(rndDist(rndGen), rndDist(rndGen), rndDist(rndGen)) * 2.0f * (float)M_PI;
-            rotationSpeeds[i] = glm::vec3(rndDist(rndGen), rndDist(rndGen), rndDist(rndGen));
+        const float offset = 3.0f;
+        transforms.resize(OBJECT_INSTANCES);
+        rotationSpeeds.resize(OBJECT_INSTANCES);
+        for (uint32_t x = 0; x < OBJECT_GRID; x++) {
+            for (uint32_t y = 0; y < OBJECT_GRID; y++) {
+                for (uint32_t z = 0; z < OBJECT_GRID; z++) {
+                    uint32_t index = x * OBJECT_GRID * OBJECT_GRID + y * OBJECT_GRID + z;
+                    transforms.setPosition(index, (glm::vec3(x, y, z) - (OBJECT_GRID - 1) / 2.0f) * offset);
+                    glm::vec3 rotation = glm::vec3(rndDist(rndGen), rndDist(rndGen), rndDist(rndGen)) * 2.0f * (float)M_PI;
+                    transforms.setRotation(index, glm::quat(rotation));
+                    rotationSpeeds[index] = glm::vec3(rndDist(rndGen), rndDist(rndGen), rndDist(rndGen));
+                }
+            }
         }
+        setAnimatedFraction(animatedFraction);
 
         updateUniformBuffers();
         updateDynamicUniformBuffer(true);
@@ -267,6 +268,15 @@ public:
         memcpy(uniformBuffers.view.mapped, &uboVS, sizeof(uboVS));
     }
 
+    // Let the first `fraction` of the objects rotate and the others stand still
+    void setAnimatedFraction(float fraction) {
+        animatedFraction = fraction;
+        const uint32_t animated = static_cast<uint32_t>(fraction * OBJECT_INSTANCES);
+        for (uint32_t i = 0; i < OBJECT_INSTANCES; i++) {
+            transforms.setAngularVelocity(i, i < animated ? rotationSpeeds[i] : glm::vec3(0.0f));
+        }
+    }
+
     void updateDynamicUniformBuffer(bool force = false) {
         // Update at max. 60 fps
         animationTimer += frameTimer;
@@ -274,37 +284,22 @@ public:
             return;
         }
 
+        auto tStart = std::chrono::high_resolution_clock::now();
+        transforms.spin(animationTimer, threadPool, backend);
         // Dynamic ubo with per-object model matrices indexed by offsets in the command buffer
-        uint32_t dim = static_cast<uint32_t>(pow(OBJECT_INSTANCES, (1.0f / 3.0f)));
-        glm::vec3 offset(5.0f);
-
-        for (uint32_t x = 0; x < dim; x++) {
-            for (uint32_t y = 0; y < dim; y++) {
-                for (uint32_t z = 0; z < dim; z++) {
-                    uint32_t index = x * dim * dim + y * dim + z;
-
-                    // Aligned offset
-                    glm::mat4* modelMat = (glm::mat4*)(((uint64_t)uboDataDynamic.model + (index * dynamicAlignment)));
-
-                    // Update rotations
-                    rotations[index] += animationTimer * rotationSpeeds[index];
-
-                    // Update matrices
-                    glm::vec3 pos =
-                        glm::vec3(-((dim * offset.x) / 2.0f) + offset.x / 2.0f + x * offset.x, -((dim * offset.y) / 2.0f) + offset.y / 2.0f + y * offset.y,
-                                  -((dim * offset.z) / 2.0f) + offset.z / 2.0f + z * offset.z);
-                    *modelMat = glm::translate(glm::mat4(1.0f), pos);
-                    *modelMat = glm::rotate(*modelMat, rotations[index].x, glm::vec3(1.0f, 1.0f, 0.0f));
-                    *modelMat = glm::rotate(*modelMat, rotations[index].y, glm::vec3(0.0f, 1.0f, 0.0f));
-                    *modelMat = glm::rotate(*modelMat, rotations[index].z, glm::vec3(0.0f, 0.0f, 1.0f));
-                }
-            }
+        const auto& ranges = transforms.update(threadPool, backend, uniformBuffers.dynamic.mapped, dynamicAlignment);
+
+        // Flush only the changed matrices to make them visible to the device
+        flushRanges.clear();
+        for (const auto& range : ranges) {
+            flushRanges.push_back({ range.first * dynamicAlignment, range.count * dynamicAlignment });
         }
+        uniformBuffers.dynamic.flush(flushRanges, context.deviceProperties.limits.nonCoherentAtomSize);
 
+        updateStatistics.milliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+        updateStatistics.objects = transforms.updatedCount();
+        updateStatistics.ranges = static_cast<uint32_t>(ranges.size());
         animationTimer = 0.0f;
-        uniformBuffers.dynamic.copy(uniformBuffers.dynamic.size, uboDataDynamic.model);
-        // Flush to make changes visible to the host
-        uniformBuffers.dynamic.flush();
     }
 
     void prepare() override {
@@ -328,6 +323,35 @@ public:
     }
 
     void viewChanged() override { updateUniformBuffers(); }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            std::vector<std::string> fractionNames;
+            int32_t fractionIndex = 0;
+            for (const auto& fraction : animatedFractions) {
+                if (fraction == animatedFraction) {
+                    fractionIndex = static_cast<int32_t>(fractionNames.size());
+                }
+                fractionNames.push_back(std::to_string(static_cast<int32_t>(fraction * 100.0f)) + " %");
+            }
+            if (ui.comboBox("Animated", &fractionIndex, fractionNames)) {
+                setAnimatedFraction(animatedFractions[fractionIndex]);
+            }
+            std::vector<std::string> backendNames{ vkx::simd::name(vkx::simd::Backend::scalar) };
+            if (vkx::simd::best() != vkx::simd::Backend::scalar) {
+                backendNames.push_back(vkx::simd::name(vkx::simd::best()));
+            }
+            int32_t backendIndex = backend == vkx::simd::Backend::scalar ? 0 : 1;
+            if (ui.comboBox("Update", &backendIndex, backendNames)) {
+                backend = backendIndex == 0 ? vkx::simd::Backend::scalar : vkx::simd::best();
+            }
+        }
+        if (ui.header("Statistics")) {
+            ui.text("%u objects", OBJECT_INSTANCES);
+            ui.text("Updated %u matrices in %u ranges", updateStatistics.objects, updateStatistics.ranges);
+            ui.text("CPU update (%u threads): %.3f ms", threadPool.size(), updateStatistics.milliseconds);
+        }
+    }
 };
 
 VULKAN_EXAMPLE_MAIN()
@@ -0,0 +1,145 @@
+/*
+* Vulkan Example - Offline baking of the image based lighting maps
+*
+* Precomputes the BRDF look-up-table and the irradiance and pre-filtered cube maps of the environments the PBR
+* examples use and stores them in the cache of vkx::pbr, the cache/ directory next to the environment files.  The
+* examples then load the maps instead of generating them on startup.  Maps that are already cached are kept, the
+* ones baked with other parameters or shaders are replaced.  Runs headless.
+*
+* Before baking, both cube maps are generated with the render pass and the compute path of vkx::pbr to report
+* their bake times and how far the results are apart, and the spherical harmonics projection is run on the CPU
+* and the GPU.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <common.hpp>
+#include <utils.hpp>
+#include <pbr.hpp>
+#include <vks/context.hpp>
+#include <vks/model.hpp>
+#include <vks/texture.hpp>
+
+#if defined(__ANDROID__)
+#define LOG(...) ((void)__android_log_print(ANDROID_LOG_INFO, "vulkanExample", __VA_ARGS__))
+#else
+#define LOG(...) printf(__VA_ARGS__)
+#endif
+
+// The maps are made from the positions only
+static const vks::model::VertexLayout VERTEX_LAYOUT{ {
+    vks::model::VERTEX_COMPONENT_POSITION,
+} };
+
+class IblBake {
+public:
+    vks::Context context;
+    vks::model::Model skybox;
+    // Environments of pbribl and pbrtexture
+    const std::vector<std::string> environments{ "textures/hdr/pisa_cube.ktx", "textures/hdr/gcanyon_cube.ktx" };
+
+    IblBake() {
+#if DEBUG
+        context.setValidationEnabled(true);
+#endif
+        context.createInstance();
+        context.createDevice();
+        skybox.loadFromFile(context, vkx::getAssetPath() + "models/cube.obj", VERTEX_LAYOUT, 1.0f);
+    }
+
+    ~IblBake() {
+        skybox.destroy();
+        context.destroy();
+    }
+
+    static double milliseconds(std::chrono::high_resolution_clock::time_point tStart) {
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+    }
+
+    // Generate a cube with both methods and print the times and the relative RMS difference of all levels
+    template <typename GenerateFunction>
+    void compareCube(const char* name, GenerateFunction generate) {
+        const vkx::pbr::Method methods[2]{ vkx::pbr::Method::renderPass, vkx::pbr::Method::compute };
+        double times[2];
+        gli::texture_cube results[2];
+        for (uint32_t i = 0; i < 2; ++i) {
+            vkx::pbr::BakeParameters parameters;
+            parameters.method = methods[i];
+            vks::texture::TextureCubeMap target;
+            auto tStart = std::chrono::high_resolution_clock::now();
+            generate(target, parameters);
+            times[i] = milliseconds(tStart);
+            results[i] = gli::convert(gli::texture_cube(vkx::pbr::readBack(context, target, true)), gli::FORMAT_RGBA32_SFLOAT_PACK32);
+            target.destroy();
+        }
+
+        const glm::vec4* reference = results[0].data<glm::vec4>();
+        const glm::vec4* computed = results[1].data<glm::vec4>();
+        double difference = 0.0, magnitude = 0.0;
+        for (size_t i = 0; i < results[0].size<glm::vec4>(); ++i) {
+            const glm::vec3 delta = glm::vec3(computed[i]) - glm::vec3(reference[i]);
+            difference += glm::dot(delta, delta);
+            magnitude += glm::dot(glm::vec3(reference[i]), glm::vec3(reference[i]));
+        }
+        LOG("%-14s %12.2f %12.2f %12.4f\n", name, times[0], times[1], sqrt(difference / std::max(magnitude, 1e-12)));
+    }
+
+    void compare(const std::string& environmentFile, const vks::texture::TextureCubeMap& environmentCube) {
+        LOG("%-14s %12s %12s %12s\n", "Map", "Passes ms", "Compute ms", "RMS diff");
+        compareCube("Irradiance", [&](vks::texture::Texture& target, const vkx::pbr::BakeParameters& parameters) {
+            vkx::pbr::generateIrradianceCube(context, target, skybox, VERTEX_LAYOUT, environmentCube.descriptor, parameters);
+        });
+        compareCube("Pre-filtered", [&](vks::texture::Texture& target, const vkx::pbr::BakeParameters& parameters) {
+            vkx::pbr::generatePrefilteredCube(context, target, skybox, VERTEX_LAYOUT, environmentCube.descriptor, parameters);
+        });
+
+        std::shared_ptr<gli::texture_cube> environment;
+        vks::file::withBinaryFileContents(environmentFile, [&](size_t size, const void* data) {
+            environment = std::make_shared<gli::texture_cube>(gli::load(static_cast<const char*>(data), size));
+        });
+        auto tStart = std::chrono::high_resolution_clock::now();
+        const vkx::pbr::IrradianceSH cpu = vkx::pbr::projectIrradianceSH(*environment);
+        const double cpuTime = milliseconds(tStart);
+        tStart = std::chrono::high_resolution_clock::now();
+        const vkx::pbr::IrradianceSH gpu = vkx::pbr::generateIrradianceSH(context, environmentCube.descriptor);
+        const double gpuTime = milliseconds(tStart);
+        float maxDifference = 0.0f;
+        for (uint32_t i = 0; i < 9; ++i) {
+            const glm::vec4 delta = glm::abs(cpu.coefficients[i] - gpu.coefficients[i]);
+            maxDifference = std::max(maxDifference, std::max(delta.x, std::max(delta.y, delta.z)));
+        }
+        LOG("SH irradiance: CPU %.2f ms, GPU %.2f ms, largest coefficient difference %.4f (DC %.4f)\n", cpuTime, gpuTime, maxDifference,
+            cpu.coefficients[0].x);
+    }
+
+    void run() {
+        if (vkx::pbr::environmentCacheDirectory(vkx::getAssetPath() + environments[0]).empty()) {
+            LOG("The precomputed maps are not cached on this platform\n");
+            return;
+        }
+
+        for (const auto& environment : environments) {
+            const std::string environmentFile = vkx::getAssetPath() + environment;
+            const std::string cacheDirectory = vkx::pbr::environmentCacheDirectory(environmentFile);
+            LOG("Baking %s into %s\n", environmentFile.c_str(), cacheDirectory.c_str());
+
+            vks::texture::TextureCubeMap environmentCube, irradianceCube, prefilteredCube;
+            vks::texture::Texture2D lutBrdf;
+            environmentCube.loadFromFile(context, environmentFile, vk::Format::eR16G16B16A16Sfloat);
+            compare(environmentFile, environmentCube);
+            vkx::pbr::loadOrGenerateBRDFLUT(context, cacheDirectory, lutBrdf);
+            vkx::pbr::loadOrGenerateIrradianceCube(context, cacheDirectory, environmentFile, irradianceCube, skybox, VERTEX_LAYOUT, environmentCube.descriptor);
+            vkx::pbr::loadOrGeneratePrefilteredCube(context, cacheDirectory, environmentFile, prefilteredCube, skybox, VERTEX_LAYOUT,
+                                                    environmentCube.descriptor);
+            context.queue.waitIdle();
+
+            environmentCube.destroy();
+            irradianceCube.destroy();
+            prefilteredCube.destroy();
+            lutBrdf.destroy();
+        }
+        LOG("Done\n");
+    }
+};
+
+RUN_EXAMPLE(IblBake)
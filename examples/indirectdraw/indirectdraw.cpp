@@ -15,11 +15,19 @@
 * The example shows how to setup and fill such a buffer on the CPU side, stages it to the device and
 * shows how to render it using only one draw command.
 *
+* The plants are static, so they are kept in a vkx::culling::Bvh.  Whenever the view changes the hierarchy
+* is culled against the view frustum, the visible instances of each mesh are packed together in the host
+* visible instance buffer and the instance counts of the indirect commands are rewritten to match.  Both
+* buffers hold one range per swap chain image, which is brought up to date when its image is drawn next.
+*
 * See readme.md for details
 *
 */
 
 #include <vulkanExampleBase.h>
+#include <culling.hpp>
+
+#include <chrono>
 
 // Number of instances per object
 #if defined(__ANDROID__)
@@ -61,11 +69,34 @@ public:
         uint32_t texIndex;
     };
 
-    // Contains the instanced data
+    // Contains the instanced data of the visible plants, grouped by mesh, objectCount instances per swap chain image
     vks::Buffer instanceBuffer;
-    // Contains the indirect drawing commands
+    // Contains the indirect drawing commands, indirectDrawCount commands per swap chain image
     vks::Buffer indirectCommandsBuffer;
     uint32_t indirectDrawCount;
+    uint32_t ringCount = 0;
+    // Incremented whenever the visible plants change, and the value each ring range was written with
+    uint32_t visibleGeneration = 0;
+    std::vector<uint32_t> ringGenerations;
+
+    // All plants, and the hierarchy of their bounds for culling
+    std::vector<InstanceData> instances;
+    vkx::culling::Bvh plantBvh;
+    vks::Frustum frustum;
+    vkx::ThreadPool threadPool;
+    vkx::simd::Backend backend = vkx::simd::best();
+    bool frustumCulling = true;
+    std::vector<uint32_t> visiblePlants;
+    // Visible plants in the order of the instance buffer
+    std::vector<uint32_t> packedPlants;
+    // Visible instances per mesh
+    std::vector<uint32_t> meshInstanceCounts;
+
+    struct {
+        float milliseconds = 0.0f;
+        uint32_t visible = 0;
+        vkx::culling::Bvh::Statistics bvh;
+    } cullStatistics;
 
     struct {
         glm::mat4 projection;
@@ -151,18 +182,22 @@ public:
         // Binding point 0 : Mesh vertex buffer
         drawCmdBuffer.bindVertexBuffers(0, models.plants.vertices.buffer, { 0 });
         // Binding point 1 : Instance data buffer
-        drawCmdBuffer.bindVertexBuffers(1, instanceBuffer.buffer, { 0 });
+        // The command buffers are recorded in swap chain image order, each one draws its own range of the rings
+        const auto image = static_cast<vk::DeviceSize>(&drawCmdBuffer - commandBuffers.data());
+        const vk::DeviceSize indirectOffset = image * indirectDrawCount * sizeof(VkDrawIndexedIndirectCommand);
+        drawCmdBuffer.bindVertexBuffers(1, instanceBuffer.buffer, { image * objectCount * sizeof(InstanceData) });
         drawCmdBuffer.bindIndexBuffer(models.plants.indices.buffer, 0, vk::IndexType::eUint32);
 
         // If the multi draw feature is supported:
         // One draw call for an arbitrary number of ojects
         // Index offsets and instance count are taken from the indirect buffer
+        // Culled meshes stay in the buffer with an instance count of 0
         if (deviceFeatures.multiDrawIndirect) {
-            drawCmdBuffer.drawIndexedIndirect(indirectCommandsBuffer.buffer, 0, indirectDrawCount, sizeof(VkDrawIndexedIndirectCommand));
+            drawCmdBuffer.drawIndexedIndirect(indirectCommandsBuffer.buffer, indirectOffset, indirectDrawCount, sizeof(VkDrawIndexedIndirectCommand));
         } else {
             // If multi draw is not available, we must issue separate draw commands
             for (auto j = 0; j < indirectCommands.size(); j++) {
-                drawCmdBuffer.drawIndexedIndirect(indirectCommandsBuffer.buffer, j * sizeof(VkDrawIndexedIndirectCommand), 1,
+                drawCmdBuffer.drawIndexedIndirect(indirectCommandsBuffer.buffer, indirectOffset + j * sizeof(VkDrawIndexedIndirectCommand), 1,
                                                   sizeof(VkDrawIndexedIndirectCommand));
             }
         }
@@ -268,7 +303,8 @@ public:
         builder.destroyShaderModules();
     }
 
-    // Prepare (and stage) a buffer containing the indirect draw commands
+    // Prepare the indirect draw commands.  Their buffer is host visible, as the instance counts change with the
+    // visible plants.
     void prepareIndirectData() {
         indirectCommands.clear();
 
@@ -291,12 +327,11 @@ public:
             objectCount += indirectCmd.instanceCount;
         }
         indirectDrawCount = static_cast<uint32_t>(indirectCommands.size());
-        indirectCommandsBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndirectBuffer, indirectCommands);
     }
 
-    // Prepare (and stage) a buffer containing instanced data for the mesh draws
+    // Prepare the instanced data of the mesh draws and the bounds of the plants for culling
     void prepareInstanceData() {
-        std::vector<InstanceData> instanceData;
+        std::vector<InstanceData>& instanceData = instances;
         instanceData.resize(objectCount);
 
         std::mt19937 rndGenerator((unsigned)time(NULL));
@@ -311,7 +346,92 @@ public:
             instanceData[i].texIndex = i / OBJECT_INSTANCE_COUNT;
         }
 
-        instanceBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, instanceData);
+        // The shader multiplies position and scaled vertex with the transposed rotation around y, so that is
+        // where the bounding sphere of the plant model ends up.  The spheres are stored as boxes in the hierarchy.
+        const float modelRadius = glm::length(glm::max(glm::abs(models.plants.dim.min), glm::abs(models.plants.dim.max)));
+        std::vector<glm::vec3> boundsMin(objectCount), boundsMax(objectCount);
+        for (uint32_t i = 0; i < objectCount; i++) {
+            const InstanceData& instance = instanceData[i];
+            const float c = cos(instance.rot.y), s = sin(instance.rot.y);
+            const glm::vec3 center{ c * instance.pos.x + s * instance.pos.z, instance.pos.y, c * instance.pos.z - s * instance.pos.x };
+            const float radius = instance.scale * modelRadius;
+            boundsMin[i] = center - glm::vec3(radius);
+            boundsMax[i] = center + glm::vec3(radius);
+        }
+        plantBvh.build(boundsMin, boundsMax);
+        updateVisiblePlants();
+        prepareInstanceRing();
+    }
+
+    // (Re)create the instance and indirect command rings if the swap chain image count changed
+    void prepareInstanceRing() {
+        if (ringCount == swapChain.imageCount) {
+            return;
+        }
+        if (instanceBuffer.buffer) {
+            device.waitIdle();
+            instanceBuffer.destroy();
+            indirectCommandsBuffer.destroy();
+        }
+        ringCount = swapChain.imageCount;
+        instanceBuffer = context.createBuffer(vk::BufferUsageFlagBits::eVertexBuffer,
+                                              vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                              ringCount * objectCount * sizeof(InstanceData));
+        instanceBuffer.map();
+        indirectCommandsBuffer = context.createBuffer(vk::BufferUsageFlagBits::eIndirectBuffer,
+                                                      vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                                      ringCount * indirectDrawCount * sizeof(vk::DrawIndexedIndirectCommand));
+        indirectCommandsBuffer.map();
+        ringGenerations.resize(ringCount);
+        for (uint32_t image = 0; image < ringCount; ++image) {
+            writeVisiblePlants(image);
+        }
+    }
+
+    // Pack the visible instances of each mesh after each other and point the indirect commands at them
+    void updateVisiblePlants() {
+        auto tStart = std::chrono::high_resolution_clock::now();
+        if (frustumCulling) {
+            frustum.update(camera.matrices.perspective * camera.matrices.view);
+            plantBvh.cull(frustum, backend, threadPool, visiblePlants);
+        } else {
+            visiblePlants.resize(objectCount);
+            for (uint32_t i = 0; i < objectCount; i++) {
+                visiblePlants[i] = i;
+            }
+        }
+
+        // The instances of mesh m are [m * OBJECT_INSTANCE_COUNT, (m + 1) * OBJECT_INSTANCE_COUNT)
+        meshInstanceCounts.assign(indirectCommands.size(), 0);
+        for (uint32_t plant : visiblePlants) {
+            meshInstanceCounts[plant / OBJECT_INSTANCE_COUNT]++;
+        }
+        uint32_t firstInstance = 0;
+        for (size_t m = 0; m < indirectCommands.size(); m++) {
+            indirectCommands[m].firstInstance = firstInstance;
+            indirectCommands[m].instanceCount = 0;
+            firstInstance += meshInstanceCounts[m];
+        }
+        packedPlants.resize(visiblePlants.size());
+        for (uint32_t plant : visiblePlants) {
+            auto& command = indirectCommands[plant / OBJECT_INSTANCE_COUNT];
+            packedPlants[command.firstInstance + command.instanceCount++] = plant;
+        }
+        ++visibleGeneration;
+
+        cullStatistics.milliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+        cullStatistics.visible = static_cast<uint32_t>(visiblePlants.size());
+        cullStatistics.bvh = frustumCulling ? plantBvh.statistics() : vkx::culling::Bvh::Statistics{};
+    }
+
+    // Copy the packed instances and the indirect commands to the ring ranges of a swap chain image
+    void writeVisiblePlants(uint32_t image) {
+        InstanceData* instanceData = static_cast<InstanceData*>(instanceBuffer.mapped) + static_cast<size_t>(image) * objectCount;
+        for (size_t i = 0; i < packedPlants.size(); i++) {
+            instanceData[i] = instances[packedPlants[i]];
+        }
+        indirectCommandsBuffer.copy(indirectCommands, image * indirectDrawCount * sizeof(vk::DrawIndexedIndirectCommand));
+        ringGenerations[image] = visibleGeneration;
     }
 
     void prepareUniformBuffers() {
@@ -323,6 +443,7 @@ public:
         if (viewChanged) {
             uboVS.projection = camera.matrices.perspective;
             uboVS.view = camera.matrices.view;
+            updateVisiblePlants();
         }
 
         memcpy(uniformData.scene.mapped, &uboVS, sizeof(uboVS));
@@ -341,6 +462,29 @@ public:
         prepared = true;
     }
 
+    void buildCommandBuffers() override {
+        // The number of swap chain images may change with the window size
+        prepareInstanceRing();
+        ExampleBase::buildCommandBuffers();
+    }
+
+    void render() override {
+        if (!prepared) {
+            return;
+        }
+        prepareFrame();
+        // Bring the ring ranges of this image up to date once the previous frame drawing from them has completed
+        if (ringGenerations[currentBuffer] != visibleGeneration) {
+            const auto& fence = swapChain.images[currentBuffer].fence;
+            if (fence) {
+                device.waitForFences(fence, VK_TRUE, UINT64_MAX);
+            }
+            writeVisiblePlants(currentBuffer);
+        }
+        drawCurrentCommandBuffer();
+        submitFrame();
+    }
+
     void viewChanged() override { updateUniformBuffer(true); }
 
     void OnUpdateUIOverlay() override {
@@ -349,8 +493,27 @@ public:
                 ui.text("multiDrawIndirect not supported");
             }
         }
+        if (ui.header("Settings")) {
+            if (ui.checkBox("Frustum culling", &frustumCulling)) {
+                updateVisiblePlants();
+            }
+            std::vector<std::string> backendNames{ vkx::simd::name(vkx::simd::Backend::scalar) };
+            if (vkx::simd::best() != vkx::simd::Backend::scalar) {
+                backendNames.push_back(vkx::simd::name(vkx::simd::best()));
+            }
+            int32_t backendIndex = backend == vkx::simd::Backend::scalar ? 0 : 1;
+            if (ui.comboBox("Leaf tests", &backendIndex, backendNames)) {
+                backend = backendIndex == 0 ? vkx::simd::Backend::scalar : vkx::simd::best();
+                updateVisiblePlants();
+            }
+        }
         if (ui.header("Statistics")) {
             ui.text("Objects: %d", objectCount);
+            ui.text("Visible: %u", cullStatistics.visible);
+            ui.text("Nodes tested: %u", cullStatistics.bvh.nodesTested);
+            ui.text("Nodes rejected: %u, inside: %u", cullStatistics.bvh.nodesRejected, cullStatistics.bvh.nodesAccepted);
+            ui.text("Objects tested: %u", cullStatistics.bvh.objectsTested);
+            ui.text("CPU culling (%u threads): %.3f ms", threadPool.size(), cullStatistics.milliseconds);
         }
     }
 };
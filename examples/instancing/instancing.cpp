@@ -4,9 +4,17 @@
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*
+* The rocks orbit the planet, so their bounding spheres are culled against the view frustum with a
+* vkx::culling::ObjectSet every frame.  Only the visible instances are copied to the instance buffer, and
+* the instance count of the draw is read from a host visible indirect buffer.  Both buffers hold one range
+* per swap chain image, so a frame never overwrites instances a previous frame is still drawing.
 */
 
 #include <vulkanExampleBase.h>
+#include <culling.hpp>
+
+#include <chrono>
 
 #define INSTANCE_COUNT 2048
 
@@ -38,8 +46,26 @@ public:
         uint32_t texIndex;
     };
 
-    // Contains the instanced data
+    // Contains the instanced data of the visible rocks, INSTANCE_COUNT instances per swap chain image
     vks::Buffer instanceBuffer;
+    // Indexed draw command of the visible rocks, one per swap chain image
+    vks::Buffer indirectBuffer;
+    uint32_t ringCount = 0;
+
+    // All rocks, and their bounding spheres after the orbit rotation of the current frame
+    std::vector<InstanceData> instances;
+    vkx::culling::ObjectSet rockBounds;
+    float rockRadius = 0.0f;
+    vks::Frustum frustum;
+    vkx::ThreadPool threadPool;
+    vkx::simd::Backend backend = vkx::simd::best();
+    bool frustumCulling = true;
+    std::vector<uint32_t> visibleRocks;
+
+    struct {
+        float milliseconds = 0.0f;
+        uint32_t visible = 0;
+    } cullStatistics;
 
     struct UboVS {
         glm::mat4 projection;
@@ -80,6 +106,7 @@ public:
         device.destroyPipelineLayout(pipelineLayout);
         device.destroyDescriptorSetLayout(descriptorSetLayout);
         instanceBuffer.destroy();
+        indirectBuffer.destroy();
         models.planet.destroy();
         models.rock.destroy();
         uniformData.scene.destroy();
@@ -106,10 +133,12 @@ public:
         // Binding point 0 : Mesh vertex buffer
         cmdBuffer.bindVertexBuffers(0, models.rock.vertices.buffer, { 0 });
         // Binding point 1 : Instance data buffer
-        cmdBuffer.bindVertexBuffers(1, instanceBuffer.buffer, { 0 });
+        // The command buffers are recorded in swap chain image order, each one draws its own range of the ring
+        const auto image = static_cast<vk::DeviceSize>(&cmdBuffer - commandBuffers.data());
+        cmdBuffer.bindVertexBuffers(1, instanceBuffer.buffer, { image * INSTANCE_COUNT * sizeof(InstanceData) });
         cmdBuffer.bindIndexBuffer(models.rock.indices.buffer, 0, vk::IndexType::eUint32);
-        // Render instances
-        cmdBuffer.drawIndexed(models.rock.indexCount, INSTANCE_COUNT, 0, 0, 0);
+        // Render the visible instances
+        cmdBuffer.drawIndexedIndirect(indirectBuffer.buffer, image * sizeof(vk::DrawIndexedIndirectCommand), 1, sizeof(vk::DrawIndexedIndirectCommand));
     }
 
     void loadAssets() override {
@@ -226,7 +255,7 @@ public:
     uint32_t rnd(uint32_t range) { return (uint32_t)rnd((float)range); }
 
     void prepareInstanceData() {
-        std::vector<InstanceData> instanceData;
+        std::vector<InstanceData>& instanceData = instances;
         instanceData.resize(INSTANCE_COUNT);
 
         std::default_random_engine rndGenerator(benchmark.active ? 0 : (unsigned)time(nullptr));
@@ -259,10 +288,71 @@ public:
             instanceData[i + INSTANCE_COUNT / 2].scale *= 0.75f;
         }
 
-        // Staging
-        // Instanced data is static, copy to device local memory
-        // This results in better performance
-        instanceBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, instanceData);
+        rockRadius = glm::length(glm::max(glm::abs(models.rock.dim.min), glm::abs(models.rock.dim.max)));
+        rockBounds.resize(INSTANCE_COUNT, vkx::culling::Shape::sphere);
+        updateVisibleRocks();
+        prepareInstanceRing();
+    }
+
+    // (Re)create the instance and indirect rings if the swap chain image count changed
+    void prepareInstanceRing() {
+        if (ringCount == swapChain.imageCount) {
+            return;
+        }
+        if (instanceBuffer.buffer) {
+            device.waitIdle();
+            instanceBuffer.destroy();
+            indirectBuffer.destroy();
+        }
+        ringCount = swapChain.imageCount;
+        // The instance data itself is static, but only the visible rocks are copied to the buffer every frame
+        instanceBuffer = context.createBuffer(vk::BufferUsageFlagBits::eVertexBuffer,
+                                              vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                              ringCount * INSTANCE_COUNT * sizeof(InstanceData));
+        instanceBuffer.map();
+        indirectBuffer = context.createBuffer(vk::BufferUsageFlagBits::eIndirectBuffer,
+                                              vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                              ringCount * sizeof(vk::DrawIndexedIndirectCommand));
+        indirectBuffer.map();
+        for (uint32_t image = 0; image < ringCount; ++image) {
+            writeVisibleRocks(image);
+        }
+    }
+
+    // Cull the rocks at their current place in the orbit
+    void updateVisibleRocks() {
+        auto tStart = std::chrono::high_resolution_clock::now();
+        visibleRocks.clear();
+        if (frustumCulling) {
+            // Same rotation around the planet as gRotMat in the vertex shader
+            for (uint32_t i = 0; i < INSTANCE_COUNT; i++) {
+                const InstanceData& instance = instances[i];
+                const float angle = instance.rot.y + uboVS.globSpeed;
+                const float c = cos(angle), s = sin(angle);
+                const glm::vec3 center{ c * instance.pos.x - s * instance.pos.z, instance.pos.y, s * instance.pos.x + c * instance.pos.z };
+                rockBounds.setSphere(i, center, instance.scale * rockRadius);
+            }
+            frustum.update(uboVS.projection * uboVS.view);
+            rockBounds.cull(frustum, backend, threadPool);
+            rockBounds.visibleIndices(visibleRocks);
+        } else {
+            for (uint32_t i = 0; i < INSTANCE_COUNT; i++) {
+                visibleRocks.push_back(i);
+            }
+        }
+
+        cullStatistics.milliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+        cullStatistics.visible = static_cast<uint32_t>(visibleRocks.size());
+    }
+
+    // Copy the visible rocks and their draw command to the ring range of a swap chain image
+    void writeVisibleRocks(uint32_t image) {
+        InstanceData* instanceData = static_cast<InstanceData*>(instanceBuffer.mapped) + static_cast<size_t>(image) * INSTANCE_COUNT;
+        for (size_t i = 0; i < visibleRocks.size(); i++) {
+            instanceData[i] = instances[visibleRocks[i]];
+        }
+        vk::DrawIndexedIndirectCommand command{ models.rock.indexCount, static_cast<uint32_t>(visibleRocks.size()), 0, 0, 0 };
+        indirectBuffer.copy(command, image * sizeof(vk::DrawIndexedIndirectCommand));
     }
 
     void prepareUniformBuffers() {
@@ -285,8 +375,8 @@ public:
 
     void prepare() override {
         ExampleBase::prepare();
-        prepareInstanceData();
         prepareUniformBuffers();
+        prepareInstanceData();
         setupDescriptorSetLayout();
         preparePipelines();
         setupDescriptorPool();
@@ -295,17 +385,51 @@ public:
         prepared = true;
     }
 
+    void buildCommandBuffers() override {
+        // The number of swap chain images may change with the window size
+        prepareInstanceRing();
+        ExampleBase::buildCommandBuffers();
+    }
+
     void render() override {
         if (!prepared) {
             return;
         }
-        draw();
+        prepareFrame();
+        // Every ring range is refreshed when its image comes up again, so view and setting changes need no
+        // update of their own.  The previous frame drawing from this range has to complete first.
+        const auto& fence = swapChain.images[currentBuffer].fence;
+        if (fence) {
+            device.waitForFences(fence, VK_TRUE, UINT64_MAX);
+        }
+        updateVisibleRocks();
+        writeVisibleRocks(currentBuffer);
+        drawCurrentCommandBuffer();
+        submitFrame();
         if (!paused) {
             updateUniformBuffer(false);
         }
     }
 
     void viewChanged() override { updateUniformBuffer(true); }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            ui.checkBox("Frustum culling", &frustumCulling);
+            std::vector<std::string> backendNames{ vkx::simd::name(vkx::simd::Backend::scalar) };
+            if (vkx::simd::best() != vkx::simd::Backend::scalar) {
+                backendNames.push_back(vkx::simd::name(vkx::simd::best()));
+            }
+            int32_t backendIndex = backend == vkx::simd::Backend::scalar ? 0 : 1;
+            if (ui.comboBox("Culling", &backendIndex, backendNames)) {
+                backend = backendIndex == 0 ? vkx::simd::Backend::scalar : vkx::simd::best();
+            }
+        }
+        if (ui.header("Statistics")) {
+            ui.text("Rocks: %u, visible: %u", INSTANCE_COUNT, cullStatistics.visible);
+            ui.text("CPU culling (%u threads): %.3f ms", threadPool.size(), cullStatistics.milliseconds);
+        }
+    }
 };
 
 RUN_EXAMPLE(VulkanExample)
@@ -0,0 +1,298 @@
+/*
+* Vulkan Example - Benchmark of clustered light culling
+*
+* Sweeps the number of point and spot lights above a ground plane whose area grows with the light count, so the
+* lights stay equally dense.  For every count the lights are assigned to the clusters of vkx::ClusteredLighting
+* by the reference on the host and on the GPU, and a compute pass shades a synthetic G-Buffer of the plane with
+* the lights of each cluster, and with all lights up to MAX_ALL_LIGHTS_COUNT.  The cost of the clustered pass
+* follows the density of the lights while the cost of shading with all of them grows with their number.  The
+* lists of the GPU are compared against the host reference.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <common.hpp>
+#include <vks/context.hpp>
+#include <vks/shaders.hpp>
+#include <utils.hpp>
+#include <clusteredlighting.hpp>
+
+#include <random>
+
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+#define LOG(...) ((void)__android_log_print(ANDROID_LOG_INFO, "vulkanExample", __VA_ARGS__))
+#else
+#define LOG(...) printf(__VA_ARGS__)
+#endif
+
+#define MIN_LIGHT_COUNT 64
+#define MAX_LIGHT_COUNT 16384
+// Shading every pixel with every light is only timed up to this count
+#define MAX_ALL_LIGHTS_COUNT 4096
+// Lights per square unit of the ground plane
+#define LIGHT_DENSITY 0.5f
+// Size of the synthetic G-Buffer
+#define WIDTH 1280
+#define HEIGHT 720
+// Frames timed for every light count, after one to warm up
+#define FRAME_COUNT 16
+// Start of the sweep and the end of the three timed passes
+#define TIMESTAMP_COUNT 4
+
+// Minimum time to run the host reference for each light count
+static const double MIN_SECONDS = 0.25;
+
+class LightingBenchmark {
+public:
+    vks::Context context;
+    vk::Device& device{ context.device };
+    vkx::ClusteredLighting clusteredLighting{ context };
+
+    struct PushConstants {
+        glm::mat4 inverseProjection;
+        glm::vec4 plane;
+        glm::uvec2 size;
+        uint32_t allLights{ 0 };
+        float zFar;
+    } pushConstants;
+
+    float zNear = 0.1f;
+    float zFar = 128.0f;
+    glm::mat4 projection;
+    glm::mat4 view;
+
+    vks::Buffer colors;
+    vk::DescriptorPool descriptorPool;
+    vk::DescriptorSetLayout descriptorSetLayout;
+    vk::DescriptorSet descriptorSet;
+    vk::PipelineLayout pipelineLayout;
+    vk::Pipeline pipeline;
+    vk::QueryPool queryPool;
+    vk::CommandBuffer commandBuffer;
+    vk::Fence fence;
+
+    uint32_t mismatches = 0;
+
+    ~LightingBenchmark() {
+        if (!device) {
+            return;
+        }
+        device.waitIdle();
+        clusteredLighting.destroy();
+        colors.destroy();
+        device.destroy(pipeline);
+        device.destroy(pipelineLayout);
+        device.destroy(descriptorSetLayout);
+        device.destroy(descriptorPool);
+        device.destroy(queryPool);
+        device.destroy(fence);
+        context.destroy();
+    }
+
+    void prepare() {
+#if defined(VK_USE_PLATFORM_ANDROID_KHR)
+        vks::android::loadVulkanLibrary();
+#endif
+        context.createInstance();
+        context.createDevice();
+        LOG("GPU: %s\n", context.deviceProperties.deviceName);
+
+        // Looking over the plane from above its center
+        const glm::vec3 eye{ 0.0f, 4.0f, 0.0f };
+        projection = glm::perspective(glm::radians(60.0f), static_cast<float>(WIDTH) / HEIGHT, zNear, zFar);
+        view = glm::lookAt(eye, glm::vec3(0.0f, 0.0f, -16.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        const glm::vec3 normal = glm::mat3(view) * glm::vec3(0.0f, 1.0f, 0.0f);
+        pushConstants.inverseProjection = glm::inverse(projection);
+        pushConstants.plane = glm::vec4(normal, -glm::dot(normal, glm::vec3(view * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f))));
+        pushConstants.size = glm::uvec2(WIDTH, HEIGHT);
+        pushConstants.zFar = zFar;
+
+        // Room for every list to be full, so only the per cluster limit drops lights
+        const vkx::ClusteredLighting::Grid grid{};
+        clusteredLighting.create(MAX_LIGHT_COUNT, grid, grid.clusterCount() * grid.maxLightsPerCluster);
+        clusteredLighting.update(projection, view, zNear, zFar);
+
+        colors = context.createDeviceBuffer(vk::BufferUsageFlagBits::eStorageBuffer, vk::DeviceSize(WIDTH) * HEIGHT * sizeof(glm::vec4));
+
+        std::vector<vk::DescriptorPoolSize> poolSizes = {
+            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 1 },
+            vk::DescriptorPoolSize{ vk::DescriptorType::eStorageBuffer, 4 },
+        };
+        descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 1, static_cast<uint32_t>(poolSizes.size()), poolSizes.data() });
+        // Binding 0 - 3 : Clusters and their lights
+        auto setLayoutBindings = vkx::ClusteredLighting::descriptorBindings(0, vk::ShaderStageFlagBits::eCompute);
+        // Binding 4 : Shaded pixels
+        setLayoutBindings.push_back({ 4, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eCompute });
+        descriptorSetLayout = device.createDescriptorSetLayout({ {}, static_cast<uint32_t>(setLayoutBindings.size()), setLayoutBindings.data() });
+        descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayout })[0];
+        auto writeDescriptorSets = clusteredLighting.descriptorWrites(descriptorSet, 0);
+        writeDescriptorSets.push_back({ descriptorSet, 4, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &colors.descriptor });
+        device.updateDescriptorSets(writeDescriptorSets, nullptr);
+
+        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eCompute, 0, sizeof(PushConstants) };
+        pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout, 1, &pushConstantRange });
+        vk::ComputePipelineCreateInfo computePipelineCreateInfo;
+        computePipelineCreateInfo.layout = pipelineLayout;
+        computePipelineCreateInfo.stage =
+            vks::shaders::loadShader(device, vkx::getAssetPath() + "shaders/lightingbenchmark/shade.comp.spv", vk::ShaderStageFlagBits::eCompute);
+        pipeline = device.createComputePipeline(context.pipelineCache, computePipelineCreateInfo);
+        device.destroyShaderModule(computePipelineCreateInfo.stage.module);
+
+        queryPool = device.createQueryPool({ {}, vk::QueryType::eTimestamp, TIMESTAMP_COUNT });
+        commandBuffer = context.allocateCommandBuffers(1)[0];
+        fence = device.createFence({});
+    }
+
+    // Lights above a square of the plane around the camera, every fourth one a spot light pointing down
+    std::vector<vkx::ClusteredLighting::Light> generateLights(uint32_t count) const {
+        using Light = vkx::ClusteredLighting::Light;
+        const float extent = std::sqrt(count / LIGHT_DENSITY) * 0.5f;
+        std::default_random_engine rndGen(0);
+        std::uniform_real_distribution<float> rndDist(0.0f, 1.0f);
+        std::vector<Light> lights;
+        lights.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            const glm::vec3 position{ (rndDist(rndGen) * 2.0f - 1.0f) * extent, 0.1f + rndDist(rndGen) * 1.9f, (rndDist(rndGen) * 2.0f - 1.0f) * extent };
+            const glm::vec3 color{ rndDist(rndGen), rndDist(rndGen), rndDist(rndGen) };
+            const float range = 1.0f + rndDist(rndGen) * 2.0f;
+            if (i % 4 == 0) {
+                const glm::vec3 direction{ rndDist(rndGen) - 0.5f, -1.0f, rndDist(rndGen) - 0.5f };
+                lights.push_back(Light::spot(position, direction, range * 2.0f, glm::radians(25.0f), glm::radians(40.0f), color));
+            } else {
+                lights.push_back(Light::point(position, range, color));
+            }
+        }
+        return lights;
+    }
+
+    // Assign the lights, shade the plane with the lights of the clusters and then with all lights
+    void buildCommandBuffer(bool allLights) {
+        commandBuffer.begin(vk::CommandBufferBeginInfo{});
+        commandBuffer.resetQueryPool(queryPool, 0, TIMESTAMP_COUNT);
+        commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, queryPool, 0);
+        clusteredLighting.record(commandBuffer);
+        commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, queryPool, 1);
+
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eCompute, pipeline);
+        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eCompute, pipelineLayout, 0, descriptorSet, nullptr);
+        pushConstants.allLights = 0;
+        commandBuffer.pushConstants<PushConstants>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushConstants);
+        commandBuffer.dispatch((WIDTH + 7) / 8, (HEIGHT + 7) / 8, 1);
+        commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, queryPool, 2);
+
+        if (allLights) {
+            vk::MemoryBarrier barrier{ vk::AccessFlagBits::eShaderWrite, vk::AccessFlagBits::eShaderWrite };
+            commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eComputeShader, vk::PipelineStageFlagBits::eComputeShader, {}, barrier, nullptr, nullptr);
+            pushConstants.allLights = 1;
+            commandBuffer.pushConstants<PushConstants>(pipelineLayout, vk::ShaderStageFlagBits::eCompute, 0, pushConstants);
+            commandBuffer.dispatch((WIDTH + 7) / 8, (HEIGHT + 7) / 8, 1);
+        }
+        commandBuffer.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, queryPool, 3);
+        commandBuffer.end();
+    }
+
+    // Milliseconds of the assignment, the clustered shading and the shading with all lights, averaged over FRAME_COUNT frames
+    glm::dvec3 measureDevice() {
+        const double period = context.deviceProperties.limits.timestampPeriod;
+        glm::dvec3 total{ 0.0 };
+        for (uint32_t frame = 0; frame <= FRAME_COUNT; ++frame) {
+            context.queue.submit(vk::SubmitInfo{ 0, nullptr, nullptr, 1, &commandBuffer }, fence);
+            device.waitForFences(fence, VK_TRUE, UINT64_MAX);
+            device.resetFences(fence);
+            std::vector<uint64_t> timestamps(TIMESTAMP_COUNT);
+            device.getQueryPoolResults(queryPool, 0, TIMESTAMP_COUNT, vk::ArrayProxy<uint64_t>{ timestamps }, sizeof(uint64_t),
+                                       vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait);
+            if (frame > 0) {
+                total += glm::dvec3(timestamps[1] - timestamps[0], timestamps[2] - timestamps[1], timestamps[3] - timestamps[2]) * period / 1e6;
+            }
+        }
+        return total / static_cast<double>(FRAME_COUNT);
+    }
+
+    // Milliseconds of the host reference, run until MIN_SECONDS have passed
+    template <typename Function>
+    double measureHost(Function function) {
+        uint32_t runs = 0;
+        auto tStart = std::chrono::high_resolution_clock::now();
+        double seconds = 0.0;
+        do {
+            function();
+            ++runs;
+            seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+        } while (seconds < MIN_SECONDS);
+        return seconds * 1000.0 / runs;
+    }
+
+    // Count the clusters whose list differs from the reference, leaving out the ones the GPU has to cut short
+    void check(uint32_t lightCount, const std::vector<glm::uvec2>& referenceClusters, const std::vector<uint32_t>& referenceIndices) {
+        std::vector<glm::uvec2> clusters;
+        std::vector<uint32_t> indices;
+        clusteredLighting.download(clusters, indices);
+        const auto& grid = clusteredLighting.grid();
+        for (uint32_t cluster = 0; cluster < grid.clusterCount(); ++cluster) {
+            const glm::uvec2& expected = referenceClusters[cluster];
+            if (expected.y > grid.maxLightsPerCluster) {
+                continue;
+            }
+            const auto begin = indices.begin() + clusters[cluster].x;
+            std::vector<uint32_t> list(begin, begin + clusters[cluster].y);
+            std::sort(list.begin(), list.end());
+            const auto expectedBegin = referenceIndices.begin() + expected.x;
+            if (list.size() != expected.y || !std::equal(list.begin(), list.end(), expectedBegin)) {
+                if (mismatches == 0) {
+                    LOG("%u lights: %u lights in cluster %u instead of %u\n", lightCount, clusters[cluster].y, cluster, expected.y);
+                }
+                ++mismatches;
+            }
+        }
+    }
+
+    void runLightCount(uint32_t lightCount) {
+        clusteredLighting.setLights(generateLights(lightCount));
+
+        const auto& grid = clusteredLighting.grid();
+        const auto viewLights = clusteredLighting.viewSpaceLights();
+        std::vector<glm::uvec2> referenceClusters;
+        std::vector<uint32_t> referenceIndices;
+        const double hostMs = measureHost([&] {
+            vkx::ClusteredLighting::assign(grid, clusteredLighting.clusterBounds(), viewLights, referenceClusters, referenceIndices);
+        });
+
+        const bool allLights = lightCount <= MAX_ALL_LIGHTS_COUNT;
+        buildCommandBuffer(allLights);
+        const glm::dvec3 deviceMs = measureDevice();
+        check(lightCount, referenceClusters, referenceIndices);
+
+        // Lights of the clusters that any light reaches
+        uint32_t occupied = 0;
+        uint32_t maxLights = 0;
+        for (const auto& cluster : referenceClusters) {
+            occupied += cluster.y > 0 ? 1 : 0;
+            maxLights = std::max(maxLights, cluster.y);
+        }
+        const double averageLights = occupied ? static_cast<double>(referenceIndices.size()) / occupied : 0.0;
+
+        if (allLights) {
+            LOG("%7u %11.3f %11.3f %13.3f %13.3f %9.1f %9u\n", lightCount, hostMs, deviceMs.x, deviceMs.y, deviceMs.z, averageLights, maxLights);
+        } else {
+            LOG("%7u %11.3f %11.3f %13.3f %13s %9.1f %9u\n", lightCount, hostMs, deviceMs.x, deviceMs.y, "-", averageLights, maxLights);
+        }
+    }
+
+    void run() {
+        prepare();
+        if (context.queueFamilyProperties[context.queueIndices.graphics].timestampValidBits == 0) {
+            LOG("Timestamps are not supported by the queue\n");
+            return;
+        }
+        const auto& grid = clusteredLighting.grid();
+        LOG("%ux%u pixels, %ux%ux%u clusters, %.2f lights per square unit\n", WIDTH, HEIGHT, grid.width, grid.height, grid.depth, LIGHT_DENSITY);
+        LOG("%7s %11s %11s %13s %13s %9s %9s\n", "Lights", "Host ms", "Assign ms", "Clustered ms", "All lights ms", "Avg/cell", "Max/cell");
+        for (uint32_t lightCount = MIN_LIGHT_COUNT; lightCount <= MAX_LIGHT_COUNT; lightCount *= 2) {
+            runLightCount(lightCount);
+        }
+        LOG("%u cluster lists differ from the host reference\n", mismatches);
+    }
+};
+
+RUN_EXAMPLE(LightingBenchmark)
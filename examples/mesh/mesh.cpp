@@ -13,8 +13,10 @@ using namespace vkx;
 // Vertex layout used in this example
 struct Vertex {
     glm::vec3 pos;
-    glm::vec3 normal;
-    glm::vec2 uv;
+    // snorm16 x, y, z and 0
+    int16_t normal[4];
+    // Half floats
+    uint16_t uv[2];
     glm::vec3 color;
 };
 
@@ -31,10 +33,11 @@ public:
     // This is for demonstration and learning purposes,
     // the other examples use a mesh loader class for easy access
     struct Mesh {
+        // Normals as 16 bit snorm and texture coordinates as half floats, read by the shader like floats
         vks::model::VertexLayout vertexLayout{ {
             vks::model::VERTEX_COMPONENT_POSITION,
-            vks::model::VERTEX_COMPONENT_NORMAL,
-            vks::model::VERTEX_COMPONENT_UV,
+            vks::model::VERTEX_COMPONENT_NORMAL_SNORM16,
+            vks::model::VERTEX_COMPONENT_UV_HALF,
             vks::model::VERTEX_COMPONENT_COLOR,
         } };
         vks::model::Model model;
@@ -89,7 +92,7 @@ public:
         // Bind mesh vertex buffer
         cmdBuffer.bindVertexBuffers(0, meshes.model.vertices.buffer, { 0 });
         // Bind mesh index buffer
-        cmdBuffer.bindIndexBuffer(meshes.model.indices.buffer, 0, vk::IndexType::eUint32);
+        cmdBuffer.bindIndexBuffer(meshes.model.indices.buffer, 0, meshes.model.indexType);
         // Render mesh vertex buffer using it's indices
         cmdBuffer.drawIndexed(meshes.model.indexCount, 1, 0, 0, 0);
     }
@@ -97,7 +100,19 @@ public:
     // Load a mesh based on data read via assimp
     // The other example will use the VulkanMesh loader which has some additional functionality for loading meshes
     void loadAssets() override {
-        meshes.model.loadFromFile(context, getAssetPath() + "models/voyager/voyager.dae", meshes.vertexLayout);
+        // Merge duplicate vertices, order the triangles for the post transform cache and less overdraw and the
+        // vertices for fetching, and use 16 bit indices if they fit
+        vks::model::ModelCreateInfo createInfo;
+        createInfo.optimization.enabled = true;
+        createInfo.optimization.shortIndices = true;
+        meshes.model.loadFromFile(context, getAssetPath() + "models/voyager/voyager.dae", meshes.vertexLayout, createInfo);
+        const auto& report = meshes.model.optimizationReport;
+        std::cout << "Mesh optimization of " << report.triangleCount << " triangles in " << report.milliseconds << " ms:" << std::endl
+                  << "  vertices " << report.vertexCountBefore << " -> " << report.vertexCountAfter << ", " << report.floatBytesPerVertex << " -> "
+                  << report.bytesPerVertex << " bytes each" << std::endl
+                  << "  ACMR " << report.cacheBefore.acmr << " -> " << report.cacheAfter.acmr << ", ATVR " << report.cacheBefore.atvr << " -> "
+                  << report.cacheAfter.atvr << std::endl
+                  << "  buffers " << report.bytesBefore << " -> " << report.bytesAfter << " bytes" << std::endl;
         textures.colorMap.loadFromFile(context, getAssetPath() + "models/voyager/voyager.ktx", vk::Format::eBc3UnormBlock);
     }
 
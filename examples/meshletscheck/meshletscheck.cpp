@@ -0,0 +1,311 @@
+/*
+* Vulkan Example - CPU checks and benchmark of the meshlet builder
+*
+* Splits grids, spheres and scattered pieces with shuffled triangles into meshlets with
+* vks::model::buildMeshlets().  The meshlets have to cover the index buffer with consecutive ranges that keep
+* every triangle with its winding, stay within the triangle limits, and come out the same when built again.
+* Every bounding sphere has to contain its vertices, and the normal cone test may only cull a meshlet for a
+* camera that none of its triangles face, which is tried from random camera positions.  The time to build the
+* meshlets of growing meshes is reported at the end.  Needs no GPU.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <check.hpp>
+#include <vks/meshlets.hpp>
+
+#include <cfloat>
+
+// Triangle limits of the meshlets, the defaults of buildMeshlets() first
+#define TRIANGLE_LIMITS { { 124, 64 }, { 64, 32 }, { 16, 1 } }
+// Random camera positions per mesh, in a box three times the size of the mesh
+#define CAMERA_COUNT 256
+// Distance a triangle plane may be off from the camera for rounding
+#define PLANE_TOLERANCE 1e-4f
+
+// Minimum time to build the meshlets per mesh size
+static const double MIN_SECONDS = 0.25;
+
+using namespace vks::model;
+
+class MeshletsCheck : public vkx::Check {
+public:
+    struct Vertex {
+        glm::vec3 position;
+        glm::vec2 uv;
+    };
+
+    struct Mesh {
+        std::string name;
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+
+        uint32_t vertexCount() const { return static_cast<uint32_t>(vertices.size()); }
+        const uint8_t* positions() const { return reinterpret_cast<const uint8_t*>(vertices.data()) + offsetof(Vertex, position); }
+        const glm::vec3& position(uint32_t index) const { return vertices[index].position; }
+    };
+
+    using Triangle = std::array<uint32_t, 3>;
+
+    std::default_random_engine rndGen{ 0 };
+
+    void error(const Mesh& mesh, const std::string& limits, const std::string& message) {
+        Check::error(mesh.name + ", " + limits + ": " + message);
+    }
+
+    // Unit square in x and z facing up, with sine bumps of the given height
+    static Mesh grid(uint32_t quads, float bumps) {
+        Mesh mesh;
+        mesh.name = (bumps > 0.0f ? "bumpy grid " : "flat grid ") + std::to_string(quads);
+        const uint32_t dim = quads + 1;
+        for (uint32_t y = 0; y < dim; ++y) {
+            for (uint32_t x = 0; x < dim; ++x) {
+                const glm::vec2 uv{ float(x) / quads, float(y) / quads };
+                const float height = bumps * sinf(uv.x * 6.0f * float(M_PI)) * sinf(uv.y * 4.0f * float(M_PI));
+                mesh.vertices.push_back({ glm::vec3(uv.x, height, uv.y), uv });
+            }
+        }
+        for (uint32_t y = 0; y < quads; ++y) {
+            for (uint32_t x = 0; x < quads; ++x) {
+                const uint32_t index = x + y * dim;
+                mesh.indices.insert(mesh.indices.end(), { index, index + dim, index + dim + 1, index + dim + 1, index + 1, index });
+            }
+        }
+        return mesh;
+    }
+
+    // Unit sphere facing outwards, whose triangles at the poles have no area
+    static Mesh sphere(uint32_t rings, uint32_t segments) {
+        Mesh mesh;
+        mesh.name = "sphere " + std::to_string(rings) + "x" + std::to_string(segments);
+        for (uint32_t ring = 0; ring <= rings; ++ring) {
+            const float theta = float(M_PI) * ring / rings;
+            for (uint32_t segment = 0; segment <= segments; ++segment) {
+                const float phi = 2.0f * float(M_PI) * segment / segments;
+                const glm::vec3 position{ sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi) };
+                mesh.vertices.push_back({ position, glm::vec2(float(segment) / segments, float(ring) / rings) });
+            }
+        }
+        const uint32_t dim = segments + 1;
+        for (uint32_t ring = 0; ring < rings; ++ring) {
+            for (uint32_t segment = 0; segment < segments; ++segment) {
+                const uint32_t index = segment + ring * dim;
+                mesh.indices.insert(mesh.indices.end(), { index, index + dim, index + 1, index + dim, index + dim + 1, index + 1 });
+            }
+        }
+        return mesh;
+    }
+
+    // Small spheres scattered in a box, each a piece of its own and smaller than a meshlet
+    Mesh pieces(uint32_t count) {
+        Mesh mesh;
+        mesh.name = "pieces " + std::to_string(count);
+        std::uniform_real_distribution<float> rndPosition(-10.0f, 10.0f);
+        const Mesh piece = sphere(4, 6);
+        for (uint32_t i = 0; i < count; ++i) {
+            const glm::vec3 offset{ rndPosition(rndGen), rndPosition(rndGen), rndPosition(rndGen) };
+            const uint32_t base = mesh.vertexCount();
+            for (const auto& vertex : piece.vertices) {
+                mesh.vertices.push_back({ vertex.position * 0.25f + offset, vertex.uv });
+            }
+            for (uint32_t index : piece.indices) {
+                mesh.indices.push_back(base + index);
+            }
+        }
+        return mesh;
+    }
+
+    void shuffleTriangles(Mesh& mesh) {
+        std::vector<Triangle> triangles = trianglesOf(mesh.indices.data(), mesh.indices.size());
+        std::shuffle(triangles.begin(), triangles.end(), rndGen);
+        for (size_t t = 0; t < triangles.size(); ++t) {
+            std::copy(triangles[t].begin(), triangles[t].end(), mesh.indices.begin() + t * 3);
+        }
+        mesh.name += ", shuffled";
+    }
+
+    static std::vector<Triangle> trianglesOf(const uint32_t* indices, size_t indexCount) {
+        std::vector<Triangle> triangles(indexCount / 3);
+        for (size_t t = 0; t < triangles.size(); ++t) {
+            triangles[t] = { { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] } };
+        }
+        return triangles;
+    }
+
+    // Same triangles in any order with their corners as given, as buildMeshlets() copies them unchanged
+    static bool sameTriangles(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        auto sorted = [](const std::vector<uint32_t>& indices) {
+            auto triangles = trianglesOf(indices.data(), indices.size());
+            std::sort(triangles.begin(), triangles.end());
+            return triangles;
+        };
+        return sorted(a) == sorted(b);
+    }
+
+    static bool sameMeshlets(const std::vector<Meshlet>& a, const std::vector<Meshlet>& b) {
+        return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(Meshlet)) == 0);
+    }
+
+    // Whether the cone test of meshlets.hpp culls `meshlet` for a camera at `camera`
+    static bool coneCulls(const Meshlet& meshlet, const glm::vec3& camera) {
+        const glm::vec3 toCenter = meshlet.center - camera;
+        return glm::dot(toCenter, meshlet.coneAxis) >= meshlet.coneCutoff * glm::length(toCenter) + meshlet.radius;
+    }
+
+    void check(const Mesh& mesh) {
+        glm::vec3 lower{ FLT_MAX }, upper{ -FLT_MAX };
+        for (const auto& vertex : mesh.vertices) {
+            lower = glm::min(lower, vertex.position);
+            upper = glm::max(upper, vertex.position);
+        }
+        std::uniform_real_distribution<float> rndUnit(-1.5f, 1.5f);
+        std::vector<glm::vec3> cameras(CAMERA_COUNT);
+        for (auto& camera : cameras) {
+            camera = (lower + upper) * 0.5f + (upper - lower) * glm::vec3(rndUnit(rndGen), rndUnit(rndGen), rndUnit(rndGen));
+        }
+
+        const std::vector<std::pair<uint32_t, uint32_t>> limitsList = TRIANGLE_LIMITS;
+        for (const auto& limits : limitsList) {
+            const uint32_t maxTriangles = limits.first, minTriangles = limits.second;
+            const std::string limitsName = std::to_string(minTriangles) + " to " + std::to_string(maxTriangles) + " triangles";
+
+            std::vector<Meshlet> meshlets;
+            std::vector<uint32_t> destination(mesh.indices.size());
+            buildMeshlets(meshlets, destination.data(), mesh.indices.data(), mesh.indices.size(), mesh.positions(), sizeof(Vertex), mesh.vertexCount(),
+                          maxTriangles, minTriangles);
+
+            // Index ranges
+            if (!sameTriangles(destination, mesh.indices)) {
+                error(mesh, limitsName, "the triangles changed");
+            }
+            uint32_t next = 0;
+            size_t vertexSum = 0;
+            for (size_t m = 0; m < meshlets.size(); ++m) {
+                const Meshlet& meshlet = meshlets[m];
+                const uint32_t triangles = meshlet.indexCount / 3;
+                if (meshlet.indexBase != next || meshlet.indexCount % 3 != 0 || triangles == 0 || triangles > maxTriangles) {
+                    error(mesh, limitsName, "meshlet " + std::to_string(m) + " has the index range " + std::to_string(meshlet.indexBase) + " + " +
+                                                std::to_string(meshlet.indexCount) + " after " + std::to_string(next));
+                    break;
+                }
+                // Only the last meshlet may stop short of the minimum, when the triangles run out
+                if (triangles < minTriangles && m + 1 < meshlets.size()) {
+                    error(mesh, limitsName, "meshlet " + std::to_string(m) + " has " + std::to_string(triangles) + " triangles");
+                }
+                next += meshlet.indexCount;
+
+                // Bounds
+                std::vector<uint32_t> vertices(destination.begin() + meshlet.indexBase, destination.begin() + meshlet.indexBase + meshlet.indexCount);
+                std::sort(vertices.begin(), vertices.end());
+                vertices.erase(std::unique(vertices.begin(), vertices.end()), vertices.end());
+                vertexSum += vertices.size();
+                for (uint32_t vertex : vertices) {
+                    if (glm::distance(mesh.position(vertex), meshlet.center) > meshlet.radius * (1.0f + 1e-5f) + 1e-6f) {
+                        error(mesh, limitsName, "vertex " + std::to_string(vertex) + " lies outside the sphere of meshlet " + std::to_string(m));
+                        break;
+                    }
+                }
+                if (fabsf(glm::length(meshlet.coneAxis) - 1.0f) > 1e-4f || meshlet.coneCutoff < 0.0f || meshlet.coneCutoff > 1.0f) {
+                    error(mesh, limitsName, "meshlet " + std::to_string(m) + " has a cone cutoff of " + std::to_string(meshlet.coneCutoff));
+                }
+            }
+            if (next != mesh.indices.size()) {
+                error(mesh, limitsName, "the meshlets cover " + std::to_string(next) + " of " + std::to_string(mesh.indices.size()) + " indices");
+                continue;
+            }
+
+            // The cone test may only cull meshlets that no triangle with an area faces the camera of
+            uint32_t culled = 0;
+            for (const auto& camera : cameras) {
+                for (size_t m = 0; m < meshlets.size(); ++m) {
+                    const Meshlet& meshlet = meshlets[m];
+                    if (!coneCulls(meshlet, camera)) {
+                        continue;
+                    }
+                    ++culled;
+                    for (uint32_t i = meshlet.indexBase; i < meshlet.indexBase + meshlet.indexCount; i += 3) {
+                        const glm::vec3 p0 = mesh.position(destination[i]);
+                        const glm::vec3 normal = glm::cross(mesh.position(destination[i + 1]) - p0, mesh.position(destination[i + 2]) - p0);
+                        const float length = glm::length(normal);
+                        if (length > 0.0f && glm::dot(normal / length, camera - p0) > PLANE_TOLERANCE) {
+                            error(mesh, limitsName,
+                                  "meshlet " + std::to_string(m) + " is culled although triangle " + std::to_string(i / 3) + " faces the camera");
+                            break;
+                        }
+                    }
+                }
+            }
+
+            // Determinism, also when appending to meshlets of another mesh
+            std::vector<Meshlet> again(1);
+            std::vector<uint32_t> destinationAgain(mesh.indices.size());
+            buildMeshlets(again, destinationAgain.data(), mesh.indices.data(), mesh.indices.size(), mesh.positions(), sizeof(Vertex), mesh.vertexCount(),
+                          maxTriangles, minTriangles);
+            again.erase(again.begin());
+            if (!sameMeshlets(again, meshlets) || destinationAgain != destination) {
+                error(mesh, limitsName, "a second build gave a different result");
+            }
+
+            LOG("%-24s %4u %4u %9u %9.1f %9.1f %8.2f%%\n", mesh.name.c_str(), minTriangles, maxTriangles, static_cast<uint32_t>(meshlets.size()),
+                double(mesh.indices.size() / 3) / meshlets.size(), double(vertexSum) / meshlets.size(),
+                100.0 * culled / (double(meshlets.size()) * cameras.size()));
+        }
+    }
+
+    // The meshlets of a flat grid face straight up, so their cones must be tight and cull from below
+    void checkFlat() {
+        const Mesh mesh = grid(32, 0.0f);
+        std::vector<Meshlet> meshlets;
+        std::vector<uint32_t> destination(mesh.indices.size());
+        buildMeshlets(meshlets, destination.data(), mesh.indices.data(), mesh.indices.size(), mesh.positions(), sizeof(Vertex), mesh.vertexCount());
+        for (size_t m = 0; m < meshlets.size(); ++m) {
+            const Meshlet& meshlet = meshlets[m];
+            if (glm::dot(meshlet.coneAxis, glm::vec3(0.0f, 1.0f, 0.0f)) < 0.9999f || meshlet.coneCutoff > 1e-3f) {
+                error(mesh, "defaults", "meshlet " + std::to_string(m) + " has a cone cutoff of " + std::to_string(meshlet.coneCutoff));
+            }
+            if (!coneCulls(meshlet, glm::vec3(0.5f, -1.0f, 0.5f)) || coneCulls(meshlet, glm::vec3(0.5f, 1.0f, 0.5f))) {
+                error(mesh, "defaults", "meshlet " + std::to_string(m) + " is not culled from below only");
+            }
+        }
+    }
+
+    void benchmark() {
+        LOG("%10s %10s %10s\n", "Triangles", "Meshlets", "ms");
+        for (uint32_t rings = 64; rings <= 512; rings *= 2) {
+            Mesh mesh = sphere(rings, rings * 2);
+            shuffleTriangles(mesh);
+            std::vector<Meshlet> meshlets;
+            std::vector<uint32_t> destination(mesh.indices.size());
+            uint32_t runs = 0;
+            auto tStart = std::chrono::high_resolution_clock::now();
+            double seconds = 0.0;
+            do {
+                meshlets.clear();
+                buildMeshlets(meshlets, destination.data(), mesh.indices.data(), mesh.indices.size(), mesh.positions(), sizeof(Vertex), mesh.vertexCount());
+                ++runs;
+                seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+            } while (seconds < MIN_SECONDS);
+            LOG("%10u %10u %10.2f\n", static_cast<uint32_t>(mesh.indices.size() / 3), static_cast<uint32_t>(meshlets.size()), seconds * 1e3 / runs);
+        }
+    }
+
+    uint32_t run() {
+        LOG("%-24s %4s %4s %9s %9s %9s %9s\n", "Mesh", "Min", "Max", "Meshlets", "Triangles", "Vertices", "Culled");
+        std::vector<Mesh> meshes{ grid(48, 0.0f), grid(48, 0.05f), sphere(24, 32), pieces(200) };
+        for (size_t i = 0, count = meshes.size(); i < count; ++i) {
+            meshes.push_back(meshes[i]);
+            shuffleTriangles(meshes.back());
+        }
+        for (const auto& mesh : meshes) {
+            check(mesh);
+        }
+        checkFlat();
+        benchmark();
+        return finish();
+    }
+};
+
+RUN_CHECK(MeshletsCheck)
@@ -0,0 +1,345 @@
+/*
+* Vulkan Example - CPU checks and benchmark of the mesh optimization stages
+*
+* Runs the stages of vks/meshoptimizer.hpp over grids, spheres and scattered pieces whose triangles are
+* shuffled.  The vertex remap has to merge exactly the vertices with equal bytes, the vertex cache and overdraw
+* orders have to keep every triangle with its winding, and the vertex fetch order has to number the vertices by
+* first use without changing what the triangles refer to.  The cache miss ratio after each stage is compared
+* against the shuffled input and the bounds the stages promise, and every stage has to give the same result
+* when run again.  The time of each stage for growing meshes is reported at the end.  Needs no GPU.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <check.hpp>
+#include <vks/meshoptimizer.hpp>
+
+#include <map>
+
+// Cache miss ratio the vertex cache order has to reach on a regular grid, where 0.5 is the optimum
+#define GRID_MAX_ACMR 0.8f
+#define OVERDRAW_THRESHOLD 1.05f
+
+// Minimum time to run each stage per mesh size
+static const double MIN_SECONDS = 0.25;
+
+using namespace vks::model;
+
+class MeshOptimizerCheck : public vkx::Check {
+public:
+    struct Vertex {
+        glm::vec3 position;
+        glm::vec2 uv;
+    };
+
+    struct Mesh {
+        std::string name;
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+
+        uint32_t vertexCount() const { return static_cast<uint32_t>(vertices.size()); }
+        const uint8_t* data() const { return reinterpret_cast<const uint8_t*>(vertices.data()); }
+    };
+
+    using Triangle = std::array<uint32_t, 3>;
+
+    std::default_random_engine rndGen{ 0 };
+
+    void error(const Mesh& mesh, const char* stage, const std::string& message) {
+        Check::error(mesh.name + ", " + stage + ": " + message);
+    }
+
+    static Mesh grid(uint32_t quads) {
+        Mesh mesh;
+        mesh.name = "grid " + std::to_string(quads);
+        const uint32_t dim = quads + 1;
+        for (uint32_t y = 0; y < dim; ++y) {
+            for (uint32_t x = 0; x < dim; ++x) {
+                const glm::vec2 uv{ float(x) / quads, float(y) / quads };
+                mesh.vertices.push_back({ glm::vec3(uv.x, 0.0f, uv.y), uv });
+            }
+        }
+        for (uint32_t y = 0; y < quads; ++y) {
+            for (uint32_t x = 0; x < quads; ++x) {
+                const uint32_t index = x + y * dim;
+                mesh.indices.insert(mesh.indices.end(), { index, index + dim, index + dim + 1, index + dim + 1, index + 1, index });
+            }
+        }
+        return mesh;
+    }
+
+    // The seam and the poles repeat positions with different texture coordinates, which must not be merged
+    static Mesh sphere(uint32_t rings, uint32_t segments) {
+        Mesh mesh;
+        mesh.name = "sphere " + std::to_string(rings) + "x" + std::to_string(segments);
+        for (uint32_t ring = 0; ring <= rings; ++ring) {
+            const float theta = float(M_PI) * ring / rings;
+            for (uint32_t segment = 0; segment <= segments; ++segment) {
+                const float phi = 2.0f * float(M_PI) * segment / segments;
+                const glm::vec3 position{ sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi) };
+                mesh.vertices.push_back({ position, glm::vec2(float(segment) / segments, float(ring) / rings) });
+            }
+        }
+        const uint32_t dim = segments + 1;
+        for (uint32_t ring = 0; ring < rings; ++ring) {
+            for (uint32_t segment = 0; segment < segments; ++segment) {
+                const uint32_t index = segment + ring * dim;
+                mesh.indices.insert(mesh.indices.end(), { index, index + 1, index + dim, index + dim, index + 1, index + dim + 1 });
+            }
+        }
+        return mesh;
+    }
+
+    // Small spheres scattered in a box, each a piece of its own
+    Mesh pieces(uint32_t count) {
+        Mesh mesh;
+        mesh.name = "pieces " + std::to_string(count);
+        std::uniform_real_distribution<float> rndPosition(-10.0f, 10.0f);
+        const Mesh piece = sphere(4, 6);
+        for (uint32_t i = 0; i < count; ++i) {
+            const glm::vec3 offset{ rndPosition(rndGen), rndPosition(rndGen), rndPosition(rndGen) };
+            const uint32_t base = mesh.vertexCount();
+            for (const auto& vertex : piece.vertices) {
+                mesh.vertices.push_back({ vertex.position * 0.25f + offset, vertex.uv });
+            }
+            for (uint32_t index : piece.indices) {
+                mesh.indices.push_back(base + index);
+            }
+        }
+        return mesh;
+    }
+
+    // One vertex per corner, as loaders produce for formats without shared vertices, with an unused vertex
+    // appended for the remap to skip
+    static Mesh unindexed(const Mesh& source) {
+        Mesh mesh;
+        mesh.name = source.name + ", unindexed";
+        for (uint32_t index : source.indices) {
+            mesh.indices.push_back(mesh.vertexCount());
+            mesh.vertices.push_back(source.vertices[index]);
+        }
+        mesh.vertices.push_back({ glm::vec3(1e6f), glm::vec2(0.0f) });
+        return mesh;
+    }
+
+    void shuffleTriangles(Mesh& mesh) {
+        std::vector<Triangle> triangles = trianglesOf(mesh.indices.data(), mesh.indices.size());
+        std::shuffle(triangles.begin(), triangles.end(), rndGen);
+        for (size_t t = 0; t < triangles.size(); ++t) {
+            std::copy(triangles[t].begin(), triangles[t].end(), mesh.indices.begin() + t * 3);
+        }
+    }
+
+    static std::vector<Triangle> trianglesOf(const uint32_t* indices, size_t indexCount) {
+        std::vector<Triangle> triangles(indexCount / 3);
+        for (size_t t = 0; t < triangles.size(); ++t) {
+            triangles[t] = { { indices[t * 3], indices[t * 3 + 1], indices[t * 3 + 2] } };
+        }
+        return triangles;
+    }
+
+    // Same triangles in any order, each with its corners in the same cyclic order
+    static bool sameTriangles(const std::vector<uint32_t>& a, const std::vector<uint32_t>& b) {
+        if (a.size() != b.size()) {
+            return false;
+        }
+        auto canonical = [](const std::vector<uint32_t>& indices) {
+            auto triangles = trianglesOf(indices.data(), indices.size());
+            for (auto& triangle : triangles) {
+                std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+            }
+            std::sort(triangles.begin(), triangles.end());
+            return triangles;
+        };
+        return canonical(a) == canonical(b);
+    }
+
+    static bool sameVertex(const Vertex& a, const Vertex& b) { return memcmp(&a, &b, sizeof(Vertex)) == 0; }
+
+    static float acmr(const std::vector<uint32_t>& indices, uint32_t vertexCount) {
+        return analyzeVertexCache(indices.data(), indices.size(), vertexCount).acmr;
+    }
+
+    // Returns the mesh with its duplicate vertices merged, or the mesh itself if the remap is wrong
+    Mesh checkRemap(const Mesh& mesh) {
+        std::vector<uint32_t> remap(mesh.vertexCount());
+        const uint32_t uniqueCount =
+            generateVertexRemap(remap.data(), mesh.indices.data(), mesh.indices.size(), mesh.data(), mesh.vertexCount(), sizeof(Vertex));
+
+        // Reference: the distinct vertices the indices use, numbered by first use
+        std::vector<uint32_t> firstUses;
+        std::map<std::string, uint32_t> seen;
+        for (uint32_t index : mesh.indices) {
+            const std::string bytes(reinterpret_cast<const char*>(&mesh.vertices[index]), sizeof(Vertex));
+            if (seen.emplace(bytes, static_cast<uint32_t>(firstUses.size())).second) {
+                firstUses.push_back(index);
+            }
+        }
+        if (uniqueCount != firstUses.size()) {
+            error(mesh, "remap", std::to_string(uniqueCount) + " unique vertices instead of " + std::to_string(firstUses.size()));
+            return mesh;
+        }
+        std::vector<bool> used(mesh.vertexCount(), false);
+        for (uint32_t index : mesh.indices) {
+            used[index] = true;
+        }
+        for (uint32_t vertex = 0; vertex < mesh.vertexCount(); ++vertex) {
+            if (!used[vertex]) {
+                if (remap[vertex] != ~0u) {
+                    error(mesh, "remap", "unused vertex " + std::to_string(vertex) + " is not mapped to ~0");
+                }
+            } else if (remap[vertex] >= uniqueCount || !sameVertex(mesh.vertices[firstUses[remap[vertex]]], mesh.vertices[vertex])) {
+                error(mesh, "remap", "vertex " + std::to_string(vertex) + " is mapped to a different one");
+                return mesh;
+            }
+        }
+
+        Mesh result;
+        result.name = mesh.name;
+        result.indices = mesh.indices;
+        remapIndices(result.indices.data(), result.indices.size(), remap.data());
+        result.vertices.resize(uniqueCount);
+        remapVertices(reinterpret_cast<uint8_t*>(result.vertices.data()), mesh.data(), mesh.vertexCount(), sizeof(Vertex), remap.data());
+        for (size_t i = 0; i < result.indices.size(); ++i) {
+            if (!sameVertex(result.vertices[result.indices[i]], mesh.vertices[mesh.indices[i]])) {
+                error(mesh, "remap", "corner " + std::to_string(i) + " changed after remapping");
+                return mesh;
+            }
+        }
+        return result;
+    }
+
+    // Returns the indices after the vertex cache and overdraw stages
+    std::vector<uint32_t> checkOrder(const Mesh& mesh, bool regularGrid) {
+        const float inputAcmr = acmr(mesh.indices, mesh.vertexCount());
+
+        std::vector<uint32_t> cacheOrder(mesh.indices.size());
+        optimizeVertexCache(cacheOrder.data(), mesh.indices.data(), mesh.indices.size(), mesh.vertexCount());
+        if (!sameTriangles(cacheOrder, mesh.indices)) {
+            error(mesh, "vertex cache", "the triangles changed");
+        }
+        std::vector<uint32_t> again(mesh.indices.size());
+        optimizeVertexCache(again.data(), mesh.indices.data(), mesh.indices.size(), mesh.vertexCount());
+        if (again != cacheOrder) {
+            error(mesh, "vertex cache", "a second run gave a different order");
+        }
+        const float cacheAcmr = acmr(cacheOrder, mesh.vertexCount());
+        if (cacheAcmr > inputAcmr) {
+            error(mesh, "vertex cache", "the cache miss ratio grew from " + std::to_string(inputAcmr) + " to " + std::to_string(cacheAcmr));
+        }
+        if (regularGrid && cacheAcmr > GRID_MAX_ACMR) {
+            error(mesh, "vertex cache", "cache miss ratio " + std::to_string(cacheAcmr) + " on a regular grid");
+        }
+
+        std::vector<uint32_t> overdrawOrder(mesh.indices.size());
+        const uint8_t* positions = mesh.data() + offsetof(Vertex, position);
+        optimizeOverdraw(overdrawOrder.data(), cacheOrder.data(), cacheOrder.size(), positions, sizeof(Vertex), mesh.vertexCount(), OVERDRAW_THRESHOLD);
+        if (!sameTriangles(overdrawOrder, mesh.indices)) {
+            error(mesh, "overdraw", "the triangles changed");
+        }
+        optimizeOverdraw(again.data(), cacheOrder.data(), cacheOrder.size(), positions, sizeof(Vertex), mesh.vertexCount(), OVERDRAW_THRESHOLD);
+        if (again != overdrawOrder) {
+            error(mesh, "overdraw", "a second run gave a different order");
+        }
+        // Every cluster restarts the cache, which costs up to a few extra misses at each cut on top of the threshold
+        const float overdrawAcmr = acmr(overdrawOrder, mesh.vertexCount());
+        if (overdrawAcmr > cacheAcmr * OVERDRAW_THRESHOLD * 1.1f) {
+            error(mesh, "overdraw", "the cache miss ratio grew from " + std::to_string(cacheAcmr) + " to " + std::to_string(overdrawAcmr));
+        }
+        LOG("%-28s %9u %9u %9.3f %9.3f %9.3f\n", mesh.name.c_str(), mesh.vertexCount(), static_cast<uint32_t>(mesh.indices.size() / 3), inputAcmr,
+            cacheAcmr, overdrawAcmr);
+        return overdrawOrder;
+    }
+
+    void checkFetch(const Mesh& mesh, const std::vector<uint32_t>& ordered) {
+        std::vector<uint32_t> indices = ordered;
+        std::vector<Vertex> vertices(mesh.vertexCount());
+        const uint32_t vertexCount = optimizeVertexFetch(reinterpret_cast<uint8_t*>(vertices.data()), indices.data(), indices.size(), mesh.data(),
+                                                         mesh.vertexCount(), sizeof(Vertex));
+        std::vector<bool> used(mesh.vertexCount(), false);
+        uint32_t usedCount = 0;
+        for (uint32_t index : ordered) {
+            usedCount += used[index] ? 0 : 1;
+            used[index] = true;
+        }
+        if (vertexCount != usedCount) {
+            error(mesh, "vertex fetch", std::to_string(vertexCount) + " vertices instead of the " + std::to_string(usedCount) + " used ones");
+            return;
+        }
+        uint32_t next = 0;
+        for (size_t i = 0; i < indices.size(); ++i) {
+            if (indices[i] > next || indices[i] >= vertexCount) {
+                error(mesh, "vertex fetch", "corner " + std::to_string(i) + " skips ahead to vertex " + std::to_string(indices[i]));
+                return;
+            }
+            next += indices[i] == next ? 1 : 0;
+            if (!sameVertex(vertices[indices[i]], mesh.vertices[ordered[i]])) {
+                error(mesh, "vertex fetch", "corner " + std::to_string(i) + " refers to a different vertex");
+                return;
+            }
+        }
+    }
+
+    void check() {
+        std::vector<std::pair<Mesh, bool>> meshes;
+        meshes.emplace_back(grid(64), true);
+        meshes.emplace_back(sphere(32, 48), false);
+        meshes.emplace_back(pieces(256), false);
+        meshes.emplace_back(unindexed(grid(16)), false);
+        meshes.emplace_back(unindexed(sphere(8, 12)), false);
+
+        LOG("%-28s %9s %9s %9s %9s %9s\n", "Mesh", "Vertices", "Triangles", "Shuffled", "Cache", "Overdraw");
+        for (auto& entry : meshes) {
+            Mesh& mesh = entry.first;
+            // The stages in the order vks::model runs them in
+            shuffleTriangles(mesh);
+            const Mesh merged = checkRemap(mesh);
+            checkFetch(merged, checkOrder(merged, entry.second));
+        }
+    }
+
+    template <typename Function>
+    double measure(Function function) {
+        uint32_t runs = 0;
+        auto tStart = std::chrono::high_resolution_clock::now();
+        double seconds = 0.0;
+        do {
+            function();
+            ++runs;
+            seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+        } while (seconds < MIN_SECONDS);
+        return seconds * 1e3 / runs;
+    }
+
+    void benchmark() {
+        LOG("%10s %10s %10s %10s %10s\n", "Triangles", "Remap ms", "Cache ms", "Overdraw ms", "Fetch ms");
+        for (uint32_t quads = 64; quads <= 512; quads *= 2) {
+            Mesh mesh = grid(quads);
+            shuffleTriangles(mesh);
+            const uint8_t* positions = mesh.data() + offsetof(Vertex, position);
+            std::vector<uint32_t> remap(mesh.vertexCount()), cacheOrder(mesh.indices.size()), overdrawOrder(mesh.indices.size()), indices;
+            std::vector<Vertex> vertices(mesh.vertexCount());
+            const double remapMs = measure([&] {
+                generateVertexRemap(remap.data(), mesh.indices.data(), mesh.indices.size(), mesh.data(), mesh.vertexCount(), sizeof(Vertex));
+            });
+            const double cacheMs = measure([&] { optimizeVertexCache(cacheOrder.data(), mesh.indices.data(), mesh.indices.size(), mesh.vertexCount()); });
+            const double overdrawMs = measure([&] {
+                optimizeOverdraw(overdrawOrder.data(), cacheOrder.data(), cacheOrder.size(), positions, sizeof(Vertex), mesh.vertexCount(), OVERDRAW_THRESHOLD);
+            });
+            const double fetchMs = measure([&] {
+                indices = overdrawOrder;
+                optimizeVertexFetch(reinterpret_cast<uint8_t*>(vertices.data()), indices.data(), indices.size(), mesh.data(), mesh.vertexCount(),
+                                    sizeof(Vertex));
+            });
+            LOG("%10u %10.2f %10.2f %11.2f %10.2f\n", static_cast<uint32_t>(mesh.indices.size() / 3), remapMs, cacheMs, overdrawMs, fetchMs);
+        }
+    }
+
+    uint32_t run() {
+        check();
+        benchmark();
+        return finish();
+    }
+};
+
+RUN_CHECK(MeshOptimizerCheck)
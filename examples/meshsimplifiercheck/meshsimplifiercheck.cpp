@@ -0,0 +1,260 @@
+/*
+* Vulkan Example - CPU checks and benchmark of the quadric error mesh simplifier
+*
+* Simplifies flat and bumpy grids and spheres with vks::model::simplify() to a series of index count and error
+* targets.  Every result has to stay within its targets, refer only to input vertices, keep no degenerate or
+* turned over triangles and come out the same when run again, in place or not.  A flat grid has to keep its
+* outline and area while it collapses to a few triangles, a sphere has to stay closed.  The time to simplify
+* meshes of growing size to a quarter of their triangles is reported at the end.  Needs no GPU.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <check.hpp>
+#include <vks/meshsimplifier.hpp>
+
+#include <cfloat>
+#include <map>
+
+// Shares of the input triangles to simplify to
+#define TARGET_SHARES { 0.5f, 0.25f, 0.1f, 0.02f }
+// Error targets in units of the mesh size, FLT_MAX leaves only the index count target
+#define ERROR_TARGETS { 0.001f, 0.01f, FLT_MAX }
+
+// Minimum time to simplify each mesh size
+static const double MIN_SECONDS = 0.25;
+
+class MeshSimplifierCheck : public vkx::Check {
+public:
+    struct Vertex {
+        glm::vec3 position;
+        glm::vec2 uv;
+    };
+
+    struct Mesh {
+        std::string name;
+        std::vector<Vertex> vertices;
+        std::vector<uint32_t> indices;
+        // Every edge is shared by two triangles once equal positions are merged
+        bool closed{ false };
+
+        uint32_t vertexCount() const { return static_cast<uint32_t>(vertices.size()); }
+        const uint8_t* positions() const { return reinterpret_cast<const uint8_t*>(vertices.data()) + offsetof(Vertex, position); }
+        const glm::vec3& position(uint32_t index) const { return vertices[index].position; }
+    };
+
+
+    void error(const Mesh& mesh, const std::string& target, const std::string& message) {
+        Check::error(mesh.name + ", " + target + ": " + message);
+    }
+
+    // Unit square in x and z, with sine bumps of the given height
+    static Mesh grid(uint32_t quads, float bumps) {
+        Mesh mesh;
+        mesh.name = (bumps > 0.0f ? "bumpy grid " : "flat grid ") + std::to_string(quads);
+        const uint32_t dim = quads + 1;
+        for (uint32_t y = 0; y < dim; ++y) {
+            for (uint32_t x = 0; x < dim; ++x) {
+                const glm::vec2 uv{ float(x) / quads, float(y) / quads };
+                const float height = bumps * sinf(uv.x * 6.0f * float(M_PI)) * sinf(uv.y * 4.0f * float(M_PI));
+                mesh.vertices.push_back({ glm::vec3(uv.x, height, uv.y), uv });
+            }
+        }
+        for (uint32_t y = 0; y < quads; ++y) {
+            for (uint32_t x = 0; x < quads; ++x) {
+                const uint32_t index = x + y * dim;
+                mesh.indices.insert(mesh.indices.end(), { index, index + dim, index + dim + 1, index + dim + 1, index + 1, index });
+            }
+        }
+        return mesh;
+    }
+
+    // Unit sphere whose seam and poles repeat positions with different texture coordinates
+    static Mesh sphere(uint32_t rings, uint32_t segments) {
+        Mesh mesh;
+        mesh.name = "sphere " + std::to_string(rings) + "x" + std::to_string(segments);
+        mesh.closed = true;
+        for (uint32_t ring = 0; ring <= rings; ++ring) {
+            const float theta = float(M_PI) * ring / rings;
+            for (uint32_t segment = 0; segment <= segments; ++segment) {
+                // The seam has to repeat the exact bits of the first segment
+                const float phi = segment == segments ? 0.0f : 2.0f * float(M_PI) * segment / segments;
+                glm::vec3 position{ sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi) };
+                if (ring == 0 || ring == rings) {
+                    position = glm::vec3(0.0f, ring == 0 ? 1.0f : -1.0f, 0.0f);
+                }
+                mesh.vertices.push_back({ position, glm::vec2(float(segment) / segments, float(ring) / rings) });
+            }
+        }
+        const uint32_t dim = segments + 1;
+        for (uint32_t ring = 0; ring < rings; ++ring) {
+            for (uint32_t segment = 0; segment < segments; ++segment) {
+                const uint32_t index = segment + ring * dim;
+                mesh.indices.insert(mesh.indices.end(), { index, index + 1, index + dim, index + dim, index + 1, index + dim + 1 });
+            }
+        }
+        return mesh;
+    }
+
+    static glm::vec3 normal(const Mesh& mesh, const uint32_t* corners) {
+        const glm::vec3 p0 = mesh.position(corners[0]);
+        return glm::cross(mesh.position(corners[1]) - p0, mesh.position(corners[2]) - p0);
+    }
+
+    static float area(const Mesh& mesh, const std::vector<uint32_t>& indices) {
+        float result = 0.0f;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            result += glm::length(normal(mesh, indices.data() + i)) * 0.5f;
+        }
+        return result;
+    }
+
+    // Vertices numbered by their position, so seam and pole copies count as one
+    static std::vector<uint32_t> weld(const Mesh& mesh) {
+        std::vector<uint32_t> welded(mesh.vertexCount());
+        std::map<std::array<float, 3>, uint32_t> unique;
+        for (uint32_t vertex = 0; vertex < mesh.vertexCount(); ++vertex) {
+            const glm::vec3& p = mesh.position(vertex);
+            welded[vertex] = unique.emplace(std::array<float, 3>{ { p.x, p.y, p.z } }, vertex).first->second;
+        }
+        return welded;
+    }
+
+    // Directed edges of the welded triangles, each has to appear once and its reverse once
+    static bool isClosed(const std::vector<uint32_t>& indices, const std::vector<uint32_t>& welded) {
+        std::map<std::pair<uint32_t, uint32_t>, uint32_t> edges;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            for (uint32_t k = 0; k < 3; ++k) {
+                ++edges[{ welded[indices[i + k]], welded[indices[i + (k + 1) % 3]] }];
+            }
+        }
+        for (const auto& edge : edges) {
+            auto reverse = edges.find({ edge.first.second, edge.first.first });
+            if (edge.second != 1 || reverse == edges.end() || reverse->second != 1) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void check(const Mesh& mesh) {
+        const std::vector<uint32_t> welded = weld(mesh);
+        const float inputArea = area(mesh, mesh.indices);
+        for (float share : TARGET_SHARES) {
+            for (float targetError : ERROR_TARGETS) {
+                const size_t targetIndexCount = static_cast<size_t>(mesh.indices.size() / 3 * share) * 3;
+                char targetName[64];
+                snprintf(targetName, sizeof(targetName), "%u indices, error %g", static_cast<uint32_t>(targetIndexCount), targetError);
+
+                std::vector<uint32_t> result(mesh.indices.size());
+                float resultError = -1.0f;
+                const size_t count = vks::model::simplify(result.data(), mesh.indices.data(), mesh.indices.size(), mesh.positions(), sizeof(Vertex),
+                                                          mesh.vertexCount(), targetIndexCount, targetError, &resultError);
+                result.resize(count);
+
+                // Targets
+                if (count % 3 != 0 || count == 0) {
+                    error(mesh, targetName, std::to_string(count) + " indices");
+                    continue;
+                }
+                if (resultError < 0.0f || resultError > targetError) {
+                    error(mesh, targetName, "error " + std::to_string(resultError));
+                }
+                if (targetError == FLT_MAX && count > targetIndexCount) {
+                    error(mesh, targetName, "stopped at " + std::to_string(count) + " indices without an error limit");
+                }
+
+                // Triangles
+                for (size_t i = 0; i < count; i += 3) {
+                    const uint32_t* corners = result.data() + i;
+                    if (corners[0] >= mesh.vertexCount() || corners[1] >= mesh.vertexCount() || corners[2] >= mesh.vertexCount()) {
+                        error(mesh, targetName, "triangle " + std::to_string(i / 3) + " refers to a vertex out of range");
+                        break;
+                    }
+                    if (welded[corners[0]] == welded[corners[1]] || welded[corners[1]] == welded[corners[2]] || welded[corners[2]] == welded[corners[0]]) {
+                        error(mesh, targetName, "triangle " + std::to_string(i / 3) + " is degenerate");
+                        break;
+                    }
+                    // The grids face up and the spheres outwards
+                    const glm::vec3 n = normal(mesh, corners);
+                    const glm::vec3 outside = mesh.closed ? mesh.position(corners[0]) + mesh.position(corners[1]) + mesh.position(corners[2])
+                                                          : glm::vec3(0.0f, 1.0f, 0.0f);
+                    if (glm::dot(n, outside) <= 0.0f) {
+                        error(mesh, targetName, "triangle " + std::to_string(i / 3) + " turned over");
+                        break;
+                    }
+                }
+                if (mesh.closed && !isClosed(result, welded)) {
+                    error(mesh, targetName, "the surface is no longer closed");
+                }
+                const float resultArea = area(mesh, result);
+                if (!mesh.closed && targetError != FLT_MAX && fabsf(resultArea - inputArea) > targetError * 4.0f) {
+                    error(mesh, targetName, "the area changed from " + std::to_string(inputArea) + " to " + std::to_string(resultArea));
+                }
+
+                // Determinism, also when simplifying in place
+                std::vector<uint32_t> again(mesh.indices.size());
+                again.resize(vks::model::simplify(again.data(), mesh.indices.data(), mesh.indices.size(), mesh.positions(), sizeof(Vertex),
+                                                  mesh.vertexCount(), targetIndexCount, targetError));
+                std::vector<uint32_t> inPlace = mesh.indices;
+                inPlace.resize(vks::model::simplify(inPlace.data(), inPlace.data(), inPlace.size(), mesh.positions(), sizeof(Vertex), mesh.vertexCount(),
+                                                    targetIndexCount, targetError));
+                if (again != result || inPlace != result) {
+                    error(mesh, targetName, "a second run gave a different result");
+                }
+
+                LOG("%-20s %9u %12g %9u %10.5f %8.3f\n", mesh.name.c_str(), static_cast<uint32_t>(targetIndexCount / 3), targetError,
+                    static_cast<uint32_t>(count / 3), resultError, resultArea / inputArea);
+            }
+        }
+    }
+
+    // A flat grid only has zero error collapses, which have to go down to a single quad
+    void checkFlat() {
+        const Mesh mesh = grid(32, 0.0f);
+        std::vector<uint32_t> result(mesh.indices.size());
+        result.resize(vks::model::simplify(result.data(), mesh.indices.data(), mesh.indices.size(), mesh.positions(), sizeof(Vertex), mesh.vertexCount(),
+                                           0, 1e-6f));
+        // Only the four corners have to stay, which two triangles cover
+        if (result.size() / 3 > 2) {
+            error(mesh, "error 1e-6", std::to_string(result.size() / 3) + " triangles left of a flat square");
+        }
+        for (uint32_t corner : { 0u, 32u, 33u * 32u, 33u * 33u - 1u }) {
+            if (std::find(result.begin(), result.end(), corner) == result.end()) {
+                error(mesh, "error 1e-6", "corner vertex " + std::to_string(corner) + " was collapsed");
+            }
+        }
+        LOG("Flat grid of %u triangles simplified to %u\n", static_cast<uint32_t>(mesh.indices.size() / 3), static_cast<uint32_t>(result.size() / 3));
+    }
+
+    void benchmark() {
+        LOG("%10s %10s %10s\n", "Triangles", "Result", "ms");
+        for (uint32_t quads = 64; quads <= 512; quads *= 2) {
+            const Mesh mesh = grid(quads, 0.05f);
+            std::vector<uint32_t> result(mesh.indices.size());
+            size_t count = 0;
+            uint32_t runs = 0;
+            auto tStart = std::chrono::high_resolution_clock::now();
+            double seconds = 0.0;
+            do {
+                count = vks::model::simplify(result.data(), mesh.indices.data(), mesh.indices.size(), mesh.positions(), sizeof(Vertex), mesh.vertexCount(),
+                                             mesh.indices.size() / 4, FLT_MAX);
+                ++runs;
+                seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+            } while (seconds < MIN_SECONDS);
+            LOG("%10u %10u %10.2f\n", static_cast<uint32_t>(mesh.indices.size() / 3), static_cast<uint32_t>(count / 3), seconds * 1e3 / runs);
+        }
+    }
+
+    uint32_t run() {
+        LOG("%-20s %9s %12s %9s %10s %8s\n", "Mesh", "Target", "Max error", "Result", "Error", "Area");
+        check(grid(48, 0.0f));
+        check(grid(48, 0.05f));
+        check(sphere(24, 32));
+        checkFlat();
+        benchmark();
+        return finish();
+    }
+};
+
+RUN_CHECK(MeshSimplifierCheck)
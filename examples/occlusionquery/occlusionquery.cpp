@@ -1,5 +1,9 @@
 /*
-* Vulkan Example - Using occlusion query for visbility testing
+* Vulkan Example - Occlusion culling against a hierarchical depth buffer
+*
+* A few thousand spheres on both sides of a large occluder.  Instead of an occlusion query per object, whose
+* results the host has to wait for, compute shaders test the bounding spheres of all objects against a depth
+* pyramid and write the instance counts of their indirect draws, see vkx::OcclusionCulling.
 *
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
@@ -7,8 +11,12 @@
 */
 
 #include <vulkanExampleBase.h>
+#include <depthpyramid.hpp>
+#include <occlusionculling.hpp>
+
+// Objects along each axis of the grid, half of the layers on each side of the occluder
+#define GRID_SIZE 16
 
-// Vertex layout used in this example
 // Vertex layout for this example
 vks::model::VertexLayout vertexLayout{ {
     vks::model::Component::VERTEX_COMPONENT_POSITION,
@@ -19,57 +27,60 @@ vks::model::VertexLayout vertexLayout{ {
 class VulkanExample : public vkx::ExampleBase {
 public:
     struct {
-        vks::model::Model teapot;
         vks::model::Model plane;
         vks::model::Model sphere;
     } meshes;
 
     struct {
         vks::Buffer vsScene;
-        vks::Buffer teapot;
-        vks::Buffer sphere;
+        vks::Buffer occluder;
     } uniformData;
 
     struct UboVS {
         glm::mat4 projection;
         glm::mat4 model;
         glm::vec4 lightPos = glm::vec4(10.0f, 10.0f, 10.0f, 1.0f);
-        float visible;
     } uboVS;
 
+    // Per-instance data block
+    struct InstanceData {
+        glm::vec4 positionScale;
+        glm::vec4 color;
+    };
+    vks::Buffer instanceBuffer;
+
     struct {
         vk::Pipeline solid;
         vk::Pipeline occluder;
-        // vk::Pipeline with basic shaders used for occlusion pass
-        vk::Pipeline simple;
     } pipelines;
 
     struct {
-        vk::DescriptorSet teapot;
-        vk::DescriptorSet sphere;
+        vk::DescriptorSet scene;
+        vk::DescriptorSet occluder;
     } descriptorSets;
 
     vk::PipelineLayout pipelineLayout;
-    vk::DescriptorSet descriptorSet;
     vk::DescriptorSetLayout descriptorSetLayout;
 
-    // Stores occlusion query results
-    vks::Buffer queryResult;
+    // Loads the attachments the first phase rendered to, for the objects found visible after it
+    vk::RenderPass secondPhaseRenderPass;
 
-    // Pool that stores all occlusion queries
-    vk::QueryPool queryPool;
+    // Scales the occluder to cover most of the grid
+    glm::mat4 occluderTransform;
 
-    // Passed query samples
-    std::array<uint64_t, 2> passedSamples{ 1, 1 };
+    vkx::DepthPyramid pyramid{ context, descriptorAllocator };
+    vkx::OcclusionCulling culling{ context };
 
     VulkanExample() {
-        passedSamples[0] = passedSamples[1] = 1;
         size = vk::Extent2D{ 1280, 720 };
         zoomSpeed = 2.5f;
         rotationSpeed = 0.5f;
         camera.setRotation({ 0.0, -123.75, 0.0 });
         camera.dolly(-35.0f);
-        title = "Vulkan Example - Occlusion queries";
+        title = "Vulkan Example - Occlusion culling";
+        settings.overlay = true;
+        // The depth pyramid is built from the depth of the first phase
+        depthStencilUsage = vk::ImageUsageFlagBits::eSampled;
     }
 
     ~VulkanExample() {
@@ -77,149 +88,175 @@ public:
         // Note : Inherited destructor cleans up resources stored in base class
         device.destroyPipeline(pipelines.solid);
         device.destroyPipeline(pipelines.occluder);
-        device.destroyPipeline(pipelines.simple);
 
         device.destroyPipelineLayout(pipelineLayout);
         device.destroyDescriptorSetLayout(descriptorSetLayout);
+        device.destroyRenderPass(secondPhaseRenderPass);
 
-        device.destroyQueryPool(queryPool);
-
-        device.destroyBuffer(queryResult.buffer);
-        device.freeMemory(queryResult.memory);
+        culling.destroy();
+        pyramid.destroy();
 
         uniformData.vsScene.destroy();
-        uniformData.sphere.destroy();
-        uniformData.teapot.destroy();
+        uniformData.occluder.destroy();
+        instanceBuffer.destroy();
 
         meshes.sphere.destroy();
         meshes.plane.destroy();
-        meshes.teapot.destroy();
-    }
-
-    // Create a buffer for storing the query result
-    // Setup a query pool
-    void setupQueryResultBuffer() {
-        uint32_t bufSize = 2 * sizeof(uint64_t);
-        // Results are saved in a host visible buffer for easy access by the application
-        queryResult = context.createBuffer(vk::BufferUsageFlagBits::eUniformBuffer | vk::BufferUsageFlagBits::eTransferDst,
-                                           vk::MemoryPropertyFlagBits::eHostVisible, bufSize);
-        // Query pool will be created for occlusion queries
-        queryPool = device.createQueryPool({ {}, vk::QueryType::eOcclusion, 2 });
     }
 
-    // Retrieves the results of the occlusion queries submitted to the command buffer
-    void getQueryResults() {
-        queue.waitIdle();
-        device.waitIdle();
-        // Store results a 64 bit values and wait until the results have been finished
-        // If you don't want to wait, you can use VK_QUERY_RESULT_WITH_AVAILABILITY_BIT
-        // which also returns the state of the result (ready) in the result
-        static const auto queryResultFlags = vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWait;
-        // We use vkGetQueryResults to copy the results into a host visible buffer
-        // you can use vk::QueryResultFlagBits::eWithAvailability
-        // which also returns the state of the result (ready) in the result
-        device.getQueryPoolResults(queryPool, 0, 2, vk::ArrayProxy<uint64_t>{ passedSamples }, sizeof(uint64_t), queryResultFlags);
+    void getEnabledFeatures() override {
+        // All objects are drawn with one call per phase if supported
+        if (context.deviceFeatures.multiDrawIndirect) {
+            context.enabledFeatures.multiDrawIndirect = VK_TRUE;
+        }
+        // The draws start at the instance of their object, without this feature vkx::OcclusionCulling issues
+        // one draw per object and rebinds the instance buffer for each
+        if (context.deviceFeatures.drawIndirectFirstInstance) {
+            context.enabledFeatures.drawIndirectFirstInstance = VK_TRUE;
+        }
     }
 
-    void updateCommandBufferPreDraw(const vk::CommandBuffer& cmdBuffer) override {
-        // Reset query pool
-        // Must be done outside of render pass
-        cmdBuffer.resetQueryPool(queryPool, 0, 2);
+    void setupSecondPhaseRenderPass() {
+        std::array<vk::AttachmentDescription, 2> attachments;
+        // Color attachment, as the first phase left it
+        attachments[0].format = colorformat;
+        attachments[0].loadOp = vk::AttachmentLoadOp::eLoad;
+        attachments[0].storeOp = vk::AttachmentStoreOp::eStore;
+        attachments[0].initialLayout = vk::ImageLayout::ePresentSrcKHR;
+        attachments[0].finalLayout = vk::ImageLayout::ePresentSrcKHR;
+        // Depth attachment, returned to the attachment layout by the pyramid
+        attachments[1].format = depthFormat;
+        attachments[1].loadOp = vk::AttachmentLoadOp::eLoad;
+        attachments[1].storeOp = vk::AttachmentStoreOp::eDontCare;
+        attachments[1].stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
+        attachments[1].stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
+        attachments[1].initialLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+        attachments[1].finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+
+        vk::AttachmentReference colorReference{ 0, vk::ImageLayout::eColorAttachmentOptimal };
+        vk::AttachmentReference depthReference{ 1, vk::ImageLayout::eDepthStencilAttachmentOptimal };
+        vk::SubpassDescription subpass;
+        subpass.pipelineBindPoint = vk::PipelineBindPoint::eGraphics;
+        subpass.colorAttachmentCount = 1;
+        subpass.pColorAttachments = &colorReference;
+        subpass.pDepthStencilAttachment = &depthReference;
+
+        // Blend onto the colors written by the first phase
+        vk::SubpassDependency dependency{ VK_SUBPASS_EXTERNAL,
+                                          0,
+                                          vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                                          vk::PipelineStageFlagBits::eColorAttachmentOutput,
+                                          vk::AccessFlagBits::eColorAttachmentWrite,
+                                          vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite,
+                                          vk::DependencyFlagBits::eByRegion };
+
+        vk::RenderPassCreateInfo renderPassInfo;
+        renderPassInfo.attachmentCount = (uint32_t)attachments.size();
+        renderPassInfo.pAttachments = attachments.data();
+        renderPassInfo.subpassCount = 1;
+        renderPassInfo.pSubpasses = &subpass;
+        renderPassInfo.dependencyCount = 1;
+        renderPassInfo.pDependencies = &dependency;
+        secondPhaseRenderPass = device.createRenderPass(renderPassInfo);
     }
 
-    void updateDrawCommandBuffer(const vk::CommandBuffer& cmdBuffer) override {
+    void bindObjects(const vk::CommandBuffer& cmdBuffer) {
         cmdBuffer.setViewport(0, viewport());
         cmdBuffer.setScissor(0, scissor());
-
-        // Occlusion pass
-        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.simple);
-
-        // Occluder first
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
-        cmdBuffer.bindVertexBuffers(0, meshes.plane.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.plane.indices.buffer, 0, vk::IndexType::eUint32);
-        cmdBuffer.drawIndexed(meshes.plane.indexCount, 1, 0, 0, 0);
-
-        // Teapot
-        cmdBuffer.beginQuery(queryPool, 0, vk::QueryControlFlags());
-
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.teapot, nullptr);
-        cmdBuffer.bindVertexBuffers(0, meshes.teapot.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.teapot.indices.buffer, 0, vk::IndexType::eUint32);
-        cmdBuffer.drawIndexed(meshes.teapot.indexCount, 1, 0, 0, 0);
-
-        cmdBuffer.endQuery(queryPool, 0);
-
-        // Sphere
-        cmdBuffer.beginQuery(queryPool, 1, vk::QueryControlFlags());
-
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.sphere, nullptr);
-        cmdBuffer.bindVertexBuffers(0, meshes.sphere.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.sphere.indices.buffer, 0, vk::IndexType::eUint32);
-        cmdBuffer.drawIndexed(meshes.sphere.indexCount, 1, 0, 0, 0);
-
-        cmdBuffer.endQuery(queryPool, 1);
-
-        // Visible pass
-        // Clear color and depth attachments
-        std::array<vk::ClearAttachment, 2> clearAttachments;
-        clearAttachments[0].aspectMask = vk::ImageAspectFlagBits::eColor;
-        clearAttachments[0].clearValue.color = defaultClearColor;
-        clearAttachments[0].colorAttachment = 0;
-
-        clearAttachments[1].aspectMask = vk::ImageAspectFlagBits::eDepth;
-        clearAttachments[1].clearValue.depthStencil = vk::ClearDepthStencilValue{ 1.0f, 0 };
-
-        vk::ClearRect clearRect;
-        clearRect.layerCount = 1;
-        clearRect.rect.extent = size;
-
-        cmdBuffer.clearAttachments(clearAttachments, clearRect);
-
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.solid);
-
-        // Teapot
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.teapot, nullptr);
-        cmdBuffer.bindVertexBuffers(0, meshes.teapot.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.teapot.indices.buffer, 0, vk::IndexType::eUint32);
-        cmdBuffer.drawIndexed(meshes.teapot.indexCount, 1, 0, 0, 0);
-
-        // Sphere
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.sphere, nullptr);
+        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.scene, nullptr);
         cmdBuffer.bindVertexBuffers(0, meshes.sphere.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.sphere.indices.buffer, 0, vk::IndexType::eUint32);
-        cmdBuffer.drawIndexed(meshes.sphere.indexCount, 1, 0, 0, 0);
-
-        // Occluder
-        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.occluder);
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
-        cmdBuffer.bindVertexBuffers(0, meshes.plane.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.plane.indices.buffer, 0, vk::IndexType::eUint32);
-        cmdBuffer.drawIndexed(meshes.plane.indexCount, 1, 0, 0, 0);
+        cmdBuffer.bindVertexBuffers(1, instanceBuffer.buffer, { 0 });
+        cmdBuffer.bindIndexBuffer(meshes.sphere.indices.buffer, 0, meshes.sphere.indexType);
     }
 
-    void draw() override {
-        prepareFrame();
-
-        drawCurrentCommandBuffer();
-
-        // Read query results for displaying in next frame
-        getQueryResults();
-
-        submitFrame();
+    // Both phases in one command buffer per frame buffer, with the pyramid and the second cull in between
+    void buildCommandBuffers() override {
+        allocateCommandBuffers();
+
+        vk::CommandBufferBeginInfo cmdBufInfo{ vk::CommandBufferUsageFlagBits::eSimultaneousUse };
+        vk::RenderPassBeginInfo secondPhaseBeginInfo{ secondPhaseRenderPass, nullptr, vk::Rect2D{ {}, size } };
+        for (size_t i = 0; i < swapChain.imageCount; ++i) {
+            const auto& cmdBuffer = commandBuffers[i];
+            cmdBuffer.reset(vk::CommandBufferResetFlagBits::eReleaseResources);
+            cmdBuffer.begin(cmdBufInfo);
+
+            // First phase: the objects visible in the last frame, and the occluder
+            culling.cullFirstPhase(cmdBuffer);
+            renderPassBeginInfo.framebuffer = framebuffers[i];
+            cmdBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+            bindObjects(cmdBuffer);
+            culling.drawFirstPhase(cmdBuffer);
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.occluder);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSets.occluder, nullptr);
+            cmdBuffer.bindVertexBuffers(0, meshes.plane.vertices.buffer, { 0 });
+            cmdBuffer.bindIndexBuffer(meshes.plane.indices.buffer, 0, meshes.plane.indexType);
+            cmdBuffer.drawIndexed(meshes.plane.indexCount, 1, 0, 0, 0);
+            cmdBuffer.endRenderPass();
+
+            // Second phase: test everything against the depth just rendered, draw what the first phase missed
+            pyramid.build(cmdBuffer);
+            culling.cullSecondPhase(cmdBuffer);
+            secondPhaseBeginInfo.framebuffer = framebuffers[i];
+            cmdBuffer.beginRenderPass(secondPhaseBeginInfo, vk::SubpassContents::eInline);
+            bindObjects(cmdBuffer);
+            culling.drawSecondPhase(cmdBuffer);
+            cmdBuffer.endRenderPass();
+
+            cmdBuffer.end();
+        }
     }
 
     void loadMeshes() {
         meshes.plane.loadFromFile(context, getAssetPath() + "models/plane_z.3ds", vertexLayout, 0.4f);
-        meshes.teapot.loadFromFile(context, getAssetPath() + "models/teapot.3ds", vertexLayout, 0.3f);
-        meshes.sphere.loadFromFile(context, getAssetPath() + "models/sphere.3ds", vertexLayout, 0.3f);
+        meshes.sphere.loadFromFile(context, getAssetPath() + "models/sphere.3ds", vertexLayout, 0.05f);
+    }
+
+    void prepareObjects() {
+        const glm::vec3 sphereCenter = (meshes.sphere.dim.min + meshes.sphere.dim.max) * 0.5f;
+        const float sphereRadius = glm::length(meshes.sphere.dim.size) * 0.5f;
+        const float spacing = sphereRadius * 3.0f;
+        const float gridExtent = spacing * GRID_SIZE;
+
+        std::vector<InstanceData> instanceData;
+        std::vector<vkx::OcclusionCulling::Object> objects;
+        for (uint32_t x = 0; x < GRID_SIZE; x++) {
+            for (uint32_t y = 0; y < GRID_SIZE; y++) {
+                for (uint32_t z = 0; z < GRID_SIZE; z++) {
+                    // Leave a gap around the occluder at z = 0
+                    const float layer = (float)z - GRID_SIZE / 2 + (z < GRID_SIZE / 2 ? -0.5f : 0.5f);
+                    const glm::vec3 position = glm::vec3(((float)x - GRID_SIZE / 2 + 0.5f) * spacing, ((float)y - GRID_SIZE / 2 + 0.5f) * spacing,
+                                                         layer * spacing + (layer < 0.0f ? -spacing : spacing));
+                    InstanceData instance;
+                    instance.positionScale = glm::vec4(position, 1.0f);
+                    instance.color = glm::vec4((float)x / GRID_SIZE, (float)y / GRID_SIZE, (float)z / GRID_SIZE, 1.0f);
+
+                    vkx::OcclusionCulling::Object object;
+                    object.center = position + sphereCenter;
+                    object.radius = sphereRadius;
+                    object.indexCount = meshes.sphere.indexCount;
+                    object.firstInstance = static_cast<uint32_t>(objects.size());
+
+                    instanceData.push_back(instance);
+                    objects.push_back(object);
+                }
+            }
+        }
+        instanceBuffer = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, instanceData);
+        culling.create(objects);
+        culling.setInstanceBuffer(1, instanceBuffer.buffer, sizeof(InstanceData));
+
+        // Cover most of the grid, so some layers are hidden from every direction
+        const glm::vec3 planeSize = meshes.plane.dim.size;
+        occluderTransform = glm::scale(glm::mat4(1.0f), glm::vec3(0.75f * gridExtent / std::max(planeSize.x, 1e-3f),
+                                                                  0.75f * gridExtent / std::max(planeSize.y, 1e-3f), 1.0f));
     }
 
     void setupDescriptorPool() {
-        std::vector<vk::DescriptorPoolSize> poolSizes{ // One uniform buffer block for each mesh
-                                                       vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, 3)
+        std::vector<vk::DescriptorPoolSize> poolSizes{ // One uniform buffer block for the objects and one for the occluder
+                                                       vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, 2)
         };
-        descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 3, (uint32_t)poolSizes.size(), poolSizes.data() });
+        descriptorPool = device.createDescriptorPool(vk::DescriptorPoolCreateInfo{ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
     }
 
     void setupDescriptorSetLayout() {
@@ -235,50 +272,44 @@ public:
     void setupDescriptorSets() {
         vk::DescriptorSetAllocateInfo allocInfo{ descriptorPool, 1, &descriptorSetLayout };
 
-        // Occluder (plane)
-        descriptorSet = device.allocateDescriptorSets(allocInfo)[0];
-
+        // Objects
+        descriptorSets.scene = device.allocateDescriptorSets(allocInfo)[0];
         std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
             // Binding 0 : Vertex shader uniform buffer
-            vk::WriteDescriptorSet{ descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.vsScene.descriptor },
+            vk::WriteDescriptorSet{ descriptorSets.scene, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.vsScene.descriptor },
         };
-
-        device.updateDescriptorSets(writeDescriptorSets, nullptr);
-
-        // Teapot
-        descriptorSets.teapot = device.allocateDescriptorSets(allocInfo)[0];
-        writeDescriptorSets[0].dstSet = descriptorSets.teapot;
-        writeDescriptorSets[0].pBufferInfo = &uniformData.teapot.descriptor;
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
 
-        // Sphere
-        descriptorSets.sphere = device.allocateDescriptorSets(allocInfo)[0];
-        writeDescriptorSets[0].dstSet = descriptorSets.sphere;
-        writeDescriptorSets[0].pBufferInfo = &uniformData.sphere.descriptor;
+        // Occluder (plane)
+        descriptorSets.occluder = device.allocateDescriptorSets(allocInfo)[0];
+        writeDescriptorSets[0].dstSet = descriptorSets.occluder;
+        writeDescriptorSets[0].pBufferInfo = &uniformData.occluder.descriptor;
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
     }
 
     void preparePipelines() {
         vks::pipelines::GraphicsPipelineBuilder pipelineBuilder{ device, pipelineLayout, renderPass };
 
-        // Solid rendering pipeline
-        vk::PipelineInputAssemblyStateCreateInfo inputAssemblyState{ {}, vk::PrimitiveTopology::eTriangleList };
+        // Solid rendering pipeline for the objects, with their positions and colors as instanced attributes
         pipelineBuilder.rasterizationState.frontFace = vk::FrontFace::eClockwise;
         pipelineBuilder.vertexInputState.appendVertexLayout(vertexLayout);
+        pipelineBuilder.vertexInputState.bindingDescriptions.push_back({ 1, sizeof(InstanceData), vk::VertexInputRate::eInstance });
+        // Location 4: Position and scale
+        pipelineBuilder.vertexInputState.attributeDescriptions.push_back(
+            vk::VertexInputAttributeDescription{ 4, 1, vk::Format::eR32G32B32A32Sfloat, offsetof(InstanceData, positionScale) });
+        // Location 5: Color
+        pipelineBuilder.vertexInputState.attributeDescriptions.push_back(
+            vk::VertexInputAttributeDescription{ 5, 1, vk::Format::eR32G32B32A32Sfloat, offsetof(InstanceData, color) });
         pipelineBuilder.loadShader(getAssetPath() + "shaders/occlusionquery/mesh.vert.spv", vk::ShaderStageFlagBits::eVertex);
         pipelineBuilder.loadShader(getAssetPath() + "shaders/occlusionquery/mesh.frag.spv", vk::ShaderStageFlagBits::eFragment);
-        // Solid rendering pipeline
         pipelines.solid = pipelineBuilder.create(context.pipelineCache);
         pipelineBuilder.destroyShaderModules();
 
-        // Basic pipeline for coloring occluded objects
-        pipelineBuilder.loadShader(getAssetPath() + "shaders/occlusionquery/simple.vert.spv", vk::ShaderStageFlagBits::eVertex);
-        pipelineBuilder.loadShader(getAssetPath() + "shaders/occlusionquery/simple.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        // Visual pipeline for the occluder, which still writes the depth the pyramid is built from
+        pipelineBuilder.vertexInputState.bindingDescriptions.clear();
+        pipelineBuilder.vertexInputState.attributeDescriptions.clear();
+        pipelineBuilder.vertexInputState.appendVertexLayout(vertexLayout);
         pipelineBuilder.rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
-        pipelines.simple = pipelineBuilder.create(context.pipelineCache);
-        pipelineBuilder.destroyShaderModules();
-
-        // Visual pipeline for the occluder
         pipelineBuilder.loadShader(getAssetPath() + "shaders/occlusionquery/occluder.vert.spv", vk::ShaderStageFlagBits::eVertex);
         pipelineBuilder.loadShader(getAssetPath() + "shaders/occlusionquery/occluder.frag.spv", vk::ShaderStageFlagBits::eFragment);
         // Enable blending
@@ -294,39 +325,32 @@ public:
     void prepareUniformBuffers() {
         // Vertex shader uniform buffer block
         uniformData.vsScene = context.createUniformBuffer(uboVS);
-        // Teapot
-        uniformData.teapot = context.createUniformBuffer(uboVS);
-        // Sphere
-        uniformData.sphere = context.createUniformBuffer(uboVS);
+        // Occluder
+        uniformData.occluder = context.createUniformBuffer(uboVS);
         updateUniformBuffers();
     }
 
     void updateUniformBuffers() {
-        // Vertex shader
+        // Objects
         uboVS.projection = camera.matrices.perspective;
         uboVS.model = camera.matrices.view;
+        uniformData.vsScene.copy(uboVS);
 
         // Occluder
-        uboVS.visible = 1.0f;
-        uniformData.vsScene.copy(uboVS);
+        uboVS.model = camera.matrices.view * occluderTransform;
+        uniformData.occluder.copy(uboVS);
 
-        // Teapot
-        // Toggle color depending on visibility
-        uboVS.visible = (passedSamples[0] > 0) ? 1.0f : 0.0f;
-        uboVS.model = camera.matrices.view * glm::translate(glm::mat4(), glm::vec3(0.0f, 0.0f, -10.0f));
-        uniformData.teapot.copy(uboVS);
-
-        // Sphere
-        // Toggle color depending on visibility
-        uboVS.visible = (passedSamples[1] > 0) ? 1.0f : 0.0f;
-        uboVS.model = camera.matrices.view * glm::translate(glm::mat4(), glm::vec3(0.0f, 0.0f, 10.0f));
-        uniformData.sphere.copy(uboVS);
+        // Both phases test with the camera of the frame
+        culling.update(camera.matrices.perspective * camera.matrices.view);
     }
 
     void prepare() override {
         ExampleBase::prepare();
         loadMeshes();
-        setupQueryResultBuffer();
+        prepareObjects();
+        pyramid.create(depthStencil);
+        culling.setDepthPyramid(pyramid);
+        setupSecondPhaseRenderPass();
         prepareUniformBuffers();
         setupDescriptorSetLayout();
         preparePipelines();
@@ -336,6 +360,12 @@ public:
         prepared = true;
     }
 
+    void windowResized() override {
+        pyramid.destroy();
+        pyramid.create(depthStencil);
+        culling.setDepthPyramid(pyramid);
+    }
+
     void render() override {
         if (!prepared)
             return;
@@ -343,6 +373,24 @@ public:
     }
 
     void viewChanged() override { updateUniformBuffers(); }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            bool changed = ui.checkBox("Frustum culling", &culling.frustumCulling);
+            changed |= ui.checkBox("Occlusion culling", &culling.occlusionCulling);
+            if (changed) {
+                updateUniformBuffers();
+            }
+        }
+        if (ui.header("Statistics")) {
+            const auto statistics = culling.statistics();
+            ui.text("Objects: %d", culling.objectCount());
+            ui.text("Drawn in the first phase: %d", statistics.firstPhase);
+            ui.text("Drawn in the second phase: %d", statistics.secondPhase);
+            ui.text("Outside the frustum: %d", statistics.frustumCulled);
+            ui.text("Occluded: %d", statistics.occlusionCulled);
+        }
+    }
 };
 
 RUN_EXAMPLE(VulkanExample)
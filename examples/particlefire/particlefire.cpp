@@ -7,26 +7,17 @@
 */
 
 #include <vulkanExampleBase.h>
+#include <particles.hpp>
 
+#include <chrono>
+
+// Initial particle count, can be raised up to a million from the UI
 #define PARTICLE_COUNT 512
 #define PARTICLE_SIZE 10.0f
 
 #define FLAME_RADIUS 8.0f
 
-#define PARTICLE_TYPE_FLAME 0
-#define PARTICLE_TYPE_SMOKE 1
-
-struct Particle {
-    glm::vec3 pos;
-    glm::vec3 color;
-    float alpha;
-    float size;
-    float rotation;
-    uint32_t type;
-    // Attributes not used in shader
-    glm::vec3 vel;
-    float rotationSpeed;
-};
+static const std::vector<uint32_t> particleCounts{ 512, 8 * 1024, 64 * 1024, 256 * 1024, 1024 * 1024 };
 
 // Vertex layout for this example
 class VulkanExample : public vkx::ExampleBase {
@@ -58,12 +49,15 @@ public:
         } };
     } meshes;
 
-    glm::vec3 emitterPos = glm::vec3(0.0f, -FLAME_RADIUS + 2.0f, 0.0f);
-    glm::vec3 minVel = glm::vec3(-3.0f, 0.5f, -3.0f);
-    glm::vec3 maxVel = glm::vec3(3.0f, 7.0f, 3.0f);
-
     struct {
+        vkx::particles::FireSystem system;
+        uint32_t count{ PARTICLE_COUNT };
+        // One range of vertices per swap chain image, persistently mapped.  The simulation writes the range of
+        // the image that is about to be drawn, once the previous frame drawing it has completed.
         vks::Buffer buffer;
+        uint32_t ringSize{ 0 };
+        uint32_t ringCount{ 0 };
+        // Matches vkx::particles::Vertex
         vks::model::VertexLayout vertexLayout{ {
             vks::model::VERTEX_COMPONENT_POSITION,
             vks::model::VERTEX_COMPONENT_COLOR,
@@ -71,8 +65,10 @@ public:
             vks::model::VERTEX_COMPONENT_DUMMY_FLOAT,  // size
             vks::model::VERTEX_COMPONENT_DUMMY_FLOAT,  // rotaton
             vks::model::VERTEX_COMPONENT_DUMMY_INT,    // type
-            vks::model::VERTEX_COMPONENT_DUMMY_VEC4,
         } };
+        vkx::ThreadPool threadPool;
+        vkx::simd::Backend backend{ vkx::simd::best() };
+        float updateMilliseconds{ 0.0f };
     } particles;
 
     struct {
@@ -104,15 +100,12 @@ public:
     vk::DescriptorSet descriptorSet;
     vk::DescriptorSetLayout descriptorSetLayout;
 
-    std::vector<Particle> particleBuffer;
-
     VulkanExample() {
         camera.setRotation({ -15.0f, 45.0f, 0.0f });
         camera.dolly(-90.0f);
         title = "Vulkan Example - Particle system";
         zoomSpeed *= 1.5f;
         timerSpeed *= 8.0f;
-        srand((uint32_t)time(NULL));
     }
 
     ~VulkanExample() {
@@ -151,95 +144,66 @@ public:
         // Particle system
         cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, descriptorSet, nullptr);
         cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, pipelines.particles);
-        cmdBuffer.bindVertexBuffers(0, particles.buffer.buffer, { 0 });
-        cmdBuffer.draw(PARTICLE_COUNT, 1, 0, 0);
+        // The command buffers are recorded in swap chain image order, each one draws its own range of the ring
+        const auto image = static_cast<vk::DeviceSize>(&cmdBuffer - commandBuffers.data());
+        cmdBuffer.bindVertexBuffers(0, particles.buffer.buffer, { image * particles.ringSize * sizeof(vkx::particles::Vertex) });
+        cmdBuffer.draw(particles.count, 1, 0, 0);
     }
 
-    float rnd(float range) { return range * (rand() / float(RAND_MAX)); }
-
-    void initParticle(Particle* particle, glm::vec3 emitterPos) {
-        particle->vel = glm::vec4(0.0f, minVel.y + rnd(maxVel.y - minVel.y), 0.0f, 0.0f);
-        particle->alpha = rnd(0.75f);
-        particle->size = 1.0f + rnd(0.5f);
-        particle->color = glm::vec4(1.0f);
-        particle->type = PARTICLE_TYPE_FLAME;
-        particle->rotation = rnd(2.0f * (float)M_PI);
-        particle->rotationSpeed = rnd(2.0f) - rnd(2.0f);
-
-        // Get random sphere point
-        float theta = rnd(2 * (float)M_PI);
-        float phi = rnd((float)M_PI) - (float)M_PI / 2;
-        float r = rnd(FLAME_RADIUS);
-
-        particle->pos.x = r * cos(theta) * cos(phi);
-        particle->pos.y = r * sin(phi);
-        particle->pos.z = r * sin(theta) * cos(phi);
-
-        particle->pos += emitterPos;
+    vkx::particles::Vertex* ringVertices(uint32_t image) {
+        return static_cast<vkx::particles::Vertex*>(particles.buffer.mapped) + static_cast<size_t>(image) * particles.ringSize;
     }
 
-    void transitionParticle(Particle* particle) {
-        switch (particle->type) {
-            case PARTICLE_TYPE_FLAME:
-                // Flame particles have a chance of turning into smoke
-                if (rnd(1.0f) < 0.05f) {
-                    particle->alpha = 0.0f;
-                    particle->color = glm::vec4(0.25f + rnd(0.25f));
-                    particle->pos.x *= 0.5f;
-                    particle->pos.z *= 0.5f;
-                    particle->vel = glm::vec4(rnd(1.0f) - rnd(1.0f), (minVel.y * 2) + rnd(maxVel.y - minVel.y), rnd(1.0f) - rnd(1.0f), 0.0f);
-                    particle->size = 1.0f + rnd(0.5f);
-                    particle->rotationSpeed = rnd(1.0f) - rnd(1.0f);
-                    particle->type = PARTICLE_TYPE_SMOKE;
-                } else {
-                    initParticle(particle, emitterPos);
-                }
-                break;
-            case PARTICLE_TYPE_SMOKE:
-                // Respawn at end of life
-                initParticle(particle, emitterPos);
-                break;
-        }
+    void prepareParticles() {
+        vkx::particles::Emitter emitter;
+        emitter.position = glm::vec3(0.0f, -FLAME_RADIUS + 2.0f, 0.0f);
+        emitter.radius = FLAME_RADIUS;
+        particles.system.create(particles.count, emitter, static_cast<uint64_t>(time(nullptr)));
+        prepareVertexRing();
     }
 
-    void prepareParticles() {
-        particleBuffer.resize(PARTICLE_COUNT);
-        for (auto& particle : particleBuffer) {
-            initParticle(&particle, emitterPos);
-            particle.alpha = 1.0f - (abs(particle.pos.y) / (FLAME_RADIUS * 2.0f));
+    // (Re)create the vertex ring if the particle or swap chain image count changed
+    void prepareVertexRing() {
+        if (particles.ringSize == particles.count && particles.ringCount == swapChain.imageCount) {
+            return;
         }
-
+        if (particles.buffer.buffer) {
+            device.waitIdle();
+            particles.buffer.destroy();
+        }
+        particles.ringSize = particles.count;
+        particles.ringCount = swapChain.imageCount;
         particles.buffer =
             context.createBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-                                 sizeof(Particle) * particleBuffer.size());
+                                 sizeof(vkx::particles::Vertex) * particles.ringSize * particles.ringCount);
         particles.buffer.map();
-        particles.buffer.copy(particleBuffer);
+        for (uint32_t image = 0; image < particles.ringCount; ++image) {
+            particles.system.write(particles.threadPool, ringVertices(image));
+        }
+    }
+
+    void setParticleCount(uint32_t count) {
+        particles.count = count;
+        prepareParticles();
+        // The draw command buffers reference the vertex ring and the particle count
+        buildCommandBuffers();
     }
 
+    // Write the particles into the ring range of the current swap chain image, advancing them unless paused
     void updateParticles() {
-        float particleTimer = frameTimer * 0.45f;
-        for (auto& particle : particleBuffer) {
-            switch (particle.type) {
-                case PARTICLE_TYPE_FLAME:
-                    particle.pos.y -= particle.vel.y * particleTimer * 3.5f;
-                    particle.alpha += particleTimer * 2.5f;
-                    particle.size -= particleTimer * 0.5f;
-                    break;
-                case PARTICLE_TYPE_SMOKE:
-                    particle.pos -= particle.vel * frameTimer * 1.0f;
-                    particle.alpha += particleTimer * 1.25f;
-                    particle.size += particleTimer * 0.125f;
-                    particle.color -= particleTimer * 0.05f;
-                    break;
-            }
-            particle.rotation += particleTimer * particle.rotationSpeed;
-            // Transition particle state
-            if (particle.alpha > 2.0f) {
-                transitionParticle(&particle);
-            }
+        // The previous frame drawing from this range has to complete first
+        const auto& fence = swapChain.images[currentBuffer].fence;
+        if (fence) {
+            device.waitForFences(fence, VK_TRUE, UINT64_MAX);
         }
-
-        particles.buffer.copy(particleBuffer);
+        auto vertices = ringVertices(currentBuffer);
+        if (paused) {
+            particles.system.write(particles.threadPool, vertices);
+            return;
+        }
+        auto tStart = std::chrono::high_resolution_clock::now();
+        particles.system.update(frameTimer, particles.threadPool, particles.backend, vertices);
+        particles.updateMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
     }
 
     void loadAssets() override {
@@ -412,17 +376,53 @@ public:
         prepared = true;
     }
 
+    void buildCommandBuffers() override {
+        // The number of swap chain images may change with the window size
+        prepareVertexRing();
+        ExampleBase::buildCommandBuffers();
+    }
+
     void render() override {
         if (!prepared)
             return;
-        draw();
+        prepareFrame();
+        updateParticles();
+        drawCurrentCommandBuffer();
+        submitFrame();
         if (!paused) {
             updateUniformBufferLight();
-            updateParticles();
         }
     }
 
     void viewChanged() override { updateUniformBuffers(); }
+
+    void OnUpdateUIOverlay() override {
+        if (ui.header("Settings")) {
+            std::vector<std::string> countNames;
+            int32_t countIndex = 0;
+            for (const auto& count : particleCounts) {
+                if (count == particles.count) {
+                    countIndex = static_cast<int32_t>(countNames.size());
+                }
+                countNames.push_back(count < 1024 ? std::to_string(count) : std::to_string(count / 1024) + "K");
+            }
+            if (ui.comboBox("Particles", &countIndex, countNames)) {
+                setParticleCount(particleCounts[countIndex]);
+            }
+            std::vector<std::string> backendNames{ vkx::simd::name(vkx::simd::Backend::scalar) };
+            if (vkx::simd::best() != vkx::simd::Backend::scalar) {
+                backendNames.push_back(vkx::simd::name(vkx::simd::best()));
+            }
+            int32_t backendIndex = particles.backend == vkx::simd::Backend::scalar ? 0 : 1;
+            if (ui.comboBox("Update", &backendIndex, backendNames)) {
+                particles.backend = backendIndex == 0 ? vkx::simd::Backend::scalar : vkx::simd::best();
+            }
+        }
+        if (ui.header("Statistics")) {
+            ui.text("%u flames, %u smoke", (uint32_t)particles.system.flameCount(), particles.count - (uint32_t)particles.system.flameCount());
+            ui.text("CPU update (%u threads): %.3f ms", particles.threadPool.size(), particles.updateMilliseconds);
+        }
+    }
 };
 
 RUN_EXAMPLE(VulkanExample)
@@ -46,11 +46,13 @@ public:
 
     struct Textures {
         vks::texture::TextureCubeMap environmentCube;
-        // Generated at runtime
+        // Generated at runtime or loaded from the cache
         vks::texture::Texture2D lutBrdf;
         vks::texture::TextureCubeMap irradianceCube;
         vks::texture::TextureCubeMap prefilteredCube;
     } textures;
+    // Environment the IBL maps are precomputed from
+    std::string environmentFile;
 
     struct Meshes {
         vks::model::Model skybox;
@@ -75,6 +77,10 @@ public:
         glm::vec4 lights[4];
         float exposure = 4.5f;
         float gamma = 2.2f;
+        // Diffuse lighting from the spherical harmonics instead of the irradiance cube
+        uint32_t sphericalHarmonics = 0;
+        float padding;
+        vkx::pbr::IrradianceSH irradianceSH;
     } uboParams;
 
     struct {
@@ -209,7 +215,8 @@ public:
     }
 
     void loadAssets() override {
-        textures.environmentCube.loadFromFile(context, getAssetPath() + "textures/hdr/pisa_cube.ktx", vF::eR16G16B16A16Sfloat);
+        environmentFile = getAssetPath() + "textures/hdr/pisa_cube.ktx";
+        textures.environmentCube.loadFromFile(context, environmentFile, vF::eR16G16B16A16Sfloat);
         // Skybox
         models.skybox.loadFromFile(context, getAssetPath() + "models/cube.obj", vertexLayout, 1.0f);
         // Objects
@@ -332,9 +339,13 @@ public:
 
     void prepare() override {
         ExampleBase::prepare();
-        vkx::pbr::generateBRDFLUT(context, textures.lutBrdf);
-        vkx::pbr::generateIrradianceCube(context, textures.irradianceCube, models.skybox, vertexLayout, textures.environmentCube.descriptor);
-        vkx::pbr::generatePrefilteredCube(context, textures.prefilteredCube, models.skybox, vertexLayout, textures.environmentCube.descriptor);
+        // The maps are baked on the first run and loaded from the cache directory next to the environment afterwards
+        const std::string cacheDirectory = vkx::pbr::environmentCacheDirectory(environmentFile);
+        const auto& environment = textures.environmentCube.descriptor;
+        vkx::pbr::loadOrGenerateBRDFLUT(context, cacheDirectory, textures.lutBrdf);
+        vkx::pbr::loadOrGenerateIrradianceCube(context, cacheDirectory, environmentFile, textures.irradianceCube, models.skybox, vertexLayout, environment);
+        vkx::pbr::loadOrGeneratePrefilteredCube(context, cacheDirectory, environmentFile, textures.prefilteredCube, models.skybox, vertexLayout, environment);
+        uboParams.irradianceSH = vkx::pbr::generateIrradianceSH(context, environment);
         prepareUniformBuffers();
         setupDescriptors();
         preparePipelines();
@@ -359,6 +370,11 @@ public:
             if (ui.inputFloat("Gamma", &uboParams.gamma, 0.1f, 2)) {
                 updateParams();
             }
+            bool sphericalHarmonics = uboParams.sphericalHarmonics != 0;
+            if (ui.checkBox("Spherical harmonics irradiance", &sphericalHarmonics)) {
+                uboParams.sphericalHarmonics = sphericalHarmonics ? 1 : 0;
+                updateParams();
+            }
             if (ui.checkBox("Skybox", &displaySkybox)) {
                 buildCommandBuffers();
             }
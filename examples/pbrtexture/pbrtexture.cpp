@@ -19,7 +19,7 @@ public:
 
     struct Textures {
         vks::texture::TextureCubeMap environmentCube;
-        // Generated at runtime
+        // Generated at runtime or loaded from the cache
         vks::texture::Texture2D lutBrdf;
         vks::texture::TextureCubeMap irradianceCube;
         vks::texture::TextureCubeMap prefilteredCube;
@@ -30,6 +30,8 @@ public:
         vks::texture::Texture2D metallicMap;
         vks::texture::Texture2D roughnessMap;
     } textures;
+    // Environment the IBL maps are precomputed from
+    std::string environmentFile;
 
     // Vertex layout for the models
     vks::model::VertexLayout vertexLayout = vks::model::VertexLayout({
@@ -145,7 +147,8 @@ public:
     }
 
     void loadAssets() override {
-        textures.environmentCube.loadFromFile(context, getAssetPath() + "textures/hdr/gcanyon_cube.ktx", vF::eR16G16B16A16Sfloat);
+        environmentFile = getAssetPath() + "textures/hdr/gcanyon_cube.ktx";
+        textures.environmentCube.loadFromFile(context, environmentFile, vF::eR16G16B16A16Sfloat);
         models.skybox.loadFromFile(context, getAssetPath() + "models/cube.obj", vertexLayout, 1.0f);
         // PBR model
         models.object.loadFromFile(context, getAssetPath() + "models/cerberus/cerberus.fbx", vertexLayout, 0.05f);
@@ -263,9 +266,12 @@ public:
 
     void prepare() override {
         ExampleBase::prepare();
-        vkx::pbr::generateBRDFLUT(context, textures.lutBrdf);
-        vkx::pbr::generateIrradianceCube(context, textures.irradianceCube, models.skybox, vertexLayout, textures.environmentCube.descriptor);
-        vkx::pbr::generatePrefilteredCube(context, textures.prefilteredCube, models.skybox, vertexLayout, textures.environmentCube.descriptor);
+        // The maps are baked on the first run and loaded from the cache directory next to the environment afterwards
+        const std::string cacheDirectory = vkx::pbr::environmentCacheDirectory(environmentFile);
+        const auto& environment = textures.environmentCube.descriptor;
+        vkx::pbr::loadOrGenerateBRDFLUT(context, cacheDirectory, textures.lutBrdf);
+        vkx::pbr::loadOrGenerateIrradianceCube(context, cacheDirectory, environmentFile, textures.irradianceCube, models.skybox, vertexLayout, environment);
+        vkx::pbr::loadOrGeneratePrefilteredCube(context, cacheDirectory, environmentFile, textures.prefilteredCube, models.skybox, vertexLayout, environment);
         prepareUniformBuffers();
         setupDescriptors();
         preparePipelines();
@@ -0,0 +1,208 @@
+/*
+* Vulkan Example - CPU checks of the SPIR-V reflection
+*
+* Reflects every compiled shader under data/shaders and compares the interfaces of a set of examples with the
+* descriptor set layouts and push constant ranges they still build by hand.  A small module assembled in memory
+* covers arrays sized by specialization constants, so those are checked even without the compiled shaders.
+* Needs no GPU.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <check.hpp>
+#include <vks/filesystem.hpp>
+#include <vks/reflection.hpp>
+#include <utils.hpp>
+
+using vks::reflection::BindingList;
+using vks::reflection::PipelineReflection;
+
+// A pipeline of an example and the layout of its set 0 as written out in the example
+struct Expectation {
+    const char* name;
+    std::vector<const char*> shaders;
+    BindingList bindings;
+    std::vector<vk::PushConstantRange> pushConstantRanges;
+};
+
+static const vk::ShaderStageFlags VS = vk::ShaderStageFlagBits::eVertex;
+static const vk::ShaderStageFlags FS = vk::ShaderStageFlagBits::eFragment;
+static const vk::ShaderStageFlags CS = vk::ShaderStageFlagBits::eCompute;
+static const vk::DescriptorType UBO = vk::DescriptorType::eUniformBuffer;
+static const vk::DescriptorType SSBO = vk::DescriptorType::eStorageBuffer;
+static const vk::DescriptorType SAMPLER = vk::DescriptorType::eCombinedImageSampler;
+static const vk::DescriptorType INPUT = vk::DescriptorType::eInputAttachment;
+
+class ReflectionCheck : public vkx::Check {
+public:
+    // Every shader compiled from data/shaders has to reflect without throwing
+    void sweep() {
+        const std::string root = vkx::getAssetPath() + "shaders/";
+        uint32_t shaderCount = 0;
+        for (const auto& directory : vks::file::listDirectory(root)) {
+            for (const auto& file : vks::file::listDirectory(root + directory)) {
+                if (file.size() < 4 || file.compare(file.size() - 4, 4, ".spv") != 0) {
+                    continue;
+                }
+                ++shaderCount;
+                try {
+                    vks::reflection::reflectFile(root + directory + "/" + file);
+                } catch (const std::exception& e) {
+                    error(directory + "/" + file + ": " + e.what());
+                }
+            }
+        }
+        if (shaderCount == 0) {
+            LOG("No compiled shaders found in %s, only the built in module is checked\n", root.c_str());
+        } else {
+            LOG("Reflected %u shaders\n", shaderCount);
+        }
+    }
+
+    // Reflected bindings have to appear in the hand written layout with the same type and count, in at least the
+    // reflected stages.  Bindings the optimizer stripped from the shaders are allowed to be missing.
+    void compare(const std::string& name, const PipelineReflection& reflection, const BindingList& bindings,
+                 const std::vector<vk::PushConstantRange>& pushConstantRanges) {
+        for (const auto& set : reflection.sets) {
+            for (const auto& reflected : set.second) {
+                const std::string where = name + " set " + std::to_string(set.first) + " binding " + std::to_string(reflected.binding);
+                auto itr = std::find_if(bindings.begin(), bindings.end(),
+                                        [&](const vk::DescriptorSetLayoutBinding& binding) { return binding.binding == reflected.binding; });
+                if (set.first != 0 || itr == bindings.end()) {
+                    error(where + ": not in the hand written layout");
+                } else if (itr->descriptorType != reflected.descriptorType) {
+                    error(where + ": reflected as " + vk::to_string(reflected.descriptorType) + " instead of " + vk::to_string(itr->descriptorType));
+                } else if (itr->descriptorCount != reflected.descriptorCount) {
+                    error(where + ": reflected with " + std::to_string(reflected.descriptorCount) + " descriptors instead of " +
+                          std::to_string(itr->descriptorCount));
+                } else if (reflected.stageFlags & ~itr->stageFlags) {
+                    error(where + ": used in " + vk::to_string(reflected.stageFlags) + " but only visible to " + vk::to_string(itr->stageFlags));
+                }
+            }
+        }
+        if (reflection.pushConstantRanges.size() != pushConstantRanges.size()) {
+            error(name + ": " + std::to_string(reflection.pushConstantRanges.size()) + " push constant ranges instead of " +
+                  std::to_string(pushConstantRanges.size()));
+            return;
+        }
+        for (size_t i = 0; i < pushConstantRanges.size(); ++i) {
+            const auto& reflected = reflection.pushConstantRanges[i];
+            const auto& expected = pushConstantRanges[i];
+            if (reflected.offset != expected.offset || reflected.size != expected.size || (reflected.stageFlags & ~expected.stageFlags)) {
+                error(name + ": push constant range " + std::to_string(reflected.offset) + " + " + std::to_string(reflected.size) + " in " +
+                      vk::to_string(reflected.stageFlags) + " differs from the hand written one");
+            }
+        }
+    }
+
+    void checkExamples() {
+        // clang-format off
+        const std::vector<Expectation> expectations{
+            { "triangle", { "triangle/triangle.vert", "triangle/triangle.frag" }, { { 0, UBO, 1, VS } }, {} },
+            { "texture", { "texture/texture.vert", "texture/texture.frag" }, { { 0, UBO, 1, VS }, { 1, SAMPLER, 1, FS } }, {} },
+            { "pushconstants", { "pushconstants/lights.vert", "pushconstants/lights.frag" }, { { 0, UBO, 1, VS } }, { { VS, 0, 6 * sizeof(float) * 4 } } },
+            { "ssao gbuffer", { "ssao/gbuffer.vert", "ssao/gbuffer.frag" }, { { 0, UBO, 1, VS }, { 1, SAMPLER, 1, FS } }, {} },
+            { "ssao", { "ssao/fullscreen.vert", "ssao/ssao.frag" },
+              { { 0, SAMPLER, 1, FS }, { 1, SAMPLER, 1, FS }, { 2, SAMPLER, 1, FS }, { 3, UBO, 1, FS }, { 4, UBO, 1, FS } }, {} },
+            { "ssao blur", { "ssao/fullscreen.vert", "ssao/blur.frag" }, { { 0, SAMPLER, 1, FS } }, {} },
+            { "ssao composition", { "ssao/fullscreen.vert", "ssao/composition.frag" },
+              { { 0, SAMPLER, 1, FS }, { 1, SAMPLER, 1, FS }, { 2, SAMPLER, 1, FS }, { 3, SAMPLER, 1, FS }, { 4, SAMPLER, 1, FS }, { 5, UBO, 1, FS } }, {} },
+            { "subpasses composition", { "subpasses/composition.vert", "subpasses/composition.frag" },
+              { { 0, INPUT, 1, FS }, { 1, INPUT, 1, FS }, { 2, INPUT, 1, FS }, { 3, UBO, 1, FS } }, {} },
+            { "subpasses transparent", { "subpasses/transparent.vert", "subpasses/transparent.frag" },
+              { { 0, UBO, 1, VS }, { 1, INPUT, 1, FS }, { 2, SAMPLER, 1, FS } }, {} },
+            { "computeheadless", { "computeheadless/headless.comp" }, { { 0, SSBO, 1, CS } }, {} },
+            { "deferred", { "deferred/deferred.vert", "deferred/deferred.frag" },
+              { { 0, UBO, 1, VS }, { 1, SAMPLER, 1, FS }, { 2, SAMPLER, 1, FS }, { 3, SAMPLER, 1, FS },
+                { 4, UBO, 1, FS }, { 5, SSBO, 1, FS }, { 6, SSBO, 1, FS }, { 7, SSBO, 1, FS } }, {} },
+            { "clusteredlighting", { "clusteredlighting/transform.comp", "clusteredlighting/assign.comp" },
+              { { 0, UBO, 1, CS }, { 1, SSBO, 1, CS }, { 2, SSBO, 1, CS }, { 3, SSBO, 1, CS },
+                { 4, SSBO, 1, CS }, { 5, SSBO, 1, CS }, { 6, SSBO, 1, CS } }, {} },
+            { "lightingbenchmark", { "lightingbenchmark/shade.comp" },
+              { { 0, UBO, 1, CS }, { 1, SSBO, 1, CS }, { 2, SSBO, 1, CS }, { 3, SSBO, 1, CS }, { 4, SSBO, 1, CS } }, { { CS, 0, 96 } } },
+        };
+        // clang-format on
+
+        uint32_t checked = 0;
+        for (const auto& expectation : expectations) {
+            try {
+                PipelineReflection reflection;
+                bool missing = false;
+                for (const auto& shader : expectation.shaders) {
+                    const std::string filename = vkx::getAssetPath() + "shaders/" + shader + ".spv";
+                    if (!std::ifstream(filename).good()) {
+                        LOG("%s: %s.spv not found, skipped\n", expectation.name, shader);
+                        missing = true;
+                        break;
+                    }
+                    reflection.addFile(filename);
+                }
+                if (!missing) {
+                    compare(expectation.name, reflection, expectation.bindings, expectation.pushConstantRanges);
+                    ++checked;
+                }
+            } catch (const std::exception& e) {
+                error(std::string(expectation.name) + ": " + e.what());
+            }
+        }
+        LOG("Compared %u of %u pipelines with their hand written layouts\n", checked, static_cast<uint32_t>(expectations.size()));
+    }
+
+    // A compute shader with a push constant block and a sampler array sized by specialization constants, and a sampler
+    // array sized by an expression of them:
+    //   layout (constant_id = 0) const uint N = 16;
+    //   layout (constant_id = 1) const uint M = 4;
+    //   layout (push_constant) uniform Block { uint values[N]; };
+    //   layout (binding = 1) uniform sampler2D samplers[M];
+    //   layout (binding = 2) uniform sampler2D moreSamplers[N + M];
+    void checkSpecializationConstants() {
+        // clang-format off
+        const std::vector<uint32_t> code{
+            0x07230203, 0x00010000, 0, 19, 0,
+            (2 << 16) | 17, 1,                              // OpCapability Shader
+            (3 << 16) | 14, 0, 1,                           // OpMemoryModel Logical GLSL450
+            (5 << 16) | 15, 5, 1, 0x6E69616D, 0,            // OpEntryPoint GLCompute %1 "main"
+            (4 << 16) | 71, 4, 6, 4,                        // OpDecorate %4 ArrayStride 4
+            (5 << 16) | 72, 5, 0, 35, 0,                    // OpMemberDecorate %5 0 Offset 0
+            (3 << 16) | 71, 5, 2,                           // OpDecorate %5 Block
+            (4 << 16) | 71, 14, 34, 0,                      // OpDecorate %14 DescriptorSet 0
+            (4 << 16) | 71, 14, 33, 1,                      // OpDecorate %14 Binding 1
+            (4 << 16) | 71, 18, 34, 0,                      // OpDecorate %18 DescriptorSet 0
+            (4 << 16) | 71, 18, 33, 2,                      // OpDecorate %18 Binding 2
+            (4 << 16) | 21, 2, 32, 0,                       // %2 = OpTypeInt 32 0
+            (4 << 16) | 50, 2, 3, 16,                       // %3 = OpSpecConstant %2 16
+            (4 << 16) | 28, 4, 2, 3,                        // %4 = OpTypeArray %2 %3
+            (3 << 16) | 30, 5, 4,                           // %5 = OpTypeStruct %4
+            (4 << 16) | 32, 6, 9, 5,                        // %6 = OpTypePointer PushConstant %5
+            (4 << 16) | 59, 6, 7, 9,                        // %7 = OpVariable %6 PushConstant
+            (3 << 16) | 22, 8, 32,                          // %8 = OpTypeFloat 32
+            (9 << 16) | 25, 9, 8, 1, 0, 0, 0, 1, 0,         // %9 = OpTypeImage %8 2D 0 0 0 1 Unknown
+            (3 << 16) | 27, 10, 9,                          // %10 = OpTypeSampledImage %9
+            (4 << 16) | 50, 2, 11, 4,                       // %11 = OpSpecConstant %2 4
+            (4 << 16) | 28, 12, 10, 11,                     // %12 = OpTypeArray %10 %11
+            (4 << 16) | 32, 13, 0, 12,                      // %13 = OpTypePointer UniformConstant %12
+            (4 << 16) | 59, 13, 14, 0,                      // %14 = OpVariable %13 UniformConstant
+            (6 << 16) | 52, 2, 15, 128, 3, 11,              // %15 = OpSpecConstantOp %2 IAdd %3 %11
+            (4 << 16) | 28, 16, 10, 15,                     // %16 = OpTypeArray %10 %15
+            (4 << 16) | 32, 17, 0, 16,                      // %17 = OpTypePointer UniformConstant %16
+            (4 << 16) | 59, 17, 18, 0,                      // %18 = OpVariable %17 UniformConstant
+        };
+        // clang-format on
+
+        try {
+            PipelineReflection reflection{ vks::reflection::reflect(code) };
+            compare("specialization constants", reflection, { { 1, SAMPLER, 4, CS }, { 2, SAMPLER, 1, CS } }, { { CS, 0, 16 * sizeof(uint32_t) } });
+        } catch (const std::exception& e) {
+            error(std::string("specialization constants: ") + e.what());
+        }
+    }
+
+    uint32_t run() {
+        checkSpecializationConstants();
+        sweep();
+        checkExamples();
+        return finish();
+    }
+};
+
+RUN_CHECK(ReflectionCheck)
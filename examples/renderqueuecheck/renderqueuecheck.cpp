@@ -0,0 +1,208 @@
+/*
+* Vulkan Example - CPU checks and benchmark of the draw sorting and batching
+*
+* Fills a vkx::render::RenderQueue with random opaque and translucent draws of a set of meshes and checks the
+* result of build(): opaque draws come first, front to back within their state, translucent draws follow back to
+* front, every run of draws sharing a mesh and state is one instanced command, and every run of commands sharing
+* state is one batch.  The indirect commands and payloads have to match.  The time to build queues of growing
+* size is reported at the end.  Needs no GPU.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <check.hpp>
+#include <renderqueue.hpp>
+
+#define MESH_COUNT 64
+#define MATERIAL_COUNT 32
+// Pipelines 0 and 1 draw opaque, 2 translucent
+#define PIPELINE_COUNT 3
+#define TRANSLUCENT_PIPELINE 2
+#define QUEUE_COUNT 64
+
+// Minimum time to build each queue size
+static const double MIN_SECONDS = 0.25;
+
+using vkx::render::DrawItem;
+using vkx::render::RenderQueue;
+
+class RenderQueueCheck : public vkx::Check {
+public:
+    std::default_random_engine rndGen{ 0 };
+    std::vector<vkx::render::MeshRange> meshes;
+
+    RenderQueueCheck() {
+        meshes.resize(MESH_COUNT);
+        uint32_t firstIndex = 0;
+        for (uint32_t i = 0; i < MESH_COUNT; ++i) {
+            meshes[i].firstIndex = firstIndex;
+            meshes[i].indexCount = 36 + 6 * i;
+            meshes[i].vertexOffset = static_cast<int32_t>(i * 24);
+            firstIndex += meshes[i].indexCount;
+        }
+    }
+
+    void error(const char* message, uint32_t queue, uint32_t index) {
+        Check::error("Queue " + std::to_string(queue) + ", entry " + std::to_string(index) + ": " + message);
+    }
+
+    // Draws at random depths.  Some meshes are drawn several times with the same state, so instancing has
+    // something to merge, and only some materials are used by several meshes, so there are batches to form.
+    std::vector<DrawItem> generate(uint32_t count) {
+        std::uniform_int_distribution<uint32_t> rndMesh(0, MESH_COUNT - 1);
+        std::uniform_int_distribution<uint32_t> rndPipeline(0, PIPELINE_COUNT - 1);
+        std::uniform_real_distribution<float> rndDepth(0.0f, 100.0f);
+        std::vector<DrawItem> items;
+        items.reserve(count);
+        for (uint32_t i = 0; i < count; ++i) {
+            const uint32_t mesh = rndMesh(rndGen);
+            // Every mesh keeps its material, so draws of the same mesh can be instanced
+            const uint32_t material = mesh % MATERIAL_COUNT;
+            const uint32_t pipeline = rndPipeline(rndGen);
+            // Instances of the same mesh at the same depth sort next to each other
+            const float depth = (i % 4 == 0) ? rndDepth(rndGen) : static_cast<float>(mesh);
+            const uint64_t key = pipeline == TRANSLUCENT_PIPELINE ? vkx::render::sortkey::translucent(pipeline, material, depth)
+                                                                  : vkx::render::sortkey::opaque(pipeline, material, depth);
+            items.push_back({ key, pipeline, material, mesh, i });
+        }
+        return items;
+    }
+
+    static float depthOf(const DrawItem& item) {
+        uint32_t bits = item.pipeline == TRANSLUCENT_PIPELINE ? ~static_cast<uint32_t>(item.key >> 31) : static_cast<uint32_t>(item.key);
+        float depth;
+        memcpy(&depth, &bits, sizeof(depth));
+        return depth;
+    }
+
+    void checkOrder(uint32_t q, const std::vector<DrawItem>& sorted) {
+        for (uint32_t i = 1; i < sorted.size(); ++i) {
+            const auto& a = sorted[i - 1];
+            const auto& b = sorted[i];
+            const bool aTranslucent = a.pipeline == TRANSLUCENT_PIPELINE, bTranslucent = b.pipeline == TRANSLUCENT_PIPELINE;
+            if (aTranslucent && !bTranslucent) {
+                error("opaque draw after a translucent one", q, i);
+            } else if (aTranslucent && bTranslucent && depthOf(a) < depthOf(b)) {
+                error("translucent draws not back to front", q, i);
+            } else if (!aTranslucent && !bTranslucent) {
+                if (a.pipeline > b.pipeline || (a.pipeline == b.pipeline && a.material > b.material)) {
+                    error("opaque draws not grouped by pipeline and material", q, i);
+                } else if (a.pipeline == b.pipeline && a.material == b.material && depthOf(a) > depthOf(b)) {
+                    error("opaque draws not front to back", q, i);
+                }
+            }
+        }
+    }
+
+    void checkBatches(uint32_t q, const RenderQueue& queue, bool mergeMaterials) {
+        const auto& sorted = queue.sortedItems();
+        const auto& payloads = queue.payloads();
+        const auto& commands = queue.commands();
+        const auto& batches = queue.batches();
+
+        if (payloads.size() != sorted.size()) {
+            error("payload count differs from the draw count", q, 0);
+            return;
+        }
+        uint32_t nextCommand = 0;
+        uint32_t nextItem = 0;
+        for (uint32_t b = 0; b < batches.size(); ++b) {
+            const auto& batch = batches[b];
+            if (batch.firstCommand != nextCommand || batch.commandCount == 0) {
+                error("batches do not cover the commands in order", q, b);
+                return;
+            }
+            if (b > 0 && batches[b - 1].pipeline == batch.pipeline && (mergeMaterials || batches[b - 1].material == batch.material)) {
+                error("neighbouring batches share their state", q, b);
+            }
+            for (uint32_t c = batch.firstCommand; c < batch.firstCommand + batch.commandCount; ++c) {
+                const auto& command = commands[c];
+                if (command.firstInstance != nextItem || command.instanceCount == 0) {
+                    error("commands do not cover the draws in order", q, c);
+                    return;
+                }
+                if (c > batch.firstCommand && commands[c - 1].mesh == command.mesh) {
+                    error("neighbouring commands of a batch draw the same mesh", q, c);
+                }
+                for (uint32_t i = command.firstInstance; i < command.firstInstance + command.instanceCount; ++i) {
+                    const auto& item = sorted[i];
+                    if (item.mesh != command.mesh || item.pipeline != batch.pipeline || (!mergeMaterials && item.material != batch.material)) {
+                        error("draw does not match its command and batch", q, i);
+                    }
+                    if (payloads[i] != item.payload) {
+                        error("payload out of order", q, i);
+                    }
+                }
+                nextItem += command.instanceCount;
+            }
+            nextCommand += batch.commandCount;
+        }
+        if (nextCommand != commands.size() || nextItem != sorted.size()) {
+            error("draws or commands left out of the batches", q, 0);
+        }
+
+        const auto indirect = queue.indirectCommands(meshes);
+        for (uint32_t c = 0; c < commands.size(); ++c) {
+            const auto& mesh = meshes[commands[c].mesh];
+            if (indirect[c].indexCount != mesh.indexCount || indirect[c].firstIndex != mesh.firstIndex || indirect[c].vertexOffset != mesh.vertexOffset ||
+                indirect[c].instanceCount != commands[c].instanceCount || indirect[c].firstInstance != commands[c].firstInstance) {
+                error("indirect command differs from its command", q, c);
+            }
+        }
+    }
+
+    void check() {
+        RenderQueue queue;
+        uint32_t draws = 0, commands = 0, batches = 0, mergedBatches = 0;
+        for (uint32_t q = 0; q < QUEUE_COUNT; ++q) {
+            const auto items = generate(256 + q * 16);
+            for (const bool mergeMaterials : { false, true }) {
+                queue.clear();
+                for (const auto& item : items) {
+                    queue.push(item);
+                }
+                queue.build(mergeMaterials);
+                checkOrder(q, queue.sortedItems());
+                checkBatches(q, queue, mergeMaterials);
+                if (mergeMaterials) {
+                    mergedBatches += static_cast<uint32_t>(queue.batches().size());
+                } else {
+                    draws += static_cast<uint32_t>(queue.size());
+                    commands += static_cast<uint32_t>(queue.commands().size());
+                    batches += static_cast<uint32_t>(queue.batches().size());
+                }
+            }
+        }
+        LOG("%u queues: %u draws in %u commands, %u batches, %u with merged materials\n", QUEUE_COUNT, draws, commands, batches, mergedBatches);
+    }
+
+    void benchmark() {
+        LOG("%8s %10s %10s %10s\n", "Draws", "Commands", "Batches", "us/build");
+        RenderQueue queue;
+        for (uint32_t count = 1024; count <= 65536; count *= 4) {
+            const auto items = generate(count);
+            uint32_t runs = 0;
+            auto tStart = std::chrono::high_resolution_clock::now();
+            double seconds = 0.0;
+            do {
+                queue.clear();
+                for (const auto& item : items) {
+                    queue.push(item);
+                }
+                queue.build();
+                ++runs;
+                seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+            } while (seconds < MIN_SECONDS);
+            LOG("%8u %10u %10u %10.1f\n", count, static_cast<uint32_t>(queue.commands().size()), static_cast<uint32_t>(queue.batches().size()),
+                seconds * 1e6 / runs);
+        }
+    }
+
+    uint32_t run() {
+        check();
+        benchmark();
+        return finish();
+    }
+};
+
+RUN_CHECK(RenderQueueCheck)
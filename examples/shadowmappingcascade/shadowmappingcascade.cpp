@@ -13,11 +13,16 @@
     This results in a better shadow map resolution distribution that can be tweaked even further by increasing
     the number of frustum splits.
 
-    A further optimization could be done using a geometry shader to do a single-pass render for the depth map
-    cascades instead of multiple passes (geometry shaders are not supported on all target devices).
+    The cascades are snapped to the shadow map texels (see vkx::ShadowCascades), so they only move when the camera
+    crosses a grid line or the light turns.  The depth of the static casters is kept in a second layered image and
+    only re-rendered for cascades that moved.  Every frame the cached layers are copied into the sampled shadow map
+    and the moving casters are drawn on top.  Each caster is culled against every cascade and only drawn into the
+    ones it can shadow.  With geometry shaders all cascades are rendered in a single layered pass, the geometry
+    shader sends each triangle to the layers of the caster's cascade mask.  Otherwise each cascade gets a pass.
 */
 
 #include <vulkanExampleBase.h>
+#include <shadowcascades.hpp>
 
 #if defined(__ANDROID__)
 #define SHADOWMAP_DIM 2048
@@ -25,22 +30,29 @@
 #define SHADOWMAP_DIM 4096
 #endif
 
+// Must match the define in the shaders
 #define SHADOW_MAP_CASCADE_COUNT 4
 
+// Trees moving around the scene, their shadows are never cached
+#define DYNAMIC_TREE_COUNT 2
+
 class VulkanExample : public vkx::ExampleBase {
 public:
     bool displayDepthMap = false;
     int32_t displayDepthMapCascadeIndex = 0;
     bool colorCascades = false;
     bool filterPCF = false;
-
-    float cascadeSplitLambda = 0.95f;
+    bool animateLight = true;
+    bool cacheStaticDepth = true;
+    int32_t snapTexels = 64;
 
     float zNear = 0.5f;
     float zFar = 48.0f;
 
     glm::vec3 lightPos = glm::vec3();
 
+    vkx::ShadowCascades shadowCascades{ SHADOW_MAP_CASCADE_COUNT, SHADOWMAP_DIM };
+
     // Vertex layout for the models
     vks::model::VertexLayout vertexLayout = vks::model::VertexLayout({
         vks::model::VERTEX_COMPONENT_POSITION,
@@ -57,6 +69,18 @@ public:
     };
     std::vector<Material> materials;
 
+    // Draw of a model at a position, read by the shaders from the object buffer
+    struct SceneObject {
+        uint32_t model;
+        uint32_t material;
+        glm::vec3 position;
+        bool dynamic;
+        // Cascades the object can cast a shadow into
+        uint32_t cascadeMask;
+    };
+    std::vector<SceneObject> objects;
+    vks::Buffer objectBuffer;
+
     struct uniformBuffers {
         vks::Buffer VS;
         vks::Buffer FS;
@@ -93,51 +117,79 @@ public:
 
     // For simplicity all pipelines use the same push constant block layout
     struct PushConstBlock {
-        glm::vec4 position;
+        uint32_t objectIndex;
         uint32_t cascadeIndex;
+        // Layers the layered depth pass renders the object into
+        uint32_t cascadeMask;
     };
 
     // Resources of the depth map generation pass
     struct DepthPass {
         vk::RenderPass renderPass;
-        vk::CommandBuffer commandBuffer;
         vk::Semaphore semaphore;
         vk::PipelineLayout pipelineLayout;
         vk::Pipeline pipeline;
-        vks::Buffer uniformBuffer;
+        vk::Format format;
+        // All cascades in one pass through a geometry shader
+        bool layered{ false };
+        vk::ShaderStageFlags stages;
+        // Cascades that got dynamic casters in the last recorded frame
+        uint32_t dynamicMask{ 0 };
 
         struct UniformBlock {
             std::array<glm::mat4, SHADOW_MAP_CASCADE_COUNT> cascadeViewProjMat;
         } ubo;
 
+        // The commands are recorded every frame, so each swap chain image gets its own copy of everything they use
+        struct Frame {
+            vk::CommandBuffer commandBuffer;
+            vk::Fence fence;
+            vks::Buffer uniformBuffer;
+            vk::DescriptorSet descriptorSet;
+        };
+        std::vector<Frame> frames;
+
         void destroy(const vk::Device& device) {
             device.destroy(renderPass);
             device.destroy(semaphore);
             device.destroy(pipelineLayout);
             device.destroy(pipeline);
-            uniformBuffer.destroy();
+            for (auto& frame : frames) {
+                device.destroy(frame.fence);
+                frame.uniformBuffer.destroy();
+            }
         }
     } depthPass;
 
-    // Layered depth image containing the shadow cascade depths
-    using DepthImage = vks::Image;
-    DepthImage depth;
-
-    // Contains all resources required for a single shadow map cascade
-    struct Cascade {
-        vk::Framebuffer frameBuffer;
-        vk::DescriptorSet descriptorSet;
-        vk::ImageView view;
-
-        float splitDepth;
-        glm::mat4 viewProjMatrix;
+    // Layered depth image with one shadow map cascade per layer, and the framebuffers rendering into it.  A single
+    // framebuffer over all layers for the layered pass, one per layer otherwise.
+    struct ShadowMap {
+        vks::Image image;
+        std::vector<vk::ImageView> layerViews;
+        std::vector<vk::Framebuffer> framebuffers;
 
         void destroy(const vk::Device& device) {
-            device.destroy(view);
-            device.destroy(frameBuffer);
+            for (auto framebuffer : framebuffers) {
+                device.destroy(framebuffer);
+            }
+            for (auto view : layerViews) {
+                device.destroy(view);
+            }
+            image.destroy();
         }
     };
-    std::array<Cascade, SHADOW_MAP_CASCADE_COUNT> cascades;
+    // Depth of the static casters, kept in the transfer source layout between frames
+    ShadowMap staticDepth;
+    // Cached static depth with the dynamic casters on top, sampled by the scene
+    ShadowMap depth;
+
+    // Work of the last recorded depth pass
+    struct Statistics {
+        uint32_t staticCascades{ 0 };
+        uint32_t staticDraws{ 0 };
+        uint32_t dynamicDraws{ 0 };
+        std::array<uint32_t, SHADOW_MAP_CASCADE_COUNT> casters;
+    } statistics;
 
     VulkanExample() {
         title = "Cascaded shadow mapping";
@@ -152,10 +204,8 @@ public:
     }
 
     ~VulkanExample() {
-        for (auto cascade : cascades) {
-            cascade.destroy(device);
-        }
-        depth.destroy();
+        depth.destroy(device);
+        staticDepth.destroy(device);
 
         device.destroy(pipelines.debugShadowMap);
         device.destroy(pipelines.sceneShadow);
@@ -175,8 +225,11 @@ public:
 
         uniformBuffers.VS.destroy();
         uniformBuffers.FS.destroy();
+        objectBuffer.destroy();
 
-        device.freeCommandBuffers(cmdPool, depthPass.commandBuffer);
+        for (const auto& frame : depthPass.frames) {
+            device.freeCommandBuffers(cmdPool, frame.commandBuffer);
+        }
         depthPass.destroy(device);
     }
 
@@ -184,75 +237,194 @@ public:
         context.enabledFeatures.samplerAnisotropy = context.deviceFeatures.samplerAnisotropy;
         // Depth clamp to avoid near plane clipping
         context.enabledFeatures.depthClamp = context.deviceFeatures.depthClamp;
+        // Layered rendering of all cascades in a single pass
+        context.enabledFeatures.geometryShader = context.deviceFeatures.geometryShader;
+    }
+
+    void bindObject(const vk::CommandBuffer& commandBuffer, const SceneObject& object) {
+        commandBuffer.bindVertexBuffers(0, models[object.model].vertices.buffer, { 0 });
+        commandBuffer.bindIndexBuffer(models[object.model].indices.buffer, 0, vk::IndexType::eUint32);
     }
 
     /*
-        Render the example scene with given command buffer, pipeline layout and dscriptor set
-        Used by the scene rendering and depth pass generation command buffer
+        Render the example scene with given command buffer
+        The positions are read from the object buffer, so the command buffers stay valid while objects move
     */
-    void renderScene(const vk::CommandBuffer& commandBuffer,
-                     const vk::PipelineLayout& pipelineLayout,
-                     const vk::DescriptorSet& descriptorSet,
-                     uint32_t cascadeIndex = 0) {
-        const vk::DeviceSize offsets[1] = { 0 };
-        PushConstBlock pushConstBlock = { glm::vec4(0.0f), cascadeIndex };
-
+    void renderScene(const vk::CommandBuffer& commandBuffer) {
         std::array<vk::DescriptorSet, 2> sets;
         sets[0] = descriptorSet;
-
-        // Floor
-        sets[1] = materials[0].descriptorSet;
-        commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, sets, nullptr);
-        commandBuffer.pushConstants<PushConstBlock>(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, pushConstBlock);
-        commandBuffer.bindVertexBuffers(0, models[0].vertices.buffer, { 0 });
-        commandBuffer.bindIndexBuffer(models[0].indices.buffer, 0, vk::IndexType::eUint32);
-        commandBuffer.drawIndexed(models[0].indexCount, 1, 0, 0, 0);
-
-        // Trees
-        const std::vector<glm::vec3> positions = {
-            glm::vec3(0.0f, 0.0f, 0.0f),    glm::vec3(1.25f, 0.25f, 1.25f),    glm::vec3(-1.25f, -0.2f, 1.25f),
-            glm::vec3(1.25f, 0.1f, -1.25f), glm::vec3(-1.25f, -0.25f, -1.25f),
-        };
-
-        for (auto position : positions) {
-            pushConstBlock.position = glm::vec4(position, 0.0f);
+        PushConstBlock pushConstBlock = {};
+        for (uint32_t i = 0; i < static_cast<uint32_t>(objects.size()); i++) {
+            const auto& object = objects[i];
+            pushConstBlock.objectIndex = i;
+            sets[1] = materials[object.material].descriptorSet;
+            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, sets, nullptr);
             commandBuffer.pushConstants<PushConstBlock>(pipelineLayout, vk::ShaderStageFlagBits::eVertex, 0, pushConstBlock);
+            bindObject(commandBuffer, object);
+            commandBuffer.drawIndexed(models[object.model].indexCount, 1, 0, 0, 0);
+        }
+    }
 
-            sets[1] = materials[1].descriptorSet;
-            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, sets, nullptr);
-            commandBuffer.bindVertexBuffers(0, models[1].vertices.buffer, { 0 });
-            commandBuffer.bindIndexBuffer(models[1].indices.buffer, 0, vk::IndexType::eUint32);
-            commandBuffer.drawIndexed(models[1].indexCount, 1, 0, 0, 0);
+    /*
+        Render the static or the dynamic casters into the cascades of `cascadeMask`, optionally clearing them first
+        Each object is only drawn into the cascades it was found to intersect
+    */
+    void renderCasters(const vk::CommandBuffer& commandBuffer,
+                       const DepthPass::Frame& frame,
+                       const ShadowMap& target,
+                       uint32_t cascadeMask,
+                       bool dynamic,
+                       bool clear) {
+        const vk::Rect2D renderArea{ {}, { SHADOWMAP_DIM, SHADOWMAP_DIM } };
+        vk::RenderPassBeginInfo renderPassBeginInfo{ depthPass.renderPass, nullptr, renderArea };
+        vk::ClearValue clearValue;
+        clearValue.depthStencil = defaultClearDepth;
+        const vk::ClearAttachment clearAttachment{ vk::ImageAspectFlagBits::eDepth, 0, clearValue };
 
-            sets[1] = materials[2].descriptorSet;
-            commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, sets, nullptr);
-            commandBuffer.bindVertexBuffers(0, models[2].vertices.buffer, { 0 });
-            commandBuffer.bindIndexBuffer(models[2].indices.buffer, 0, vk::IndexType::eUint32);
-            commandBuffer.drawIndexed(models[2].indexCount, 1, 0, 0, 0);
+        std::array<vk::DescriptorSet, 2> sets;
+        sets[0] = frame.descriptorSet;
+        uint32_t& draws = dynamic ? statistics.dynamicDraws : statistics.staticDraws;
+
+        const uint32_t passCount = depthPass.layered ? 1 : SHADOW_MAP_CASCADE_COUNT;
+        for (uint32_t pass = 0; pass < passCount; pass++) {
+            const uint32_t passMask = depthPass.layered ? cascadeMask : cascadeMask & (1u << pass);
+            if (!passMask) {
+                continue;
+            }
+            renderPassBeginInfo.framebuffer = target.framebuffers[pass];
+            commandBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
+            if (clear) {
+                // The render pass loads the attachment, so cascades that are still cached keep their depth
+                std::vector<vk::ClearRect> clearRects;
+                for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
+                    if (passMask & (1u << i)) {
+                        clearRects.push_back({ renderArea, depthPass.layered ? i : 0, 1 });
+                    }
+                }
+                commandBuffer.clearAttachments(clearAttachment, clearRects);
+            }
+            for (uint32_t i = 0; i < static_cast<uint32_t>(objects.size()); i++) {
+                const auto& object = objects[i];
+                const PushConstBlock pushConstBlock = { i, pass, object.cascadeMask & passMask };
+                if (object.dynamic != dynamic || !pushConstBlock.cascadeMask) {
+                    continue;
+                }
+                sets[1] = materials[object.material].descriptorSet;
+                commandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, depthPass.pipelineLayout, 0, sets, nullptr);
+                commandBuffer.pushConstants<PushConstBlock>(depthPass.pipelineLayout, depthPass.stages, 0, pushConstBlock);
+                bindObject(commandBuffer, object);
+                commandBuffer.drawIndexed(models[object.model].indexCount, 1, 0, 0, 0);
+                draws++;
+            }
+            commandBuffer.endRenderPass();
         }
     }
 
+    // Layout transition of all cascades of a shadow map
+    void transition(const vk::CommandBuffer& commandBuffer,
+                    const ShadowMap& target,
+                    vk::ImageLayout oldLayout,
+                    vk::ImageLayout newLayout,
+                    vk::PipelineStageFlags srcStageMask,
+                    vk::AccessFlags srcAccessMask,
+                    vk::PipelineStageFlags dstStageMask,
+                    vk::AccessFlags dstAccessMask) {
+        vk::ImageMemoryBarrier barrier;
+        barrier.srcAccessMask = srcAccessMask;
+        barrier.dstAccessMask = dstAccessMask;
+        barrier.oldLayout = oldLayout;
+        barrier.newLayout = newLayout;
+        barrier.image = target.image.image;
+        barrier.subresourceRange = { vk::ImageAspectFlagBits::eDepth, 0, 1, 0, SHADOW_MAP_CASCADE_COUNT };
+        commandBuffer.pipelineBarrier(srcStageMask, dstStageMask, {}, nullptr, nullptr, barrier);
+    }
+
     /*
         Setup resources used by the depth pass
-        The depth image is layered with each layer storing one shadow map cascade
+        Both depth images are layered with each layer storing one shadow map cascade
     */
+    void createShadowMap(ShadowMap& target, const vk::ImageUsageFlags& usage) {
+        vk::ImageCreateInfo imageInfo;
+        imageInfo.imageType = vk::ImageType::e2D;
+        imageInfo.extent.width = SHADOWMAP_DIM;
+        imageInfo.extent.height = SHADOWMAP_DIM;
+        imageInfo.extent.depth = 1;
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = SHADOW_MAP_CASCADE_COUNT;
+        imageInfo.format = depthPass.format;
+        imageInfo.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | usage;
+        target.image = context.createImage(imageInfo);
+
+        // Full depth map view (all layers)
+        vk::ImageViewCreateInfo viewInfo;
+        viewInfo.viewType = vk::ImageViewType::e2DArray;
+        viewInfo.format = depthPass.format;
+        viewInfo.subresourceRange = { vk::ImageAspectFlagBits::eDepth, 0, 1, 0, SHADOW_MAP_CASCADE_COUNT };
+        viewInfo.image = target.image.image;
+        target.image.view = device.createImageView(viewInfo);
+
+        vk::FramebufferCreateInfo framebufferInfo;
+        framebufferInfo.renderPass = depthPass.renderPass;
+        framebufferInfo.attachmentCount = 1;
+        framebufferInfo.width = SHADOWMAP_DIM;
+        framebufferInfo.height = SHADOWMAP_DIM;
+
+        if (depthPass.layered) {
+            // The geometry shader selects the layer
+            framebufferInfo.pAttachments = &target.image.view;
+            framebufferInfo.layers = SHADOW_MAP_CASCADE_COUNT;
+            target.framebuffers.push_back(device.createFramebuffer(framebufferInfo));
+            return;
+        }
+
+        // One image view and framebuffer per cascade
+        viewInfo.subresourceRange.layerCount = 1;
+        framebufferInfo.layers = 1;
+        for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
+            viewInfo.subresourceRange.baseArrayLayer = i;
+            target.layerViews.push_back(device.createImageView(viewInfo));
+            framebufferInfo.pAttachments = &target.layerViews.back();
+            target.framebuffers.push_back(device.createFramebuffer(framebufferInfo));
+        }
+    }
+
     void prepareDepthPass() {
-        auto depthFormat = context.getSupportedDepthFormat();
-        vk::CommandBufferAllocateInfo allocInfo;
-        depthPass.commandBuffer = context.allocateCommandBuffers(1)[0];
-        depthPass.semaphore = device.createSemaphore(vk::SemaphoreCreateInfo{});
+        depthPass.layered = context.enabledFeatures.geometryShader;
+        depthPass.stages = vk::ShaderStageFlagBits::eVertex;
+        if (depthPass.layered) {
+            depthPass.stages |= vk::ShaderStageFlagBits::eGeometry;
+        }
+        // No stencil, so copies between the depth images only move the depth
+        depthPass.format = vk::Format::eD16Unorm;
+        const vk::FormatProperties formatProperties = context.physicalDevice.getFormatProperties(vk::Format::eD32Sfloat);
+        const vk::FormatFeatureFlags formatFeatures = vk::FormatFeatureFlagBits::eDepthStencilAttachment | vk::FormatFeatureFlagBits::eSampledImage;
+        if ((formatProperties.optimalTilingFeatures & formatFeatures) == formatFeatures) {
+            depthPass.format = vk::Format::eD32Sfloat;
+        }
         // Create a semaphore used to synchronize depth map generation and use
+        depthPass.semaphore = device.createSemaphore(vk::SemaphoreCreateInfo{});
+
+        const auto commandBuffers = context.allocateCommandBuffers(swapChain.imageCount);
+        depthPass.frames.resize(swapChain.imageCount);
+        for (uint32_t i = 0; i < swapChain.imageCount; i++) {
+            depthPass.frames[i].commandBuffer = commandBuffers[i];
+            depthPass.frames[i].fence = device.createFence({ vk::FenceCreateFlagBits::eSignaled });
+        }
 
         /*
             Depth map renderpass
+            Loads and stores the cascades, clearing is done per cascade inside the pass and the layouts are changed
+            with barriers outside of it
         */
 
         vk::AttachmentDescription attachmentDescription;
-        attachmentDescription.format = depthFormat;
-        attachmentDescription.loadOp = vk::AttachmentLoadOp::eClear;
+        attachmentDescription.format = depthPass.format;
+        attachmentDescription.loadOp = vk::AttachmentLoadOp::eLoad;
+        attachmentDescription.storeOp = vk::AttachmentStoreOp::eStore;
         attachmentDescription.stencilLoadOp = vk::AttachmentLoadOp::eDontCare;
         attachmentDescription.stencilStoreOp = vk::AttachmentStoreOp::eDontCare;
-        attachmentDescription.finalLayout = vk::ImageLayout::eDepthStencilReadOnlyOptimal;
+        attachmentDescription.initialLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
+        attachmentDescription.finalLayout = vk::ImageLayout::eDepthStencilAttachmentOptimal;
 
         vk::AttachmentReference depthReference;
         depthReference.attachment = 0;
@@ -263,77 +435,26 @@ public:
         subpass.colorAttachmentCount = 0;
         subpass.pDepthStencilAttachment = &depthReference;
 
-        // Use subpass dependencies for layout transitions
-        std::array<vk::SubpassDependency, 2> dependencies;
-
-        dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
-        dependencies[0].dstSubpass = 0;
-        dependencies[0].srcStageMask = vk::PipelineStageFlagBits::eBottomOfPipe;
-        dependencies[0].dstStageMask = vk::PipelineStageFlagBits::eLateFragmentTests;
-        dependencies[0].srcAccessMask = vk::AccessFlagBits::eShaderRead;
-        dependencies[0].dstAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-        dependencies[0].dependencyFlags = vk::DependencyFlagBits::eByRegion;
-
-        dependencies[1].srcSubpass = 0;
-        dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
-        dependencies[1].srcStageMask = vk::PipelineStageFlagBits::eLateFragmentTests;
-        dependencies[1].dstStageMask = vk::PipelineStageFlagBits::eFragmentShader;
-        dependencies[1].srcAccessMask = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
-        dependencies[1].dstAccessMask = vk::AccessFlagBits::eShaderRead;
-        dependencies[1].dependencyFlags = vk::DependencyFlagBits::eByRegion;
-
         vk::RenderPassCreateInfo renderPassCreateInfo;
         renderPassCreateInfo.attachmentCount = 1;
         renderPassCreateInfo.pAttachments = &attachmentDescription;
         renderPassCreateInfo.subpassCount = 1;
         renderPassCreateInfo.pSubpasses = &subpass;
-        renderPassCreateInfo.dependencyCount = static_cast<uint32_t>(dependencies.size());
-        renderPassCreateInfo.pDependencies = dependencies.data();
 
         depthPass.renderPass = device.createRenderPass(renderPassCreateInfo);
 
         /*
-            Layered depth image and views
+            Layered depth images
         */
 
-        vk::ImageCreateInfo imageInfo;
-        imageInfo.imageType = vk::ImageType::e2D;
-        imageInfo.extent.width = SHADOWMAP_DIM;
-        imageInfo.extent.height = SHADOWMAP_DIM;
-        imageInfo.extent.depth = 1;
-        imageInfo.mipLevels = 1;
-        imageInfo.arrayLayers = SHADOW_MAP_CASCADE_COUNT;
-        imageInfo.format = depthFormat;
-        imageInfo.usage = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled;
-        depth = context.createImage(imageInfo);
-
-        // Full depth map view (all layers)
-        vk::ImageViewCreateInfo viewInfo;
-        viewInfo.viewType = vk::ImageViewType::e2DArray;
-        viewInfo.format = depthFormat;
-        viewInfo.subresourceRange = { vk::ImageAspectFlagBits::eDepth, 0, 1, 0, SHADOW_MAP_CASCADE_COUNT };
-        viewInfo.image = depth.image;
-        depth.view = device.createImageView(viewInfo);
-
-        // One image and framebuffer per cascade
-        viewInfo.subresourceRange.layerCount = 1;
-
-        vk::FramebufferCreateInfo framebufferInfo;
-        framebufferInfo.renderPass = depthPass.renderPass;
-        framebufferInfo.attachmentCount = 1;
-        framebufferInfo.width = SHADOWMAP_DIM;
-        framebufferInfo.height = SHADOWMAP_DIM;
-        framebufferInfo.layers = 1;
-
-        for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
-            // Image view for this cascade's layer (inside the depth map)
-            // This view is used to render to that specific depth image layer
-            viewInfo.subresourceRange.baseArrayLayer = i;
-            cascades[i].view = device.createImageView(viewInfo);
-            // Framebuffer
-            framebufferInfo.pAttachments = &cascades[i].view;
-            cascades[i].frameBuffer = device.createFramebuffer(framebufferInfo);
-        }
+        createShadowMap(staticDepth, vk::ImageUsageFlagBits::eTransferSrc);
+        createShadowMap(depth, vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst);
+        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) {
+            transition(commandBuffer, staticDepth, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferSrcOptimal, vk::PipelineStageFlagBits::eTopOfPipe,
+                       {}, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead);
+            transition(commandBuffer, depth, vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilReadOnlyOptimal, vk::PipelineStageFlagBits::eTopOfPipe,
+                       {}, vk::PipelineStageFlagBits::eFragmentShader, vk::AccessFlagBits::eShaderRead);
+        });
 
         // Shared sampler for cascade deoth reads
         vk::SamplerCreateInfo sampler;
@@ -348,56 +469,90 @@ public:
         sampler.minLod = 0.0f;
         sampler.maxLod = 1.0f;
         sampler.borderColor = vk::BorderColor::eFloatOpaqueWhite;
-        depth.sampler = device.createSampler(sampler);
+        depth.image.sampler = device.createSampler(sampler);
     }
 
     /*
-        Build the command buffer for rendering the depth map cascades
-        Uses multiple passes with each pass rendering the scene to the cascade's depth image layer
-        Could be optimized using a geometry shader (and layered frame buffer) on devices that support geometry shaders
+        Record the depth map generation of this frame
+        Cascades whose matrix changed get the static casters re-rendered into the cache.  The cached layers are
+        copied into the sampled shadow map wherever dynamic casters were drawn last frame or are drawn now, and
+        the dynamic casters go on top.  A frame in which nothing moved records no work at all.
     */
-    void buildDepthPassCommandBuffer() {
-        depthPass.commandBuffer.begin({ vk::CommandBufferUsageFlagBits::eSimultaneousUse });
-        vk::Viewport viewport;
-        viewport.width = (float)SHADOWMAP_DIM;
-        viewport.height = (float)SHADOWMAP_DIM;
-        viewport.minDepth = 0;
-        viewport.maxDepth = 1;
-        depthPass.commandBuffer.setViewport(0, viewport);
-
-        vk::Rect2D scissor;
-        scissor.extent = vk::Extent2D{ SHADOWMAP_DIM, SHADOWMAP_DIM };
-        depthPass.commandBuffer.setScissor(0, scissor);
+    void buildDepthPassCommandBuffer(const DepthPass::Frame& frame) {
+        const vk::CommandBuffer& commandBuffer = frame.commandBuffer;
+        commandBuffer.begin({ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+        commandBuffer.setViewport(0, vk::Viewport{ 0, 0, (float)SHADOWMAP_DIM, (float)SHADOWMAP_DIM, 0, 1 });
+        commandBuffer.setScissor(0, vk::Rect2D{ {}, { SHADOWMAP_DIM, SHADOWMAP_DIM } });
+        commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, depthPass.pipeline);
+
+        const vk::PipelineStageFlags fragmentTests = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+        const vk::AccessFlags attachmentAccess = vk::AccessFlagBits::eDepthStencilAttachmentRead | vk::AccessFlagBits::eDepthStencilAttachmentWrite;
+
+        if (!cacheStaticDepth) {
+            shadowCascades.invalidate();
+        }
+        const uint32_t staleMask = shadowCascades.staleMask();
+        uint32_t dynamicMask = 0;
+        for (const auto& object : objects) {
+            if (object.dynamic) {
+                dynamicMask |= object.cascadeMask;
+            }
+        }
+        // Layers that held dynamic depth need the static depth back as well
+        const uint32_t refreshMask = staleMask | dynamicMask | depthPass.dynamicMask;
+        depthPass.dynamicMask = dynamicMask;
 
-        vk::ClearValue clearValue;
-        clearValue.depthStencil = defaultClearDepth;
+        statistics.staticDraws = 0;
+        statistics.dynamicDraws = 0;
+        statistics.staticCascades = 0;
+        for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
+            statistics.staticCascades += (staleMask >> i) & 1;
+        }
 
-        vk::RenderPassBeginInfo renderPassBeginInfo;
-        renderPassBeginInfo.renderPass = depthPass.renderPass;
-        renderPassBeginInfo.renderArea.extent.width = SHADOWMAP_DIM;
-        renderPassBeginInfo.renderArea.extent.height = SHADOWMAP_DIM;
-        renderPassBeginInfo.clearValueCount = 1;
-        renderPassBeginInfo.pClearValues = &clearValue;
+        if (staleMask) {
+            transition(commandBuffer, staticDepth, vk::ImageLayout::eTransferSrcOptimal, vk::ImageLayout::eDepthStencilAttachmentOptimal,
+                       vk::PipelineStageFlagBits::eTransfer, {}, fragmentTests, attachmentAccess);
+            renderCasters(commandBuffer, frame, staticDepth, staleMask, false, true);
+            transition(commandBuffer, staticDepth, vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::ImageLayout::eTransferSrcOptimal,
+                       vk::PipelineStageFlagBits::eLateFragmentTests, vk::AccessFlagBits::eDepthStencilAttachmentWrite, vk::PipelineStageFlagBits::eTransfer,
+                       vk::AccessFlagBits::eTransferRead);
+            // Later frames are submitted after this one
+            shadowCascades.markCached(staleMask);
+        }
 
-        // One pass per cascade
-        // The layer that this pass renders too is defined by the cascade's image view (selected via the cascade's decsriptor set)
-        for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
-            renderPassBeginInfo.framebuffer = cascades[i].frameBuffer;
-            depthPass.commandBuffer.beginRenderPass(renderPassBeginInfo, vk::SubpassContents::eInline);
-            depthPass.commandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, depthPass.pipeline);
-            renderScene(depthPass.commandBuffer, depthPass.pipelineLayout, cascades[i].descriptorSet, i);
-            depthPass.commandBuffer.endRenderPass();
+        if (refreshMask) {
+            transition(commandBuffer, depth, vk::ImageLayout::eDepthStencilReadOnlyOptimal, vk::ImageLayout::eTransferDstOptimal,
+                       vk::PipelineStageFlagBits::eFragmentShader, {}, vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite);
+            std::vector<vk::ImageCopy> regions;
+            for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
+                if (refreshMask & (1u << i)) {
+                    const vk::ImageSubresourceLayers layer{ vk::ImageAspectFlagBits::eDepth, 0, i, 1 };
+                    regions.push_back({ layer, {}, layer, {}, { SHADOWMAP_DIM, SHADOWMAP_DIM, 1 } });
+                }
+            }
+            commandBuffer.copyImage(staticDepth.image.image, vk::ImageLayout::eTransferSrcOptimal, depth.image.image, vk::ImageLayout::eTransferDstOptimal,
+                                    regions);
+            if (dynamicMask) {
+                transition(commandBuffer, depth, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eDepthStencilAttachmentOptimal,
+                           vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, fragmentTests, attachmentAccess);
+                renderCasters(commandBuffer, frame, depth, dynamicMask, true, false);
+                transition(commandBuffer, depth, vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+                           vk::PipelineStageFlagBits::eLateFragmentTests, vk::AccessFlagBits::eDepthStencilAttachmentWrite,
+                           vk::PipelineStageFlagBits::eFragmentShader, vk::AccessFlagBits::eShaderRead);
+            } else {
+                transition(commandBuffer, depth, vk::ImageLayout::eTransferDstOptimal, vk::ImageLayout::eDepthStencilReadOnlyOptimal,
+                           vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::PipelineStageFlagBits::eFragmentShader,
+                           vk::AccessFlagBits::eShaderRead);
+            }
         }
 
-        depthPass.commandBuffer.end();
+        commandBuffer.end();
     }
 
     void updateDrawCommandBuffer(const vk::CommandBuffer& drawCommandBuffer) override {
         drawCommandBuffer.setViewport(0, vk::Viewport{ 0, 0, (float)size.width, (float)size.height, 0, 1 });
         drawCommandBuffer.setScissor(0, vk::Rect2D{ { 0, 0 }, size });
 
-        vk::DeviceSize offsets[1] = { 0 };
-
         // Visualize shadow map cascade
         if (displayDepthMap) {
             drawCommandBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayout, 0, { descriptorSet }, nullptr);
@@ -409,7 +564,7 @@ public:
         }
         drawCommandBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, (filterPCF) ? pipelines.sceneShadowPCF : pipelines.sceneShadow);
         // Render shadowed scene
-        renderScene(drawCommandBuffer, pipelineLayout, descriptorSet);
+        renderScene(drawCommandBuffer);
     }
 
     void loadAssets() override {
@@ -424,13 +579,67 @@ public:
         models[2].loadFromFile(context, getAssetPath() + "models/oak_leafs.dae", vertexLayout, 2.0f);
     }
 
+    void prepareObjects() {
+        // Floor
+        objects.push_back({ 0, 0, glm::vec3(0.0f), false, 0 });
+
+        // Trees, trunk and leaves are culled separately
+        const std::vector<glm::vec3> positions = {
+            glm::vec3(0.0f, 0.0f, 0.0f),    glm::vec3(1.25f, 0.25f, 1.25f),    glm::vec3(-1.25f, -0.2f, 1.25f),
+            glm::vec3(1.25f, 0.1f, -1.25f), glm::vec3(-1.25f, -0.25f, -1.25f),
+        };
+        for (auto position : positions) {
+            objects.push_back({ 1, 1, position, false, 0 });
+            objects.push_back({ 2, 2, position, false, 0 });
+        }
+        for (uint32_t i = 0; i < DYNAMIC_TREE_COUNT; i++) {
+            objects.push_back({ 1, 1, glm::vec3(0.0f), true, 0 });
+            objects.push_back({ 2, 2, glm::vec3(0.0f), true, 0 });
+        }
+
+        objectBuffer = context.createBuffer(vk::BufferUsageFlagBits::eStorageBuffer,
+                                            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                            objects.size() * sizeof(glm::vec4));
+        objectBuffer.map();
+    }
+
+    /*
+        Move the dynamic trees and find the cascades each object can cast a shadow into
+    */
+    void updateObjects() {
+        // Trunk and leaves of a tree follow each other
+        uint32_t dynamicIndex = 0;
+        for (auto& object : objects) {
+            if (object.dynamic) {
+                const uint32_t tree = dynamicIndex++ / 2;
+                float angle = glm::radians(timer * 360.0f * 4.0f + tree * 360.0f / DYNAMIC_TREE_COUNT);
+                object.position = glm::vec3(cos(angle) * 2.5f, 0.0f, sin(angle) * 2.5f);
+            }
+        }
+
+        std::vector<glm::vec4> positions;
+        statistics.casters.fill(0);
+        for (auto& object : objects) {
+            const auto& dim = models[object.model].dim;
+            const glm::vec3 center = object.position + 0.5f * (dim.min + dim.max);
+            object.cascadeMask = shadowCascades.casterMask(center, 0.5f * glm::length(dim.size), context.enabledFeatures.depthClamp);
+            for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
+                statistics.casters[i] += (object.cascadeMask >> i) & 1;
+            }
+            positions.push_back(glm::vec4(object.position, 0.0f));
+        }
+        memcpy(objectBuffer.mapped, positions.data(), positions.size() * sizeof(glm::vec4));
+    }
+
     void setupLayoutsAndDescriptors() {
         // Descriptor pool
         std::vector<vk::DescriptorPoolSize> poolSizes{
             { vk::DescriptorType::eUniformBuffer, 32 },
             { vk::DescriptorType::eCombinedImageSampler, 32 },
+            { vk::DescriptorType::eStorageBuffer, 1 + swapChain.imageCount },
         };
-        descriptorPool = device.createDescriptorPool({ {}, 4 + SHADOW_MAP_CASCADE_COUNT, static_cast<uint32_t>(poolSizes.size()), poolSizes.data() });
+        descriptorPool =
+            device.createDescriptorPool({ {}, 4 + swapChain.imageCount, static_cast<uint32_t>(poolSizes.size()), poolSizes.data() });
 
         /*
             Descriptor set layouts
@@ -438,9 +647,10 @@ public:
 
         // Shared matrices and samplers
         std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
-            vk::DescriptorSetLayoutBinding{ 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
+            vk::DescriptorSetLayoutBinding{ 0, vk::DescriptorType::eUniformBuffer, 1, depthPass.stages },
             vk::DescriptorSetLayoutBinding{ 1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
             vk::DescriptorSetLayoutBinding{ 2, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eFragment },
+            vk::DescriptorSetLayoutBinding{ 3, vk::DescriptorType::eStorageBuffer, 1, vk::ShaderStageFlagBits::eVertex },
         };
         descriptorSetLayouts.base = device.createDescriptorSetLayout({ {}, static_cast<uint32_t>(setLayoutBindings.size()), setLayoutBindings.data() });
 
@@ -453,7 +663,7 @@ public:
         /*
             Descriptor sets
         */
-        vk::DescriptorImageInfo depthMapDescriptor{ depth.sampler, depth.view, vk::ImageLayout::eDepthStencilReadOnlyOptimal };
+        vk::DescriptorImageInfo depthMapDescriptor{ depth.image.sampler, depth.image.view, vk::ImageLayout::eDepthStencilReadOnlyOptimal };
         descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.base })[0];
 
         // Scene rendering / debug display
@@ -461,16 +671,13 @@ public:
             { descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.VS.descriptor },
             { descriptorSet, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &depthMapDescriptor },
             { descriptorSet, 2, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformBuffers.FS.descriptor },
+            { descriptorSet, 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &objectBuffer.descriptor },
         };
-        // Per-cascade descriptor sets
-        // Each descriptor set represents a single layer of the array texture
-        vk::DescriptorImageInfo cascadeImageInfo{ depth.sampler, depth.view, vk::ImageLayout::eDepthStencilReadOnlyOptimal };
-        for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
-            cascades[i].descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.base })[0];
-            writeDescriptorSets.push_back(
-                { cascades[i].descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &depthPass.uniformBuffer.descriptor });
-            writeDescriptorSets.push_back({ cascades[i].descriptorSet, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &cascadeImageInfo });
-            device.updateDescriptorSets(writeDescriptorSets, nullptr);
+        // Depth pass descriptor sets with the cascade matrices of each frame
+        for (auto& frame : depthPass.frames) {
+            frame.descriptorSet = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.base })[0];
+            writeDescriptorSets.push_back({ frame.descriptorSet, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &frame.uniformBuffer.descriptor });
+            writeDescriptorSets.push_back({ frame.descriptorSet, 3, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &objectBuffer.descriptor });
         }
         // Per-material descriptor sets
         for (auto& material : materials) {
@@ -484,12 +691,13 @@ public:
             Pipeline layouts
         */
 
-        vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex, 0, sizeof(PushConstBlock) };
         std::array<vk::DescriptorSetLayout, 2> setLayouts = { descriptorSetLayouts.base, descriptorSetLayouts.material };
         {
             // Shared pipeline layout (scene and depth map debug display)
+            vk::PushConstantRange pushConstantRange{ vk::ShaderStageFlagBits::eVertex, 0, sizeof(PushConstBlock) };
             pipelineLayout = device.createPipelineLayout({ {}, (uint32_t)setLayouts.size(), setLayouts.data(), 1, &pushConstantRange });
-            // Depth pass pipeline layout
+            // Depth pass pipeline layout, the geometry shader of the layered pass reads the cascade mask
+            pushConstantRange.stageFlags = depthPass.stages;
             depthPass.pipelineLayout = device.createPipelineLayout({ {}, (uint32_t)setLayouts.size(), setLayouts.data(), 1, &pushConstantRange });
         }
     }
@@ -529,11 +737,15 @@ public:
         */
         builder.loadShader(getAssetPath() + "shaders/shadowmappingcascade/depthpass.vert.spv", vk::ShaderStageFlagBits::eVertex);
         builder.loadShader(getAssetPath() + "shaders/shadowmappingcascade/depthpass.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        if (depthPass.layered) {
+            // Sends each triangle to the layers of the cascades the caster intersects
+            builder.loadShader(getAssetPath() + "shaders/shadowmappingcascade/depthpass.geom.spv", vk::ShaderStageFlagBits::eGeometry);
+        }
         // No blend attachment states (no color attachments used)
         builder.colorBlendState.blendAttachmentStates.clear();
         builder.depthStencilState.depthCompareOp = vk::CompareOp::eLessOrEqual;
         // Enable depth clamp (if available)
-        builder.rasterizationState.depthClampEnable = context.deviceFeatures.depthClamp;
+        builder.rasterizationState.depthClampEnable = context.enabledFeatures.depthClamp;
         builder.layout = depthPass.pipelineLayout;
         builder.renderPass = depthPass.renderPass;
         depthPass.pipeline = builder.create(context.pipelineCache);
@@ -541,92 +753,26 @@ public:
 
     void prepareUniformBuffers() {
         // Shadow map generation buffer blocks
-        depthPass.uniformBuffer = context.createUniformBuffer(depthPass.ubo);
+        for (auto& frame : depthPass.frames) {
+            frame.uniformBuffer = context.createUniformBuffer(depthPass.ubo);
+        }
         // Scene uniform buffer blocks
         uniformBuffers.VS = context.createUniformBuffer(uboVS);
         uniformBuffers.FS = context.createUniformBuffer(uboFS);
 
         updateLight();
+        updateCascades();
         updateUniformBuffers();
     }
 
     /*
         Calculate frustum split depths and matrices for the shadow map cascades
-        Based on https://johanmedestrom.wordpress.com/2016/03/18/opengl-cascaded-shadow-maps/
+        The matrices only change when the camera crosses the snapping grid of a cascade, see vkx::ShadowCascades
     */
     void updateCascades() {
-        float cascadeSplits[SHADOW_MAP_CASCADE_COUNT];
-
-        float nearClip = camera.getNearClip();
-        float farClip = camera.getFarClip();
-        float clipRange = farClip - nearClip;
-
-        float minZ = nearClip;
-        float maxZ = nearClip + clipRange;
-
-        float range = maxZ - minZ;
-        float ratio = maxZ / minZ;
-
-        // Calculate split depths based on view camera furstum
-        // Based on method presentd in https://developer.nvidia.com/gpugems/GPUGems3/gpugems3_ch10.html
-        for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
-            float p = (i + 1) / static_cast<float>(SHADOW_MAP_CASCADE_COUNT);
-            float log = minZ * std::pow(ratio, p);
-            float uniform = minZ + range * p;
-            float d = cascadeSplitLambda * (log - uniform) + uniform;
-            cascadeSplits[i] = (d - nearClip) / clipRange;
-        }
-
-        // Calculate orthographic projection matrix for each cascade
-        float lastSplitDist = 0.0;
-        for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
-            float splitDist = cascadeSplits[i];
-
-            glm::vec3 frustumCorners[8] = {
-                glm::vec3(-1.0f, 1.0f, -1.0f), glm::vec3(1.0f, 1.0f, -1.0f), glm::vec3(1.0f, -1.0f, -1.0f), glm::vec3(-1.0f, -1.0f, -1.0f),
-                glm::vec3(-1.0f, 1.0f, 1.0f),  glm::vec3(1.0f, 1.0f, 1.0f),  glm::vec3(1.0f, -1.0f, 1.0f),  glm::vec3(-1.0f, -1.0f, 1.0f),
-            };
-
-            // Project frustum corners into world space
-            glm::mat4 invCam = glm::inverse(camera.matrices.perspective * camera.matrices.view);
-            for (uint32_t i = 0; i < 8; i++) {
-                glm::vec4 invCorner = invCam * glm::vec4(frustumCorners[i], 1.0f);
-                frustumCorners[i] = invCorner / invCorner.w;
-            }
-
-            for (uint32_t i = 0; i < 4; i++) {
-                glm::vec3 dist = frustumCorners[i + 4] - frustumCorners[i];
-                frustumCorners[i + 4] = frustumCorners[i] + (dist * splitDist);
-                frustumCorners[i] = frustumCorners[i] + (dist * lastSplitDist);
-            }
-
-            // Get frustum center
-            glm::vec3 frustumCenter = glm::vec3(0.0f);
-            for (uint32_t i = 0; i < 8; i++) {
-                frustumCenter += frustumCorners[i];
-            }
-            frustumCenter /= 8.0f;
-
-            float radius = 0.0f;
-            for (uint32_t i = 0; i < 8; i++) {
-                float distance = glm::length(frustumCorners[i] - frustumCenter);
-                radius = glm::max(radius, distance);
-            }
-            radius = std::ceil(radius * 16.0f) / 16.0f;
-
-            glm::vec3 maxExtents = glm::vec3(radius);
-            glm::vec3 minExtents = -maxExtents;
-
-            glm::vec3 lightDir = normalize(-lightPos);
-            glm::mat4 lightViewMatrix = glm::lookAt(frustumCenter - lightDir * -minExtents.z, frustumCenter, glm::vec3(0.0f, 1.0f, 0.0f));
-            glm::mat4 lightOrthoMatrix = glm::ortho(minExtents.x, maxExtents.x, minExtents.y, maxExtents.y, 0.0f, maxExtents.z - minExtents.z);
-
-            // Store split distance and matrix in cascade
-            cascades[i].splitDepth = (camera.getNearClip() + splitDist * clipRange) * -1.0f;
-            cascades[i].viewProjMatrix = lightOrthoMatrix * lightViewMatrix;
-
-            lastSplitDist = cascadeSplits[i];
-        }
+        shadowCascades.snapTexels = snapTexels;
+        shadowCascades.update(camera.matrices.perspective, camera.matrices.view, camera.getNearClip(), camera.getFarClip(), normalize(-lightPos));
+        updateObjects();
     }
 
     void updateLight() {
@@ -637,12 +783,11 @@ public:
 
     void updateUniformBuffers() {
         /*
-            Depth rendering
+            Depth rendering, copied to the buffer of a frame when its commands are recorded
         */
         for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
-            depthPass.ubo.cascadeViewProjMat[i] = cascades[i].viewProjMatrix;
+            depthPass.ubo.cascadeViewProjMat[i] = shadowCascades[i].viewProjection;
         }
-        memcpy(depthPass.uniformBuffer.mapped, &depthPass.ubo, sizeof(depthPass.ubo));
 
         /*
             Scene rendering
@@ -654,8 +799,8 @@ public:
         memcpy(uniformBuffers.VS.mapped, &uboVS, sizeof(uboVS));
 
         for (uint32_t i = 0; i < SHADOW_MAP_CASCADE_COUNT; i++) {
-            uboFS.cascadeSplits[i] = cascades[i].splitDepth;
-            uboFS.cascadeViewProjMat[i] = cascades[i].viewProjMatrix;
+            uboFS.cascadeSplits[i] = shadowCascades[i].splitDepth;
+            uboFS.cascadeViewProjMat[i] = shadowCascades[i].viewProjection;
         }
         uboFS.inverseViewMat = glm::inverse(camera.matrices.view);
         uboFS.lightDir = normalize(-lightPos);
@@ -668,6 +813,13 @@ public:
 
         // Depth map generation
         {
+            auto& frame = depthPass.frames[currentBuffer % depthPass.frames.size()];
+            // The commands and the matrices were last used for the same swap chain image
+            device.waitForFences(frame.fence, VK_TRUE, UINT64_MAX);
+            device.resetFences(frame.fence);
+            frame.uniformBuffer.copy(depthPass.ubo);
+            buildDepthPassCommandBuffer(frame);
+
             vk::SubmitInfo submitInfo;
             vk::PipelineStageFlags stageFlags = vk::PipelineStageFlagBits::eBottomOfPipe;
             submitInfo.pWaitDstStageMask = &stageFlags;
@@ -676,8 +828,8 @@ public:
             submitInfo.signalSemaphoreCount = 1;
             submitInfo.pSignalSemaphores = &depthPass.semaphore;
             submitInfo.commandBufferCount = 1;
-            submitInfo.pCommandBuffers = &depthPass.commandBuffer;
-            queue.submit(submitInfo, nullptr);
+            submitInfo.pCommandBuffers = &frame.commandBuffer;
+            queue.submit(submitInfo, frame.fence);
         }
 
         // Scene rendering
@@ -689,13 +841,12 @@ public:
     void prepare() override {
         ExampleBase::prepare();
         updateLight();
-        updateCascades();
         prepareDepthPass();
+        prepareObjects();
         prepareUniformBuffers();
         setupLayoutsAndDescriptors();
         preparePipelines();
         buildCommandBuffers();
-        buildDepthPassCommandBuffer();
         prepared = true;
     }
 
@@ -704,7 +855,9 @@ public:
             return;
         draw();
         if (!paused) {
-            updateLight();
+            if (animateLight) {
+                updateLight();
+            }
             updateCascades();
             updateUniformBuffers();
         }
@@ -717,10 +870,16 @@ public:
 
     void OnUpdateUIOverlay() override {
         if (ui.header("Settings")) {
-            if (ui.sliderFloat("Split lambda", &cascadeSplitLambda, 0.1f, 1.0f)) {
+            if (ui.sliderFloat("Split lambda", &shadowCascades.splitLambda, 0.1f, 1.0f)) {
                 updateCascades();
                 updateUniformBuffers();
             }
+            if (ui.sliderInt("Cascade snap (texels)", &snapTexels, 1, 256)) {
+                updateCascades();
+                updateUniformBuffers();
+            }
+            ui.checkBox("Animate light", &animateLight);
+            ui.checkBox("Cache static depth", &cacheStaticDepth);
             if (ui.checkBox("Color cascades", &colorCascades)) {
                 updateUniformBuffers();
             }
@@ -736,6 +895,12 @@ public:
                 buildCommandBuffers();
             }
         }
+        if (ui.header("Shadow pass")) {
+            ui.text(depthPass.layered ? "Layered, one pass" : "One pass per cascade");
+            ui.text("Casters per cascade: %d %d %d %d", statistics.casters[0], statistics.casters[1], statistics.casters[2], statistics.casters[3]);
+            ui.text("Static cascades redrawn: %d", statistics.staticCascades);
+            ui.text("Draws: %d static, %d dynamic", statistics.staticDraws, statistics.dynamicDraws);
+        }
     }
 };
 
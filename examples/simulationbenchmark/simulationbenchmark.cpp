@@ -0,0 +1,134 @@
+/*
+* Vulkan Example - CPU benchmark of the compute example simulations
+*
+* Runs the CPU implementations of the computenbody, computeparticles and computecloth kernels with every
+* available instruction set, single threaded and on all cores, and reports the interactions per second.
+* Needs no GPU.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <common.hpp>
+#include <attractor.hpp>
+#include <cloth.hpp>
+#include <nbody.hpp>
+
+#if defined(__ANDROID__)
+#define LOG(...) ((void)__android_log_print(ANDROID_LOG_INFO, "vulkanExample", __VA_ARGS__))
+#else
+#define LOG(...) printf(__VA_ARGS__)
+#endif
+
+#define NBODY_PARTICLE_COUNT 16 * 1024
+#define ATTRACTOR_PARTICLE_COUNT 256 * 1024
+#define CLOTH_GRID_SIZE 256
+// Iterations per frame of the computecloth example
+#define CLOTH_ITERATIONS 64
+
+// Minimum time to run each configuration
+static const double MIN_SECONDS = 1.0;
+
+class SimulationBenchmark {
+public:
+    std::vector<vkx::simd::Backend> backends;
+    std::vector<uint32_t> threadCounts;
+
+    std::vector<vkx::nbody::Particle> nbodyParticles;
+    std::vector<vkx::attractor::Particle> attractorParticles;
+    std::vector<vkx::cloth::Particle> clothParticles;
+    vkx::cloth::Parameters clothParameters;
+
+    SimulationBenchmark() {
+        backends.push_back(vkx::simd::Backend::scalar);
+        if (vkx::simd::best() != vkx::simd::Backend::scalar) {
+            backends.push_back(vkx::simd::best());
+        }
+        threadCounts.push_back(1);
+        const uint32_t hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+        if (hardwareThreads > 1) {
+            threadCounts.push_back(hardwareThreads);
+        }
+        prepareScenes();
+    }
+
+    void prepareScenes() {
+        std::default_random_engine rndGen(0);
+        std::uniform_real_distribution<float> rndDist(-1.0f, 1.0f);
+
+        nbodyParticles.resize(NBODY_PARTICLE_COUNT);
+        for (auto& particle : nbodyParticles) {
+            particle.pos = glm::vec4(rndDist(rndGen) * 4.0f, rndDist(rndGen) * 0.5f, rndDist(rndGen) * 4.0f, (rndDist(rndGen) * 0.5f + 0.5f) * 75.0f);
+            particle.vel = glm::vec4(rndDist(rndGen), rndDist(rndGen), rndDist(rndGen), 0.5f);
+        }
+
+        attractorParticles.resize(ATTRACTOR_PARTICLE_COUNT);
+        for (auto& particle : attractorParticles) {
+            particle.pos = glm::vec2(rndDist(rndGen), rndDist(rndGen));
+            particle.vel = glm::vec2(0.0f);
+            particle.gradientPos = glm::vec4(particle.pos.x / 2.0f, 0.0f, 0.0f, 0.0f);
+        }
+
+        // Vertical cloth pinned at its top corners, falling onto the sphere
+        const float spacing = 2.5f / (CLOTH_GRID_SIZE - 1);
+        clothParticles.resize(CLOTH_GRID_SIZE * CLOTH_GRID_SIZE);
+        for (uint32_t y = 0; y < CLOTH_GRID_SIZE; ++y) {
+            for (uint32_t x = 0; x < CLOTH_GRID_SIZE; ++x) {
+                auto& particle = clothParticles[y * CLOTH_GRID_SIZE + x];
+                particle.pos = glm::vec4(x * spacing - 1.25f, y * spacing - 1.25f, 0.0f, 1.0f);
+                particle.vel = glm::vec4(0.0f);
+                particle.pinned = (y == 0 && (x == 0 || x == CLOTH_GRID_SIZE - 1)) ? 1.0f : 0.0f;
+            }
+        }
+        clothParameters.deltaT = 0.000005f;
+        clothParameters.restDistH = spacing;
+        clothParameters.restDistV = spacing;
+        clothParameters.restDistD = sqrtf(2.0f) * spacing;
+        clothParameters.spherePos = glm::vec4(0.0f, 0.0f, 0.5f, 0.0f);
+        clothParameters.particleCount = glm::ivec2(CLOTH_GRID_SIZE, CLOTH_GRID_SIZE);
+    }
+
+    // Repeat `step` until MIN_SECONDS have passed and print the throughput
+    template <typename StepFunction>
+    void measure(const char* kernel, vkx::simd::Backend backend, uint32_t threads, uint64_t interactionsPerStep, StepFunction step) {
+        // Warm up caches and the thread pool
+        step();
+        uint32_t steps = 0;
+        auto tStart = std::chrono::high_resolution_clock::now();
+        double seconds = 0.0;
+        do {
+            step();
+            ++steps;
+            seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+        } while (seconds < MIN_SECONDS);
+
+        const double interactionsPerSecond = static_cast<double>(interactionsPerStep) * steps / seconds;
+        LOG("%-10s %-8s %7u %7u %11.3f %16.3e\n", kernel, vkx::simd::name(backend), threads, steps, seconds * 1000.0 / steps, interactionsPerSecond);
+    }
+
+    void run() {
+        LOG("%-10s %-8s %7s %7s %11s %16s\n", "Kernel", "Backend", "Threads", "Steps", "ms/step", "Interactions/s");
+        for (auto threads : threadCounts) {
+            vkx::ThreadPool pool(threads);
+            for (auto backend : backends) {
+                vkx::nbody::Simulation nbody;
+                nbody.load(nbodyParticles.data(), nbodyParticles.size());
+                vkx::nbody::Parameters nbodyParameters;
+                measure("N-body", backend, threads, nbody.interactionsPerStep(), [&] { nbody.step(0.0005f, nbodyParameters, pool, backend); });
+
+                vkx::attractor::Simulation particles;
+                particles.load(attractorParticles.data(), attractorParticles.size());
+                vkx::attractor::Parameters attractorParameters;
+                attractorParameters.deltaT = 0.04f;
+                attractorParameters.destX = 0.5f;
+                measure("Particles", backend, threads, particles.interactionsPerStep(), [&] { particles.step(attractorParameters, pool, backend); });
+
+                vkx::cloth::Simulation cloth;
+                cloth.load(clothParticles.data(), clothParameters);
+                measure("Cloth", backend, threads, cloth.interactionsPerStep() * CLOTH_ITERATIONS,
+                        [&] { cloth.step(clothParameters, CLOTH_ITERATIONS, pool, backend); });
+            }
+        }
+    }
+};
+
+RUN_EXAMPLE(SimulationBenchmark)
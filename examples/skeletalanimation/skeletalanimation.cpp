@@ -7,6 +7,7 @@
 */
 
 #include <vulkanExampleBase.h>
+#include <scenegraph.hpp>
 
 #include <map>
 #include <assimp/matrix4x4.h>
@@ -65,15 +66,14 @@ struct VertexBoneData {
 
 // Stores information on a single bone
 struct BoneInfo {
-    aiMatrix4x4 offset;
-    aiMatrix4x4 finalTransformation;
-
-    BoneInfo() {
-        offset = aiMatrix4x4();
-        finalTransformation = aiMatrix4x4();
-    };
+    glm::mat4 offset{ 1.0f };
 };
 
+// Assimp matrices are row major
+static glm::mat4 toGlm(const aiMatrix4x4& matrix) {
+    return glm::transpose(glm::make_mat4(&matrix.a1));
+}
+
 class SkinnedMesh : public vks::model::Model {
 public:
     // Bone related stuff
@@ -84,11 +84,18 @@ public:
     // Number of bones present
     uint32_t numBones = 0;
     // Root inverese transform matrix
-    aiMatrix4x4 globalInverseTransform;
+    glm::mat4 globalInverseTransform;
     // Per-vertex bone info
     std::vector<VertexBoneData> bones;
     // Bone transformations
-    std::vector<aiMatrix4x4> boneTransforms;
+    std::vector<glm::mat4> boneTransforms;
+
+    // Node hierarchy of the scene, flattened once on load
+    vkx::SceneGraph nodes;
+    // Bone driven by each node, or SceneGraph::INVALID_NODE
+    std::vector<uint32_t> nodeBones;
+    // Channel of the active animation moving each node, if any
+    std::vector<const aiNodeAnim*> nodeChannels;
 
     // Modifier for the animation
     float animationSpeed = 0.75f;
@@ -109,8 +116,7 @@ public:
         bones.resize(vertexCount);
         numAnimations = pScene->mNumAnimations;
         // Store global inverse transform matrix of root node
-        globalInverseTransform = pScene->mRootNode->mTransformation;
-        globalInverseTransform.Inverse();
+        globalInverseTransform = glm::inverse(toGlm(pScene->mRootNode->mTransformation));
         // Load bones (weights and IDs)
         for (uint32_t m = 0; m < pScene->mNumMeshes; m++) {
             aiMesh* paiMesh = pScene->mMeshes[m];
@@ -118,6 +124,21 @@ public:
                 loadBones(m, paiMesh, bones);
             }
         }
+        // Flatten the node hierarchy, so animating it does not need to walk the assimp nodes every frame
+        nodes.clear();
+        addNodes(pScene->mRootNode, vkx::SceneGraph::INVALID_NODE);
+        nodeBones.resize(nodes.size());
+        for (uint32_t node = 0; node < nodes.size(); node++) {
+            auto bone = boneMapping.find(nodes.name(node));
+            nodeBones[node] = bone != boneMapping.end() ? bone->second : vkx::SceneGraph::INVALID_NODE;
+        }
+    }
+
+    void addNodes(const aiNode* pNode, uint32_t parent) {
+        const uint32_t node = nodes.addNode(parent, toGlm(pNode->mTransformation), pNode->mName.data);
+        for (uint32_t i = 0; i < pNode->mNumChildren; i++) {
+            addNodes(pNode->mChildren[i], node);
+        }
     }
 
     void appendVertex(std::vector<uint8_t>& outputBuffer, const aiScene* pScene, uint32_t meshIndex, uint32_t vertexIndex) override {
@@ -159,6 +180,11 @@ public:
     void setAnimation(uint32_t animationIndex) {
         assert(animationIndex < numAnimations);
         pAnimation = pScene->mAnimations[animationIndex];
+        // Look up the channels once instead of by name every frame
+        nodeChannels.resize(nodes.size());
+        for (uint32_t node = 0; node < nodes.size(); node++) {
+            nodeChannels[node] = findNodeAnim(pAnimation, nodes.name(node));
+        }
     }
 
     // Load bone information from ASSIMP mesh
@@ -176,7 +202,7 @@ public:
                 numBones++;
                 BoneInfo bone;
                 boneInfo.push_back(bone);
-                boneInfo[index].offset = pMesh->mBones[i]->mOffsetMatrix;
+                boneInfo[index].offset = toGlm(pMesh->mBones[i]->mOffsetMatrix);
                 boneMapping[name] = index;
             } else {
                 index = boneMapping[name];
@@ -190,17 +216,30 @@ public:
         boneTransforms.resize(numBones);
     }
 
-    // Recursive bone transformation for given animation time
+    // Bone transformations for given animation time
     void update(float time) {
         float TicksPerSecond = (float)(pScene->mAnimations[0]->mTicksPerSecond != 0 ? pScene->mAnimations[0]->mTicksPerSecond : 25.0f);
         float TimeInTicks = time * TicksPerSecond;
         float AnimationTime = fmod(TimeInTicks, (float)pScene->mAnimations[0]->mDuration);
 
-        aiMatrix4x4 identity = aiMatrix4x4();
-        readNodeHierarchy(AnimationTime, pScene->mRootNode, identity);
+        // Only animated nodes get new local transforms, the scene graph propagates them to their children
+        for (uint32_t node = 0; node < nodes.size(); node++) {
+            const aiNodeAnim* pNodeAnim = nodeChannels[node];
+            if (pNodeAnim) {
+                // Get interpolated matrices between current and next frame
+                aiMatrix4x4 matScale = interpolateScale(AnimationTime, pNodeAnim);
+                aiMatrix4x4 matRotation = interpolateRotation(AnimationTime, pNodeAnim);
+                aiMatrix4x4 matTranslation = interpolateTranslation(AnimationTime, pNodeAnim);
+                nodes.setLocal(node, toGlm(matTranslation * matRotation * matScale));
+            }
+        }
+        nodes.update();
 
-        for (uint32_t i = 0; i < boneTransforms.size(); i++) {
-            boneTransforms[i] = boneInfo[i].finalTransformation;
+        for (uint32_t node = 0; node < nodes.size(); node++) {
+            const uint32_t bone = nodeBones[node];
+            if (bone != vkx::SceneGraph::INVALID_NODE) {
+                boneTransforms[bone] = globalInverseTransform * nodes.world(node) * boneInfo[bone].offset;
+            }
         }
     }
 
@@ -308,35 +347,6 @@ private:
         aiMatrix4x4::Scaling(scale, mat);
         return mat;
     }
-
-    // Get node hierarchy for current animation time
-    void readNodeHierarchy(float AnimationTime, const aiNode* pNode, const aiMatrix4x4& ParentTransform) {
-        std::string NodeName(pNode->mName.data);
-
-        aiMatrix4x4 NodeTransformation(pNode->mTransformation);
-
-        const aiNodeAnim* pNodeAnim = findNodeAnim(pAnimation, NodeName);
-
-        if (pNodeAnim) {
-            // Get interpolated matrices between current and next frame
-            aiMatrix4x4 matScale = interpolateScale(AnimationTime, pNodeAnim);
-            aiMatrix4x4 matRotation = interpolateRotation(AnimationTime, pNodeAnim);
-            aiMatrix4x4 matTranslation = interpolateTranslation(AnimationTime, pNodeAnim);
-
-            NodeTransformation = matTranslation * matRotation * matScale;
-        }
-
-        aiMatrix4x4 GlobalTransformation = ParentTransform * NodeTransformation;
-
-        if (boneMapping.find(NodeName) != boneMapping.end()) {
-            uint32_t BoneIndex = boneMapping[NodeName];
-            boneInfo[BoneIndex].finalTransformation = globalInverseTransform * GlobalTransformation * boneInfo[BoneIndex].offset;
-        }
-
-        for (uint32_t i = 0; i < pNode->mNumChildren; i++) {
-            readNodeHierarchy(AnimationTime, pNode->mChildren[i], GlobalTransformation);
-        }
-    }
 };
 
 class VulkanExample : public vkx::ExampleBase {
@@ -529,7 +539,7 @@ public:
         // Update bones
         skinnedMesh.update(runningTime);
         for (uint32_t i = 0; i < skinnedMesh.boneTransforms.size(); i++) {
-            uboVS.bones[i] = glm::transpose(glm::make_mat4(&skinnedMesh.boneTransforms[i].a1));
+            uboVS.bones[i] = skinnedMesh.boneTransforms[i];
         }
 
         uniformData.vsScene.copy(uboVS);
@@ -37,10 +37,25 @@ public:
         glm::vec4 lightPos = glm::vec4(0.0f, -2.0f, 1.0f, 0.0f);
     } uboVS;
 
+    // Descriptor and pipeline layouts are reflected from the shaders, the cache owns the resulting objects
+    vks::reflection::PipelineReflection shaderInterface;
+    vks::reflection::LayoutCache layoutCache{ device };
     vk::PipelineLayout pipelineLayout;
     vk::DescriptorSet descriptorSet;
     vk::DescriptorSetLayout descriptorSetLayout;
 
+    // Host data to take specialization constants from
+    struct SpecializationData {
+        // Sets the lighting model used in the fragment "uber" shader
+        uint32_t lightingModel;
+        // Parameter for the toon shading part of the fragment shader
+        float toonDesaturationFactor = 0.5f;
+    };
+
+    // Every lighting model is compiled into its own pipeline from the same "uber" shader
+    std::unique_ptr<vks::pipelines::PipelineVariantCache<SpecializationData>> pipelineVariants;
+    std::shared_ptr<vks::pipelines::GraphicsPipelineBuilder> pipelineBuilder;
+
     struct {
         vk::Pipeline phong;
         vk::Pipeline toon;
@@ -57,12 +72,10 @@ public:
     }
 
     ~VulkanExample() {
-        device.destroy(pipelines.phong);
-        device.destroy(pipelines.textured);
-        device.destroy(pipelines.toon);
+        pipelineVariants.reset();
+        pipelineBuilder.reset();
 
-        device.destroy(pipelineLayout);
-        device.destroy(descriptorSetLayout);
+        layoutCache.destroy();
 
         models.cube.destroy();
         textures.colormap.destroy();
@@ -109,21 +122,17 @@ public:
     }
 
     void setupDescriptorPool() {
-        std::vector<vk::DescriptorPoolSize> poolSizes{
-            vk::DescriptorPoolSize{ vk::DescriptorType::eUniformBuffer, 1 },
-            vk::DescriptorPoolSize{ vk::DescriptorType::eCombinedImageSampler, 1 },
-        };
-        descriptorPool = device.createDescriptorPool({ {}, 2, static_cast<uint32_t>(poolSizes.size()), poolSizes.data() });
+        // Sized from the reflected bindings rather than guessed
+        descriptorPool = shaderInterface.createDescriptorPool(device);
     }
 
     void setupDescriptorSetLayout() {
-        std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
-            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eVertex },
-            { 1, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
-        };
+        // Binding 0 : vertex shader uniform buffer, binding 1 : fragment shader color map
+        shaderInterface.add(vks::reflection::reflectFile(getAssetPath() + "shaders/specializationconstants/uber.vert.spv"));
+        shaderInterface.add(vks::reflection::reflectFile(getAssetPath() + "shaders/specializationconstants/uber.frag.spv"));
 
-        descriptorSetLayout = device.createDescriptorSetLayout({ {}, static_cast<uint32_t>(setLayoutBindings.size()), setLayoutBindings.data() });
-        pipelineLayout = device.createPipelineLayout({ {}, 1, &descriptorSetLayout });
+        descriptorSetLayout = layoutCache.getSetLayouts(shaderInterface)[0];
+        pipelineLayout = layoutCache.getPipelineLayout(shaderInterface);
     }
 
     void setupDescriptorSet() {
@@ -136,63 +145,51 @@ public:
     }
 
     void preparePipelines() {
-        vks::pipelines::GraphicsPipelineBuilder builder{ device, pipelineLayout, renderPass };
+        // The builder is shared with the variant cache, which needs it (and its shader modules) to stay alive
+        // for as long as new variants may be requested
+        pipelineBuilder = std::make_shared<vks::pipelines::GraphicsPipelineBuilder>(device, pipelineLayout, renderPass);
+        auto& builder = *pipelineBuilder;
         builder.rasterizationState.frontFace = vk::FrontFace::eClockwise;
         builder.dynamicState.dynamicStateEnables.push_back(vk::DynamicState::eLineWidth);
         builder.vertexInputState.appendVertexLayout(vertexLayout);
 
-        // Prepare specialization data
-
-        // Host data to take specialization constants from
-        struct SpecializationData {
-            // Sets the lighting model used in the fragment "uber" shader
-            uint32_t lightingModel;
-            // Parameter for the toon shading part of the fragment shader
-            float toonDesaturationFactor = 0.5f;
-        } specializationData;
+        // All pipelines will use the same "uber" shader and specialization constants to change branching and parameters of that shader
+        builder.loadShader(getAssetPath() + "shaders/specializationconstants/uber.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        builder.loadShader(getAssetPath() + "shaders/specializationconstants/uber.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        builder.update();
 
-        // Each shader constant of a shader stage corresponds to one map entry
-        std::array<vk::SpecializationMapEntry, 2> specializationMapEntries;
         // Shader bindings based on specialization constants are marked by the new "constant_id" layout qualifier:
         //	layout (constant_id = 0) const int LIGHTING_MODEL = 0;
         //	layout (constant_id = 1) const float PARAM_TOON_DESATURATION = 0.0f;
+        // Map entries are generated from the struct members, with constant IDs assigned in the order listed
+        vks::pipelines::SpecializationLayout<SpecializationData> specializationLayout{
+            &SpecializationData::lightingModel,
+            &SpecializationData::toonDesaturationFactor,
+        };
 
-        // Map entry for the lighting model to be used by the fragment shader
-        specializationMapEntries[0].constantID = 0;
-        specializationMapEntries[0].size = sizeof(specializationData.lightingModel);
-        specializationMapEntries[0].offset = 0;
-
-        // Map entry for the toon shader parameter
-        specializationMapEntries[1].constantID = 1;
-        specializationMapEntries[1].size = sizeof(specializationData.toonDesaturationFactor);
-        specializationMapEntries[1].offset = offsetof(SpecializationData, toonDesaturationFactor);
-
-        // Prepare specialization info block for the shader stage
-        vk::SpecializationInfo specializationInfo{};
-        specializationInfo.dataSize = sizeof(specializationData);
-        specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationMapEntries.size());
-        specializationInfo.pMapEntries = specializationMapEntries.data();
-        specializationInfo.pData = &specializationData;
-
-        // Create pipelines
-        // All pipelines will use the same "uber" shader and specialization constants to change branching and parameters of that shader
-        builder.loadShader(getAssetPath() + "shaders/specializationconstants/uber.vert.spv", vk::ShaderStageFlagBits::eVertex);
-        builder.loadShader(getAssetPath() + "shaders/specializationconstants/uber.frag.spv", vk::ShaderStageFlagBits::eFragment);
-
-        // Specialization info is assigned is part of the shader stage (modul) and must be set after creating the module and before creating the pipeline
-        builder.shaderStages[1].pSpecializationInfo = &specializationInfo;
+        // Specialization info is applied to the fragment stage only
+        auto sharedBuilder = pipelineBuilder;
+        auto pipelineCache = context.pipelineCache;
+        pipelineVariants.reset(new vks::pipelines::PipelineVariantCache<SpecializationData>(
+            device, specializationLayout, [sharedBuilder, pipelineCache](const vk::SpecializationInfo& specializationInfo) {
+                return sharedBuilder->createSpecialized(pipelineCache, vk::ShaderStageFlagBits::eFragment, specializationInfo);
+            }));
 
         // Solid phong shading
-        specializationData.lightingModel = 0;
-        pipelines.phong = builder.create(context.pipelineCache);
-
+        SpecializationData phongData;
+        phongData.lightingModel = 0;
         // Phong and textured
-        specializationData.lightingModel = 1;
-        pipelines.toon = builder.create(context.pipelineCache);
-
+        SpecializationData toonData;
+        toonData.lightingModel = 1;
         // Textured discard
-        specializationData.lightingModel = 2;
-        pipelines.textured = builder.create(context.pipelineCache);
+        SpecializationData texturedData;
+        texturedData.lightingModel = 2;
+
+        // Compile the toon and textured variants in the background while the phong variant is built on this thread
+        pipelineVariants->prewarm({ toonData, texturedData });
+        pipelines.phong = pipelineVariants->get(phongData);
+        pipelines.toon = pipelineVariants->get(toonData);
+        pipelines.textured = pipelineVariants->get(texturedData);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
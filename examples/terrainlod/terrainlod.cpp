@@ -0,0 +1,218 @@
+/*
+* Vulkan Example - CPU checks and benchmark of the quadtree terrain LOD selection
+*
+* Builds a tile file from a synthetic terrain and runs the vkx::terrain selection for a camera flying over it.
+* Every selection is checked to cover the visible part of the terrain exactly once, and to only stop at nodes
+* whose projected error is within the limit.  The tiles are then streamed through a vkx::terrain::TileCache with
+* a small budget, checking the loaded samples against the terrain, and the selection is compared with the one
+* over a fully resident tree once the loads have caught up.  Needs no GPU.
+*
+* This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*/
+
+#include <check.hpp>
+#include <terrain.hpp>
+
+// Quads along a tile edge and levels of the tree, the terrain has TILE_SIZE * 2^(LEVELS - 1) + 1 samples per edge
+#define TILE_SIZE 64
+#define LEVELS 7
+#define TERRAIN_SIZE 4096.0f
+#define HEIGHT_SCALE 512.0f
+#define VIEW_COUNT 64
+// Layers of the simulated height texture array
+#define CACHE_SLOTS 768
+#define MAX_UPLOADS 16
+
+// Minimum time to run the selection for each error limit
+static const double MIN_SECONDS = 0.5;
+
+class TerrainLod : public vkx::Check {
+public:
+    vkx::ThreadPool pool;
+    const uint32_t dim = TILE_SIZE * (1u << (LEVELS - 1)) + 1;
+    std::vector<uint16_t> heights;
+    std::string filename = "terrainlod.tiles";
+    vkx::terrain::TileFile file;
+    vkx::terrain::Quadtree quadtree;
+    std::vector<vkx::terrain::View> views;
+
+    TerrainLod() {
+        // A coarse random grid enlarged with noise detail
+        const uint32_t sourceDim = 17;
+        std::default_random_engine rndGen(0);
+        std::uniform_int_distribution<uint32_t> rndHeight(8192, 57343);
+        std::vector<uint16_t> source(sourceDim * sourceDim);
+        for (auto& height : source) {
+            height = static_cast<uint16_t>(rndHeight(rndGen));
+        }
+
+        auto tStart = std::chrono::high_resolution_clock::now();
+        heights = vkx::terrain::upsample(source, sourceDim, dim, 4096.0f, 1, pool);
+        if (!vkx::terrain::buildTileFile(filename, heights, dim, TILE_SIZE, pool) || !file.open(filename)) {
+            throw std::runtime_error("Could not write " + filename);
+        }
+        LOG("%u x %u samples in %u levels of %u x %u quad tiles, built in %.1f ms\n", dim, dim, file.levels(), TILE_SIZE, TILE_SIZE,
+            std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count());
+        quadtree.create(file, glm::vec3(-TERRAIN_SIZE * 0.5f, 0.0f, -TERRAIN_SIZE * 0.5f), TERRAIN_SIZE, HEIGHT_SCALE);
+
+        // A circle above the terrain, looking ahead and a little down
+        const glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, TERRAIN_SIZE * 2.0f);
+        views.resize(VIEW_COUNT);
+        for (uint32_t v = 0; v < VIEW_COUNT; ++v) {
+            const float angle = glm::radians(360.0f) * v / VIEW_COUNT;
+            const glm::vec3 eye{ sinf(angle) * TERRAIN_SIZE * 0.3f, -HEIGHT_SCALE * 1.1f, cosf(angle) * TERRAIN_SIZE * 0.3f };
+            const glm::vec3 forward{ cosf(angle), 0.3f, -sinf(angle) };
+            views[v].frustum.update(projection * glm::lookAt(eye, eye + forward, glm::vec3(0.0f, -1.0f, 0.0f)));
+            views[v].eye = eye;
+            views[v].projectionScale = vkx::terrain::projectionScale(glm::radians(60.0f), 1080.0f);
+        }
+    }
+
+    ~TerrainLod() { std::remove(filename.c_str()); }
+
+    void error(const char* message, uint32_t view, uint32_t node) {
+        Check::error("View " + std::to_string(view) + ", node " + std::to_string(node) + ": " + message);
+    }
+
+    // Check that the tiles cover every visible leaf exactly once and are accurate enough
+    void check(uint32_t v, const std::vector<vkx::terrain::Tile>& tiles) {
+        const uint32_t leafLevel = quadtree.levels() - 1;
+        const uint32_t edgeLeaves = 1u << leafLevel;
+        std::vector<uint8_t> coverage(edgeLeaves * edgeLeaves, 0);
+        for (const auto& tile : tiles) {
+            const uint32_t index = tile.node - vkx::terrain::levelStart(tile.level);
+            const uint32_t shift = leafLevel - tile.level;
+            const uint32_t x0 = (index % (1u << tile.level)) << shift, y0 = (index / (1u << tile.level)) << shift;
+            for (uint32_t y = y0; y < y0 + (1u << shift); ++y) {
+                for (uint32_t x = x0; x < x0 + (1u << shift); ++x) {
+                    ++coverage[y * edgeLeaves + x];
+                }
+            }
+            if (tile.level < leafLevel && quadtree.distance(tile.node, views[v].eye) < quadtree.splitDistance(tile.node, views[v])) {
+                error("drawn although its error is too large", v, tile.node);
+            }
+            if (tile.morphStart > tile.morphEnd) {
+                error("morph starts after it ends", v, tile.node);
+            }
+        }
+        for (uint32_t y = 0; y < edgeLeaves; ++y) {
+            for (uint32_t x = 0; x < edgeLeaves; ++x) {
+                const uint32_t leaf = vkx::terrain::nodeIndex(leafLevel, x, y);
+                const glm::vec3 center = (quadtree.boundsMin(leaf) + quadtree.boundsMax(leaf)) * 0.5f;
+                const glm::vec3 extent = (quadtree.boundsMax(leaf) - quadtree.boundsMin(leaf)) * 0.5f;
+                const uint8_t covered = coverage[y * edgeLeaves + x];
+                if (covered > 1) {
+                    error("covered by more than one tile", v, leaf);
+                } else if (covered == 0 && views[v].frustum.checkBox(center, extent)) {
+                    error("visible but not covered", v, leaf);
+                }
+            }
+        }
+    }
+
+    // Check a loaded tile against the terrain at its corners and center
+    void checkSamples(uint32_t view, const vkx::terrain::TileCache::Upload& upload, const std::vector<uint16_t>& data) {
+        uint32_t level = 0;
+        while (vkx::terrain::levelStart(level + 1) <= upload.node) {
+            ++level;
+        }
+        const uint32_t index = upload.node - vkx::terrain::levelStart(level);
+        const uint32_t step = 1u << (quadtree.levels() - 1 - level);
+        const uint32_t x0 = (index % (1u << level)) * TILE_SIZE * step, y0 = (index / (1u << level)) * TILE_SIZE * step;
+        const uint32_t points[3]{ 0, TILE_SIZE / 2, TILE_SIZE };
+        for (auto ty : points) {
+            for (auto tx : points) {
+                const uint16_t loaded = data[upload.offset + (ty + 1) * file.tileDim() + tx + 1];
+                if (loaded != heights[(y0 + ty * step) * dim + x0 + tx * step]) {
+                    error("loaded samples differ from the terrain", view, upload.node);
+                    return;
+                }
+            }
+        }
+    }
+
+    void benchmark() {
+        LOG("%-10s %8s %8s %12s %11s\n", "Max error", "Tiles", "Leaves", "Triangles", "us/select");
+        std::vector<vkx::terrain::Tile> tiles;
+        for (float maxPixelError : { 1.0f, 2.0f, 4.0f, 8.0f }) {
+            uint64_t tileCount = 0, leafCount = 0;
+            for (uint32_t v = 0; v < VIEW_COUNT; ++v) {
+                views[v].maxPixelError = maxPixelError;
+                quadtree.select(views[v], tiles);
+                check(v, tiles);
+                tileCount += tiles.size();
+                leafCount += std::count_if(tiles.begin(), tiles.end(), [&](const vkx::terrain::Tile& tile) { return tile.level + 1 == quadtree.levels(); });
+            }
+
+            uint32_t steps = 0;
+            auto tStart = std::chrono::high_resolution_clock::now();
+            double seconds = 0.0;
+            do {
+                quadtree.select(views[steps % VIEW_COUNT], tiles);
+                ++steps;
+                seconds = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - tStart).count();
+            } while (seconds < MIN_SECONDS);
+            LOG("%-10.1f %8.1f %8.1f %12.0f %11.2f\n", maxPixelError, double(tileCount) / VIEW_COUNT, double(leafCount) / VIEW_COUNT,
+                double(tileCount) / VIEW_COUNT * TILE_SIZE * TILE_SIZE * 2, seconds * 1e6 / steps);
+        }
+        for (auto& view : views) {
+            view.maxPixelError = 2.0f;
+        }
+    }
+
+    void stream() {
+        vkx::terrain::TileCache cache;
+        cache.create(file, CACHE_SLOTS);
+        cache.preload({ 0 });
+
+        std::vector<vkx::terrain::Tile> tiles, reference;
+        std::vector<uint32_t> missing;
+        std::vector<vkx::terrain::TileCache::Upload> uploads;
+        std::vector<uint16_t> data;
+        uint32_t frames = 0, mismatches = 0;
+        for (uint32_t v = 0; v < VIEW_COUNT; ++v) {
+            quadtree.select(views[v], reference);
+            // Stay on the view until nothing is missing anymore
+            for (uint32_t attempt = 0; attempt < 10000; ++attempt, ++frames) {
+                cache.beginFrame();
+                missing.clear();
+                quadtree.select(views[v], tiles, &cache, &missing);
+                for (const auto& tile : tiles) {
+                    if (!cache.resident(tile.node)) {
+                        error("drawn but not resident", v, tile.node);
+                    }
+                }
+                cache.request(missing);
+                cache.collect(MAX_UPLOADS, uploads, data);
+                for (const auto& upload : uploads) {
+                    checkSamples(v, upload, data);
+                }
+                if (missing.empty() && uploads.empty()) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+            auto byNode = [](const vkx::terrain::Tile& a, const vkx::terrain::Tile& b) { return a.node < b.node; };
+            std::sort(tiles.begin(), tiles.end(), byNode);
+            std::sort(reference.begin(), reference.end(), byNode);
+            if (tiles.size() != reference.size() ||
+                !std::equal(tiles.begin(), tiles.end(), reference.begin(), [](const vkx::terrain::Tile& a, const vkx::terrain::Tile& b) { return a.node == b.node; })) {
+                ++mismatches;
+            }
+        }
+        const auto statistics = cache.statistics();
+        LOG("Streaming through %u slots (%.1f MB): %u frames, %u tiles loaded, %u evicted, %u of %u views differ from the resident selection\n",
+            cache.slotCount(), cache.slotCount() * file.tileBytes() / (1024.0 * 1024.0), frames, statistics.loaded, statistics.evicted, mismatches,
+            VIEW_COUNT);
+        errors += mismatches;
+        cache.destroy();
+    }
+
+    uint32_t run() {
+        benchmark();
+        stream();
+        return finish();
+    }
+};
+
+RUN_CHECK(TerrainLod)
@@ -4,10 +4,37 @@
 * Copyright (C) 2016 by Sascha Willems - www.saschawillems.de
 *
 * This code is licensed under the MIT license (MIT) (http://opensource.org/licenses/MIT)
+*
+* Before the tessellation control shader culls patches on the GPU, whole regions of the terrain are rejected
+* on the CPU with a vkx::culling::Bvh over the patch bounds.  Only the indices of the patches that survive are
+* written to a host visible index buffer, and the draw reads its index count from an indirect buffer.
+*
+* The quadtree mode draws a terrain with 16 times the samples of the height map instead, enlarged once into a
+* vkx::terrain tile file.  Each frame the quadtree picks the tiles whose error stays within a few pixels, the
+* tile cache streams missing ones from the file into the layers of a height texture array within a fixed
+* budget, and all tiles are drawn with one indirect draw of an instanced grid.  Vertices morph to the grid of
+* the parent tile as they near its distance, and skirts cover the cracks between tiles of different levels.
+* The staging memory of the uploads, the tile instances and the indirect draw have one range per swap chain
+* image, and the copies are submitted ahead of the draw of that image instead of waiting for the queue.
 */
 
 #include <vulkanExampleBase.h>
-#include <frustum.hpp>
+#include <culling.hpp>
+#include <terrain.hpp>
+
+#include <chrono>
+
+#if defined(__ANDROID__)
+#include <android.hpp>
+#endif
+
+// The tile file enlarges the height map by this factor along each edge
+#define TERRAIN_UPSAMPLE 4
+#define TERRAIN_TILE_SIZE 64
+// Memory for the height tiles on the GPU
+#define TERRAIN_TILE_BUDGET (16 * 1024 * 1024)
+// Tiles copied to the height texture array per frame
+#define TERRAIN_MAX_UPLOADS 16
 
 // Vertex layout for this example
 vks::model::VertexLayout vertexLayout{ {
@@ -27,6 +54,7 @@ private:
 public:
     bool wireframe = false;
     bool tessellation = true;
+    bool quadtreeTerrain = true;
 
     struct {
         vks::model::Model object;
@@ -36,6 +64,7 @@ public:
     struct {
         vks::Buffer terrainTessellation;
         vks::Buffer skysphereVertex;
+        vks::Buffer terrainTiles;
     } uniformData;
 
     // Shared values for tessellation control and evaluation stages
@@ -56,10 +85,25 @@ public:
         glm::mat4 mvp;
     } uboVS;
 
+    // Quadtree terrain vertex shader stage
+    struct {
+        glm::mat4 projection;
+        glm::mat4 modelview;
+        glm::vec4 eye;
+        glm::vec2 origin;
+        float size;
+        float heightScale;
+        float tileSize;
+        // Depth of the skirts relative to the tile size
+        float skirtDepth = 0.05f;
+    } uboTiles;
+
     struct {
         vk::Pipeline terrain;
         vk::Pipeline wireframe;
         vk::Pipeline skysphere;
+        vk::Pipeline tiles;
+        vk::Pipeline tilesWireframe;
     } pipelines;
 
     struct {
@@ -75,6 +119,7 @@ public:
     struct {
         vk::DescriptorSet terrain;
         vk::DescriptorSet skysphere;
+        vk::DescriptorSet tiles;
     } descriptorSets;
 
     // Pipeline statistics
@@ -85,6 +130,53 @@ public:
     // View frustum passed to tessellation control shader for culling
     vks::Frustum frustum;
 
+    // Patches culled on the CPU, with the indices of all patches and those of the visible ones
+    vkx::culling::Bvh patchBvh;
+    std::vector<uint32_t> patchIndices;
+    std::vector<uint32_t> visiblePatches;
+    vks::Buffer visibleIndices;
+    vks::Buffer indirectBuffer;
+    vkx::ThreadPool threadPool;
+    bool cpuCulling = true;
+
+    struct {
+        float milliseconds = 0.0f;
+        uint32_t visible = 0;
+    } cullStatistics;
+
+    // Quadtree terrain, with the heights of the resident tiles in the layers of a texture array
+    struct TileInstance {
+        // Offset in x and z, size and texture array layer
+        glm::vec4 offsetSize;
+        // Eye distances the morph to the parent's grid starts and ends at
+        glm::vec4 morph;
+    };
+
+    vkx::terrain::TileFile tileFile;
+    vkx::terrain::Quadtree quadtree;
+    vkx::terrain::TileCache tileCache;
+    vkx::terrain::View tileView;
+    std::vector<vkx::terrain::Tile> selectedTiles;
+    std::vector<uint32_t> missingTiles;
+    std::vector<vkx::terrain::TileCache::Upload> tileUploads;
+    std::vector<uint16_t> tileData;
+    vks::texture::Texture tileHeights;
+    vks::Buffer tileVertices;
+    vks::Buffer tileIndices;
+    uint32_t tileIndexCount = 0;
+    // Per swap chain image: TERRAIN_MAX_UPLOADS tiles of staging memory, the command buffer copying them to the
+    // texture array, slotCount instances and one indirect command
+    uint32_t tileRingCount = 0;
+    vks::Buffer tileStaging;
+    std::vector<vk::CommandBuffer> tileUploadCommands;
+    vks::Buffer tileInstances;
+    vks::Buffer tileIndirect;
+
+    struct {
+        float milliseconds = 0.0f;
+        uint32_t maxLevel = 0;
+    } tileStatistics;
+
     VulkanExample() {
         title = "Vulkan Example - Dynamic terrain tessellation";
         camera.type = Camera::CameraType::firstperson;
@@ -115,6 +207,8 @@ public:
         // Note : Inherited destructor cleans up resources stored in base class
         device.destroy(pipelines.terrain);
         device.destroy(pipelines.wireframe);
+        device.destroy(pipelines.tiles);
+        device.destroy(pipelines.tilesWireframe);
 
         device.destroy(pipelineLayouts.skysphere);
         device.destroy(pipelineLayouts.terrain);
@@ -123,6 +217,20 @@ public:
         device.destroy(descriptorSetLayouts.skysphere);
 
         meshes.object.destroy();
+        visibleIndices.destroy();
+        indirectBuffer.destroy();
+
+        tileCache.destroy();
+        tileHeights.destroy();
+        tileStaging.destroy();
+        if (!tileUploadCommands.empty()) {
+            device.freeCommandBuffers(context.getCommandPool(), tileUploadCommands);
+        }
+        tileVertices.destroy();
+        tileIndices.destroy();
+        tileInstances.destroy();
+        tileIndirect.destroy();
+        uniformData.terrainTiles.destroy();
 
         uniformData.skysphereVertex.destroy();
         uniformData.terrainTessellation.destroy();
@@ -204,11 +312,23 @@ public:
             cmdBuffer.beginQuery(queryPool, 0, vk::QueryControlFlagBits::ePrecise);
         }
         // Render
-        cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, wireframe ? pipelines.wireframe : pipelines.terrain);
-        cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.terrain, 0, descriptorSets.terrain, {});
-        cmdBuffer.bindVertexBuffers(0, meshes.object.vertices.buffer, { 0 });
-        cmdBuffer.bindIndexBuffer(meshes.object.indices.buffer, 0, vk::IndexType::eUint32);
-        cmdBuffer.drawIndexed(meshes.object.indexCount, 1, 0, 0, 0);
+        if (quadtreeTerrain) {
+            // All selected tiles are instances of the same grid
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, wireframe ? pipelines.tilesWireframe : pipelines.tiles);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.terrain, 0, descriptorSets.tiles, {});
+            // The command buffers are recorded in swap chain image order, each one draws its own range of the rings
+            const auto image = static_cast<vk::DeviceSize>(&cmdBuffer - commandBuffers.data());
+            cmdBuffer.bindVertexBuffers(0, tileVertices.buffer, { 0 });
+            cmdBuffer.bindVertexBuffers(1, tileInstances.buffer, { image * tileCache.slotCount() * sizeof(TileInstance) });
+            cmdBuffer.bindIndexBuffer(tileIndices.buffer, 0, vk::IndexType::eUint32);
+            cmdBuffer.drawIndexedIndirect(tileIndirect.buffer, image * sizeof(vk::DrawIndexedIndirectCommand), 1, sizeof(vk::DrawIndexedIndirectCommand));
+        } else {
+            cmdBuffer.bindPipeline(vk::PipelineBindPoint::eGraphics, wireframe ? pipelines.wireframe : pipelines.terrain);
+            cmdBuffer.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, pipelineLayouts.terrain, 0, descriptorSets.terrain, {});
+            cmdBuffer.bindVertexBuffers(0, meshes.object.vertices.buffer, { 0 });
+            cmdBuffer.bindIndexBuffer(visibleIndices.buffer, 0, vk::IndexType::eUint32);
+            cmdBuffer.drawIndexedIndirect(indirectBuffer.buffer, 0, 1, sizeof(vk::DrawIndexedIndirectCommand));
+        }
         // End pipeline statistics query
         if (deviceFeatures.pipelineStatisticsQuery) {
             cmdBuffer.endQuery(queryPool, 0);
@@ -257,31 +377,282 @@ public:
         }
 
         meshes.object.vertices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertices);
-        meshes.object.indices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indices);
         meshes.object.indexCount = indices.size();
+
+        // Bounds of the patches, from the flat grid down to the largest displacement of the height map
+        std::vector<glm::vec3> patchMin(w * w), patchMax(w * w);
+        for (uint32_t patch = 0; patch < w * w; patch++) {
+            const glm::vec3& first = vertices[indices[patch * 4]].pos;
+            const glm::vec3& last = vertices[indices[patch * 4 + 2]].pos;
+            patchMin[patch] = glm::vec3(first.x, -uboTess.displacementFactor, first.z);
+            patchMax[patch] = glm::vec3(last.x, 0.0f, last.z);
+        }
+        patchBvh.build(patchMin, patchMax);
+        patchIndices = std::move(indices);
+
+        visibleIndices = context.createBuffer(vk::BufferUsageFlagBits::eIndexBuffer,
+                                              vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                              patchIndices.size() * sizeof(uint32_t));
+        visibleIndices.map();
+        indirectBuffer = context.createBuffer(vk::BufferUsageFlagBits::eIndirectBuffer,
+                                              vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                              sizeof(vk::DrawIndexedIndirectCommand));
+        indirectBuffer.map();
+    }
+
+    // Write the indices of the patches intersecting the view frustum to the index buffer of the draw
+    void cullPatches() {
+        auto tStart = std::chrono::high_resolution_clock::now();
+        const uint32_t patchCount = static_cast<uint32_t>(patchIndices.size() / 4);
+        if (cpuCulling) {
+            patchBvh.cull(frustum, vkx::simd::best(), threadPool, visiblePatches);
+        } else {
+            visiblePatches.resize(patchCount);
+            for (uint32_t patch = 0; patch < patchCount; patch++) {
+                visiblePatches[patch] = patch;
+            }
+        }
+
+        uint32_t* indices = static_cast<uint32_t*>(visibleIndices.mapped);
+        for (size_t i = 0; i < visiblePatches.size(); i++) {
+            memcpy(indices + i * 4, patchIndices.data() + visiblePatches[i] * 4, 4 * sizeof(uint32_t));
+        }
+        vk::DrawIndexedIndirectCommand command{ static_cast<uint32_t>(visiblePatches.size() * 4), 1, 0, 0, 0 };
+        indirectBuffer.copy(command);
+
+        cullStatistics.milliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+        cullStatistics.visible = static_cast<uint32_t>(visiblePatches.size());
+    }
+
+    // Open the tile file of the quadtree terrain, building it from the height map on the first run
+    void openTileFile() {
+        const std::string heightMapFile = getAssetPath() + "textures/terrain_heightmap_r16.ktx";
+#if defined(__ANDROID__)
+        // The assets are read only
+        const std::string filename = std::string(vkx::android::androidApp->activity->internalDataPath) + "/terrain_heightmap_r16.tiles";
+#else
+        const std::string filename = heightMapFile.substr(0, heightMapFile.find_last_of('.')) + ".tiles";
+#endif
+        if (tileFile.open(filename)) {
+            return;
+        }
+
+        std::shared_ptr<gli::texture2d> heightMap;
+        vks::file::withBinaryFileContents(heightMapFile, [&](size_t size, const void* data) {
+            heightMap = std::make_shared<gli::texture2d>(gli::load((const char*)data, size));
+        });
+        const uint32_t sourceDim = static_cast<uint32_t>(heightMap->extent().x);
+        std::vector<uint16_t> heights(sourceDim * sourceDim);
+        memcpy(heights.data(), heightMap->data(), heights.size() * sizeof(uint16_t));
+
+        const uint32_t dim = sourceDim * TERRAIN_UPSAMPLE + 1;
+        std::cout << "Building the terrain tiles of " << dim << " x " << dim << " samples into " << filename << std::endl;
+        heights = vkx::terrain::upsample(heights, sourceDim, dim, 96.0f, 0, threadPool);
+        if (!vkx::terrain::buildTileFile(filename, heights, dim, TERRAIN_TILE_SIZE, threadPool) || !tileFile.open(filename)) {
+            throw std::runtime_error("Could not write the terrain tiles to " + filename);
+        }
+    }
+
+    // Create the quadtree, the tile cache with its texture array and the instanced grid of the quadtree terrain
+    void prepareTerrainTiles() {
+        openTileFile();
+        // Covers the same square as the tessellated patches
+        quadtree.create(tileFile, glm::vec3(-63.0f, 0.0f, -63.0f), 128.0f, uboTess.displacementFactor);
+        const uint32_t slotCount = std::min<uint32_t>(TERRAIN_TILE_BUDGET / tileFile.tileBytes(), context.deviceProperties.limits.maxImageArrayLayers);
+        tileCache.create(tileFile, slotCount);
+
+        vk::ImageCreateInfo imageCreateInfo;
+        imageCreateInfo.imageType = vk::ImageType::e2D;
+        imageCreateInfo.format = vk::Format::eR16Unorm;
+        imageCreateInfo.extent = vk::Extent3D{ tileFile.tileDim(), tileFile.tileDim(), 1 };
+        imageCreateInfo.mipLevels = 1;
+        imageCreateInfo.arrayLayers = slotCount;
+        imageCreateInfo.usage = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst;
+        tileHeights = context.createImage(imageCreateInfo);
+        tileHeights.mipLevels = 1;
+        tileHeights.layerCount = slotCount;
+        tileHeights.imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+        context.setImageLayout(tileHeights.image, vk::ImageLayout::eUndefined, vk::ImageLayout::eShaderReadOnlyOptimal,
+                               vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, slotCount });
+        vk::ImageViewCreateInfo viewCreateInfo;
+        viewCreateInfo.viewType = vk::ImageViewType::e2DArray;
+        viewCreateInfo.image = tileHeights.image;
+        viewCreateInfo.format = vk::Format::eR16Unorm;
+        viewCreateInfo.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, slotCount };
+        tileHeights.view = device.createImageView(viewCreateInfo);
+        // Linear filtering interpolates the heights between the samples the vertices morph between
+        vk::SamplerCreateInfo samplerInfo;
+        samplerInfo.minFilter = samplerInfo.magFilter = vk::Filter::eLinear;
+        samplerInfo.addressModeU = samplerInfo.addressModeV = vk::SamplerAddressMode::eClampToEdge;
+        tileHeights.sampler = device.createSampler(samplerInfo);
+        tileHeights.updateDescriptor();
+
+        // Grid positions of the tile, followed by a copy of the edge vertices for the skirts, flagged in z
+        const uint32_t tileSize = tileFile.tileSize();
+        const uint32_t gridDim = tileSize + 1;
+        std::vector<glm::vec3> vertices;
+        for (uint32_t y = 0; y < gridDim; y++) {
+            for (uint32_t x = 0; x < gridDim; x++) {
+                vertices.push_back(glm::vec3(x, y, 0.0f));
+            }
+        }
+        std::vector<uint32_t> indices;
+        for (uint32_t y = 0; y < tileSize; y++) {
+            for (uint32_t x = 0; x < tileSize; x++) {
+                const uint32_t index = x + y * gridDim;
+                indices.insert(indices.end(), { index, index + gridDim, index + gridDim + 1, index + gridDim + 1, index + 1, index });
+            }
+        }
+        // Edges as start vertex and step along the edge, the steps backwards wrap around
+        const uint32_t edges[4][2]{ { 0, 1 }, { tileSize, gridDim }, { gridDim * gridDim - 1, 0u - 1 }, { gridDim * tileSize, 0u - gridDim } };
+        for (const auto& edge : edges) {
+            const uint32_t skirtStart = static_cast<uint32_t>(vertices.size());
+            for (uint32_t i = 0; i < gridDim; i++) {
+                vertices.push_back(vertices[edge[0] + i * edge[1]] + glm::vec3(0.0f, 0.0f, 1.0f));
+            }
+            for (uint32_t i = 0; i < tileSize; i++) {
+                const uint32_t top = edge[0] + i * edge[1], bottom = skirtStart + i;
+                indices.insert(indices.end(), { top, bottom, bottom + 1, bottom + 1, top + edge[1], top });
+            }
+        }
+        tileVertices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eVertexBuffer, vertices);
+        tileIndices = context.stageToDeviceBuffer(vk::BufferUsageFlagBits::eIndexBuffer, indices);
+        tileIndexCount = static_cast<uint32_t>(indices.size());
+        prepareTileRing();
+
+        // Have the root and its children before the first frame, this once waiting for the copies to complete
+        tileCache.preload({ 0, 1, 2, 3, 4 });
+        context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& commandBuffer) { uploadTiles(commandBuffer, 0); });
+    }
+
+    // (Re)create the per image rings of the quadtree terrain if the swap chain image count changed
+    void prepareTileRing() {
+        if (tileRingCount == swapChain.imageCount) {
+            return;
+        }
+        if (tileStaging.buffer) {
+            device.waitIdle();
+            tileStaging.destroy();
+            tileInstances.destroy();
+            tileIndirect.destroy();
+            device.freeCommandBuffers(context.getCommandPool(), tileUploadCommands);
+        }
+        tileRingCount = swapChain.imageCount;
+        tileStaging = context.createBuffer(vk::BufferUsageFlagBits::eTransferSrc,
+                                           vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                           tileRingCount * TERRAIN_MAX_UPLOADS * tileFile.tileBytes());
+        tileStaging.map();
+        tileUploadCommands = context.allocateCommandBuffers(tileRingCount);
+        // Every drawn tile is resident, so there are never more tiles than slots
+        tileInstances = context.createBuffer(vk::BufferUsageFlagBits::eVertexBuffer,
+                                             vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                             tileRingCount * tileCache.slotCount() * sizeof(TileInstance));
+        tileInstances.map();
+        // Nothing is drawn from a range until a frame selected its tiles
+        tileIndirect = context.createBuffer(vk::BufferUsageFlagBits::eIndirectBuffer,
+                                            vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
+                                            tileRingCount * sizeof(vk::DrawIndexedIndirectCommand));
+        tileIndirect.map();
+        for (uint32_t image = 0; image < tileRingCount; image++) {
+            tileIndirect.copy(vk::DrawIndexedIndirectCommand{ tileIndexCount, 0, 0, 0, 0 }, image * sizeof(vk::DrawIndexedIndirectCommand));
+        }
+    }
+
+    // Record the copies of the tiles the cache finished loading into their layers of the height texture array,
+    // staged in the ring range of a swap chain image.  Returns false if there was nothing to copy.
+    bool uploadTiles(const vk::CommandBuffer& commandBuffer, uint32_t image) {
+        tileCache.collect(TERRAIN_MAX_UPLOADS, tileUploads, tileData);
+        if (tileUploads.empty()) {
+            return false;
+        }
+        const vk::DeviceSize stagingOffset = static_cast<vk::DeviceSize>(image) * TERRAIN_MAX_UPLOADS * tileFile.tileBytes();
+        memcpy(static_cast<uint8_t*>(tileStaging.mapped) + stagingOffset, tileData.data(), tileData.size() * sizeof(uint16_t));
+        std::vector<vk::BufferImageCopy> regions;
+        for (const auto& upload : tileUploads) {
+            vk::BufferImageCopy region;
+            region.bufferOffset = stagingOffset + upload.offset * sizeof(uint16_t);
+            region.imageSubresource = vk::ImageSubresourceLayers{ vk::ImageAspectFlagBits::eColor, 0, upload.slot, 1 };
+            region.imageExtent = vk::Extent3D{ tileFile.tileDim(), tileFile.tileDim(), 1 };
+            regions.push_back(region);
+        }
+
+        // The vertex shader reads the heights as well, which the layout helpers do not wait for.  The first
+        // barrier also orders the copies after the draws of earlier frames still reading the replaced tiles.
+        vk::ImageMemoryBarrier barrier;
+        barrier.image = tileHeights.image;
+        barrier.subresourceRange = vk::ImageSubresourceRange{ vk::ImageAspectFlagBits::eColor, 0, 1, 0, tileHeights.layerCount };
+        const vk::PipelineStageFlags shaderStages = vk::PipelineStageFlagBits::eVertexShader | vk::PipelineStageFlagBits::eFragmentShader;
+        barrier.oldLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+        barrier.newLayout = vk::ImageLayout::eTransferDstOptimal;
+        barrier.srcAccessMask = vk::AccessFlagBits::eShaderRead;
+        barrier.dstAccessMask = vk::AccessFlagBits::eTransferWrite;
+        commandBuffer.pipelineBarrier(shaderStages, vk::PipelineStageFlagBits::eTransfer, {}, nullptr, nullptr, barrier);
+        commandBuffer.copyBufferToImage(tileStaging.buffer, tileHeights.image, vk::ImageLayout::eTransferDstOptimal, regions);
+        barrier.oldLayout = vk::ImageLayout::eTransferDstOptimal;
+        barrier.newLayout = vk::ImageLayout::eShaderReadOnlyOptimal;
+        barrier.srcAccessMask = vk::AccessFlagBits::eTransferWrite;
+        barrier.dstAccessMask = vk::AccessFlagBits::eShaderRead;
+        commandBuffer.pipelineBarrier(vk::PipelineStageFlagBits::eTransfer, shaderStages, {}, nullptr, nullptr, barrier);
+        return true;
+    }
+
+    // Select the tiles of the quadtree terrain for the current view, stream in missing ones and write the instances
+    // to the ring range of a swap chain image, once the frame that last drew from it has completed
+    void updateTerrainTiles(uint32_t image) {
+        auto tStart = std::chrono::high_resolution_clock::now();
+        tileView.frustum = frustum;
+        tileView.eye = glm::vec3(glm::inverse(camera.matrices.view)[3]);
+        tileView.projectionScale = vkx::terrain::projectionScale(glm::radians(camera.fov), (float)size.height);
+
+        tileCache.beginFrame();
+        missingTiles.clear();
+        quadtree.select(tileView, selectedTiles, &tileCache, &missingTiles);
+        tileCache.request(missingTiles);
+
+        TileInstance* instances = static_cast<TileInstance*>(tileInstances.mapped) + static_cast<size_t>(image) * tileCache.slotCount();
+        tileStatistics.maxLevel = 0;
+        for (size_t i = 0; i < selectedTiles.size(); i++) {
+            const auto& tile = selectedTiles[i];
+            instances[i].offsetSize = glm::vec4(tile.offset, tile.size, (float)tileCache.slot(tile.node));
+            instances[i].morph = glm::vec4(tile.morphStart, tile.morphEnd, 0.0f, 0.0f);
+            tileStatistics.maxLevel = std::max(tileStatistics.maxLevel, tile.level);
+        }
+        vk::DrawIndexedIndirectCommand command{ tileIndexCount, static_cast<uint32_t>(selectedTiles.size()), 0, 0, 0 };
+        tileIndirect.copy(command, image * sizeof(vk::DrawIndexedIndirectCommand));
+        tileStatistics.milliseconds = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+
+        // The tiles drawn this frame keep their slots, so loads only replace tiles the instances do not use.  The
+        // copies go ahead of the draw on the same queue, the draw's fence covers them as well.
+        const vk::CommandBuffer& commandBuffer = tileUploadCommands[image];
+        commandBuffer.begin(vk::CommandBufferBeginInfo{ vk::CommandBufferUsageFlagBits::eOneTimeSubmit });
+        const bool uploaded = uploadTiles(commandBuffer, image);
+        commandBuffer.end();
+        if (uploaded) {
+            vk::SubmitInfo submitInfo;
+            submitInfo.commandBufferCount = 1;
+            submitInfo.pCommandBuffers = &commandBuffer;
+            queue.submit(submitInfo, {});
+        }
     }
 
     void setupDescriptorPool() {
         std::vector<vk::DescriptorPoolSize> poolSizes = {
             vk::DescriptorPoolSize(vk::DescriptorType::eUniformBuffer, 3),
-            vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 3),
+            vk::DescriptorPoolSize(vk::DescriptorType::eCombinedImageSampler, 5),
         };
 
-        descriptorPool = device.createDescriptorPool({ {}, 2, (uint32_t)poolSizes.size(), poolSizes.data() });
+        descriptorPool = device.createDescriptorPool({ {}, 3, (uint32_t)poolSizes.size(), poolSizes.data() });
     }
 
     void setupDescriptorSetLayouts() {
-        // Terrain
+        // Terrain, shared by the tessellated patches and the quadtree tiles
+        const vk::ShaderStageFlags terrainStages =
+            vk::ShaderStageFlagBits::eVertex | vk::ShaderStageFlagBits::eTessellationControl | vk::ShaderStageFlagBits::eTessellationEvaluation;
         std::vector<vk::DescriptorSetLayoutBinding> setLayoutBindings{
-            // Binding 0 : Shared Tessellation shader ubo
-            { 0, vk::DescriptorType::eUniformBuffer, 1, vk::ShaderStageFlagBits::eTessellationControl | vk::ShaderStageFlagBits::eTessellationEvaluation },
-            // Binding 1 : Height map
-            {
-                1,
-                vk::DescriptorType::eCombinedImageSampler,
-                1,
-                vk::ShaderStageFlagBits::eTessellationControl | vk::ShaderStageFlagBits::eTessellationEvaluation | vk::ShaderStageFlagBits::eFragment,
-            },
+            // Binding 0 : Shared Tessellation shader ubo, or the one of the tiles
+            { 0, vk::DescriptorType::eUniformBuffer, 1, terrainStages },
+            // Binding 1 : Height map, or the height texture array of the tiles
+            { 1, vk::DescriptorType::eCombinedImageSampler, 1, terrainStages | vk::ShaderStageFlagBits::eFragment },
             // Binding 3 : Terrain texture array layers
             { 2, vk::DescriptorType::eCombinedImageSampler, 1, vk::ShaderStageFlagBits::eFragment },
         };
@@ -304,6 +675,8 @@ public:
         descriptorSets.terrain = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.terrain })[0];
         // Skysphere
         descriptorSets.skysphere = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.skysphere })[0];
+        // Quadtree terrain
+        descriptorSets.tiles = device.allocateDescriptorSets({ descriptorPool, 1, &descriptorSetLayouts.terrain })[0];
 
         std::vector<vk::WriteDescriptorSet> writeDescriptorSets{
             // Terrain
@@ -319,6 +692,14 @@ public:
             { descriptorSets.skysphere, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.skysphereVertex.descriptor },
             // Binding 1 : Fragment shader color map
             { descriptorSets.skysphere, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &textures.skySphere.descriptor },
+
+            // Quadtree terrain
+            // Binding 0 : Vertex shader ubo
+            { descriptorSets.tiles, 0, 0, 1, vk::DescriptorType::eUniformBuffer, nullptr, &uniformData.terrainTiles.descriptor },
+            // Binding 1 : Heights of the resident tiles
+            { descriptorSets.tiles, 1, 0, 1, vk::DescriptorType::eCombinedImageSampler, &tileHeights.descriptor },
+            // Binding 2 : Color map (alpha channel)
+            { descriptorSets.tiles, 2, 0, 1, vk::DescriptorType::eCombinedImageSampler, &textures.terrainArray.descriptor },
         };
         device.updateDescriptorSets(writeDescriptorSets, nullptr);
     }
@@ -356,6 +737,29 @@ public:
         builder.loadShader(getAssetPath() + "shaders/terraintessellation/skysphere.vert.spv", vk::ShaderStageFlagBits::eVertex);
         builder.loadShader(getAssetPath() + "shaders/terraintessellation/skysphere.frag.spv", vk::ShaderStageFlagBits::eFragment);
         pipelines.skysphere = builder.create(context.pipelineCache);
+
+        // Quadtree terrain pipeline, an instance of the tile grid per selected tile
+        vks::pipelines::GraphicsPipelineBuilder tileBuilder{ device, pipelineLayouts.terrain, renderPass };
+        // The skirts face both ways
+        tileBuilder.rasterizationState.cullMode = vk::CullModeFlagBits::eNone;
+        tileBuilder.dynamicState.dynamicStateEnables.push_back(vk::DynamicState::eLineWidth);
+        tileBuilder.vertexInputState.bindingDescriptions = {
+            { 0, sizeof(glm::vec3), vk::VertexInputRate::eVertex },
+            { 1, sizeof(TileInstance), vk::VertexInputRate::eInstance },
+        };
+        tileBuilder.vertexInputState.attributeDescriptions = {
+            // Location 0 : Grid position and skirt flag
+            { 0, 0, vk::Format::eR32G32B32Sfloat, 0 },
+            // Location 1 : Tile offset, size and layer
+            { 1, 1, vk::Format::eR32G32B32A32Sfloat, offsetof(TileInstance, offsetSize) },
+            // Location 2 : Morph distances
+            { 2, 1, vk::Format::eR32G32Sfloat, offsetof(TileInstance, morph) },
+        };
+        tileBuilder.loadShader(getAssetPath() + "shaders/terraintessellation/tile.vert.spv", vk::ShaderStageFlagBits::eVertex);
+        tileBuilder.loadShader(getAssetPath() + "shaders/terraintessellation/tile.frag.spv", vk::ShaderStageFlagBits::eFragment);
+        pipelines.tiles = tileBuilder.create(context.pipelineCache);
+        tileBuilder.rasterizationState.polygonMode = vk::PolygonMode::eLine;
+        pipelines.tilesWireframe = tileBuilder.create(context.pipelineCache);
     }
 
     // Prepare and initialize uniform buffer containing shader uniforms
@@ -363,6 +767,7 @@ public:
         // Shared tessellation shader stages uniform buffer
         uniformData.terrainTessellation = context.createUniformBuffer(uboTess);
         uniformData.skysphereVertex = context.createUniformBuffer(uboVS);
+        uniformData.terrainTiles = context.createUniformBuffer(uboTiles);
         updateUniformBuffers();
     }
 
@@ -375,6 +780,7 @@ public:
         uboTess.viewportDim = glm::vec2((float)size.width, (float)size.height);
         frustum.update(uboTess.projection * uboTess.modelview);
         memcpy(uboTess.frustumPlanes, frustum.planes.data(), sizeof(glm::vec4) * 6);
+        cullPatches();
 
         float savedFactor = uboTess.tessellationFactor;
         if (!tessellation) {
@@ -389,11 +795,30 @@ public:
         // Skysphere vertex shader
         uboVS.mvp = camera.matrices.perspective * glm::mat4(glm::mat3(camera.matrices.view));
         uniformData.skysphereVertex.copy(uboVS);
+
+        // Quadtree terrain
+        uboTiles.projection = uboTess.projection;
+        uboTiles.modelview = uboTess.modelview;
+        uboTiles.eye = glm::vec4(glm::vec3(glm::inverse(camera.matrices.view)[3]), 1.0f);
+        uboTiles.origin = glm::vec2(-63.0f);
+        uboTiles.size = quadtree.size();
+        uboTiles.heightScale = uboTess.displacementFactor;
+        uboTiles.tileSize = (float)quadtree.tileSize();
+        uniformData.terrainTiles.copy(uboTiles);
     }
 
     void draw() {
         ExampleBase::prepareFrame();
 
+        // Runs every frame, as the streamed tiles arrive while the view stands still
+        if (quadtreeTerrain) {
+            const auto& fence = swapChain.images[currentBuffer].fence;
+            if (fence) {
+                device.waitForFences(fence, VK_TRUE, UINT64_MAX);
+            }
+            updateTerrainTiles(currentBuffer);
+        }
+
         drawCurrentCommandBuffer();
         if (deviceFeatures.pipelineStatisticsQuery) {
             getQueryResults();
@@ -405,6 +830,7 @@ public:
     void prepare() override {
         ExampleBase::prepare();
         generateTerrain();
+        prepareTerrainTiles();
         if (deviceFeatures.pipelineStatisticsQuery) {
             setupQueryResultBuffer();
         }
@@ -417,6 +843,14 @@ public:
         prepared = true;
     }
 
+    void buildCommandBuffers() override {
+        // The number of swap chain images may change with the window size
+        if (tileCache.slotCount() > 0) {
+            prepareTileRing();
+        }
+        ExampleBase::buildCommandBuffers();
+    }
+
     void viewChanged() override { updateUniformBuffers(); }
 
     void OnUpdateUIOverlay() override {
@@ -427,12 +861,33 @@ public:
             if (ui.inputFloat("Factor", &uboTess.tessellationFactor, 0.05f, 2)) {
                 updateUniformBuffers();
             }
+            if (ui.checkBox("Quadtree terrain", &quadtreeTerrain)) {
+                buildCommandBuffers();
+            }
+            if (quadtreeTerrain) {
+                ui.inputFloat("Pixel error", &tileView.maxPixelError, 0.5f, 1);
+                tileView.maxPixelError = std::max(tileView.maxPixelError, 0.5f);
+            } else if (ui.checkBox("CPU patch culling", &cpuCulling)) {
+                cullPatches();
+            }
             if (deviceFeatures.fillModeNonSolid) {
                 if (ui.checkBox("Wireframe", &wireframe)) {
                     buildCommandBuffers();
                 }
             }
         }
+        if (ui.header("Statistics")) {
+            if (quadtreeTerrain) {
+                const auto cacheStatistics = tileCache.statistics();
+                ui.text("Tiles: %u, deepest level: %u of %u", static_cast<uint32_t>(selectedTiles.size()), tileStatistics.maxLevel, quadtree.levels() - 1);
+                ui.text("Resident: %u of %u, loading: %u", cacheStatistics.resident, tileCache.slotCount(), cacheStatistics.pending);
+                ui.text("Loaded: %u, evicted: %u", cacheStatistics.loaded, cacheStatistics.evicted);
+                ui.text("LOD selection: %.3f ms", tileStatistics.milliseconds);
+            } else {
+                ui.text("Patches: %u, visible: %u", static_cast<uint32_t>(patchIndices.size() / 4), cullStatistics.visible);
+                ui.text("CPU culling (%u threads): %.3f ms", threadPool.size(), cullStatistics.milliseconds);
+            }
+        }
         if (deviceFeatures.pipelineStatisticsQuery) {
             if (ui.header("Pipeline statistics")) {
                 ui.text("VS invocations: %d", pipelineStats[0]);
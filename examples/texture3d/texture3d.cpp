@@ -7,8 +7,7 @@
 */
 
 #include "vulkanExampleBase.h"
-#include <numeric>
-#include <future>
+#include <noise.hpp>
 
 // Vertex layout for this example
 struct Vertex {
@@ -17,102 +16,6 @@ struct Vertex {
     float normal[3];
 };
 
-// Translation of Ken Perlin's JAVA implementation (http://mrl.nyu.edu/~perlin/noise/)
-template <typename T>
-class PerlinNoise {
-private:
-    uint32_t permutations[512];
-    static T fade(T t) { return t * t * t * (t * (t * (T)6 - (T)15) + (T)10); }
-    static T lerp(T t, T a, T b) { return a + t * (b - a); }
-    static T grad(int hash, T x, T y, T z) {
-        // Convert LO 4 bits of hash code into 12 gradient directions
-        int h = hash & 15;
-        T u = h < 8 ? x : y;
-        T v = h < 4 ? y : h == 12 || h == 14 ? x : z;
-        return ((h & 1) == 0 ? u : -u) + ((h & 2) == 0 ? v : -v);
-    }
-
-public:
-    PerlinNoise() {
-        // Generate random lookup for permutations containing all numbers from 0..255
-        std::vector<uint8_t> plookup;
-        plookup.resize(256);
-        std::iota(plookup.begin(), plookup.end(), 0);
-        std::default_random_engine rndEngine(std::random_device{}());
-        std::shuffle(plookup.begin(), plookup.end(), rndEngine);
-
-        for (uint32_t i = 0; i < 256; i++) {
-            permutations[i] = permutations[256 + i] = plookup[i];
-        }
-    }
-
-    T noise(T x, T y, T z) {
-        // Find unit cube that contains point
-        int32_t X = (int32_t)floor(x) & 255;
-        int32_t Y = (int32_t)floor(y) & 255;
-        int32_t Z = (int32_t)floor(z) & 255;
-        // Find relative x,y,z of point in cube
-        x -= floor(x);
-        y -= floor(y);
-        z -= floor(z);
-
-        // Compute fade curves for each of x,y,z
-        T u = fade(x);
-        T v = fade(y);
-        T w = fade(z);
-
-        // Hash coordinates of the 8 cube corners
-        uint32_t A = permutations[X] + Y;
-        uint32_t AA = permutations[A] + Z;
-        uint32_t AB = permutations[A + 1] + Z;
-        uint32_t B = permutations[X + 1] + Y;
-        uint32_t BA = permutations[B] + Z;
-        uint32_t BB = permutations[B + 1] + Z;
-
-        // And add blended results for 8 corners of the cube;
-        T res = lerp(w,
-                     lerp(v, lerp(u, grad(permutations[AA], x, y, z), grad(permutations[BA], x - 1, y, z)),
-                          lerp(u, grad(permutations[AB], x, y - 1, z), grad(permutations[BB], x - 1, y - 1, z))),
-                     lerp(v, lerp(u, grad(permutations[AA + 1], x, y, z - 1), grad(permutations[BA + 1], x - 1, y, z - 1)),
-                          lerp(u, grad(permutations[AB + 1], x, y - 1, z - 1), grad(permutations[BB + 1], x - 1, y - 1, z - 1))));
-        return res;
-    }
-};
-
-// Fractal noise generator based on perlin noise above
-template <typename T>
-class FractalNoise {
-private:
-    PerlinNoise<float> perlinNoise;
-    uint32_t octaves;
-    T frequency;
-    T amplitude;
-    T persistence;
-
-public:
-    FractalNoise(const PerlinNoise<T>& perlinNoise) {
-        this->perlinNoise = perlinNoise;
-        octaves = 6;
-        persistence = (T)0.5;
-    }
-
-    T noise(T x, T y, T z) {
-        T sum = 0;
-        T frequency = (T)1;
-        T amplitude = (T)1;
-        T max = (T)0;
-        for (uint32_t i = 0; i < octaves; i++) {
-            sum += perlinNoise.noise(x * frequency, y * frequency, z * frequency) * amplitude;
-            max += amplitude;
-            amplitude *= persistence;
-            frequency *= (T)2;
-        }
-
-        sum = sum / max;
-        return (sum + (T)1.0) / (T)2.0;
-    }
-};
-
 class VulkanExample : public vkx::ExampleBase {
 public:
     // Contains all Vulkan objects that are required to store and use a 3D texture
@@ -122,6 +25,24 @@ public:
 
     bool regenerateNoise = true;
 
+    enum class Generator
+    {
+        cpuScalar = 0,
+        cpuSimd = 1,
+        gpu = 2,
+    };
+    Generator generator{ Generator::cpuSimd };
+    vkx::noise::Parameters noiseParameters;
+    vkx::noise::ComputeGenerator computeGenerator{ context };
+    vkx::ThreadPool threadPool;
+    uint64_t noiseSeed{ 0 };
+    double generationMilliseconds{ 0.0 };
+    bool benchmarkRequested{ false };
+    // Voxels per second of each generator in the last benchmark, 0 if not run yet
+    std::array<double, 3> benchmarkResults{ { 0.0, 0.0, 0.0 } };
+    vkx::noise::Quality quality;
+    bool qualityCompared{ false };
+
     struct {
         vks::model::Model cube;
     } models;
@@ -159,6 +80,7 @@ public:
         // Clean up used Vulkan resources
         // Note : Inherited destructor cleans up resources stored in base class
 
+        computeGenerator.destroy();
         texture.destroy();
         device.destroy(pipelines.solid);
         device.destroy(pipelineLayout);
@@ -228,55 +150,33 @@ public:
         textureDescriptor.sampler = texture.sampler;
     }
 
-    // Generate randomized noise and upload it to the 3D texture using staging
-    void updateNoiseTexture() {
-        const uint32_t texMemSize = textureSize.width * textureSize.height * textureSize.depth;
-
-        std::vector<uint8_t> data;
-        data.assign(texMemSize, 0);
-
-        // Generate perlin based noise
-        std::cout << "Generating " << textureSize.width << " x " << textureSize.height << " x " << textureSize.depth << " noise texture..." << std::endl;
-
-        auto tStart = std::chrono::high_resolution_clock::now();
-
-        PerlinNoise<float> perlinNoise;
-        FractalNoise<float> fractalNoise(perlinNoise);
-
-        std::default_random_engine rndEngine(std::random_device{}());
-        const int32_t noiseType = rand() % 2;
-        const float noiseScale = static_cast<float>(rand() % 10) + 4.0f;
-
-#pragma omp parallel for
-        for (int32_t z = 0; z < textureSize.depth; z++) {
-            auto zoffset = z * textureSize.width * textureSize.height;
-            for (uint32_t y = 0; y < textureSize.height; y++) {
-                auto yoffset = y * textureSize.width;
-                for (uint32_t x = 0; x < textureSize.width; x++) {
-                    float nx = (float)x / (float)textureSize.width;
-                    float ny = (float)y / (float)textureSize.height;
-                    float nz = (float)z / (float)textureSize.depth;
-#define FRACTAL
-#ifdef FRACTAL
-                    float n = fractalNoise.noise(nx * noiseScale, ny * noiseScale, nz * noiseScale);
-#else
-                    float n = 20.0 * perlinNoise.noise(nx, ny, nz);
-#endif
-                    n = n - floor(n);
-
-                    data[x + yoffset + zoffset] = static_cast<uint8_t>(floor(n * 255));
-                }
-            }
+    const char* generatorName(Generator type) const {
+        switch (type) {
+            case Generator::cpuScalar:
+                return "CPU scalar";
+            case Generator::cpuSimd:
+                return vkx::simd::best() == vkx::simd::Backend::avx2 ? "CPU AVX2" : vkx::simd::best() == vkx::simd::Backend::neon ? "CPU NEON" : "CPU";
+            case Generator::gpu:
+                return "GPU compute";
         }
+        return "";
+    }
 
-        auto tEnd = std::chrono::high_resolution_clock::now();
-        auto tDiff = std::chrono::duration<double, std::milli>(tEnd - tStart).count();
-
-        std::cout << "Done in " << tDiff << "ms" << std::endl;
+    // Fill the 3D texture with the current noise, returns the time taken in ms
+    double generateNoise(Generator type) {
+        const vkx::noise::Tables tables(noiseSeed);
+        if (type == Generator::gpu) {
+            return computeGenerator.generate(tables, noiseParameters, textureSize, texture.image);
+        }
 
-        // Create a host-visible staging buffer that contains the raw image data
-        // Copy texture data into staging buffer
-        vks::Buffer stagingBuffer = context.createStagingBuffer(data);
+        auto tStart = std::chrono::high_resolution_clock::now();
+        // The noise is written straight into the mapped staging buffer
+        const vk::DeviceSize texMemSize = textureSize.width * textureSize.height * textureSize.depth;
+        vks::Buffer stagingBuffer = context.createStagingBuffer(texMemSize);
+        const vkx::simd::Backend backend = type == Generator::cpuScalar ? vkx::simd::Backend::scalar : vkx::simd::best();
+        vkx::noise::generate(tables, noiseParameters, textureSize.width, textureSize.height, textureSize.depth, threadPool, backend,
+                             stagingBuffer.map<uint8_t>());
+        stagingBuffer.unmap();
 
         context.withPrimaryCommandBuffer([&](const vk::CommandBuffer& copyCmd) {
             // Image barrier for optimal image
@@ -301,9 +201,37 @@ public:
 
         // Clean up staging resources
         stagingBuffer.destroy();
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - tStart).count();
+    }
+
+    // Generate randomized noise and upload it to the 3D texture
+    void updateNoiseTexture() {
+        std::cout << "Generating " << textureSize.width << " x " << textureSize.height << " x " << textureSize.depth << " noise texture..." << std::endl;
+        noiseSeed = (static_cast<uint64_t>(rand()) << 32) | static_cast<uint64_t>(rand());
+        noiseParameters.scale = static_cast<float>(rand() % 10) + 4.0f;
+        qualityCompared = false;
+
+        // The texture may still be in use by the last frame
+        queue.waitIdle();
+        generationMilliseconds = generateNoise(generator);
+        std::cout << "Done in " << generationMilliseconds << "ms (" << generatorName(generator) << ")" << std::endl;
         regenerateNoise = false;
     }
 
+    // Generate the current noise with every generator and measure their throughput, ending with the selected one
+    void benchmarkNoise() {
+        const double voxels = static_cast<double>(textureSize.width) * textureSize.height * textureSize.depth;
+        queue.waitIdle();
+        for (uint32_t i = 0; i < benchmarkResults.size(); ++i) {
+            const Generator type = static_cast<Generator>((static_cast<uint32_t>(generator) + 1 + i) % benchmarkResults.size());
+            const double milliseconds = generateNoise(type);
+            benchmarkResults[static_cast<uint32_t>(type)] = voxels / (milliseconds / 1000.0);
+            std::cout << generatorName(type) << ": " << milliseconds << " ms, " << benchmarkResults[static_cast<uint32_t>(type)] / 1.0e6 << " Mvoxels/s"
+                      << std::endl;
+        }
+        benchmarkRequested = false;
+    }
+
     void updateDrawCommandBuffer(const vk::CommandBuffer& drawCmdBuffer) override {
         vk::Viewport viewport;
         viewport.width = (float)size.width;
@@ -424,6 +352,7 @@ public:
         generateQuad();
         prepareUniformBuffers();
         prepareNoiseTexture(256, 256, 256);
+        computeGenerator.create();
         setupDescriptorSetLayout();
         preparePipelines();
         setupDescriptorPool();
@@ -439,6 +368,9 @@ public:
         if (regenerateNoise) {
             updateNoiseTexture();
         }
+        if (benchmarkRequested) {
+            benchmarkNoise();
+        }
         if (!paused) {
             updateUniformBuffers(false);
         }
@@ -448,12 +380,49 @@ public:
 
     void OnUpdateUIOverlay() override {
         if (ui.header("Settings")) {
-            if (regenerateNoise) {
+            if (regenerateNoise || benchmarkRequested) {
                 ui.text("Generating new noise texture...");
             } else {
+                int32_t generatorIndex = static_cast<int32_t>(generator);
+                const std::vector<std::string> generatorNames{
+                    generatorName(Generator::cpuScalar),
+                    generatorName(Generator::cpuSimd),
+                    generatorName(Generator::gpu),
+                };
+                if (ui.comboBox("Generator", &generatorIndex, generatorNames)) {
+                    generator = static_cast<Generator>(generatorIndex);
+                }
+                int32_t typeIndex = static_cast<int32_t>(noiseParameters.type);
+                if (ui.comboBox("Noise", &typeIndex, { "Perlin", "Simplex" })) {
+                    noiseParameters.type = static_cast<vkx::noise::Type>(typeIndex);
+                    regenerateNoise = true;
+                }
                 if (ui.button("Generate new texture")) {
                     regenerateNoise = true;
                 }
+                if (ui.button("Benchmark generators")) {
+                    benchmarkRequested = true;
+                }
+                if (ui.button("Compare with scalar reference")) {
+                    quality = vkx::noise::compareWithReference(vkx::noise::Tables(noiseSeed), noiseParameters, textureSize.width, textureSize.height,
+                                                               textureSize.depth, threadPool, vkx::simd::best());
+                    qualityCompared = true;
+                }
+            }
+        }
+        if (ui.header("Statistics")) {
+            const double voxels = static_cast<double>(textureSize.width) * textureSize.height * textureSize.depth;
+            ui.text("%s: %.1f ms, %.1f Mvoxels/s", generatorName(generator), generationMilliseconds, voxels / generationMilliseconds / 1000.0);
+            ui.text("CPU threads: %u", threadPool.size());
+            for (uint32_t i = 0; i < benchmarkResults.size(); ++i) {
+                if (benchmarkResults[i] > 0.0) {
+                    ui.text("%s: %.1f Mvoxels/s", generatorName(static_cast<Generator>(i)), benchmarkResults[i] / 1.0e6);
+                }
+            }
+            if (qualityCompared) {
+                ui.text("Perlin %s vs reference: %s, max %u ulps / %.2e", generatorName(Generator::cpuSimd), quality.values.passed() ? "match" : "MISMATCH",
+                        quality.values.maxUlps, quality.values.maxAbsolute);
+                ui.text("%zu of %zu voxels differ, by up to %u", quality.bytesDiffering, quality.bytesCompared, quality.maxByteDifference);
             }
         }
     }